@@ -7,10 +7,32 @@ enum PolyFlags : unsigned char
     Liquid = 1 << 2,
     Wmo = 1 << 3,
     Doodad = 1 << 4,
+
+    // only used for the polygons of off-mesh connections
+    OffMesh = 1 << 5,
 };
 
 #include <cstdint>
 
+// how the contents of a nav file are compressed on disk.  uncompressed files
+// are memory mapped when loaded, while compressed ones are inflated into
+// memory.  new methods must be appended, as the value is stored in the file
+enum class NavCompression : std::uint32_t
+{
+    None = 0,
+    Zlib = 1,
+};
+
+// the kinds of liquid, as told apart by the ADT liquid data.  new kinds must
+// be appended, as the value is stored in nav files
+enum class LiquidType : std::uint8_t
+{
+    Water = 0,
+    Ocean = 1,
+    Magma = 2,
+    Slime = 3,
+};
+
 // WARNING!!!  If these values are changed, existing data must be regenerated.
 // It is assumed that the client and generator values match EXACTLY!
 
@@ -23,6 +45,8 @@ struct MeshSettings
         112; // number of voxel rows and columns per tile
 
     static constexpr float CellHeight = 0.25f;
+
+    // the size of the agent of AgentSize::Default.  see AgentProfiles
     static constexpr float WalkableHeight =
         1.6f; // agent height in world units (yards)
     static constexpr float WalkableRadius =
@@ -46,12 +70,105 @@ struct MeshSettings
     static constexpr int VerticesPerPolygon = 6;
 
     static constexpr std::uint32_t FileSignature = 'NNAV';
-    static constexpr std::uint32_t FileVersion = '0006';
+    static constexpr std::uint32_t FileVersion = '0010';
+
+    // the oldest nav file layout which the pathfind library still reads.
+    // files from '0010' on follow the tile count in the header with a uint32
+    // of NavFileFlags and the offset of the first tile as a uint32, so that
+    // later versions may append to the header without breaking older readers.
+    // the first to be appended is the AgentSize of the tiles as a uint32,
+    // without which they are of AgentSize::Default, and the second their
+    // RegionPartition as a uint32, without which they are of
+    // RegionPartition::Watershed
+    static constexpr std::uint32_t MinFileVersion = '0009';
     static constexpr std::uint32_t FileADT = 'ADT\0';
     static constexpr std::uint32_t FileWMO = 'WMO\0';
-    static constexpr std::uint32_t FileMap = 'MAP1';
+    static constexpr std::uint32_t FileMap = 'MAP2';
+    static constexpr std::uint32_t FilePortals = 'PRTL';
+
+    // a compressed nav file begins with this, its NavCompression, and the
+    // inflated length of its contents as a uint64, followed by the contents
+    static constexpr std::uint32_t FileCompressed = 'NCMP';
     static constexpr std::uint32_t WMOcoordinate = 0xFFFFFFFF;
 
+    // a pack of BVH files begins with this, FileVersion and the number of
+    // files as a uint32, then for each file, sorted by name, a
+    // BVHPackEntry.  the names and contents follow
+    static constexpr std::uint32_t FileBVHPack = 'BVHP';
+
+    // a game object spawn file begins with this, the version of its layout
+    // (which is independent of FileVersion) and the number of spawns as
+    // uint32s, then the GameObjectSpawns, sorted by map and
+    // then guid.  see pathfind::GameObjectFile
+    static constexpr std::uint32_t FileGameObjects = 'GOBJ';
+
+    // the capabilities of a nav file which a reader must understand.  a file
+    // with a flag not listed in FileFlags is rejected rather than misread
+    enum NavFileFlags : std::uint32_t
+    {
+        // each tile is preceded by its length in bytes as a uint32, and a
+        // reader skips whatever follows the mesh up to that length
+        NavFileTileSizes = 1 << 0,
+
+        // the mesh of each tile with quad heights is followed by the lowest
+        // z of static WMO geometry over each of WmoFloorCells by
+        // WmoFloorCells cells of the tile, as floats, or FLT_MAX where there
+        // is none.  see Map::ZoneAndArea()
+        NavFileWmoFloors = 1 << 1,
+
+        // the WMO floors are followed by the number of model surfaces in the
+        // tile's height field as a uint32.  unless it is zero, width * height
+        // + 1 uint32s follow, where column i has the surfaces from the i-th
+        // to before the next, then the surfaces as uint16 heights in units of
+        // the height field's ch above its bmin, highest first.  see
+        // Map::FindHeights()
+        NavFileSurfaces = 1 << 2,
+
+        // the cs and ch of each tile's height field are followed by the
+        // length in bytes of its spans as a uint32, so that a reader which
+        // does not load the height field may skip them without walking
+        // every column
+        NavFileSpanLengths = 1 << 3,
+
+        // the surfaces of each tile with quad heights are followed by the
+        // number of meshes of the tile built for agents other than that of
+        // the file, as a uint32, then for each its AgentSize and length in
+        // bytes as uint32s and the mesh, padded as the tile's own mesh is.
+        // see MeshBuilder::AddAgentSize()
+        NavFileAgentMeshes = 1 << 4,
+
+        // the agent meshes are followed by the number of liquid surfaces
+        // over the LiquidCells by LiquidCells cells of the tile as a uint32.
+        // unless it is zero, LiquidCells * LiquidCells + 1 uint32s follow,
+        // where cell i has the surfaces from the i-th to before the next,
+        // then the heights of the surfaces at the centre of their cells as
+        // floats, highest first, then their LiquidTypes as uint8s.  see
+        // Map::GetLiquidLevel()
+        NavFileLiquids = 1 << 5,
+
+        // a height field whose spans are zero bytes long was left out by the
+        // builder, which keeps only those of tiles near game objects (see
+        // MeshBuilder::OmitHeightFields()).  its width, height and bounds
+        // remain, but its tile cannot be rebuilt beneath temporary obstacles
+        NavFileOmittedSpans = 1 << 6,
+    };
+
+    // the flags which this build reads, and sets on the files it writes
+    static constexpr std::uint32_t FileFlags =
+        NavFileTileSizes | NavFileWmoFloors | NavFileSurfaces |
+        NavFileSpanLengths | NavFileAgentMeshes | NavFileLiquids |
+        NavFileOmittedSpans;
+
+    static constexpr int WmoFloorCells = 8;
+
+    // each quad of ADT liquid is two by two cells
+    static constexpr int LiquidCells = 16 / TilesPerChunk;
+
+    // nav files are stored uncompressed and memory mapped when loaded.  the
+    // finalized mesh of each tile is padded to begin at a multiple of this,
+    // so that detour can use it directly from the mapping.
+    static constexpr int TileDataAlignment = 4;
+
     // Nothing below here should ever have to change
 
     static constexpr int Adts = 64;
@@ -90,6 +207,148 @@ struct MeshSettings
     static_assert(CellSize > 0.f, "CellSize must be positive");
 };
 
+// how the walkable area of each tile is divided into the regions from which
+// its polygons are made.  the partition is recorded in the header of each nav
+// file, after the agent size, so that tiles rebuilt beneath temporary
+// obstacles are divided as they were built.  new methods must be appended,
+// as the value is stored in the file
+enum class RegionPartition : std::uint32_t
+{
+    // a distance field, flooded outwards from its peaks.  this makes the
+    // best shaped polygons, but is by far the slowest stage of a dense tile
+    Watershed = 0,
+
+    // strips swept along each row and merged with those of the row before.
+    // the fastest, but makes long thin polygons, which lengthen paths a
+    // little and make more of them
+    Monotone = 1,
+
+    // as monotone, within each layer of spans which do not overlap, which
+    // makes better polygons for little more time
+    Layers = 2,
+};
+
+inline constexpr std::uint32_t RegionPartitionCount = 3;
+
+// the agents for which a map may be built.  the grid of tiles and voxels is
+// the same for all of them, so that one build of the pathfind library serves
+// maps built for any agent size, and only the body of the agent differs.
+// the size is recorded in the header of each nav file.  new sizes must be
+// appended, as the value is stored in the file
+enum class AgentSize : std::uint32_t
+{
+    // the size of a humanoid, from MeshSettings
+    Default = 0,
+
+    // creatures lower than a humanoid, which fit beneath its overhangs
+    Small = 1,
+
+    // mounts and large creatures, which need wider passages
+    Large = 2,
+};
+
+struct AgentProfile
+{
+    AgentSize m_size;
+    const char* m_name;
+
+    // as MeshSettings::WalkableHeight, WalkableRadius and WalkableClimb
+    float m_walkableHeight;
+    float m_walkableRadius;
+    float m_walkableClimb;
+
+    constexpr int VoxelWalkableRadius() const
+    {
+        return static_cast<int>(m_walkableRadius / MeshSettings::CellSize);
+    }
+    constexpr int VoxelWalkableHeight() const
+    {
+        return static_cast<int>(m_walkableHeight / MeshSettings::CellHeight);
+    }
+    constexpr int VoxelWalkableClimb() const
+    {
+        return static_cast<int>(m_walkableClimb / MeshSettings::CellHeight);
+    }
+};
+
+// indexed by AgentSize
+inline constexpr AgentProfile AgentProfiles[] = {
+    {AgentSize::Default, "default", MeshSettings::WalkableHeight,
+     MeshSettings::WalkableRadius, MeshSettings::WalkableClimb},
+    {AgentSize::Small, "small", 1.f, MeshSettings::WalkableRadius, 0.75f},
+    {AgentSize::Large, "large", 3.f, 1.f, MeshSettings::WalkableClimb},
+};
+
+inline constexpr std::uint32_t AgentProfileCount =
+    sizeof(AgentProfiles) / sizeof(AgentProfiles[0]);
+
+// the size must be fewer than AgentProfileCount
+constexpr const AgentProfile& GetAgentProfile(AgentSize size)
+{
+    return AgentProfiles[static_cast<std::uint32_t>(size)];
+}
+
+// portals are joined across tiles within MeshSettings::WalkableClimb of each
+// other's height, whatever the size of the agent, so no agent may climb more
+constexpr bool ValidAgentProfiles()
+{
+    for (auto i = 0u; i < AgentProfileCount; ++i)
+    {
+        auto const& profile = AgentProfiles[i];
+
+        if (static_cast<std::uint32_t>(profile.m_size) != i ||
+            profile.VoxelWalkableRadius() <= 0 ||
+            profile.VoxelWalkableHeight() < 0 ||
+            profile.VoxelWalkableClimb() < 0 ||
+            profile.m_walkableClimb > MeshSettings::WalkableClimb)
+            return false;
+    }
+
+    return true;
+}
+
+static_assert(ValidAgentProfiles(),
+              "Agent profiles must be in order and of valid sizes");
+
+// a link between two points of the navmesh that cannot be walked, such as an
+// elevator, a teleporter or a ledge which may only be jumped down.  it is
+// built into the tile containing its start, and detour only links its end to
+// that tile or one of its eight neighbours.  positions are in world space.
+struct OffMeshConnection
+{
+    float m_start[3];
+    float m_end[3];
+    float m_radius;
+    bool m_bidirectional;
+
+    // those built by MapBuilder have id zero
+    std::uint32_t m_id;
+};
+
+// a game object as read from the rows of a CSV file of spawns, which hold
+// these fields in order.  the rotation is a quaternion.  packed, as it is
+// stored so in spawn files, which are used straight from their mapping
+#pragma pack(push, 1)
+struct GameObjectSpawn
+{
+    std::uint64_t m_guid;
+    std::uint32_t m_displayId;
+    std::uint32_t m_map;
+    float m_position[3];
+    float m_rotation[4];
+};
+#pragma pack(pop)
+
+// where a file is in a pack of BVH files.  offsets are from the start of the
+// pack, and the contents of each file begin on an eight byte boundary
+struct BVHPackEntry
+{
+    std::uint64_t m_offset;
+    std::uint64_t m_size;
+    std::uint32_t m_nameOffset;
+    std::uint32_t m_nameLength;
+};
+
 enum class Result {
     SUCCESS = 0,
     UNRECOGNIZED_EXTENSION = 1,
@@ -170,6 +429,9 @@ enum class Result {
     TEMPORARY_WMO_OBSTACLES_ARE_NOT_SUPPORTED = 60,
     NO_DOODAD_SET_SPECIFIED_FOR_WMO_GAME_OBJECT = 61,
 
+    // these two are no longer thrown, as math::Matrix is always 4x4.  they
+    // are reserved, so that no other error takes a value which callers of
+    // the C API may still test for
     BAD_MATRIX_ROW = 62,
     INVALID_MATRIX_MULTIPLICATION = 63,
     ONLY_4X4_MATRIX_IS_SUPPORTED = 64,
@@ -205,5 +467,48 @@ enum class Result {
 
     FAILED_TO_FIND_POINT_BETWEEN_VECTORS = 89,
 
+    FAILED_TO_MAP_FILE = 90,
+
+    PATH_REQUEST_NOT_FINISHED = 91,
+
+    UNKNOWN_QUERY_FILTER = 92,
+
+    INVALID_DOODAD_SET_FOR_WMO_GAME_OBJECT = 93,
+
+    FAILED_TO_OPEN_OFF_MESH_CONNECTION_FILE = 94,
+    BAD_FORMAT_OF_OFF_MESH_CONNECTION_FILE = 95,
+
+    DTPATHCORRIDOR_INIT_FAILED = 96,
+    DTCROWD_INIT_FAILED = 97,
+
+    INVALID_SHARD = 98,
+
+    UNKNOWN_NAV_COMPRESSION = 99,
+
+    UNKNOWN_JOB = 100,
+
+    INVALID_QUERY_RECORDING = 101,
+
+    BUILD_ALREADY_STARTED = 102,
+
+    ALLOCATOR_ALREADY_INSTALLED = 103,
+
+    NO_POLYGON_NEAR_POSITION = 104,
+
+    UNKNOWN_AGENT_SIZE = 105,
+    AGENT_SIZE_MISMATCH = 106,
+
+    // C API
+    UNKNOWN_LIQUID_LEVEL = 107,
+
+    UNKNOWN_REGION_PARTITION = 108,
+    REGION_PARTITION_MISMATCH = 109,
+
+    ADT_LOAD_CANCELLED = 110,
+
+    TILE_HAS_NO_HEIGHT_FIELD = 111,
+
+    INVALID_QUERY_LIMITS = 112,
+
     UNKNOWN_EXCEPTION = 0xFF,
 };
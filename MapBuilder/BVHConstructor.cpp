@@ -1,19 +1,48 @@
 #include "BVHConstructor.hpp"
 
+#include "Common.hpp"
 #include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
 #include "utility/PicoSHA2/picosha2.h"
 
+#include <algorithm>
+#include <fstream>
 #include <iomanip>
+#include <iterator>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+bool BVHConstructor::PackFiles = false;
+bool BVHConstructor::ShareFiles = false;
+
+void BVHConstructor::SetPackFiles(bool pack)
+{
+    PackFiles = pack;
+}
+
+void BVHConstructor::SetShareFiles(bool share)
+{
+    ShareFiles = share;
+}
+
 BVHConstructor::BVHConstructor(const fs::path& outputPath)
     : m_outputPath(outputPath), m_shutdown(false)
 {
-    auto const index_file = m_outputPath / "BVH" / "bvh.idx";
+    LoadIndex(m_outputPath);
+}
+
+BVHConstructor::~BVHConstructor()
+{
+    if (!m_shutdown)
+        Shutdown();
+}
+
+void BVHConstructor::LoadIndex(const fs::path& outputPath)
+{
+    auto const index_file = outputPath / "BVH" / "bvh.idx";
     if (!fs::is_regular_file(index_file))
         return;
 
@@ -48,19 +77,8 @@ BVHConstructor::BVHConstructor(const fs::path& outputPath)
     }
 }
 
-BVHConstructor::~BVHConstructor()
+std::string BVHConstructor::FileName(const fs::path& mpq_path)
 {
-    if (!m_shutdown)
-        Shutdown();
-}
-
-fs::path BVHConstructor::InternalAddFile(const fs::path& mpq_path)
-{
-    auto const it = m_files.find(mpq_path.string());
-
-    if (it != m_files.end())
-        return it->second;
-
     auto const extension = mpq_path.extension().string();
 
     std::string kind;
@@ -86,7 +104,14 @@ fs::path BVHConstructor::InternalAddFile(const fs::path& mpq_path)
     for (auto const c : hash)
         str << std::hex << std::setw(2) << std::setfill('0') << (int)c;
 
-    return m_files[mpq_path.string()] = kind + "_" + str.str() + ".bvh";
+    return kind + "_" + str.str() + ".bvh";
+}
+
+fs::path BVHConstructor::InternalAddFile(const fs::path& mpq_path)
+{
+    // the index of an earlier build may have pointed the model at a file it
+    // shared, which must not be written in place of the model's own
+    return m_files[mpq_path.string()] = FileName(mpq_path);
 }
 
 fs::path BVHConstructor::AddFile(const fs::path& mpq_path)
@@ -103,6 +128,156 @@ fs::path BVHConstructor::AddTemporaryObstacle(std::uint32_t id,
            (m_temporaryObstacles[id] = InternalAddFile(mpq_path).string());
 }
 
+bool BVHConstructor::ClaimFile(const fs::path& mpq_path, fs::path& path)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto const file = InternalAddFile(mpq_path);
+    path = m_outputPath / "BVH" / file;
+
+    return m_claimed.insert(file.string()).second;
+}
+
+void BVHConstructor::Merge(const fs::path& outputPath)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    LoadIndex(outputPath);
+
+    // the names of the files are derived from the paths of the models, so
+    // two outputs never disagree about what a file contains
+    for (auto const& entry : fs::directory_iterator(outputPath / "BVH"))
+        if (entry.is_regular_file() && entry.path().extension() == ".bvh")
+            fs::copy_file(entry.path(),
+                          m_outputPath / "BVH" / entry.path().filename(),
+                          fs::copy_options::skip_existing);
+}
+
+void BVHConstructor::WritePack(const std::vector<std::string>& files) const
+{
+    auto const bvhPath = m_outputPath / "BVH";
+
+    std::vector<BVHPackEntry> entries(files.size());
+
+    // the table, followed by the names
+    std::uint64_t offset =
+        3 * sizeof(std::uint32_t) + entries.size() * sizeof(BVHPackEntry);
+
+    for (auto i = 0u; i < files.size(); ++i)
+    {
+        entries[i].m_nameOffset = static_cast<std::uint32_t>(offset);
+        entries[i].m_nameLength = static_cast<std::uint32_t>(files[i].length());
+        offset += files[i].length();
+    }
+
+    for (auto i = 0u; i < files.size(); ++i)
+    {
+        offset = (offset + 7) & ~static_cast<std::uint64_t>(7);
+
+        entries[i].m_offset = offset;
+        entries[i].m_size = fs::file_size(bvhPath / files[i]);
+        offset += entries[i].m_size;
+    }
+
+    // written beside the pack and renamed over it once complete, so that a
+    // reader never sees one half written
+    auto const packFile = bvhPath / "bvh.pack";
+    auto tempFile = packFile;
+    tempFile += ".tmp";
+
+    {
+        std::ofstream o(tempFile, std::ofstream::binary | std::ofstream::trunc);
+
+        auto const count = static_cast<std::uint32_t>(entries.size());
+
+        o.write(reinterpret_cast<const char*>(&MeshSettings::FileBVHPack),
+                sizeof(MeshSettings::FileBVHPack));
+        o.write(reinterpret_cast<const char*>(&MeshSettings::FileVersion),
+                sizeof(MeshSettings::FileVersion));
+        o.write(reinterpret_cast<const char*>(&count), sizeof(count));
+
+        if (!entries.empty())
+            o.write(reinterpret_cast<const char*>(&entries[0]),
+                    entries.size() * sizeof(BVHPackEntry));
+
+        for (auto const& file : files)
+            o.write(file.c_str(), file.length());
+
+        std::vector<char> contents;
+        for (auto i = 0u; i < files.size(); ++i)
+        {
+            while (static_cast<std::uint64_t>(o.tellp()) < entries[i].m_offset)
+                o.put('\0');
+
+            contents.resize(static_cast<size_t>(entries[i].m_size));
+
+            std::ifstream in(bvhPath / files[i], std::ifstream::binary);
+            if (!contents.empty() && !in.read(&contents[0], contents.size()))
+                THROW(Result::FAILED_TO_OPEN_FILE_FOR_BINARY_STREAM);
+
+            o.write(contents.data(), contents.size());
+        }
+
+        if (!o)
+            THROW(Result::FAILED_TO_OPEN_FILE_FOR_BINARY_STREAM);
+    }
+
+    fs::rename(tempFile, packFile);
+}
+
+void BVHConstructor::ShareIdenticalFiles(
+    std::vector<std::pair<std::string, std::string>>& files,
+    std::vector<std::pair<std::uint32_t, std::string>>& obstacles) const
+{
+    auto const bvhPath = m_outputPath / "BVH";
+
+    // a model whose own file was written by an earlier build is compared by
+    // that file, which may have changed since it was last shared
+    for (auto& entry : files)
+    {
+        auto const own = FileName(entry.first);
+        if (fs::is_regular_file(bvhPath / own))
+            entry.second = own;
+    }
+
+    std::vector<std::string> names;
+    for (auto const& entry : files)
+        names.push_back(entry.second);
+    for (auto const& entry : obstacles)
+        names.push_back(entry.second);
+
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    // the first file by name with each hash of contents, by that hash
+    std::unordered_map<std::string, std::string> byContents;
+
+    // the file with the same contents which each is replaced by
+    std::unordered_map<std::string, std::string> shared;
+
+    std::vector<char> contents;
+    for (auto const& name : names)
+    {
+        std::ifstream in(bvhPath / name, std::ifstream::binary);
+        if (!in)
+            continue;
+
+        contents.assign(std::istreambuf_iterator<char>(in),
+                        std::istreambuf_iterator<char>());
+
+        auto const hash = picosha2::hash256_hex_string(contents);
+        shared[name] = byContents.insert({hash, name}).first->second;
+    }
+
+    for (auto& entry : files)
+        if (auto const i = shared.find(entry.second); i != shared.end())
+            entry.second = i->second;
+
+    for (auto& entry : obstacles)
+        if (auto const i = shared.find(entry.second); i != shared.end())
+            entry.second = i->second;
+}
+
 void BVHConstructor::Shutdown()
 {
     if (m_shutdown)
@@ -118,6 +293,14 @@ void BVHConstructor::Shutdown()
     m_files.clear();
     std::sort(serialized.begin(), serialized.end());
 
+    std::vector<std::pair<std::uint32_t, std::string>> obstacles(
+        m_temporaryObstacles.begin(), m_temporaryObstacles.end());
+    m_temporaryObstacles.clear();
+    std::sort(obstacles.begin(), obstacles.end());
+
+    if (ShareFiles)
+        ShareIdenticalFiles(serialized, obstacles);
+
     out << static_cast<std::uint32_t>(serialized.size()); // entry count
 
     for (auto const& entry : serialized)
@@ -125,11 +308,6 @@ void BVHConstructor::Shutdown()
             << static_cast<std::uint32_t>(entry.second.length())
             << entry.second;
 
-    std::vector<std::pair<std::uint32_t, std::string>> obstacles(
-        m_temporaryObstacles.begin(), m_temporaryObstacles.end());
-    m_temporaryObstacles.clear();
-    std::sort(obstacles.begin(), obstacles.end());
-
     out << static_cast<std::uint32_t>(obstacles.size());
     for (auto const& entry : obstacles)
         out << entry.first << static_cast<std::uint32_t>(entry.second.length())
@@ -139,5 +317,26 @@ void BVHConstructor::Shutdown()
                     std::ofstream::binary | std::ofstream::trunc);
     o << out;
 
+    if (PackFiles)
+    {
+        std::vector<std::string> files;
+        files.reserve(serialized.size());
+
+        // an entry whose file was never written is left for the pathfind
+        // library to report when it is asked for
+        for (auto const& entry : serialized)
+            if (fs::is_regular_file(m_outputPath / "BVH" / entry.second))
+                files.push_back(entry.second);
+
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+
+        WritePack(files);
+    }
+    // a pack left by an earlier build would otherwise go on being used in
+    // place of the files it no longer matches
+    else
+        fs::remove(m_outputPath / "BVH" / "bvh.pack");
+
     m_shutdown = true;
 }
\ No newline at end of file
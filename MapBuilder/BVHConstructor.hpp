@@ -6,6 +6,8 @@
 #include <mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -22,19 +24,67 @@ private:
     // that can be referenced later.  maps to .bvh path.
     std::unordered_map<int, std::string> m_temporaryObstacles;
 
+    // the .bvh files which some thread has undertaken to write during this
+    // build, whether or not it has finished
+    std::unordered_set<std::string> m_claimed;
+
     std::atomic_bool m_shutdown;
 
+    static bool PackFiles;
+    static bool ShareFiles;
+
     std::mutex m_mutex;
 
+    // the name of the model's own file, derived from its path alone
+    static std::string FileName(const fs::path& mpq_path);
+
     // assumes the mutex has already been locked
     fs::path InternalAddFile(const fs::path& mpq_path);
 
+    // adds the entries of the index in the given output directory.  assumes
+    // the mutex has already been locked
+    void LoadIndex(const fs::path& outputPath);
+
+    // copies every file in the index into bvh.pack.  assumes the mutex has
+    // already been locked
+    void WritePack(const std::vector<std::string>& files) const;
+
+    // points the entries of models whose files have identical contents at
+    // the first of those files by name
+    void ShareIdenticalFiles(
+        std::vector<std::pair<std::string, std::string>>& files,
+        std::vector<std::pair<std::uint32_t, std::string>>& obstacles) const;
+
 public:
     BVHConstructor(const fs::path& outputPath);
     ~BVHConstructor();
 
+    // when set, Shutdown() also copies every file into a single pack, which
+    // the pathfind library maps once rather than opening each file.  it
+    // applies to every constructor
+    static void SetPackFiles(bool pack);
+
+    // when set, Shutdown() compares the contents of every file, and the index
+    // gives models with identical collision geometry, such as recolored
+    // doodads, the same file, which the pathfind library then loads once for
+    // all of them.  each model is still written to its own file, so that a
+    // later build which changes one of them does not change the others.  it
+    // applies to every constructor
+    static void SetShareFiles(bool share);
+
     fs::path AddFile(const fs::path& mpq_path);
     fs::path AddTemporaryObstacle(std::uint32_t id, const fs::path& mpq_path);
 
+    // adds the file as AddFile() does, setting path to it, and returns true
+    // only to the first caller to ask for the model, which should then write
+    // it.  the model is given to no other caller, even while the first is
+    // still writing it
+    bool ClaimFile(const fs::path& mpq_path, fs::path& path);
+
+    // adds the files which were written to another output directory, such as
+    // that of one shard of a distributed build, copying those not already
+    // present
+    void Merge(const fs::path& outputPath);
+
     void Shutdown();
 };
\ No newline at end of file
@@ -10,7 +10,9 @@
 #include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
 
+#include <algorithm>
 #include <cstdint>
+#include <iomanip>
 #include <iostream>
 #include <mutex>
 #include <sstream>
@@ -18,38 +20,102 @@
 #include <thread>
 #include <unordered_map>
 
+namespace
+{
+// the size of the model's files.  wmo groups are stored in files of their
+// own beside the root, except in alpha data, where the root holds them
+size_t EstimateCost(const std::string& path, bool isDoodad)
+{
+    auto cost = parser::sMpqManager.FileSize(path);
+
+    if (!isDoodad)
+    {
+        auto const stem = path.substr(0, path.rfind('.'));
+
+        for (auto i = 0;; ++i)
+        {
+            std::stringstream group;
+            group << stem << "_" << std::setfill('0') << std::setw(3) << i
+                  << ".wmo";
+
+            auto const size = parser::sMpqManager.FileSize(group.str());
+
+            if (!size)
+                break;
+
+            cost += size;
+        }
+    }
+
+    // so that every model counts towards the progress
+    return (std::max)(cost, static_cast<size_t>(1));
+}
+} // namespace
+
 namespace parser
 {
 GameObjectBVHBuilder::GameObjectBVHBuilder(const std::filesystem::path& dataPath,
                                            const std::filesystem::path& outputPath,
                                            size_t workers)
     : m_dataPath(dataPath), m_bvhConstructor(outputPath), m_workers(workers),
+      m_totalCost(0), m_remaining(0), m_remainingCost(0),
       m_shutdownRequested(false)
 {
     sMpqManager.Initialize(m_dataPath);
 
     const parser::DBC displayInfo("DBFilesClient\\GameObjectDisplayInfo.dbc");
 
+    auto const rows = displayInfo.GetColumn(0);
+
+    std::vector<Task> tasks;
+
     for (auto i = 0u; i < displayInfo.RecordCount(); ++i)
     {
-        auto const row = displayInfo.GetField(i, 0);
-        auto const path = displayInfo.GetStringField(i, 1);
+        auto const row = rows[i];
+        auto const view = displayInfo.GetStringField(i, 1);
 
-        if (!path.length())
+        if (view.empty())
             continue;
 
+        const std::string path(view);
+
         if (!sMpqManager.FileExists(path))
             continue;
 
-        auto const extension = fs::path(path).extension().string();
+        // the first character of the extension
+        auto const dot = path.rfind('.');
+        auto const type = dot != std::string::npos && dot + 1 < path.length() ?
+                              path[dot + 1] :
+                              '\0';
 
-        if (extension[1] == 'm' || extension[1] == 'M')
-            m_doodads[row] = path;
-        else if (extension[1] == 'w' || extension[1] == 'W')
-            m_wmos[row] = path;
+        bool isDoodad;
+        if (type == 'm' || type == 'M')
+            isDoodad = true;
+        else if (type == 'w' || type == 'W')
+            isDoodad = false;
         else
             THROW(Result::UNRECOGNIZED_EXTENSION);
+
+        tasks.push_back({row, path, isDoodad, EstimateCost(path, isDoodad)});
+        m_totalCost += tasks.back().m_cost;
     }
+
+    // the most costly models are started first, and dealt out in turn, so
+    // that no worker is left serializing a large wmo alone at the end
+    std::sort(tasks.begin(), tasks.end(), [](const Task& a, const Task& b) {
+        return a.m_cost != b.m_cost ? a.m_cost > b.m_cost :
+                                      a.m_entry < b.m_entry;
+    });
+
+    auto const queueCount = (std::max)(m_workers, static_cast<size_t>(1));
+    for (auto i = 0u; i < queueCount; ++i)
+        m_queues.push_back(std::make_unique<WorkQueue>());
+
+    for (auto i = 0u; i < tasks.size(); ++i)
+        m_queues[i % queueCount]->m_tasks.push_back(std::move(tasks[i]));
+
+    m_remaining = tasks.size();
+    m_remainingCost = m_totalCost;
 }
 
 GameObjectBVHBuilder::~GameObjectBVHBuilder()
@@ -61,10 +127,11 @@ void GameObjectBVHBuilder::Begin()
 {
     // if zero or one threads are requested, execute synchronously
     if (m_workers <= 1)
-        Work();
+        Work(0);
     else
         for (auto i = 0u; i < m_workers; ++i)
-            m_threads.push_back(std::thread(&GameObjectBVHBuilder::Work, this));
+            m_threads.push_back(
+                std::thread(&GameObjectBVHBuilder::Work, this, i));
 }
 
 size_t GameObjectBVHBuilder::Shutdown()
@@ -85,87 +152,94 @@ size_t GameObjectBVHBuilder::Shutdown()
     return result;
 }
 
-void GameObjectBVHBuilder::Work()
+float GameObjectBVHBuilder::PercentComplete() const
 {
-    sMpqManager.Initialize(m_dataPath);
+    if (!m_totalCost)
+        return 100.f;
+
+    return 100.f * (float(m_totalCost - m_remainingCost) / float(m_totalCost));
+}
 
-    while (!m_shutdownRequested)
+bool GameObjectBVHBuilder::NextTask(size_t worker, Task& task)
+{
     {
-        std::uint32_t entry;
-        std::string filename;
-        bool isDoodad;
+        auto& own = *m_queues[worker];
+        std::lock_guard<std::mutex> guard(own.m_mutex);
 
+        if (!own.m_tasks.empty())
         {
-            std::lock_guard<std::mutex> guard(m_mutex);
-
-            if (m_doodads.empty() && m_wmos.empty())
-                break;
+            task = std::move(own.m_tasks.front());
+            own.m_tasks.pop_front();
+            return true;
+        }
+    }
 
-            // if there are any wmos, start them first.  they take longer and
-            // if we are using multiple threads this will let them get started
-            // sooner in the process.
+    // the back of another queue holds its cheapest task, which leaves its
+    // owner the costly ones it had been dealt
+    for (auto i = 1u; i < m_queues.size(); ++i)
+    {
+        auto& other = *m_queues[(worker + i) % m_queues.size()];
+        std::lock_guard<std::mutex> guard(other.m_mutex);
 
-            if (!m_wmos.empty())
-            {
-                auto const i = m_wmos.begin();
-                entry = i->first;
-                filename = i->second;
-                m_wmos.erase(i);
-                isDoodad = false;
-            }
-            // otherwise there must be a doodad or we would have bailed out, so
-            // pick it and continue.
-            else
-            {
-                auto const i = m_doodads.begin();
-                entry = i->first;
-                filename = i->second;
-                m_doodads.erase(i);
-                isDoodad = true;
-            }
+        if (!other.m_tasks.empty())
+        {
+            task = std::move(other.m_tasks.back());
+            other.m_tasks.pop_back();
+            return true;
         }
+    }
+
+    return false;
+}
 
+void GameObjectBVHBuilder::Work(size_t worker)
+{
+    // the archives are shared, so this only attaches this thread's manager
+    // to those opened by the constructor
+    sMpqManager.Initialize(m_dataPath);
+
+    Task task;
+    while (!m_shutdownRequested && NextTask(worker, task))
+    {
         try
         {
-            fs::path output;
+            // empty for models with no collideable geometry
+            std::string serialized;
 
-            if (isDoodad)
+            if (task.m_isDoodad)
             {
-                const parser::Doodad doodad(filename);
+                auto const doodad = sMpqManager.GetDoodad(task.m_filename);
 
-                // ignore doodads with no collideable geometry
-                if (doodad.Vertices.empty() || doodad.Indices.empty())
+                if (!doodad->Vertices.empty() && !doodad->Indices.empty())
                 {
-                    std::lock_guard<std::mutex> guard(m_mutex);
-                    m_serialized[entry] = "";
-                    continue;
-                }
+                    auto output = m_bvhConstructor.AddTemporaryObstacle(
+                        task.m_entry, task.m_filename);
 
-                output = m_bvhConstructor.AddTemporaryObstacle(entry, filename);
-                meshfiles::SerializeDoodad(doodad, output);
+                    // several game objects, and wmos, may share the model
+                    if (m_bvhConstructor.ClaimFile(task.m_filename, output))
+                        meshfiles::SerializeDoodad(*doodad, output);
+                    serialized = output.filename().string();
+                }
             }
             else
             {
-                const parser::Wmo wmo(filename);
+                auto const wmo = sMpqManager.GetWmo(task.m_filename);
 
-                // ignore wmos with no collision geometry.  this probably
-                // shouldn't ever really happen
-                if (wmo.Vertices.empty() || wmo.Indices.empty())
+                // this probably shouldn't ever really happen
+                if (!wmo->Vertices.empty() && !wmo->Indices.empty())
                 {
-                    std::lock_guard<std::mutex> guard(m_mutex);
-                    m_serialized[entry] = "";
-                    continue;
-                }
+                    auto const output = m_bvhConstructor.AddTemporaryObstacle(
+                        task.m_entry, task.m_filename);
 
-                output = m_bvhConstructor.AddTemporaryObstacle(entry, filename);
-
-                // note that this will also serialize all doodads referenced in
-                // all doodad sets within this wmo
-                meshfiles::SerializeWmo(wmo, m_bvhConstructor);
+                    // note that this will also serialize all doodads
+                    // referenced in all doodad sets within this wmo
+                    meshfiles::SerializeWmo(*wmo, m_bvhConstructor);
+                    serialized = output.filename().string();
+                }
             }
 
             std::lock_guard<std::mutex> guard(m_mutex);
-            m_serialized[entry] = output.filename().string();
+            m_serialized[task.m_entry] = serialized;
         }
         catch (utility::exception const& e)
         {
@@ -174,6 +248,9 @@ void GameObjectBVHBuilder::Work()
             std::cerr << str.str();
             std::cerr.flush();
         }
+
+        m_remainingCost -= task.m_cost;
+        --m_remaining;
     }
 }
-} // namespace parser
\ No newline at end of file
+} // namespace parser
@@ -2,7 +2,10 @@
 
 #include "BVHConstructor.hpp"
 
+#include <atomic>
 #include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -17,19 +20,43 @@ class GameObjectBVHBuilder
 private:
     const std::filesystem::path m_dataPath;
 
+    struct Task
+    {
+        std::uint32_t m_entry;
+        std::string m_filename;
+        bool m_isDoodad;
+
+        // an estimate of how long the model takes to serialize, the size of
+        // the files it is read from
+        size_t m_cost;
+    };
+
+    // each worker takes from the front of its own queue, and when that is
+    // empty, steals from the back of another's
+    struct WorkQueue
+    {
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+
     BVHConstructor m_bvhConstructor;
     const size_t m_workers;
 
-    std::unordered_map<std::uint32_t, std::string> m_doodads;
-    std::unordered_map<std::uint32_t, std::string> m_wmos;
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    size_t m_totalCost;
+    std::atomic_size_t m_remaining;
+    std::atomic_size_t m_remainingCost;
+
+    // guards m_serialized
+    std::mutex m_mutex;
     std::unordered_map<std::uint32_t, std::string> m_serialized;
     std::vector<std::thread> m_threads;
 
-    mutable std::mutex m_mutex;
-
     std::atomic_bool m_shutdownRequested;
 
-    void Work();
+    // false once every queue is empty
+    bool NextTask(size_t worker, Task& task);
+    void Work(size_t worker);
 
 public:
     GameObjectBVHBuilder(const std::filesystem::path& dataPath,
@@ -39,10 +66,11 @@ public:
     void Begin();
     size_t Shutdown();
 
-    size_t Remaining() const
-    {
-        std::lock_guard<std::mutex> guard(m_mutex);
-        return m_doodads.size() + m_wmos.size();
-    }
+    // the number of models not yet serialized
+    size_t Remaining() const { return m_remaining; }
+
+    // weighted by the estimated cost of each model, so that it advances
+    // evenly however the large and small models are spread
+    float PercentComplete() const;
 };
 } // namespace parser
\ No newline at end of file
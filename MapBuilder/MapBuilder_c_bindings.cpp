@@ -7,6 +7,93 @@
 #include "parser/MpqManager.hpp"
 #include "utility/Exception.hpp"
 
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct mapbuild_session {
+    std::string m_dataPath;
+    std::unique_ptr<MeshBuilder> m_builder;
+
+    // the configuration, applied by mapbuild_session_start()
+    std::set<std::pair<int, int>> m_adts;
+    int m_shard = 0;
+    int m_shards = 1;
+    bool m_incremental = false;
+    bool m_resume = false;
+
+    // everything below is guarded by m_mutex
+    std::mutex m_mutex;
+
+    unsigned int m_threads = 1;
+    bool m_started = false;
+    bool m_saved = false;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // asked to stop when the thread count was lowered, and destroyed once
+    // they have
+    std::vector<std::unique_ptr<Worker>> m_stoppingWorkers;
+};
+
+namespace {
+// matches the workers of a started session to its thread count.  the caller
+// must hold the session's mutex
+void update_workers(mapbuild_session& session) {
+    for (auto i = session.m_stoppingWorkers.begin(); i != session.m_stoppingWorkers.end();) {
+        if ((*i)->IsFinished()) {
+            i = session.m_stoppingWorkers.erase(i);
+        }
+        else {
+            ++i;
+        }
+    }
+
+    if (!session.m_started) {
+        return;
+    }
+
+    while (session.m_workers.size() > session.m_threads) {
+        session.m_workers.back()->RequestShutdown();
+        session.m_stoppingWorkers.push_back(std::move(session.m_workers.back()));
+        session.m_workers.pop_back();
+    }
+
+    // once cancelled, new workers would find nothing to build
+    while (session.m_workers.size() < session.m_threads && !session.m_builder->Cancelled()) {
+        session.m_workers.push_back(
+            std::make_unique<Worker>(session.m_dataPath, session.m_builder.get()));
+    }
+}
+
+// the caller must hold the session's mutex
+bool session_finished(const mapbuild_session& session) {
+    if (!session.m_started) {
+        return false;
+    }
+
+    for (auto const& worker : session.m_workers) {
+        if (!worker->IsFinished()) {
+            return false;
+        }
+    }
+
+    for (auto const& worker : session.m_stoppingWorkers) {
+        if (!worker->IsFinished()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+} // namespace
+
 extern "C" {
 
 MapBuildResultType mapbuild_build_bvh(const char* const data_path,
@@ -123,6 +210,267 @@ MapBuildResultType mapbuild_build_map(const char* const data_path,
     return static_cast<MapBuildResultType>(Result::SUCCESS);
 }
 
+mapbuild_session* mapbuild_new_session(const char* const data_path,
+                                       const char* const output_path,
+                                       const char* const map_name,
+                                       const char* const gameobject_csv,
+                                       MapBuildResultType* const result)
+{
+    std::filesystem::path outputPath = output_path;
+
+    try {
+        parser::sMpqManager.Initialize(data_path);
+
+        files::create_bvh_output_directory(outputPath);
+        files::create_nav_output_directory(outputPath);
+
+        auto session = std::make_unique<mapbuild_session>();
+
+        session->m_dataPath = data_path;
+        session->m_builder = std::make_unique<MeshBuilder>(outputPath, map_name, 0);
+
+        if (gameobject_csv && strlen(gameobject_csv) != 0) {
+            session->m_builder->LoadGameObjects(gameobject_csv);
+        }
+
+        *result = static_cast<MapBuildResultType>(Result::SUCCESS);
+        return session.release();
+    }
+    catch (utility::exception& e) {
+        *result = static_cast<MapBuildResultType>(e.ResultCode());
+    }
+    catch (...) {
+        *result = static_cast<MapBuildResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+
+    return nullptr;
+}
+
+void mapbuild_free_session(mapbuild_session* const session)
+{
+    if (!session) {
+        return;
+    }
+
+    session->m_builder->Cancel();
+
+    // the workers must stop before the builder they use is destroyed
+    session->m_workers.clear();
+    session->m_stoppingWorkers.clear();
+
+    delete session;
+}
+
+MapBuildResultType mapbuild_session_add_adts(mapbuild_session* const session,
+                                             int32_t min_x, int32_t min_y,
+                                             int32_t max_x, int32_t max_y)
+{
+    std::lock_guard<std::mutex> guard(session->m_mutex);
+
+    if (session->m_started) {
+        return static_cast<MapBuildResultType>(Result::BUILD_ALREADY_STARTED);
+    }
+
+    if (min_x < 0 || min_y < 0 || max_x >= MeshSettings::Adts || max_y >= MeshSettings::Adts ||
+        min_x > max_x || min_y > max_y) {
+        return static_cast<MapBuildResultType>(Result::INCORRECT_ADT_COORDINATES);
+    }
+
+    for (auto y = min_y; y <= max_y; ++y) {
+        for (auto x = min_x; x <= max_x; ++x) {
+            session->m_adts.insert({x, y});
+        }
+    }
+
+    return static_cast<MapBuildResultType>(Result::SUCCESS);
+}
+
+MapBuildResultType mapbuild_session_select_shard(mapbuild_session* const session,
+                                                 uint32_t shard, uint32_t shards)
+{
+    std::lock_guard<std::mutex> guard(session->m_mutex);
+
+    if (session->m_started) {
+        return static_cast<MapBuildResultType>(Result::BUILD_ALREADY_STARTED);
+    }
+
+    if (shard >= shards) {
+        return static_cast<MapBuildResultType>(Result::INVALID_SHARD);
+    }
+
+    session->m_shard = static_cast<int>(shard);
+    session->m_shards = static_cast<int>(shards);
+
+    return static_cast<MapBuildResultType>(Result::SUCCESS);
+}
+
+MapBuildResultType mapbuild_session_set_skip(mapbuild_session* const session,
+                                             uint8_t incremental, uint8_t resume)
+{
+    std::lock_guard<std::mutex> guard(session->m_mutex);
+
+    if (session->m_started) {
+        return static_cast<MapBuildResultType>(Result::BUILD_ALREADY_STARTED);
+    }
+
+    session->m_incremental = !!incremental;
+    session->m_resume = !!resume;
+
+    return static_cast<MapBuildResultType>(Result::SUCCESS);
+}
+
+MapBuildResultType mapbuild_session_set_threads(mapbuild_session* const session,
+                                                uint32_t threads)
+{
+    try {
+        std::lock_guard<std::mutex> guard(session->m_mutex);
+
+        // Same behavior as mapbuild_build_map
+        session->m_threads = threads ? threads : 1;
+        update_workers(*session);
+
+        return static_cast<MapBuildResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<MapBuildResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<MapBuildResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+MapBuildResultType mapbuild_session_start(mapbuild_session* const session)
+{
+    try {
+        std::lock_guard<std::mutex> guard(session->m_mutex);
+
+        if (session->m_started) {
+            return static_cast<MapBuildResultType>(Result::BUILD_ALREADY_STARTED);
+        }
+
+        auto& builder = *session->m_builder;
+
+        // ADTs are chosen before any are skipped, as the command line does
+        if (!session->m_adts.empty()) {
+            builder.SelectADTs(session->m_adts);
+        }
+
+        if (session->m_shards > 1) {
+            builder.SelectShard(session->m_shard, session->m_shards);
+        }
+
+        if (session->m_incremental) {
+            builder.SkipUnchangedADTs();
+        }
+
+        if (session->m_resume) {
+            builder.SkipCompletedADTs();
+        }
+
+        session->m_started = true;
+        update_workers(*session);
+
+        return static_cast<MapBuildResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<MapBuildResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<MapBuildResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+MapBuildResultType mapbuild_session_get_progress(mapbuild_session* const session,
+                                                 MapBuildProgress* const progress)
+{
+    std::lock_guard<std::mutex> guard(session->m_mutex);
+
+    progress->completed_tiles = session->m_builder->CompletedTiles();
+    progress->total_tiles = session->m_builder->TotalTiles();
+    progress->threads = static_cast<uint32_t>(session->m_workers.size());
+    progress->started = session->m_started;
+    progress->finished = session_finished(*session);
+    progress->cancelled = session->m_builder->Cancelled();
+
+    return static_cast<MapBuildResultType>(Result::SUCCESS);
+}
+
+MapBuildResultType mapbuild_session_get_finished_tiles(mapbuild_session* const session,
+                                                       uint64_t from,
+                                                       MapBuildTile* const buffer,
+                                                       uint32_t buffer_length,
+                                                       uint32_t* const amount_of_tiles)
+{
+    try {
+        std::vector<std::pair<int, int>> tiles;
+        session->m_builder->FinishedTiles(static_cast<size_t>(from), tiles);
+
+        *amount_of_tiles = static_cast<uint32_t>(tiles.size());
+
+        if (tiles.size() > buffer_length) {
+            return static_cast<MapBuildResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < tiles.size(); ++i) {
+            buffer[i] = MapBuildTile { tiles[i].first, tiles[i].second };
+        }
+
+        return static_cast<MapBuildResultType>(Result::SUCCESS);
+    }
+    catch (...) {
+        return static_cast<MapBuildResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+MapBuildResultType mapbuild_session_cancel(mapbuild_session* const session)
+{
+    session->m_builder->Cancel();
+    return static_cast<MapBuildResultType>(Result::SUCCESS);
+}
+
+MapBuildResultType mapbuild_session_wait(mapbuild_session* const session)
+{
+    try {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> guard(session->m_mutex);
+
+                update_workers(*session);
+
+                if (!session->m_started || session_finished(*session)) {
+                    break;
+                }
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        std::lock_guard<std::mutex> guard(session->m_mutex);
+
+        if (!session->m_started) {
+            return static_cast<MapBuildResultType>(Result::SUCCESS);
+        }
+
+        auto& builder = *session->m_builder;
+
+        // a shard's map file is saved once the shards are merged, and a
+        // cancelled build's once it has been resumed
+        if (!session->m_saved && !builder.Cancelled() && session->m_shards == 1 &&
+            builder.CompletedTiles() == builder.TotalTiles()) {
+            builder.SaveMap();
+            session->m_saved = true;
+        }
+
+        return static_cast<MapBuildResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<MapBuildResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<MapBuildResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
 MapBuildResultType mapbuild_bvh_files_exist(const char* const output_path,
                                             uint8_t* const exists) {
     std::string outputPath = output_path;
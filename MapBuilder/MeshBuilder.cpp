@@ -3,32 +3,58 @@
 #include "BVHConstructor.hpp"
 #include "Common.hpp"
 #include "FileExist.hpp"
+#include "PortalBuilder.hpp"
 #include "RecastContext.hpp"
 #include "parser/Adt/Adt.hpp"
 #include "parser/Adt/AdtChunk.hpp"
+#include "parser/Adt/Chunks/MMDX.hpp"
+#include "parser/Adt/Chunks/MWMO.hpp"
 #include "parser/DBC.hpp"
+#include "parser/MpqManager.hpp"
+#include "parser/Wmo/Wmo.hpp"
+#include "parser/Wmo/WmoDoodad.hpp"
+#include "pathfind/Allocator.hpp"
+#include "pathfind/GameObjectFile.hpp"
+#include "pathfind/OffMeshParams.hpp"
+#include "pathfind/RegionBuilder.hpp"
+#include "pathfind/SpanFilter.hpp"
 #include "recastnavigation/Detour/Include/DetourAlloc.h"
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
 #include "recastnavigation/Detour/Include/DetourNavMeshBuilder.h"
 #include "recastnavigation/Recast/Include/Recast.h"
 #include "utility/AABBTree.hpp"
 #include "utility/Exception.hpp"
+#include "utility/MappedFile.hpp"
 #include "utility/MathHelper.hpp"
+#include "utility/Matrix.hpp"
+#include "utility/String.hpp"
 #include "utility/Vector.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #define ZERO(x) memset(&x, 0, sizeof(x))
@@ -99,106 +125,165 @@ void ComputeRequiredChunks(const parser::Map* map, int tileX, int tileY,
         }
 }
 
-bool TransformAndRasterize(rcContext& ctx, rcHeightfield& heightField,
-                           float slope,
-                           const std::vector<math::Vertex>& vertices,
-                           const std::vector<int>& indices,
-                           unsigned char areaFlags)
+// sets the area of each triangle from the flags of the geometry it belongs to
+void MarkAreas(rcContext& ctx, float slope, const float* vertices,
+               int vertexCount, const int* indices, int triangleCount,
+               unsigned char areaFlags, unsigned char* areas)
 {
-    if (!vertices.size() || !indices.size())
-        return true;
-
-    std::vector<float> rastVert;
-    math::Convert::VerticesToRecast(vertices, rastVert);
-
-    std::vector<unsigned char> areas(indices.size() / 3, areaFlags);
+    std::fill(areas, areas + triangleCount, areaFlags);
 
     // if these triangles are ADT, mark steep
     if (areaFlags & PolyFlags::Ground)
     {
-        rcMarkWalkableTriangles(
-            &ctx, slope, &rastVert[0], static_cast<int>(vertices.size()),
-            &indices[0], static_cast<int>(indices.size() / 3), &areas[0]);
+        rcMarkWalkableTriangles(&ctx, slope, vertices, vertexCount, indices,
+                                triangleCount, areas);
 
         // this will override the area for all walkable triangles, but what we
         // want is to flag the unwalkable ones.  so a little massaging of flags
         // is necessary here
-        for (auto& a : areas)
+        for (auto i = 0; i < triangleCount; ++i)
         {
-            if (a == RC_WALKABLE_AREA)
-                a = areaFlags;
+            if (areas[i] == RC_WALKABLE_AREA)
+                areas[i] = areaFlags;
             else
-                a = areaFlags | PolyFlags::Steep;
+                areas[i] = areaFlags | PolyFlags::Steep;
         }
     }
     // otherwise, if they are from doodads, clear steep
     else if (areaFlags & PolyFlags::Doodad)
-        rcClearUnwalkableTriangles(
-            &ctx, slope, &rastVert[0], static_cast<int>(vertices.size()),
-            &indices[0], static_cast<int>(indices.size() / 3), &areas[0]);
+        rcClearUnwalkableTriangles(&ctx, slope, vertices, vertexCount, indices,
+                                   triangleCount, areas);
+}
+
+bool TransformAndRasterize(rcContext& ctx, rcHeightfield& heightField,
+                           float slope,
+                           const std::vector<math::Vertex>& vertices,
+                           const std::vector<int>& indices,
+                           unsigned char areaFlags)
+{
+    if (!vertices.size() || !indices.size())
+        return true;
+
+    // reused by every call on the thread, so that rasterizing liquid does not
+    // allocate once it has grown to the largest chunk
+    thread_local std::vector<float> rastVert;
+    math::Convert::VerticesToRecast(vertices, rastVert);
+
+    std::vector<unsigned char> areas(indices.size() / 3);
+
+    MarkAreas(ctx, slope, &rastVert[0], static_cast<int>(vertices.size()),
+              &indices[0], static_cast<int>(indices.size() / 3), areaFlags,
+              &areas[0]);
 
     return rcRasterizeTriangles(
         &ctx, &rastVert[0], static_cast<int>(vertices.size()), &indices[0],
         &areas[0], static_cast<int>(indices.size() / 3), heightField, -1);
 }
 
-void FilterGroundBeneathLiquid(rcHeightfield& solid)
+// rasterizes the terrain of the chunk straight from its heights, without
+// building a list of its vertices first
+bool RasterizeTerrain(rcContext& ctx, rcHeightfield& heightField, float slope,
+                      const parser::AdtChunk& chunk)
 {
-    for (int i = 0; i < solid.width * solid.height; ++i)
-    {
-        // as we go, we build a list of spans which will be removed in the event
-        // we find liquid
-        std::vector<rcSpan*> spans;
+    int indices[parser::AdtChunk::MaxTerrainIndexCount];
+    auto const indexCount = chunk.GetTerrainIndices(indices);
 
-        for (rcSpan* s = solid.spans[i]; s; s = s->next)
-        {
-            // if we found a non-wmo liquid span, remove everything beneath it
-            if (!!(s->area & PolyFlags::Liquid) && !(s->area & PolyFlags::Wmo))
-            {
-                for (auto ns : spans)
-                    ns->area = RC_NULL_AREA;
+    if (!indexCount)
+        return true;
 
-                spans.clear();
-            }
-            // if we found a wmo liquid span, remove every wmo span beneath it
-            else if (!!(s->area & (PolyFlags::Liquid | PolyFlags::Wmo)))
-            {
-                for (auto ns : spans)
-                    if (!!(ns->area & PolyFlags::Wmo))
-                        ns->area = RC_NULL_AREA;
+    float rastVert[parser::AdtChunk::TerrainVertexCount * 3];
+    for (auto i = 0; i < parser::AdtChunk::TerrainVertexCount; ++i)
+        math::Convert::VertexToRecast(chunk.GetTerrainVertex(i),
+                                      &rastVert[i * 3]);
 
-                spans.clear();
-            }
-            else
-                spans.push_back(s);
-        }
-    }
+    unsigned char areas[parser::AdtChunk::MaxTerrainIndexCount / 3];
+
+    MarkAreas(ctx, slope, rastVert, parser::AdtChunk::TerrainVertexCount,
+              indices, indexCount / 3, PolyFlags::Ground, areas);
+
+    return rcRasterizeTriangles(&ctx, rastVert,
+                                parser::AdtChunk::TerrainVertexCount, indices,
+                                areas, indexCount / 3, heightField, -1);
+}
+
+// appends the triangles of a model, transformed into the world and converted
+// to recast space, to those already in the output, along with their areas.
+// the vertices are written straight into the output, rather than being
+// transformed into one temporary list and converted into another
+void AppendTriangles(rcContext& ctx, float slope,
+                     const std::vector<math::Vertex>& vertices,
+                     const math::Matrix& transform,
+                     const std::vector<int>& indices, unsigned char areaFlags,
+                     std::vector<float>& outVertices,
+                     std::vector<int>& outIndices,
+                     std::vector<unsigned char>& outAreas)
+{
+    if (!vertices.size() || !indices.size())
+        return;
+
+    auto const vertexOffset = static_cast<int>(outVertices.size() / 3);
+    auto const areaOffset = outAreas.size();
+
+    outVertices.resize(outVertices.size() + vertices.size() * 3);
+    math::Convert::TransformToRecast(vertices, transform,
+                                     &outVertices[vertexOffset * 3]);
+
+    outAreas.resize(areaOffset + indices.size() / 3);
+
+    MarkAreas(ctx, slope, &outVertices[vertexOffset * 3],
+              static_cast<int>(vertices.size()), &indices[0],
+              static_cast<int>(indices.size() / 3), areaFlags,
+              &outAreas[areaOffset]);
+
+    outIndices.reserve(outIndices.size() + indices.size());
+    for (auto const i : indices)
+        outIndices.push_back(vertexOffset + i);
 }
 
-// NOTE: this does not set bmin/bmax
-void InitializeRecastConfig(rcConfig& config)
+// NOTE: this does not set bmin/bmax.  the border must be wide enough for
+// every agent built from the same height field
+void InitializeRecastConfig(rcConfig& config, const AgentProfile& agent,
+                            int borderSize)
 {
     ZERO(config);
 
     config.cs = MeshSettings::CellSize;
     config.ch = MeshSettings::CellHeight;
     config.walkableSlopeAngle = MeshSettings::WalkableSlope;
-    config.walkableClimb = MeshSettings::VoxelWalkableClimb;
-    config.walkableHeight = MeshSettings::VoxelWalkableHeight;
-    config.walkableRadius = MeshSettings::VoxelWalkableRadius;
+    config.walkableClimb = agent.VoxelWalkableClimb();
+    config.walkableHeight = agent.VoxelWalkableHeight();
+    config.walkableRadius = agent.VoxelWalkableRadius();
     config.maxEdgeLen = config.walkableRadius * 4;
     config.maxSimplificationError = MeshSettings::MaxSimplificationError;
     config.minRegionArea = MeshSettings::MinRegionSize;
     config.mergeRegionArea = MeshSettings::MergeRegionSize;
     config.maxVertsPerPoly = MeshSettings::VerticesPerPolygon;
     config.tileSize = MeshSettings::TileVoxelSize;
-    config.borderSize = config.walkableRadius + 3;
+    config.borderSize = borderSize;
     config.width = config.tileSize + config.borderSize * 2;
     config.height = config.tileSize + config.borderSize * 2;
     config.detailSampleDist = MeshSettings::DetailSampleDistance;
     config.detailSampleMaxError = MeshSettings::DetailSampleMaxError;
 }
 
+// copies the spans of a height field into a new one of the same extent
+bool CopyHeightField(rcContext& ctx, const rcHeightfield& from,
+                     rcHeightfield& to)
+{
+    if (!rcCreateHeightfield(&ctx, to, from.width, from.height, from.bmin,
+                             from.bmax, from.cs, from.ch))
+        return false;
+
+    // spans within a column never overlap, so none of these are merged
+    for (auto y = 0; y < from.height; ++y)
+        for (auto x = 0; x < from.width; ++x)
+            for (auto s = from.spans[y * from.width + x]; s; s = s->next)
+                if (!rcAddSpan(&ctx, to, x, y, s->smin, s->smax, s->area, 0))
+                    return false;
+
+    return true;
+}
+
 void SerializeWMOAndDoodadIDs(const std::unordered_set<std::uint32_t>& wmos,
                               const std::unordered_set<std::uint32_t>& doodads,
                               utility::BinaryStream& out)
@@ -219,11 +304,14 @@ void SerializeWMOAndDoodadIDs(const std::unordered_set<std::uint32_t>& wmos,
     out = std::move(result);
 }
 
-void SerializeHeightField(const rcHeightfield& solid,
+// without spans, only the size and bounds of the height field are written,
+// as MeshSettings::NavFileOmittedSpans describes
+void SerializeHeightField(const rcHeightfield& solid, bool spans,
                           utility::BinaryStream& out)
 {
-    utility::BinaryStream result(sizeof(std::uint32_t) *
-                                 (11 + 3 * (solid.width * solid.height)));
+    utility::BinaryStream result(
+        sizeof(std::uint32_t) *
+        (12 + (spans ? 3 * (solid.width * solid.height) : 0)));
 
     result << static_cast<std::int32_t>(solid.width)
            << static_cast<std::int32_t>(solid.height);
@@ -233,6 +321,16 @@ void SerializeHeightField(const rcHeightfield& solid,
 
     result << solid.cs << solid.ch;
 
+    // place holder for the length of the spans (see NavFileSpanLengths)
+    auto const spansLength = result.wpos();
+    result << static_cast<std::uint32_t>(0);
+
+    if (!spans)
+    {
+        out = std::move(result);
+        return;
+    }
+
     // TODO this might be storable in less space, since rcSpan is a bitfield
     // struct
     for (auto i = 0; i < solid.width * solid.height; ++i)
@@ -257,6 +355,55 @@ void SerializeHeightField(const rcHeightfield& solid,
         result.Write(columnSize, static_cast<std::uint32_t>(height));
     }
 
+    result.Write(spansLength,
+                 static_cast<std::uint32_t>(result.wpos() - spansLength -
+                                            sizeof(std::uint32_t)));
+
+    out = std::move(result);
+}
+
+// writes the tops of the walkable model spans of the height field, to be
+// read according to MeshSettings::NavFileSurfaces.  the terrain is left out,
+// since its height is stored exactly with the quads
+void SerializeSurfaces(const rcHeightfield& solid, bool enabled,
+                       utility::BinaryStream& out)
+{
+    std::vector<std::uint32_t> starts;
+    std::vector<std::uint16_t> surfaces;
+
+    if (enabled)
+    {
+        starts.reserve(solid.width * solid.height + 1);
+
+        std::vector<std::uint16_t> column;
+
+        for (auto i = 0; i < solid.width * solid.height; ++i)
+        {
+            starts.push_back(static_cast<std::uint32_t>(surfaces.size()));
+
+            column.clear();
+            for (const rcSpan* s = solid.spans[i]; !!s; s = s->next)
+                if (s->area != RC_NULL_AREA && !(s->area & PolyFlags::Ground))
+                    column.push_back(static_cast<std::uint16_t>(s->smax));
+
+            // spans are listed from the bottom up
+            surfaces.insert(surfaces.end(), column.rbegin(), column.rend());
+        }
+
+        starts.push_back(static_cast<std::uint32_t>(surfaces.size()));
+    }
+
+    utility::BinaryStream result(sizeof(std::uint32_t) * (1 + starts.size()) +
+                                 sizeof(std::uint16_t) * surfaces.size());
+
+    result << static_cast<std::uint32_t>(surfaces.size());
+
+    if (!surfaces.empty())
+    {
+        result.Write(&starts[0], sizeof(std::uint32_t) * starts.size());
+        result.Write(&surfaces[0], sizeof(std::uint16_t) * surfaces.size());
+    }
+
     out = std::move(result);
 }
 
@@ -334,9 +481,14 @@ using SmartPolyMeshPtr = std::unique_ptr<rcPolyMesh, decltype(&rcFreePolyMesh)>;
 using SmartPolyMeshDetailPtr =
     std::unique_ptr<rcPolyMeshDetail, decltype(&rcFreePolyMeshDetail)>;
 
-bool SerializeMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
-                       int tileY, rcHeightfield& solid,
-                       utility::BinaryStream& out)
+// when portals is given, the portals of the finished tile are written to it
+// (see BuildTilePortals()).  detour keeps only those off-mesh connections
+// which start within the tile, so all of them may be given
+bool SerializeMeshTile(
+    RecastContext& ctx, const rcConfig& config, const AgentProfile& agent,
+    RegionPartition partition, int tileX, int tileY, rcHeightfield& solid,
+    const std::vector<OffMeshConnection>& offMeshConnections,
+    utility::BinaryStream& out, utility::BinaryStream* portals = nullptr)
 {
     // initialize compact height field
     SmartCompactHeightFieldPtr chf(rcAllocCompactHeightfield(),
@@ -347,11 +499,11 @@ bool SerializeMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
                                    *chf))
         return false;
 
-    if (!rcBuildDistanceField(&ctx, *chf))
+    // keep the agent's radius clear of walls and ledges
+    if (!rcErodeWalkableArea(&ctx, config.walkableRadius, *chf))
         return false;
 
-    if (!rcBuildRegions(&ctx, *chf, config.borderSize, config.minRegionArea,
-                        config.mergeRegionArea))
+    if (!pathfind::BuildRegions(ctx, config, partition, *chf))
         return false;
 
     SmartContourSetPtr cset(rcAllocContourSet(), rcFreeContourSet);
@@ -416,9 +568,9 @@ bool SerializeMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
     params.detailVertsCount = polyMeshDetail->nverts;
     params.detailTris = polyMeshDetail->tris;
     params.detailTriCount = polyMeshDetail->ntris;
-    params.walkableHeight = MeshSettings::WalkableHeight;
-    params.walkableRadius = MeshSettings::WalkableRadius;
-    params.walkableClimb = MeshSettings::WalkableClimb;
+    params.walkableHeight = agent.m_walkableHeight;
+    params.walkableRadius = agent.m_walkableRadius;
+    params.walkableClimb = agent.m_walkableClimb;
     params.tileX = tileX;
     params.tileY = tileY;
     params.tileLayer = 0;
@@ -428,18 +580,31 @@ bool SerializeMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
     params.ch = config.ch;
     params.buildBvTree = true;
 
+    const pathfind::OffMeshParams offMesh(offMeshConnections);
+    offMesh.Apply(params);
+
+    ctx.StartStage(RecastContext::Serialize);
+
     unsigned char* outData;
     int outDataSize;
     if (!dtCreateNavMeshData(&params, &outData, &outDataSize))
+    {
+        ctx.StopStage(RecastContext::Serialize);
         return false;
+    }
 
     utility::BinaryStream result(outDataSize);
     result.Write(outData, outDataSize);
 
     out = std::move(result);
 
+    if (portals)
+        BuildTilePortals(outData, outDataSize, *portals);
+
     dtFree(outData);
 
+    ctx.StopStage(RecastContext::Serialize);
+
     return true;
 }
 
@@ -451,16 +616,258 @@ bool IsHeightFieldEmpty(rcHeightfield const& solid)
 
     return true;
 }
+
+// 64 bit FNV-1a, used to fingerprint the inputs of each ADT for incremental
+// builds.  it need not be cryptographic, only stable between builds
+constexpr std::uint64_t FingerprintBasis = 0xCBF29CE484222325ull;
+
+void Fingerprint(std::uint64_t& hash, const void* data, size_t length)
+{
+    auto const bytes = static_cast<const std::uint8_t*>(data);
+
+    for (auto i = 0u; i < length; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+}
+
+template <typename T>
+void Fingerprint(std::uint64_t& hash, const T& value)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "fingerprinted values must be trivially copyable");
+    Fingerprint(hash, &value, sizeof(value));
+}
+
+// the first length bytes of the stream
+void Fingerprint(std::uint64_t& hash, utility::BinaryStream& stream,
+                 size_t length)
+{
+    std::vector<std::uint8_t> buffer(0x10000);
+
+    stream.rpos(0);
+
+    for (auto remaining = length; remaining > 0;)
+    {
+        auto const chunk = (std::min)(remaining, buffer.size());
+
+        stream.ReadBytes(&buffer[0], chunk);
+        Fingerprint(hash, &buffer[0], chunk);
+
+        remaining -= chunk;
+    }
+}
+
+// the file's name is included, so that moving a model changes it
+std::uint64_t FileFingerprint(const std::string& file,
+                              utility::BinaryStream* stream)
+{
+    auto hash = FingerprintBasis;
+    Fingerprint(hash, file.data(), file.length());
+    Fingerprint(hash, *stream, stream->wpos());
+
+    return hash;
+}
+
+// whether the file is a whole nav file for the given ADT, agent and region
+// partition, as written by meshfiles::ADT::Serialize() with its checksum
+bool IsCompleteNavFile(const fs::path& path, int adtX, int adtY,
+                       AgentSize agent, RegionPartition partition)
+{
+    if (!fs::exists(path))
+        return false;
+
+    auto file = std::make_shared<utility::MappedFile>(path);
+
+    // a compressed file is judged by its contents
+    constexpr size_t compressedHeaderSize =
+        2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+    if (file->size() >= compressedHeaderSize &&
+        *reinterpret_cast<const std::uint32_t*>(file->data()) ==
+            MeshSettings::FileCompressed)
+    {
+        utility::MappedStream compressed(file, sizeof(std::uint32_t));
+
+        std::uint32_t compression;
+        std::uint64_t length;
+        compressed >> compression >> length;
+
+        if (compression != static_cast<std::uint32_t>(NavCompression::Zlib))
+            return false;
+
+        try
+        {
+            file = std::make_shared<utility::MappedFile>(
+                utility::BinaryStream::Inflate(
+                    file->data() + compressedHeaderSize,
+                    file->size() - compressedHeaderSize,
+                    static_cast<size_t>(length)));
+        }
+        catch (const utility::exception&)
+        {
+            return false;
+        }
+    }
+
+    constexpr size_t headerSize = 8 * sizeof(std::uint32_t);
+
+    if (file->size() < headerSize + sizeof(std::uint64_t))
+        return false;
+
+    // read in place, rather than copied into a stream
+    utility::MappedStream in(file);
+
+    std::uint32_t sig, ver, kind, x, y, tileCount;
+    in >> sig >> ver >> kind >> x >> y >> tileCount;
+
+    if (sig != MeshSettings::FileSignature ||
+        ver != MeshSettings::FileVersion || kind != MeshSettings::FileADT ||
+        x != static_cast<std::uint32_t>(adtX) ||
+        y != static_cast<std::uint32_t>(adtY) ||
+        tileCount != MeshSettings::TilesPerADT * MeshSettings::TilesPerADT)
+        return false;
+
+    std::uint32_t flags, firstTile;
+    in >> flags >> firstTile;
+
+    auto size = static_cast<std::uint32_t>(AgentSize::Default);
+
+    if (firstTile >= in.rpos() + sizeof(size))
+        in >> size;
+
+    if (size != static_cast<std::uint32_t>(agent))
+        return false;
+
+    auto partitionValue =
+        static_cast<std::uint32_t>(RegionPartition::Watershed);
+
+    if (firstTile >= in.rpos() + sizeof(partitionValue))
+        in >> partitionValue;
+
+    if (partitionValue != static_cast<std::uint32_t>(partition))
+        return false;
+
+    auto const length = file->size() - sizeof(std::uint64_t);
+
+    auto checksum = FingerprintBasis;
+    Fingerprint(checksum, file->data(), length);
+
+    std::uint64_t stored;
+    in.rpos(length);
+    in >> stored;
+
+    return stored == checksum;
+}
+
+// the fingerprint of a file from the MPQs, or zero if there is no such file
+std::uint64_t FileFingerprint(const std::string& file)
+{
+    auto const stream = parser::sMpqManager.OpenFile(file);
+
+    return stream ? FileFingerprint(file, stream.get()) : 0;
+}
+
+// the settings which determine the output of every tile
+std::uint64_t SettingsFingerprint(const AgentProfile& agent)
+{
+    auto hash = FingerprintBasis;
+
+    Fingerprint(hash, MeshSettings::FileVersion);
+    Fingerprint(hash, MeshSettings::TileVoxelSize);
+    Fingerprint(hash, MeshSettings::CellSize);
+    Fingerprint(hash, MeshSettings::CellHeight);
+    Fingerprint(hash, agent.m_size);
+    Fingerprint(hash, agent.m_walkableHeight);
+    Fingerprint(hash, agent.m_walkableRadius);
+
+    // so that tiles built before the walkable area was eroded are rebuilt
+    Fingerprint(hash, std::uint8_t {1});
+    Fingerprint(hash, MeshSettings::WalkableSlope);
+    Fingerprint(hash, agent.m_walkableClimb);
+    Fingerprint(hash, MeshSettings::DetailSampleDistance);
+    Fingerprint(hash, MeshSettings::DetailSampleMaxError);
+    Fingerprint(hash, MeshSettings::MaxSimplificationError);
+    Fingerprint(hash, MeshSettings::MinRegionSize);
+    Fingerprint(hash, MeshSettings::MergeRegionSize);
+    Fingerprint(hash, MeshSettings::VerticesPerPolygon);
+
+    return hash;
+}
+
+// the distance of the given ADT along a hilbert curve covering the ADT grid.
+// consecutive ADTs along the curve are neighbours, and unlike a row by row
+// walk, the curve rarely returns to the neighbourhood of an ADT once it has
+// moved on
+int HilbertIndex(int x, int y)
+{
+    constexpr int n = MeshSettings::Adts;
+    static_assert((n & (n - 1)) == 0, "hilbert curve requires a power of two");
+
+    auto result = 0;
+
+    for (auto s = n / 2; s > 0; s /= 2)
+    {
+        auto const rx = (x & s) ? 1 : 0;
+        auto const ry = (y & s) ? 1 : 0;
+
+        result += s * s * ((3 * rx) ^ ry);
+
+        // rotate the quadrant so that the curve within it is oriented as the
+        // curve of the whole grid
+        if (!ry)
+        {
+            if (rx)
+            {
+                x = n - 1 - x;
+                y = n - 1 - y;
+            }
+
+            std::swap(x, y);
+        }
+    }
+
+    return result;
+}
+
+const AgentProfile& CheckedAgentProfile(AgentSize size)
+{
+    if (static_cast<std::uint32_t>(size) >= AgentProfileCount)
+        THROW(Result::UNKNOWN_AGENT_SIZE);
+
+    return GetAgentProfile(size);
+}
 } // namespace
 
 MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
-                         const std::string& mapName, int logLevel)
+                         const std::string& mapName, int logLevel,
+                         AgentSize agent)
+    // this must follow the parser initialization
+    : MeshBuilder(outputPath, std::make_unique<parser::Map>(mapName), logLevel,
+                  agent)
+{
+}
+
+MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
+                         const std::string& transportName,
+                         const std::string& wmoPath, int logLevel,
+                         AgentSize agent)
+    : MeshBuilder(outputPath,
+                  std::make_unique<parser::Map>(transportName, wmoPath),
+                  logLevel, agent)
+{
+}
+
+MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
+                         std::unique_ptr<parser::Map> map, int logLevel,
+                         AgentSize agent)
     : m_outputPath(outputPath), m_bvhConstructor(outputPath),
-      m_chunkReferences(MeshSettings::ChunkCount * MeshSettings::ChunkCount),
-      m_completedTiles(0), m_logLevel(logLevel)
+      m_nextTile(0), m_adtReferences(MeshSettings::Adts * MeshSettings::Adts),
+      m_globalWMOSerialized(false), m_completedTiles(0), m_logLevel(logLevel),
+      m_agent(CheckedAgentProfile(agent))
 {
-    // this must follow the parser initialization
-    m_map = std::make_unique<parser::Map>(mapName);
+    m_map = std::move(map);
 
     if (auto const wmo = m_map->GetGlobalWmoInstance())
     {
@@ -471,20 +878,26 @@ MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
             ::ceilf((wmo->Bounds.MaxCorner.Y - wmo->Bounds.MinCorner.Y) /
                     MeshSettings::TileSize));
 
-        m_globalWMO = std::make_unique<meshfiles::GlobalWMO>();
+        m_globalWMO = std::make_unique<meshfiles::GlobalWMO>(m_agent.m_size);
 
         for (auto tileY = 0; tileY < tileHeight; ++tileY)
             for (auto tileX = 0; tileX < tileWidth; ++tileX)
                 m_pendingTiles.push_back({tileX, tileY});
 
-        wmo->BuildTriangles(m_globalWMOVertices, m_globalWMOIndices);
-        wmo->BuildLiquidTriangles(m_globalWMOLiquidVertices,
-                                  m_globalWMOLiquidIndices);
-        wmo->BuildDoodadTriangles(m_globalWMODoodadVertices,
-                                  m_globalWMODoodadIndices);
+        rcConfig config;
+        InitializeRecastConfig(config, m_agent, BorderSize());
+
+        RecastContext ctx(m_logLevel);
 
-        std::vector<float> vertices;
-        math::Convert::VerticesToRecast(m_globalWMOVertices, vertices);
+        // tiles are laid out from the northwest corner of the WMO, as in
+        // BuildAndSerializeWMOTile().  the workers have not yet started, so
+        // the geometry is sorted into them on as many threads as there are
+        // cores
+        m_globalWMOGeometry = BuildWmoGeometry(
+            ctx, config, -wmo->Bounds.MaxCorner.Y, -wmo->Bounds.MaxCorner.X,
+            *wmo, (std::max)(1u, std::thread::hardware_concurrency()));
+
+        auto const& vertices = m_globalWMOGeometry->m_vertices;
 
         m_minX = m_maxX = vertices[0];
         m_minY = m_maxY = vertices[1];
@@ -508,46 +921,57 @@ MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
     }
     else
     {
-        // this build order should ensure that the tiles for one ADT finish
-        // before the next ADT begins (more or less)
-        for (auto y = MeshSettings::Adts - 1; y >= 0; --y)
-            for (auto x = MeshSettings::Adts - 1; x >= 0; --x)
-            {
-                if (!m_map->HasAdt(x, y))
-                    continue;
-
-                for (auto tileY = 0; tileY < MeshSettings::TilesPerADT; ++tileY)
-                    for (auto tileX = 0; tileX < MeshSettings::TilesPerADT;
-                         ++tileX)
-                    {
-                        auto const globalTileX =
-                            x * MeshSettings::TilesPerADT + tileX;
-                        auto const globalTileY =
-                            y * MeshSettings::TilesPerADT + tileY;
-
-                        std::vector<std::pair<int, int>> chunks;
-                        ComputeRequiredChunks(m_map.get(), globalTileX,
-                                              globalTileY, chunks);
-
-                        for (auto const& chunk : chunks)
-                            AddChunkReference(chunk.first, chunk.second);
-
-                        m_pendingTiles.push_back({globalTileX, globalTileY});
-                    }
-            }
+        std::vector<std::pair<int, int>> adts;
+
+        for (auto y = 0; y < MeshSettings::Adts; ++y)
+            for (auto x = 0; x < MeshSettings::Adts; ++x)
+                if (m_map->HasAdt(x, y))
+                    adts.push_back({x, y});
+
+        // an ADT is unloaded once every tile needing its chunks is built, and
+        // tiles need the chunks of neighbouring ADTs too.  visiting the ADTs
+        // along a hilbert curve, rather than row by row, means that far fewer
+        // of them are resident at once.  tiles are taken from the back, and
+        // the tiles of one ADT are all taken before those of the next.
+        std::sort(adts.begin(), adts.end(),
+                  [](const std::pair<int, int>& a, const std::pair<int, int>& b)
+                  {
+                      return HilbertIndex(a.first, a.second) >
+                             HilbertIndex(b.first, b.second);
+                  });
+
+        for (auto const& adt : adts)
+            for (auto tileY = 0; tileY < MeshSettings::TilesPerADT; ++tileY)
+                for (auto tileX = 0; tileX < MeshSettings::TilesPerADT; ++tileX)
+                {
+                    auto const globalTileX =
+                        adt.first * MeshSettings::TilesPerADT + tileX;
+                    auto const globalTileY =
+                        adt.second * MeshSettings::TilesPerADT + tileY;
+
+                    std::vector<std::pair<int, int>> chunks;
+                    ComputeRequiredChunks(m_map.get(), globalTileX,
+                                          globalTileY, chunks);
+
+                    for (auto const& chunk : chunks)
+                        AddChunkReference(chunk.first, chunk.second);
+
+                    m_pendingTiles.push_back({globalTileX, globalTileY});
+                }
     }
 
     m_totalTiles = m_pendingTiles.size();
 
-    files::create_nav_output_directory_for_map(m_outputPath, mapName);
+    files::create_nav_output_directory_for_map(m_outputPath, m_map->Name);
 }
 
 MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
                          const std::string& mapName, int logLevel, int adtX,
-                         int adtY)
+                         int adtY, AgentSize agent)
     : m_outputPath(outputPath), m_bvhConstructor(outputPath),
-      m_chunkReferences(MeshSettings::ChunkCount * MeshSettings::ChunkCount),
-      m_completedTiles(0), m_logLevel(logLevel)
+      m_nextTile(0), m_adtReferences(MeshSettings::Adts * MeshSettings::Adts),
+      m_globalWMOSerialized(false), m_completedTiles(0), m_logLevel(logLevel),
+      m_agent(CheckedAgentProfile(agent))
 {
     // this must follow the parser initialization
     m_map = std::make_unique<parser::Map>(mapName);
@@ -573,53 +997,111 @@ MeshBuilder::MeshBuilder(const std::filesystem::path& outputPath,
     files::create_nav_output_directory_for_map(m_outputPath, mapName);
 }
 
-void MeshBuilder::LoadGameObjects(const std::string& path)
+void MeshBuilder::AddAgentSize(AgentSize size)
 {
-    std::cout << "Reading game object..." << std::endl;
+    auto const& agent = CheckedAgentProfile(size);
 
-    std::ifstream in(path);
+    if (&agent == &m_agent || IsGlobalWMO())
+        return;
 
-    if (in.fail())
-        THROW(Result::FAILED_TO_OPEN_GAMEOBJECT_FILE).ErrorCode();
+    for (auto const other : m_otherAgents)
+        if (other == &agent)
+            return;
 
-    m_gameObjectInstances.clear();
+    m_otherAgents.push_back(&agent);
+}
 
-    std::string line;
-    std::vector<std::string> cells;
-    while (std::getline(in, line))
-    {
-        std::istringstream str(line);
-        std::string field;
+int MeshBuilder::BorderSize() const
+{
+    auto radius = m_agent.VoxelWalkableRadius();
 
-        while (std::getline(str, field, ','))
-            cells.emplace_back(field);
-    }
+    for (auto const agent : m_otherAgents)
+        radius = (std::max)(radius, agent->VoxelWalkableRadius());
 
-    in.close();
+    return radius + 3;
+}
+
+bool MeshBuilder::InstallAllocator()
+{
+    pathfind::Allocator::Config config;
+
+    // a tile's compact height field and region scratch alone run to several
+    // megabytes, which the defaults, sized for rebuilding the odd tile beneath
+    // an obstacle, would not hold
+    config.m_threadCacheBytes = 64 << 20;
+
+    return pathfind::Allocator::Install(config);
+}
+
+std::string MeshBuilder::TransportName(const std::string& wmoPath)
+{
+    // mpq paths are separated by backslashes, which std::filesystem only
+    // takes for separators on windows
+    auto const slash = wmoPath.find_last_of("\\/");
+    auto name =
+        slash == std::string::npos ? wmoPath : wmoPath.substr(slash + 1);
+
+    auto const dot = name.rfind('.');
+    if (dot != std::string::npos)
+        name.erase(dot);
+
+    return name;
+}
+
+bool MeshBuilder::FindAgentSize(const std::string& name, AgentSize& size)
+{
+    for (auto const& profile : AgentProfiles)
+        if (name == profile.m_name)
+        {
+            size = profile.m_size;
+            return true;
+        }
 
-    if (!!(cells.size() % 10))
-        THROW(Result::BAD_FORMAT_OF_GAMEOBJECT_FILE);
+    return false;
+}
+
+bool MeshBuilder::FindAgentSizes(const std::string& names,
+                                 std::vector<AgentSize>& sizes)
+{
+    sizes.clear();
 
-    m_gameObjectInstances.reserve(cells.size() / 10);
+    std::istringstream in(names);
+    std::string name;
 
-    for (auto i = 0u; i < cells.size(); i += 10)
+    while (std::getline(in, name, ','))
     {
-        GameObjectInstance instance {
-            std::stoull(cells[i]),                                // guid
-            static_cast<std::uint32_t>(std::stoul(cells[i + 1])), // display id
-            static_cast<std::uint32_t>(std::stoul(cells[i + 2])), // map
-            std::stof(cells[i + 3]),                              // position x
-            std::stof(cells[i + 4]),                              // position y
-            std::stof(cells[i + 5]),                              // position z
-            std::stof(cells[i + 6]),                              // quaternion
-            std::stof(cells[i + 7]),
-            std::stof(cells[i + 8]),
-            std::stof(cells[i + 9]),
-        };
+        AgentSize size;
+
+        if (!FindAgentSize(name, size))
+            return false;
+
+        sizes.push_back(size);
+    }
+
+    return !sizes.empty();
+}
+
+void MeshBuilder::LoadGameObjects(const std::string& path)
+{
+    std::cout << "Reading game object..." << std::endl;
 
-        // only concern ourselves with gameobjects on the current map
-        if (instance.map == m_map->Id)
-            m_gameObjectInstances.emplace_back(instance);
+    // only concern ourselves with gameobjects on the current map
+    if (pathfind::GameObjectFile::IsSpawnFile(path))
+    {
+        auto const spawns =
+            pathfind::GameObjectFile(path).MapSpawns(m_map->Id);
+        m_gameObjectInstances.assign(spawns.begin(), spawns.end());
+    }
+    else
+    {
+        pathfind::GameObjectFile::ReadCSV(path, m_gameObjectInstances);
+
+        m_gameObjectInstances.erase(
+            std::remove_if(m_gameObjectInstances.begin(),
+                           m_gameObjectInstances.end(),
+                           [this](const GameObjectSpawn& instance)
+                           { return instance.m_map != m_map->Id; }),
+            m_gameObjectInstances.end());
     }
 
     std::cout << "Loaded " << m_gameObjectInstances.size()
@@ -634,7 +1116,7 @@ void MeshBuilder::LoadGameObjects(const std::string& path)
     for (auto i = 0u; i < displayInfo.RecordCount(); ++i)
     {
         auto const id = displayInfo.GetField(i, 0);
-        auto const modelPath = displayInfo.GetStringField(i, 1);
+        const std::string modelPath(displayInfo.GetStringField(i, 1));
 
         // not sure why this happens.  might we be missing some needed
         // information?
@@ -687,116 +1169,1339 @@ void MeshBuilder::LoadGameObjects(const std::string& path)
 
     for (auto const& go : m_gameObjectInstances)
     {
-        if (models.find(go.displayId) == models.end())
+        if (models.find(go.m_displayId) == models.end())
             THROW(Result::GAME_OBJECT_REFERENCES_NON_EXISTENT_MODEL_ID);
     }
 }
 
-bool MeshBuilder::GetNextTile(int& tileX, int& tileY)
+void MeshBuilder::LoadOffMeshConnections(const std::string& path)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
-
-    if (m_pendingTiles.empty())
-        return false;
+    std::ifstream in(path);
 
-    auto const back = m_pendingTiles.back();
-    m_pendingTiles.pop_back();
+    if (in.fail())
+        THROW(Result::FAILED_TO_OPEN_OFF_MESH_CONNECTION_FILE).ErrorCode();
 
-    tileX = back.first;
-    tileY = back.second;
+    m_offMeshConnections.clear();
 
-    return true;
-}
+    // each line holds the nine fields of one connection: its map, start,
+    // end, radius and whether it is bidirectional.  blank lines are ignored
+    std::string line;
+    for (auto lineNumber = 1; std::getline(in, line); ++lineNumber)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
 
-bool MeshBuilder::IsGlobalWMO() const
-{
-    return !!m_map->GetGlobalWmoInstance();
-}
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        std::vector<std::string> cells;
+        std::istringstream str(line);
+        std::string field;
+
+        while (std::getline(str, field, ','))
+            cells.emplace_back(field);
+
+        OffMeshConnection connection;
+        unsigned long map;
+
+        try
+        {
+            if (cells.size() != 9)
+                throw std::invalid_argument("field count");
+
+            map = std::stoul(cells[0]);
+
+            for (auto j = 0; j < 3; ++j)
+            {
+                connection.m_start[j] = std::stof(cells[1 + j]);
+                connection.m_end[j] = std::stof(cells[4 + j]);
+            }
+
+            connection.m_radius = std::stof(cells[7]);
+            connection.m_bidirectional = std::stoi(cells[8]) != 0;
+        }
+        catch (const std::logic_error&)
+        {
+            std::stringstream error;
+            error << path << " line " << lineNumber << ": expected nine "
+                  << "numeric fields, found \"" << line << "\"";
+            THROW_MSG(error.str(),
+                      Result::BAD_FORMAT_OF_OFF_MESH_CONNECTION_FILE);
+        }
+
+        // only concern ourselves with connections on the current map
+        if (map != m_map->Id)
+            continue;
+
+        connection.m_id = 0;
+
+        m_offMeshConnections.push_back(connection);
+    }
+
+    in.close();
+
+    std::cout << "Loaded " << m_offMeshConnections.size()
+              << " off-mesh connections." << std::endl;
+}
+
+fs::path MeshBuilder::ManifestPath() const
+{
+    return m_outputPath / "Nav" / m_map->Name / "fingerprints.txt";
+}
+
+std::uint64_t MeshBuilder::ComputeFingerprint(
+    int adtX, int adtY,
+    std::unordered_map<std::string, std::uint64_t>& modelFingerprints) const
+{
+    auto hash = SettingsFingerprint(m_agent);
+
+    for (auto const agent : m_otherAgents)
+        Fingerprint(hash, SettingsFingerprint(*agent));
+
+    // an ADT built without surface heights is out of date once they are
+    // wanted, and the reverse
+    Fingerprint(hash, m_surfaceHeights);
+    Fingerprint(hash, m_regionPartition);
+    Fingerprint(hash, m_heightFieldRadius);
+
+    auto const modelFingerprint = [&modelFingerprints](const std::string& name)
+    {
+        auto const lower = utility::lower(name);
+        auto const i = modelFingerprints.find(lower);
+
+        if (i != modelFingerprints.end())
+            return i->second;
+
+        auto result = FileFingerprint(lower);
+
+        // the geometry of a WMO is in its group files, which are numbered
+        // from zero
+        if (fs::path(lower).extension() == ".wmo")
+        {
+            auto const stem = lower.substr(0, lower.length() - 4);
+
+            for (auto group = 0;; ++group)
+            {
+                std::stringstream groupName;
+                groupName << stem << "_" << std::setw(3) << std::setfill('0')
+                          << group << ".wmo";
+
+                if (!parser::sMpqManager.FileExists(groupName.str()))
+                    break;
+
+                Fingerprint(result, FileFingerprint(groupName.str()));
+            }
+        }
+
+        modelFingerprints[lower] = result;
+        return result;
+    };
+
+    // tiles along the edges of the ADT also use the terrain and models of its
+    // neighbours
+    for (auto y = adtY - 1; y <= adtY + 1; ++y)
+        for (auto x = adtX - 1; x <= adtX + 1; ++x)
+        {
+            if (x < 0 || y < 0 || x >= MeshSettings::Adts ||
+                y >= MeshSettings::Adts || !m_map->HasAdt(x, y))
+                continue;
+
+            std::stringstream name;
+            name << "World\\maps\\" << m_map->Name << "\\" << m_map->Name
+                 << "_" << x << "_" << y << ".adt";
+
+            auto const stream = parser::sMpqManager.OpenFile(name.str());
+
+            // alpha data keeps its ADTs within the WDT, where they cannot be
+            // told apart, so they are always built
+            if (!stream)
+                return 0;
+
+            Fingerprint(hash, x);
+            Fingerprint(hash, y);
+            Fingerprint(hash, FileFingerprint(name.str(), stream.get()));
+
+            size_t location;
+            if (stream->GetChunkLocation("MMDX", location))
+            {
+                parser::input::MMDX names(location, stream.get());
+                for (auto const& doodad : names.DoodadNames)
+                    Fingerprint(hash, modelFingerprint(doodad));
+            }
+
+            if (stream->GetChunkLocation("MWMO", location))
+            {
+                parser::input::MWMO names(location, stream.get());
+                for (auto const& wmo : names.WmoNames)
+                    Fingerprint(hash, modelFingerprint(wmo));
+            }
+        }
+
+    auto const isNearby = [adtX, adtY](const math::Vertex& position)
+    {
+        int x, y;
+        math::Convert::WorldToAdt(position, x, y);
+
+        return std::abs(x - adtX) <= 1 && std::abs(y - adtY) <= 1;
+    };
+
+    for (auto const& instance : m_gameObjectInstances)
+        if (isNearby({instance.m_position[0], instance.m_position[1],
+                      instance.m_position[2]}))
+            Fingerprint(hash, instance);
+
+    for (auto const& connection : m_offMeshConnections)
+        if (isNearby({connection.m_start[0], connection.m_start[1],
+                      connection.m_start[2]}))
+        {
+            Fingerprint(hash, connection.m_start);
+            Fingerprint(hash, connection.m_end);
+            Fingerprint(hash, connection.m_radius);
+            Fingerprint(hash, connection.m_bidirectional);
+        }
+
+    // zero is reserved for ADTs which have no fingerprint
+    return hash ? hash : 1;
+}
+
+size_t MeshBuilder::SkipUnchangedADTs()
+{
+    if (IsGlobalWMO())
+        return 0;
+
+    m_manifest.clear();
+
+    std::ifstream in(ManifestPath());
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream str(line);
+
+        int x, y;
+        char separator;
+        std::uint64_t fingerprint;
+
+        if (str >> x >> separator >> y >> std::hex >> fingerprint)
+            m_manifest[{x, y}] = fingerprint;
+    }
+    in.close();
+
+    std::unordered_map<std::string, std::uint64_t> modelFingerprints;
+    std::set<std::pair<int, int>> unchanged;
+
+    for (auto const& tile : m_pendingTiles)
+    {
+        std::pair<int, int> const adt {tile.first / MeshSettings::TilesPerADT,
+                                       tile.second / MeshSettings::TilesPerADT};
+
+        if (m_fingerprints.find(adt) != m_fingerprints.end())
+            continue;
+
+        auto const fingerprint =
+            ComputeFingerprint(adt.first, adt.second, modelFingerprints);
+
+        m_fingerprints[adt] = fingerprint;
+
+        std::stringstream name;
+        name << std::setw(2) << std::setfill('0') << adt.first << "_"
+             << std::setw(2) << std::setfill('0') << adt.second << ".nav";
+
+        auto const recorded = m_manifest.find(adt);
+
+        if (fingerprint && recorded != m_manifest.end() &&
+            recorded->second == fingerprint &&
+            fs::exists(m_outputPath / "Nav" / m_map->Name / name.str()))
+            unchanged.insert(adt);
+    }
+
+    SkipADTs(unchanged);
+
+    return unchanged.size();
+}
+
+size_t MeshBuilder::SkipCompletedADTs()
+{
+    // the nav file of a global WMO is written only once every tile is built
+    if (IsGlobalWMO())
+    {
+        if (m_pendingTiles.empty() ||
+            !fs::exists(m_outputPath / "Nav" / m_map->Name / "Map.nav"))
+            return 0;
+
+        m_pendingTiles.clear();
+        m_totalTiles = 0;
+
+        return 1;
+    }
+
+    std::set<std::pair<int, int>> completed;
+
+    for (auto const& tile : m_pendingTiles)
+    {
+        std::pair<int, int> const adt {tile.first / MeshSettings::TilesPerADT,
+                                       tile.second / MeshSettings::TilesPerADT};
+
+        if (completed.find(adt) != completed.end())
+            continue;
+
+        std::stringstream name;
+        name << std::setw(2) << std::setfill('0') << adt.first << "_"
+             << std::setw(2) << std::setfill('0') << adt.second << ".nav";
+
+        if (IsCompleteNavFile(m_outputPath / "Nav" / m_map->Name / name.str(),
+                              adt.first, adt.second, m_agent.m_size,
+                              m_regionPartition))
+            completed.insert(adt);
+    }
+
+    SkipADTs(completed);
+
+    return completed.size();
+}
+
+void MeshBuilder::SelectShard(int shard, int shards)
+{
+    if (shard < 0 || shard >= shards)
+        THROW(Result::INVALID_SHARD);
+
+    // a global WMO is a single file, and so is not divided
+    if (IsGlobalWMO())
+    {
+        if (shard > 0)
+        {
+            m_pendingTiles.clear();
+            m_totalTiles = 0;
+        }
+
+        return;
+    }
+
+    // the ADTs in the order in which they would be built.  every shard is
+    // given a run of them along the hilbert curve, so that the neighbouring
+    // ADTs it must also load are mostly its own
+    std::vector<std::pair<int, int>> order;
+    std::set<std::pair<int, int>> seen;
+
+    for (auto tile = m_pendingTiles.rbegin(); tile != m_pendingTiles.rend();
+         ++tile)
+    {
+        std::pair<int, int> const adt {
+            tile->first / MeshSettings::TilesPerADT,
+            tile->second / MeshSettings::TilesPerADT};
+
+        if (seen.insert(adt).second)
+            order.push_back(adt);
+    }
+
+    auto const begin = order.size() * shard / shards;
+    auto const end = order.size() * (shard + 1) / shards;
+
+    std::set<std::pair<int, int>> others(order.begin(), order.begin() + begin);
+    others.insert(order.begin() + end, order.end());
+
+    RemovePendingADTs(others);
+}
+
+void MeshBuilder::SelectADTs(const std::set<std::pair<int, int>>& adts)
+{
+    // a global WMO is a single file, and so is built whole
+    if (IsGlobalWMO())
+        return;
+
+    std::set<std::pair<int, int>> others;
+
+    for (auto const& tile : m_pendingTiles)
+    {
+        std::pair<int, int> const adt {tile.first / MeshSettings::TilesPerADT,
+                                       tile.second / MeshSettings::TilesPerADT};
+
+        if (adts.find(adt) == adts.end())
+            others.insert(adt);
+    }
+
+    SkipADTs(others);
+}
+
+void MeshBuilder::MergeShard(const fs::path& shardPath)
+{
+    auto const nav = shardPath / "Nav" / m_map->Name;
+
+    if (!fs::is_directory(nav))
+        THROW(Result::INVALID_SHARD);
+
+    // partially written files and the manifest of an incremental build are
+    // left behind
+    for (auto const& entry : fs::directory_iterator(nav))
+    {
+        auto const extension = entry.path().extension();
+
+        if (!entry.is_regular_file() ||
+            (extension != ".nav" && extension != ".portals"))
+            continue;
+
+        fs::copy_file(entry.path(),
+                      m_outputPath / "Nav" / m_map->Name /
+                          entry.path().filename(),
+                      fs::copy_options::overwrite_existing);
+    }
+
+    m_bvhConstructor.Merge(shardPath);
+}
+
+void MeshBuilder::OmitHeightFields(float radius)
+{
+    m_heightFieldRadius = (std::max)(0.f, (std::min)(MeshSettings::AdtSize,
+                                                     radius));
+}
+
+bool MeshBuilder::NeedsHeightField(int tileX, int tileY) const
+{
+    if (m_heightFieldRadius < 0.f)
+        return true;
+
+    // the northwest corner is where world x and y are greatest
+    float maxX, maxY;
+    math::Convert::TileToWorldNorthwestCorner(tileX, tileY, maxX, maxY);
+
+    auto const minX = maxX - MeshSettings::TileSize;
+    auto const minY = maxY - MeshSettings::TileSize;
+
+    // the distance in two dimensions from each object to the tile
+    for (auto const& instance : m_gameObjectInstances)
+    {
+        auto const x = instance.m_position[0];
+        auto const y = instance.m_position[1];
+        auto const dx = (std::max)({0.f, minX - x, x - maxX});
+        auto const dy = (std::max)({0.f, minY - y, y - maxY});
+
+        if (dx * dx + dy * dy <= m_heightFieldRadius * m_heightFieldRadius)
+            return true;
+    }
+
+    return false;
+}
+
+void MeshBuilder::SetRegionPartition(RegionPartition partition)
+{
+    m_regionPartition = partition;
+
+    if (m_globalWMO)
+        m_globalWMO->SetRegionPartition(partition);
+}
+
+bool MeshBuilder::FindRegionPartition(const std::string& name,
+                                      RegionPartition& partition)
+{
+    static const std::pair<const char*, RegionPartition> names[] = {
+        {"watershed", RegionPartition::Watershed},
+        {"monotone", RegionPartition::Monotone},
+        {"layers", RegionPartition::Layers},
+    };
+
+    for (auto const& entry : names)
+        if (name == entry.first)
+        {
+            partition = entry.second;
+            return true;
+        }
+
+    return false;
+}
+
+void MeshBuilder::CompressNavFiles(int level)
+{
+    m_compressionLevel = (std::max)(0, (std::min)(9, level));
+}
+
+void MeshBuilder::RemovePendingADTs(const std::set<std::pair<int, int>>& adts)
+{
+    std::vector<std::pair<int, int>> pending;
+
+    for (auto const& tile : m_pendingTiles)
+    {
+        if (adts.find({tile.first / MeshSettings::TilesPerADT,
+                       tile.second / MeshSettings::TilesPerADT}) == adts.end())
+        {
+            pending.push_back(tile);
+            continue;
+        }
+
+        std::vector<std::pair<int, int>> chunks;
+        ComputeRequiredChunks(m_map.get(), tile.first, tile.second, chunks);
+
+        for (auto const& chunk : chunks)
+            RemoveChunkReference(chunk.first, chunk.second);
+    }
+
+    m_pendingTiles = std::move(pending);
+    m_totalTiles = m_pendingTiles.size();
+}
+
+void MeshBuilder::SkipADTs(const std::set<std::pair<int, int>>& adts)
+{
+    if (adts.empty())
+        return;
+
+    RemovePendingADTs(adts);
+
+    // the ADTs are still parsed, which is far cheaper than building them, so
+    // that their WMO and doodad instances are included in the .map file
+    for (auto const& adt : adts)
+    {
+        m_map->GetAdt(adt.first, adt.second);
+
+        auto const index = adt.second * MeshSettings::Adts + adt.first;
+        if (!m_adtReferences[index].load(std::memory_order_relaxed))
+            m_map->UnloadAdt(adt.first, adt.second);
+    }
+}
+
+void MeshBuilder::RecordFingerprint(int adtX, int adtY)
+{
+    auto const fingerprint = m_fingerprints.find({adtX, adtY});
+
+    if (fingerprint == m_fingerprints.end() || !fingerprint->second)
+        return;
+
+    m_manifest[{adtX, adtY}] = fingerprint->second;
+
+    // appended as each ADT is finished, so that an interrupted build loses
+    // none of them.  a later line for the same ADT replaces an earlier one
+    std::ofstream out(ManifestPath(), std::ofstream::app);
+    out << std::setw(2) << std::setfill('0') << adtX << "_" << std::setw(2)
+        << std::setfill('0') << adtY << " " << std::hex << std::setw(16)
+        << fingerprint->second << std::endl;
+}
+
+bool MeshBuilder::GetNextTile(int& tileX, int& tileY)
+{
+    if (m_cancelled)
+        return false;
+
+    // the tiles are not modified once the builder is constructed
+    auto const next = m_nextTile.fetch_add(1, std::memory_order_relaxed);
+
+    if (next >= m_pendingTiles.size())
+        return false;
+
+    auto const& tile = m_pendingTiles[m_pendingTiles.size() - 1 - next];
+
+    tileX = tile.first;
+    tileY = tile.second;
+
+    return true;
+}
+
+bool MeshBuilder::IsGlobalWMO() const
+{
+    return !!m_map->GetGlobalWmoInstance();
+}
 
 void MeshBuilder::AddChunkReference(int chunkX, int chunkY)
 {
-    assert(chunkX >= 0 && chunkY >= 0 && chunkX < MeshSettings::ChunkCount &&
-           chunkY < MeshSettings::ChunkCount);
-    ++m_chunkReferences[chunkY * MeshSettings::ChunkCount + chunkX];
+    assert(chunkX >= 0 && chunkY >= 0 && chunkX < MeshSettings::ChunkCount &&
+           chunkY < MeshSettings::ChunkCount);
+
+    auto const adtX = chunkX / MeshSettings::ChunksPerAdt;
+    auto const adtY = chunkY / MeshSettings::ChunksPerAdt;
+
+    m_adtReferences[adtY * MeshSettings::Adts + adtX].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+void MeshBuilder::RemoveChunkReference(int chunkX, int chunkY)
+{
+    auto const adtX = chunkX / MeshSettings::ChunksPerAdt;
+    auto const adtY = chunkY / MeshSettings::ChunksPerAdt;
+
+    // the last reference to any chunk of this ADT unloads it.  the release
+    // ordering ensures every other tile is finished with the ADT by then
+    if (m_adtReferences[adtY * MeshSettings::Adts + adtX].fetch_sub(
+            1, std::memory_order_acq_rel) == 1)
+    {
+#ifdef _DEBUG
+        std::stringstream str;
+        str << "No threads need ADT (" << std::setfill(' ') << std::setw(2)
+            << adtX << ", " << std::setfill(' ') << std::setw(2) << adtY
+            << ").  Unloading.\n";
+        std::cout << str.str();
+#endif
+
+        m_map->UnloadAdt(adtX, adtY);
+        EvictGeometry();
+    }
+}
+
+void MeshBuilder::InstanceGeometry::AddTriangles(
+    const rcConfig& config, float originX, float originZ,
+    const std::vector<int>& indices, const std::vector<unsigned char>& areas,
+    unsigned int threads)
+{
+    using Tiles = std::map<std::pair<int, int>, TileTriangles>;
+
+    auto const border = config.borderSize * config.cs;
+
+    auto const sort = [&](size_t first, size_t last, Tiles& tiles)
+    {
+        for (auto t = first; t < last; ++t)
+        {
+            auto const v0 = &m_vertices[indices[t * 3 + 0] * 3];
+            auto const v1 = &m_vertices[indices[t * 3 + 1] * 3];
+            auto const v2 = &m_vertices[indices[t * 3 + 2] * 3];
+
+            auto const minX = (std::min)({v0[0], v1[0], v2[0]}) - originX;
+            auto const maxX = (std::max)({v0[0], v1[0], v2[0]}) - originX;
+            auto const minZ = (std::min)({v0[2], v1[2], v2[2]}) - originZ;
+            auto const maxZ = (std::max)({v0[2], v1[2], v2[2]}) - originZ;
+
+            // every tile whose bounds, widened by the border, the triangle's
+            // bounds touch
+            auto const firstX = static_cast<int>(
+                std::ceil((minX - border) / MeshSettings::TileSize - 1.f));
+            auto const lastX = static_cast<int>(
+                std::floor((maxX + border) / MeshSettings::TileSize));
+            auto const firstY = static_cast<int>(
+                std::ceil((minZ - border) / MeshSettings::TileSize - 1.f));
+            auto const lastY = static_cast<int>(
+                std::floor((maxZ + border) / MeshSettings::TileSize));
+
+            for (auto y = firstY; y <= lastY; ++y)
+                for (auto x = firstX; x <= lastX; ++x)
+                {
+                    auto& tile = tiles[{x, y}];
+
+                    tile.m_indices.insert(tile.m_indices.end(),
+                                          &indices[t * 3],
+                                          &indices[t * 3] + 3);
+                    tile.m_areas.push_back(areas[t]);
+                }
+        }
+    };
+
+    auto const count = areas.size();
+
+    // below this, starting the threads costs more than they save
+    constexpr size_t ParallelTriangles = 0x10000;
+
+    if (threads < 2 || count < ParallelTriangles)
+    {
+        sort(0, count, m_tiles);
+        return;
+    }
+
+    // each thread sorts a run of the triangles into tiles of its own
+    std::vector<Tiles> parts(threads);
+    std::vector<std::future<void>> tasks;
+
+    for (auto i = 1u; i < threads; ++i)
+        tasks.push_back(std::async(std::launch::async,
+                                   [&, i]()
+                                   {
+                                       sort(count * i / threads,
+                                            count * (i + 1) / threads,
+                                            parts[i]);
+                                   }));
+
+    sort(0, count / threads, parts[0]);
+
+    for (auto& task : tasks)
+        task.get();
+
+    // the runs are joined in order, so that every tile lists its triangles as
+    // they would have been listed by one thread
+    for (auto& part : parts)
+        for (auto& tile : part)
+        {
+            auto& triangles = m_tiles[tile.first];
+
+            triangles.m_indices.insert(triangles.m_indices.end(),
+                                       tile.second.m_indices.begin(),
+                                       tile.second.m_indices.end());
+            triangles.m_areas.insert(triangles.m_areas.end(),
+                                     tile.second.m_areas.begin(),
+                                     tile.second.m_areas.end());
+        }
+}
+
+std::shared_ptr<MeshBuilder::InstanceGeometry>
+MeshBuilder::BuildWmoGeometry(rcContext& ctx, const rcConfig& config,
+                              float originX, float originZ,
+                              const parser::WmoInstance& instance,
+                              unsigned int threads)
+{
+    auto geometry = std::make_shared<InstanceGeometry>();
+
+    std::vector<int> allIndices;
+    std::vector<unsigned char> areas;
+
+    auto const slope = config.walkableSlopeAngle;
+    auto const& model = *instance.Model;
+
+    AppendTriangles(ctx, slope, model.Vertices, instance.TransformMatrix,
+                    model.Indices, PolyFlags::Wmo, geometry->m_vertices,
+                    allIndices, areas);
+
+    AppendTriangles(ctx, slope, model.LiquidVertices, instance.TransformMatrix,
+                    model.LiquidIndices, PolyFlags::Wmo | PolyFlags::Liquid,
+                    geometry->m_vertices, allIndices, areas);
+
+    // a wmo may name a doodad set which it does not have, as in outlands (ADT
+    // 18, 37)
+    if (instance.DoodadSet < model.DoodadSets.size())
+        for (auto const& doodad : model.DoodadSets[instance.DoodadSet])
+            AppendTriangles(ctx, slope, doodad->Parent->Vertices,
+                            instance.TransformMatrix * doodad->TransformMatrix,
+                            doodad->Parent->Indices, PolyFlags::Doodad,
+                            geometry->m_vertices, allIndices, areas);
+
+    geometry->AddTriangles(config, originX, originZ, allIndices, areas,
+                           threads);
+
+    for (auto const& chunk : instance.AdtChunks)
+        geometry->m_adts.push_back(chunk.AdtY * MeshSettings::Adts +
+                                   chunk.AdtX);
+
+    return geometry;
+}
+
+std::shared_ptr<const MeshBuilder::InstanceGeometry>
+MeshBuilder::GetWmoGeometry(rcContext& ctx, const rcConfig& config,
+                            std::uint32_t id,
+                            const parser::WmoInstance& instance)
+{
+    {
+        auto const guard = Lock(m_geometryMutex);
+
+        auto const cached = m_wmoGeometry.find(id);
+        if (cached != m_wmoGeometry.end())
+            return cached->second;
+    }
+
+    auto const origin = -32.f * MeshSettings::AdtSize;
+    auto geometry = BuildWmoGeometry(ctx, config, origin, origin, instance);
+
+    auto const guard = Lock(m_geometryMutex);
+
+    // should another tile have built it meanwhile, theirs is kept
+    return m_wmoGeometry.emplace(id, std::move(geometry)).first->second;
+}
+
+std::shared_ptr<const MeshBuilder::InstanceGeometry>
+MeshBuilder::GetDoodadGeometry(rcContext& ctx, const rcConfig& config,
+                               std::uint32_t id,
+                               const parser::DoodadInstance& instance)
+{
+    {
+        auto const guard = Lock(m_geometryMutex);
+
+        auto const cached = m_doodadGeometry.find(id);
+        if (cached != m_doodadGeometry.end())
+            return cached->second;
+    }
+
+    auto geometry = std::make_shared<InstanceGeometry>();
+
+    std::vector<int> allIndices;
+    std::vector<unsigned char> areas;
+
+    AppendTriangles(ctx, config.walkableSlopeAngle, instance.Model->Vertices,
+                    instance.TransformMatrix, instance.Model->Indices,
+                    PolyFlags::Doodad, geometry->m_vertices, allIndices, areas);
+
+    auto const origin = -32.f * MeshSettings::AdtSize;
+    geometry->AddTriangles(config, origin, origin, allIndices, areas);
+
+    for (auto const& chunk : instance.AdtChunks)
+        geometry->m_adts.push_back(chunk.AdtY * MeshSettings::Adts +
+                                   chunk.AdtX);
+
+    auto const guard = Lock(m_geometryMutex);
+
+    return m_doodadGeometry.emplace(id, std::move(geometry)).first->second;
+}
+
+bool MeshBuilder::Rasterize(rcContext& ctx, rcHeightfield& heightField,
+                            const InstanceGeometry& geometry, int tileX,
+                            int tileY)
+{
+    auto const tile = geometry.m_tiles.find({tileX, tileY});
+
+    if (tile == geometry.m_tiles.end())
+        return true;
+
+    return rcRasterizeTriangles(
+        &ctx, &geometry.m_vertices[0],
+        static_cast<int>(geometry.m_vertices.size() / 3),
+        &tile->second.m_indices[0], &tile->second.m_areas[0],
+        static_cast<int>(tile->second.m_areas.size()), heightField, -1);
+}
+
+void MeshBuilder::SerializeWmoFloors(
+    rcContext& ctx, const rcConfig& config, int tileX, int tileY,
+    const std::unordered_set<std::uint32_t>& wmos, utility::BinaryStream& out)
+{
+    auto constexpr cells = MeshSettings::WmoFloorCells;
+    auto constexpr cellSize = MeshSettings::TileSize / cells;
+
+    auto const originX =
+        tileX * MeshSettings::TileSize - 32.f * MeshSettings::AdtSize;
+    auto const originZ =
+        tileY * MeshSettings::TileSize - 32.f * MeshSettings::AdtSize;
+
+    float floors[cells][cells];
+    for (auto& row : floors)
+        for (auto& floor : row)
+            floor = (std::numeric_limits<float>::max)();
+
+    // the geometry includes the doodads and liquid of the WMO, which may
+    // only lower a floor.  that is harmless, since below the floor the
+    // pathfind library answers from the terrain alone, and above it falls
+    // back to casting a ray
+    auto const toCell = [](float coordinate) {
+        return static_cast<int>(std::floor(coordinate / cellSize));
+    };
+
+    for (auto const wmoId : wmos)
+    {
+        auto const geometry = GetWmoGeometry(ctx, config, wmoId,
+                                             *m_map->GetWmoInstance(wmoId));
+
+        auto const tile = geometry->m_tiles.find({tileX, tileY});
+
+        if (tile == geometry->m_tiles.end())
+            continue;
+
+        auto const& indices = tile->second.m_indices;
+        auto const vertices = &geometry->m_vertices[0];
+
+        for (auto i = 0u; i < indices.size(); i += 3)
+        {
+            auto const a = &vertices[3 * indices[i + 0]];
+            auto const b = &vertices[3 * indices[i + 1]];
+            auto const c = &vertices[3 * indices[i + 2]];
+
+            auto const minX = (std::max)(
+                0, toCell((std::min)({a[0], b[0], c[0]}) - originX));
+            auto const maxX = (std::min)(
+                cells - 1, toCell((std::max)({a[0], b[0], c[0]}) - originX));
+            auto const minZ = (std::max)(
+                0, toCell((std::min)({a[2], b[2], c[2]}) - originZ));
+            auto const maxZ = (std::min)(
+                cells - 1, toCell((std::max)({a[2], b[2], c[2]}) - originZ));
+
+            auto const bottom = (std::min)({a[1], b[1], c[1]});
+
+            for (auto x = minX; x <= maxX; ++x)
+                for (auto z = minZ; z <= maxZ; ++z)
+                    floors[x][z] = (std::min)(floors[x][z], bottom);
+        }
+    }
+
+    out.Write(floors, sizeof(floors));
+}
+
+void MeshBuilder::SerializeLiquids(
+    rcContext& ctx, const rcConfig& config, const parser::AdtChunk& chunk,
+    int tileX, int tileY, const std::unordered_set<std::uint32_t>& wmos,
+    utility::BinaryStream& out)
+{
+    auto constexpr cells = MeshSettings::LiquidCells;
+    auto constexpr cellSize = MeshSettings::TileSize / cells;
+    auto constexpr quadSize = MeshSettings::AdtSize / 128.f;
+
+    auto const originX =
+        tileX * MeshSettings::TileSize - 32.f * MeshSettings::AdtSize;
+    auto const originZ =
+        tileY * MeshSettings::TileSize - 32.f * MeshSettings::AdtSize;
+
+    struct Surface
+    {
+        float m_height;
+        LiquidType m_type;
+    };
+
+    // cell x + z * cells is the x-th along recast x and the z-th along z
+    std::vector<std::vector<Surface>> columns(cells * cells);
+
+    // the ADT liquid, as BuildLiquid() triangulates it, which is only where
+    // there is terrain
+    if (chunk.m_hasTerrain)
+        for (auto const& layer : chunk.m_liquidLayers)
+            for (auto z = 0; z < cells; ++z)
+                for (auto x = 0; x < cells; ++x)
+                {
+                    // the rows of quads run south, and their columns east
+                    auto const row =
+                        (chunk.m_originX + originZ + (z + 0.5f) * cellSize) /
+                        quadSize;
+                    auto const column =
+                        (chunk.m_originY + originX + (x + 0.5f) * cellSize) /
+                        quadSize;
+
+                    auto const qy = (std::max)(
+                        0, (std::min)(7, static_cast<int>(row)));
+                    auto const qx = (std::max)(
+                        0, (std::min)(7, static_cast<int>(column)));
+
+                    if (!(layer.m_quads & (1ull << (qy * 8 + qx))))
+                        continue;
+
+                    auto const u = column - qx;
+                    auto const v = row - qy;
+
+                    // each quad is split from its (1, 0) corner to (0, 1)
+                    auto const height =
+                        u + v <= 1.f
+                            ? layer.GetHeight(qx, qy) +
+                                  u * (layer.GetHeight(qx + 1, qy) -
+                                       layer.GetHeight(qx, qy)) +
+                                  v * (layer.GetHeight(qx, qy + 1) -
+                                       layer.GetHeight(qx, qy))
+                            : layer.GetHeight(qx + 1, qy + 1) +
+                                  (1.f - u) *
+                                      (layer.GetHeight(qx, qy + 1) -
+                                       layer.GetHeight(qx + 1, qy + 1)) +
+                                  (1.f - v) *
+                                      (layer.GetHeight(qx + 1, qy) -
+                                       layer.GetHeight(qx + 1, qy + 1));
+
+                    columns[x + z * cells].push_back({height, layer.m_type});
+                }
+
+    // the liquid of the WMOs, whose type is not kept by the parser
+    auto const toCell = [](float coordinate) {
+        return static_cast<int>(std::floor(coordinate / cellSize - 0.5f));
+    };
+
+    for (auto const wmoId : wmos)
+    {
+        auto const geometry = GetWmoGeometry(ctx, config, wmoId,
+                                             *m_map->GetWmoInstance(wmoId));
+
+        auto const tile = geometry->m_tiles.find({tileX, tileY});
+
+        if (tile == geometry->m_tiles.end())
+            continue;
+
+        auto const& indices = tile->second.m_indices;
+        auto const& areas = tile->second.m_areas;
+        auto const vertices = &geometry->m_vertices[0];
+
+        for (auto i = 0u; i < areas.size(); ++i)
+        {
+            if (!(areas[i] & PolyFlags::Liquid))
+                continue;
+
+            auto const a = &vertices[3 * indices[3 * i + 0]];
+            auto const b = &vertices[3 * indices[3 * i + 1]];
+            auto const c = &vertices[3 * indices[3 * i + 2]];
+
+            // twice the signed area of the triangle in the xz plane
+            auto const area =
+                (b[0] - a[0]) * (c[2] - a[2]) - (c[0] - a[0]) * (b[2] - a[2]);
+
+            if (std::fabs(area) < 1e-6f)
+                continue;
+
+            auto const minX = (std::max)(
+                0, toCell((std::min)({a[0], b[0], c[0]}) - originX));
+            auto const maxX = (std::min)(
+                cells - 1,
+                toCell((std::max)({a[0], b[0], c[0]}) - originX) + 1);
+            auto const minZ = (std::max)(
+                0, toCell((std::min)({a[2], b[2], c[2]}) - originZ));
+            auto const maxZ = (std::min)(
+                cells - 1,
+                toCell((std::max)({a[2], b[2], c[2]}) - originZ) + 1);
+
+            for (auto z = minZ; z <= maxZ; ++z)
+                for (auto x = minX; x <= maxX; ++x)
+                {
+                    auto const px = originX + (x + 0.5f) * cellSize;
+                    auto const pz = originZ + (z + 0.5f) * cellSize;
+
+                    auto const wb = ((px - a[0]) * (c[2] - a[2]) -
+                                     (c[0] - a[0]) * (pz - a[2])) /
+                                    area;
+                    auto const wc = ((b[0] - a[0]) * (pz - a[2]) -
+                                     (px - a[0]) * (b[2] - a[2])) /
+                                    area;
+
+                    if (wb < 0.f || wc < 0.f || wb + wc > 1.f)
+                        continue;
+
+                    columns[x + z * cells].push_back(
+                        {a[1] + wb * (b[1] - a[1]) + wc * (c[1] - a[1]),
+                         LiquidType::Water});
+                }
+        }
+    }
+
+    std::vector<std::uint32_t> starts;
+    std::vector<float> heights;
+    std::vector<LiquidType> types;
+
+    for (auto& column : columns)
+    {
+        starts.push_back(static_cast<std::uint32_t>(heights.size()));
+
+        std::sort(column.begin(), column.end(),
+                  [](const Surface& a, const Surface& b)
+                  { return a.m_height > b.m_height; });
+
+        // a centre on the edge between triangles is found by both
+        for (auto const& surface : column)
+        {
+            if (heights.size() > starts.back() &&
+                heights.back() - surface.m_height < 0.01f &&
+                types.back() == surface.m_type)
+                continue;
+
+            heights.push_back(surface.m_height);
+            types.push_back(surface.m_type);
+        }
+    }
+
+    starts.push_back(static_cast<std::uint32_t>(heights.size()));
+
+    utility::BinaryStream result(
+        sizeof(std::uint32_t) * (1 + starts.size()) +
+        (sizeof(float) + sizeof(LiquidType)) * heights.size());
+
+    result << static_cast<std::uint32_t>(heights.size());
+
+    if (!heights.empty())
+    {
+        result.Write(&starts[0], sizeof(std::uint32_t) * starts.size());
+        result.Write(&heights[0], sizeof(float) * heights.size());
+        result.Write(&types[0], sizeof(LiquidType) * types.size());
+    }
+
+    out = std::move(result);
 }
 
-void MeshBuilder::RemoveChunkReference(int chunkX, int chunkY)
+bool MeshBuilder::RasterizeADTTiles(rcContext& ctx, rcHeightfield& heightField,
+                                    const InstanceGeometry& geometry,
+                                    int adtX, int adtY)
 {
-    auto const adtX = chunkX / MeshSettings::ChunksPerAdt;
-    auto const adtY = chunkY / MeshSettings::ChunksPerAdt;
+    auto const firstX = adtX * MeshSettings::TilesPerADT;
+    auto const firstY = adtY * MeshSettings::TilesPerADT;
 
-    std::lock_guard<std::mutex> guard(m_mutex);
-    --m_chunkReferences[chunkY * MeshSettings::ChunkCount + chunkX];
+    // the vertices and area of each triangle, so that those listed by more
+    // than one tile can be found once sorted
+    std::vector<std::array<int, 4>> triangles;
+
+    for (auto const& tile : geometry.m_tiles)
+    {
+        if (tile.first.first < firstX ||
+            tile.first.first >= firstX + MeshSettings::TilesPerADT ||
+            tile.first.second < firstY ||
+            tile.first.second >= firstY + MeshSettings::TilesPerADT)
+            continue;
+
+        auto const& indices = tile.second.m_indices;
+
+        for (auto t = 0u; t < tile.second.m_areas.size(); ++t)
+            triangles.push_back({indices[t * 3 + 0], indices[t * 3 + 1],
+                                 indices[t * 3 + 2], tile.second.m_areas[t]});
+    }
 
-    // check to see if all chunks on this ADT are without references.  if so,
-    // unload the ADT
-    bool unload = true;
-    for (int x = 0; x < MeshSettings::ChunksPerAdt; ++x)
-        for (int y = 0; y < MeshSettings::ChunksPerAdt; ++y)
+    if (triangles.empty())
+        return true;
+
+    std::sort(triangles.begin(), triangles.end());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()),
+                    triangles.end());
+
+    std::vector<int> indices;
+    std::vector<unsigned char> areas;
+
+    indices.reserve(triangles.size() * 3);
+    areas.reserve(triangles.size());
+
+    for (auto const& triangle : triangles)
+    {
+        indices.insert(indices.end(), triangle.begin(), triangle.begin() + 3);
+        areas.push_back(static_cast<unsigned char>(triangle[3]));
+    }
+
+    return rcRasterizeTriangles(
+        &ctx, &geometry.m_vertices[0],
+        static_cast<int>(geometry.m_vertices.size() / 3), &indices[0],
+        &areas[0], static_cast<int>(areas.size()), heightField, -1);
+}
+
+bool MeshBuilder::RasterizeADT(RecastContext& ctx, int adtX, int adtY,
+                               rcHeightfield& heightField)
+{
+    ctx.StartStage(RecastContext::ChunkLoad);
+
+    // every chunk needed by any tile of the ADT.  they are all still loaded,
+    // since each tile keeps a reference to its chunks until it is built, and
+    // none of the ADT's tiles can be built before this is done
+    std::set<std::pair<int, int>> chunkPositions;
+
+    for (auto y = 0; y < MeshSettings::TilesPerADT; ++y)
+        for (auto x = 0; x < MeshSettings::TilesPerADT; ++x)
+        {
+            std::vector<std::pair<int, int>> tileChunks;
+            ComputeRequiredChunks(m_map.get(),
+                                  adtX * MeshSettings::TilesPerADT + x,
+                                  adtY * MeshSettings::TilesPerADT + y,
+                                  tileChunks);
+
+            chunkPositions.insert(tileChunks.begin(), tileChunks.end());
+        }
+
+    float minZ = (std::numeric_limits<float>::max)(),
+          maxZ = std::numeric_limits<float>::lowest();
+
+    std::vector<const parser::AdtChunk*> chunks;
+    chunks.reserve(chunkPositions.size());
+
+    for (auto const& chunkPosition : chunkPositions)
+    {
+        auto const adt =
+            GetAdt(chunkPosition.first / MeshSettings::ChunksPerAdt,
+                   chunkPosition.second / MeshSettings::ChunksPerAdt);
+        auto const chunk =
+            adt->GetChunk(chunkPosition.first % MeshSettings::ChunksPerAdt,
+                          chunkPosition.second % MeshSettings::ChunksPerAdt);
+
+        minZ = (std::min)(minZ, chunk->m_minZ);
+        maxZ = (std::max)(maxZ, chunk->m_maxZ);
+
+        chunks.push_back(chunk);
+    }
+
+    ctx.StopStage(RecastContext::ChunkLoad);
+
+    rcConfig config;
+    InitializeRecastConfig(config, m_agent, BorderSize());
+
+    config.width = config.height =
+        MeshSettings::TilesPerADT * config.tileSize + config.borderSize * 2;
+
+    // laid out as the tiles are in BuildAndSerializeMapTile(), so that the
+    // columns of each tile are those of the ADT offset by a whole number
+    auto const border = config.borderSize * config.cs;
+    auto const firstTileX = adtX * MeshSettings::TilesPerADT;
+    auto const firstTileY = adtY * MeshSettings::TilesPerADT;
+
+    config.bmin[0] = firstTileX * MeshSettings::TileSize -
+                     32.f * MeshSettings::AdtSize - border;
+    config.bmin[1] = minZ;
+    config.bmin[2] = firstTileY * MeshSettings::TileSize -
+                     32.f * MeshSettings::AdtSize - border;
+
+    config.bmax[0] =
+        (firstTileX + MeshSettings::TilesPerADT) * MeshSettings::TileSize -
+        32.f * MeshSettings::AdtSize + border;
+    config.bmax[1] = maxZ;
+    config.bmax[2] =
+        (firstTileY + MeshSettings::TilesPerADT) * MeshSettings::TileSize -
+        32.f * MeshSettings::AdtSize + border;
+
+    if (!rcCreateHeightfield(&ctx, heightField, config.width, config.height,
+                             config.bmin, config.bmax, config.cs, config.ch))
+        return false;
+
+    std::unordered_set<std::uint32_t> rasterizedWmos;
+    std::unordered_set<std::uint32_t> rasterizedDoodads;
+
+    std::vector<math::Vertex> liquidVertices;
+    std::vector<int> liquidIndices;
+
+    for (auto const& chunk : chunks)
+    {
+        if (!RasterizeTerrain(ctx, heightField, config.walkableSlopeAngle,
+                              *chunk))
+            return false;
+
+        liquidVertices.clear();
+        liquidIndices.clear();
+        chunk->BuildLiquid(liquidVertices, liquidIndices);
+
+        if (!TransformAndRasterize(ctx, heightField, config.walkableSlopeAngle,
+                                   liquidVertices, liquidIndices,
+                                   PolyFlags::Liquid))
+            return false;
+
+        for (auto const& wmoId : chunk->m_wmoInstances)
         {
-            auto const globalChunkX = adtX * MeshSettings::ChunksPerAdt + x;
-            auto const globalChunkY = adtY * MeshSettings::ChunksPerAdt + y;
+            if (!rasterizedWmos.insert(wmoId).second)
+                continue;
 
-            if (m_chunkReferences[globalChunkY * MeshSettings::ChunkCount +
-                                  globalChunkX] > 0)
+            auto const wmoInstance = m_map->GetWmoInstance(wmoId);
+
+            if (!wmoInstance)
             {
-                unload = false;
-                break;
+                std::stringstream str;
+                str << "Could not find required WMO ID = " << wmoId
+                    << " needed by ADT (" << adtX << ", " << adtY << ")";
+
+                THROW_MSG(str.str(), Result::COULD_NOT_FIND_WMO);
             }
+
+            ctx.StartStage(RecastContext::Geometry);
+            auto const geometry =
+                GetWmoGeometry(ctx, config, wmoId, *wmoInstance);
+            ctx.StopStage(RecastContext::Geometry);
+
+            if (!RasterizeADTTiles(ctx, heightField, *geometry, adtX, adtY))
+                return false;
         }
 
-    if (unload)
-    {
-#ifdef _DEBUG
-        std::stringstream str;
-        str << "No threads need ADT (" << std::setfill(' ') << std::setw(2)
-            << adtX << ", " << std::setfill(' ') << std::setw(2) << adtY
-            << ").  Unloading.\n";
-        std::cout << str.str();
-#endif
+        for (auto const& doodadId : chunk->m_doodadInstances)
+        {
+            if (!rasterizedDoodads.insert(doodadId).second)
+                continue;
 
-        m_map->UnloadAdt(adtX, adtY);
+            auto const doodadInstance = m_map->GetDoodadInstance(doodadId);
+
+            assert(!!doodadInstance);
+
+            ctx.StartStage(RecastContext::Geometry);
+            auto const geometry =
+                GetDoodadGeometry(ctx, config, doodadId, *doodadInstance);
+            ctx.StopStage(RecastContext::Geometry);
+
+            if (!RasterizeADTTiles(ctx, heightField, *geometry, adtX, adtY))
+                return false;
+        }
     }
+
+    return true;
 }
 
-void MeshBuilder::SerializeWmo(const parser::Wmo& wmo)
+bool MeshBuilder::CopyADTHeightField(RecastContext& ctx, rcConfig& config,
+                                     int tileX, int tileY,
+                                     rcHeightfield& heightField)
 {
-    if (m_bvhWmos.find(wmo.MpqPath) != m_bvhWmos.end())
-        return;
+    auto const adtX = tileX / MeshSettings::TilesPerADT;
+    auto const adtY = tileY / MeshSettings::TilesPerADT;
 
-    meshfiles::SerializeWmo(wmo, m_bvhConstructor);
+    std::shared_ptr<ADTHeightField> adt;
 
-    // the above serialization routine will also serialize all doodads in all
-    // doodad sets for this wmo, therefore we should mark them as serialized
+    {
+        auto const guard = Lock(m_geometryMutex);
 
-    for (auto const& doodadSet : wmo.DoodadSets)
-        for (auto const& wmoDoodad : doodadSet)
-            m_bvhDoodads.insert(wmoDoodad->Parent->MpqPath);
+        auto& entry = m_adtHeightFields[{adtX, adtY}];
+
+        if (!entry)
+            entry = std::make_shared<ADTHeightField>();
+
+        adt = entry;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(adt->m_mutex);
+
+        if (!adt->m_rasterized)
+        {
+            SmartHeightFieldPtr solid(rcAllocHeightfield(), rcFreeHeightField);
+
+            if (RasterizeADT(ctx, adtX, adtY, *solid))
+                adt->m_heightField = std::move(solid);
+
+            adt->m_rasterized = true;
+        }
+    }
+
+    auto result = false;
+
+    // once rasterized, the heightfield of the ADT is only read
+    if (auto const source = adt->m_heightField.get())
+    {
+        config.bmin[1] = source->bmin[1];
+        config.bmax[1] = source->bmax[1];
+
+        result = rcCreateHeightfield(&ctx, heightField, config.width,
+                                     config.height, config.bmin, config.bmax,
+                                     config.cs, config.ch);
+
+        auto const offsetX =
+            (tileX % MeshSettings::TilesPerADT) * config.tileSize;
+        auto const offsetY =
+            (tileY % MeshSettings::TilesPerADT) * config.tileSize;
+
+        ctx.StartStage(RecastContext::Rasterize);
+
+        // spans within a column never overlap, so none of these are merged
+        for (auto y = 0; result && y < heightField.height; ++y)
+            for (auto x = 0; x < heightField.width; ++x)
+                for (auto s = source->spans[(y + offsetY) * source->width +
+                                            x + offsetX];
+                     s; s = s->next)
+                    rcAddSpan(&ctx, heightField, x, y, s->smin, s->smax,
+                              s->area, 0);
+
+        ctx.StopStage(RecastContext::Rasterize);
+    }
 
-    m_bvhWmos.insert(wmo.MpqPath);
+    auto const guard = Lock(m_geometryMutex);
+
+    if (++adt->m_copiedTiles ==
+        MeshSettings::TilesPerADT * MeshSettings::TilesPerADT)
+        m_adtHeightFields.erase({adtX, adtY});
+
+    return result;
 }
 
-void MeshBuilder::SerializeDoodad(const parser::Doodad& doodad)
+void MeshBuilder::EvictGeometry()
 {
-    if (m_bvhDoodads.find(doodad.MpqPath) != m_bvhDoodads.end())
-        return;
+    // a tile holds references to every ADT whose chunks it reads, which
+    // include those of the instances on them.  so once none of an instance's
+    // ADTs are referenced, no tile yet to be built can need it
+    auto const unneeded = [this](const InstanceGeometry& geometry)
+    {
+        for (auto const adt : geometry.m_adts)
+            if (m_adtReferences[adt].load(std::memory_order_relaxed) > 0)
+                return false;
+
+        return true;
+    };
+
+    auto const guard = Lock(m_geometryMutex);
+
+    for (auto cache : {&m_wmoGeometry, &m_doodadGeometry})
+        for (auto i = cache->begin(); i != cache->end();)
+        {
+            if (unneeded(*i->second))
+                i = cache->erase(i);
+            else
+                ++i;
+        }
+}
 
-    meshfiles::SerializeDoodad(doodad,
-                               m_bvhConstructor.AddFile(doodad.MpqPath));
+void MeshBuilder::SerializeWmo(const parser::Wmo& wmo)
+{
+    // this also serializes all doodads in all doodad sets for this wmo
+    meshfiles::SerializeWmo(wmo, m_bvhConstructor);
+}
 
-    m_bvhDoodads.insert(doodad.MpqPath);
+void MeshBuilder::SerializeDoodad(const parser::Doodad& doodad)
+{
+    fs::path path;
+    if (m_bvhConstructor.ClaimFile(doodad.MpqPath, path))
+        meshfiles::SerializeDoodad(doodad, path);
 }
 
 bool MeshBuilder::BuildAndSerializeWMOTile(int tileX, int tileY)
 {
+    auto const start = std::chrono::steady_clock::now();
+
     auto const wmoInstance = m_map->GetGlobalWmoInstance();
 
     assert(!!wmoInstance);
 
-    SerializeWmo(*wmoInstance->Model);
+    // the BVH of the WMO is written by whichever worker gets here first,
+    // while the others carry on building tiles
+    if (!m_globalWMOSerialized.exchange(true))
+        SerializeWmo(*wmoInstance->Model);
 
     rcConfig config;
-    InitializeRecastConfig(config);
+    InitializeRecastConfig(config, m_agent, BorderSize());
 
     // tile coordinates are calculated offset from the northwest corner
     auto const westStart =
@@ -826,7 +2531,7 @@ bool MeshBuilder::BuildAndSerializeWMOTile(int tileX, int tileY)
     config.bmax[0] += config.borderSize * config.cs;
     config.bmax[2] += config.borderSize * config.cs;
 
-    RecastContext ctx(m_logLevel);
+    RecastContext ctx(m_logLevel, m_profile);
 
     SmartHeightFieldPtr solid(rcAllocHeightfield(), rcFreeHeightField);
 
@@ -834,62 +2539,56 @@ bool MeshBuilder::BuildAndSerializeWMOTile(int tileX, int tileY)
                              config.bmin, config.bmax, config.cs, config.ch))
         return false;
 
-    // wmo terrain
-    if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                               m_globalWMOVertices, m_globalWMOIndices,
-                               PolyFlags::Wmo))
-        return false;
-
-    // wmo liquid
-    if (!TransformAndRasterize(
-            ctx, *solid, config.walkableSlopeAngle, m_globalWMOLiquidVertices,
-            m_globalWMOLiquidIndices, PolyFlags::Wmo | PolyFlags::Liquid))
-        return false;
-
-    // wmo doodads
-    if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                               m_globalWMODoodadVertices,
-                               m_globalWMODoodadIndices, PolyFlags::Doodad))
+    // wmo terrain, liquid and doodads
+    if (!Rasterize(ctx, *solid, *m_globalWMOGeometry, tileX, tileY))
         return false;
 
     auto const solidEmpty = IsHeightFieldEmpty(*solid);
 
     if (!solidEmpty)
     {
-        FilterGroundBeneathLiquid(*solid);
-
-        // note that no area id preservation is necessary here because we have
-        // no ADT terrain
-        rcFilterLedgeSpans(&ctx, config.walkableHeight, config.walkableClimb,
-                           *solid);
-        rcFilterWalkableLowHeightSpans(&ctx, config.walkableHeight, *solid);
-        rcFilterLowHangingWalkableObstacles(&ctx, config.walkableClimb, *solid);
+        pathfind::FilterGroundBeneathLiquid(*solid);
+        pathfind::FilterWalkableSpans(ctx, config.walkableHeight,
+                                      config.walkableClimb, *solid);
     }
 
     // serialize heightfield for this tile
+    ctx.StartStage(RecastContext::Serialize);
     utility::BinaryStream heightFieldData(
         sizeof(std::uint32_t) * (10 + 3 * (solid->width * solid->height)));
 
     if (!solidEmpty)
-        SerializeHeightField(*solid, heightFieldData);
+        SerializeHeightField(*solid, true, heightFieldData);
+    ctx.StopStage(RecastContext::Serialize);
 
     // serialize final navmesh tile
     utility::BinaryStream meshData(0);
     if (!solidEmpty)
     {
         auto const result =
-            SerializeMeshTile(ctx, config, tileX, tileY, *solid, meshData);
+            SerializeMeshTile(ctx, config, m_agent, m_regionPartition, tileX,
+                              tileY, *solid, m_offMeshConnections, meshData);
         assert(result);
     }
 
-    std::lock_guard<std::mutex> guard(m_mutex);
+    auto const guard = Lock(m_mutex);
 
     if (!solidEmpty)
         m_globalWMO->AddTile(tileX, tileY, heightFieldData, meshData);
 
     if (++m_completedTiles == m_totalTiles)
     {
-        m_globalWMO->Serialize(m_outputPath / "Nav" / m_map->Name / "Map.nav");
+        ctx.StartStage(RecastContext::Serialize);
+        auto const filename = m_outputPath / "Nav" / m_map->Name / "Map.nav";
+
+        m_globalWMO->Serialize(filename);
+
+        if (m_compressionLevel > 0)
+            meshfiles::CompressNavFile(
+                filename, m_compressionLevel,
+                Result::WMO_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
+
+        ctx.StopStage(RecastContext::Serialize);
 
 #ifdef _DEBUG
         std::stringstream log;
@@ -898,11 +2597,18 @@ bool MeshBuilder::BuildAndSerializeWMOTile(int tileX, int tileY)
 #endif
     }
 
+    RecordFinishedTile(tileX, tileY);
+    RecordProfile(ctx, tileX, tileY, start);
+
     return true;
 }
 
 bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
 {
+    auto const start = std::chrono::steady_clock::now();
+
+    RecastContext ctx(m_logLevel, m_profile);
+
     float minZ = (std::numeric_limits<float>::max)(),
           maxZ = std::numeric_limits<float>::lowest();
 
@@ -912,6 +2618,8 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
 
     ComputeRequiredChunks(m_map.get(), tileX, tileY, chunkPositions);
 
+    ctx.StartStage(RecastContext::ChunkLoad);
+
     chunks.reserve(chunkPositions.size());
     for (auto const& chunkPosition : chunkPositions)
     {
@@ -923,7 +2631,7 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
         assert(adtX >= 0 && adtY >= 0 && adtX < MeshSettings::Adts &&
                adtY < MeshSettings::Adts);
 
-        auto const adt = m_map->GetAdt(adtX, adtY);
+        auto const adt = GetAdt(adtX, adtY);
         auto const chunk = adt->GetChunk(chunkX, chunkY);
 
         minZ = (std::min)(minZ, chunk->m_minZ);
@@ -932,13 +2640,15 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
         chunks.push_back(chunk);
     }
 
+    ctx.StopStage(RecastContext::ChunkLoad);
+
     // because ComputeRequiredChunks places the chunk that this tile falls on at
     // the start of the collection, we know that the first element in the
     // 'chunks' collection is also the chunk upon which this tile falls.
     auto const tileChunk = chunks[0];
 
     rcConfig config;
-    InitializeRecastConfig(config);
+    InitializeRecastConfig(config, m_agent, BorderSize());
 
     config.bmin[0] =
         tileX * MeshSettings::TileSize - 32.f * MeshSettings::AdtSize;
@@ -964,32 +2674,48 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
     config.bmax[0] += config.borderSize * config.cs;
     config.bmax[2] += config.borderSize * config.cs;
 
-    RecastContext ctx(m_logLevel);
-
     SmartHeightFieldPtr solid(rcAllocHeightfield(), rcFreeHeightField);
 
-    if (!rcCreateHeightfield(&ctx, *solid, config.width, config.height,
-                             config.bmin, config.bmax, config.cs, config.ch))
+    auto const shared = m_shareADTHeightFields;
+
+    if (shared)
+    {
+        if (!CopyADTHeightField(ctx, config, tileX, tileY, *solid))
+            return false;
+    }
+    else if (!rcCreateHeightfield(&ctx, *solid, config.width, config.height,
+                                  config.bmin, config.bmax, config.cs,
+                                  config.ch))
         return false;
 
     std::unordered_set<std::uint32_t> rasterizedWmos;
     std::unordered_set<std::uint32_t> rasterizedDoodads;
 
     // incrementally rasterize mesh geometry into the height field, setting poly
-    // flags as appropriate
+    // flags as appropriate.  when it was copied from the ADT's, this only
+    // finds the models which the tile uses
+    std::vector<math::Vertex> liquidVertices;
+    std::vector<int> liquidIndices;
+
     for (auto const& chunk : chunks)
     {
         // adt terrain
-        if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                                   chunk->m_terrainVertices,
-                                   chunk->m_terrainIndices, PolyFlags::Ground))
+        if (!shared &&
+            !RasterizeTerrain(ctx, *solid, config.walkableSlopeAngle, *chunk))
             return false;
 
-        // liquid
-        if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                                   chunk->m_liquidVertices,
-                                   chunk->m_liquidIndices, PolyFlags::Liquid))
-            return false;
+        // liquid, which is kept compactly until it is needed here
+        if (!shared)
+        {
+            liquidVertices.clear();
+            liquidIndices.clear();
+            chunk->BuildLiquid(liquidVertices, liquidIndices);
+
+            if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
+                                       liquidVertices, liquidIndices,
+                                       PolyFlags::Liquid))
+                return false;
+        }
 
         // wmos (and included doodads and liquid)
         for (auto const& wmoId : chunk->m_wmoInstances)
@@ -1016,24 +2742,16 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
             if (!tileBounds.intersect2d(wmoInstance->Bounds))
                 continue;
 
-            std::vector<math::Vertex> vertices;
-            std::vector<int> indices;
-
-            wmoInstance->BuildTriangles(vertices, indices);
-            if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                                       vertices, indices, PolyFlags::Wmo))
-                return false;
-
-            wmoInstance->BuildLiquidTriangles(vertices, indices);
-            if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                                       vertices, indices,
-                                       PolyFlags::Wmo | PolyFlags::Liquid))
-                return false;
+            if (!shared)
+            {
+                ctx.StartStage(RecastContext::Geometry);
+                auto const geometry =
+                    GetWmoGeometry(ctx, config, wmoId, *wmoInstance);
+                ctx.StopStage(RecastContext::Geometry);
 
-            wmoInstance->BuildDoodadTriangles(vertices, indices);
-            if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                                       vertices, indices, PolyFlags::Doodad))
-                return false;
+                if (!Rasterize(ctx, *solid, *geometry, tileX, tileY))
+                    return false;
+            }
 
             rasterizedWmos.insert(wmoId);
         }
@@ -1051,54 +2769,67 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
             if (!tileBounds.intersect2d(doodadInstance->Bounds))
                 continue;
 
-            std::vector<math::Vertex> vertices;
-            std::vector<int> indices;
+            if (!shared)
+            {
+                ctx.StartStage(RecastContext::Geometry);
+                auto const geometry =
+                    GetDoodadGeometry(ctx, config, doodadId, *doodadInstance);
+                ctx.StopStage(RecastContext::Geometry);
 
-            doodadInstance->BuildTriangles(vertices, indices);
-            if (!TransformAndRasterize(ctx, *solid, config.walkableSlopeAngle,
-                                       vertices, indices, PolyFlags::Doodad))
-                return false;
+                if (!Rasterize(ctx, *solid, *geometry, tileX, tileY))
+                    return false;
+            }
 
             rasterizedDoodads.insert(doodadId);
         }
     }
 
-    FilterGroundBeneathLiquid(*solid);
+    pathfind::FilterGroundBeneathLiquid(*solid);
 
-    // we don't want to filter ledge spans from ADT terrain.  this will restore
-    // the area for these spans, which we are using for flags
+    // the meshes of the other agents are built from copies of the height
+    // field as it was rasterized, each filtered and eroded for its own agent,
+    // before the original is filtered for the map's agent.  only the mesh of
+    // the map's agent has portals, and its height field is the one stored
+    std::vector<meshfiles::AgentMesh> agentMeshes(m_otherAgents.size());
+
+    for (auto i = 0u; i < m_otherAgents.size(); ++i)
     {
-        std::vector<std::pair<rcSpan*, unsigned int>> groundSpanAreas;
+        auto const& agent = *m_otherAgents[i];
+
+        rcConfig agentConfig;
+        InitializeRecastConfig(agentConfig, agent, config.borderSize);
+        memcpy(agentConfig.bmin, config.bmin, sizeof(config.bmin));
+        memcpy(agentConfig.bmax, config.bmax, sizeof(config.bmax));
 
-        groundSpanAreas.reserve(solid->width * solid->height);
+        SmartHeightFieldPtr agentSolid(rcAllocHeightfield(),
+                                       rcFreeHeightField);
+
+        if (!CopyHeightField(ctx, *solid, *agentSolid))
+            return false;
 
-        for (auto i = 0; i < solid->width * solid->height; ++i)
-            for (rcSpan* s = solid->spans[i]; s; s = s->next)
-                if (s->area & PolyFlags::Ground)
-                    groundSpanAreas.push_back(std::pair<rcSpan*, unsigned int>(
-                        s, static_cast<unsigned int>(s->area)));
+        pathfind::FilterWalkableSpans(ctx, agentConfig.walkableHeight,
+                                      agentConfig.walkableClimb, *agentSolid);
 
-        rcFilterLedgeSpans(&ctx, config.walkableHeight, config.walkableClimb,
-                           *solid);
+        agentMeshes[i].m_agent = agent.m_size;
 
-        for (auto p : groundSpanAreas)
-            p.first->area = p.second;
+        if (!SerializeMeshTile(ctx, agentConfig, agent, m_regionPartition,
+                               tileX, tileY, *agentSolid, m_offMeshConnections,
+                               agentMeshes[i].m_mesh))
+            return false;
     }
 
-    rcFilterWalkableLowHeightSpans(&ctx, config.walkableHeight, *solid);
-    rcFilterLowHangingWalkableObstacles(&ctx, config.walkableClimb, *solid);
+    pathfind::FilterWalkableSpans(ctx, config.walkableHeight,
+                                  config.walkableClimb, *solid);
 
-    {
-        std::lock_guard<std::mutex> guard(m_mutex);
+    ctx.StartStage(RecastContext::Serialize);
 
-        // Write the BVH for every new WMO
-        for (auto const& wmoId : rasterizedWmos)
-            SerializeWmo(*m_map->GetWmoInstance(wmoId)->Model);
+    // Write the BVH for every new WMO and doodad.  each is claimed from the
+    // constructor by the first worker to reach it, so no lock is needed here
+    for (auto const& wmoId : rasterizedWmos)
+        SerializeWmo(*m_map->GetWmoInstance(wmoId)->Model);
 
-        // Write the BVH for every new doodad
-        for (auto const& doodadId : rasterizedDoodads)
-            SerializeDoodad(*m_map->GetDoodadInstance(doodadId)->Model);
-    }
+    for (auto const& doodadId : rasterizedDoodads)
+        SerializeDoodad(*m_map->GetDoodadInstance(doodadId)->Model);
 
     // serialize WMO and doodad IDs for this tile
     utility::BinaryStream wmosAndDoodads;
@@ -1106,37 +2837,70 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
 
     // serialize heightfield for this tile
     utility::BinaryStream heightFieldData;
-    SerializeHeightField(*solid, heightFieldData);
+    SerializeHeightField(*solid, NeedsHeightField(tileX, tileY),
+                         heightFieldData);
 
     // serialize ADT vertex height
     utility::BinaryStream quadHeightData;
     SerializeTileQuadHeight(tileChunk, tileX, tileY, quadHeightData);
 
-    // serialize final navmesh tile
+    // serialize the floor of the WMOs for zone and area queries
+    utility::BinaryStream wmoFloorData;
+    SerializeWmoFloors(ctx, config, tileX, tileY, rasterizedWmos,
+                       wmoFloorData);
+
+    // and the surfaces of the models for height queries
+    utility::BinaryStream surfaceData;
+    SerializeSurfaces(*solid, m_surfaceHeights, surfaceData);
+
+    // and the surfaces of the liquid for liquid queries
+    utility::BinaryStream liquidData;
+    SerializeLiquids(ctx, config, *tileChunk, tileX, tileY, rasterizedWmos,
+                     liquidData);
+
+    ctx.StopStage(RecastContext::Serialize);
+
+    // serialize final navmesh tile, and the portals through which it
+    // connects to its neighbours
     utility::BinaryStream meshData;
+    utility::BinaryStream portalData;
     auto const result =
-        SerializeMeshTile(ctx, config, tileX, tileY, *solid, meshData);
-
-    {
-        std::lock_guard<std::mutex> guard(m_mutex);
+        SerializeMeshTile(ctx, config, m_agent, m_regionPartition, tileX,
+                          tileY, *solid, m_offMeshConnections, meshData,
+                          &portalData);
 
+    {
         auto const adtX = tileX / MeshSettings::TilesPerADT;
         auto const adtY = tileY / MeshSettings::TilesPerADT;
         auto const localTileX = tileX % MeshSettings::TilesPerADT;
         auto const localTileY = tileY % MeshSettings::TilesPerADT;
 
-        auto adt = GetInProgressADT(adtX, adtY);
+        meshfiles::ADT* adt;
 
-        adt->AddTile(localTileX, localTileY, wmosAndDoodads, quadHeightData,
-                     heightFieldData, meshData);
+        {
+            auto const guard = Lock(m_mutex);
+            adt = GetInProgressADT(adtX, adtY);
+        }
 
-        if (adt->IsComplete())
+        // the ADT is written by whichever worker adds its last tile, without
+        // holding the mutex, since no other worker will use it again
+        if (adt->AddTile(localTileX, localTileY, wmosAndDoodads, quadHeightData,
+                         heightFieldData, meshData, wmoFloorData, surfaceData,
+                         portalData, agentMeshes, liquidData))
         {
             std::stringstream str;
             str << std::setw(2) << std::setfill('0') << adtX << "_"
-                << std::setw(2) << std::setfill('0') << adtY << ".nav";
+                << std::setw(2) << std::setfill('0') << adtY;
+
+            auto const path = m_outputPath / "Nav" / m_map->Name;
 
-            adt->Serialize(m_outputPath / "Nav" / m_map->Name / str.str());
+            // the nav file is written last, since resumed builds take it to
+            // mean that the ADT is finished
+            ctx.StartStage(RecastContext::Serialize);
+            adt->SerializePortals(path / (str.str() + ".portals"));
+            adt->Serialize();
+
+            ctx.StopStage(RecastContext::Serialize);
 
 #ifdef _DEBUG
             std::stringstream log;
@@ -1145,17 +2909,157 @@ bool MeshBuilder::BuildAndSerializeMapTile(int tileX, int tileY)
             std::cout << log.str() << std::endl;
 #endif
 
+            auto const guard = Lock(m_mutex);
             RemoveADT(adt);
+            RecordFingerprint(adtX, adtY);
         }
     }
 
+    RecordProfile(ctx, tileX, tileY, start);
+
     ++m_completedTiles;
+    RecordFinishedTile(tileX, tileY);
+
     for (auto const& chunk : chunkPositions)
         RemoveChunkReference(chunk.first, chunk.second);
 
     return result;
 }
 
+std::unique_lock<std::mutex> MeshBuilder::Lock(std::mutex& mutex)
+{
+    std::unique_lock<std::mutex> guard(mutex, std::try_to_lock);
+
+    // the clock is only read when the lock is contended
+    if (!guard.owns_lock())
+    {
+        auto const start = std::chrono::steady_clock::now();
+        guard.lock();
+
+        m_lockWait += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+    }
+
+    return guard;
+}
+
+const parser::Adt* MeshBuilder::GetAdt(int adtX, int adtY)
+{
+    auto const start = std::chrono::steady_clock::now();
+    auto const result = m_map->GetAdt(adtX, adtY);
+
+    m_adtWait += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+    return result;
+}
+
+void MeshBuilder::RecordProfile(
+    const RecastContext& ctx, int tileX, int tileY,
+    const std::chrono::steady_clock::time_point& start)
+{
+    if (!m_profile)
+        return;
+
+    TileProfile profile;
+    profile.m_x = tileX;
+    profile.m_y = tileY;
+    profile.m_total = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+    for (auto i = 0; i < RecastContext::StageCount; ++i)
+        profile.m_stages[i] =
+            ctx.GetStageTime(static_cast<RecastContext::Stage>(i));
+
+    std::lock_guard<std::mutex> guard(m_profileMutex);
+    m_profiles.push_back(profile);
+}
+
+void MeshBuilder::SaveProfile(std::ostream& summary, size_t hotTiles) const
+{
+    std::lock_guard<std::mutex> guard(m_profileMutex);
+
+    std::ofstream csv(m_outputPath / "Nav" / m_map->Name / "profile.csv",
+                      std::ofstream::trunc);
+
+    csv << "tile_x,tile_y,total";
+    for (auto i = 0; i < RecastContext::StageCount; ++i)
+        csv << ","
+            << RecastContext::StageName(static_cast<RecastContext::Stage>(i));
+    csv << "\n";
+
+    std::int64_t totals[RecastContext::StageCount] = {};
+    std::int64_t total = 0;
+
+    for (auto const& profile : m_profiles)
+    {
+        csv << profile.m_x << "," << profile.m_y << "," << profile.m_total;
+
+        for (auto i = 0; i < RecastContext::StageCount; ++i)
+        {
+            csv << "," << profile.m_stages[i];
+            totals[i] += profile.m_stages[i];
+        }
+
+        csv << "\n";
+        total += profile.m_total;
+    }
+
+    if (m_profiles.empty())
+        return;
+
+    // everything is in microseconds, which are shown as milliseconds
+    summary << std::fixed << std::setprecision(1) << "Tile time by stage ("
+            << m_profiles.size() << " tiles, " << total / 1000.0
+            << " ms in total):\n";
+
+    for (auto i = 0; i < RecastContext::StageCount; ++i)
+    {
+        auto const stage = static_cast<RecastContext::Stage>(i);
+
+        summary << "  " << std::left << std::setw(12) << std::setfill(' ')
+                << RecastContext::StageName(stage) << std::right
+                << std::setw(12) << totals[i] / 1000.0 << " ms"
+                << std::setw(7) << 100.0 * totals[i] / total << "%\n";
+    }
+
+    std::vector<const TileProfile*> slowest;
+    for (auto const& profile : m_profiles)
+        slowest.push_back(&profile);
+
+    auto const count = (std::min)(hotTiles, slowest.size());
+    std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(),
+                      [](const TileProfile* a, const TileProfile* b)
+                      { return a->m_total > b->m_total; });
+
+    summary << "Slowest tiles:\n";
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        auto const& profile = *slowest[i];
+
+        auto const worst =
+            std::max_element(std::begin(profile.m_stages),
+                             std::end(profile.m_stages)) -
+            std::begin(profile.m_stages);
+
+        summary << "  (" << std::setw(4) << profile.m_x << ", " << std::setw(4)
+                << profile.m_y << ") ADT (" << std::setw(2)
+                << profile.m_x / MeshSettings::TilesPerADT << ", "
+                << std::setw(2) << profile.m_y / MeshSettings::TilesPerADT
+                << ")" << std::setw(12) << profile.m_total / 1000.0
+                << " ms, mostly "
+                << RecastContext::StageName(
+                       static_cast<RecastContext::Stage>(worst))
+                << "\n";
+    }
+
+    summary.flush();
+}
+
 void MeshBuilder::SaveMap() const
 {
     utility::BinaryStream out;
@@ -1164,6 +3068,46 @@ void MeshBuilder::SaveMap() const
     std::ofstream of(m_outputPath / (m_map->Name + ".map"),
                      std::ofstream::binary | std::ofstream::trunc);
     of << out;
+
+    if (m_fingerprints.empty())
+        return;
+
+    // rewrite the manifest without the lines which have since been replaced
+    std::ofstream manifest(ManifestPath(), std::ofstream::trunc);
+    for (auto const& adt : m_manifest)
+        manifest << std::setw(2) << std::setfill('0') << std::dec
+                 << adt.first.first << "_" << std::setw(2) << adt.first.second
+                 << " " << std::hex << std::setw(16) << adt.second << "\n";
+}
+
+void MeshBuilder::RecordFinishedTile(int tileX, int tileY)
+{
+    std::lock_guard<std::mutex> guard(m_finishedTilesMutex);
+    m_finishedTiles.emplace_back(tileX, tileY);
+}
+
+void MeshBuilder::FinishedTiles(size_t from,
+                                std::vector<std::pair<int, int>>& tiles) const
+{
+    std::lock_guard<std::mutex> guard(m_finishedTilesMutex);
+
+    if (from < m_finishedTiles.size())
+        tiles.insert(tiles.end(), m_finishedTiles.begin() + from,
+                     m_finishedTiles.end());
+}
+
+std::vector<std::pair<int, int>> MeshBuilder::InProgressADTs() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    std::vector<std::pair<int, int>> result;
+    result.reserve(m_adtsInProgress.size());
+
+    for (auto const& adt : m_adtsInProgress)
+        if (adt.second)
+            result.push_back(adt.first);
+
+    return result;
 }
 
 float MeshBuilder::PercentComplete() const
@@ -1174,7 +3118,15 @@ float MeshBuilder::PercentComplete() const
 meshfiles::ADT* MeshBuilder::GetInProgressADT(int x, int y)
 {
     if (!m_adtsInProgress[{x, y}])
-        m_adtsInProgress[{x, y}] = std::make_unique<meshfiles::ADT>(x, y);
+    {
+        std::stringstream name;
+        name << std::setw(2) << std::setfill('0') << x << "_" << std::setw(2)
+             << std::setfill('0') << y << ".nav";
+
+        m_adtsInProgress[{x, y}] = std::make_unique<meshfiles::ADT>(
+            x, y, m_outputPath / "Nav" / m_map->Name / name.str(),
+            m_agent.m_size, m_regionPartition, m_writer, m_compressionLevel);
+    }
 
     return m_adtsInProgress[{x, y}].get();
 }
@@ -1191,67 +3143,407 @@ void MeshBuilder::RemoveADT(const meshfiles::ADT* adt)
 
 namespace meshfiles
 {
+namespace
+{
+// files are written under a temporary name and renamed once they are whole,
+// so that an interrupted build never leaves behind a partial file which looks
+// finished
+fs::path TemporaryName(const fs::path& filename)
+{
+    auto temporary = filename;
+    temporary += ".tmp";
+    return temporary;
+}
+
+void RenameFile(const fs::path& filename, Result error)
+{
+    std::error_code ec;
+    fs::rename(TemporaryName(filename), filename, ec);
+
+    if (ec)
+        THROW(error);
+}
+
+// the buffer is either a stream or a rope of them
+template <typename Buffer>
+void WriteFile(const fs::path& filename, const Buffer& buffer, Result error)
+{
+    {
+        std::ofstream out(TemporaryName(filename),
+                          std::ofstream::binary | std::ofstream::trunc);
+
+        if (out.fail())
+            THROW(error);
+
+        out << buffer;
+        out.close();
+
+        if (out.fail())
+            THROW(error);
+    }
+
+    RenameFile(filename, error);
+}
+
+// appends the height field, the mesh size and the padded mesh of a tile.
+// offset is the position in the file at which out begins, since the mesh is
+// aligned within the file
+void WriteTile(const utility::BinaryStream& heightField,
+               const utility::BinaryStream& mesh, size_t offset,
+               utility::BinaryRope& out)
+{
+    out.Append(heightField);
+
+    auto& size = out.AppendOwned(sizeof(std::uint32_t) +
+                                 MeshSettings::TileDataAlignment - 1);
+    size << static_cast<std::uint32_t>(mesh.wpos());
+
+    // the file is memory mapped when loaded, and detour uses the mesh in place
+    auto const end = offset + out.wpos();
+    for (auto i = end; i % MeshSettings::TileDataAlignment; ++i)
+        size << static_cast<std::uint8_t>(0);
+
+    out.Append(mesh);
+}
+
+// appends the meshes of the other agents, each padded as by WriteTile()
+void WriteAgentMeshes(const std::vector<AgentMesh>& meshes, size_t offset,
+                      utility::BinaryRope& out)
+{
+    out.AppendOwned(sizeof(std::uint32_t))
+        << static_cast<std::uint32_t>(meshes.size());
+
+    for (auto const& mesh : meshes)
+    {
+        auto& header = out.AppendOwned(2 * sizeof(std::uint32_t) +
+                                       MeshSettings::TileDataAlignment - 1);
+        header << static_cast<std::uint32_t>(mesh.m_agent)
+               << static_cast<std::uint32_t>(mesh.m_mesh.wpos());
+
+        auto const end = offset + out.wpos();
+        for (auto i = end; i % MeshSettings::TileDataAlignment; ++i)
+            header << static_cast<std::uint8_t>(0);
+
+        out.Append(mesh.m_mesh);
+    }
+}
+} // namespace
+
 void File::AddTile(int x, int y, utility::BinaryStream& heightfield,
-                   const utility::BinaryStream& mesh)
+                   utility::BinaryStream& mesh)
+{
+    auto& tile = m_tiles[{x, y}];
+
+    tile.m_heightField = std::move(heightfield);
+    tile.m_mesh = std::move(mesh);
+}
+
+void File::SerializeTile(const TileData& tile, utility::BinaryRope& out)
+{
+    WriteTile(tile.m_heightField, tile.m_mesh, 0, out);
+}
+
+FileWriter::FileWriter() : m_stop(false), m_thread(&FileWriter::Run, this) {}
+
+FileWriter::~FileWriter()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void FileWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        m_condition.wait(lock,
+                         [this]() { return m_stop || !m_writes.empty(); });
+
+        // whatever was queued is written before stopping
+        if (m_writes.empty())
+            return;
+
+        auto write = std::move(m_writes.front());
+        m_writes.pop_front();
+
+        lock.unlock();
+        write();
+        lock.lock();
+    }
+}
+
+void FileWriter::Queue(std::function<void()> write)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_writes.push_back(std::move(write));
+    }
+
+    m_condition.notify_one();
+}
+
+void FileWriter::Flush()
+{
+    auto const done = std::make_shared<std::promise<void>>();
+    auto finished = done->get_future();
+
+    Queue([done]() { done->set_value(); });
+
+    finished.wait();
+}
+
+ADT::ADT(int x, int y, const fs::path& filename, AgentSize agent,
+         RegionPartition partition, FileWriter& writer, int compressionLevel)
+    : m_x(x), m_y(y), m_filename(filename), m_agent(agent),
+      m_partition(partition), m_compressionLevel(compressionLevel),
+      m_writer(writer),
+      m_writeFailed(false), m_written(0), m_checksum(FingerprintBasis),
+      m_tileCount(0), m_nextTile(0), m_nextWrite(0), m_adler(1)
+{
+}
+
+ADT::~ADT()
+{
+    // the writes queued by an abandoned ADT refer to it
+    m_writer.Flush();
+}
+
+void ADT::Queue(std::shared_ptr<utility::BinaryStream> data)
 {
-    m_tiles[{x, y}] = std::move(heightfield);
-    m_tiles[{x, y}] << static_cast<std::uint32_t>(mesh.wpos());
-    m_tiles[{x, y}].Append(mesh);
+    m_writer.Queue([this, data]() {
+        m_out << *data;
+
+        if (m_out.fail())
+            m_writeFailed = true;
+    });
+}
+
+void ADT::QueueCompressed()
+{
+    for (auto next = m_compressed.find(m_nextWrite);
+         next != m_compressed.end(); next = m_compressed.find(m_nextWrite))
+    {
+        m_adler = utility::BinaryRope::Adler32Combine(
+            m_adler, next->second.m_adler, next->second.m_length);
+        Queue(std::move(next->second.m_data));
+
+        m_compressed.erase(next);
+        ++m_nextWrite;
+    }
 }
 
-void ADT::AddTile(int x, int y, utility::BinaryStream& wmosAndDoodads,
+bool ADT::AddTile(int x, int y, utility::BinaryStream& wmosAndDoodads,
                   utility::BinaryStream& quadHeights,
                   utility::BinaryStream& heightField,
-                  utility::BinaryStream& mesh)
+                  utility::BinaryStream& mesh,
+                  utility::BinaryStream& wmoFloors,
+                  utility::BinaryStream& surfaces,
+                  utility::BinaryStream& portals,
+                  const std::vector<AgentMesh>& agentMeshes,
+                  utility::BinaryStream& liquids)
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-    File::AddTile(x, y, heightField, mesh);
+    // the pieces of the tile are fingerprinted, and compressed, where they
+    // are, rather than copied into one buffer first
+    utility::BinaryRope tile;
+
+    if (!m_out.is_open())
+    {
+        m_out.open(TemporaryName(m_filename),
+                   std::ofstream::binary | std::ofstream::trunc);
+
+        if (m_out.fail())
+            THROW(Result::ADT_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
+
+        // the inflated length is filled in once it is known
+        if (m_compressionLevel > 0)
+        {
+            auto const prefix = std::make_shared<utility::BinaryStream>();
+
+            *prefix << MeshSettings::FileCompressed
+                    << static_cast<std::uint32_t>(NavCompression::Zlib)
+                    << static_cast<std::uint64_t>(0);
+            utility::BinaryRope::ZlibHeader(m_compressionLevel, *prefix);
+
+            Queue(prefix);
+        }
+
+        auto& header = tile.AppendOwned(9 * sizeof(std::uint32_t));
+
+        header << MeshSettings::FileSignature << MeshSettings::FileVersion
+               << MeshSettings::FileADT;
+
+        // ADT x and y
+        header << static_cast<std::uint32_t>(m_x)
+               << static_cast<std::uint32_t>(m_y);
+
+        // tile count.  the tiles are written in the order in which they are
+        // finished, which the pathfind library does not mind
+        header << static_cast<std::uint32_t>(MeshSettings::TilesPerADT *
+                                             MeshSettings::TilesPerADT);
+
+        // flags, the offset of the first tile, the size of the agent and
+        // how the regions were partitioned
+        header << MeshSettings::FileFlags
+               << static_cast<std::uint32_t>(10 * sizeof(std::uint32_t))
+               << static_cast<std::uint32_t>(m_agent)
+               << static_cast<std::uint32_t>(m_partition);
+    }
+
+    // after the file header, for the first tile
+    auto const start = tile.wpos();
+    auto& header = tile.AppendOwned(5 * sizeof(std::uint32_t));
+
+    // the length of the tile, filled in once it is known
+    header << static_cast<std::uint32_t>(0);
+
+    // we want to store the global tile x and y, rather than the x, y relative
+    // to this ADT
+    header << static_cast<std::uint32_t>(x + m_x * MeshSettings::TilesPerADT)
+           << static_cast<std::uint32_t>(y + m_y * MeshSettings::TilesPerADT);
+
+    // append wmo and doodad id buffer (which already contains size
+    // information), or an empty one if there is none
+    if (!wmosAndDoodads.wpos())
+        header << static_cast<std::uint32_t>(0)
+               << static_cast<std::uint32_t>(0);
+    else
+        tile.Append(wmosAndDoodads);
+
+    // append adt quad height data
+    tile.Append(quadHeights);
+
+    // height field and finalized tile buffer
+    WriteTile(heightField, mesh, m_written, tile);
+
+    tile.Append(wmoFloors);
+    tile.Append(surfaces);
+
+    WriteAgentMeshes(agentMeshes, m_written, tile);
+
+    tile.Append(liquids);
+
+    auto const length = static_cast<std::uint32_t>(tile.wpos() - start -
+                                                   sizeof(std::uint32_t));
+    header.Write(static_cast<size_t>(0), length);
+
+    tile.ForEach([this](const std::uint8_t* data, size_t size) {
+        Fingerprint(m_checksum, data, size);
+    });
+
+    m_written += tile.wpos();
+    m_portals[{x, y}] = std::move(portals);
+
+    if (m_compressionLevel > 0)
+    {
+        auto const number = m_nextTile++;
+
+        lock.unlock();
+
+        CompressedTile compressed {std::make_shared<utility::BinaryStream>(),
+                                   0, tile.wpos()};
+        compressed.m_adler =
+            tile.Deflate(m_compressionLevel, false, *compressed.m_data);
 
-    m_wmosAndDoodadIds[{x, y}] = std::move(wmosAndDoodads);
-    m_quadHeights[{x, y}] = std::move(quadHeights);
+        lock.lock();
+
+        m_compressed.emplace(number, std::move(compressed));
+        QueueCompressed();
+    }
+    else
+    {
+        // the streams of the caller do not outlive this, so the writer is
+        // given a copy, which takes far less time than writing it
+        auto const data = std::make_shared<utility::BinaryStream>(tile.wpos());
+
+        tile.ForEach([&data](const std::uint8_t* bytes, size_t size) {
+            data->Write(bytes, size);
+        });
+
+        Queue(data);
+    }
+
+    // a tile is only counted once compressed, so by the time the last one is
+    // counted, every one of them has been queued
+    return ++m_tileCount ==
+           MeshSettings::TilesPerADT * MeshSettings::TilesPerADT;
 }
 
-void ADT::Serialize(const fs::path& filename) const
+void ADT::Serialize()
 {
-    size_t bufferSize = 6 * sizeof(std::uint32_t);
+    std::lock_guard<std::mutex> guard(m_mutex);
 
-    // first compute total size, just to reduce reallocations
-    for (auto const& tile : m_tiles)
-    {
-        bufferSize += 2 * sizeof(std::uint32_t);
+    assert(m_tileCount ==
+           MeshSettings::TilesPerADT * MeshSettings::TilesPerADT);
 
-        // in this case, the wmo and doodad counts are included in the buffer
-        if (m_wmosAndDoodadIds.find(tile.first) != m_wmosAndDoodadIds.end())
-            bufferSize += m_wmosAndDoodadIds.at(tile.first).wpos();
-        // if the buffer is empty, two zeros are written
-        else
-            bufferSize += 2 * sizeof(std::uint32_t);
+    // resumed builds use this to tell a whole file from a damaged one.  the
+    // pathfind library reads only the tiles, and ignores it
+    utility::BinaryRope trailer;
+    trailer.AppendOwned(sizeof(m_checksum)) << m_checksum;
 
-        // quad height data
-        bufferSize += m_quadHeights.at(tile.first).wpos();
+    auto const data = std::make_shared<utility::BinaryStream>();
 
-        // height field and mesh buffer
-        bufferSize += tile.second.wpos();
+    if (m_compressionLevel > 0)
+    {
+        m_adler = utility::BinaryRope::Adler32Combine(
+            m_adler, trailer.Deflate(m_compressionLevel, true, *data),
+            trailer.wpos());
+
+        for (auto shift = 24; shift >= 0; shift -= 8)
+            *data << static_cast<std::uint8_t>(m_adler >> shift);
     }
+    else
+        *data << m_checksum;
 
-    utility::BinaryStream outBuffer(bufferSize);
+    Queue(data);
+
+    auto const inflatedLength =
+        static_cast<std::uint64_t>(m_written + trailer.wpos());
+
+    m_writer.Queue([this, inflatedLength]() {
+        if (m_compressionLevel > 0)
+        {
+            m_out.seekp(2 * sizeof(std::uint32_t));
+            m_out.write(reinterpret_cast<const char*>(&inflatedLength),
+                        sizeof(inflatedLength));
+        }
+
+        m_out.close();
+
+        if (m_out.fail())
+            m_writeFailed = true;
+    });
+
+    m_writer.Flush();
+
+    if (m_writeFailed)
+        THROW(Result::ADT_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
+
+    RenameFile(m_filename,
+               Result::ADT_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
+}
+
+void ADT::SerializePortals(const fs::path& filename) const
+{
+    utility::BinaryStream outBuffer;
 
-    // header
     outBuffer << MeshSettings::FileSignature << MeshSettings::FileVersion
-              << MeshSettings::FileADT;
+              << MeshSettings::FilePortals;
 
-    // ADT x and y
     outBuffer << static_cast<std::uint32_t>(m_x)
               << static_cast<std::uint32_t>(m_y);
 
-    // tile count
-    outBuffer << static_cast<std::uint32_t>(m_tiles.size());
+    outBuffer << static_cast<std::uint32_t>(m_portals.size());
 
-    for (auto const& tile : m_tiles)
+    for (auto const& tile : m_portals)
     {
-        // we want to store the global tile x and y, rather than the x, y
-        // relative to this ADT
         auto const x = static_cast<std::uint32_t>(tile.first.first) +
                        m_x * MeshSettings::TilesPerADT;
         auto const y = static_cast<std::uint32_t>(tile.first.second) +
@@ -1259,33 +3551,17 @@ void ADT::Serialize(const fs::path& filename) const
 
         outBuffer << x << y;
 
-        // append wmo and doodad id buffer (which already contains size
-        // information), or an empty one if there is none
-        if (m_wmosAndDoodadIds.find(tile.first) == m_wmosAndDoodadIds.end())
+        // tiles without a mesh, or whose portals could not be found, have
+        // neither portals nor edges
+        if (tile.second.wpos() > 0)
+            outBuffer.Append(tile.second);
+        else
             outBuffer << static_cast<std::uint32_t>(0)
                       << static_cast<std::uint32_t>(0);
-        else
-            outBuffer.Append(m_wmosAndDoodadIds.at(tile.first));
-
-        // append adt quad height data
-        outBuffer.Append(m_quadHeights.at(tile.first));
-
-        // height field and finalized tile buffer
-        outBuffer.Append(tile.second);
     }
 
-    // just to make sure our calculation still works.  if it doesnt, we could
-    // see copious reallocations in the above code!
-    assert(outBuffer.wpos() == bufferSize);
-
-    outBuffer.Compress();
-
-    std::ofstream out(filename, std::ofstream::binary | std::ofstream::trunc);
-
-    if (out.fail())
-        THROW(Result::ADT_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
-
-    out << outBuffer;
+    WriteFile(filename, outBuffer,
+              Result::ADT_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
 }
 
 void GlobalWMO::AddTile(int x, int y, utility::BinaryStream& heightField,
@@ -1297,14 +3573,10 @@ void GlobalWMO::AddTile(int x, int y, utility::BinaryStream& heightField,
 
 void GlobalWMO::Serialize(const fs::path& filename) const
 {
-    size_t bufferSize = 6 * sizeof(std::uint32_t);
-
-    // first compute total size, just to reduce reallocations
-    for (auto const& tile : m_tiles)
-        bufferSize += 4 * sizeof(std::uint32_t) + tile.second.wpos() +
-                      sizeof(std::uint8_t);
-
-    utility::BinaryStream outBuffer(bufferSize);
+    // the tiles are written to the file where they are, between small
+    // headers of their own
+    utility::BinaryRope rope;
+    auto& outBuffer = rope.AppendOwned(10 * sizeof(std::uint32_t));
 
     // header
     outBuffer << MeshSettings::FileSignature << MeshSettings::FileVersion
@@ -1316,38 +3588,50 @@ void GlobalWMO::Serialize(const fs::path& filename) const
     // tile count
     outBuffer << static_cast<std::uint32_t>(m_tiles.size());
 
+    // flags, the offset of the first tile, the size of the agent and how the
+    // regions were partitioned
+    outBuffer << MeshSettings::FileFlags
+              << static_cast<std::uint32_t>(10 * sizeof(std::uint32_t))
+              << static_cast<std::uint32_t>(m_agent)
+              << static_cast<std::uint32_t>(m_partition);
+
     for (auto const& tile : m_tiles)
     {
+        // the length of the tile, filled in once it is known
+        auto const start = rope.wpos();
+        auto& header = rope.AppendOwned(5 * sizeof(std::uint32_t) +
+                                        sizeof(std::uint8_t));
+        header << static_cast<std::uint32_t>(0);
+
         // tile x and y
-        outBuffer << tile.first.first << tile.first.second;
+        header << tile.first.first << tile.first.second;
 
         // no per-tile doodad ids for global WMOs
-        outBuffer << static_cast<std::uint32_t>(0)
-                  << static_cast<std::uint32_t>(0);
+        header << static_cast<std::uint32_t>(0)
+               << static_cast<std::uint32_t>(0);
 
         // the '0' indicates that there is no quad height data for this tile
-        outBuffer << static_cast<std::uint8_t>(0);
+        header << static_cast<std::uint8_t>(0);
 
         // height field and finalized tile buffer
-        outBuffer.Append(tile.second);
-    }
-
-    // temporary just to make sure our calculation still works.  if it doesnt,
-    // we could see copious reallocations in the above code!
-    assert(outBuffer.wpos() == bufferSize);
-
-    outBuffer.Compress();
-
-    std::ofstream out(filename, std::ofstream::binary | std::ofstream::trunc);
+        SerializeTile(tile.second, rope);
 
-    if (out.fail())
-        THROW(Result::WMO_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE).ErrorCode();
+        header.Write(static_cast<size_t>(0),
+                     static_cast<std::uint32_t>(rope.wpos() - start -
+                                                sizeof(std::uint32_t)));
+    }
 
-    out << outBuffer;
+    WriteFile(filename, rope,
+              Result::WMO_SERIALIZATION_FAILED_TO_OPEN_OUTPUT_FILE);
 }
 
 void SerializeWmo(const parser::Wmo& wmo, BVHConstructor& constructor)
 {
+    // whoever claimed the wmo also writes its doodads
+    fs::path path;
+    if (!constructor.ClaimFile(wmo.MpqPath, path))
+        return;
+
     math::AABBTree aabbTree(wmo.Vertices, wmo.Indices);
 
     utility::BinaryStream o;
@@ -1373,19 +3657,35 @@ void SerializeWmo(const parser::Wmo& wmo, BVHConstructor& constructor)
             o << wmoDoodad->Bounds;
             o.WriteString(doodad->MpqPath, MeshSettings::MaxMPQPathLength);
 
-            // TODO: this probably causes the file to be written repeatedly
-            // also serialize this doodad
-            SerializeDoodad(*wmoDoodad->Parent.get(),
-                            constructor.AddFile(doodad->MpqPath));
+            // also serialize this doodad, unless another wmo shares it
+            fs::path doodadPath;
+            if (constructor.ClaimFile(doodad->MpqPath, doodadPath))
+                SerializeDoodad(*doodad, doodadPath);
         }
     }
 
-    auto const path = constructor.AddFile(wmo.MpqPath);
-
     std::ofstream of(path, std::ofstream::binary | std::ofstream::trunc);
     of << o;
 }
 
+void CompressNavFile(const fs::path& filename, int level, Result error)
+{
+    utility::BinaryStream contents(filename);
+
+    auto const length = static_cast<std::uint64_t>(contents.wpos());
+
+    contents.Compress(level);
+
+    utility::BinaryRope rope;
+
+    rope.AppendOwned(2 * sizeof(std::uint32_t) + sizeof(std::uint64_t))
+        << MeshSettings::FileCompressed
+        << static_cast<std::uint32_t>(NavCompression::Zlib) << length;
+    rope.Append(contents);
+
+    WriteFile(filename, rope, error);
+}
+
 void SerializeDoodad(const parser::Doodad& doodad, const fs::path& path)
 {
     math::AABBTree doodadTree(doodad.Vertices, doodad.Indices);
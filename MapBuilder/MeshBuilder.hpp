@@ -2,16 +2,31 @@
 
 #include "BVHConstructor.hpp"
 #include "Common.hpp"
+#include "RecastContext.hpp"
+#include "parser/Doodad/DoodadInstance.hpp"
 #include "parser/Map/Map.hpp"
 #include "parser/Wmo/Wmo.hpp"
+#include "parser/Wmo/WmoInstance.hpp"
+#include "recastnavigation/Recast/Include/Recast.h"
 #include "utility/BinaryStream.hpp"
 #include "utility/Vector.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <ostream>
+#include <set>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -20,15 +35,24 @@ namespace meshfiles
 class File
 {
 protected:
-    // serialized heightfield and finalized mesh data, mapped by tile id
-    std::map<std::pair<std::int32_t, std::int32_t>, utility::BinaryStream>
-        m_tiles;
+    struct TileData
+    {
+        utility::BinaryStream m_heightField;
+        utility::BinaryStream m_mesh;
+    };
+
+    // serialized heightfield and finalized mesh data, mapped by tile id.  they
+    // are kept apart because the mesh must be aligned within the output file
+    std::map<std::pair<std::int32_t, std::int32_t>, TileData> m_tiles;
 
     mutable std::mutex m_mutex;
 
     // this function assumes that the mutex has already been locked
     void AddTile(int x, int y, utility::BinaryStream& heightfield,
-                 const utility::BinaryStream& mesh);
+                 utility::BinaryStream& mesh);
+
+    // writes the height field, the mesh size and the padded mesh of a tile
+    static void SerializeTile(const TileData& tile, utility::BinaryRope& out);
 
 public:
     virtual ~File() = default;
@@ -36,42 +60,143 @@ public:
     virtual void Serialize(const std::filesystem::path& filename) const = 0;
 };
 
-class ADT : File
+// the mesh of a tile built for an agent other than that of the map, from the
+// same height field
+struct AgentMesh
+{
+    AgentSize m_agent;
+    utility::BinaryStream m_mesh;
+};
+
+// runs the writes queued by the workers one after another, in the order in
+// which they were queued, on a thread of its own, so that no worker waits
+// for the disk
+class FileWriter
+{
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::function<void()>> m_writes;
+    bool m_stop;
+    std::thread m_thread;
+
+    void Run();
+
+public:
+    FileWriter();
+    ~FileWriter();
+
+    FileWriter(const FileWriter&) = delete;
+    FileWriter& operator=(const FileWriter&) = delete;
+
+    void Queue(std::function<void()> write);
+
+    // waits for every write queued so far
+    void Flush();
+};
+
+// the nav file of an ADT is written as its tiles are finished, rather than
+// once all of them are, so that only the tiles being built are held in
+// memory.  it is written under a temporary name until it is whole.  when it
+// is compressed, each tile is compressed by the worker which built it, into
+// blocks which follow one another in a single zlib stream
+class ADT
 {
 private:
     const int m_x;
     const int m_y;
+    const std::filesystem::path m_filename;
+    const AgentSize m_agent;
+    const RegionPartition m_partition;
+    const int m_compressionLevel;
 
-    // serialized data for WMOs and doodad IDs, mapped by tile id within the ADT
-    std::map<std::pair<int, int>, utility::BinaryStream> m_wmosAndDoodadIds;
+    FileWriter& m_writer;
 
-    // serialized data for ADT quad heights, mapped by tile id within the ADT
-    std::map<std::pair<int, int>, utility::BinaryStream> m_quadHeights;
+    mutable std::mutex m_mutex;
 
-public:
-    ADT(int x, int y) : m_x(x), m_y(y) {}
+    // only used by the writer once opened
+    std::ofstream m_out;
+    std::atomic_bool m_writeFailed;
+
+    // bytes of the (uncompressed) contents so far, for aligning the meshes,
+    // and their checksum
+    size_t m_written;
+    std::uint64_t m_checksum;
 
-    virtual ~ADT() = default;
+    int m_tileCount;
 
-    // these x and y arguments refer to the tile x and y
-    void AddTile(int x, int y, utility::BinaryStream& wmosAndDoodads,
+    // tiles are numbered as their place in the file is taken, and once
+    // compressed are queued for writing in that order.  the adler-32 is of
+    // the contents queued so far
+    struct CompressedTile
+    {
+        std::shared_ptr<utility::BinaryStream> m_data;
+        std::uint32_t m_adler;
+        size_t m_length;
+    };
+
+    std::uint64_t m_nextTile;
+    std::uint64_t m_nextWrite;
+    std::map<std::uint64_t, CompressedTile> m_compressed;
+    std::uint32_t m_adler;
+
+    // serialized portals of each tile, mapped by tile id within the ADT
+    std::map<std::pair<int, int>, utility::BinaryStream> m_portals;
+
+    // these functions assume that the mutex has already been locked
+    void Queue(std::shared_ptr<utility::BinaryStream> data);
+    void QueueCompressed();
+
+public:
+    ADT(int x, int y, const std::filesystem::path& filename, AgentSize agent,
+        RegionPartition partition, FileWriter& writer, int compressionLevel);
+    ~ADT();
+
+    // these x and y arguments refer to the tile x and y.  the tile is queued
+    // for writing straight away, once compressed if the file is to be, which
+    // is done without holding the mutex.  returns true for the tile which
+    // completes the ADT, after which no other tile may be added, so that its
+    // caller alone may serialize it
+    bool AddTile(int x, int y, utility::BinaryStream& wmosAndDoodads,
                  utility::BinaryStream& quadHeights,
                  utility::BinaryStream& heightField,
-                 utility::BinaryStream& mesh);
+                 utility::BinaryStream& mesh, utility::BinaryStream& wmoFloors,
+                 utility::BinaryStream& surfaces,
+                 utility::BinaryStream& portals,
+                 const std::vector<AgentMesh>& agentMeshes,
+                 utility::BinaryStream& liquids);
 
     bool IsComplete() const
     {
-        return m_tiles.size() ==
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_tileCount ==
                (MeshSettings::TilesPerADT * MeshSettings::TilesPerADT);
     }
-    void Serialize(const std::filesystem::path& filename) const override;
+
+    // finishes the nav file, once every tile has been added, and waits for
+    // it to be written
+    void Serialize();
+
+    // writes the portal graph of the ADT's tiles, which is kept in a file of
+    // its own so that routing need not read the nav file
+    void SerializePortals(const std::filesystem::path& filename) const;
 };
 
 class GlobalWMO : File
 {
+private:
+    const AgentSize m_agent;
+    RegionPartition m_partition = RegionPartition::Watershed;
+
 public:
+    explicit GlobalWMO(AgentSize agent) : m_agent(agent) {}
     virtual ~GlobalWMO() = default;
 
+    void SetRegionPartition(RegionPartition partition)
+    {
+        m_partition = partition;
+    }
+
     void AddTile(int x, int y, utility::BinaryStream& heightField,
                  utility::BinaryStream& mesh);
 
@@ -81,6 +206,11 @@ public:
 void SerializeWmo(const parser::Wmo& wmo, BVHConstructor& constructor);
 void SerializeDoodad(const parser::Doodad& doodad,
                      const std::filesystem::path& path);
+
+// rewrites a finished nav file with its contents compressed at the given
+// zlib level.  the file is whole under its own name throughout
+void CompressNavFile(const std::filesystem::path& filename, int level,
+                     Result error);
 } // namespace meshfiles
 
 class MeshBuilder
@@ -90,52 +220,241 @@ private:
     BVHConstructor m_bvhConstructor;
     const std::filesystem::path m_outputPath;
 
-#pragma pack(push, 1)
-    struct GameObjectInstance
-    {
-        std::uint64_t guid;
-        std::uint32_t displayId;
-        std::uint32_t map;
-        float position[3];
-        float quaternion[4];
-    };
-#pragma pack(pop)
+    std::vector<GameObjectSpawn> m_gameObjectInstances;
 
-    std::vector<GameObjectInstance> m_gameObjectInstances;
+    // declared before the ADTs, whose writes it may still hold
+    meshfiles::FileWriter m_writer;
+
+    // built into every tile of the map in which they start
+    std::vector<OffMeshConnection> m_offMeshConnections;
 
     std::map<std::pair<int, int>, std::unique_ptr<meshfiles::ADT>>
         m_adtsInProgress;
     std::unique_ptr<meshfiles::GlobalWMO> m_globalWMO;
 
+    // tiles are taken from the back, by claiming the next index with an
+    // atomic increment rather than taking the mutex
     std::vector<std::pair<int, int>> m_pendingTiles;
-    std::vector<int>
-        m_chunkReferences; // this is a fixed size, but it is so big that it can
-                           // single-handedly overflow the stack
+    std::atomic<size_t> m_nextTile;
 
-    std::vector<math::Vertex> m_globalWMOVertices;
-    std::vector<int> m_globalWMOIndices;
+    // once set, no more tiles are given out (see Cancel())
+    std::atomic_bool m_cancelled {false};
 
-    std::vector<math::Vertex> m_globalWMOLiquidVertices;
-    std::vector<int> m_globalWMOLiquidIndices;
+    // the number of references to chunks of each ADT by tiles which have not
+    // yet been built.  the ADT is unloaded when it reaches zero
+    std::vector<std::atomic<int>> m_adtReferences;
 
-    std::vector<math::Vertex> m_globalWMODoodadVertices;
-    std::vector<int> m_globalWMODoodadIndices;
+    struct TileTriangles
+    {
+        std::vector<int> m_indices;
+        std::vector<unsigned char> m_areas;
+    };
 
-    std::unordered_set<std::string> m_bvhWmos;
-    std::unordered_set<std::string> m_bvhDoodads;
+    // the triangles of a WMO or doodad instance in recast space, with the area
+    // of each.  they are shared by every tile the instance overlaps, rather
+    // than being transformed again for each of them
+    struct InstanceGeometry
+    {
+        std::vector<float> m_vertices;
+
+        // the triangles which overlap each tile, including its border, so that
+        // a tile rasterizes only those which can reach it.  a triangle may
+        // appear in several tiles
+        std::map<std::pair<int, int>, TileTriangles> m_tiles;
+
+        // the ADTs which the instance overlaps, indexed as m_adtReferences
+        std::vector<int> m_adts;
+
+        // sorts triangles of m_vertices into the tiles of a grid whose first
+        // tile begins at originX, originZ in recast space.  large geometry
+        // may be sorted on several threads
+        void AddTriangles(const rcConfig& config, float originX, float originZ,
+                          const std::vector<int>& indices,
+                          const std::vector<unsigned char>& areas,
+                          unsigned int threads = 1);
+    };
+
+    std::shared_ptr<const InstanceGeometry> m_globalWMOGeometry;
+    std::atomic_bool m_globalWMOSerialized;
+
+    std::mutex m_geometryMutex;
+    std::unordered_map<std::uint32_t, std::shared_ptr<const InstanceGeometry>>
+        m_wmoGeometry;
+    std::unordered_map<std::uint32_t, std::shared_ptr<const InstanceGeometry>>
+        m_doodadGeometry;
+
+    // the heightfield of a whole ADT and its border, from which each of its
+    // tiles copies its own columns when heightfields are shared
+    struct ADTHeightField
+    {
+        // held by the tile which rasterizes the ADT, while the others wait
+        std::mutex m_mutex;
+        bool m_rasterized = false;
+
+        // null when the ADT could not be rasterized
+        std::unique_ptr<rcHeightfield, decltype(&rcFreeHeightField)>
+            m_heightField {nullptr, rcFreeHeightField};
+
+        // freed once every tile of the ADT has copied from it
+        int m_copiedTiles = 0;
+    };
+
+    bool m_shareADTHeightFields = false;
+    bool m_surfaceHeights = false;
+
+    // the zlib level at which nav files are compressed, or zero when they
+    // are left uncompressed to be memory mapped
+    int m_compressionLevel = 0;
+
+    RegionPartition m_regionPartition = RegionPartition::Watershed;
+
+    // how near to a game object a tile must be for its height field to be
+    // written, or negative when every height field is
+    float m_heightFieldRadius = -1.f;
+
+    // whether the height field of the tile is written (see OmitHeightFields())
+    bool NeedsHeightField(int tileX, int tileY) const;
+
+    // guarded by m_geometryMutex
+    std::map<std::pair<int, int>, std::shared_ptr<ADTHeightField>>
+        m_adtHeightFields;
 
     float m_minX, m_maxX, m_minY, m_maxY, m_minZ, m_maxZ;
 
     mutable std::mutex m_mutex;
 
     size_t m_totalTiles;
-    size_t m_completedTiles;
+    std::atomic<size_t> m_completedTiles;
+
+    // every tile built so far, in the order they were finished
+    mutable std::mutex m_finishedTilesMutex;
+    std::vector<std::pair<int, int>> m_finishedTiles;
+
+    void RecordFinishedTile(int tileX, int tileY);
 
     const int m_logLevel;
 
+    // the agent for which every tile is built, and those for which tiles of
+    // ADTs are also built from the same height fields (see AddAgentSize())
+    const AgentProfile& m_agent;
+    std::vector<const AgentProfile*> m_otherAgents;
+
+    // the border of every height field, which is wide enough for each agent
+    int BorderSize() const;
+
+    // the time spent on each tile, in microseconds, when profiling
+    struct TileProfile
+    {
+        int m_x;
+        int m_y;
+        std::int64_t m_total;
+        std::int64_t m_stages[RecastContext::StageCount];
+    };
+
+    bool m_profile = false;
+    mutable std::mutex m_profileMutex;
+    std::vector<TileProfile> m_profiles;
+
+    void RecordProfile(const RecastContext& ctx, int tileX, int tileY,
+                       const std::chrono::steady_clock::time_point& start);
+
+    // the time, in nanoseconds, which the workers together have spent waiting
+    // for the builder's locks, and for ADTs to be parsed
+    std::atomic<std::int64_t> m_lockWait {0};
+    std::atomic<std::int64_t> m_adtWait {0};
+
+    // locks the mutex, adding the time spent waiting for it to m_lockWait
+    std::unique_lock<std::mutex> Lock(std::mutex& mutex);
+
+    // gets the ADT from the map, adding the time taken to m_adtWait
+    const parser::Adt* GetAdt(int adtX, int adtY);
+
+    // fingerprints of the inputs of each ADT to be built, when building
+    // incrementally.  zero for those which cannot be fingerprinted
+    std::map<std::pair<int, int>, std::uint64_t> m_fingerprints;
+
+    // the fingerprints of every ADT written so far, both by this build and by
+    // those before it
+    std::map<std::pair<int, int>, std::uint64_t> m_manifest;
+
+    std::filesystem::path ManifestPath() const;
+
+    // parses the raw ADT files, of this ADT and its neighbours, only for the
+    // names of the models they use.  modelFingerprints caches the fingerprint
+    // of each model, which are shared by many ADTs
+    std::uint64_t
+    ComputeFingerprint(int adtX, int adtY,
+                       std::unordered_map<std::string, std::uint64_t>&
+                           modelFingerprints) const;
+
+    // this function assumes ownership of the mutex
+    void RecordFingerprint(int adtX, int adtY);
+
+    // removes the tiles of the given ADTs from those to be built
+    void RemovePendingADTs(const std::set<std::pair<int, int>>& adts);
+
+    // as above, but the ADTs are also parsed, so that their instances are
+    // still written to the .map file
+    void SkipADTs(const std::set<std::pair<int, int>>& adts);
+
     void AddChunkReference(int chunkX, int chunkY);
     void RemoveChunkReference(int chunkX, int chunkY);
 
+    static std::shared_ptr<InstanceGeometry>
+    BuildWmoGeometry(rcContext& ctx, const rcConfig& config, float originX,
+                     float originZ, const parser::WmoInstance& instance,
+                     unsigned int threads = 1);
+
+    // built on first use by any tile
+    std::shared_ptr<const InstanceGeometry>
+    GetWmoGeometry(rcContext& ctx, const rcConfig& config, std::uint32_t id,
+                   const parser::WmoInstance& instance);
+    std::shared_ptr<const InstanceGeometry>
+    GetDoodadGeometry(rcContext& ctx, const rcConfig& config,
+                      std::uint32_t id,
+                      const parser::DoodadInstance& instance);
+
+    // writes the lowest point of each given WMO over each cell of the tile,
+    // to be read according to MeshSettings::NavFileWmoFloors
+    void SerializeWmoFloors(rcContext& ctx, const rcConfig& config, int tileX,
+                            int tileY,
+                            const std::unordered_set<std::uint32_t>& wmos,
+                            utility::BinaryStream& out);
+
+    // writes the surfaces of the liquid of the chunk and of the given WMOs
+    // over each cell of the tile, to be read according to
+    // MeshSettings::NavFileLiquids
+    void SerializeLiquids(rcContext& ctx, const rcConfig& config,
+                          const parser::AdtChunk& chunk, int tileX,
+                          int tileY,
+                          const std::unordered_set<std::uint32_t>& wmos,
+                          utility::BinaryStream& out);
+
+    // rasterizes the triangles of the geometry which overlap the tile
+    static bool Rasterize(rcContext& ctx, rcHeightfield& heightField,
+                          const InstanceGeometry& geometry, int tileX,
+                          int tileY);
+
+    // as above, for every tile of an ADT, rasterizing once each the triangles
+    // which are listed by several of them
+    static bool RasterizeADTTiles(rcContext& ctx, rcHeightfield& heightField,
+                                  const InstanceGeometry& geometry, int adtX,
+                                  int adtY);
+
+    // rasterizes the terrain, liquid and models of an ADT and its border into
+    // one heightfield
+    bool RasterizeADT(RecastContext& ctx, int adtX, int adtY,
+                      rcHeightfield& heightField);
+
+    // creates the heightfield of a tile and copies its columns from that of
+    // its ADT, rasterizing that first if no other tile has.  the height
+    // bounds of the config are replaced by those of the ADT
+    bool CopyADTHeightField(RecastContext& ctx, rcConfig& config, int tileX,
+                            int tileY, rcHeightfield& heightField);
+
+    // drops the geometry of instances which no remaining tile overlaps
+    void EvictGeometry();
+
     void SerializeWmo(const parser::Wmo& wmo);
     void SerializeDoodad(const parser::Doodad& doodad);
 
@@ -143,15 +462,173 @@ private:
     meshfiles::ADT* GetInProgressADT(int x, int y);
     void RemoveADT(const meshfiles::ADT* adt);
 
+    MeshBuilder(const std::filesystem::path& outputPath,
+                std::unique_ptr<parser::Map> map, int logLevel,
+                AgentSize agent);
+
 public:
     MeshBuilder(const std::filesystem::path& outputPath, const std::string& mapName,
-                int logLevel);
+                int logLevel, AgentSize agent = AgentSize::Default);
+
+    // builds the navmesh of a transport, such as a ship or zeppelin, from its
+    // wmo alone and in the coordinates of the model, as if it were the global
+    // wmo of a map of the given name (see TransportName()).  the
+    // pathfind::TransportMap of that name then answers queries on its deck
+    // wherever the transport is
+    MeshBuilder(const std::filesystem::path& outputPath,
+                const std::string& transportName, const std::string& wmoPath,
+                int logLevel, AgentSize agent = AgentSize::Default);
     MeshBuilder(const std::filesystem::path& outputPath, const std::string& mapName,
-                int logLevel, int adtX, int adtY);
-
+                int logLevel, int adtX, int adtY,
+                AgentSize agent = AgentSize::Default);
+
+    const AgentProfile& GetAgentProfile() const { return m_agent; }
+
+    // also builds each tile for the given agent, from the height field which
+    // was rasterized for the map's own agent, and stores the mesh alongside
+    // the tile's (see MeshSettings::NavFileAgentMeshes).  only the geometry
+    // is rasterized once: each agent's copy of the height field is filtered
+    // and meshed apart.  this must be called before any tile is built, and
+    // does nothing for maps of a global WMO
+    void AddAgentSize(AgentSize size);
+
+    // finds the agent of the given name (see AgentProfiles), returning false
+    // if there is none
+    static bool FindAgentSize(const std::string& name, AgentSize& size);
+
+    // as above, for a list of names separated by commas, none of them empty
+    static bool FindAgentSizes(const std::string& names,
+                               std::vector<AgentSize>& sizes);
+
+    // installs pathfind::Allocator for recast and detour, with room enough
+    // in each thread's cache for the scratch of a tile, so that each worker
+    // reuses the blocks freed by its previous tile.  this must be called
+    // before recast or detour allocate anything, and so before any builder
+    // exists.  returns false if it was already installed
+    static bool InstallAllocator();
+
+    // the name which the output of a transport is given by default, being
+    // the file name of its wmo without the extension
+    static std::string TransportName(const std::string& wmoPath);
+
+    // reads the game objects of this map from a CSV file or a spawn file
+    // (see pathfind::GameObjectFile)
     void LoadGameObjects(const std::string& path);
 
+    // each line of the file is the map id, the start and end positions, the
+    // radius and whether the connection may also be traversed from its end
+    // (0 or 1), separated by commas
+    void LoadOffMeshConnections(const std::string& path);
+
+    // for incremental builds.  fingerprints the inputs of each ADT (its
+    // source files and those of its neighbours and their models, the mesh
+    // settings, and the game objects and off-mesh connections nearby) and
+    // removes the tiles of every ADT whose fingerprint matches that recorded
+    // by an earlier build.  the fingerprints of ADTs built from here on are
+    // recorded in a manifest next to the nav files.  game objects and off-mesh
+    // connections must be loaded first.  returns the number of ADTs skipped
+    size_t SkipUnchangedADTs();
+
+    // for resuming an interrupted build.  removes the tiles of every ADT
+    // whose nav file is whole, judged by its header and checksum.  a global
+    // WMO counts as one ADT.  returns the number of ADTs skipped
+    size_t SkipCompletedADTs();
+
+    // for building a map across several hosts.  keeps only the ADTs of one of
+    // shards parts of the map, counting from zero.  the parts depend only on
+    // the map, so that every host agrees on them, and each host reads the
+    // neighbouring ADTs it needs from its own copy of the data.  a global
+    // WMO is built entirely by the first shard.  this must be called before
+    // any ADTs are skipped
+    void SelectShard(int shard, int shards);
+
+    // for building only some of the ADTs of a map.  every other ADT is
+    // skipped, though still parsed as by SkipCompletedADTs(), so that the .map
+    // file saved afterwards is whole.  this must be called before any ADTs are
+    // skipped otherwise
+    void SelectADTs(const std::set<std::pair<int, int>>& adts);
+
+    // copies the nav files and BVH data which a shard wrote to its output
+    // directory into this one.  the .map file, which needs every ADT, is
+    // not copied.  resuming afterwards skips the ADTs which were merged and
+    // builds any which were not, before the .map file is saved as usual
+    void MergeShard(const std::filesystem::path& shardPath);
+
+    // rasterizes each ADT once into a heightfield covering it and its
+    // border, from which its tiles copy their columns, rather than each
+    // tile rasterizing the geometry around it.  this costs the memory of an
+    // ADT's heightfield for each ADT being built, but spares the border of
+    // every tile from being rasterized again by its neighbours
+    void ShareADTHeightFields() { m_shareADTHeightFields = true; }
+
+    // stores the height of every walkable model surface of each column of
+    // the height field with the tile, so that the pathfind library may
+    // answer approximate height queries without casting rays, at the cost
+    // of larger nav files
+    void SerializeSurfaceHeights() { m_surfaceHeights = true; }
+
+    // compresses each nav file once it is written, at a zlib level from 1
+    // (fastest) to 9 (smallest).  compressed files take less space but are
+    // inflated into memory when loaded, rather than mapped.  zero leaves
+    // them uncompressed, which is the default
+    void CompressNavFiles(int level);
+
+    // partitions the walkable area of each tile into regions by the given
+    // method (see RegionPartition), which is recorded in the nav files so
+    // that the pathfind library rebuilds their tiles alike.  this must be
+    // called before any tile is built
+    void SetRegionPartition(RegionPartition partition);
+
+    // leaves the height field out of every ADT tile farther than radius
+    // yards (at most MeshSettings::AdtSize) in two dimensions from all of the
+    // game objects loaded by LoadGameObjects().  the height field is only
+    // read to rebuild a tile beneath temporary obstacles, and tiles without
+    // one keep their meshes, though the obstacles still block line of sight
+    // over them.  this makes smaller nav files which load
+    // faster for maps whose obstacles are all game objects known in advance.
+    // this must be called before any tile is built
+    void OmitHeightFields(float radius);
+
+    // finds the partition of the given name ("watershed", "monotone" or
+    // "layers"), returning false if there is none
+    static bool FindRegionPartition(const std::string& name,
+                                    RegionPartition& partition);
+
+    // times each stage of building every tile from here on
+    void EnableProfiling() { m_profile = true; }
+
+    // writes the time spent in each stage of each tile to profile.csv, next
+    // to the nav files, and a summary of where the time went and of the
+    // slowest tiles to the given stream
+    void SaveProfile(std::ostream& summary, size_t hotTiles = 10) const;
+
     size_t CompletedTiles() const { return m_completedTiles; }
+    size_t TotalTiles() const { return m_totalTiles; }
+
+    // appends the tiles finished since the first `from' of them to tiles
+    void FinishedTiles(size_t from,
+                       std::vector<std::pair<int, int>>& tiles) const;
+
+    // the ADTs of which some, but not all, tiles have been built
+    std::vector<std::pair<int, int>> InProgressADTs() const;
+
+    // stops the workers from taking any more tiles.  those already being
+    // built are finished, and every nav file written by then is whole, so
+    // that the build may later be resumed (see SkipCompletedADTs()).  the
+    // map should not be saved once the build is cancelled
+    void Cancel() { m_cancelled = true; }
+    bool Cancelled() const { return m_cancelled; }
+
+    // the total time every worker has spent waiting for another to release
+    // one of the builder's locks, and for ADTs to be parsed
+    std::chrono::nanoseconds LockWaitTime() const
+    {
+        return std::chrono::nanoseconds(m_lockWait.load());
+    }
+    std::chrono::nanoseconds ADTLoadTime() const
+    {
+        return std::chrono::nanoseconds(m_adtWait.load());
+    }
 
     bool GetNextTile(int& tileX, int& tileY);
 
@@ -0,0 +1,279 @@
+#include "PortalBuilder.hpp"
+
+#include "Common.hpp"
+#include "recastnavigation/Detour/Include/DetourAlloc.h"
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "utility/BinaryStream.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+// the most polygons a path between two portals of one tile may cross
+constexpr int MaxPortalPathPolys = 1024;
+
+// one polygon edge along the border of the tile
+struct BorderEdge
+{
+    int m_side;
+    float m_min;
+    float m_max;
+
+    // the heights at m_min and m_max
+    float m_minHeight;
+    float m_maxHeight;
+
+    float m_point[3];
+    dtPolyRef m_poly;
+};
+
+// contiguous border edges, through which a path may leave the tile
+struct Portal
+{
+    int m_side;
+    float m_min;
+    float m_max;
+    float m_lowest;
+    float m_highest;
+
+    // the height of the portal at m_max, for joining the next edge
+    float m_endHeight;
+
+    std::vector<const BorderEdge*> m_edges;
+
+    float m_point[3];
+    dtPolyRef m_poly;
+};
+
+// the recast axis along which the border on the given side runs.  portals on
+// sides 0 and 4 face along x, and those on sides 2 and 6 along z
+int BorderAxis(int side)
+{
+    return side == 0 || side == 4 ? 2 : 0;
+}
+
+float Distance(const float* a, const float* b)
+{
+    auto const dx = a[0] - b[0];
+    auto const dy = a[1] - b[1];
+    auto const dz = a[2] - b[2];
+
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+} // namespace
+
+void BuildTilePortals(const unsigned char* tileData, int tileDataSize,
+                      utility::BinaryStream& out)
+{
+    constexpr float mapOrigin = -32.f * MeshSettings::AdtSize;
+
+    dtNavMeshParams params;
+    params.orig[0] = mapOrigin;
+    params.orig[1] = 0.f;
+    params.orig[2] = mapOrigin;
+    params.tileHeight = params.tileWidth = MeshSettings::TileSize;
+    params.maxTiles = 1;
+    params.maxPolys = 1 << DT_POLY_BITS;
+
+    dtNavMesh navMesh;
+    if (dtStatusFailed(navMesh.init(&params)))
+        return;
+
+    // detour patches links into the data it is given, so it gets a copy
+    auto const data =
+        static_cast<unsigned char*>(dtAlloc(tileDataSize, DT_ALLOC_PERM));
+    memcpy(data, tileData, tileDataSize);
+
+    dtTileRef tileRef;
+    if (dtStatusFailed(navMesh.addTile(data, tileDataSize, DT_TILE_FREE_DATA,
+                                       0, &tileRef)))
+    {
+        dtFree(data);
+        return;
+    }
+
+    auto const tile = navMesh.getTileByRef(tileRef);
+    auto const base = navMesh.getPolyRefBase(tile);
+
+    std::vector<BorderEdge> edges;
+
+    for (auto i = 0; i < tile->header->polyCount; ++i)
+    {
+        auto const& poly = tile->polys[i];
+
+        if (poly.getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+            continue;
+
+        for (auto j = 0; j < poly.vertCount; ++j)
+        {
+            if (!(poly.neis[j] & DT_EXT_LINK))
+                continue;
+
+            BorderEdge edge;
+            edge.m_side = poly.neis[j] & 0xFF;
+            edge.m_poly = base | static_cast<dtPolyRef>(i);
+
+            auto const va = &tile->verts[poly.verts[j] * 3];
+            auto const vb =
+                &tile->verts[poly.verts[(j + 1) % poly.vertCount] * 3];
+
+            auto const axis = BorderAxis(edge.m_side);
+            auto const aFirst = va[axis] <= vb[axis];
+
+            edge.m_min = aFirst ? va[axis] : vb[axis];
+            edge.m_max = aFirst ? vb[axis] : va[axis];
+            edge.m_minHeight = aFirst ? va[1] : vb[1];
+            edge.m_maxHeight = aFirst ? vb[1] : va[1];
+
+            for (auto k = 0; k < 3; ++k)
+                edge.m_point[k] = 0.5f * (va[k] + vb[k]);
+
+            edges.push_back(edge);
+        }
+    }
+
+    std::sort(edges.begin(), edges.end(),
+              [](const BorderEdge& a, const BorderEdge& b)
+              {
+                  return a.m_side != b.m_side ? a.m_side < b.m_side
+                                              : a.m_min < b.m_min;
+              });
+
+    // merge edges into portals where they meet end to end.  a portal of
+    // another layer, such as a bridge above the ground, may be interleaved
+    // with them, so every portal on the side is a candidate
+    std::vector<Portal> portals;
+    size_t sideBegin = 0;
+
+    for (auto const& edge : edges)
+    {
+        if (!portals.empty() && portals.back().m_side != edge.m_side)
+            sideBegin = portals.size();
+
+        Portal* joined = nullptr;
+
+        for (auto p = sideBegin; p < portals.size(); ++p)
+        {
+            auto& portal = portals[p];
+
+            if (edge.m_min <= portal.m_max + MeshSettings::CellSize &&
+                std::fabs(edge.m_minHeight - portal.m_endHeight) <=
+                    MeshSettings::WalkableClimb)
+            {
+                joined = &portal;
+                break;
+            }
+        }
+
+        if (!joined)
+        {
+            portals.emplace_back();
+            joined = &portals.back();
+
+            joined->m_side = edge.m_side;
+            joined->m_min = edge.m_min;
+            joined->m_max = edge.m_max;
+            joined->m_lowest = (std::min)(edge.m_minHeight, edge.m_maxHeight);
+            joined->m_highest = (std::max)(edge.m_minHeight, edge.m_maxHeight);
+        }
+
+        joined->m_max = (std::max)(joined->m_max, edge.m_max);
+        joined->m_endHeight = edge.m_maxHeight;
+        joined->m_lowest = (std::min)(
+            joined->m_lowest, (std::min)(edge.m_minHeight, edge.m_maxHeight));
+        joined->m_highest = (std::max)(
+            joined->m_highest, (std::max)(edge.m_minHeight, edge.m_maxHeight));
+        joined->m_edges.push_back(&edge);
+    }
+
+    // routes pass through the middle of the edge nearest the middle of the
+    // portal
+    for (auto& portal : portals)
+    {
+        auto const middle = 0.5f * (portal.m_min + portal.m_max);
+        auto const axis = BorderAxis(portal.m_side);
+
+        auto const nearest = *std::min_element(
+            portal.m_edges.begin(), portal.m_edges.end(),
+            [middle, axis](const BorderEdge* a, const BorderEdge* b) {
+                return std::fabs(a->m_point[axis] - middle) <
+                       std::fabs(b->m_point[axis] - middle);
+            });
+
+        memcpy(portal.m_point, nearest->m_point, sizeof(portal.m_point));
+        portal.m_poly = nearest->m_poly;
+    }
+
+    // portal indices are stored as 16 bits
+    if (portals.size() > 0xFFFF)
+        portals.resize(0xFFFF);
+
+    out << static_cast<std::uint32_t>(portals.size());
+
+    for (auto const& portal : portals)
+        out << static_cast<std::uint8_t>(portal.m_side) << portal.m_min
+            << portal.m_max << portal.m_lowest << portal.m_highest
+            << portal.m_point[0] << portal.m_point[1] << portal.m_point[2];
+
+    dtNavMeshQuery query;
+    if (dtStatusFailed(query.init(&navMesh, 4096)))
+    {
+        out << static_cast<std::uint32_t>(0);
+        return;
+    }
+
+    dtQueryFilter filter;
+    std::vector<dtPolyRef> path(MaxPortalPathPolys);
+    std::vector<float> straightPath(MaxPortalPathPolys * 3);
+
+    struct Edge
+    {
+        std::uint16_t m_from;
+        std::uint16_t m_to;
+        float m_cost;
+    };
+
+    std::vector<Edge> portalEdges;
+
+    for (auto a = 0u; a < portals.size(); ++a)
+        for (auto b = a + 1; b < portals.size(); ++b)
+        {
+            int pathLength;
+            auto const findPathResult = query.findPath(
+                portals[a].m_poly, portals[b].m_poly, portals[a].m_point,
+                portals[b].m_point, &filter, &path[0], &pathLength,
+                MaxPortalPathPolys);
+
+            // a partial path means the portals are not connected within
+            // this tile
+            if (!dtStatusSucceed(findPathResult) ||
+                !!(findPathResult & DT_PARTIAL_RESULT))
+                continue;
+
+            int straightPathLength;
+            if (!dtStatusSucceed(query.findStraightPath(
+                    portals[a].m_point, portals[b].m_point, &path[0],
+                    pathLength, &straightPath[0], nullptr, nullptr,
+                    &straightPathLength, MaxPortalPathPolys)))
+                continue;
+
+            float cost = 0.f;
+            for (auto i = 1; i < straightPathLength; ++i)
+                cost += Distance(&straightPath[(i - 1) * 3],
+                                 &straightPath[i * 3]);
+
+            portalEdges.push_back({static_cast<std::uint16_t>(a),
+                                   static_cast<std::uint16_t>(b), cost});
+        }
+
+    out << static_cast<std::uint32_t>(portalEdges.size());
+
+    for (auto const& edge : portalEdges)
+        out << edge.m_from << edge.m_to << edge.m_cost;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "utility/BinaryStream.hpp"
+
+// finds the portals through which a finished navmesh tile connects to its
+// neighbours, and the cost of walking between each connected pair of them
+// within the tile.  these make up the coarse graph which pathfind uses to
+// route long paths before refining them with detour (see
+// pathfind::PortalGraph).  the tile data is that produced by
+// dtCreateNavMeshData()
+//
+// the output is the portal count, then for each portal its side (as detour
+// numbers them), the range it spans along that side, the range of its height
+// and the point of the portal through which routes pass.  this is followed by
+// the edge count and, for each edge, both portal indices and the cost.  all
+// positions are in recast space.
+void BuildTilePortals(const unsigned char* tileData, int tileDataSize,
+                      utility::BinaryStream& out);
@@ -34,4 +34,102 @@ void RecastContext::doLog(const rcLogCategory category, const char* msg,
 
     out << msg << std::endl;
     std::cout << out.str();
-}
\ No newline at end of file
+}
+const char* RecastContext::StageName(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::ChunkLoad:
+            return "chunk_load";
+        case Stage::Geometry:
+            return "geometry";
+        case Stage::Rasterize:
+            return "rasterize";
+        case Stage::Filter:
+            return "filter";
+        case Stage::Regions:
+            return "regions";
+        case Stage::Contours:
+            return "contours";
+        case Stage::PolyMesh:
+            return "poly_mesh";
+        case Stage::DetailMesh:
+            return "detail_mesh";
+        case Stage::Serialize:
+            return "serialize";
+        default:
+            return "unknown";
+    }
+}
+
+RecastContext::Stage RecastContext::GetStage(rcTimerLabel label)
+{
+    switch (label)
+    {
+        case RC_TIMER_RASTERIZE_TRIANGLES:
+            return Stage::Rasterize;
+        case RC_TIMER_FILTER_BORDER:
+        case RC_TIMER_FILTER_WALKABLE:
+        case RC_TIMER_FILTER_LOW_OBSTACLES:
+        case RC_TIMER_MEDIAN_AREA:
+            return Stage::Filter;
+        case RC_TIMER_BUILD_COMPACTHEIGHTFIELD:
+        case RC_TIMER_ERODE_AREA:
+        case RC_TIMER_BUILD_DISTANCEFIELD:
+        case RC_TIMER_BUILD_REGIONS:
+            return Stage::Regions;
+        case RC_TIMER_BUILD_CONTOURS:
+            return Stage::Contours;
+        case RC_TIMER_BUILD_POLYMESH:
+            return Stage::PolyMesh;
+        case RC_TIMER_BUILD_POLYMESHDETAIL:
+            return Stage::DetailMesh;
+        default:
+            return Stage::StageCount;
+    }
+}
+
+void RecastContext::doResetTimers()
+{
+    for (auto& time : m_stageTimes)
+        time = 0;
+}
+
+void RecastContext::doStartTimer(const rcTimerLabel label)
+{
+    auto const stage = GetStage(label);
+
+    if (stage != Stage::StageCount)
+        StartStage(stage);
+}
+
+void RecastContext::doStopTimer(const rcTimerLabel label)
+{
+    auto const stage = GetStage(label);
+
+    if (stage != Stage::StageCount)
+        StopStage(stage);
+}
+
+int RecastContext::doGetAccumulatedTime(const rcTimerLabel label) const
+{
+    auto const stage = GetStage(label);
+
+    return stage == Stage::StageCount ? -1
+                                      : static_cast<int>(m_stageTimes[stage]);
+}
+
+void RecastContext::StartStage(Stage stage)
+{
+    if (m_timerEnabled)
+        m_stageStarts[stage] = Clock::now();
+}
+
+void RecastContext::StopStage(Stage stage)
+{
+    if (m_timerEnabled)
+        m_stageTimes[stage] +=
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                Clock::now() - m_stageStarts[stage])
+                .count();
+}
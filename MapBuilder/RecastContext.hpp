@@ -2,17 +2,65 @@
 
 #include "recastnavigation/Recast/Include/Recast.h"
 
+#include <chrono>
+#include <cstdint>
+
 class RecastContext : public rcContext
 {
+public:
+    // the stages of building a tile which are profiled.  most are timed by
+    // recast itself, through the timer labels of the functions it provides
+    enum Stage
+    {
+        ChunkLoad,
+        Geometry,
+        Rasterize,
+        Filter,
+        Regions,
+        Contours,
+        PolyMesh,
+        DetailMesh,
+        Serialize,
+        StageCount,
+    };
+
+    static const char* StageName(Stage stage);
+
 private:
+    using Clock = std::chrono::steady_clock;
+
     const rcLogCategory m_logLevel;
 
+    Clock::time_point m_stageStarts[StageCount];
+    std::int64_t m_stageTimes[StageCount];
+
     virtual void doLog(const rcLogCategory category, const char* msg,
                        const int len) override;
 
+    virtual void doResetTimers() override;
+    virtual void doStartTimer(const rcTimerLabel label) override;
+    virtual void doStopTimer(const rcTimerLabel label) override;
+    virtual int doGetAccumulatedTime(const rcTimerLabel label) const override;
+
+    // the stage timed by a recast label, or StageCount for those which are
+    // not profiled, such as the steps within rcBuildRegions()
+    static Stage GetStage(rcTimerLabel label);
+
 public:
-    RecastContext(int logLevel)
-        : m_logLevel(static_cast<rcLogCategory>(logLevel))
+    // timing costs a little, and so is only done when profiling
+    RecastContext(int logLevel, bool profile = false)
+        : m_logLevel(static_cast<rcLogCategory>(logLevel)), m_stageTimes()
+    {
+        enableTimer(profile);
+    }
+
+    // for the stages which recast does not time.  stages must not overlap
+    void StartStage(Stage stage);
+    void StopStage(Stage stage);
+
+    // microseconds spent in the stage since the timers were last reset
+    std::int64_t GetStageTime(Stage stage) const
     {
+        return m_stageTimes[stage];
     }
-};
\ No newline at end of file
+};
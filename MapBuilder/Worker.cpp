@@ -3,6 +3,7 @@
 #include "Common.hpp"
 #include "MeshBuilder.hpp"
 #include "parser/MpqManager.hpp"
+#include "utility/Trace.hpp"
 
 #include <cassert>
 #include <chrono>
@@ -39,6 +40,8 @@ void Worker::Work()
             if (!m_meshBuilder->GetNextTile(tileX, tileY))
                 break;
 
+            utility::Trace::Scope trace("BuildTile", "build", tileX, tileY);
+
             if (m_wmo)
             {
                 if (!m_meshBuilder->BuildAndSerializeWMOTile(tileX, tileY))
@@ -93,6 +96,11 @@ void Worker::Work()
     m_isFinished = true;
 }
 
+void Worker::RequestShutdown()
+{
+    m_shutdownRequested = true;
+}
+
 bool Worker::IsFinished() const
 {
     return m_isFinished;
@@ -15,7 +15,7 @@ private:
     MeshBuilder* const m_meshBuilder;
 
     const bool m_wmo;
-    bool m_shutdownRequested;
+    std::atomic_bool m_shutdownRequested;
     std::atomic_bool m_isFinished;
 
     std::thread m_thread;
@@ -26,5 +26,9 @@ public:
     Worker(const std::string& dataPath, MeshBuilder* meshBuilder);
     ~Worker();
 
+    // asks the worker to stop once it has finished the tile it is building,
+    // without waiting for it to
+    void RequestShutdown();
+
     bool IsFinished() const;
 };
\ No newline at end of file
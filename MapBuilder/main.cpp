@@ -4,18 +4,34 @@
 #include "parser/Adt/Adt.hpp"
 #include "parser/MpqManager.hpp"
 #include "parser/Wmo/WmoInstance.hpp"
+#include "pathfind/Allocator.hpp"
+#include "pathfind/GameObjectFile.hpp"
+#include "utility/AABBTree.hpp"
 #include "utility/String.hpp"
+#include "utility/Trace.hpp"
 #include "FileExist.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 #define STATUS_INTERVAL_SECONDS 10
 
@@ -28,14 +44,55 @@ void DisplayUsage(std::ostream& o)
     o << "  -d/--data <data directory>     -- Path to data directory from "
          "which to draw input geometry\n";
     o << "  -m/--map <map name>            -- Which map to produce data for\n";
+    o << "  --transport <wmo path>         -- Build the navmesh of a transport "
+         "wmo in its own coordinates, named as --map or else after the wmo\n";
     o << "  -b/--bvh                       -- Build line of sight (BVH) data "
          "for all models eligible for spawning by the server\n";
     o << "  -g/--gocsv <go csv file>       -- Path to CSV file containing game "
          "object data to include in static mesh output\n";
+    o << "  --gobinary <file>              -- Convert the --gocsv file to a "
+         "binary spawn file, for every map, and exit\n";
+    o << "  -c/--offmeshcsv <csv file>     -- Path to CSV file containing "
+         "off-mesh connections to include in static mesh output\n";
+    o << "  -i/--incremental               -- Skip ADTs whose inputs are "
+         "unchanged since the last incremental build\n";
+    o << "  -r/--resume                    -- Skip ADTs already built by an "
+         "interrupted build\n";
+    o << "  -p/--shard <i/N>               -- Build only the i-th of N parts "
+         "of the map, from 1 to N, without its .map file\n";
+    o << "  -e/--merge <shard directory>   -- Copy the output of a shard "
+         "before building what remains of the map (may be repeated)\n";
+    o << "  -f/--profile                   -- Time each stage of every tile, "
+         "writing profile.csv next to the nav files\n";
+    o << "  -a/--adtHeightField            -- Rasterize each ADT once, rather "
+         "than each tile and its border apart\n";
+    o << "  -v/--surfaceHeights            -- Store the height of every "
+         "walkable model surface for imprecise height queries\n";
+    o << "  -z/--compress <level>          -- Compress nav files at a zlib "
+         "level from 1 to 9, rather than leaving them to be mapped\n";
+    o << "  --partition <method>           -- Partition tile regions by "
+         "watershed (the default), monotone (fastest) or layers\n";
+    o << "  --heightFieldRadius <yards>    -- Only store the height fields "
+         "of tiles this near to game objects, for smaller nav files\n";
+    o << "  -j/--agent <size>[,<size>...]  -- Build for agents of this size "
+         "(default, small or large), and of any others listed from the same "
+         "height fields\n";
+    o << "  -k/--modelCache <directory>    -- Cache parsed model geometry in "
+         "directory for later builds from the same data\n";
+    o << "  -n/--packBvh                   -- Also copy every BVH file into "
+         "a single pack, mapped at once by the pathfind library\n";
+    o << "  -u/--shareBvh                  -- Give models with identical "
+         "collision geometry the same BVH file\n";
     o << "  -o/--output <output directory> -- Path to root output directory\n";
     o << "  -t/--threads <thread count>    -- How many worker threads to use\n";
+    o << "  -w/--benchmark <thread count>  -- Build the map at 1, 2, 4, ... "
+         "up to this many threads, reporting how each scales\n";
+    o << "  -q/--trace <file>              -- Write a Chrome trace of tile "
+         "builds, file reads and ADT parsing to file\n";
     o << "  -l/--logLevel <log level>      -- Log level (0 = none, 1 = "
          "progress, 2 = warning, 3 = error)\n";
+    o << "  -s/--bvhBuilder <method>       -- How to build BVH data (binned = "
+         "binned SAH, the default, sweep = full sweep SAH)\n";
 #ifdef _DEBUG
     o << "  -x/--adtX <x>                  -- X coordinate of individual ADT "
          "to process\n";
@@ -44,13 +101,133 @@ void DisplayUsage(std::ostream& o)
 #endif
     o.flush();
 }
+
+// forgets the peak resident size of the process so far, where supported, so
+// that each benchmark run reports its own
+void ResetPeakResidentSize()
+{
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+// the peak resident size of the process, in bytes
+std::uint64_t PeakResidentSize()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                                 sizeof(counters)))
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+#elif defined(__linux__)
+    std::ifstream in("/proc/self/status");
+
+    for (std::string line; std::getline(in, line);)
+        if (line.rfind("VmHWM:", 0) == 0)
+            return std::stoull(line.substr(6)) * 1024;
+
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+
+    // this is in bytes on macos, where it cannot be reset
+    return static_cast<std::uint64_t>(usage.ru_maxrss);
+#endif
+}
+
+// builds the map into a directory of its own at 1, 2, 4, ... up to
+// maxThreads threads, reporting the throughput and contention of each.  the
+// directory is removed after each run, so that every run builds everything
+void Benchmark(const std::string& dataPath, const std::string& outputPath,
+               const std::string& map, int logLevel,
+               const std::vector<AgentSize>& agents, int maxThreads,
+               const std::function<void(MeshBuilder&)>& configure)
+{
+    std::cout << std::setw(8) << "threads" << std::setw(8) << "tiles"
+              << std::setw(12) << "seconds" << std::setw(12) << "tiles/s"
+              << std::setw(12) << "peak MiB" << std::setw(14) << "lock wait s"
+              << std::setw(14) << "ADT load s" << std::endl;
+
+    for (auto threads = 1;; threads = (std::min)(2 * threads, maxThreads))
+    {
+        auto const runPath = std::filesystem::path(outputPath) /
+                             ("Benchmark" + std::to_string(threads));
+
+        std::filesystem::remove_all(runPath);
+        files::create_bvh_output_directory(runPath);
+        files::create_nav_output_directory(runPath);
+
+        ResetPeakResidentSize();
+
+        MeshBuilder builder(runPath, map, logLevel, agents[0]);
+
+        for (auto i = 1u; i < agents.size(); ++i)
+            builder.AddAgentSize(agents[i]);
+
+        configure(builder);
+
+        auto const start = std::chrono::steady_clock::now();
+
+        {
+            std::vector<std::unique_ptr<Worker>> workers;
+            for (auto i = 0; i < threads; ++i)
+                workers.push_back(std::make_unique<Worker>(dataPath, &builder));
+
+            for (auto const& worker : workers)
+                while (!worker->IsFinished())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+
+        auto const seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+
+        std::cout << std::fixed << std::setw(8) << threads << std::setw(8)
+                  << builder.CompletedTiles() << std::setw(12)
+                  << std::setprecision(2) << seconds << std::setw(12)
+                  << builder.CompletedTiles() / seconds << std::setw(12)
+                  << std::setprecision(1)
+                  << PeakResidentSize() / (1024.0 * 1024.0) << std::setw(14)
+                  << std::setprecision(3)
+                  << std::chrono::duration<double>(builder.LockWaitTime())
+                         .count()
+                  << std::setw(14)
+                  << std::chrono::duration<double>(builder.ADTLoadTime())
+                         .count()
+                  << std::endl;
+
+        std::filesystem::remove_all(runPath);
+
+        if (threads == maxThreads)
+            break;
+    }
+}
 } // namespace
 
 int main(int argc, char* argv[])
 {
-    std::string dataPath, map, outputPath, goCSVPath;
+    std::string dataPath, map, outputPath, goCSVPath, goBinaryPath,
+        offMeshCSVPath, modelCachePath, tracePath, transportPath;
     int adtX = -1, adtY = -1, threads = 1, logLevel;
-    bool bvh = false;
+    int shard = -1, shards = 0, compressionLevel = 0, benchmark = 0;
+    bool bvh = false, incremental = false, resume = false, profile = false,
+         adtHeightField = false, packBvh = false, shareBvh = false,
+         surfaceHeights = false;
+    std::vector<std::string> mergePaths;
+    std::vector<AgentSize> agents {AgentSize::Default};
+    auto partition = RegionPartition::Watershed;
+    float heightFieldRadius = -1.f;
+
+    // every tile allocates and frees the same recast scratch: its height
+    // fields, compact height field, contours and meshes.  with the pooling
+    // allocator, each worker reuses the blocks of its previous tile instead
+    // of going back to the heap.  this must happen before anything is
+    // allocated by recast or detour
+    MeshBuilder::InstallAllocator();
 
     try
     {
@@ -64,6 +241,41 @@ int main(int argc, char* argv[])
                 bvh = true;
                 continue;
             }
+            else if (arg == "-i" || arg == "--incremental")
+            {
+                incremental = true;
+                continue;
+            }
+            else if (arg == "-r" || arg == "--resume")
+            {
+                resume = true;
+                continue;
+            }
+            else if (arg == "-f" || arg == "--profile")
+            {
+                profile = true;
+                continue;
+            }
+            else if (arg == "-a" || arg == "--adtheightfield")
+            {
+                adtHeightField = true;
+                continue;
+            }
+            else if (arg == "-v" || arg == "--surfaceheights")
+            {
+                surfaceHeights = true;
+                continue;
+            }
+            else if (arg == "-n" || arg == "--packbvh")
+            {
+                packBvh = true;
+                continue;
+            }
+            else if (arg == "-u" || arg == "--sharebvh")
+            {
+                shareBvh = true;
+                continue;
+            }
             else if (arg == "-h" || arg == "--help")
             {
                 // when this is requested, don't do anything else
@@ -80,14 +292,94 @@ int main(int argc, char* argv[])
                 dataPath = argv[++i];
             else if (arg == "-m" || arg == "--map")
                 map = argv[++i];
+            else if (arg == "--transport")
+                transportPath = argv[++i];
             else if (arg == "-g" || arg == "--gocsv")
                 goCSVPath = argv[++i];
+            else if (arg == "--gobinary")
+                goBinaryPath = argv[++i];
+            else if (arg == "-c" || arg == "--offmeshcsv")
+                offMeshCSVPath = argv[++i];
+            else if (arg == "-p" || arg == "--shard")
+            {
+                const std::string value = argv[++i];
+                auto const slash = value.find('/');
+
+                if (slash == std::string::npos)
+                    throw std::invalid_argument("Shard must be given as i/N");
+
+                shard = std::stoi(value.substr(0, slash)) - 1;
+                shards = std::stoi(value.substr(slash + 1));
+
+                if (shard < 0 || shard >= shards)
+                    throw std::invalid_argument("Invalid shard " + value);
+            }
+            else if (arg == "-e" || arg == "--merge")
+                mergePaths.push_back(argv[++i]);
+            else if (arg == "-z" || arg == "--compress")
+            {
+                compressionLevel = std::stoi(argv[++i]);
+
+                if (compressionLevel < 1 || compressionLevel > 9)
+                    throw std::invalid_argument(
+                        "Compression level must be from 1 to 9");
+            }
+            else if (arg == "-j" || arg == "--agent")
+            {
+                const std::string sizes = utility::lower(argv[++i]);
+
+                if (!MeshBuilder::FindAgentSizes(sizes, agents))
+                    throw std::invalid_argument("Unrecognized agent sizes " +
+                                                sizes);
+            }
+            else if (arg == "--partition")
+            {
+                const std::string name = utility::lower(argv[++i]);
+
+                if (!MeshBuilder::FindRegionPartition(name, partition))
+                    throw std::invalid_argument(
+                        "Unrecognized region partition " + name);
+            }
+            else if (arg == "--heightfieldradius")
+            {
+                heightFieldRadius = std::stof(argv[++i]);
+
+                if (heightFieldRadius < 0.f)
+                    throw std::invalid_argument(
+                        "Height field radius must not be negative");
+            }
+            else if (arg == "-k" || arg == "--modelcache")
+                modelCachePath = argv[++i];
+            else if (arg == "-q" || arg == "--trace")
+                tracePath = argv[++i];
             else if (arg == "-o" || arg == "--output")
                 outputPath = argv[++i];
             else if (arg == "-t" || arg == "--threads")
                 threads = std::stoi(argv[++i]);
+            else if (arg == "-w" || arg == "--benchmark")
+            {
+                benchmark = std::stoi(argv[++i]);
+
+                if (benchmark < 1)
+                    throw std::invalid_argument(
+                        "Benchmark thread count must be at least 1");
+            }
             else if (arg == "-l" || arg == "--loglevel")
                 logLevel = std::stoi(argv[++i]);
+            else if (arg == "-s" || arg == "--bvhbuilder")
+            {
+                const std::string method = utility::lower(argv[++i]);
+
+                if (method == "binned")
+                    math::AABBTree::SetDefaultBuildMethod(
+                        math::AABBTree::BuildMethod::BinnedSAH);
+                else if (method == "sweep")
+                    math::AABBTree::SetDefaultBuildMethod(
+                        math::AABBTree::BuildMethod::SweepSAH);
+                else
+                    throw std::invalid_argument("Unrecognized BVH builder " +
+                                                method);
+            }
 #ifdef _DEBUG
             else if (arg == "-x" || arg == "--adtX")
                 adtX = std::stoi(argv[++i]);
@@ -105,6 +397,32 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
+    // converting game objects needs neither data nor output
+    if (!goBinaryPath.empty())
+    {
+        if (goCSVPath.empty())
+        {
+            std::cerr << "ERROR: Must specify the CSV file to convert (--gocsv)"
+                      << std::endl;
+            DisplayUsage(std::cerr);
+            return EXIT_FAILURE;
+        }
+
+        try
+        {
+            std::vector<GameObjectSpawn> spawns;
+            pathfind::GameObjectFile::ReadCSV(goCSVPath, spawns);
+            pathfind::GameObjectFile::Write(goBinaryPath, std::move(spawns));
+        }
+        catch (std::exception const& e)
+        {
+            std::cerr << "ERROR: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
     if (outputPath.empty())
     {
         std::cerr << "ERROR: Must specify output path" << std::endl;
@@ -112,7 +430,7 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
-    if (!bvh && map.empty())
+    if (!bvh && map.empty() && transportPath.empty())
     {
         std::cerr << "ERROR: Must specify either a map to generate (--map) or "
                      "the global generation of BVH data (--bvh)"
@@ -131,6 +449,22 @@ int main(int argc, char* argv[])
 
     auto lastStatus = static_cast<time_t>(0);
 
+    if (!tracePath.empty())
+        utility::Trace::Start();
+
+    // written however the build ends, from here on
+    struct TraceWriter
+    {
+        const std::string& m_path;
+
+        ~TraceWriter()
+        {
+            if (!m_path.empty() && !utility::Trace::Save(m_path))
+                std::cerr << "ERROR: Failed to write trace to " << m_path
+                          << std::endl;
+        }
+    } traceWriter {tracePath};
+
     std::unique_ptr<MeshBuilder> builder;
     std::vector<std::unique_ptr<Worker>> workers;
 
@@ -138,12 +472,19 @@ int main(int argc, char* argv[])
     {
         files::create_bvh_output_directory(outputPath);
 
+        if (!modelCachePath.empty())
+            parser::MpqManager::SetModelCache(modelCachePath);
+
+        BVHConstructor::SetPackFiles(packBvh);
+        BVHConstructor::SetShareFiles(shareBvh);
+
         if (bvh)
         {
-            if (!goCSVPath.empty())
+            if (!goCSVPath.empty() || !offMeshCSVPath.empty())
             {
-                std::cerr << "ERROR: Specifying gameobject data for BVH "
-                             "generation is meaningless"
+                std::cerr << "ERROR: Specifying gameobject or off-mesh "
+                             "connection data for BVH generation is "
+                             "meaningless"
                           << std::endl;
                 DisplayUsage(std::cerr);
                 return EXIT_FAILURE;
@@ -173,11 +514,9 @@ int main(int argc, char* argv[])
 
                     auto const completed = startSize - goBuilder.Remaining();
 
-                    auto const percentComplete =
-                        100.f * static_cast<float>(completed) / startSize;
                     str << "% Complete: " << std::setprecision(4)
-                        << percentComplete << " (" << std::dec << completed
-                        << " / " << startSize << ")\n";
+                        << goBuilder.PercentComplete() << " (" << std::dec
+                        << completed << " / " << startSize << ")\n";
                     std::cout << str.str();
                     std::cout.flush();
 
@@ -204,14 +543,104 @@ int main(int argc, char* argv[])
 
         parser::sMpqManager.Initialize(dataPath);
 
-        if (adtX >= 0 && adtY >= 0)
+        if (benchmark > 0)
+        {
+            Benchmark(dataPath, outputPath, map, logLevel, agents, benchmark,
+                      [&](MeshBuilder& builder)
+                      {
+                          if (!goCSVPath.empty())
+                              builder.LoadGameObjects(goCSVPath);
+
+                          if (!offMeshCSVPath.empty())
+                              builder.LoadOffMeshConnections(offMeshCSVPath);
+
+                          if (adtHeightField)
+                              builder.ShareADTHeightFields();
+
+                          if (surfaceHeights)
+                              builder.SerializeSurfaceHeights();
+
+                          if (compressionLevel > 0)
+                              builder.CompressNavFiles(compressionLevel);
+
+                          builder.SetRegionPartition(partition);
+
+                          if (heightFieldRadius >= 0.f)
+                              builder.OmitHeightFields(heightFieldRadius);
+
+                          // a shard makes a smaller, fixed set of ADTs
+                          if (shards > 0)
+                              builder.SelectShard(shard, shards);
+                      });
+
+            return EXIT_SUCCESS;
+        }
+
+        if (!transportPath.empty())
+        {
+            // a transport has neither ADTs nor game objects of its own, and
+            // is only ever built whole
+            if (adtX >= 0 || adtY >= 0 || shards > 0 || !goCSVPath.empty() ||
+                !offMeshCSVPath.empty())
+            {
+                std::cerr << "ERROR: A transport is built whole, without game "
+                             "objects or off-mesh connections"
+                          << std::endl;
+                DisplayUsage(std::cerr);
+                return EXIT_FAILURE;
+            }
+
+            if (map.empty())
+                map = MeshBuilder::TransportName(transportPath);
+
+            builder = std::make_unique<MeshBuilder>(
+                outputPath, map, transportPath, logLevel, agents[0]);
+
+            if (profile)
+                builder->EnableProfiling();
+
+            if (compressionLevel > 0)
+                builder->CompressNavFiles(compressionLevel);
+
+            builder->SetRegionPartition(partition);
+
+            std::cout << "Building transport " << map << "..." << std::endl;
+
+            for (auto i = 0; i < threads; ++i)
+                workers.push_back(
+                    std::make_unique<Worker>(dataPath, builder.get()));
+        }
+        else if (adtX >= 0 && adtY >= 0)
         {
             builder = std::make_unique<MeshBuilder>(outputPath, map, logLevel,
-                                                    adtX, adtY);
+                                                    adtX, adtY, agents[0]);
+
+            for (auto i = 1u; i < agents.size(); ++i)
+                builder->AddAgentSize(agents[i]);
+
+            if (profile)
+                builder->EnableProfiling();
+
+            if (adtHeightField)
+                builder->ShareADTHeightFields();
+
+            if (surfaceHeights)
+                builder->SerializeSurfaceHeights();
+
+            if (compressionLevel > 0)
+                builder->CompressNavFiles(compressionLevel);
+
+            builder->SetRegionPartition(partition);
+
+            if (heightFieldRadius >= 0.f)
+                builder->OmitHeightFields(heightFieldRadius);
 
             if (!goCSVPath.empty())
                 builder->LoadGameObjects(goCSVPath);
 
+            if (!offMeshCSVPath.empty())
+                builder->LoadOffMeshConnections(offMeshCSVPath);
+
             if (builder->IsGlobalWMO())
             {
                 std::cerr << "ERROR: Specified map has no ADTs" << std::endl;
@@ -234,11 +663,50 @@ int main(int argc, char* argv[])
         }
         else
         {
-            builder = std::make_unique<MeshBuilder>(outputPath, map, logLevel);
+            builder = std::make_unique<MeshBuilder>(outputPath, map, logLevel,
+                                                    agents[0]);
+
+            for (auto i = 1u; i < agents.size(); ++i)
+                builder->AddAgentSize(agents[i]);
 
             if (!goCSVPath.empty())
                 builder->LoadGameObjects(goCSVPath);
 
+            if (!offMeshCSVPath.empty())
+                builder->LoadOffMeshConnections(offMeshCSVPath);
+
+            if (profile)
+                builder->EnableProfiling();
+
+            if (adtHeightField)
+                builder->ShareADTHeightFields();
+
+            if (surfaceHeights)
+                builder->SerializeSurfaceHeights();
+
+            if (compressionLevel > 0)
+                builder->CompressNavFiles(compressionLevel);
+
+            builder->SetRegionPartition(partition);
+
+            if (heightFieldRadius >= 0.f)
+                builder->OmitHeightFields(heightFieldRadius);
+
+            // this must come first, so that every shard divides the map alike
+            if (shards > 0)
+                builder->SelectShard(shard, shards);
+
+            for (auto const& mergePath : mergePaths)
+                builder->MergeShard(mergePath);
+
+            if (incremental)
+                std::cout << "Skipping " << builder->SkipUnchangedADTs()
+                          << " unchanged ADTs." << std::endl;
+
+            if (resume || !mergePaths.empty())
+                std::cout << "Skipping " << builder->SkipCompletedADTs()
+                          << " completed ADTs." << std::endl;
+
             for (auto i = 0; i < threads; ++i)
                 workers.push_back(
                     std::make_unique<Worker>(dataPath, builder.get()));
@@ -281,12 +749,24 @@ int main(int argc, char* argv[])
         }
     }
 
-    builder->SaveMap();
+    // the .map file of a shard would hold only its own ADTs, so it is written
+    // when the shards are merged instead
+    if (shards == 0)
+        builder->SaveMap();
 
     auto const runTime = time(nullptr) - start;
 
     std::cout << "Finished " << map << " (" << builder->CompletedTiles()
               << " tiles) in " << runTime << " seconds." << std::endl;
 
+    if (profile)
+    {
+        builder->SaveProfile(std::cout);
+
+        auto const stats = pathfind::Allocator::GetStats();
+        std::cout << "Recast allocations: " << stats.m_allocations << " ("
+                  << stats.m_reused << " reused)" << std::endl;
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
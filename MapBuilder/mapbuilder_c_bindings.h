@@ -60,4 +60,125 @@ MapBuildResultType mapbuild_map_files_exist(const char* const output_path,
                                             const char* const map_name,
                                             uint8_t* const exists);
 
+/*
+    A build of one map which runs in the background, so that the caller can choose
+    which ADTs are built, change the number of threads building them, watch the
+    tiles finish and cancel the build.
+
+    A session is configured, then started with `mapbuild_session_start`, and
+    finished with `mapbuild_session_wait`. The functions of a session may be called
+    from any thread.
+*/
+typedef struct mapbuild_session mapbuild_session;
+
+typedef struct {
+    uint64_t completed_tiles;
+    uint64_t total_tiles;
+    uint32_t threads;
+    uint8_t started;
+    uint8_t finished;
+    uint8_t cancelled;
+} MapBuildProgress;
+
+typedef struct {
+    int32_t x;
+    int32_t y;
+} MapBuildTile;
+
+/*
+    Creates a session for building the map with `map_name`. The arguments are as
+    for `mapbuild_build_map`, and the session has one thread until
+    `mapbuild_session_set_threads` is called.
+
+    Returns `NULL` and sets `result` if the map cannot be read.
+*/
+mapbuild_session* mapbuild_new_session(const char* const data_path,
+                                       const char* const output_path,
+                                       const char* const map_name,
+                                       const char* const gameobject_csv,
+                                       MapBuildResultType* const result);
+
+/*
+    Cancels the build if it is running, waits for the tiles being built, and
+    frees the session.
+*/
+void mapbuild_free_session(mapbuild_session* const session);
+
+/*
+    Adds the ADTs from (`min_x`, `min_y`) to (`max_x`, `max_y`) inclusive to those
+    to be built. When no ADTs are added every ADT is built, and otherwise only those
+    added are. The others are still parsed when the build starts, so that the map
+    file saved at the end is whole.
+
+    This must be called before `mapbuild_session_start`.
+*/
+MapBuildResultType mapbuild_session_add_adts(mapbuild_session* const session,
+                                             int32_t min_x, int32_t min_y,
+                                             int32_t max_x, int32_t max_y);
+
+/*
+    Builds only part `shard` of `shards` parts of the map, counting from zero, as
+    `MapBuilder --shard` does. The map file is then not saved, as it is once the
+    parts are merged.
+
+    This must be called before `mapbuild_session_start`.
+*/
+MapBuildResultType mapbuild_session_select_shard(mapbuild_session* const session,
+                                                 uint32_t shard, uint32_t shards);
+
+/*
+    When `incremental` is not `0`, ADTs whose inputs are unchanged since the last
+    incremental build are skipped. When `resume` is not `0`, ADTs already built by
+    an interrupted or cancelled build are skipped.
+
+    This must be called before `mapbuild_session_start`.
+*/
+MapBuildResultType mapbuild_session_set_skip(mapbuild_session* const session,
+                                             uint8_t incremental, uint8_t resume);
+
+/*
+    Sets the number of threads building the map, which may be changed while it is
+    running. When lowered, the threads which are no longer needed stop once they
+    finish their current tile. `0` is treated as `1`.
+*/
+MapBuildResultType mapbuild_session_set_threads(mapbuild_session* const session,
+                                                uint32_t threads);
+
+/*
+    Starts building the map in the background.
+*/
+MapBuildResultType mapbuild_session_start(mapbuild_session* const session);
+
+/*
+    Returns how many tiles have been built, of how many, and whether the build has
+    finished or been cancelled. `finished` is set once every thread has stopped.
+*/
+MapBuildResultType mapbuild_session_get_progress(mapbuild_session* const session,
+                                                 MapBuildProgress* const progress);
+
+/*
+    Writes the tiles finished since the first `from` of them to `buffer`, in the order
+    they were finished, so that a caller polling with `from` set to the number of tiles
+    it has seen so far learns of each tile once.
+
+    `amount_of_tiles` is set to the number of tiles finished since `from`. If it is
+    more than `buffer_length`, `BUFFER_TOO_SMALL` is returned.
+*/
+MapBuildResultType mapbuild_session_get_finished_tiles(mapbuild_session* const session,
+                                                       uint64_t from,
+                                                       MapBuildTile* const buffer,
+                                                       uint32_t buffer_length,
+                                                       uint32_t* const amount_of_tiles);
+
+/*
+    Stops the build from starting any more tiles. The tiles already being built are
+    finished, and the build may be resumed later by another session.
+*/
+MapBuildResultType mapbuild_session_cancel(mapbuild_session* const session);
+
+/*
+    Waits for the build to finish, and saves the map file if every tile was built.
+*/
+MapBuildResultType mapbuild_session_wait(mapbuild_session* const session);
+
 }
\ No newline at end of file
@@ -3,8 +3,11 @@
 #include "Worker.hpp"
 #include "parser/MpqManager.hpp"
 #include "FileExist.hpp"
+#include "utility/Trace.hpp"
 
 #include <pybind11/pybind11.h>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <memory>
 #include <string>
@@ -15,8 +18,13 @@ namespace fs = std::filesystem;
 namespace py = pybind11;
 
 int BuildBVH(const std::string& dataPath, const std::string& outputPath,
-             size_t workers)
+             size_t workers, const std::string& modelCache, bool packBvh,
+             bool shareBvh)
 {
+    parser::MpqManager::SetModelCache(modelCache);
+    BVHConstructor::SetPackFiles(packBvh);
+    BVHConstructor::SetShareFiles(shareBvh);
+
     parser::sMpqManager.Initialize(dataPath);
 
     files::create_bvh_output_directory(outputPath);
@@ -33,12 +41,73 @@ int BuildBVH(const std::string& dataPath, const std::string& outputPath,
     return static_cast<int>(goBuilder.Shutdown());
 }
 
-bool BuildMap(const std::string& dataPath, const std::string& outputPath,
-              const std::string& mapName, size_t threads,
-              const std::string& goCSV)
+// set from any thread to cancel the build_map() it was given to
+class CancelToken
 {
-    if (!threads)
-        return false;
+private:
+    std::atomic_bool m_cancelled {false};
+
+public:
+    void Cancel() { m_cancelled = true; }
+    bool Cancelled() const { return m_cancelled; }
+};
+
+namespace
+{
+// called with the GIL held
+py::dict Progress(const MeshBuilder& builder, double elapsed)
+{
+    auto const completed = builder.CompletedTiles();
+    auto const total = builder.TotalTiles();
+
+    py::list adts;
+    for (auto const& adt : builder.InProgressADTs())
+        adts.append(py::make_tuple(adt.first, adt.second));
+
+    py::dict result;
+
+    result["completed_tiles"] = completed;
+    result["total_tiles"] = total;
+    result["adts"] = adts;
+    result["elapsed"] = elapsed;
+
+    // the remaining tiles are assumed to take as long as those done so far
+    if (completed > 0)
+        result["eta"] = elapsed * static_cast<double>(total - completed) /
+                        static_cast<double>(completed);
+    else
+        result["eta"] = py::none();
+
+    return result;
+}
+} // namespace
+
+py::object BuildMap(const std::string& dataPath, const std::string& outputPath,
+                    const std::string& mapName, size_t threads,
+                    const std::string& goCSV, const std::string& offMeshCSV,
+                    bool incremental, bool resume, bool profile,
+                    bool adtHeightField, int compressionLevel,
+                    const std::string& modelCache, bool packBvh,
+                    bool shareBvh, bool surfaceHeights,
+                    const std::string& agent, const std::string& partition,
+                    float heightFieldRadius, const py::object& progress,
+                    double progressInterval, CancelToken* cancel)
+{
+    std::vector<AgentSize> agents;
+    RegionPartition regionPartition;
+
+    if (!threads || !MeshBuilder::FindAgentSizes(agent, agents) ||
+        !MeshBuilder::FindRegionPartition(partition, regionPartition))
+    {
+        py::gil_scoped_acquire gil;
+        return py::bool_(false);
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    parser::MpqManager::SetModelCache(modelCache);
+    BVHConstructor::SetPackFiles(packBvh);
+    BVHConstructor::SetShareFiles(shareBvh);
 
     parser::sMpqManager.Initialize(dataPath);
 
@@ -50,11 +119,39 @@ bool BuildMap(const std::string& dataPath, const std::string& outputPath,
 
     try
     {
-        builder = std::make_unique<MeshBuilder>(outputPath, mapName, 0);
+        builder =
+            std::make_unique<MeshBuilder>(outputPath, mapName, 0, agents[0]);
+
+        for (auto i = 1u; i < agents.size(); ++i)
+            builder->AddAgentSize(agents[i]);
 
         if (!goCSV.empty())
             builder->LoadGameObjects(goCSV);
 
+        if (!offMeshCSV.empty())
+            builder->LoadOffMeshConnections(offMeshCSV);
+
+        if (profile)
+            builder->EnableProfiling();
+
+        if (adtHeightField)
+            builder->ShareADTHeightFields();
+
+        if (surfaceHeights)
+            builder->SerializeSurfaceHeights();
+
+        builder->CompressNavFiles(compressionLevel);
+        builder->SetRegionPartition(regionPartition);
+
+        if (heightFieldRadius >= 0.f)
+            builder->OmitHeightFields(heightFieldRadius);
+
+        if (incremental)
+            builder->SkipUnchangedADTs();
+
+        if (resume)
+            builder->SkipCompletedADTs();
+
         for (auto i = 0u; i < threads; ++i)
             workers.push_back(
                 std::make_unique<Worker>(dataPath, builder.get()));
@@ -62,9 +159,23 @@ bool BuildMap(const std::string& dataPath, const std::string& outputPath,
     catch (std::exception const& e)
     {
         std::cerr << "Builder initialization failed: " << e.what() << std::endl;
-        return false;
+
+        py::gil_scoped_acquire gil;
+        return py::bool_(false);
     }
 
+    auto const seconds = [&start]()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+            .count();
+    };
+
+    // wake often enough to notice cancellation promptly, whatever the rate
+    // of progress reports
+    auto const poll = std::chrono::milliseconds(100);
+    auto nextReport = std::chrono::steady_clock::now();
+
     for (;;)
     {
         bool done = true;
@@ -78,17 +189,68 @@ bool BuildMap(const std::string& dataPath, const std::string& outputPath,
         if (done)
             break;
 
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        if (cancel && cancel->Cancelled())
+            builder->Cancel();
+
+        if (!progress.is_none() &&
+            std::chrono::steady_clock::now() >= nextReport)
+        {
+            nextReport += std::chrono::duration_cast<
+                std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(progressInterval));
+
+            try
+            {
+                py::gil_scoped_acquire gil;
+                progress(Progress(*builder, seconds()));
+            }
+            catch (...)
+            {
+                // an exception from the callback ends the build, once the
+                // tiles being built are finished
+                builder->Cancel();
+                workers.clear();
+                throw;
+            }
+        }
+
+        std::this_thread::sleep_for(poll);
     }
 
-    builder->SaveMap();
+    auto const cancelled = builder->Cancelled();
 
-    return true;
+    // a cancelled build is resumed later, which saves the map once every ADT
+    // has been built
+    if (!cancelled)
+    {
+        builder->SaveMap();
+
+        if (profile)
+            builder->SaveProfile(std::cout);
+    }
+
+    py::gil_scoped_acquire gil;
+
+    if (!progress.is_none())
+        progress(Progress(*builder, seconds()));
+
+    py::dict stats;
+
+    stats["cancelled"] = cancelled;
+    stats["completed_tiles"] = builder->CompletedTiles();
+    stats["total_tiles"] = builder->TotalTiles();
+    stats["seconds"] = seconds();
+    stats["lock_wait_seconds"] =
+        std::chrono::duration<double>(builder->LockWaitTime()).count();
+    stats["adt_load_seconds"] =
+        std::chrono::duration<double>(builder->ADTLoadTime()).count();
+
+    return std::move(stats);
 }
 
 bool BuildADT(const std::string& dataPath, const std::string& outputPath,
               const std::string& mapName, int x, int y,
-              const std::string& goCSV)
+              const std::string& goCSV, const std::string& offMeshCSV)
 {
     if (x < 0 || y < 0)
         return false;
@@ -104,6 +266,9 @@ bool BuildADT(const std::string& dataPath, const std::string& outputPath,
     if (!goCSV.empty())
         builder->LoadGameObjects(goCSV);
 
+    if (!offMeshCSV.empty())
+        builder->LoadOffMeshConnections(offMeshCSV);
+
     if (builder->IsGlobalWMO())
         return false;
 
@@ -136,33 +301,70 @@ bool MapFilesExist(const std::string& outputPath, const std::string& mapName) {
     return file_exist::map_files_exist(outputPath, mapName);
 }
 
+// the builds below run for minutes, during which other Python threads
+// should not be held up
 PYBIND11_MODULE(mapbuild, m)
 {
+    // the module has its own copy of recast, which has allocated nothing yet
+    MeshBuilder::InstallAllocator();
+
+    py::class_<CancelToken>(m, "CancelToken", "Cancels the `build_map` it is given to, from any thread, once `cancel` is called.")
+        .def(py::init<>())
+        .def("cancel",
+            &CancelToken::Cancel,
+            "Stops the build from starting any more tiles.  The tiles already being built are finished first, and the build may later be resumed.")
+        .def("cancelled",
+            &CancelToken::Cancelled,
+            "Returns whether `cancel` has been called.");
+
     m.def("build_bvh",
         BuildBVH,
-        "Builds all gameobjects. Must be called before `build_map`.",
+        py::call_guard<py::gil_scoped_release>(),
+        "Builds all gameobjects. Must be called before `build_map`.  When `model_cache` names a directory, parsed model geometry is cached there for later builds from the same data.  When `pack_bvh`, every BVH file is also copied into a single pack, which the pathfind library maps at once rather than opening each file.  When `share_bvh`, models with identical collision geometry are given the same BVH file, which the pathfind library loads once for all of them.",
         py::arg("data_path"),
         py::arg("output_path"),
-        py::arg("workers")
+        py::arg("workers"),
+        py::arg("model_cache") = "",
+        py::arg("pack_bvh") = false,
+        py::arg("share_bvh") = false
     );
     m.def("build_map",
         &BuildMap,
-        "Builds a specific map. `build_bvh` must be called before this function.",
+        py::call_guard<py::gil_scoped_release>(),
+        "Builds a specific map. `build_bvh` must be called before this function.  When `incremental`, ADTs whose inputs are unchanged since the last incremental build are skipped.  When `resume`, ADTs already built by an interrupted build are skipped.  When `profile`, the time spent in each stage of every tile is written to profile.csv next to the nav files, and summarized.  When `adt_heightfield`, each ADT is rasterized once into a heightfield from which its tiles are copied, which is faster but needs more memory.  A `compression_level` from 1 to 9 compresses the nav files, which are then inflated rather than mapped when loaded.  When `model_cache` names a directory, parsed model geometry is cached there for later builds from the same data.  When `pack_bvh`, every BVH file is also copied into a single pack, which the pathfind library maps at once rather than opening each file.  When `share_bvh`, models with identical collision geometry are given the same BVH file, which the pathfind library loads once for all of them.  When `surface_heights`, the height of every walkable model surface is stored with each tile, so that the pathfind library can answer imprecise height queries without casting rays.  `agent` names the size of the agent the navmesh is built for: `default` for a humanoid, `small` for lower creatures or `large` for mounts and large creatures.  Further sizes may follow, separated by commas, for which each tile is also built from the same height field, to be searched with `find_agent_path`.  `partition` chooses how the walkable area of each tile is divided into regions: `watershed`, the default, gives the best polygons, `monotone` is the fastest but gives long, thin polygons, and `layers` suits tiles of many overlapping floors.  When `height_field_radius` is not negative, only the ADT tiles within that many yards of a game object of `go_csv` keep their height fields, which makes smaller nav files that load faster, but tiles without one are not rebuilt beneath temporary obstacles, which then only block line of sight and rays.  `progress`, when given, is called about every `progress_interval` seconds, and once more at the end, with a dict of the completed and total tiles, the ADTs being built, and the elapsed and estimated remaining seconds.  Cancelling the `cancel` token stops the build once the tiles being built are finished, without saving the map, so that it may be resumed.  Returns a dict of statistics of the build, or `False` if it could not be started.",
         py::arg("data_path"),
         py::arg("output_path"),
         py::arg("map_name"),
         py::arg("threads"),
-        py::arg("go_csv")
+        py::arg("go_csv"),
+        py::arg("off_mesh_csv") = "",
+        py::arg("incremental") = false,
+        py::arg("resume") = false,
+        py::arg("profile") = false,
+        py::arg("adt_heightfield") = false,
+        py::arg("compression_level") = 0,
+        py::arg("model_cache") = "",
+        py::arg("pack_bvh") = false,
+        py::arg("share_bvh") = false,
+        py::arg("surface_heights") = false,
+        py::arg("agent") = "default",
+        py::arg("partition") = "watershed",
+        py::arg("height_field_radius") = -1.f,
+        py::arg("progress") = py::none(),
+        py::arg("progress_interval") = 1.0,
+        py::arg("cancel") = nullptr
     );
     m.def("build_adt",
          &BuildADT,
+         py::call_guard<py::gil_scoped_release>(),
          "Build a specific ADT.",
          py::arg("data_path"),
          py::arg("output_path"),
          py::arg("map_name"),
          py::arg("x"),
          py::arg("y"),
-         py::arg("go_csv")
+         py::arg("go_csv"),
+         py::arg("off_mesh_csv") = ""
     );
     m.def("map_files_exist",
          &MapFilesExist,
@@ -175,4 +377,14 @@ PYBIND11_MODULE(mapbuild, m)
          "Checks if gameobjects exist. If `True` the gameobjects will not need to be built.",
          py::arg("output_path")
     );
+    m.def("start_trace",
+         &utility::Trace::Start,
+         "Begins collecting trace events around tile builds, file reads and ADT parsing, discarding any collected before.  Tracing is off by default.");
+    m.def("stop_trace",
+         &utility::Trace::Stop,
+         "Stops collecting trace events, keeping those already collected.");
+    m.def("save_trace",
+         &utility::Trace::Save,
+         "Writes the trace events collected so far to `path` as Chrome trace JSON, for viewing in chrome://tracing or Perfetto.  Returns `False` if the file could not be written.",
+         py::arg("path"));
 }
\ No newline at end of file
@@ -134,6 +134,41 @@ void Camera::UpdateProjection(float vpX, float vpY, float width, float height,
 
     m_projMatrix = math::Matrix::CreateProjectionMatrix(
         PI / 4.f, width / height, 1.f, 10000.f);
+
+    // the planes of a frustum are sums and differences of the rows of the
+    // transform into clip space, where x and y are within [-w, w] and z is
+    // within [0, w].  see also ProjectPoint()
+    auto const clip = m_projMatrix.Transposed() * m_viewMatrix.Transposed();
+
+    for (auto i = 0; i < 4; ++i)
+    {
+        m_frustum[0][i] = clip[3][i] + clip[0][i];
+        m_frustum[1][i] = clip[3][i] - clip[0][i];
+        m_frustum[2][i] = clip[3][i] + clip[1][i];
+        m_frustum[3][i] = clip[3][i] - clip[1][i];
+        m_frustum[4][i] = clip[2][i];
+        m_frustum[5][i] = clip[3][i] - clip[2][i];
+    }
+}
+
+bool Camera::IsVisible(const math::BoundingBox& bounds) const
+{
+    // the box is outside when the corner furthest along the normal of any
+    // plane is behind it
+    auto const& min = bounds.MinCorner;
+    auto const& max = bounds.MaxCorner;
+
+    for (auto const& plane : m_frustum)
+    {
+        auto const x = plane[0] >= 0.f ? max.X : min.X;
+        auto const y = plane[1] >= 0.f ? max.Y : min.Y;
+        auto const z = plane[2] >= 0.f ? max.Z : min.Z;
+
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] < 0.f)
+            return false;
+    }
+
+    return true;
 }
 
 math::Vertex Camera::ProjectPoint(const math::Vertex& pos) const
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "utility/BoundingBox.hpp"
 #include "utility/Matrix.hpp"
 #include "utility/Vector.hpp"
 
@@ -36,6 +37,10 @@ private:
     float m_viewportMinDepth;
     float m_viewportMaxDepth;
 
+    // the planes of the view frustum in world coordinates, as (a, b, c, d)
+    // with the normal pointing inwards
+    float m_frustum[6][4];
+
 public:
     Camera();
 
@@ -60,9 +65,14 @@ public:
     void UpdateMousePan(int newX, int newY);
     void GetMousePanStart(int& x, int& y) const;
 
+    // this also updates the view frustum from the current view, and so is
+    // called once per frame, before anything is culled
     void UpdateProjection(float vpX, float vpY, float width, float height,
                           float minDepth, float maxDepth);
 
+    // false only when the box is certainly outside the view frustum
+    bool IsVisible(const math::BoundingBox& bounds) const;
+
     math::Vertex ProjectPoint(const math::Vector3& pos) const;
     math::Vertex UnprojectPoint(const math::Vector3& pos) const;
 
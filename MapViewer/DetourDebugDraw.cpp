@@ -1,81 +1,119 @@
 #include "DetourDebugDraw.hpp"
 
+#include "Common.hpp"
 #include "utility/MathHelper.hpp"
 
-#include <iostream>
 #include <unordered_map>
 #include <vector>
 
-DetourDebugDraw::DetourDebugDraw(Renderer* renderer)
-    : m_type(DU_DRAW_TRIS), m_size(0.f), m_renderer(renderer), m_steep(false)
+namespace
 {
-    m_renderer->ClearBuffers(Renderer::Geometry::LineGeometry);
-    m_renderer->ClearBuffers(Renderer::Geometry::NavMeshGeometry);
-}
-
-void DetourDebugDraw::begin(duDebugDrawPrimitives prim, float size)
+// the triangles of the polygons of a tile with or without the steep flag,
+// sharing the vertices which the polygons share so that their normals are
+// smoothed across them
+struct TileGeometry
 {
-    m_type = prim;
-    m_size = size;
-    m_uniqueVertices.clear();
-    m_vertices.clear();
-    m_indices.clear();
-    m_colors.clear();
-}
+    std::unordered_map<int, int> m_vertexIndices;
+    std::vector<math::Vertex> m_vertices;
+    std::vector<int> m_indices;
 
-void DetourDebugDraw::vertex(const float* pos, unsigned int color)
-{
-    math::Vertex v;
-    math::Convert::VertexToWow(pos, v);
-
-    if (m_uniqueVertices.find(v) == m_uniqueVertices.end())
+    // key identifies the vertex within the tile
+    void AddVertex(int key, const float* position)
     {
-        m_uniqueVertices[v] = static_cast<int>(m_vertices.size());
-        m_vertices.push_back(v);
-        m_colors.push_back(color);
+        auto const i = m_vertexIndices.find(key);
+
+        if (i != m_vertexIndices.end())
+        {
+            m_indices.push_back(i->second);
+            return;
+        }
+
+        auto const index = static_cast<int>(m_vertices.size());
+
+        math::Vertex vertex;
+        math::Convert::VertexToWow(position, vertex);
+
+        m_vertexIndices[key] = index;
+        m_vertices.push_back(vertex);
+        m_indices.push_back(index);
     }
+};
+} // namespace
 
-    m_indices.push_back(m_uniqueVertices[v]);
-}
+DetourDebugDraw::DetourDebugDraw(Renderer* renderer) : m_renderer(renderer) {}
 
-void DetourDebugDraw::vertex(const float x, const float y, const float z,
-                             unsigned int color)
+void DetourDebugDraw::AddTile(const dtMeshTile& tile, dtTileRef ref)
 {
-    const float rv[] {x, y, z};
-    math::Vertex v;
+    TileGeometry geometry[2];
 
-    vertex(rv, color);
-}
+    for (auto i = 0; i < tile.header->polyCount; ++i)
+    {
+        auto const& poly = tile.polys[i];
 
-void DetourDebugDraw::vertex(const float* pos, unsigned int color,
-                             const float* /*uv*/)
-{
-    vertex(pos, color);
-}
+        if (poly.getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+            continue;
 
-void DetourDebugDraw::vertex(const float x, const float y, const float z,
-                             unsigned int color, const float /*u*/,
-                             const float /*v*/)
-{
-    vertex(x, y, z, color);
+        auto& out = geometry[!!(poly.flags & PolyFlags::Steep)];
+        auto const& detail = tile.detailMeshes[i];
+
+        for (auto j = 0u; j < detail.triCount; ++j)
+        {
+            auto const triangle = &tile.detailTris[(detail.triBase + j) * 4];
+
+            // the first vertices of a detail mesh are those of its polygon,
+            // and the rest are its own
+            for (auto k = 0; k < 3; ++k)
+                if (triangle[k] < poly.vertCount)
+                    out.AddVertex(poly.verts[triangle[k]],
+                                  &tile.verts[poly.verts[triangle[k]] * 3]);
+                else
+                {
+                    auto const v =
+                        detail.vertBase + triangle[k] - poly.vertCount;
+                    out.AddVertex(tile.header->vertCount + v,
+                                  &tile.detailVerts[v * 3]);
+                }
+        }
+    }
+
+    m_renderer->AddMeshTile(ref, geometry[0].m_vertices, geometry[0].m_indices,
+                            false);
+    m_renderer->AddMeshTile(ref, geometry[1].m_vertices, geometry[1].m_indices,
+                            true);
 }
 
-void DetourDebugDraw::end()
+void DetourDebugDraw::Update(const pathfind::Map& map)
 {
-    switch (m_type)
+    auto const& mesh = map.GetNavMesh();
+
+    std::unordered_map<dtTileRef, std::uint64_t> tiles;
+
+    for (auto i = 0; i < mesh.getMaxTiles(); ++i)
     {
-        case duDebugDrawPrimitives::DU_DRAW_LINES:
-            // slight kludge to ignore inner mesh poly lines for now
-            if (m_size != IgnoreLineSize)
-                m_renderer->AddLines(m_vertices, m_indices);
+        auto const tile = mesh.getTile(i);
 
-            break;
+        if (!tile || !tile->header)
+            continue;
 
-        case duDebugDrawPrimitives::DU_DRAW_TRIS:
-            m_renderer->AddMesh(m_vertices, m_indices, m_steep);
-            break;
+        auto const ref = mesh.getTileRef(tile);
+        auto const generation = map.GetTileGeneration(ref);
+        tiles[ref] = generation;
 
-        default:
-            break;
+        auto const drawn = m_tiles.find(ref);
+
+        if (drawn != m_tiles.end() && drawn->second == generation)
+            continue;
+
+        // the old geometry of a rebuilt tile
+        if (drawn != m_tiles.end())
+            m_renderer->RemoveMeshTile(ref);
+
+        AddTile(*tile, ref);
     }
-}
\ No newline at end of file
+
+    for (auto const& drawn : m_tiles)
+        if (!tiles.count(drawn.first))
+            m_renderer->RemoveMeshTile(drawn.first);
+
+    m_tiles = std::move(tiles);
+}
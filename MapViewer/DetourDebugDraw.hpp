@@ -1,52 +1,34 @@
 #pragma once
 
 #include "Renderer.hpp"
-#include "recastnavigation/DebugUtils/Include/DebugDraw.h"
-#include "utility/Vector.hpp"
+#include "pathfind/Map.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
 
+#include <cstdint>
 #include <unordered_map>
-#include <vector>
 
-namespace std
-{
-template <>
-struct hash<math::Vertex>
-{
-    std::size_t operator()(const math::Vertex& vertex) const
-    {
-        return std::hash<float>()(vertex.X) + std::hash<float>()(vertex.Y);
-    }
-};
-} // namespace std
-
-class DetourDebugDraw : public duDebugDraw
+// draws the tiles of the navmesh of a map through a renderer.  the geometry of
+// each tile is kept by the renderer under its tile reference, so that only the
+// tiles which were added, removed or rebuilt since the last update are drawn
+// again.  a tile rebuilt beneath temporary obstacles keeps its reference, so
+// each is remembered together with the generation of its mesh, which does
+// change (see pathfind::Map::GetTileGeneration())
+class DetourDebugDraw
 {
 private:
-    static constexpr float IgnoreLineSize = 1.5f;
-    duDebugDrawPrimitives m_type;
-    float m_size;
-    bool m_steep;
+    Renderer* const m_renderer;
 
-    std::unordered_map<math::Vertex, int> m_uniqueVertices;
-    std::vector<math::Vertex> m_vertices;
-    std::vector<int> m_indices;
-    std::vector<unsigned int> m_colors;
+    std::unordered_map<dtTileRef, std::uint64_t> m_tiles;
 
-    Renderer* const m_renderer;
+    void AddTile(const dtMeshTile& tile, dtTileRef ref);
 
 public:
     DetourDebugDraw(Renderer* renderer);
 
-    void Steep(bool steep) { m_steep = steep; }
-
-    virtual void depthMask(bool /*state*/) {}
-    virtual void texture(bool /*state*/) {}
-    virtual void begin(duDebugDrawPrimitives prim, float size = 1.f);
-    virtual void vertex(const float* pos, unsigned int color);
-    virtual void vertex(const float x, const float y, const float z,
-                        unsigned int color);
-    virtual void vertex(const float* pos, unsigned int color, const float* uv);
-    virtual void vertex(const float x, const float y, const float z,
-                        unsigned int color, const float u, const float v);
-    virtual void end();
-};
\ No newline at end of file
+    // draws the new and rebuilt tiles of the navmesh of the map, and removes
+    // the tiles no longer in it
+    void Update(const pathfind::Map& map);
+
+    // forgets every tile, as when the renderer has been cleared
+    void Clear() { m_tiles.clear(); }
+};
@@ -3,6 +3,7 @@
 #include "utility/Ray.hpp"
 #include "utility/Vector.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <d3d11.h>
 #include <dxgi1_3.h>
@@ -120,6 +121,15 @@ Renderer::Renderer(HWND window)
          D3D11_INPUT_PER_VERTEX_DATA, 0},
         {"COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 24,
          D3D11_INPUT_PER_VERTEX_DATA, 0},
+        // the rows of the transform of each instance
+        {"WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0,
+         D3D11_INPUT_PER_INSTANCE_DATA, 1},
+        {"WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16,
+         D3D11_INPUT_PER_INSTANCE_DATA, 1},
+        {"WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32,
+         D3D11_INPUT_PER_INSTANCE_DATA, 1},
+        {"WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48,
+         D3D11_INPUT_PER_INSTANCE_DATA, 1},
     };
 
     ThrowIfFail(m_device->CreateInputLayout(ied, _countof(ied), g_VShader,
@@ -137,6 +147,23 @@ Renderer::Renderer(HWND window)
 
     ThrowIfFail(m_device->CreateBuffer(&cbbd, nullptr, &m_cbPerObjectBuffer));
 
+    constexpr float identity[] = {1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f,
+                                  0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f};
+
+    D3D11_BUFFER_DESC ibd;
+    ZERO(ibd);
+
+    ibd.Usage = D3D11_USAGE_IMMUTABLE;
+    ibd.ByteWidth = sizeof(identity);
+    ibd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+    D3D11_SUBRESOURCE_DATA identityData;
+    ZERO(identityData);
+    identityData.pSysMem = identity;
+
+    ThrowIfFail(m_device->CreateBuffer(&ibd, &identityData,
+                                       &m_identityInstanceBuffer));
+
     SetWireframe(false);
 
     D3D11_TEXTURE2D_DESC dsdtex;
@@ -213,6 +240,12 @@ Renderer::Renderer(HWND window)
 void Renderer::ClearBuffers(Geometry type)
 {
     m_buffers[type].clear();
+    m_models[type].clear();
+
+    if (type == WmoGeometry)
+        m_wmos.clear();
+    else if (type == DoodadGeometry)
+        m_doodads.clear();
 }
 
 void Renderer::ClearBuffers()
@@ -254,36 +287,90 @@ void Renderer::AddLiquid(const std::vector<math::Vertex>& vertices,
     InsertBuffer(m_buffers[LiquidGeometry], LiquidColor, vertices, indices);
 }
 
-void Renderer::AddWmo(unsigned int id,
-                      const std::vector<math::Vertex>& vertices,
-                      const std::vector<int>& indices)
+void Renderer::AddWmoInstance(unsigned int id, const void* model,
+                              const std::vector<math::Vertex>& vertices,
+                              const std::vector<int>& indices,
+                              const math::Matrix& transform)
 {
-    // if we are already rendering this wmo, do nothing
-    if (m_wmos.find(id) != m_wmos.end())
-        return;
-
     m_wmos.insert(id);
+    AddInstance(WmoGeometry, WmoColor, model, vertices, indices, transform);
+}
 
-    InsertBuffer(m_buffers[WmoGeometry], WmoColor, vertices, indices);
+void Renderer::AddDoodadInstance(unsigned int id, const void* model,
+                                 const std::vector<math::Vertex>& vertices,
+                                 const std::vector<int>& indices,
+                                 const math::Matrix& transform)
+{
+    m_doodads.insert(id);
+    AddInstance(DoodadGeometry, DoodadColor, model, vertices, indices,
+                transform);
 }
 
-void Renderer::AddDoodad(unsigned int id,
-                         const std::vector<math::Vertex>& vertices,
-                         const std::vector<int>& indices)
+void Renderer::AddInstance(Geometry type, const float* color,
+                           const void* model,
+                           const std::vector<math::Vertex>& vertices,
+                           const std::vector<int>& indices,
+                           const math::Matrix& transform)
 {
-    // if we are already rendering this doodad, do nothing
-    if (m_doodads.find(id) != m_doodads.end())
+    if (vertices.empty() || indices.empty())
         return;
 
-    m_doodads.insert(id);
-    InsertBuffer(m_buffers[DoodadGeometry], DoodadColor, vertices, indices);
+    auto const existing = m_models[type].find(model);
+    auto& instanced = existing == m_models[type].end()
+                          ? m_models[type][model]
+                          : existing->second;
+
+    if (existing == m_models[type].end())
+    {
+        std::vector<GeometryBuffer> geometry;
+        InsertBuffer(geometry, color, vertices, indices);
+
+        instanced.Geometry = std::move(geometry[0]);
+        instanced.Bounds = {vertices[0], vertices[0]};
+
+        for (auto const& vertex : vertices)
+            instanced.Bounds.update(vertex);
+    }
+
+    ModelInstance instance;
+    instance.Transform = transform;
+    instance.InverseTransform = transform.ComputeInverse();
+    instance.Bounds = instanced.Bounds;
+    instance.Bounds.transform(transform);
+
+    if (instanced.Instances.empty())
+        instanced.InstanceBounds = instance.Bounds;
+    else
+    {
+        instanced.InstanceBounds.update(instance.Bounds.MinCorner);
+        instanced.InstanceBounds.update(instance.Bounds.MaxCorner);
+    }
+
+    instanced.Instances.push_back(instance);
 }
 
-void Renderer::AddMesh(const std::vector<math::Vertex>& vertices,
-                       const std::vector<int>& indices, bool steep)
+void Renderer::AddMeshTile(std::uint64_t tile,
+                           const std::vector<math::Vertex>& vertices,
+                           const std::vector<int>& indices, bool steep)
 {
-    InsertBuffer(m_buffers[NavMeshGeometry], steep ? MeshSteepColor : MeshColor,
-                 vertices, indices);
+    auto& buffers = m_buffers[NavMeshGeometry];
+    auto const count = buffers.size();
+
+    InsertBuffer(buffers, steep ? MeshSteepColor : MeshColor, vertices,
+                 indices);
+
+    if (buffers.size() > count)
+        buffers.back().Tile = tile;
+}
+
+void Renderer::RemoveMeshTile(std::uint64_t tile)
+{
+    auto& buffers = m_buffers[NavMeshGeometry];
+
+    buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                 [tile](const GeometryBuffer& buffer)
+                                 { return buffer.Tile == tile; }),
+                  buffers.end());
 }
 
 void Renderer::AddLines(const std::vector<math::Vertex>& vertices,
@@ -379,6 +466,112 @@ void Renderer::AddGameObject(const std::vector<math::Vertex>& vertices,
                  indices);
 }
 
+void Renderer::DrawBuffers(Geometry type, D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+    const unsigned int stride = sizeof(ColoredVertex);
+    const unsigned int offset = 0;
+
+    m_deviceContext->IASetPrimitiveTopology(topology);
+
+    for (auto const& buffer : m_buffers[type])
+    {
+        if (!m_camera.IsVisible(buffer.Bounds))
+            continue;
+
+        ID3D11Buffer* const pBuffer[] = {buffer.VertexBufferGpu};
+        m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride, &offset);
+
+        // only the arrows are drawn without indices
+        if (buffer.IndexBufferCpu.empty())
+        {
+            m_deviceContext->Draw(
+                static_cast<UINT>(buffer.VertexBufferCpu.size()), 0);
+            continue;
+        }
+
+        m_deviceContext->IASetIndexBuffer(buffer.IndexBufferGpu,
+                                          DXGI_FORMAT_R32_UINT, 0);
+        m_deviceContext->DrawIndexed(
+            static_cast<UINT>(buffer.IndexBufferCpu.size()), 0, 0);
+    }
+}
+
+void Renderer::DrawModels(Geometry type)
+{
+    const unsigned int strides[] = {sizeof(ColoredVertex), 16 * sizeof(float)};
+    const unsigned int offsets[] = {0, 0};
+
+    m_deviceContext->IASetPrimitiveTopology(
+        D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+    for (auto& entry : m_models[type])
+    {
+        auto& model = entry.second;
+
+        if (!m_camera.IsVisible(model.InstanceBounds))
+            continue;
+
+        // only the visible instances are uploaded, which for instances spread
+        // across a zone is usually few of them
+        m_visibleTransforms.clear();
+
+        for (auto const& instance : model.Instances)
+            if (m_camera.IsVisible(instance.Bounds))
+            {
+                m_visibleTransforms.resize(m_visibleTransforms.size() + 16);
+                instance.Transform.PopulateArray(
+                    &m_visibleTransforms[m_visibleTransforms.size() - 16]);
+            }
+
+        auto const count = m_visibleTransforms.size() / 16;
+
+        if (!count)
+            continue;
+
+        if (count > model.InstanceCapacity)
+        {
+            model.InstanceCapacity =
+                (std::max)(count, 2 * model.InstanceCapacity);
+
+            D3D11_BUFFER_DESC instanceBufferDesc;
+            ZERO(instanceBufferDesc);
+
+            instanceBufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+            instanceBufferDesc.ByteWidth =
+                static_cast<decltype(instanceBufferDesc.ByteWidth)>(
+                    16 * sizeof(float) * model.InstanceCapacity);
+            instanceBufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+            instanceBufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+            model.InstanceBufferGpu.Release();
+            ThrowIfFail(m_device->CreateBuffer(&instanceBufferDesc, nullptr,
+                                               &model.InstanceBufferGpu));
+        }
+
+        D3D11_MAPPED_SUBRESOURCE ms;
+        ThrowIfFail(m_deviceContext->Map(model.InstanceBufferGpu, 0,
+                                         D3D11_MAP_WRITE_DISCARD, 0, &ms));
+        memcpy(ms.pData, &m_visibleTransforms[0],
+               sizeof(float) * m_visibleTransforms.size());
+        m_deviceContext->Unmap(model.InstanceBufferGpu, 0);
+
+        ID3D11Buffer* const pBuffers[] = {model.Geometry.VertexBufferGpu,
+                                          model.InstanceBufferGpu};
+        m_deviceContext->IASetVertexBuffers(0, 2, pBuffers, strides, offsets);
+        m_deviceContext->IASetIndexBuffer(model.Geometry.IndexBufferGpu,
+                                          DXGI_FORMAT_R32_UINT, 0);
+
+        m_deviceContext->DrawIndexedInstanced(
+            static_cast<UINT>(model.Geometry.IndexBufferCpu.size()),
+            static_cast<UINT>(count), 0, 0, 0);
+    }
+
+    // geometry which is not instanced is drawn as a single identity instance
+    ID3D11Buffer* const pIdentity[] = {m_identityInstanceBuffer};
+    m_deviceContext->IASetVertexBuffers(1, 1, pIdentity, &strides[1],
+                                        &offsets[1]);
+}
+
 bool Renderer::HasWmo(unsigned int id) const
 {
     return m_wmos.find(id) != m_wmos.end();
@@ -475,6 +668,11 @@ void Renderer::InsertBuffer(std::vector<GeometryBuffer>& buffer,
 
     GeometryBuffer geometry;
     geometry.UserParameter = userParam;
+    geometry.Bounds = {vertices[0], vertices[0]};
+
+    for (auto const& vertex : vertices)
+        geometry.Bounds.update(vertex);
+
     geometry.VertexBufferCpu = vertexBufferCpu;
     geometry.IndexBufferCpu = indices;
     geometry.VertexBufferGpu = vertexBuffer;
@@ -538,89 +736,27 @@ void Renderer::Render()
                                        &constants, 0, 0);
     m_deviceContext->VSSetConstantBuffers(0, 1, &m_cbPerObjectBuffer.p);
 
-    const unsigned int stride = sizeof(ColoredVertex);
-    const unsigned int offset = 0;
-
-    /// TODO: Rework all this duplicated code to use the geometry flags in order
-    /// to determine which buffers should be rendered in a general way
+    {
+        const unsigned int instanceStride = 16 * sizeof(float);
+        const unsigned int offset = 0;
+        ID3D11Buffer* const pIdentity[] = {m_identityInstanceBuffer};
+        m_deviceContext->IASetVertexBuffers(1, 1, pIdentity, &instanceStride,
+                                            &offset);
+    }
 
     // draw terrain
     if (m_renderADT)
-        for (size_t i = 0; i < m_buffers[TerrainGeometry].size(); ++i)
-        {
-            ID3D11Buffer* const pBuffer[] = {
-                m_buffers[TerrainGeometry][i].VertexBufferGpu};
-            m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                &offset);
-            m_deviceContext->IASetIndexBuffer(
-                m_buffers[TerrainGeometry][i].IndexBufferGpu,
-                DXGI_FORMAT_R32_UINT, 0);
-            m_deviceContext->IASetPrimitiveTopology(
-                D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-            m_deviceContext->DrawIndexed(
-                static_cast<UINT>(
-                    m_buffers[TerrainGeometry][i].IndexBufferCpu.size()),
-                0, 0);
-        }
+        DrawBuffers(TerrainGeometry, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
     // draw wmos
     if (m_renderWMO)
-        for (size_t i = 0; i < m_buffers[WmoGeometry].size(); ++i)
-        {
-            ID3D11Buffer* const pBuffer[] = {
-                m_buffers[WmoGeometry][i].VertexBufferGpu};
-            m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                &offset);
-            m_deviceContext->IASetIndexBuffer(
-                m_buffers[WmoGeometry][i].IndexBufferGpu, DXGI_FORMAT_R32_UINT,
-                0);
-            m_deviceContext->IASetPrimitiveTopology(
-                D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-            m_deviceContext->DrawIndexed(
-                static_cast<UINT>(
-                    m_buffers[WmoGeometry][i].IndexBufferCpu.size()),
-                0, 0);
-        }
+        DrawModels(WmoGeometry);
 
     // draw doodads
     if (m_renderDoodad)
     {
-        for (size_t i = 0; i < m_buffers[DoodadGeometry].size(); ++i)
-        {
-            ID3D11Buffer* const pBuffer[] = {
-                m_buffers[DoodadGeometry][i].VertexBufferGpu};
-            m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                &offset);
-            m_deviceContext->IASetIndexBuffer(
-                m_buffers[DoodadGeometry][i].IndexBufferGpu,
-                DXGI_FORMAT_R32_UINT, 0);
-            m_deviceContext->IASetPrimitiveTopology(
-                D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-            m_deviceContext->DrawIndexed(
-                static_cast<UINT>(
-                    m_buffers[DoodadGeometry][i].IndexBufferCpu.size()),
-                0, 0);
-        }
-        for (size_t i = 0; i < m_buffers[GameObjectGeometry].size(); ++i)
-        {
-            ID3D11Buffer* const pBuffer[] = {
-                m_buffers[GameObjectGeometry][i].VertexBufferGpu};
-            m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                &offset);
-            m_deviceContext->IASetIndexBuffer(
-                m_buffers[GameObjectGeometry][i].IndexBufferGpu,
-                DXGI_FORMAT_R32_UINT, 0);
-            m_deviceContext->IASetPrimitiveTopology(
-                D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-            m_deviceContext->DrawIndexed(
-                static_cast<UINT>(
-                    m_buffers[GameObjectGeometry][i].IndexBufferCpu.size()),
-                0, 0);
-        }
+        DrawModels(DoodadGeometry);
+        DrawBuffers(GameObjectGeometry, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     }
 
     if (m_renderLiquid || m_renderMesh || m_renderPathfind)
@@ -631,61 +767,13 @@ void Renderer::Render()
 
         // draw liquid (with alpha blending)
         if (m_renderLiquid)
-            for (size_t i = 0; i < m_buffers[LiquidGeometry].size(); ++i)
-            {
-                ID3D11Buffer* const pBuffer[] = {
-                    m_buffers[LiquidGeometry][i].VertexBufferGpu};
-                m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                    &offset);
-                m_deviceContext->IASetIndexBuffer(
-                    m_buffers[LiquidGeometry][i].IndexBufferGpu,
-                    DXGI_FORMAT_R32_UINT, 0);
-                m_deviceContext->IASetPrimitiveTopology(
-                    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-                m_deviceContext->DrawIndexed(
-                    static_cast<UINT>(
-                        m_buffers[LiquidGeometry][i].IndexBufferCpu.size()),
-                    0, 0);
-            }
+            DrawBuffers(LiquidGeometry, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
         // draw meshes (also with alpha blending)
         if (m_renderMesh)
         {
-            for (size_t i = 0; i < m_buffers[NavMeshGeometry].size(); ++i)
-            {
-                ID3D11Buffer* const pBuffer[] = {
-                    m_buffers[NavMeshGeometry][i].VertexBufferGpu};
-                m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                    &offset);
-                m_deviceContext->IASetIndexBuffer(
-                    m_buffers[NavMeshGeometry][i].IndexBufferGpu,
-                    DXGI_FORMAT_R32_UINT, 0);
-                m_deviceContext->IASetPrimitiveTopology(
-                    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-                m_deviceContext->DrawIndexed(
-                    static_cast<UINT>(
-                        m_buffers[NavMeshGeometry][i].IndexBufferCpu.size()),
-                    0, 0);
-            }
-
-            for (size_t i = 0; i < m_buffers[LineGeometry].size(); ++i)
-            {
-                ID3D11Buffer* const pBuffer[] = {
-                    m_buffers[LineGeometry][i].VertexBufferGpu};
-                m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                    &offset);
-                m_deviceContext->IASetIndexBuffer(
-                    m_buffers[LineGeometry][i].IndexBufferGpu,
-                    DXGI_FORMAT_R32_UINT, 0);
-                m_deviceContext->IASetPrimitiveTopology(
-                    D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
-                m_deviceContext->DrawIndexed(
-                    static_cast<UINT>(
-                        m_buffers[LineGeometry][i].IndexBufferCpu.size()),
-                    0, 0);
-            }
+            DrawBuffers(NavMeshGeometry, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            DrawBuffers(LineGeometry, D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
         }
 
         m_deviceContext->RSSetState(m_rasterizerStateNoCull);
@@ -693,38 +781,8 @@ void Renderer::Render()
         // draw pathfind queries (also with alpha blending)
         if (m_renderPathfind)
         {
-            for (size_t i = 0; i < m_buffers[SphereGeometry].size(); ++i)
-            {
-                ID3D11Buffer* const pBuffer[] = {
-                    m_buffers[SphereGeometry][i].VertexBufferGpu};
-                m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                    &offset);
-                m_deviceContext->IASetIndexBuffer(
-                    m_buffers[SphereGeometry][i].IndexBufferGpu,
-                    DXGI_FORMAT_R32_UINT, 0);
-                m_deviceContext->IASetPrimitiveTopology(
-                    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-
-                m_deviceContext->DrawIndexed(
-                    static_cast<UINT>(
-                        m_buffers[SphereGeometry][i].IndexBufferCpu.size()),
-                    0, 0);
-            }
-
-            for (size_t i = 0; i < m_buffers[ArrowGeometry].size(); ++i)
-            {
-                ID3D11Buffer* const pBuffer[] = {
-                    m_buffers[ArrowGeometry][i].VertexBufferGpu};
-                m_deviceContext->IASetVertexBuffers(0, 1, pBuffer, &stride,
-                                                    &offset);
-                m_deviceContext->IASetPrimitiveTopology(
-                    D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
-
-                m_deviceContext->Draw(
-                    static_cast<UINT>(
-                        m_buffers[ArrowGeometry][i].VertexBufferCpu.size()),
-                    0);
-            }
+            DrawBuffers(SphereGeometry, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+            DrawBuffers(ArrowGeometry, D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
         }
 
         m_deviceContext->OMSetBlendState(m_opaqueBlendState, blendFactor,
@@ -762,7 +820,7 @@ bool Renderer::HitTest(int x, int y, std::uint32_t geometryFlags,
 
     math::Ray ray(nearPosition, farPosition);
 
-    int faceIndex = -1;
+    auto hit = false;
 
     for (std::uint32_t geometry = 0; geometry < NumGeometryBuffers; ++geometry)
     {
@@ -772,34 +830,91 @@ bool Renderer::HitTest(int x, int y, std::uint32_t geometryFlags,
         for (size_t i = 0; i < m_buffers[geometry].size(); ++i)
         {
             const auto& buffer = m_buffers[geometry][i];
-            for (size_t j = 0; j < buffer.IndexBufferCpu.size() / 3; ++j)
+
+            float boxDistance;
+            if (!ray.IntersectBoundingBox(buffer.Bounds, &boxDistance) ||
+                boxDistance > ray.GetDistance())
+                continue;
+
+            auto distance = ray.GetDistance();
+
+            if (HitTestBuffer(buffer, ray, distance))
             {
-                const auto& v0 =
-                    buffer.VertexBufferCpu[buffer.IndexBufferCpu[j * 3 + 0]]
-                        .vertex;
-                const auto& v1 =
-                    buffer.VertexBufferCpu[buffer.IndexBufferCpu[j * 3 + 1]]
-                        .vertex;
-                const auto& v2 =
-                    buffer.VertexBufferCpu[buffer.IndexBufferCpu[j * 3 + 2]]
-                        .vertex;
-
-                float distance = 1.0f;
-                if (ray.IntersectTriangle(v0, v1, v2, &distance) &&
-                    distance < ray.GetDistance())
+                ray.SetHitPoint(distance);
+
+                hit = true;
+                param = buffer.UserParameter;
+            }
+        }
+
+        // the distance along a ray is a fraction of its length, which an
+        // affine transform preserves.  the ray is moved into the space of
+        // each model rather than each of its triangles into the world
+        for (auto const& entry : m_models[geometry])
+        {
+            auto const& model = entry.second;
+
+            float modelDistance;
+            if (!ray.IntersectBoundingBox(model.InstanceBounds,
+                                          &modelDistance) ||
+                modelDistance > ray.GetDistance())
+                continue;
+
+            for (auto const& instance : model.Instances)
+            {
+                float boxDistance;
+                if (!ray.IntersectBoundingBox(instance.Bounds, &boxDistance) ||
+                    boxDistance > ray.GetDistance())
+                    continue;
+
+                const math::Ray modelRay(
+                    math::Vertex::Transform(ray.GetStartPoint(),
+                                            instance.InverseTransform),
+                    math::Vertex::Transform(ray.GetEndPoint(),
+                                            instance.InverseTransform));
+
+                auto distance = ray.GetDistance();
+
+                if (HitTestBuffer(model.Geometry, modelRay, distance))
                 {
                     ray.SetHitPoint(distance);
 
-                    faceIndex = static_cast<int>(j);
-                    param = buffer.UserParameter;
+                    hit = true;
+                    param = model.Geometry.UserParameter;
                 }
             }
         }
     }
 
-    if (faceIndex == -1)
+    if (!hit)
         return false;
 
     out = ray.GetHitPoint();
     return true;
+}
+
+bool Renderer::HitTestBuffer(const GeometryBuffer& buffer,
+                             const math::Ray& ray, float& distance)
+{
+    auto hit = false;
+
+    for (size_t j = 0; j < buffer.IndexBufferCpu.size() / 3; ++j)
+    {
+        const auto& v0 =
+            buffer.VertexBufferCpu[buffer.IndexBufferCpu[j * 3 + 0]].vertex;
+        const auto& v1 =
+            buffer.VertexBufferCpu[buffer.IndexBufferCpu[j * 3 + 1]].vertex;
+        const auto& v2 =
+            buffer.VertexBufferCpu[buffer.IndexBufferCpu[j * 3 + 2]].vertex;
+
+        float triangleDistance = 1.0f;
+        if (ray.IntersectTriangle(v0, v1, v2, &triangleDistance) &&
+            triangleDistance < distance)
+        {
+            distance = triangleDistance;
+            hit = true;
+        }
+    }
+
+    return hit;
 }
\ No newline at end of file
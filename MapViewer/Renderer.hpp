@@ -1,6 +1,9 @@
 #pragma once
 
 #include "Camera.hpp"
+#include "utility/BoundingBox.hpp"
+#include "utility/Matrix.hpp"
+#include "utility/Ray.hpp"
 #include "utility/Vector.hpp"
 
 #include <Windows.h>
@@ -8,6 +11,7 @@
 #include <d3d11.h>
 #include <dxgi1_3.h>
 #include <memory>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -72,6 +76,36 @@ private:
 
         CComPtr<ID3D11Buffer> VertexBufferGpu;
         CComPtr<ID3D11Buffer> IndexBufferGpu;
+
+        // of the vertices, for culling and hit testing
+        math::BoundingBox Bounds;
+
+        // the navmesh tile of NavMeshGeometry, otherwise zero
+        std::uint64_t Tile = 0;
+    };
+
+    struct ModelInstance
+    {
+        math::Matrix Transform;
+        math::Matrix InverseTransform;
+        math::BoundingBox Bounds;
+    };
+
+    // a model whose geometry is uploaded once, in model space, and drawn in
+    // one call for all of its instances, each with its own transform.  the
+    // transforms of the visible instances are uploaded every frame
+    struct InstancedModel
+    {
+        GeometryBuffer Geometry;
+
+        // the bounds of the model space geometry, and of every instance
+        math::BoundingBox Bounds;
+        math::BoundingBox InstanceBounds;
+
+        std::vector<ModelInstance> Instances;
+
+        CComPtr<ID3D11Buffer> InstanceBufferGpu;
+        size_t InstanceCapacity = 0;
     };
 
     const HWND m_window;
@@ -100,6 +134,18 @@ private:
 
     std::vector<GeometryBuffer> m_buffers[NumGeometryBuffers];
 
+    // by the model they are instances of, which is only compared.  only
+    // WmoGeometry and DoodadGeometry are instanced
+    std::unordered_map<const void*, InstancedModel>
+        m_models[NumGeometryBuffers];
+
+    // the transform of geometry which is not instanced, which is bound to
+    // the instance slot whenever such geometry is drawn
+    CComPtr<ID3D11Buffer> m_identityInstanceBuffer;
+
+    // the transforms of the visible instances of the model being drawn
+    std::vector<float> m_visibleTransforms;
+
     std::unordered_set<unsigned int> m_wmos;
     std::unordered_set<unsigned int> m_doodads;
 
@@ -118,6 +164,20 @@ private:
                       const std::vector<int>& indices,
                       std::uint32_t userParam = 0, bool genNormals = true);
 
+    void AddInstance(Geometry type, const float* color, const void* model,
+                     const std::vector<math::Vertex>& vertices,
+                     const std::vector<int>& indices,
+                     const math::Matrix& transform);
+
+    // both skip whatever is outside the view of the camera
+    void DrawBuffers(Geometry type, D3D11_PRIMITIVE_TOPOLOGY topology);
+    void DrawModels(Geometry type);
+
+    // the distance along the ray of the nearest triangle of the buffer which
+    // is nearer than distance, if there is one
+    static bool HitTestBuffer(const GeometryBuffer& buffer,
+                              const math::Ray& ray, float& distance);
+
 public:
     Renderer(HWND window);
 
@@ -130,12 +190,27 @@ public:
                     const std::vector<int>& indices, std::uint32_t areaId);
     void AddLiquid(const std::vector<math::Vertex>& vertices,
                    const std::vector<int>& indices);
-    void AddWmo(unsigned int id, const std::vector<math::Vertex>& vertices,
-                const std::vector<int>& indices);
-    void AddDoodad(unsigned int id, const std::vector<math::Vertex>& vertices,
-                   const std::vector<int>& indices);
-    void AddMesh(const std::vector<math::Vertex>& vertices,
-                 const std::vector<int>& indices, bool steep);
+
+    // each instance with the given id adds the geometry of its model, which
+    // is only read the first time an instance of that model is added and is
+    // in model space, and its transform into the world.  several instances
+    // may share an id, as the doodads of a wmo share the id of the wmo
+    void AddWmoInstance(unsigned int id, const void* model,
+                        const std::vector<math::Vertex>& vertices,
+                        const std::vector<int>& indices,
+                        const math::Matrix& transform);
+    void AddDoodadInstance(unsigned int id, const void* model,
+                           const std::vector<math::Vertex>& vertices,
+                           const std::vector<int>& indices,
+                           const math::Matrix& transform);
+
+    // the navmesh is kept by tile, so that a tile can be replaced alone when
+    // it is rebuilt.  see DetourDebugDraw
+    void AddMeshTile(std::uint64_t tile,
+                     const std::vector<math::Vertex>& vertices,
+                     const std::vector<int>& indices, bool steep);
+    void RemoveMeshTile(std::uint64_t tile);
+
     void AddLines(const std::vector<math::Vertex>& vertices,
                   const std::vector<int>& indices);
     void AddSphere(const math::Vertex& position, float size,
@@ -7,7 +7,6 @@
 #include "parser/MpqManager.hpp"
 #include "parser/Wmo/WmoInstance.hpp"
 #include "pathfind/Map.hpp"
-#include "recastnavigation/DebugUtils/Include/DetourDebugDraw.h"
 #include "resource.h"
 #include "utility/Exception.hpp"
 #include "utility/MathHelper.hpp"
@@ -15,9 +14,14 @@
 #include "utility/Vector.hpp"
 
 #include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <future>
 #include <memory>
+#include <set>
 #include <shellapi.h>
 #include <sstream>
+#include <utility>
 #include <vector>
 #include <windows.h>
 #include <windowsx.h>
@@ -43,6 +47,7 @@ HWND gGuiWindow, gControlWindow;
 fs::path gNavData;
 
 std::unique_ptr<Renderer> gRenderer;
+std::unique_ptr<DetourDebugDraw> gNavMeshDraw;
 std::unique_ptr<CommonControl> gControls;
 std::unique_ptr<parser::Map> gMap;
 std::unique_ptr<pathfind::Map> gNavMesh;
@@ -63,6 +68,14 @@ struct MouseDoodad
 
 std::unique_ptr<MouseDoodad> gMouseDoodad;
 
+// when streaming, the ADTs within this many of the one beneath the camera are
+// read in the background, one at a time, and displayed as each is read
+constexpr int StreamRadius = 1;
+
+bool gStreamAdts = false;
+std::set<std::pair<int, int>> gDisplayedAdts;
+std::future<const parser::Adt*> gStreamingAdt;
+
 void UpdateMouseDoodadTransform()
 {
     gMouseDoodad->Transform =
@@ -76,38 +89,18 @@ void MoveMouseDoodad(math::Vertex const& position)
     gMouseDoodad->Position = position;
     UpdateMouseDoodadTransform();
 
-    auto vertices = gMouseDoodad->Model->m_aabbTree.Vertices();
+    auto const& tree = gMouseDoodad->Model->m_aabbTree;
+
+    std::vector<math::Vertex> vertices(tree.Vertices().begin(),
+                                       tree.Vertices().end());
     for (auto& vertex : vertices)
         vertex = math::Vector3::Transform(vertex, gMouseDoodad->Transform);
 
-    gRenderer->ClearGameObjects();
-    gRenderer->AddGameObject(vertices,
-                             gMouseDoodad->Model->m_aabbTree.Indices());
-}
-
-void duDebugDrawNavMeshPolysWithoutFlags(struct duDebugDraw* dd,
-                                         const dtNavMesh& mesh,
-                                         const unsigned short polyFlags,
-                                         const unsigned int col)
-{
-    if (!dd)
-        return;
-
-    for (int i = 0; i < mesh.getMaxTiles(); ++i)
-    {
-        const dtMeshTile* tile = mesh.getTile(i);
-        if (!tile->header)
-            continue;
-        dtPolyRef base = mesh.getPolyRefBase(tile);
+    const std::vector<int> indices(tree.Indices().begin(),
+                                   tree.Indices().end());
 
-        for (int j = 0; j < tile->header->polyCount; ++j)
-        {
-            const dtPoly* p = &tile->polys[j];
-            if ((p->flags & polyFlags) != 0)
-                continue;
-            duDebugDrawNavMeshPoly(dd, mesh, base | (dtPolyRef)j, col);
-        }
-    }
+    gRenderer->ClearGameObjects();
+    gRenderer->AddGameObject(vertices, indices);
 }
 
 int gMovingUp = 0;
@@ -266,13 +259,8 @@ LRESULT CALLBACK GuiWindowProc(HWND hWnd, UINT message, WPARAM wParam,
                         gMouseDoodad->Position, gMouseDoodad->Rotation);
                     gMouseDoodad.reset();
 
-                    DetourDebugDraw dd(gRenderer.get());
-                    dd.Steep(true);
-                    duDebugDrawNavMeshPolysWithFlags(
-                        &dd, gNavMesh->GetNavMesh(), PolyFlags::Steep, 0);
-                    dd.Steep(false);
-                    duDebugDrawNavMeshPolysWithoutFlags(
-                        &dd, gNavMesh->GetNavMesh(), PolyFlags::Steep, 0);
+                    // only the tiles rebuilt beneath the object are redrawn
+                    gNavMeshDraw->Update(*gNavMesh);
 
                     return TRUE;
                 }
@@ -416,6 +404,7 @@ enum Controls : int
     RenderMesh,
     SpawnDoodadEdit,
     SpawnDoodadButton,
+    StreamAdts,
 };
 
 void InitializeWindows(HINSTANCE hInstance, HWND& guiWindow,
@@ -482,17 +471,53 @@ void GetMapName(const std::string& inName, std::string& outName)
     outName.erase(std::remove(outName.begin(), outName.end(), ' '));
 }
 
+// adds the wmo, and unless they have been already its doodads, as instances of
+// their models
+void AddWmoInstance(unsigned int id, const parser::WmoInstance& wmo)
+{
+    gRenderer->AddWmoInstance(id, wmo.Model, wmo.Model->Vertices,
+                              wmo.Model->Indices, wmo.TransformMatrix);
+
+    std::vector<math::Vertex> vertices;
+    std::vector<int> indices;
+
+    wmo.BuildLiquidTriangles(vertices, indices);
+    gRenderer->AddLiquid(vertices, indices);
+
+    // TODO: this happens in outlands (ADT 18, 37)
+    if (gRenderer->HasDoodad(id) ||
+        wmo.DoodadSet >= wmo.Model->DoodadSets.size())
+        return;
+
+    for (auto const& doodad : wmo.Model->DoodadSets[wmo.DoodadSet])
+        gRenderer->AddDoodadInstance(id, doodad->Parent.get(),
+                                     doodad->Parent->Vertices,
+                                     doodad->Parent->Indices,
+                                     wmo.TransformMatrix *
+                                         doodad->TransformMatrix);
+}
+
 void LoadAdt(const parser::Adt* adt)
 {
+    gDisplayedAdts.insert({adt->X, adt->Y});
+
     for (int chunkX = 0; chunkX < MeshSettings::ChunksPerAdt; ++chunkX)
         for (int chunkY = 0; chunkY < MeshSettings::ChunksPerAdt; ++chunkY)
         {
             auto const chunk = adt->GetChunk(chunkX, chunkY);
 
-            gRenderer->AddTerrain(chunk->m_terrainVertices,
-                                  chunk->m_terrainIndices, chunk->m_areaId);
-            gRenderer->AddLiquid(chunk->m_liquidVertices,
-                                 chunk->m_liquidIndices);
+            std::vector<math::Vertex> terrainVertices;
+            std::vector<int> terrainIndices;
+            chunk->BuildTerrain(terrainVertices, terrainIndices);
+
+            gRenderer->AddTerrain(terrainVertices, terrainIndices,
+                                  chunk->m_areaId);
+
+            std::vector<math::Vertex> liquidVertices;
+            std::vector<int> liquidIndices;
+            chunk->BuildLiquid(liquidVertices, liquidIndices);
+
+            gRenderer->AddLiquid(liquidVertices, liquidIndices);
 
             for (auto& d : chunk->m_doodadInstances)
             {
@@ -503,11 +528,10 @@ void LoadAdt(const parser::Adt* adt)
 
                 assert(doodad);
 
-                std::vector<math::Vertex> vertices;
-                std::vector<int> indices;
-
-                doodad->BuildTriangles(vertices, indices);
-                gRenderer->AddDoodad(d, vertices, indices);
+                gRenderer->AddDoodadInstance(d, doodad->Model,
+                                             doodad->Model->Vertices,
+                                             doodad->Model->Indices,
+                                             doodad->TransformMatrix);
             }
 
             for (auto& w : chunk->m_wmoInstances)
@@ -519,42 +543,84 @@ void LoadAdt(const parser::Adt* adt)
 
                 assert(wmo);
 
-                std::vector<math::Vertex> vertices;
-                std::vector<int> indices;
-
-                wmo->BuildTriangles(vertices, indices);
-                gRenderer->AddWmo(w, vertices, indices);
-
-                wmo->BuildLiquidTriangles(vertices, indices);
-                gRenderer->AddLiquid(vertices, indices);
-
-                if (gRenderer->HasDoodad(w))
-                    continue;
-
-                wmo->BuildDoodadTriangles(vertices, indices);
-                gRenderer->AddDoodad(w, vertices, indices);
+                AddWmoInstance(w, *wmo);
             }
         }
 
     if (!!gNavMesh && gNavMesh->LoadADT(adt->X, adt->Y))
+        gNavMeshDraw->Update(*gNavMesh);
+}
+
+// displays the ADT read in the background once it is ready, and starts reading
+// the nearest ADT around the camera which is not yet displayed
+void UpdateStreamedAdts()
+{
+    if (gStreamingAdt.valid())
     {
-        DetourDebugDraw dd(gRenderer.get());
-        dd.Steep(true);
-        duDebugDrawNavMeshPolysWithFlags(&dd, gNavMesh->GetNavMesh(),
-                                         PolyFlags::Steep, 0);
-        dd.Steep(false);
-        duDebugDrawNavMeshPolysWithoutFlags(&dd, gNavMesh->GetNavMesh(),
-                                            PolyFlags::Steep, 0);
+        if (gStreamingAdt.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready)
+            return;
+
+        try
+        {
+            if (auto const adt = gStreamingAdt.get())
+                LoadAdt(adt);
+        }
+        catch (const std::exception& e)
+        {
+            MessageBox(nullptr, e.what(), "Error loading ADT",
+                       MB_OK | MB_ICONERROR);
+        }
     }
+
+    if (!gStreamAdts || !gMap || gMap->GetGlobalWmoInstance())
+        return;
+
+    int cameraX, cameraY;
+    math::Convert::WorldToAdt(gRenderer->m_camera.GetPosition(), cameraX,
+                              cameraY);
+
+    for (auto radius = 0; radius <= StreamRadius; ++radius)
+        for (auto y = cameraY - radius; y <= cameraY + radius; ++y)
+            for (auto x = cameraX - radius; x <= cameraX + radius; ++x)
+            {
+                // only the ring at this radius, as those within it are nearer
+                if (std::abs(x - cameraX) != radius &&
+                    std::abs(y - cameraY) != radius)
+                    continue;
+
+                if (x < 0 || y < 0 || x >= MeshSettings::Adts ||
+                    y >= MeshSettings::Adts || !gMap->HasAdt(x, y) ||
+                    gDisplayedAdts.count({x, y}))
+                    continue;
+
+                // marked now, so that an ADT which fails to load is not
+                // tried again
+                gDisplayedAdts.insert({x, y});
+
+                auto const map = gMap.get();
+                gStreamingAdt = std::async(std::launch::async, [map, x, y]()
+                                           { return map->GetAdt(x, y); });
+                return;
+            }
 }
 
 void ChangeMap(const std::string& cn)
 {
     gHasStart = false;
 
+    // the map must outlive any ADT being read from it
+    if (gStreamingAdt.valid())
+        gStreamingAdt.wait();
+
+    gStreamingAdt = {};
+    gDisplayedAdts.clear();
+
     if (gMap)
         gRenderer->ClearBuffers();
 
+    gNavMeshDraw->Clear();
+
     if (cn == "")
         return;
 
@@ -590,15 +656,14 @@ void ChangeMap(const std::string& cn)
 
                     ++count;
 
+                    auto const& bounds = adt->GetBounds();
+
                     const float cx =
-                        (adt->Bounds.MaxCorner.X + adt->Bounds.MinCorner.X) /
-                        2.f;
+                        (bounds.MaxCorner.X + bounds.MinCorner.X) / 2.f;
                     const float cy =
-                        (adt->Bounds.MaxCorner.Y + adt->Bounds.MinCorner.Y) /
-                        2.f;
+                        (bounds.MaxCorner.Y + bounds.MinCorner.Y) / 2.f;
                     const float cz =
-                        (adt->Bounds.MaxCorner.Z + adt->Bounds.MinCorner.Z) /
-                        2.f;
+                        (bounds.MaxCorner.Z + bounds.MinCorner.Z) / 2.f;
 
                     avgX += cx;
                     avgY += cy;
@@ -629,17 +694,7 @@ void ChangeMap(const std::string& cn)
     // including all mesh tiles
     if (auto const wmo = gMap->GetGlobalWmoInstance())
     {
-        std::vector<math::Vertex> vertices;
-        std::vector<int> indices;
-
-        wmo->BuildTriangles(vertices, indices);
-        gRenderer->AddWmo(0, vertices, indices);
-
-        wmo->BuildLiquidTriangles(vertices, indices);
-        gRenderer->AddLiquid(vertices, indices);
-
-        wmo->BuildDoodadTriangles(vertices, indices);
-        gRenderer->AddDoodad(0, vertices, indices);
+        AddWmoInstance(0, *wmo);
 
         auto const cx =
             (wmo->Bounds.MaxCorner.X + wmo->Bounds.MinCorner.X) / 2.f;
@@ -654,15 +709,7 @@ void ChangeMap(const std::string& cn)
         gControls->Enable(Controls::Load, false);
 
         if (gNavMesh)
-        {
-            DetourDebugDraw dd(gRenderer.get());
-            dd.Steep(true);
-            duDebugDrawNavMeshPolysWithFlags(&dd, gNavMesh->GetNavMesh(),
-                                             PolyFlags::Steep, 0);
-            dd.Steep(false);
-            duDebugDrawNavMeshPolysWithoutFlags(&dd, gNavMesh->GetNavMesh(),
-                                                PolyFlags::Steep, 0);
-        }
+            gNavMeshDraw->Update(*gNavMesh);
     }
     else
         gControls->Enable(Controls::Load, true);
@@ -754,12 +801,11 @@ void LoadPositionFromGUI()
 
             LoadAdt(adt);
 
-            const float cx =
-                (adt->Bounds.MaxCorner.X + adt->Bounds.MinCorner.X) / 2.f;
-            const float cy =
-                (adt->Bounds.MaxCorner.Y + adt->Bounds.MinCorner.Y) / 2.f;
-            const float cz =
-                (adt->Bounds.MaxCorner.Z + adt->Bounds.MinCorner.Z) / 2.f;
+            auto const& bounds = adt->GetBounds();
+
+            const float cx = (bounds.MaxCorner.X + bounds.MinCorner.X) / 2.f;
+            const float cy = (bounds.MaxCorner.Y + bounds.MinCorner.Y) / 2.f;
+            const float cz = (bounds.MaxCorner.Z + bounds.MinCorner.Z) / 2.f;
 
             gRenderer->m_camera.Move(cx + 300.f, cy + 300.f, cz + 300.f);
             gRenderer->m_camera.LookAt(cx, cy, cz);
@@ -864,6 +910,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/,
 
     // set up and initialize Direct3D
     gRenderer = std::make_unique<Renderer>(gGuiWindow);
+    gNavMeshDraw = std::make_unique<DetourDebugDraw>(gRenderer.get());
 
     // set up and initialize our Windows common control API for the control
     // window
@@ -935,6 +982,9 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/,
     gControls->AddButton(Controls::SpawnDoodadButton, "Spawn GO", 115, 242, 100,
                          25, SpawnGOFromGUI);
 
+    gControls->AddCheckBox(Controls::StreamAdts, "Stream ADTs", 10, 275, false,
+                           [](bool checked) { gStreamAdts = checked; });
+
     // enter the main loop:
 
     MSG msg;
@@ -959,6 +1009,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE /*hPrevInstance*/,
                 break;
         }
 
+        UpdateStreamedAdts();
+
         gRenderer->Render();
         Sleep(5);
     };
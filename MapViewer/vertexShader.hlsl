@@ -7,6 +7,13 @@ struct VSInput {
     float3 position : POSITION0;
     float3 normal : NORMAL0;
     float4 color : COLOR0;
+
+    // the rows of the transform of the instance, which is the identity for
+    // geometry that is not instanced
+    float4 world0 : WORLD0;
+    float4 world1 : WORLD1;
+    float4 world2 : WORLD2;
+    float4 world3 : WORLD3;
 };
 
 struct VSOutput {
@@ -18,14 +25,17 @@ struct VSOutput {
 
 VSOutput VShader(VSInput input)
 {
-    float4 position = float4(input.position, 1.0f);
-    position = mul(viewMatrix, position);
+    float4x4 world = float4x4(input.world0, input.world1, input.world2,
+                              input.world3);
+
+    float4 worldPos = mul(world, float4(input.position, 1.0f));
+    float4 position = mul(viewMatrix, worldPos);
     position = mul(projMatrix, position);
 
     VSOutput output = (VSOutput)0;
     output.position = position;
-    output.worldPos = input.position;
-    output.normal = input.normal;
+    output.worldPos = worldPos.xyz;
+    output.normal = mul((float3x3)world, input.normal);
     output.color = input.color;
 
     return output;
@@ -0,0 +1,423 @@
+#include "Common.hpp"
+#include "pathfind/Map.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+#include "utility/BoundingBox.hpp"
+#include "utility/MathHelper.hpp"
+#include "utility/String.hpp"
+#include "utility/Vector.hpp"
+
+// the implementation is compiled into the utility library
+#define MINIZ_HEADER_FILE_ONLY
+#include "utility/miniz.c"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+void DisplayUsage(std::ostream& o)
+{
+    o << "Usage:\n";
+    o << "  -h/--help                      -- Display help message\n";
+    o << "  -m/--map <map name>            -- Specifies the map to render\n";
+    o << "  -o/--output <output directory> -- Path to root output directory, "
+         "holding the nav files to render\n";
+    o << "  -i/--images <directory>        -- Where to write the images "
+         "(default: current directory)\n";
+    o << "  -s/--size <pixels>             -- Width and height of each image "
+         "(default 512)\n";
+    o << "  -t/--threads <count>           -- Number of rendering threads "
+         "(default: one per hardware thread)\n";
+    o.flush();
+}
+
+// a top down view of a square of the world, whose north west corner is at
+// (m_x, m_y).  rows run south and columns east, as on the in game map
+class Image
+{
+private:
+    const int m_pixels;
+    const float m_x;
+    const float m_y;
+    const float m_pixelSize;
+
+    // the highest surface seen at each pixel, and the flags of its polygon.
+    // pixels with no surface have the lowest height
+    std::vector<float> m_heights;
+    std::vector<std::uint8_t> m_flags;
+
+public:
+    Image(int pixels, float x, float y, float size)
+        : m_pixels(pixels), m_x(x), m_y(y), m_pixelSize(size / pixels),
+          m_heights(pixels * pixels, std::numeric_limits<float>::lowest()),
+          m_flags(pixels * pixels, 0)
+    {
+    }
+
+    void DrawTriangle(const math::Vertex& a, const math::Vertex& b,
+                      const math::Vertex& c, std::uint8_t flags)
+    {
+        // positions in pixels, x being the column and y the row
+        float const ax = (m_y - a.Y) / m_pixelSize,
+                    ay = (m_x - a.X) / m_pixelSize;
+        float const bx = (m_y - b.Y) / m_pixelSize,
+                    by = (m_x - b.X) / m_pixelSize;
+        float const cx = (m_y - c.Y) / m_pixelSize,
+                    cy = (m_x - c.X) / m_pixelSize;
+
+        auto const area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+
+        if (std::fabs(area) < 1e-6f)
+            return;
+
+        // the pixels whose centers may lie within the triangle
+        auto const minX = (std::max)(
+            0, static_cast<int>(std::floor((std::min)({ax, bx, cx}))));
+        auto const maxX =
+            (std::min)(m_pixels - 1,
+                       static_cast<int>(std::ceil((std::max)({ax, bx, cx}))));
+        auto const minY = (std::max)(
+            0, static_cast<int>(std::floor((std::min)({ay, by, cy}))));
+        auto const maxY =
+            (std::min)(m_pixels - 1,
+                       static_cast<int>(std::ceil((std::max)({ay, by, cy}))));
+
+        for (auto row = minY; row <= maxY; ++row)
+            for (auto column = minX; column <= maxX; ++column)
+            {
+                auto const px = column + 0.5f, py = row + 0.5f;
+
+                // barycentric weights of a, b and c
+                auto const u =
+                    ((bx - px) * (cy - py) - (by - py) * (cx - px)) / area;
+                auto const v =
+                    ((cx - px) * (ay - py) - (cy - py) * (ax - px)) / area;
+                auto const w = 1.f - u - v;
+
+                if (u < 0.f || v < 0.f || w < 0.f)
+                    continue;
+
+                auto const z = u * a.Z + v * b.Z + w * c.Z;
+                auto const i = row * m_pixels + column;
+
+                if (z > m_heights[i])
+                {
+                    m_heights[i] = z;
+                    m_flags[i] = flags;
+                }
+            }
+    }
+
+    // draws the detail triangles of every polygon of the tile
+    void DrawTile(const dtMeshTile& tile)
+    {
+        for (auto i = 0; i < tile.header->polyCount; ++i)
+        {
+            auto const& poly = tile.polys[i];
+
+            if (poly.getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+                continue;
+
+            auto const& detail = tile.detailMeshes[i];
+
+            for (auto j = 0u; j < detail.triCount; ++j)
+            {
+                auto const triangle =
+                    &tile.detailTris[(detail.triBase + j) * 4];
+
+                math::Vertex v[3];
+
+                // the first vertices of a detail mesh are those of its
+                // polygon, and the rest are its own
+                for (auto k = 0; k < 3; ++k)
+                    math::Convert::VertexToWow(
+                        triangle[k] < poly.vertCount
+                            ? &tile.verts[poly.verts[triangle[k]] * 3]
+                            : &tile.detailVerts[(detail.vertBase +
+                                                 triangle[k] - poly.vertCount) *
+                                                3],
+                        v[k]);
+
+                DrawTriangle(v[0], v[1], v[2],
+                             static_cast<std::uint8_t>(poly.flags));
+            }
+        }
+    }
+
+    // writes the image as an RGB PNG.  the hue of each pixel is from the
+    // flags of its polygon, and its brightness from its height within the
+    // range of heights of the image.  pixels without mesh are black
+    bool Write(const fs::path& path) const
+    {
+        auto low = (std::numeric_limits<float>::max)();
+        auto high = std::numeric_limits<float>::lowest();
+
+        for (auto const z : m_heights)
+            if (z != std::numeric_limits<float>::lowest())
+            {
+                low = (std::min)(low, z);
+                high = (std::max)(high, z);
+            }
+
+        std::vector<std::uint8_t> rgb(m_heights.size() * 3, 0);
+
+        for (auto i = 0u; i < m_heights.size(); ++i)
+        {
+            if (m_heights[i] == std::numeric_limits<float>::lowest())
+                continue;
+
+            // checked in order, so that steep wmo floors show as steep
+            std::uint8_t color[3] = {60, 170, 60};
+
+            if (m_flags[i] & PolyFlags::Steep)
+                color[0] = 200, color[1] = 60, color[2] = 40;
+            else if (m_flags[i] & PolyFlags::Liquid)
+                color[0] = 40, color[1] = 90, color[2] = 220;
+            else if (m_flags[i] & PolyFlags::Wmo)
+                color[0] = 200, color[1] = 170, color[2] = 60;
+            else if (m_flags[i] & PolyFlags::Doodad)
+                color[0] = 150, color[1] = 90, color[2] = 200;
+
+            auto const shade =
+                high > low ? 0.4f + 0.6f * (m_heights[i] - low) / (high - low)
+                           : 1.f;
+
+            for (auto c = 0; c < 3; ++c)
+                rgb[i * 3 + c] = static_cast<std::uint8_t>(color[c] * shade);
+        }
+
+        size_t length = 0;
+        auto const png = tdefl_write_image_to_png_file_in_memory_ex(
+            &rgb[0], m_pixels, m_pixels, 3, &length, MZ_DEFAULT_LEVEL,
+            MZ_FALSE);
+
+        if (!png)
+            return false;
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(static_cast<const char*>(png),
+                  static_cast<std::streamsize>(length));
+        mz_free(png);
+
+        return !!out;
+    }
+};
+
+// draws the tiles of the ADT at (x, y)
+void RenderAdt(const dtNavMesh& mesh, int x, int y, Image& image)
+{
+    for (auto tileY = y * MeshSettings::TilesPerADT;
+         tileY < (y + 1) * MeshSettings::TilesPerADT; ++tileY)
+        for (auto tileX = x * MeshSettings::TilesPerADT;
+             tileX < (x + 1) * MeshSettings::TilesPerADT; ++tileX)
+        {
+            const dtMeshTile* tiles[8];
+            auto const count = mesh.getTilesAt(
+                tileX, tileY, tiles, sizeof(tiles) / sizeof(tiles[0]));
+
+            for (auto i = 0; i < count; ++i)
+                image.DrawTile(*tiles[i]);
+        }
+}
+
+// renders a map whose only mesh is of its global wmo into one image, covering
+// the bounds of every tile
+bool RenderGlobalWmo(const dtNavMesh& mesh, int pixels, const fs::path& path)
+{
+    math::BoundingBox bounds;
+    bounds.MinCorner = {(std::numeric_limits<float>::max)(),
+                        (std::numeric_limits<float>::max)(),
+                        (std::numeric_limits<float>::max)()};
+    bounds.MaxCorner = {std::numeric_limits<float>::lowest(),
+                        std::numeric_limits<float>::lowest(),
+                        std::numeric_limits<float>::lowest()};
+
+    std::vector<const dtMeshTile*> tiles;
+
+    for (auto i = 0; i < mesh.getMaxTiles(); ++i)
+    {
+        auto const tile = mesh.getTile(i);
+
+        if (!tile || !tile->header)
+            continue;
+
+        math::Vertex min, max;
+        math::Convert::VertexToWow(tile->header->bmin, min);
+        math::Convert::VertexToWow(tile->header->bmax, max);
+
+        // the conversion swaps the corners about
+        bounds.update(min);
+        bounds.update(max);
+
+        tiles.push_back(tile);
+    }
+
+    if (tiles.empty())
+        return false;
+
+    auto const size = (std::max)(bounds.MaxCorner.X - bounds.MinCorner.X,
+                                 bounds.MaxCorner.Y - bounds.MinCorner.Y);
+
+    Image image(pixels, bounds.MaxCorner.X, bounds.MaxCorner.Y, size);
+
+    for (auto const tile : tiles)
+        image.DrawTile(*tile);
+
+    return image.Write(path);
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string map, outputPath;
+    fs::path imagePath = ".";
+    int pixels = 512;
+    unsigned int threads = 0;
+
+    try
+    {
+        for (auto i = 1; i < argc; ++i)
+        {
+            const std::string arg = utility::lower(argv[i]);
+
+            if (arg == "-h" || arg == "--help")
+            {
+                DisplayUsage(std::cout);
+                return EXIT_SUCCESS;
+            }
+
+            if (i == argc - 1)
+                throw std::invalid_argument("Missing argument to parameter " +
+                                            arg);
+
+            if (arg == "-m" || arg == "--map")
+                map = argv[++i];
+            else if (arg == "-o" || arg == "--output")
+                outputPath = argv[++i];
+            else if (arg == "-i" || arg == "--images")
+                imagePath = argv[++i];
+            else if (arg == "-s" || arg == "--size")
+                pixels = std::stoi(argv[++i]);
+            else if (arg == "-t" || arg == "--threads")
+                threads = std::stoul(argv[++i]);
+            else
+                throw std::invalid_argument("Unrecognized argument " + arg);
+        }
+
+        if (pixels <= 0)
+            throw std::invalid_argument("Image size must be positive");
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        DisplayUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    if (map.empty() || outputPath.empty())
+    {
+        DisplayUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    if (!threads)
+        threads = (std::max)(1u, std::thread::hardware_concurrency());
+
+    try
+    {
+        fs::create_directories(imagePath);
+
+        pathfind::Map navMap(outputPath, map);
+        auto const& mesh = navMap.GetNavMesh();
+
+        if (!navMap.HasADTs())
+        {
+            if (!RenderGlobalWmo(mesh, pixels, imagePath / (map + ".png")))
+            {
+                std::cerr << "ERROR: Could not render " << map << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            return EXIT_SUCCESS;
+        }
+
+        navMap.LoadAllADTs(threads);
+
+        std::vector<std::pair<int, int>> adts;
+
+        for (auto y = 0; y < MeshSettings::Adts; ++y)
+            for (auto x = 0; x < MeshSettings::Adts; ++x)
+                if (navMap.IsADTLoaded(x, y))
+                    adts.emplace_back(x, y);
+
+        std::cout << "Rendering " << adts.size() << " ADTs of " << map
+                  << " on " << threads << " threads..." << std::endl;
+
+        // once loaded, the mesh is only read, and so each ADT may be drawn on
+        // any thread
+        std::atomic<size_t> next {0};
+        std::atomic<size_t> failures {0};
+        std::mutex outputMutex;
+
+        auto const work = [&]()
+        {
+            for (auto i = next++; i < adts.size(); i = next++)
+            {
+                auto const x = adts[i].first, y = adts[i].second;
+
+                float nwX, nwY;
+                math::Convert::ADTToWorldNorthwestCorner(x, y, nwX, nwY);
+
+                Image image(pixels, nwX, nwY, MeshSettings::AdtSize);
+                RenderAdt(mesh, x, y, image);
+
+                std::stringstream name;
+                name << map << "_" << x << "_" << y << ".png";
+
+                if (image.Write(imagePath / name.str()))
+                    continue;
+
+                ++failures;
+
+                std::lock_guard<std::mutex> guard(outputMutex);
+                std::cerr << "ERROR: Could not write " << name.str()
+                          << std::endl;
+            }
+        };
+
+        std::vector<std::thread> workers;
+
+        for (auto i = 1u; i < threads; ++i)
+            workers.emplace_back(work);
+
+        work();
+
+        for (auto& worker : workers)
+            worker.join();
+
+        if (failures)
+            return EXIT_FAILURE;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+#include "MapBuilder/FileExist.hpp"
+#include "MapBuilder/MeshBuilder.hpp"
+#include "MapBuilder/Worker.hpp"
+#include "parser/MpqManager.hpp"
+#include "pathfind/Map.hpp"
+#include "utility/MathHelper.hpp"
+#include "utility/String.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// every allocation made by the process is counted, so that each benchmark can
+// report how many its operation makes
+namespace
+{
+std::atomic<std::uint64_t> allocations {0};
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if (auto const result = std::malloc(size ? size : 1))
+        return result;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+// the map of test/test_map.mpq, and the area of it covered by every query
+const std::string MapName = "development";
+constexpr float MinX = 16200.f, MaxX = 16400.f;
+constexpr float MinY = 16780.f, MaxY = 16860.f;
+
+// queries are drawn from a fixed seed, so that every run measures the same
+constexpr std::uint32_t Seed = 0x6e616d69;
+
+void DisplayUsage(std::ostream& o)
+{
+    o << "Usage:\n";
+    o << "  -h/--help                      -- Display help message\n";
+    o << "  -d/--data <data directory>     -- Path to the directory holding "
+         "test_map.mpq\n";
+    o << "  -o/--output <output directory> -- Path to root output directory, "
+         "built into when it holds no nav files\n";
+    o << "  -n/--iterations <count>        -- How many times to perform each "
+         "operation (default 1000)\n";
+    o << "  -g/--gameObject <display id>   -- Also measure adding and "
+         "removing a game object with this display id\n";
+    o << "  -t/--threads <thread count>    -- How many worker threads to "
+         "build with\n";
+    o.flush();
+}
+
+void BuildMap(const std::string& dataPath, const std::string& outputPath,
+              int threads)
+{
+    parser::sMpqManager.Initialize(dataPath);
+
+    files::create_bvh_output_directory(outputPath);
+    files::create_nav_output_directory(outputPath);
+
+    MeshBuilder builder(outputPath, MapName, 0);
+
+    {
+        std::vector<std::unique_ptr<Worker>> workers;
+        for (auto i = 0; i < threads; ++i)
+            workers.push_back(std::make_unique<Worker>(dataPath, &builder));
+
+        for (auto const& worker : workers)
+            while (!worker->IsFinished())
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    builder.SaveMap();
+}
+
+// performs op for each of [0, count) after one untimed pass to warm caches,
+// and reports the mean time and number of allocations of each
+void Measure(const std::string& name, size_t count,
+             const std::function<void(size_t)>& op)
+{
+    for (auto i = 0u; i < count; ++i)
+        op(i);
+
+    auto const startAllocations = allocations.load();
+    auto const start = std::chrono::steady_clock::now();
+
+    for (auto i = 0u; i < count; ++i)
+        op(i);
+
+    auto const stop = std::chrono::steady_clock::now();
+    auto const totalAllocations = allocations.load() - startAllocations;
+
+    auto const ns =
+        std::chrono::duration<double, std::nano>(stop - start).count();
+
+    std::cout << std::left << std::setw(24) << name << std::right
+              << std::setw(10) << count << " ops" << std::setw(14)
+              << std::fixed << std::setprecision(1)
+              << ns / static_cast<double>(count) << " ns/op" << std::setw(10)
+              << std::setprecision(2)
+              << static_cast<double>(totalAllocations) /
+                     static_cast<double>(count)
+              << " allocs/op" << std::endl;
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string dataPath, outputPath;
+    size_t iterations = 1000;
+    int threads = 1;
+    long long displayId = -1;
+
+    try
+    {
+        for (auto i = 1; i < argc; ++i)
+        {
+            const std::string arg = utility::lower(argv[i]);
+
+            if (arg == "-h" || arg == "--help")
+            {
+                DisplayUsage(std::cout);
+                return EXIT_SUCCESS;
+            }
+
+            if (i == argc - 1)
+                throw std::invalid_argument("Missing argument to parameter " +
+                                            arg);
+
+            if (arg == "-d" || arg == "--data")
+                dataPath = argv[++i];
+            else if (arg == "-o" || arg == "--output")
+                outputPath = argv[++i];
+            else if (arg == "-n" || arg == "--iterations")
+                iterations = std::stoul(argv[++i]);
+            else if (arg == "-g" || arg == "--gameobject")
+                displayId = std::stoll(argv[++i]);
+            else if (arg == "-t" || arg == "--threads")
+                threads = std::stoi(argv[++i]);
+            else
+                throw std::invalid_argument("Unrecognized argument " + arg);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        DisplayUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    if (outputPath.empty() || !iterations || threads < 1)
+    {
+        DisplayUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        if (!file_exist::map_files_exist(outputPath, MapName))
+        {
+            if (dataPath.empty())
+            {
+                std::cerr << "ERROR: No nav files in " << outputPath
+                          << ", and no data from which to build them"
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            std::cout << "Building " << MapName << "..." << std::endl;
+            BuildMap(dataPath, outputPath, threads);
+        }
+
+        pathfind::Map map(outputPath, MapName);
+
+        int adtX, adtY;
+        math::Convert::WorldToAdt({MinX, MinY, 0.f}, adtX, adtY);
+
+        if (!map.LoadADT(adtX, adtY))
+        {
+            std::cerr << "ERROR: Failed to load ADT (" << adtX << ", " << adtY
+                      << ")" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::mt19937 mt(Seed);
+        std::uniform_real_distribution<float> xs(MinX, MaxX);
+        std::uniform_real_distribution<float> ys(MinY, MaxY);
+
+        // every query begins on the ground, so that each does its whole job
+        std::vector<math::Vertex> points;
+        points.reserve(iterations * 2);
+
+        for (auto attempts = 0u; points.size() < iterations * 2; ++attempts)
+        {
+            if (attempts == iterations * 200)
+            {
+                std::cerr << "ERROR: Too few heights found for the queries"
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+
+            std::vector<float> heights;
+            auto const x = xs(mt), y = ys(mt);
+
+            if (map.FindHeights(x, y, heights))
+                points.push_back({x, y, heights.back()});
+        }
+
+        auto const start = [&](size_t i) -> const math::Vertex&
+        { return points[2 * i]; };
+        auto const stop = [&](size_t i) -> const math::Vertex&
+        { return points[2 * i + 1]; };
+
+        std::vector<math::Vertex> path;
+        std::vector<float> heights;
+        float z;
+        unsigned int zone, area;
+
+        Measure("FindPath", iterations,
+                [&](size_t i) { map.FindPath(start(i), stop(i), path); });
+        Measure("LineOfSight", iterations,
+                [&](size_t i) { map.LineOfSight(start(i), stop(i), false); });
+        Measure("LineOfSight doodads", iterations,
+                [&](size_t i) { map.LineOfSight(start(i), stop(i), true); });
+        Measure("FindHeight", iterations,
+                [&](size_t i)
+                { map.FindHeight(start(i), stop(i).X, stop(i).Y, z); });
+        Measure("FindHeights", iterations,
+                [&](size_t i)
+                {
+                    heights.clear();
+                    map.FindHeights(start(i).X, start(i).Y, heights);
+                });
+        Measure("ZoneAndArea", iterations,
+                [&](size_t i) { map.ZoneAndArea(start(i), zone, area); });
+
+        // loading is far slower than a query, so is measured fewer times
+        auto const loads = (std::max)(iterations / 100, size_t {1});
+        Measure("LoadADT/UnloadADT", loads,
+                [&](size_t)
+                {
+                    map.UnloadADT(adtX, adtY);
+                    map.LoadADT(adtX, adtY);
+                });
+
+        if (displayId >= 0)
+            Measure("AddGameObject", loads,
+                    [&](size_t i)
+                    {
+                        map.AddGameObject(1, static_cast<unsigned int>(
+                                                 displayId),
+                                          start(i), 0.f);
+                        map.RemoveGameObject(1);
+                    });
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+#include "pathfind/Map.hpp"
+#include "pathfind/QueryRecorder.hpp"
+#include "utility/String.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace
+{
+using pathfind::QueryRecorder;
+using Query = QueryRecorder::Query;
+
+void DisplayUsage(std::ostream& o)
+{
+    o << "Usage:\n";
+    o << "  -h/--help                      -- Display help message\n";
+    o << "  -o/--output <output directory> -- Path to root output directory, "
+         "holding the nav files to replay against\n";
+    o << "  -r/--recording <file>          -- The recording, from "
+         "Map::StartRecording()\n";
+    o << "  -e/--tolerance <distance>      -- How far positions and heights "
+         "may differ (default 0.01)\n";
+    o << "  -v/--verbose <count>           -- Describe at most this many "
+         "differences (default 10)\n";
+    o.flush();
+}
+
+// performs the query of the entry, storing what it returned in result
+void Replay(const pathfind::Map& map, const QueryRecorder::Entry& entry,
+            QueryRecorder::Entry& result)
+{
+    result.m_path.clear();
+    result.m_heights.clear();
+
+    auto const start = std::chrono::steady_clock::now();
+
+    switch (entry.m_query)
+    {
+        case Query::FindPath:
+            result.m_result =
+                map.FindPath(entry.m_start, entry.m_end, result.m_path,
+                             entry.m_flag, entry.m_filter);
+            break;
+        case Query::FindHeight:
+        {
+            float z;
+            result.m_result =
+                map.FindHeight(entry.m_start, entry.m_end.X, entry.m_end.Y, z);
+            if (result.m_result)
+                result.m_heights.push_back(z);
+            break;
+        }
+        case Query::FindHeights:
+            result.m_result = map.FindHeights(entry.m_start.X, entry.m_start.Y,
+                                              result.m_heights, entry.m_flag);
+            break;
+        case Query::ZoneAndArea:
+            result.m_result =
+                map.ZoneAndArea(entry.m_start, result.m_zone, result.m_area);
+            break;
+        case Query::LineOfSight:
+            result.m_result =
+                map.LineOfSight(entry.m_start, entry.m_end, entry.m_flag);
+            break;
+        default:
+            break;
+    }
+
+    result.m_nanoseconds = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+}
+
+// describes how the replayed result differs from the recorded one, or returns
+// an empty string if it does not
+std::string Compare(const QueryRecorder::Entry& recorded,
+                    const QueryRecorder::Entry& replayed, float tolerance)
+{
+    if (recorded.m_result != replayed.m_result)
+        return recorded.m_result ? "now fails" : "now succeeds";
+
+    if (!recorded.m_result)
+        return {};
+
+    switch (recorded.m_query)
+    {
+        case Query::FindPath:
+            if (recorded.m_path.size() != replayed.m_path.size())
+                return std::to_string(recorded.m_path.size()) +
+                       " hops, now " + std::to_string(replayed.m_path.size());
+
+            for (auto i = 0u; i < recorded.m_path.size(); ++i)
+                if (recorded.m_path[i].GetDistance(replayed.m_path[i]) >
+                    tolerance)
+                    return "hop " + std::to_string(i) + " moved";
+            break;
+        case Query::FindHeight:
+        case Query::FindHeights:
+            if (recorded.m_heights.size() != replayed.m_heights.size())
+                return std::to_string(recorded.m_heights.size()) +
+                       " heights, now " +
+                       std::to_string(replayed.m_heights.size());
+
+            for (auto i = 0u; i < recorded.m_heights.size(); ++i)
+                if (std::fabs(recorded.m_heights[i] - replayed.m_heights[i]) >
+                    tolerance)
+                    return "height " + std::to_string(i) + " was " +
+                           std::to_string(recorded.m_heights[i]) + ", now " +
+                           std::to_string(replayed.m_heights[i]);
+            break;
+        case Query::ZoneAndArea:
+            if (recorded.m_zone != replayed.m_zone ||
+                recorded.m_area != replayed.m_area)
+                return "zone " + std::to_string(recorded.m_zone) + " area " +
+                       std::to_string(recorded.m_area) + ", now zone " +
+                       std::to_string(replayed.m_zone) + " area " +
+                       std::to_string(replayed.m_area);
+            break;
+        default:
+            break;
+    }
+
+    return {};
+}
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    std::string outputPath, recordingPath;
+    float tolerance = 0.01f;
+    size_t verbose = 10;
+
+    try
+    {
+        for (auto i = 1; i < argc; ++i)
+        {
+            const std::string arg = utility::lower(argv[i]);
+
+            if (arg == "-h" || arg == "--help")
+            {
+                DisplayUsage(std::cout);
+                return EXIT_SUCCESS;
+            }
+
+            if (i == argc - 1)
+                throw std::invalid_argument("Missing argument to parameter " +
+                                            arg);
+
+            if (arg == "-o" || arg == "--output")
+                outputPath = argv[++i];
+            else if (arg == "-r" || arg == "--recording")
+                recordingPath = argv[++i];
+            else if (arg == "-e" || arg == "--tolerance")
+                tolerance = std::stof(argv[++i]);
+            else if (arg == "-v" || arg == "--verbose")
+                verbose = std::stoul(argv[++i]);
+            else
+                throw std::invalid_argument("Unrecognized argument " + arg);
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
+        DisplayUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    if (outputPath.empty() || recordingPath.empty())
+    {
+        DisplayUsage(std::cerr);
+        return EXIT_FAILURE;
+    }
+
+    size_t differences = 0;
+
+    try
+    {
+        std::string mapName;
+        std::vector<QueryRecorder::Entry> entries;
+        QueryRecorder::Read(recordingPath, mapName, entries);
+
+        std::cout << "Replaying " << entries.size() << " queries of "
+                  << mapName << "..." << std::endl;
+
+        pathfind::Map map(outputPath, mapName);
+
+        // the recording does not say which ADTs were loaded, so each is loaded
+        // as the queries first touch it, during an untimed pass
+        map.SetResidencyBudget((std::numeric_limits<size_t>::max)());
+
+        QueryRecorder::Entry result {};
+
+        for (auto const& entry : entries)
+            Replay(map, entry, result);
+
+        struct Totals
+        {
+            size_t m_count = 0;
+            std::uint64_t m_recorded = 0;
+            std::uint64_t m_replayed = 0;
+            size_t m_differences = 0;
+        };
+
+        Totals totals[pathfind::QueryMetrics::QueryCount];
+
+        for (auto i = 0u; i < entries.size(); ++i)
+        {
+            auto const& entry = entries[i];
+            Replay(map, entry, result);
+
+            auto& total = totals[static_cast<int>(entry.m_query)];
+            ++total.m_count;
+            total.m_recorded += entry.m_nanoseconds;
+            total.m_replayed += result.m_nanoseconds;
+
+            auto const difference = Compare(entry, result, tolerance);
+
+            if (difference.empty())
+                continue;
+
+            ++total.m_differences;
+
+            if (differences++ < verbose)
+                std::cout << "#" << i << " "
+                          << pathfind::QueryMetrics::QueryName(entry.m_query)
+                          << " from " << entry.m_start << ": " << difference
+                          << std::endl;
+        }
+
+        std::cout << std::left << std::setw(20) << "query" << std::right
+                  << std::setw(10) << "count" << std::setw(16)
+                  << "recorded us" << std::setw(16) << "replayed us"
+                  << std::setw(10) << "ratio" << std::setw(14) << "differences"
+                  << std::endl;
+
+        for (auto i = 0; i < pathfind::QueryMetrics::QueryCount; ++i)
+        {
+            auto const& total = totals[i];
+
+            if (!total.m_count)
+                continue;
+
+            auto const count = static_cast<double>(total.m_count);
+            auto const recorded = total.m_recorded / count / 1000.0;
+            auto const replayed = total.m_replayed / count / 1000.0;
+
+            std::cout << std::left << std::setw(20)
+                      << pathfind::QueryMetrics::QueryName(
+                             static_cast<Query>(i))
+                      << std::right << std::setw(10) << total.m_count
+                      << std::fixed << std::setprecision(2) << std::setw(16)
+                      << recorded << std::setw(16) << replayed << std::setw(10)
+                      << (recorded > 0.0 ? replayed / recorded : 0.0)
+                      << std::setw(14) << total.m_differences << std::endl;
+        }
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return differences ? EXIT_FAILURE : EXIT_SUCCESS;
+}
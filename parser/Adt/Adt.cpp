@@ -17,6 +17,7 @@
 #include "Doodad/DoodadPlacement.hpp"
 #include "Map/Map.hpp"
 #include "MpqManager.hpp"
+#include "utility/Trace.hpp"
 #include "utility/Vector.hpp"
 
 #include <algorithm>
@@ -26,34 +27,193 @@
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
 
 #define ADT_VERSION 18
 
+namespace
+{
+// adds a layer of liquid to the chunk, where rendered(x, y) is true for each
+// quad which has liquid
+template <typename Rendered>
+void AddLiquidLayer(parser::AdtChunk& chunk, LiquidType type,
+                    const float (&heights)[9][9], Rendered rendered)
+{
+    parser::AdtLiquidLayer layer;
+    layer.m_quads = 0;
+    layer.m_type = type;
+    layer.m_height = 0.f;
+
+    auto flat = true;
+
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 8; ++x)
+        {
+            if (!rendered(x, y))
+                continue;
+
+            if (!layer.m_quads)
+                layer.m_height = heights[y][x];
+
+            layer.m_quads |= 1ull << (y * 8 + x);
+
+            for (int cornerY = y; cornerY <= y + 1; ++cornerY)
+                for (int cornerX = x; cornerX <= x + 1; ++cornerX)
+                {
+                    auto const height = heights[cornerY][cornerX];
+
+                    flat = flat && height == layer.m_height;
+
+                    chunk.m_minZ = std::min(chunk.m_minZ, height);
+                    chunk.m_maxZ = std::max(chunk.m_maxZ, height);
+                }
+        }
+
+    if (!layer.m_quads)
+        return;
+
+    if (!flat)
+        layer.m_heights.assign(&heights[0][0], &heights[0][0] + 9 * 9);
+
+    chunk.m_liquidLayers.push_back(std::move(layer));
+}
+} // namespace
+
 namespace parser
 {
+math::Vertex AdtChunk::GetTerrainVertex(int index) const
+{
+    constexpr float quadSize = MeshSettings::AdtSize / 128.f;
+
+    // if index % 17 > 8, this is the inner part of a quad
+    auto const inner = index % 17 > 8;
+    auto const x = inner ? (index - 9) % 17 : index % 17;
+    auto const y = index / 17;
+    auto const innerOffset = inner ? quadSize / 2.f : 0.f;
+
+    return {m_originX - (y * quadSize) - innerOffset,
+            m_originY - (x * quadSize) - innerOffset, m_heights[index]};
+}
+
+int AdtChunk::GetTerrainIndices(int* indices) const
+{
+    if (!m_hasTerrain)
+        return 0;
+
+    auto count = 0;
+
+    for (int y = 0; y < 8; ++y)
+        for (int x = 0; x < 8; ++x)
+        {
+            // if this quad is a hole, skip it
+            if (m_holeMap[y][x])
+                continue;
+
+            auto const currIndex = y * 17 + x;
+
+            // upper, left, lower and right triangles
+            for (auto const i : {currIndex, currIndex + 9, currIndex + 1,
+                                 currIndex, currIndex + 17, currIndex + 9,
+                                 currIndex + 9, currIndex + 17, currIndex + 18,
+                                 currIndex + 1, currIndex + 9, currIndex + 18})
+                indices[count++] = i;
+        }
+
+    return count;
+}
+
+void AdtChunk::BuildTerrain(std::vector<math::Vertex>& vertices,
+                            std::vector<int>& indices) const
+{
+    if (!m_hasTerrain)
+        return;
+
+    auto const first = static_cast<int>(vertices.size());
+
+    for (int i = 0; i < TerrainVertexCount; ++i)
+        vertices.push_back(GetTerrainVertex(i));
+
+    int terrainIndices[MaxTerrainIndexCount];
+    auto const count = GetTerrainIndices(terrainIndices);
+
+    for (int i = 0; i < count; ++i)
+        indices.push_back(first + terrainIndices[i]);
+}
+
+void AdtChunk::BuildLiquid(std::vector<math::Vertex>& vertices,
+                           std::vector<int>& indices) const
+{
+    // the corners of the quads, which the liquid shares with the terrain
+    auto const corner = [this](int x, int y)
+    { return GetTerrainVertex(y * 17 + x); };
+
+    if (!m_hasTerrain)
+        return;
+
+    for (auto const& layer : m_liquidLayers)
+    {
+        auto const first = static_cast<int>(vertices.size());
+
+        // a flat layer over the whole chunk needs only two triangles
+        if (layer.m_heights.empty() && layer.m_quads == ~0ull)
+        {
+            for (auto const y : {0, 8})
+                for (auto const x : {0, 8})
+                    vertices.emplace_back(corner(x, y).X, corner(x, y).Y,
+                                          layer.m_height);
+
+            for (auto const i : {0, 2, 1, 2, 3, 1})
+                indices.push_back(first + i);
+
+            continue;
+        }
+
+        for (int y = 0; y <= 8; ++y)
+            for (int x = 0; x <= 8; ++x)
+                vertices.emplace_back(corner(x, y).X, corner(x, y).Y,
+                                      layer.GetHeight(x, y));
+
+        for (int y = 0; y < 8; ++y)
+            for (int x = 0; x < 8; ++x)
+            {
+                if (!(layer.m_quads & (1ull << (y * 8 + x))))
+                    continue;
+
+                auto const v = first + y * 9 + x;
+
+                for (auto const i : {v, v + 9, v + 1, v + 9, v + 10, v + 1})
+                    indices.push_back(i);
+            }
+    }
+}
+
 Adt::Adt(Map* map, int adtX, int adtY)
-    : X(adtX), Y(adtY), m_map(map),
-      Bounds({(32.f - static_cast<float>(adtY) - 1.f) * MeshSettings::AdtSize,
+    : X(adtX), Y(adtY), m_map(map), m_alpha(map->m_isAlphaData),
+      m_loadedChunks(0),
+      m_bounds({(32.f - static_cast<float>(adtY) - 1.f) * MeshSettings::AdtSize,
               (32.f - static_cast<float>(adtX) - 1.f) * MeshSettings::AdtSize,
               std::numeric_limits<float>::max()},
              {(32.f - static_cast<float>(adtY)) * MeshSettings::AdtSize,
               (32.f - static_cast<float>(adtX)) * MeshSettings::AdtSize,
               std::numeric_limits<float>::lowest()})
 {
+    utility::Trace::Scope trace("parser::Adt", "parse", adtX, adtY);
+
     std::unique_ptr<utility::BinaryStream> reader;
 
     size_t mhdrLocation;
 
-    // if we are working with files from the alpha, the data we need is already
-    // in memory.  lets create a unique pointer to the shared memory so other
-    // threads don't have to make copies of the same data.  it will never
-    // change once loaded so this should be fine.
+    // if we are working with files from the alpha, the data we need is
+    // already mapped by the map.  the reader sees only as far as the end of
+    // this ADT, so that searches for chunks stop there rather than running on
+    // through the ADTs after it
     if (map->m_isAlphaData)
     {
-        reader = std::make_unique<utility::BinaryStream>(map->m_alphaData);
+        reader = std::make_unique<utility::BinaryStream>(
+            map->m_alphaData, 0, map->m_adtEnds[adtX][adtY]);
 
         auto const offset = map->m_adtOffsets[adtX][adtY];
 
@@ -98,22 +258,23 @@ Adt::Adt(Map* map, int adtX, int adtY)
             new input::MH2O(header.Mh2oOffset, reader.get()) :
             nullptr);
 
+    if (liquidChunk)
+        m_liquidLayers = std::move(liquidChunk->Layers);
+
     size_t currMcnk;
     if (!reader->GetChunkLocation("MCNK", mhdrLocation, currMcnk))
         THROW(Result::NO_MCNK_CHUNK);
 
-    std::unique_ptr<input::MCNK> chunks[16][16];
-
-    bool hasMclq = false;
+    // only the location of each chunk is read here.  the chunks themselves
+    // are parsed when first asked for
     for (int y = 0; y < 16; ++y)
         for (int x = 0; x < 16; ++x)
         {
-            chunks[y][x] = std::make_unique<input::MCNK>(
-                currMcnk, reader.get(), map->m_isAlphaData, adtX, adtY);
-            currMcnk += 8 + chunks[y][x]->Size;
+            m_chunkOffsets[y][x] = currMcnk;
+            m_chunkLoaded[y][x] = false;
 
-            if (chunks[y][x]->HasWater)
-                hasMclq = true;
+            reader->rpos(currMcnk + 4);
+            currMcnk += 8 + reader->Read<std::uint32_t>();
         }
 
     std::vector<std::string> doodadNames;
@@ -156,271 +317,14 @@ Adt::Adt(Map* map, int adtX, int adtY)
             new input::MODF(modfLocation, reader.get()) :
             nullptr);
 
-    // Process all data into triangles/indices
-    // Terrain
-
-    for (int chunkY = 0; chunkY < 16; ++chunkY)
-        for (int chunkX = 0; chunkX < 16; ++chunkX)
+    for (auto& row : m_chunks)
+        for (auto& chunk : row)
         {
-            auto const mapChunk = chunks[chunkY][chunkX].get();
-
-            AdtChunk* const chunk = new AdtChunk();
-
-            memcpy(chunk->m_heights, mapChunk->Heights,
-                   sizeof(chunk->m_heights));
-
-            chunk->m_terrainVertices = std::move(mapChunk->Positions);
-            chunk->m_minZ = mapChunk->MinZ;
-            chunk->m_maxZ = mapChunk->MaxZ;
-            chunk->m_areaId = mapChunk->AreaId;
-            chunk->m_zoneId = sMpqManager.GetZoneId(chunk->m_areaId);
-
-            Bounds.MaxCorner.Z = std::max(Bounds.MaxCorner.Z, mapChunk->MaxZ);
-            Bounds.MinCorner.Z = std::min(Bounds.MinCorner.Z, mapChunk->MinZ);
-
-            memcpy(chunk->m_holeMap, mapChunk->HoleMap,
-                   sizeof(chunk->m_holeMap));
-
-            // build index list to exclude holes (8 * 8 quads, 4 triangles per
-            // quad, 3 indices per triangle)
-            chunk->m_terrainIndices.reserve(8 * 8 * 4 * 3);
-
-            for (int y = 0; y < 8; ++y)
-                for (int x = 0; x < 8; ++x)
-                {
-                    // if this chunk has holes and this quad is one of them,
-                    // skip it
-                    if (mapChunk->HasHoles && mapChunk->HoleMap[y][x])
-                        continue;
-
-                    auto const currIndex = y * 17 + x;
-
-                    // Upper triangle
-                    chunk->m_terrainIndices.push_back(currIndex);
-                    chunk->m_terrainIndices.push_back(currIndex + 9);
-                    chunk->m_terrainIndices.push_back(currIndex + 1);
-
-                    // Left triangle
-                    chunk->m_terrainIndices.push_back(currIndex);
-                    chunk->m_terrainIndices.push_back(currIndex + 17);
-                    chunk->m_terrainIndices.push_back(currIndex + 9);
-
-                    // Lower triangle
-                    chunk->m_terrainIndices.push_back(currIndex + 9);
-                    chunk->m_terrainIndices.push_back(currIndex + 17);
-                    chunk->m_terrainIndices.push_back(currIndex + 18);
-
-                    // Right triangle
-                    chunk->m_terrainIndices.push_back(currIndex + 1);
-                    chunk->m_terrainIndices.push_back(currIndex + 9);
-                    chunk->m_terrainIndices.push_back(currIndex + 18);
-                }
-
-            m_chunks[chunkY][chunkX].reset(chunk);
+            chunk = std::make_unique<AdtChunk>();
+            chunk->m_minZ = std::numeric_limits<float>::max();
+            chunk->m_maxZ = std::numeric_limits<float>::lowest();
         }
 
-    // Water
-
-    if (liquidChunk)
-        for (size_t i = 0; i < liquidChunk->Layers.size(); ++i)
-        {
-            auto const layer = liquidChunk->Layers[i].get();
-            auto const chunk = m_chunks[layer->Y][layer->X].get();
-
-            for (int y = 0; y < 8; ++y)
-                for (int x = 0; x < 8; ++x)
-                {
-                    if (!layer->Render[y][x])
-                        continue;
-
-                    int terrainVert = y * 17 + x;
-                    chunk->m_liquidVertices.push_back(
-                        {chunk->m_terrainVertices[terrainVert].X,
-                         chunk->m_terrainVertices[terrainVert].Y,
-                         layer->Heights[y + 0][x + 0]});
-
-                    terrainVert = y * 17 + (x + 1);
-                    chunk->m_liquidVertices.push_back(
-                        {chunk->m_terrainVertices[terrainVert].X,
-                         chunk->m_terrainVertices[terrainVert].Y,
-                         layer->Heights[y + 0][x + 1]});
-
-                    terrainVert = (y + 1) * 17 + x;
-                    chunk->m_liquidVertices.push_back(
-                        {chunk->m_terrainVertices[terrainVert].X,
-                         chunk->m_terrainVertices[terrainVert].Y,
-                         layer->Heights[y + 1][x + 0]});
-
-                    terrainVert = (y + 1) * 17 + (x + 1);
-                    chunk->m_liquidVertices.push_back(
-                        {chunk->m_terrainVertices[terrainVert].X,
-                         chunk->m_terrainVertices[terrainVert].Y,
-                         layer->Heights[y + 1][x + 1]});
-
-                    Bounds.MinCorner.Z = std::min(Bounds.MinCorner.Z,
-                                                  layer->Heights[y + 0][x + 0]);
-                    Bounds.MinCorner.Z = std::min(Bounds.MinCorner.Z,
-                                                  layer->Heights[y + 0][x + 1]);
-                    Bounds.MinCorner.Z = std::min(Bounds.MinCorner.Z,
-                                                  layer->Heights[y + 1][x + 0]);
-                    Bounds.MinCorner.Z = std::min(Bounds.MinCorner.Z,
-                                                  layer->Heights[y + 1][x + 1]);
-                    Bounds.MaxCorner.Z = std::max(Bounds.MaxCorner.Z,
-                                                  layer->Heights[y + 0][x + 0]);
-                    Bounds.MaxCorner.Z = std::max(Bounds.MaxCorner.Z,
-                                                  layer->Heights[y + 0][x + 1]);
-                    Bounds.MaxCorner.Z = std::max(Bounds.MaxCorner.Z,
-                                                  layer->Heights[y + 1][x + 0]);
-                    Bounds.MaxCorner.Z = std::max(Bounds.MaxCorner.Z,
-                                                  layer->Heights[y + 1][x + 1]);
-
-                    chunk->m_minZ =
-                        std::min(chunk->m_minZ, layer->Heights[y + 0][x + 0]);
-                    chunk->m_minZ =
-                        std::min(chunk->m_minZ, layer->Heights[y + 0][x + 1]);
-                    chunk->m_minZ =
-                        std::min(chunk->m_minZ, layer->Heights[y + 1][x + 0]);
-                    chunk->m_minZ =
-                        std::min(chunk->m_minZ, layer->Heights[y + 1][x + 1]);
-                    chunk->m_maxZ =
-                        std::max(chunk->m_maxZ, layer->Heights[y + 0][x + 0]);
-                    chunk->m_maxZ =
-                        std::max(chunk->m_maxZ, layer->Heights[y + 0][x + 1]);
-                    chunk->m_maxZ =
-                        std::max(chunk->m_maxZ, layer->Heights[y + 1][x + 0]);
-                    chunk->m_maxZ =
-                        std::max(chunk->m_maxZ, layer->Heights[y + 1][x + 1]);
-
-                    chunk->m_liquidIndices.push_back(static_cast<std::int32_t>(
-                        chunk->m_liquidVertices.size() - 4));
-                    chunk->m_liquidIndices.push_back(static_cast<std::int32_t>(
-                        chunk->m_liquidVertices.size() - 2));
-                    chunk->m_liquidIndices.push_back(static_cast<std::int32_t>(
-                        chunk->m_liquidVertices.size() - 3));
-
-                    chunk->m_liquidIndices.push_back(static_cast<std::int32_t>(
-                        chunk->m_liquidVertices.size() - 2));
-                    chunk->m_liquidIndices.push_back(static_cast<std::int32_t>(
-                        chunk->m_liquidVertices.size() - 1));
-                    chunk->m_liquidIndices.push_back(static_cast<std::int32_t>(
-                        chunk->m_liquidVertices.size() - 3));
-                }
-        }
-
-    if (hasMclq)
-        for (int chunkY = 0; chunkY < 16; ++chunkY)
-            for (int chunkX = 0; chunkX < 16; ++chunkX)
-            {
-                auto const mclqBlock =
-                    chunks[chunkY][chunkX]->LiquidChunk.get();
-
-                if (!mclqBlock)
-                    continue;
-
-                auto const chunk = m_chunks[chunkY][chunkX].get();
-
-                // four vertices per square, 8x8 squares (max)
-                chunk->m_liquidVertices.reserve(chunk->m_liquidVertices.size() +
-                                                4 * 8 * 8);
-
-                // six indices (two triangles) per square
-                chunk->m_liquidIndices.reserve(chunk->m_liquidIndices.size() +
-                                               6 * 8 * 8);
-
-                for (int y = 0; y < 8; ++y)
-                    for (int x = 0; x < 8; ++x)
-                    {
-                        if (mclqBlock->RenderMap[y][x] == 0xF)
-                            continue;
-
-                        int terrainVert = y * 17 + x;
-                        chunk->m_liquidVertices.push_back(
-                            {chunk->m_terrainVertices[terrainVert].X,
-                             chunk->m_terrainVertices[terrainVert].Y,
-                             mclqBlock->Heights[y][x]});
-
-                        terrainVert = y * 17 + (x + 1);
-                        chunk->m_liquidVertices.push_back(
-                            {chunk->m_terrainVertices[terrainVert].X,
-                             chunk->m_terrainVertices[terrainVert].Y,
-                             mclqBlock->Heights[y][x + 1]});
-
-                        terrainVert = (y + 1) * 17 + x;
-                        chunk->m_liquidVertices.push_back(
-                            {chunk->m_terrainVertices[terrainVert].X,
-                             chunk->m_terrainVertices[terrainVert].Y,
-                             mclqBlock->Heights[y + 1][x]});
-
-                        terrainVert = (y + 1) * 17 + (x + 1);
-                        chunk->m_liquidVertices.push_back(
-                            {chunk->m_terrainVertices[terrainVert].X,
-                             chunk->m_terrainVertices[terrainVert].Y,
-                             mclqBlock->Heights[y + 1][x + 1]});
-
-                        Bounds.MinCorner.Z =
-                            std::min(Bounds.MinCorner.Z,
-                                     mclqBlock->Heights[y + 0][x + 0]);
-                        Bounds.MinCorner.Z =
-                            std::min(Bounds.MinCorner.Z,
-                                     mclqBlock->Heights[y + 0][x + 1]);
-                        Bounds.MinCorner.Z =
-                            std::min(Bounds.MinCorner.Z,
-                                     mclqBlock->Heights[y + 1][x + 0]);
-                        Bounds.MinCorner.Z =
-                            std::min(Bounds.MinCorner.Z,
-                                     mclqBlock->Heights[y + 1][x + 1]);
-                        Bounds.MaxCorner.Z =
-                            std::max(Bounds.MaxCorner.Z,
-                                     mclqBlock->Heights[y + 0][x + 0]);
-                        Bounds.MaxCorner.Z =
-                            std::max(Bounds.MaxCorner.Z,
-                                     mclqBlock->Heights[y + 0][x + 1]);
-                        Bounds.MaxCorner.Z =
-                            std::max(Bounds.MaxCorner.Z,
-                                     mclqBlock->Heights[y + 1][x + 0]);
-                        Bounds.MaxCorner.Z =
-                            std::max(Bounds.MaxCorner.Z,
-                                     mclqBlock->Heights[y + 1][x + 1]);
-
-                        chunk->m_minZ = std::min(
-                            chunk->m_minZ, mclqBlock->Heights[y + 0][x + 0]);
-                        chunk->m_minZ = std::min(
-                            chunk->m_minZ, mclqBlock->Heights[y + 0][x + 1]);
-                        chunk->m_minZ = std::min(
-                            chunk->m_minZ, mclqBlock->Heights[y + 1][x + 0]);
-                        chunk->m_minZ = std::min(
-                            chunk->m_minZ, mclqBlock->Heights[y + 1][x + 1]);
-                        chunk->m_maxZ = std::max(
-                            chunk->m_maxZ, mclqBlock->Heights[y + 0][x + 0]);
-                        chunk->m_maxZ = std::max(
-                            chunk->m_maxZ, mclqBlock->Heights[y + 0][x + 1]);
-                        chunk->m_maxZ = std::max(
-                            chunk->m_maxZ, mclqBlock->Heights[y + 1][x + 0]);
-                        chunk->m_maxZ = std::max(
-                            chunk->m_maxZ, mclqBlock->Heights[y + 1][x + 1]);
-
-                        chunk->m_liquidIndices.push_back(
-                            static_cast<std::int32_t>(
-                                chunk->m_liquidVertices.size() - 4));
-                        chunk->m_liquidIndices.push_back(
-                            static_cast<std::int32_t>(
-                                chunk->m_liquidVertices.size() - 2));
-                        chunk->m_liquidIndices.push_back(
-                            static_cast<std::int32_t>(
-                                chunk->m_liquidVertices.size() - 3));
-
-                        chunk->m_liquidIndices.push_back(
-                            static_cast<std::int32_t>(
-                                chunk->m_liquidVertices.size() - 2));
-                        chunk->m_liquidIndices.push_back(
-                            static_cast<std::int32_t>(
-                                chunk->m_liquidVertices.size() - 1));
-                        chunk->m_liquidIndices.push_back(
-                            static_cast<std::int32_t>(
-                                chunk->m_liquidVertices.size() - 3));
-                    }
-            }
-
     // WMOs
 
     if (wmoChunk)
@@ -474,10 +378,10 @@ Adt::Adt(Map* map, int adtX, int adtY)
                              wmoInstance->Bounds.MaxCorner.Z);
             }
 
-            Bounds.MinCorner.Z =
-                std::min(Bounds.MinCorner.Z, wmoInstance->Bounds.MinCorner.Z);
-            Bounds.MaxCorner.Z =
-                std::max(Bounds.MaxCorner.Z, wmoInstance->Bounds.MaxCorner.Z);
+            m_bounds.MinCorner.Z = std::min(m_bounds.MinCorner.Z,
+                                            wmoInstance->Bounds.MinCorner.Z);
+            m_bounds.MaxCorner.Z = std::max(m_bounds.MaxCorner.Z,
+                                            wmoInstance->Bounds.MaxCorner.Z);
         }
 
     // Doodads
@@ -536,15 +440,85 @@ Adt::Adt(Map* map, int adtX, int adtY)
                              doodadInstance->Bounds.MaxCorner.Z);
             }
 
-            Bounds.MinCorner.Z = std::min(Bounds.MinCorner.Z,
-                                          doodadInstance->Bounds.MinCorner.Z);
-            Bounds.MaxCorner.Z = std::max(Bounds.MaxCorner.Z,
-                                          doodadInstance->Bounds.MaxCorner.Z);
+            m_bounds.MinCorner.Z = std::min(
+                m_bounds.MinCorner.Z, doodadInstance->Bounds.MinCorner.Z);
+            m_bounds.MaxCorner.Z = std::max(
+                m_bounds.MaxCorner.Z, doodadInstance->Bounds.MaxCorner.Z);
         }
+
+    m_reader = std::move(reader);
+}
+
+Adt::~Adt() = default;
+
+void Adt::LoadChunk(int chunkX, int chunkY) const
+{
+    input::MCNK mapChunk(m_chunkOffsets[chunkY][chunkX], m_reader.get(),
+                         m_alpha, X, Y);
+
+    auto const chunk = m_chunks[chunkY][chunkX].get();
+
+    chunk->m_hasTerrain = mapChunk.Size != 0;
+
+    if (chunk->m_hasTerrain)
+    {
+        memcpy(chunk->m_heights, mapChunk.Heights, sizeof(chunk->m_heights));
+        memcpy(chunk->m_holeMap, mapChunk.HoleMap, sizeof(chunk->m_holeMap));
+    }
+    else
+    {
+        memset(chunk->m_heights, 0, sizeof(chunk->m_heights));
+        memset(chunk->m_holeMap, 0, sizeof(chunk->m_holeMap));
+    }
+
+    chunk->m_originX = mapChunk.OriginX;
+    chunk->m_originY = mapChunk.OriginY;
+    chunk->m_minZ = std::min(chunk->m_minZ, mapChunk.MinZ);
+    chunk->m_maxZ = std::max(chunk->m_maxZ, mapChunk.MaxZ);
+    chunk->m_areaId = mapChunk.AreaId;
+    chunk->m_zoneId = sMpqManager.GetZoneId(chunk->m_areaId);
+
+
+    // Water
+
+    for (auto const& layer : m_liquidLayers)
+        if (layer->X == chunkX && layer->Y == chunkY)
+            AddLiquidLayer(*chunk, layer->Type, layer->Heights,
+                           [&layer](int x, int y)
+                           { return layer->Render[y][x]; });
+
+    if (auto const mclqBlock = mapChunk.LiquidChunk.get())
+        AddLiquidLayer(*chunk, mclqBlock->Liquid, mclqBlock->Heights,
+                       [mclqBlock](int x, int y)
+                       { return mclqBlock->RenderMap[y][x] != 0xF; });
+
+    m_bounds.MinCorner.Z = std::min(m_bounds.MinCorner.Z, chunk->m_minZ);
+    m_bounds.MaxCorner.Z = std::max(m_bounds.MaxCorner.Z, chunk->m_maxZ);
+
+    m_chunkLoaded[chunkY][chunkX] = true;
+
+    // once every chunk is parsed, the file is no longer needed
+    if (++m_loadedChunks ==
+        MeshSettings::ChunksPerAdt * MeshSettings::ChunksPerAdt)
+        m_reader.reset();
 }
 
 const AdtChunk* Adt::GetChunk(const int chunkX, const int chunkY) const
 {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (!m_chunkLoaded[chunkY][chunkX])
+        LoadChunk(chunkX, chunkY);
+
     return m_chunks[chunkY][chunkX].get();
 }
+
+const math::BoundingBox& Adt::GetBounds() const
+{
+    for (int chunkY = 0; chunkY < 16; ++chunkY)
+        for (int chunkX = 0; chunkX < 16; ++chunkX)
+            GetChunk(chunkX, chunkY);
+
+    return m_bounds;
+}
 } // namespace parser
\ No newline at end of file
@@ -1,27 +1,60 @@
 #pragma once
 
+#include "Common.hpp"
 #include "parser/Doodad/DoodadInstance.hpp"
 #include "parser/Wmo/WmoInstance.hpp"
+#include "utility/BinaryStream.hpp"
 #include "utility/BoundingBox.hpp"
 
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace parser
 {
+// a layer of liquid over some of the quads of a chunk.  most liquid, such as
+// the ocean, is flat, and so has a single height rather than one for each
+// corner of the quads
+struct AdtLiquidLayer
+{
+    // bit y * 8 + x is set when quad (x, y) has liquid
+    std::uint64_t m_quads;
+
+    LiquidType m_type;
+
+    float m_height;
+
+    // the 9 * 9 corner heights, or none when the layer is flat
+    std::vector<float> m_heights;
+
+    float GetHeight(int x, int y) const
+    {
+        return m_heights.empty() ? m_height : m_heights[y * 9 + x];
+    }
+};
+
+// the terrain of a chunk is a grid of 9 * 9 outer and 8 * 8 inner vertices,
+// whose positions follow from the origin of the chunk, so only the heights are
+// kept.  the triangles are generated from them when they are needed
 struct AdtChunk
 {
+    static constexpr int TerrainVertexCount = 9 * 9 + 8 * 8;
+
+    // 8 * 8 quads, 4 triangles per quad, 3 indices per triangle
+    static constexpr int MaxTerrainIndexCount = 8 * 8 * 4 * 3;
+
+    bool m_hasTerrain;
     bool m_holeMap[8][8];
 
-    float m_heights[9 * 9 + 8 * 8];
+    float m_heights[TerrainVertexCount];
 
-    std::vector<math::Vertex> m_terrainVertices;
-    std::vector<int> m_terrainIndices;
+    // the world position of the north west corner of the chunk
+    float m_originX;
+    float m_originY;
 
-    std::vector<math::Vertex> m_liquidVertices;
-    std::vector<int> m_liquidIndices;
+    std::vector<AdtLiquidLayer> m_liquidLayers;
 
     std::vector<std::uint32_t> m_wmoInstances;
     std::vector<std::uint32_t> m_doodadInstances;
@@ -31,23 +64,70 @@ struct AdtChunk
 
     float m_minZ;
     float m_maxZ;
+
+    // vertex i of the terrain, in the order in which they appear in the file,
+    // where each row of 9 outer vertices is followed by 8 inner ones
+    math::Vertex GetTerrainVertex(int index) const;
+
+    // writes the indices of the terrain triangles, excluding those of holes,
+    // to the output, which must have room for MaxTerrainIndexCount of them.
+    // returns the number written
+    int GetTerrainIndices(int* indices) const;
+
+    // appends the triangles of the terrain to the output
+    void BuildTerrain(std::vector<math::Vertex>& vertices,
+                      std::vector<int>& indices) const;
+
+    // appends the triangles of every liquid layer to the output
+    void BuildLiquid(std::vector<math::Vertex>& vertices,
+                     std::vector<int>& indices) const;
 };
 
 class Map;
 
+namespace input
+{
+struct LiquidLayer;
+}
+
+// the wmo and doodad instances of an ADT are found when it is loaded, since
+// the map must know of every instance.  its chunks, however, are only parsed
+// when first asked for, so that a tile which reaches just the edge of a
+// neighbouring ADT need not parse the rest of it
 class Adt
 {
 private:
-    std::unique_ptr<AdtChunk> m_chunks[16][16];
     Map* const m_map;
+    const bool m_alpha;
+
+    // guards the parsing of chunks, which several threads may ask for at once
+    mutable std::mutex m_mutex;
+
+    // the file, which is kept until every chunk has been parsed from it
+    mutable std::unique_ptr<utility::BinaryStream> m_reader;
+    mutable int m_loadedChunks;
+
+    size_t m_chunkOffsets[16][16];
+    mutable bool m_chunkLoaded[16][16];
+    std::unique_ptr<AdtChunk> m_chunks[16][16];
+
+    std::vector<std::unique_ptr<input::LiquidLayer>> m_liquidLayers;
+
+    mutable math::BoundingBox m_bounds;
+
+    // the caller must hold m_mutex
+    void LoadChunk(int chunkX, int chunkY) const;
 
 public:
     const int X;
     const int Y;
 
-    math::BoundingBox Bounds;
-
     Adt(Map* map, int x, int y);
+    ~Adt();
+
     const AdtChunk* GetChunk(int chunkX, int chunkY) const;
+
+    // parses every chunk not yet parsed, since they contribute to the bounds
+    const math::BoundingBox& GetBounds() const;
 };
 } // namespace parser
\ No newline at end of file
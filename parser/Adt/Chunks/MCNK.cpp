@@ -18,7 +18,7 @@ MCNK::MCNK(size_t position, utility::BinaryStream* reader, bool alpha,
     int adtX, int adtY)
     : AdtChunk(position, reader), HasHoles(false), HasWater(false),
       MaxZ(std::numeric_limits<float>::lowest()),
-      MinZ(std::numeric_limits<float>::max())
+      MinZ(std::numeric_limits<float>::max()), OriginX(0.f), OriginY(0.f)
 {
     assert(Type == AdtChunkType::MCNK);
 
@@ -109,16 +109,13 @@ MCNK::MCNK(size_t position, utility::BinaryStream* reader, bool alpha,
 
     const MCVT heightChunk(Position + heightOffset, reader);
 
-    constexpr float quadSize = MeshSettings::AdtSize / 128.f;
+    // the x and y of each vertex follow from its place in the grid, and so
+    // are not stored
+    OriginX = offset.X;
+    OriginY = offset.Y;
 
-    Positions.reserve(VertexCount);
     for (int i = 0; i < VertexCount; ++i)
     {
-        // if i % 17 > 8, this is the inner part of a quad
-        const int x = (i % 17 > 8 ? (i - 9) % 17 : i % 17);
-        const int y = i / 17;
-        const float innerOffset = (i % 17 > 8 ? quadSize / 2.f : 0.f);
-
         const float z = offset.Z + heightChunk.Heights[i];
 
         Heights[i] = z;
@@ -127,9 +124,6 @@ MCNK::MCNK(size_t position, utility::BinaryStream* reader, bool alpha,
             MaxZ = z;
         if (z < MinZ)
             MinZ = z;
-
-        Positions.push_back({offset.X - (y * quadSize) - innerOffset,
-                             offset.Y - (x * quadSize) - innerOffset, z});
     }
 
     reader->rpos(position + 8 + liquidOffset);
@@ -33,7 +33,9 @@ public:
     std::uint32_t AreaId;
 
     bool HoleMap[8][8];
-    std::vector<math::Vector3> Positions;
+    // the world position of the north west corner of the chunk
+    float OriginX;
+    float OriginY;
     float Heights[VertexCount];
 
     std::unique_ptr<MCLQ> LiquidChunk;
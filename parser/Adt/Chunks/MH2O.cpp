@@ -46,6 +46,11 @@ MH2O::MH2O(size_t position, utility::BinaryStream* reader)
                 newLayer->X = x;
                 newLayer->Y = y;
 
+                // the basic liquids of LiquidType.dbc, from 1, repeat water,
+                // ocean, magma and slime, as do most of those after them
+                newLayer->Type = static_cast<LiquidType>(
+                    instance.Type > 0 ? (instance.Type - 1) % 4 : 0);
+
                 memset(newLayer->Render, 0, sizeof(newLayer->Render));
                 memset(newLayer->Heights, 0, sizeof(newLayer->Heights));
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Adt/AdtChunk.hpp"
+#include "Common.hpp"
 #include "utility/BinaryStream.hpp"
 
 #include <cstdint>
@@ -15,6 +16,8 @@ struct LiquidLayer
     int X;
     int Y;
 
+    LiquidType Type;
+
     bool Render[8][8];
     float Heights[9][9];
 };
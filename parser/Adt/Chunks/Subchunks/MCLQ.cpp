@@ -15,6 +15,15 @@ MCLQ::MCLQ(size_t position, utility::BinaryStream* reader, bool alpha,
     else
         assert(Type == AdtChunkType::MCLQ);
 
+    if (flags & LiquidFlags::Ocean)
+        Liquid = LiquidType::Ocean;
+    else if (flags & LiquidFlags::Magma)
+        Liquid = LiquidType::Magma;
+    else if (flags & LiquidFlags::Slime)
+        Liquid = LiquidType::Slime;
+    else
+        Liquid = LiquidType::Water;
+
     Altitude = reader->Read<float>();
     BaseHeight = reader->Read<float>();
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Adt/AdtChunk.hpp"
+#include "Common.hpp"
 #include "utility/BinaryStream.hpp"
 
 #include <cstdint>
@@ -24,6 +25,9 @@ public:
     float Heights[9][9];
     std::uint8_t RenderMap[8][8];
 
+    // from the liquid flags of the chunk
+    LiquidType Liquid;
+
     float Altitude;
     float BaseHeight;
 
@@ -4,10 +4,13 @@
 #include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <string_view>
 
 #pragma pack(push, 1)
 // taken from https://wowdev.wiki/DBC
@@ -42,29 +45,51 @@ DBC::DBC(const std::string& filename)
 
     m_recordCount = header.record_count;
     m_fieldCount = header.field_count;
+    m_stringSize = header.string_block_size;
 
-    m_data.resize(header.record_count * header.field_count);
-    in->ReadBytes(&m_data[0], m_data.size() * sizeof(std::uint32_t));
+    // ensure that we have precisely enough space left for the records and
+    // the string block
+    auto const dataSize = m_recordCount * m_fieldCount * sizeof(std::uint32_t);
+    if (in->rpos() + dataSize + m_stringSize > in->wpos())
+        THROW(Result::UNRECOGNIZED_DBC_FILE);
+
+    m_file = in->Share();
+
+    m_data = m_file->data() + in->rpos();
+    m_string = reinterpret_cast<const char*>(m_data + dataSize);
+}
 
-    // ensure that we have precisely enough space left for the string block
-    assert(header.string_block_size + in->rpos() == in->wpos());
-    m_string.resize(header.string_block_size);
-    in->ReadBytes(&m_string[0], m_string.size());
+void DBC::CheckColumn(int column) const
+{
+    if (column < 0 || static_cast<size_t>(column) >= m_fieldCount)
+        THROW(Result::INVALID_ROW_COLUMN_FROM_DBC);
 }
 
 std::uint32_t DBC::GetField(int row, int column) const
 {
-    auto const offset = row * m_fieldCount + column;
+    CheckColumn(column);
 
-    if (offset > m_data.size() || column >= m_fieldCount)
+    if (row < 0 || static_cast<size_t>(row) >= m_recordCount)
         THROW(Result::INVALID_ROW_COLUMN_FROM_DBC);
 
-    return m_data[offset];
+    std::uint32_t result;
+    memcpy(&result,
+           m_data + (row * m_fieldCount + column) * sizeof(std::uint32_t),
+           sizeof(result));
+
+    return result;
 }
 
-std::string DBC::GetStringField(int row, int column) const
+std::string_view DBC::GetStringField(int row, int column) const
 {
     auto const pos = GetField(row, column);
-    return std::string(reinterpret_cast<const char*>(&m_string[pos]));
+
+    if (pos >= m_stringSize)
+        THROW(Result::INVALID_ROW_COLUMN_FROM_DBC);
+
+    auto const start = m_string + pos;
+    auto const end = std::find(start, m_string + m_stringSize, '\0');
+
+    return std::string_view(start, static_cast<size_t>(end - start));
 }
-} // namespace parser
+} // namespace parser
\ No newline at end of file
@@ -1,27 +1,132 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace parser
 {
+// the file is kept as it was read from the archive, and fields and strings
+// are read from it in place rather than copied out of it
 class DBC
 {
 private:
     static constexpr std::uint32_t Magic = 'CBDW';
 
-    std::vector<std::uint32_t> m_data;
-    std::vector<std::uint8_t> m_string;
+    std::shared_ptr<std::vector<std::uint8_t>> m_file;
+
+    const std::uint8_t* m_data;
+    const char* m_string;
+    size_t m_stringSize;
 
     size_t m_recordCount;
     size_t m_fieldCount;
 
+    void CheckColumn(int column) const;
+
 public:
+    // one field of every record, read as T
+    template <typename T>
+    class Column
+    {
+        static_assert(std::is_trivially_copyable<T>::value &&
+                          sizeof(T) == sizeof(std::uint32_t),
+                      "T must be a trivially copyable 32 bit value");
+
+    private:
+        const std::uint8_t* m_first;
+        size_t m_stride;
+        size_t m_size;
+
+    public:
+        class Iterator
+        {
+        private:
+            const std::uint8_t* m_position;
+            size_t m_stride;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const T*;
+            using reference = T;
+
+            Iterator(const std::uint8_t* position, size_t stride)
+                : m_position(position), m_stride(stride)
+            {
+            }
+
+            T operator*() const
+            {
+                T result;
+                memcpy(&result, m_position, sizeof(result));
+                return result;
+            }
+
+            Iterator& operator++()
+            {
+                m_position += m_stride;
+                return *this;
+            }
+
+            Iterator operator++(int)
+            {
+                auto const result = *this;
+                m_position += m_stride;
+                return result;
+            }
+
+            bool operator==(const Iterator& other) const
+            {
+                return m_position == other.m_position;
+            }
+
+            bool operator!=(const Iterator& other) const
+            {
+                return m_position != other.m_position;
+            }
+        };
+
+        Column(const std::uint8_t* first, size_t stride, size_t size)
+            : m_first(first), m_stride(stride), m_size(size)
+        {
+        }
+
+        T operator[](size_t row) const
+        {
+            return *Iterator(m_first + row * m_stride, m_stride);
+        }
+
+        size_t size() const { return m_size; }
+
+        Iterator begin() const { return Iterator(m_first, m_stride); }
+        Iterator end() const
+        {
+            return Iterator(m_first + m_size * m_stride, m_stride);
+        }
+    };
+
     DBC(const std::string& filename);
 
     std::uint32_t GetField(int row, int column) const;
-    std::string GetStringField(int row, int column) const;
+
+    // the string refers to the file, and so lives only as long as the DBC
+    std::string_view GetStringField(int row, int column) const;
+
+    template <typename T = std::uint32_t>
+    Column<T> GetColumn(int column) const
+    {
+        CheckColumn(column);
+
+        return Column<T>(m_data + column * sizeof(std::uint32_t),
+                         m_fieldCount * sizeof(std::uint32_t), m_recordCount);
+    }
 
     size_t RecordCount() const { return m_recordCount; }
 };
@@ -1,5 +1,6 @@
 #include "Doodad/Doodad.hpp"
 
+#include "ModelCache.hpp"
 #include "MpqManager.hpp"
 #include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
@@ -7,12 +8,58 @@
 #include "utility/Vector.hpp"
 
 #include <cstdint>
+#include <exception>
+#include <filesystem>
 #include <memory>
 #include <string>
 
 namespace parser
 {
 Doodad::Doodad(const std::string& path) : MpqPath(utility::lower(path))
+{
+    auto const cachePath = sMpqManager.GetModelCachePath(MpqPath);
+
+    if (!cachePath.empty() && LoadCache(cachePath))
+        return;
+
+    if (Parse(path) && !cachePath.empty())
+        SaveCache(cachePath);
+}
+
+bool Doodad::LoadCache(const std::filesystem::path& filename)
+{
+    auto const in = cache::Open(filename, cache::Doodad, MpqPath);
+
+    if (!in)
+        return false;
+
+    try
+    {
+        cache::ReadVector(*in, Vertices);
+        cache::ReadVector(*in, Indices);
+    }
+    catch (const std::exception&)
+    {
+        Vertices.clear();
+        Indices.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void Doodad::SaveCache(const std::filesystem::path& filename) const
+{
+    utility::BinaryStream out;
+
+    cache::WriteHeader(out, cache::Doodad, MpqPath);
+    cache::WriteVector(out, Vertices);
+    cache::WriteVector(out, Indices);
+
+    cache::Save(filename, out);
+}
+
+bool Doodad::Parse(const std::string& path)
 {
     auto reader = sMpqManager.OpenFile(MpqPath);
 
@@ -20,7 +67,7 @@ Doodad::Doodad(const std::string& path) : MpqPath(utility::lower(path))
     {
         // THROW_MSG("Doodad " + path + " not found", ResultCode::DOODAD_PATH_NOT_FOUND);
         std::cerr << "Doodad " << path << " not found" << std::endl;
-        return;
+        return false;
     }
 
     auto const magic = reader->Read<std::uint32_t>();
@@ -48,7 +95,7 @@ Doodad::Doodad(const std::string& path) : MpqPath(utility::lower(path))
         // not all models are collideable
         size_t clidLocation;
         if (!reader->GetChunkLocation("DILC", 4, clidLocation))
-            return;
+            return true;
 
         reader->rpos(clidLocation + 8);
 
@@ -102,7 +149,7 @@ Doodad::Doodad(const std::string& path) : MpqPath(utility::lower(path))
     }
 
     if (!indexCount || !vertexCount)
-        return;
+        return true;
 
     Vertices.resize(vertexCount);
 
@@ -116,5 +163,7 @@ Doodad::Doodad(const std::string& path) : MpqPath(utility::lower(path))
     reader->rpos(indicesPosition);
     for (auto i = 0u; i < indexCount; ++i)
         Indices.push_back(reader->Read<std::uint16_t>());
+
+    return true;
 }
 } // namespace parser
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "utility/Vector.hpp"
 
+#include <filesystem>
 #include <string>
 #include <vector>
 
@@ -13,6 +14,12 @@ private:
     static constexpr unsigned int Magic = '02DM';
     static constexpr unsigned int AlphaMagic = 'XLDM';
 
+    // returns false when the model was not found
+    bool Parse(const std::string& path);
+
+    bool LoadCache(const std::filesystem::path& filename);
+    void SaveCache(const std::filesystem::path& filename) const;
+
 public:
     const std::string MpqPath;
 
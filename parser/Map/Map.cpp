@@ -11,11 +11,13 @@
 #include "utility/String.hpp"
 #include "utility/Vector.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <ostream>
 #include <sstream>
@@ -27,11 +29,13 @@ Map::Map(const std::string& name)
 {
     auto const file = "World\\Maps\\" + Name + "\\" + Name + ".wdt";
 
-    auto reader = sMpqManager.OpenFile(file);
+    auto const wdt = sMpqManager.OpenMappedFile(file);
 
-    if (!reader)
+    if (!wdt)
         THROW(Result::WDT_OPEN_FAILED);
 
+    auto reader = std::make_unique<utility::BinaryStream>(wdt, 0, wdt->size());
+
     size_t mphdLocation;
     if (!reader->GetChunkLocation("MPHD", mphdLocation))
         THROW(Result::MPHD_NOT_FOUND);
@@ -60,13 +64,9 @@ Map::Map(const std::string& name)
 
     if (m_isAlphaData)
     {
-        // save this data in memory for use by worker threads
-        // TODO: transfer ownership from reader to m_alphaData, replacing
-        // reader with a weak pointer?
-        reader->rpos(0);
-        m_alphaData =
-            std::make_shared<std::vector<std::uint8_t>>(reader->wpos());
-        reader->ReadBytes(&m_alphaData->at(0), m_alphaData->size());
+        // keep the file for use by worker threads, each of which reads the
+        // part of it for its ADT in place
+        m_alphaData = wdt;
 
         // go back and read doodad and wmo names
         reader->rpos(mphdLocation + 8);
@@ -92,6 +92,26 @@ Map::Map(const std::string& name)
                 reader->rpos(reader->rpos() + 8);
             }
 
+        // the ADTs follow one another, so the data of each ends where that
+        // of the one after it in the file begins
+        std::vector<std::uint32_t> offsets;
+        for (int y = 0; y < MeshSettings::Adts; ++y)
+            for (int x = 0; x < MeshSettings::Adts; ++x)
+                if (m_hasAdt[x][y])
+                    offsets.push_back(m_adtOffsets[x][y]);
+
+        std::sort(offsets.begin(), offsets.end());
+
+        for (int y = 0; y < MeshSettings::Adts; ++y)
+            for (int x = 0; x < MeshSettings::Adts; ++x)
+            {
+                auto const next =
+                    std::upper_bound(offsets.begin(), offsets.end(),
+                                     m_adtOffsets[x][y]);
+
+                m_adtEnds[x][y] = next == offsets.end() ? wdt->size() : *next;
+            }
+
         size_t mdnmLocation;
         if (!reader->GetChunkLocation("MDNM", doodadNameOffset, mdnmLocation))
             THROW(Result::MDNM_NOT_FOUND);
@@ -218,6 +238,23 @@ Map::Map(const std::string& name)
         transformMatrix);
 }
 
+Map::Map(const std::string& name, const std::string& wmoPath)
+    : m_hasTerrain(false), m_isAlphaData(false), m_globalWmo(nullptr),
+      Name(name), Id(TransportId)
+{
+    ::memset(m_hasAdt, 0, sizeof(m_hasAdt));
+
+    // the instance grows these to fit the model
+    constexpr auto limit = (std::numeric_limits<float>::max)();
+
+    math::BoundingBox bounds;
+    bounds.MinCorner = {limit, limit, limit};
+    bounds.MaxCorner = {-limit, -limit, -limit};
+
+    m_globalWmo = std::make_unique<WmoInstance>(
+        GetWmo(wmoPath), 0, 0, bounds, math::Matrix::CreateScalingMatrix(1.f));
+}
+
 bool Map::HasAdt(int x, int y) const
 {
     assert(x >= 0 && y >= 0 && x < MeshSettings::Adts &&
@@ -250,36 +287,21 @@ void Map::UnloadAdt(int x, int y)
 
 const Wmo* Map::GetWmo(const std::string& name)
 {
-    auto filename = utility::lower(name);
-
-    std::lock_guard<std::mutex> guard(m_wmoMutex);
+    auto const filename = utility::lower(name);
 
-    for (auto const& wmo : m_loadedWmos)
-        if (wmo->MpqPath == filename)
-            return wmo.get();
-
-    auto ret = new Wmo(filename);
+    {
+        std::lock_guard<std::mutex> guard(m_wmoMutex);
 
-    m_loadedWmos.push_back(std::unique_ptr<const Wmo>(ret));
+        auto const i = m_loadedWmos.find(filename);
+        if (i != m_loadedWmos.end())
+            return i->second.get();
+    }
 
-    // loading this WMO also loaded all referenced doodads in all doodad sets
-    // for the wmo. for now, let us share ownership between the WMO and this map
-    std::lock_guard<std::mutex> doodadGuard(m_doodadMutex);
-    for (auto const& doodadSet : ret->DoodadSets)
-        for (auto const& wmoDoodad : doodadSet)
-        {
-            bool present = false;
-            for (auto const& d : m_loadedDoodads)
-                if (d->MpqPath == wmoDoodad->Parent->MpqPath)
-                {
-                    present = true;
-                    break;
-                }
+    // parsed without the lock held, since parsing a large wmo takes a while
+    auto wmo = sMpqManager.GetWmo(filename);
 
-            if (!present)
-                m_loadedDoodads.push_back(wmoDoodad->Parent);
-        }
-    return ret;
+    std::lock_guard<std::mutex> guard(m_wmoMutex);
+    return m_loadedWmos.emplace(filename, std::move(wmo)).first->second.get();
 }
 
 void Map::InsertWmoInstance(unsigned int uniqueId, const WmoInstance* wmo)
@@ -304,17 +326,21 @@ const WmoInstance* Map::GetGlobalWmoInstance() const
 
 const Doodad* Map::GetDoodad(const std::string& name)
 {
-    auto filename = utility::lower(name);
+    auto const filename = utility::lower(name);
 
-    std::lock_guard<std::mutex> guard(m_doodadMutex);
+    {
+        std::lock_guard<std::mutex> guard(m_doodadMutex);
+
+        auto const i = m_loadedDoodads.find(filename);
+        if (i != m_loadedDoodads.end())
+            return i->second.get();
+    }
 
-    for (auto const& doodad : m_loadedDoodads)
-        if (doodad->MpqPath == filename)
-            return doodad.get();
+    auto doodad = sMpqManager.GetDoodad(filename);
 
-    auto ret = new Doodad(name);
-    m_loadedDoodads.push_back(std::unique_ptr<const Doodad>(ret));
-    return ret;
+    std::lock_guard<std::mutex> guard(m_doodadMutex);
+    return m_loadedDoodads.emplace(filename, std::move(doodad))
+        .first->second.get();
 }
 
 void Map::InsertDoodadInstance(unsigned int uniqueId,
@@ -344,21 +370,21 @@ void Map::Serialize(utility::BinaryStream& stream) const
               (sizeof(std::uint32_t) + // id
                sizeof(std::uint16_t) + // doodad set
                sizeof(std::uint16_t) + // name set
-               22 * sizeof(float) + // 16 floats for transform matrix, 6 floats
-                                    // for bounds
+               38 * sizeof(float) + // 16 floats each for transform matrix
+                                    // and its inverse, 6 floats for bounds
                MeshSettings::MaxMPQPathLength    // model file name
                ) * m_loadedWmoInstances.size() + // for each wmo instance
               sizeof(std::uint32_t) +            // loaded doodad size
               (sizeof(std::uint32_t) +           // id
-               22 * sizeof(float) + // 16 floats for transform matrix, 6 floats
-                                    // for bounds
+               38 * sizeof(float) + // 16 floats each for transform matrix
+                                    // and its inverse, 6 floats for bounds
                MeshSettings::MaxMPQPathLength // model file name
                ) * m_loadedDoodadInstances.size()) :
              (sizeof(std::uint32_t) + // id
               sizeof(std::uint16_t) + // doodad set
               sizeof(std::uint16_t) + // name set
-              22 * sizeof(float) + // 16 floats for transform matrix, 6 floats
-                                   // for bounds
+              38 * sizeof(float) + // 16 floats each for transform matrix and
+                                   // its inverse, 6 floats for bounds
               MeshSettings::MaxMPQPathLength // model file name
               ));
 
@@ -389,6 +415,9 @@ void Map::Serialize(utility::BinaryStream& stream) const
 
         ourStream.Write(has_adt, sizeof(has_adt));
 
+        // the instances are written in order of their ids, and with their
+        // inverse transforms, so that the pathfind library can load them
+        // without sorting them or inverting their transforms itself
         {
             std::lock_guard<std::mutex> guard(m_wmoMutex);
 
@@ -401,6 +430,7 @@ void Map::Serialize(utility::BinaryStream& stream) const
                 ourStream << static_cast<std::uint16_t>(wmo.second->DoodadSet);
                 ourStream << static_cast<std::uint16_t>(wmo.second->NameSet);
                 ourStream << wmo.second->TransformMatrix;
+                ourStream << wmo.second->TransformMatrix.ComputeInverse();
                 ourStream << wmo.second->Bounds;
                 ourStream.WriteString(wmo.second->Model->MpqPath,
                                       MeshSettings::MaxMPQPathLength);
@@ -417,6 +447,7 @@ void Map::Serialize(utility::BinaryStream& stream) const
             {
                 ourStream << static_cast<std::uint32_t>(doodad.first);
                 ourStream << doodad.second->TransformMatrix;
+                ourStream << doodad.second->TransformMatrix.ComputeInverse();
                 ourStream << doodad.second->Bounds;
                 ourStream.WriteString(doodad.second->Model->MpqPath,
                                       MeshSettings::MaxMPQPathLength);
@@ -435,6 +466,7 @@ void Map::Serialize(utility::BinaryStream& stream) const
         ourStream << static_cast<std::uint16_t>(wmo->DoodadSet);
         ourStream << static_cast<std::uint16_t>(wmo->NameSet);
         ourStream << wmo->TransformMatrix;
+        ourStream << wmo->TransformMatrix.ComputeInverse();
         ourStream << wmo->Bounds;
         ourStream.WriteString(wmo->Model->MpqPath,
                               MeshSettings::MaxMPQPathLength);
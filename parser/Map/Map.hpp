@@ -4,6 +4,7 @@
 #include "parser/Adt/Adt.hpp"
 #include "parser/Wmo/WmoInstance.hpp"
 #include "utility/BinaryStream.hpp"
+#include "utility/MappedFile.hpp"
 
 #include <cstdint>
 #include <map>
@@ -12,6 +13,7 @@
 #include <ostream>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace parser
@@ -29,9 +31,15 @@ private:
 
     // ALPHA-EXCLUSIVE DATA
     bool m_isAlphaData;
-    std::shared_ptr<std::vector<std::uint8_t>> m_alphaData;
+
+    // the whole WDT, which is mapped rather than read into memory when the
+    // archive holding it allows
+    std::shared_ptr<utility::MappedFile> m_alphaData;
 
     std::uint32_t m_adtOffsets[MeshSettings::Adts][MeshSettings::Adts];
+
+    // where the data of each ADT ends, which is where that of the next begins
+    size_t m_adtEnds[MeshSettings::Adts][MeshSettings::Adts];
     std::vector<std::string> m_doodadNames;
     std::vector<std::string> m_wmoNames;
     // END ALPHA-EXCLUSIVE DATA
@@ -41,15 +49,17 @@ private:
     std::unique_ptr<WmoInstance> m_globalWmo;
 
     mutable std::mutex m_wmoMutex;
-    std::vector<std::unique_ptr<const Wmo>> m_loadedWmos;
+    // the models are shared with every other map using the same data, and
+    // are held here by their lowercase names so that they are found quickly
+    std::unordered_map<std::string, std::shared_ptr<const Wmo>> m_loadedWmos;
     std::map<std::uint32_t, std::unique_ptr<const WmoInstance>>
         m_loadedWmoInstances;
     std::map<std::uint64_t, std::unique_ptr<const WmoInstance>>
         m_loadedWmoGameObjects;
 
     mutable std::mutex m_doodadMutex;
-    std::vector<std::shared_ptr<const Doodad>>
-        m_loadedDoodads; // must be shared because it can also be owned by a WMO
+    std::unordered_map<std::string, std::shared_ptr<const Doodad>>
+        m_loadedDoodads;
     std::map<std::uint32_t, std::unique_ptr<const DoodadInstance>>
         m_loadedDoodadInstances;
     std::map<std::uint64_t, std::unique_ptr<const WmoInstance>>
@@ -58,11 +68,21 @@ private:
     friend Adt::Adt(Map*, int, int);
 
 public:
+    // the id of a map holding only the wmo of a transport, which no map of
+    // the game has
+    static constexpr unsigned int TransportId = 0xFFFFFFFF;
+
     const std::string Name;
     const unsigned int Id;
 
     Map(const std::string& MapName);
 
+    // a map of nothing but the given wmo, placed with no transform at all so
+    // that the navmesh built from it is in the coordinates of the model.
+    // this is how the decks of transports are built, which move about
+    // whichever map they are on.  the map is named as given
+    Map(const std::string& name, const std::string& wmoPath);
+
     bool HasAdt(int x, int y) const;
     const Adt* GetAdt(int x, int y);
     void UnloadAdt(int x, int y);
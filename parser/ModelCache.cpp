@@ -0,0 +1,98 @@
+#include "ModelCache.hpp"
+
+#include "utility/BinaryStream.hpp"
+#include "utility/MappedFile.hpp"
+
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace parser
+{
+namespace cache
+{
+void WriteHeader(utility::BinaryStream& out, std::uint32_t kind,
+                 const std::string& path)
+{
+    out << Signature << Version << kind
+        << static_cast<std::uint32_t>(path.length());
+    out.Write(path.c_str(), path.length());
+}
+
+std::unique_ptr<utility::MappedStream>
+Open(const fs::path& filename, std::uint32_t kind, const std::string& path)
+{
+    std::error_code ec;
+    if (!fs::is_regular_file(filename, ec))
+        return nullptr;
+
+    try
+    {
+        auto in = std::make_unique<utility::MappedStream>(
+            std::make_shared<utility::MappedFile>(filename));
+
+        std::uint32_t signature, version, entryKind, length;
+        *in >> signature >> version >> entryKind >> length;
+
+        if (signature != Signature || version != Version ||
+            entryKind != kind || length != path.length())
+            return nullptr;
+
+        // the name of the entry is a hash, so the model is named in full
+        if (path.compare(0, length,
+                         reinterpret_cast<const char*>(in->ReadInPlace(length)),
+                         length) != 0)
+            return nullptr;
+
+        return in;
+    }
+    catch (const std::exception&)
+    {
+        return nullptr;
+    }
+}
+
+void Save(const fs::path& filename, const utility::BinaryStream& contents)
+{
+    std::stringstream suffix;
+    suffix << "." << std::hash<std::thread::id>()(std::this_thread::get_id())
+           << ".tmp";
+
+    auto temporary = filename;
+    temporary += suffix.str();
+
+    {
+        std::ofstream out(temporary,
+                          std::ofstream::binary | std::ofstream::trunc);
+
+        if (out.fail())
+            return;
+
+        out << contents;
+        out.close();
+
+        if (out.fail())
+        {
+            std::error_code ec;
+            fs::remove(temporary, ec);
+            return;
+        }
+    }
+
+    std::error_code ec;
+    fs::rename(temporary, filename, ec);
+
+    if (ec)
+        fs::remove(temporary, ec);
+}
+} // namespace cache
+} // namespace parser
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "utility/BinaryStream.hpp"
+#include "utility/MappedFile.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace parser
+{
+// the entries of the on-disk cache of parsed models, which MpqManager names.
+// each holds the geometry of one model after a header naming it, and is
+// memory mapped when read
+namespace cache
+{
+static constexpr std::uint32_t Signature = 'MCHE';
+
+// must be increased whenever a change to the parsing of models changes what
+// they contain, so that older entries are parsed again
+static constexpr std::uint32_t Version = 1;
+
+static constexpr std::uint32_t Doodad = 'DOOD';
+static constexpr std::uint32_t Wmo = 'WMO\0';
+
+void WriteHeader(utility::BinaryStream& out, std::uint32_t kind,
+                 const std::string& path);
+
+// positioned after the header, or null when there is no entry or it is for
+// another model, kind or version
+std::unique_ptr<utility::MappedStream>
+Open(const std::filesystem::path& filename, std::uint32_t kind,
+     const std::string& path);
+
+// several threads may save the same entry at once, and each writes its own
+// temporary file before renaming it into place.  failures are ignored, since
+// the entry is only an optimization
+void Save(const std::filesystem::path& filename,
+          const utility::BinaryStream& contents);
+
+template <typename T>
+void WriteVector(utility::BinaryStream& out, const std::vector<T>& values)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "T must be trivially copyable");
+
+    out << static_cast<std::uint32_t>(values.size());
+
+    if (!values.empty())
+        out.Write(&values[0], values.size() * sizeof(T));
+}
+
+template <typename T>
+void ReadVector(utility::MappedStream& in, std::vector<T>& values)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "T must be trivially copyable");
+
+    values.resize(in.Read<std::uint32_t>());
+
+    if (!values.empty())
+        in.ReadBytes(&values[0], values.size() * sizeof(T));
+}
+} // namespace cache
+} // namespace parser
@@ -1,15 +1,21 @@
 #include "MpqManager.hpp"
 
 #include "DBC.hpp"
+#include "Doodad/Doodad.hpp"
 #include "StormLib.h"
+#include "Wmo/Wmo.hpp"
 #include "utility/Exception.hpp"
 #include "utility/String.hpp"
+#include "utility/Trace.hpp"
 
 #include <algorithm>
 #include <cctype>
 #include <cstdint>
 #include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <system_error>
 #include <unordered_map>
@@ -58,6 +64,45 @@ void AddIfMpq(std::vector<fs::path>& files, const fs::path& file)
     files.push_back(file);
 }
 
+constexpr std::uint64_t HashBasis = 0xCBF29CE484222325ull;
+
+// FNV-1a, continuing from an earlier hash
+std::uint64_t Hash(std::uint64_t hash, const void* data, size_t length)
+{
+    auto const bytes = static_cast<const std::uint8_t*>(data);
+
+    for (auto i = 0u; i < length; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+// FNV-1a of the path as stormlib compares it, ignoring case and treating
+// either slash alike
+std::uint64_t PathHash(const char* path)
+{
+    std::uint64_t result = HashBasis;
+
+    for (auto c = path; *c; ++c)
+    {
+        auto const ch =
+            *c == '/' ? '\\' : std::tolower(static_cast<unsigned char>(*c));
+
+        result ^= static_cast<std::uint8_t>(ch);
+        result *= 0x100000001B3ull;
+    }
+
+    return result;
+}
+
+std::uint64_t PathHash(const std::string& path)
+{
+    return PathHash(path.c_str());
+}
+
 std::string GetRealModelPath(const std::string& path, bool alpha)
 {
     auto const length = path.length();
@@ -90,19 +135,263 @@ namespace parser
 {
 thread_local MpqManager sMpqManager;
 
-void MpqManager::LoadMpq(const fs::path& filePath)
+fs::path MpqManager::ModelCache;
+
+struct MpqManager::Data
+{
+    using HANDLE = void*;
+
+    struct Archive
+    {
+        // relative to the data directory, in lowercase
+        std::string Name;
+        fs::path Path;
+        HANDLE Handle;
+
+        // held for every use of the handle
+        std::mutex Mutex;
+
+        // returns false when the archive does not have the file, or it is
+        // empty
+        bool Read(const std::string& file, std::vector<std::uint8_t>& contents);
+
+        bool Has(const std::string& file);
+
+        // zero when the archive does not have the file
+        size_t Size(const std::string& file);
+
+        // maps the file straight from the archive on disk, which is only
+        // possible when it is stored there uncompressed and unencrypted.
+        // returns null otherwise
+        std::shared_ptr<utility::MappedFile> Map(const std::string& file);
+    };
+
+    bool Alpha = false;
+
+    fs::path BasePath;
+
+    // in order of priority, highest first
+    std::vector<std::unique_ptr<Archive>> Archives;
+
+    // the archive of highest priority holding each non-empty file, by the
+    // PathHash() of its name
+    std::unordered_map<std::uint64_t, Archive*> Index;
+
+    // archives without a listfile, whose files cannot be indexed, and so are
+    // searched for any file not found in the index
+    std::vector<Archive*> Unindexed;
+
+    std::unordered_map<std::string, unsigned int> Maps;
+    std::unordered_map<std::uint32_t, std::uint32_t> AreaToZone;
+
+    // a hash of the name, size and modification time of every archive,
+    // which changes whenever the data does
+    std::uint64_t Stamp = 0;
+
+    // each model is parsed by the first thread to ask for it, while any
+    // others asking for the same model wait for it rather than parse it too
+    template <typename T>
+    struct Model
+    {
+        std::mutex Mutex;
+        std::shared_ptr<const T> Value;
+    };
+
+    template <typename T>
+    using Models =
+        std::unordered_map<std::string, std::shared_ptr<Model<T>>>;
+
+    // guards both collections, but not the parsing of their models
+    std::mutex ModelMutex;
+    Models<Wmo> Wmos;
+    Models<Doodad> Doodads;
+
+    Data() = default;
+    Data(const Data&) = delete;
+    ~Data()
+    {
+        for (auto const& archive : Archives)
+            SFileCloseArchive(archive->Handle);
+    }
+
+    Data& operator=(const Data&) = delete;
+
+    void LoadMpq(const fs::path& filePath);
+    void LoadMpqs(const fs::path& wowDir);
+
+    // the archive which should hold the file, if it has been indexed
+    Archive* Find(const std::string& file) const;
+
+    // the archive which holds the file, if any, and the name of the file
+    // within it, which differs for the alpha's archives of a single file
+    Archive* Locate(const std::string& file, std::string& name) const;
+
+    template <typename T>
+    std::shared_ptr<const T> GetModel(Models<T>& models,
+                                      const std::string& path);
+};
+
+void MpqManager::Data::LoadMpq(const fs::path& filePath)
 {
-    HANDLE archive;
+    auto archive = std::make_unique<Archive>();
+    archive->Path = filePath;
 
-    if (!SFileOpenArchive(filePath.string().c_str(), 0, MPQ_OPEN_READ_ONLY, &archive))
+    if (!SFileOpenArchive(filePath.string().c_str(), 0, MPQ_OPEN_READ_ONLY,
+                          &archive->Handle))
         THROW(Result::COULD_NOT_OPEN_MPQ).ErrorCode();
 
     std::error_code ec;
     auto const rel = fs::relative(filePath, BasePath, ec);
     if (ec)
-        MpqHandles[filePath.string()] = archive;
+        archive->Name = filePath.string();
     else
-        MpqHandles[utility::lower(rel.string())] = archive;
+        archive->Name = utility::lower(rel.string());
+
+    auto const size = static_cast<std::uint64_t>(fs::file_size(filePath, ec));
+    auto const time = static_cast<std::uint64_t>(
+        fs::last_write_time(filePath, ec).time_since_epoch().count());
+
+    Stamp = Hash(Stamp, archive->Name.c_str(), archive->Name.length());
+    Stamp = Hash(Stamp, &size, sizeof(size));
+    Stamp = Hash(Stamp, &time, sizeof(time));
+
+    // without a listfile, stormlib cannot name the files of the archive
+    if (!SFileHasFile(archive->Handle, "(listfile)"))
+    {
+        Unindexed.push_back(archive.get());
+        Archives.push_back(std::move(archive));
+        return;
+    }
+
+    SFILE_FIND_DATA data;
+    auto const search =
+        SFileFindFirstFile(archive->Handle, "*", &data, nullptr);
+
+    if (search)
+    {
+        do
+        {
+            // the archives are loaded in order of priority, so a file which
+            // is already indexed is overridden by the archive which has it
+            if (data.dwFileSize != 0)
+                Index.emplace(PathHash(data.cFileName), archive.get());
+        } while (SFileFindNextFile(search, &data));
+
+        SFileFindClose(search);
+    }
+
+    Archives.push_back(std::move(archive));
+}
+
+MpqManager::Data::Archive*
+MpqManager::Data::Find(const std::string& file) const
+{
+    auto const i = Index.find(PathHash(file));
+
+    return i == Index.end() ? nullptr : i->second;
+}
+
+MpqManager::Data::Archive*
+MpqManager::Data::Locate(const std::string& file, std::string& name) const
+{
+    name = file;
+
+    // the index is only a hint, since the hash of another file may match
+    if (auto const archive = Find(file))
+        if (archive->Has(file))
+            return archive;
+
+    for (auto const archive : Unindexed)
+        if (archive->Has(file))
+            return archive;
+
+    // it is possible that we reach here when operating on alpha data, when
+    // many (all?) files were in their own MPQ.  lets check for that next...
+    auto const mpqName = file + ".mpq";
+
+    for (auto const& archive : Archives)
+    {
+        // if we are on Linux, the mpq filenames will use forward slashes
+        // instead of backslashes.  this code could be cleaner.
+        std::string mpqPath = archive->Name;
+        std::replace(mpqPath.begin(), mpqPath.end(), '/', '\\');
+
+        if (mpqPath != mpqName)
+            continue;
+
+        // if we have found a match, there should be exactly two files in this
+        // mpq: the data file, and a checksum file.
+
+        std::lock_guard<std::mutex> guard(archive->Mutex);
+
+        SFILE_FIND_DATA data;
+        auto const search =
+            SFileFindFirstFile(archive->Handle, "*", &data, nullptr);
+        if (!search)
+            continue;
+
+        // TODO: what follows is probably over kill, but left here to test the
+        // assumptions the code relies on.
+        std::vector<std::string> files;
+        std::string candidate("");
+        do
+        {
+            const std::string fn(data.cFileName);
+            files.push_back(fn);
+
+            if (fn != "(attributes)" && data.dwFileSize != 16 &&
+                data.dwFileSize != 0)
+            {
+                if (!candidate.empty())
+                    THROW(Result::MULTIPLE_CANDIDATES_IN_ALPHA_MPQ);
+                candidate = fn;
+            }
+
+            if (!SFileFindNextFile(search, &data))
+            {
+                SFileFindClose(search);
+                break;
+            }
+        } while (true);
+
+        if (files.size() != 3)
+            THROW(Result::TOO_MANY_FILES_IN_ALPHA_MPQ);
+        if (candidate.empty())
+            THROW(Result::NO_MPQ_CANDIDATE);
+
+        name = candidate;
+        return archive.get();
+    }
+
+    return nullptr;
+}
+
+template <typename T>
+std::shared_ptr<const T>
+MpqManager::Data::GetModel(Models<T>& models, const std::string& path)
+{
+    auto name = utility::lower(path);
+    std::replace(name.begin(), name.end(), '/', '\\');
+
+    std::shared_ptr<Model<T>> model;
+
+    {
+        std::lock_guard<std::mutex> guard(ModelMutex);
+
+        auto& entry = models[name];
+        if (!entry)
+            entry = std::make_shared<Model<T>>();
+
+        model = entry;
+    }
+
+    std::lock_guard<std::mutex> guard(model->Mutex);
+
+    // when parsing throws, the next thread to ask tries again
+    if (!model->Value)
+        model->Value = std::make_shared<const T>(name);
+
+    return model->Value;
 }
 
 void MpqManager::Initialize()
@@ -110,14 +399,74 @@ void MpqManager::Initialize()
     Initialize(".");
 }
 
-// Priority logic is explained at https://github.com/namreeb/namigator/issues/22
 void MpqManager::Initialize(const fs::path& wowDir)
+{
+    // the data of each directory, for as long as some thread is using it
+    static std::mutex dataMutex;
+    static std::unordered_map<std::string, std::weak_ptr<Data>> allData;
+
+    std::error_code ec;
+    auto const canonical = fs::weakly_canonical(wowDir, ec);
+    auto const key = (ec ? wowDir : canonical).string();
+
+    // held while loading, so that threads initializing at the same time
+    // wait for the first rather than opening the archives themselves
+    std::lock_guard<std::mutex> guard(dataMutex);
+
+    auto& data = allData[key];
+
+    Shared = data.lock();
+
+    if (Shared)
+        return;
+
+    auto shared = std::make_shared<Data>();
+    shared->LoadMpqs(wowDir);
+
+    // the tables are read from the archives through this manager
+    Shared = shared;
+
+    try
+    {
+        const DBC maps("DBFilesClient\\Map.dbc");
+
+        for (auto i = 0u; i < maps.RecordCount(); ++i)
+        {
+            auto const map_name =
+                utility::lower(std::string(maps.GetStringField(i, 1)));
+            shared->Maps[map_name] = maps.GetField(i, 0);
+        }
+
+        const DBC area("DBFilesClient\\AreaTable.dbc");
+        auto const ids = area.GetColumn(0);
+        auto const parents = area.GetColumn(2);
+
+        std::unordered_map<std::uint32_t, std::uint32_t> areaToZone;
+        areaToZone.reserve(area.RecordCount());
+        for (auto i = 0u; i < area.RecordCount(); ++i)
+            areaToZone[ids[i]] = parents[i];
+
+        for (auto const& i : areaToZone)
+            shared->AreaToZone[i.first] = GetRootAreaId(areaToZone, i.first);
+    }
+    catch (...)
+    {
+        Shared.reset();
+        throw;
+    }
+
+    data = Shared;
+}
+
+// Priority logic is explained at https://github.com/namreeb/namigator/issues/22
+void MpqManager::Data::LoadMpqs(const fs::path& wowDir)
 {
     if (!fs::is_directory(wowDir))
         THROW(Result::NO_DATA_FILES_FOUND);
 
     Alpha = false;
     BasePath = fs::path(wowDir);
+    Stamp = HashBasis;
     std::string locale = "";
 
     for (auto const& d : fs::directory_iterator(BasePath))
@@ -201,158 +550,235 @@ void MpqManager::Initialize(const fs::path& wowDir)
 
     for (auto const& file : files)
         LoadMpq(file);
+}
+
+bool MpqManager::Data::Archive::Read(const std::string& file,
+                                     std::vector<std::uint8_t>& contents)
+{
+    std::lock_guard<std::mutex> guard(Mutex);
+
+    if (!SFileHasFile(Handle, file.c_str()))
+        return false;
 
-    const DBC maps("DBFilesClient\\Map.dbc");
+    HANDLE fileHandle;
+    if (!SFileOpenFileEx(Handle, file.c_str(), SFILE_OPEN_FROM_MPQ,
+                         &fileHandle))
+        THROW(Result::ERROR_IN_SFILEOPENFILEX).ErrorCode();
 
-    for (auto i = 0u; i < maps.RecordCount(); ++i)
+    auto const fileSize = SFileGetFileSize(fileHandle, nullptr);
+
+    if (!fileSize)
     {
-        auto const map_name = utility::lower(maps.GetStringField(i, 1));
-        Maps[map_name] = maps.GetField(i, 0);
+        SFileCloseFile(fileHandle);
+        return false;
     }
 
-    const DBC area("DBFilesClient\\AreaTable.dbc");
-    std::unordered_map<std::uint32_t, std::uint32_t> areaToZone;
-    for (auto i = 0; i < area.RecordCount(); ++i)
-    {
-        auto const id = area.GetField(i, 0);
-        auto const parent = area.GetField(i, 2);
+    contents.resize(fileSize);
 
-        areaToZone[id] = parent;
+    if (!SFileReadFile(fileHandle, &contents[0],
+                       static_cast<DWORD>(contents.size()), nullptr, nullptr))
+    {
+        SFileCloseFile(fileHandle);
+        THROW(Result::ERROR_IN_SFILEREADFILE).ErrorCode();
     }
 
-    for (auto const& i : areaToZone)
-        AreaToZone[i.first] = GetRootAreaId(areaToZone, i.first);
+    SFileCloseFile(fileHandle);
+
+    return true;
 }
 
-bool MpqManager::FileExists(const std::string& file) const
+bool MpqManager::Data::Archive::Has(const std::string& file)
 {
-    for (auto const& i : MpqHandles)
-        if (SFileHasFile(i.second, file.c_str()))
-            return true;
-    return false;
+    std::lock_guard<std::mutex> guard(Mutex);
+
+    return SFileHasFile(Handle, file.c_str());
 }
 
-std::unique_ptr<utility::BinaryStream>
-MpqManager::OpenFile(const std::string& file)
+size_t MpqManager::Data::Archive::Size(const std::string& file)
+{
+    std::lock_guard<std::mutex> guard(Mutex);
+
+    HANDLE fileHandle;
+    if (!SFileOpenFileEx(Handle, file.c_str(), SFILE_OPEN_FROM_MPQ,
+                         &fileHandle))
+        return 0;
+
+    auto const fileSize = SFileGetFileSize(fileHandle, nullptr);
+
+    SFileCloseFile(fileHandle);
+
+    return fileSize == SFILE_INVALID_SIZE ? 0 : fileSize;
+}
+
+std::shared_ptr<utility::MappedFile>
+MpqManager::Data::Archive::Map(const std::string& file)
+{
+    std::lock_guard<std::mutex> guard(Mutex);
+
+    HANDLE fileHandle;
+    if (!SFileOpenFileEx(Handle, file.c_str(), SFILE_OPEN_FROM_MPQ,
+                         &fileHandle))
+        THROW(Result::ERROR_IN_SFILEOPENFILEX).ErrorCode();
+
+    auto const fileSize = SFileGetFileSize(fileHandle, nullptr);
+
+    DWORD flags = 0;
+    ULONGLONG byteOffset = 0;
+    ULONGLONG headerOffset = 0;
+
+    // the offset of the file is relative to the header of the archive, which
+    // need not be at the start of the archive's file
+    auto const stored =
+        SFileGetFileInfo(fileHandle, SFileInfoFlags, &flags, sizeof(flags),
+                         nullptr) &&
+        SFileGetFileInfo(fileHandle, SFileInfoByteOffset, &byteOffset,
+                         sizeof(byteOffset), nullptr) &&
+        SFileGetFileInfo(Handle, SFileMpqHeaderOffset, &headerOffset,
+                         sizeof(headerOffset), nullptr) &&
+        !(flags & (MPQ_FILE_COMPRESS_MASK | MPQ_FILE_ENCRYPTED |
+                   MPQ_FILE_PATCH_FILE));
+
+    SFileCloseFile(fileHandle);
+
+    if (!stored || !fileSize)
+        return nullptr;
+
+    return std::make_shared<utility::MappedFile>(
+        Path, static_cast<size_t>(headerOffset + byteOffset), fileSize);
+}
+
+void MpqManager::SetModelCache(const fs::path& directory)
+{
+    if (!directory.empty())
+        fs::create_directories(directory);
+
+    ModelCache = directory;
+}
+
+std::shared_ptr<const Wmo> MpqManager::GetWmo(const std::string& path)
 {
-    if (MpqHandles.empty())
+    if (!Shared)
         THROW(Result::MPQ_MANAGER_NOT_INIATIALIZED);
 
-    auto file_lower = utility::lower(GetRealModelPath(file, Alpha));
+    return Shared->GetModel(Shared->Wmos, path);
+}
 
-    for (auto const& i : MpqHandles)
-    {
-        if (!SFileHasFile(i.second, file_lower.c_str()))
-            continue;
+std::shared_ptr<const Doodad> MpqManager::GetDoodad(const std::string& path)
+{
+    if (!Shared)
+        THROW(Result::MPQ_MANAGER_NOT_INIATIALIZED);
 
-        HANDLE fileHandle;
-        if (!SFileOpenFileEx(i.second, file_lower.c_str(), SFILE_OPEN_FROM_MPQ,
-                             &fileHandle))
-            THROW(Result::ERROR_IN_SFILEOPENFILEX).ErrorCode();
+    return Shared->GetModel(Shared->Doodads, path);
+}
 
-        auto const fileSize = SFileGetFileSize(fileHandle, nullptr);
+fs::path MpqManager::GetModelCachePath(const std::string& file) const
+{
+    if (ModelCache.empty() || !Shared)
+        return {};
 
-        if (!fileSize)
-            continue;
+    auto const hash =
+        Hash(PathHash(file), &Shared->Stamp, sizeof(Shared->Stamp));
 
-        std::vector<std::uint8_t> inFileData(fileSize);
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << hash
+         << ".model";
 
-        if (!SFileReadFile(fileHandle, &inFileData[0],
-                           static_cast<DWORD>(inFileData.size()), nullptr,
-                           nullptr))
-        {
-            SFileCloseFile(fileHandle);
-            THROW(Result::ERROR_IN_SFILEREADFILE).ErrorCode();
-        }
+    return ModelCache / name.str();
+}
 
-        SFileCloseFile(fileHandle);
+bool MpqManager::FileExists(const std::string& file) const
+{
+    if (!Shared)
+        return false;
 
-        return std::make_unique<utility::BinaryStream>(inFileData);
-    }
+    if (auto const archive = Shared->Find(file))
+    {
+        std::lock_guard<std::mutex> guard(archive->Mutex);
 
-    // it is possible that we reach here when operating on alpha data, when
-    // many (all?) files were in their own MPQ.  lets check for that next...
-    file_lower += ".mpq";
+        // the hash of another file may have matched
+        if (SFileHasFile(archive->Handle, file.c_str()))
+            return true;
+    }
 
-    for (auto const& i : MpqHandles)
+    for (auto const archive : Shared->Unindexed)
     {
-        // if we are on Linux, the mpq filenames will use forward slashes
-        // instead of backslashes.  this code could be cleaner.
-        std::string mpqPath = i.first;
-        std::replace(mpqPath.begin(), mpqPath.end(), '/', '\\');
+        std::lock_guard<std::mutex> guard(archive->Mutex);
 
-        if (mpqPath != file_lower)
-            continue;
+        if (SFileHasFile(archive->Handle, file.c_str()))
+            return true;
+    }
 
-        // if we have found a match, there should be exactly two files in this
-        // mpq: the data file, and a checksum file.
+    return false;
+}
 
-        SFILE_FIND_DATA data;
-        auto const search = SFileFindFirstFile(i.second, "*", &data, nullptr);
-        if (!search)
-            continue;
+size_t MpqManager::FileSize(const std::string& file)
+{
+    if (!Shared || Shared->Archives.empty())
+        THROW(Result::MPQ_MANAGER_NOT_INIATIALIZED);
 
-        // TODO: what follows is probably over kill, but left here to test the
-        // assumptions the code relies on.
-        std::vector<std::string> files;
-        std::string candidate("");
-        do
-        {
-            const std::string fn(data.cFileName);
-            files.push_back(fn);
+    std::string name;
+    auto const archive = Shared->Locate(
+        utility::lower(GetRealModelPath(file, Shared->Alpha)), name);
 
-            if (fn != "(attributes)" && data.dwFileSize != 16 &&
-                data.dwFileSize != 0)
-            {
-                if (!candidate.empty())
-                    THROW(Result::MULTIPLE_CANDIDATES_IN_ALPHA_MPQ);
-                candidate = fn;
-            }
+    return archive ? archive->Size(name) : 0;
+}
 
-            if (!SFileFindNextFile(search, &data))
-            {
-                SFileFindClose(search);
-                break;
-            }
-        } while (true);
+std::unique_ptr<utility::BinaryStream>
+MpqManager::OpenFile(const std::string& file)
+{
+    utility::Trace::Scope trace("MpqManager::OpenFile", "io");
 
-        if (files.size() != 3)
-            THROW(Result::TOO_MANY_FILES_IN_ALPHA_MPQ);
-        if (candidate.empty())
-            THROW(Result::NO_MPQ_CANDIDATE);
+    if (!Shared || Shared->Archives.empty())
+        THROW(Result::MPQ_MANAGER_NOT_INIATIALIZED);
 
-        HANDLE fileHandle;
-        if (!SFileOpenFileEx(i.second, candidate.c_str(), SFILE_OPEN_FROM_MPQ,
-                             &fileHandle))
-            THROW(Result::ERROR_IN_SFILEOPENFILEX).ErrorCode();
+    std::string name;
+    auto const archive = Shared->Locate(
+        utility::lower(GetRealModelPath(file, Shared->Alpha)), name);
 
-        auto const fileSize = SFileGetFileSize(fileHandle, nullptr);
+    std::vector<std::uint8_t> inFileData;
 
-        std::vector<std::uint8_t> inFileData(fileSize);
+    if (!archive || !archive->Read(name, inFileData))
+        return nullptr;
 
-        if (!SFileReadFile(fileHandle, &inFileData[0],
-                           static_cast<DWORD>(inFileData.size()), nullptr,
-                           nullptr))
-        {
-            SFileCloseFile(fileHandle);
-            THROW(Result::ERROR_IN_SFILEREADFILE).ErrorCode();
-        }
+    return std::make_unique<utility::BinaryStream>(std::move(inFileData));
+}
 
-        SFileCloseFile(fileHandle);
+std::shared_ptr<utility::MappedFile>
+MpqManager::OpenMappedFile(const std::string& file)
+{
+    utility::Trace::Scope trace("MpqManager::OpenMappedFile", "io");
 
-        return std::make_unique<utility::BinaryStream>(inFileData);
-    }
+    if (!Shared || Shared->Archives.empty())
+        THROW(Result::MPQ_MANAGER_NOT_INIATIALIZED);
 
-    return nullptr;
+    std::string name;
+    auto const archive = Shared->Locate(
+        utility::lower(GetRealModelPath(file, Shared->Alpha)), name);
+
+    if (!archive)
+        return nullptr;
+
+    if (auto mapping = archive->Map(name))
+        return mapping;
+
+    std::vector<std::uint8_t> inFileData;
+
+    if (!archive->Read(name, inFileData))
+        return nullptr;
+
+    return std::make_shared<utility::MappedFile>(std::move(inFileData));
 }
 
 unsigned int MpqManager::GetMapId(const std::string& name) const
 {
     std::string nameLower = utility::lower(name);
 
-    auto const i = Maps.find(nameLower);
+    if (!Shared)
+        THROW(Result::MPQ_MANAGER_NOT_INIATIALIZED);
+
+    auto const i = Shared->Maps.find(nameLower);
 
-    if (i == Maps.end())
+    if (i == Shared->Maps.end())
         THROW_MSG("Map ID for " + name + " not found", Result::MAP_ID_NOT_FOUND);
 
     return i->second;
@@ -360,9 +786,12 @@ unsigned int MpqManager::GetMapId(const std::string& name) const
 
 unsigned int MpqManager::GetZoneId(unsigned int areaId) const
 {
-    auto const i = AreaToZone.find(areaId);
+    if (!Shared)
+        return 0;
+
+    auto const i = Shared->AreaToZone.find(areaId);
 
-    if (i == AreaToZone.end())
+    if (i == Shared->AreaToZone.end())
         return 0;
 
     return i->second;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "utility/BinaryStream.hpp"
+#include "utility/MappedFile.hpp"
 
 #include <filesystem>
 #include <memory>
@@ -12,28 +13,59 @@ namespace fs = std::filesystem;
 
 namespace parser
 {
+class Doodad;
+class Wmo;
+
+// each thread has its own manager, but the archives and lookup tables of a
+// data directory are opened and parsed once, and shared by the managers of
+// every thread using that directory.  stormlib does not allow the same
+// archive to be read from several threads at once, so reads of each archive
+// are serialized.  they are released once no manager uses them.
+//
+// so too are the models parsed from that directory, so that however many
+// maps are built and whichever threads build them, each model is parsed
+// once.  they are kept for as long as the archives are.
 class MpqManager
 {
 private:
-    using HANDLE = void*;
-
-    bool Alpha;
+    struct Data;
 
-    fs::path BasePath;
+    std::shared_ptr<Data> Shared;
 
-    std::unordered_map<std::string, HANDLE> MpqHandles;
-    std::unordered_map<std::string, unsigned int> Maps;
-    std::unordered_map<std::uint32_t, std::uint32_t> AreaToZone;
-
-    void LoadMpq(const std::filesystem::path& filePath);
+    static fs::path ModelCache;
 
 public:
     void Initialize();
     void Initialize(const fs::path& wowDir);
 
+    // parsed model geometry is cached in this directory, when one is given,
+    // so that later runs need not read and parse the same models again.  it
+    // applies to every manager, and must be set before other threads use
+    // them
+    static void SetModelCache(const fs::path& directory);
+
+    // where the parsed geometry of the model is cached, or an empty path when
+    // there is no cache.  entries are named for the model and for the
+    // archives of the data directory, so that changed data is never served
+    // from entries made before
+    fs::path GetModelCachePath(const std::string& file) const;
+
+    // the model at the path, parsed when first asked for
+    std::shared_ptr<const Wmo> GetWmo(const std::string& path);
+    std::shared_ptr<const Doodad> GetDoodad(const std::string& path);
+
     bool FileExists(const std::string& file) const;
+
+    // the size in bytes of the file once read, or zero when there is no such
+    // file
+    size_t FileSize(const std::string& file);
     std::unique_ptr<utility::BinaryStream> OpenFile(const std::string& file);
 
+    // the contents of the file, which are mapped from the archive on disk
+    // rather than read into memory when the archive stores them as they are
+    std::shared_ptr<utility::MappedFile>
+    OpenMappedFile(const std::string& file);
+
     unsigned int GetMapId(const std::string& name) const;
     unsigned int GetZoneId(unsigned int areaId) const;
 };
@@ -2,6 +2,7 @@
 
 #include "Common.hpp"
 #include "DBC.hpp"
+#include "ModelCache.hpp"
 #include "MpqManager.hpp"
 #include "Wmo/GroupFile/WmoGroupFile.hpp"
 #include "Wmo/RootFile/Chunks/MODD.hpp"
@@ -13,16 +14,132 @@
 #include "utility/Exception.hpp"
 #include "utility/String.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <future>
 #include <iomanip>
 #include <map>
 #include <memory>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+namespace
+{
+// the fewest group files worth reading on each thread
+constexpr size_t ParallelGroupFiles = 8;
+} // namespace
+
 namespace parser
 {
 Wmo::Wmo(const std::string& path) : MpqPath(utility::lower(path))
+{
+    auto const cachePath = sMpqManager.GetModelCachePath(MpqPath);
+
+    if (!cachePath.empty() && LoadCache(cachePath))
+        return;
+
+    Parse(path);
+
+    if (!cachePath.empty())
+        SaveCache(cachePath);
+}
+
+bool Wmo::LoadCache(const std::filesystem::path& filename)
+{
+    auto const in = cache::Open(filename, cache::Wmo, MpqPath);
+
+    if (!in)
+        return false;
+
+    try
+    {
+        cache::ReadVector(*in, Vertices);
+        cache::ReadVector(*in, Indices);
+        cache::ReadVector(*in, LiquidVertices);
+        cache::ReadVector(*in, LiquidIndices);
+        RootId = in->Read<std::uint32_t>();
+        cache::ReadVector(*in, NameSetToAreaAndZone);
+
+        DoodadSets.resize(in->Read<std::uint32_t>());
+
+        for (auto& doodadSet : DoodadSets)
+        {
+            auto const count = in->Read<std::uint32_t>();
+            doodadSet.reserve(count);
+
+            for (auto i = 0u; i < count; ++i)
+            {
+                std::string name(in->Read<std::uint32_t>(), '\0');
+                if (!name.empty())
+                    in->ReadBytes(&name[0], name.length());
+
+                float matrix[16];
+                in->ReadBytes(matrix, sizeof(matrix));
+
+                auto doodad = sMpqManager.GetDoodad(name);
+
+                if (!!doodad->Vertices.size() && !!doodad->Indices.size())
+                    doodadSet.push_back(std::make_unique<WmoDoodad const>(
+                        doodad, math::Matrix::CreateFromArray(matrix, 16)));
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        Vertices.clear();
+        Indices.clear();
+        LiquidVertices.clear();
+        LiquidIndices.clear();
+        NameSetToAreaAndZone.clear();
+        DoodadSets.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void Wmo::SaveCache(const std::filesystem::path& filename) const
+{
+    utility::BinaryStream out;
+
+    cache::WriteHeader(out, cache::Wmo, MpqPath);
+    cache::WriteVector(out, Vertices);
+    cache::WriteVector(out, Indices);
+    cache::WriteVector(out, LiquidVertices);
+    cache::WriteVector(out, LiquidIndices);
+    out << static_cast<std::uint32_t>(RootId);
+    cache::WriteVector(out, NameSetToAreaAndZone);
+
+    // the doodads are stored by name, since their own geometry is cached
+    // alongside that of the wmo
+    out << static_cast<std::uint32_t>(DoodadSets.size());
+
+    for (auto const& doodadSet : DoodadSets)
+    {
+        out << static_cast<std::uint32_t>(doodadSet.size());
+
+        for (auto const& doodad : doodadSet)
+        {
+            auto const& name = doodad->Parent->MpqPath;
+
+            out << static_cast<std::uint32_t>(name.length());
+            out.Write(name.c_str(), name.length());
+
+            float matrix[16];
+            doodad->TransformMatrix.PopulateArray(matrix);
+            out.Write(matrix, sizeof(matrix));
+        }
+    }
+
+    cache::Save(filename, out);
+}
+
+void Wmo::Parse(const std::string& path)
 {
     auto reader = sMpqManager.OpenFile(path);
 
@@ -72,15 +189,52 @@ Wmo::Wmo(const std::string& path) : MpqPath(utility::lower(path))
         fileName = fileName.substr(0, fileName.rfind('.'));
         auto const dirName = path.substr(0, path.rfind('\\'));
 
+        std::vector<std::string> groupPaths;
+        groupPaths.reserve(information.WMOGroupFilesCount);
+
         for (int i = 0; i < information.WMOGroupFilesCount; ++i)
         {
             std::stringstream ss;
 
             ss << dirName << "\\" << fileName << "_" << std::setfill('0')
                << std::setw(3) << i << ".wmo";
-            groupFiles.push_back(
-                std::make_unique<input::WmoGroupFile>(version, ss.str()));
+            groupPaths.push_back(ss.str());
         }
+
+        groupFiles.resize(groupPaths.size());
+
+        // each thread takes whichever group is next, so that one thread
+        // reaching a large group does not hold up the rest.  the groups are
+        // merged below in their own order regardless of which finished first
+        std::atomic_size_t nextGroup {0};
+        auto const loadGroups = [&]()
+        {
+            for (auto g = nextGroup++; g < groupPaths.size(); g = nextGroup++)
+                groupFiles[g] = std::make_unique<input::WmoGroupFile>(
+                    version, groupPaths[g]);
+        };
+
+        auto const threads = (std::min)(
+            groupPaths.size() / ParallelGroupFiles,
+            static_cast<size_t>(std::thread::hardware_concurrency()));
+
+        // the manager is per thread, so each helper is given a copy of this
+        // thread's, which shares its archives
+        auto const manager = sMpqManager;
+        std::vector<std::future<void>> helpers;
+
+        for (size_t t = 1; t < threads; ++t)
+            helpers.push_back(std::async(std::launch::async,
+                                         [&]()
+                                         {
+                                             sMpqManager = manager;
+                                             loadGroups();
+                                         }));
+
+        loadGroups();
+
+        for (auto& helper : helpers)
+            helper.get();
     }
 
     size_t modsLocation;
@@ -293,7 +447,7 @@ Wmo::Wmo(const std::string& path) : MpqPath(utility::lower(path))
             math::Matrix transformMatrix;
             placement.GetTransformMatrix(transformMatrix);
 
-            auto doodad = LoadDoodad(name);
+            auto doodad = sMpqManager.GetDoodad(name);
 
             if (!!doodad->Vertices.size() && !!doodad->Indices.size())
                 DoodadSets[i].push_back(
@@ -301,17 +455,4 @@ Wmo::Wmo(const std::string& path) : MpqPath(utility::lower(path))
         }
     }
 }
-
-std::shared_ptr<const Doodad> Wmo::LoadDoodad(const std::string &name) const
-{
-    for (size_t i = 0; i < DoodadSets.size(); ++i)
-    {
-        auto & doodadSet = DoodadSets[i];
-        for (size_t j = 0; j < doodadSet.size(); ++j)
-            if (doodadSet[j]->Parent->MpqPath == name)
-                return doodadSet[j]->Parent;
-    }
-
-    return std::make_shared<const Doodad>(name);
-}
 } // namespace parser
\ No newline at end of file
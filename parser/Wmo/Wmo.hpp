@@ -5,6 +5,7 @@
 
 #include <array>
 #include <cstdint>
+#include <filesystem>
 #include <memory>
 #include <string>
 #include <vector>
@@ -17,7 +18,10 @@ namespace parser
 class Wmo
 {
 private:
-    std::shared_ptr<const Doodad> LoadDoodad(const std::string& name) const;
+    void Parse(const std::string& path);
+
+    bool LoadCache(const std::filesystem::path& filename);
+    void SaveCache(const std::filesystem::path& filename) const;
 
 public:
     const std::string MpqPath;
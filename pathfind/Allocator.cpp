@@ -0,0 +1,240 @@
+#include "Allocator.hpp"
+
+#include "recastnavigation/Detour/Include/DetourAlloc.h"
+#include "recastnavigation/Recast/Include/RecastAlloc.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+
+namespace
+{
+// blocks are pooled in classes of 64 bytes to 1 MiB, which covers the
+// scratch of a tile rebuild save for its largest buffers
+constexpr int MinClassShift = 6;
+constexpr int MaxClassShift = 20;
+constexpr int ClassCount = MaxClassShift - MinClassShift + 1;
+constexpr std::uint8_t Unpooled = 0xFF;
+
+// precedes each block, and keeps what follows it aligned as malloc() would
+struct alignas(std::max_align_t) Header
+{
+    std::uint64_t m_size;
+    std::uint8_t m_class;
+    bool m_permanent;
+};
+
+using Stats = pathfind::Allocator::Stats;
+
+std::mutex InstallMutex;
+std::atomic_bool IsInstalled {false};
+pathfind::Allocator::Config Limits;
+
+std::atomic<std::uint64_t> PermanentBytes {0};
+std::atomic<std::uint64_t> TemporaryBytes {0};
+std::atomic<std::uint64_t> CachedBytes {0};
+std::atomic<std::uint64_t> Allocations {0};
+std::atomic<std::uint64_t> Reused {0};
+
+// a freed block holds the next in its list where its data was
+Header*& Next(Header* block)
+{
+    return *reinterpret_cast<Header**>(block + 1);
+}
+
+struct FreeLists
+{
+    Header* m_heads[ClassCount] = {};
+    std::uint64_t m_bytes = 0;
+
+    Header* Pop(std::uint8_t sizeClass)
+    {
+        auto const block = m_heads[sizeClass];
+
+        if (block)
+        {
+            m_heads[sizeClass] = Next(block);
+            m_bytes -= block->m_size;
+            CachedBytes -= block->m_size;
+        }
+
+        return block;
+    }
+
+    bool Push(Header* block, std::uint64_t limit)
+    {
+        if (m_bytes + block->m_size > limit)
+            return false;
+
+        Next(block) = m_heads[block->m_class];
+        m_heads[block->m_class] = block;
+        m_bytes += block->m_size;
+        CachedBytes += block->m_size;
+
+        return true;
+    }
+
+    void Clear()
+    {
+        for (auto& head : m_heads)
+            while (head)
+            {
+                auto const block = head;
+                head = Next(block);
+                CachedBytes -= block->m_size;
+                std::free(block);
+            }
+
+        m_bytes = 0;
+    }
+};
+
+std::mutex SharedMutex;
+FreeLists SharedLists;
+
+// freeing a block as its thread exits, after the cache of the thread has been
+// destroyed, frees it outright.  this flag is trivially destructible, and so
+// may still be read then
+thread_local bool ThreadCacheDestroyed = false;
+
+struct ThreadCache : FreeLists
+{
+    ~ThreadCache()
+    {
+        Clear();
+        ThreadCacheDestroyed = true;
+    }
+};
+
+FreeLists* GetThreadCache()
+{
+    if (ThreadCacheDestroyed)
+        return nullptr;
+
+    thread_local ThreadCache cache;
+    return &cache;
+}
+
+std::uint8_t SizeClass(size_t size)
+{
+    for (auto shift = MinClassShift; shift <= MaxClassShift; ++shift)
+        if (size <= (size_t {1} << shift))
+            return static_cast<std::uint8_t>(shift - MinClassShift);
+
+    return Unpooled;
+}
+
+void* Allocate(size_t size, bool permanent)
+{
+    auto const sizeClass = SizeClass(size);
+    Header* block = nullptr;
+
+    if (sizeClass != Unpooled)
+    {
+        if (permanent)
+        {
+            std::lock_guard<std::mutex> guard(SharedMutex);
+            block = SharedLists.Pop(sizeClass);
+        }
+        else if (auto const cache = GetThreadCache())
+            block = cache->Pop(sizeClass);
+    }
+
+    if (block)
+        ++Reused;
+    else
+    {
+        auto const blockSize = sizeClass == Unpooled
+                                   ? size
+                                   : size_t {1} << (sizeClass + MinClassShift);
+
+        block = static_cast<Header*>(std::malloc(sizeof(Header) + blockSize));
+
+        if (!block)
+            return nullptr;
+
+        block->m_size = blockSize;
+        block->m_class = sizeClass;
+    }
+
+    block->m_permanent = permanent;
+    (permanent ? PermanentBytes : TemporaryBytes) += block->m_size;
+    ++Allocations;
+
+    return block + 1;
+}
+
+void Free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    auto const block = static_cast<Header*>(ptr) - 1;
+    (block->m_permanent ? PermanentBytes : TemporaryBytes) -= block->m_size;
+
+    if (block->m_class != Unpooled)
+    {
+        if (block->m_permanent)
+        {
+            std::lock_guard<std::mutex> guard(SharedMutex);
+            if (SharedLists.Push(block, Limits.m_sharedCacheBytes))
+                return;
+        }
+        else if (auto const cache = GetThreadCache())
+            if (cache->Push(block, Limits.m_threadCacheBytes))
+                return;
+    }
+
+    std::free(block);
+}
+
+void* DetourAllocate(size_t size, dtAllocHint hint)
+{
+    return Allocate(size, hint == DT_ALLOC_PERM);
+}
+
+void* RecastAllocate(size_t size, rcAllocHint hint)
+{
+    return Allocate(size, hint == RC_ALLOC_PERM);
+}
+} // anonymous namespace
+
+namespace pathfind
+{
+bool Allocator::Install(const Config& config)
+{
+    std::lock_guard<std::mutex> guard(InstallMutex);
+
+    if (IsInstalled)
+        return false;
+
+    Limits = config;
+
+    dtAllocSetCustom(&DetourAllocate, &Free);
+    rcAllocSetCustom(&RecastAllocate, &Free);
+
+    IsInstalled = true;
+
+    return true;
+}
+
+bool Allocator::Installed()
+{
+    return IsInstalled;
+}
+
+Allocator::Stats Allocator::GetStats()
+{
+    Stats result;
+
+    result.m_permanentBytes = PermanentBytes;
+    result.m_temporaryBytes = TemporaryBytes;
+    result.m_cachedBytes = CachedBytes;
+    result.m_allocations = Allocations;
+    result.m_reused = Reused;
+
+    return result;
+}
+} // namespace pathfind
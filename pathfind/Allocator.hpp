@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pathfind
+{
+// an allocator for recast and detour, which otherwise call malloc() for every
+// allocation.  rebuilding the tiles beneath temporary obstacles allocates and
+// frees the same scratch buffers over and over, and on a long running server
+// the churn fragments the heap.  once installed, freed blocks are kept in
+// power of two size classes for reuse: those allocated for temporary use (as
+// recast and detour hint) by the thread which freed them, without locking,
+// and those for permanent use, such as navmesh tile tables and query node
+// pools, in a pool shared by every thread.  allocations larger than the
+// largest class go straight to malloc().
+//
+// blocks from malloc() cannot be freed here, nor these by free(), so this
+// must be installed before any map, crowd or rebuild exists, and can then
+// never be removed.  it is not installed by default.
+class Allocator
+{
+public:
+    struct Config
+    {
+        // the most bytes of freed blocks each thread keeps for reuse
+        std::uint64_t m_threadCacheBytes = 8 << 20;
+
+        // the most bytes of freed permanent blocks kept for reuse
+        std::uint64_t m_sharedCacheBytes = 32 << 20;
+    };
+
+    struct Stats
+    {
+        // bytes of blocks in use, by their hint, including the rounding up
+        // of each to its size class
+        std::uint64_t m_permanentBytes;
+        std::uint64_t m_temporaryBytes;
+
+        // bytes of freed blocks held for reuse
+        std::uint64_t m_cachedBytes;
+
+        std::uint64_t m_allocations;
+
+        // of the allocations, those served by a freed block rather than by
+        // malloc()
+        std::uint64_t m_reused;
+    };
+
+    // installs the allocator with the given limits, returning false if it
+    // was already installed, in which case the limits are unchanged
+    static bool Install(const Config& config);
+    static bool Install() { return Install(Config {}); }
+
+    static bool Installed();
+
+    // all zeros until installed
+    static Stats GetStats();
+};
+} // namespace pathfind
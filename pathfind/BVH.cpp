@@ -3,6 +3,10 @@
 #include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
 namespace pathfind
 {
 BVH::BVH(const fs::path& path) : m_dataPath(path)
@@ -41,6 +45,59 @@ BVH::BVH(const fs::path& path) : m_dataPath(path)
 
         m_temporaryObstacles[entry] = index.ReadString(length);
     }
+
+    auto const pack_file = m_dataPath / "BVH" / "bvh.pack";
+
+    if (!fs::is_regular_file(pack_file))
+        return;
+
+    m_pack = std::make_shared<utility::MappedFile>(pack_file);
+
+    utility::BinaryStream pack(m_pack, 0, m_pack->size());
+
+    std::uint32_t signature, version, count;
+    pack >> signature >> version >> count;
+
+    if (signature != MeshSettings::FileBVHPack ||
+        version < MeshSettings::MinFileVersion ||
+        version > MeshSettings::FileVersion)
+        THROW(Result::INCORRECT_FILE_SIGNATURE);
+
+    m_packEntries.resize(count);
+    if (count > 0)
+        pack.ReadBytes(&m_packEntries[0], count * sizeof(BVHPackEntry));
+
+    for (auto const& entry : m_packEntries)
+        if (entry.m_nameOffset + entry.m_nameLength > m_pack->size() ||
+            entry.m_offset + entry.m_size > m_pack->size())
+            THROW(Result::INCORRECT_FILE_SIGNATURE);
+}
+
+std::unique_ptr<utility::BinaryStream>
+BVH::Open(const std::string& bvh_path) const
+{
+    if (m_pack)
+    {
+        auto const name = fs::path(bvh_path).filename().string();
+        auto const data = reinterpret_cast<const char*>(m_pack->data());
+
+        auto const entry = std::lower_bound(
+            m_packEntries.begin(), m_packEntries.end(), name,
+            [data](const BVHPackEntry& e, const std::string& n)
+            {
+                return std::string_view(data + e.m_nameOffset,
+                                        e.m_nameLength) < n;
+            });
+
+        if (entry != m_packEntries.end() &&
+            std::string_view(data + entry->m_nameOffset,
+                             entry->m_nameLength) == name)
+            return std::make_unique<utility::BinaryStream>(
+                m_pack, static_cast<size_t>(entry->m_offset),
+                static_cast<size_t>(entry->m_size));
+    }
+
+    return std::make_unique<utility::BinaryStream>(fs::path(bvh_path));
 }
 
 std::string BVH::GetBVHPath(const std::string& mpq_path) const
@@ -1,9 +1,15 @@
 #pragma once
 
+#include "Common.hpp"
+#include "utility/BinaryStream.hpp"
+#include "utility/MappedFile.hpp"
+
 #include <cstdint>
 #include <filesystem>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -20,9 +26,19 @@ private:
     // map gameobject display id to .bvh path
     std::unordered_map<int, std::string> m_temporaryObstacles;
 
+    // the pack of every .bvh file, when MapBuilder was asked to make one,
+    // and its table of files, sorted by name
+    std::shared_ptr<utility::MappedFile> m_pack;
+    std::vector<BVHPackEntry> m_packEntries;
+
 public:
     BVH(const fs::path& path);
 
+    // the contents of a .bvh file, as returned by GetBVHPath().  those in the
+    // pack are read from its mapping rather than from a file of their own
+    std::unique_ptr<utility::BinaryStream>
+    Open(const std::string& bvh_path) const;
+
     std::string GetBVHPath(const std::string& mpq_path) const;
     std::string GetBVHPath(std::uint32_t entry) const;
 
@@ -0,0 +1,174 @@
+#include "Crowd.hpp"
+
+#include "Common.hpp"
+#include "Map.hpp"
+#include "recastnavigation/Detour/Include/DetourCommon.h"
+#include "recastnavigation/DetourCrowd/Include/DetourCrowd.h"
+#include "utility/Exception.hpp"
+#include "utility/MathHelper.hpp"
+
+#include <mutex>
+#include <shared_mutex>
+
+namespace pathfind
+{
+Crowd::Crowd(const Map& map, dtNavMesh& navMesh, int maxAgents,
+             float maxAgentRadius, const dtQueryFilter& queryFilter)
+    : m_map(map), m_crowd(dtAllocCrowd()),
+      m_meshGeneration(map.m_meshGeneration)
+{
+    if (!m_crowd || !m_crowd->init(maxAgents, maxAgentRadius, &navMesh))
+        THROW(Result::DTCROWD_INIT_FAILED);
+
+    // every agent uses the first filter
+    *m_crowd->getEditableFilter(0) = queryFilter;
+}
+
+int Crowd::AddAgent(const math::Vertex& position, float radius, float speed)
+{
+    Map::ResidencyPins pins(m_map);
+
+    m_map.EnsureResident(position.X, position.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    dtCrowdAgentParams params {};
+    params.radius = radius;
+    params.height = m_map.GetAgentProfile().m_walkableHeight;
+    params.maxSpeed = speed;
+    params.maxAcceleration = 8.f * speed;
+    params.collisionQueryRange = 12.f * radius;
+    params.pathOptimizationRange = 30.f * radius;
+    params.separationWeight = 2.f;
+    params.updateFlags = DT_CROWD_ANTICIPATE_TURNS |
+                         DT_CROWD_OBSTACLE_AVOIDANCE | DT_CROWD_SEPARATION |
+                         DT_CROWD_OPTIMIZE_VIS | DT_CROWD_OPTIMIZE_TOPO;
+
+    // the highest quality of the avoidance settings which dtCrowd::init()
+    // sets up
+    params.obstacleAvoidanceType = 3;
+    params.queryFilterType = 0;
+
+    float recastPosition[3];
+    math::Convert::VertexToRecast(position, recastPosition);
+
+    return m_crowd->addAgent(recastPosition, &params);
+}
+
+void Crowd::RemoveAgent(int agent)
+{
+    m_crowd->removeAgent(agent);
+}
+
+bool Crowd::SetTarget(int agent, const math::Vertex& target)
+{
+    Map::ResidencyPins pins(m_map);
+
+    m_map.EnsureResident(target.X, target.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    float recastTarget[3];
+    math::Convert::VertexToRecast(target, recastTarget);
+
+    dtPolyRef targetPolyRef;
+    float nearest[3];
+    if (!(m_crowd->getNavMeshQuery()->findNearestPoly(
+              recastTarget, m_crowd->getQueryExtents(),
+              m_crowd->getFilter(0), &targetPolyRef, nearest) &
+          DT_SUCCESS) ||
+        !targetPolyRef)
+        return false;
+
+    return m_crowd->requestMoveTarget(agent, targetPolyRef, nearest);
+}
+
+bool Crowd::ResetTarget(int agent)
+{
+    return m_crowd->resetMoveTarget(agent);
+}
+
+void Crowd::Update(float seconds)
+{
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    if (m_meshGeneration != m_map.m_meshGeneration)
+    {
+        ReplanRebuiltAgents();
+        m_meshGeneration = m_map.m_meshGeneration;
+    }
+
+    m_crowd->update(seconds, nullptr);
+}
+
+void Crowd::ReplanRebuiltAgents()
+{
+    auto const& navQuery = *m_crowd->getNavMeshQuery();
+    auto const filter = m_crowd->getFilter(0);
+    auto const extents = m_crowd->getQueryExtents();
+
+    for (auto i = 0; i < m_crowd->getAgentCount(); ++i)
+    {
+        auto const agent = m_crowd->getEditableAgent(i);
+
+        if (!agent->active ||
+            !m_map.MeshReplacedSince(m_meshGeneration,
+                                     agent->corridor.getPath(),
+                                     agent->corridor.getPathCount()))
+            continue;
+
+        // as detour does for an agent whose polygon has become invalid
+        dtPolyRef polyRef = 0;
+        float nearest[3];
+        navQuery.findNearestPoly(agent->npos, extents, filter, &polyRef,
+                                 nearest);
+
+        if (!polyRef)
+        {
+            agent->corridor.reset(0, agent->npos);
+            agent->state = DT_CROWDAGENT_STATE_INVALID;
+            continue;
+        }
+
+        agent->corridor.reset(polyRef, nearest);
+        dtVcopy(agent->npos, nearest);
+
+        // agents steered by velocity, or without a target, have no path
+        if (agent->targetState == DT_CROWDAGENT_TARGET_NONE ||
+            agent->targetState == DT_CROWDAGENT_TARGET_VELOCITY)
+            continue;
+
+        dtPolyRef targetRef = 0;
+        float target[3];
+        navQuery.findNearestPoly(agent->targetPos, extents, filter,
+                                 &targetRef, target);
+
+        if (targetRef)
+            m_crowd->requestMoveTarget(i, targetRef, target);
+        else
+            m_crowd->resetMoveTarget(i);
+    }
+}
+
+bool Crowd::GetAgentPosition(int agent, math::Vertex& position) const
+{
+    auto const crowdAgent = m_crowd->getAgent(agent);
+
+    if (!crowdAgent || !crowdAgent->active)
+        return false;
+
+    math::Convert::VertexToWow(crowdAgent->npos, position);
+    return true;
+}
+
+bool Crowd::GetAgentVelocity(int agent, math::Vertex& velocity) const
+{
+    auto const crowdAgent = m_crowd->getAgent(agent);
+
+    if (!crowdAgent || !crowdAgent->active)
+        return false;
+
+    math::Convert::VertexToWow(crowdAgent->vel, velocity);
+    return true;
+}
+} // namespace pathfind
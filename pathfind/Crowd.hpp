@@ -0,0 +1,82 @@
+#pragma once
+
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "recastnavigation/DetourCrowd/Include/DetourCrowd.h"
+#include "utility/Vector.hpp"
+
+#include <cstdint>
+#include <memory>
+
+namespace pathfind
+{
+class Map;
+
+// local steering for a group of agents, such as a pack of mobs chasing the
+// same player.  each agent follows a corridor to its target as PathCorridor
+// does, while detour's crowd keeps the agents apart from one another and
+// smooths their velocities.  the positions it produces are only suggestions
+// for where each agent should be after an update, which the caller is free
+// to use or ignore.
+//
+// detour replans an agent whose corridor holds polygons which are no longer
+// valid, but those of a tile rebuilt beneath temporary obstacles keep their
+// references and so still appear valid.  the crowd therefore remembers the
+// mesh generation of the map, and replans the agents crossing a tile rebuilt
+// since then at the next update.
+//
+// a crowd must not outlive the map which created it, nor be used from several
+// threads at once.  its agents do not cause ADTs to be loaded when a
+// residency budget is set, beyond those loaded where they are added and
+// where their targets are set.
+class Crowd
+{
+    friend class Map;
+
+private:
+    struct Deleter
+    {
+        void operator()(dtCrowd* crowd) const { dtFreeCrowd(crowd); }
+    };
+
+    const Map& m_map;
+    std::unique_ptr<dtCrowd, Deleter> m_crowd;
+
+    // Map::m_meshGeneration as of the last update
+    std::uint64_t m_meshGeneration;
+
+    // moves each agent whose corridor crosses a tile rebuilt since the last
+    // update back onto the navmesh, and requests its target again, so that
+    // its path is searched anew.  the caller must hold the map's mutex
+    void ReplanRebuiltAgents();
+
+    // the caller must hold the map's mutex
+    Crowd(const Map& map, dtNavMesh& navMesh, int maxAgents,
+          float maxAgentRadius, const dtQueryFilter& queryFilter);
+
+public:
+    Crowd(const Crowd&) = delete;
+    Crowd& operator=(const Crowd&) = delete;
+
+    // adds an agent at the nearest point of the navmesh to position, which
+    // moves at no more than speed yards per second.  radius may not exceed
+    // that which the crowd was created with.  returns the index of the agent,
+    // or -1 when the crowd is full or no polygon is near position
+    int AddAgent(const math::Vertex& position, float radius, float speed);
+
+    void RemoveAgent(int agent);
+
+    // the agent will steer towards target from the next update.  returns
+    // false when no polygon is near target
+    bool SetTarget(int agent, const math::Vertex& target);
+
+    // the agent will stop where it is from the next update
+    bool ResetTarget(int agent);
+
+    // moves every agent with a target up to seconds further along its route
+    void Update(float seconds);
+
+    // both return false when the index does not refer to an agent
+    bool GetAgentPosition(int agent, math::Vertex& position) const;
+    bool GetAgentVelocity(int agent, math::Vertex& velocity) const;
+};
+} // namespace pathfind
@@ -0,0 +1,196 @@
+#include "GameObjectFile.hpp"
+
+#include "Common.hpp"
+#include "utility/Exception.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace pathfind
+{
+namespace
+{
+constexpr std::uint32_t SpawnFileVersion = 1;
+
+struct SpawnFileHeader
+{
+    std::uint32_t m_signature;
+    std::uint32_t m_version;
+    std::uint32_t m_count;
+};
+
+// parses the field at the cursor, which must be followed by the separator,
+// and moves past both
+template <typename T, typename Parse>
+T ParseField(const char*& cursor, char separator, Parse parse)
+{
+    char* end;
+    errno = 0;
+
+    auto const result = parse(cursor, &end);
+
+    if (end == cursor || errno == ERANGE)
+        THROW(Result::BAD_FORMAT_OF_GAMEOBJECT_FILE);
+
+    while (*end == ' ' || *end == '\t')
+        ++end;
+
+    if (*end != separator)
+        THROW(Result::BAD_FORMAT_OF_GAMEOBJECT_FILE);
+
+    cursor = end + 1;
+
+    return static_cast<T>(result);
+}
+
+std::uint64_t ParseInteger(const char*& cursor, char separator)
+{
+    return ParseField<std::uint64_t>(
+        cursor, separator,
+        [](const char* s, char** end) { return std::strtoull(s, end, 10); });
+}
+
+float ParseFloat(const char*& cursor, char separator)
+{
+    return ParseField<float>(cursor, separator, [](const char* s, char** end)
+                             { return std::strtof(s, end); });
+}
+} // namespace
+
+GameObjectFile::GameObjectFile(const std::filesystem::path& path)
+{
+    try
+    {
+        m_file = std::make_shared<utility::MappedFile>(path);
+    }
+    catch (const utility::exception&)
+    {
+        THROW(Result::FAILED_TO_OPEN_GAMEOBJECT_FILE).ErrorCode();
+    }
+
+    SpawnFileHeader header;
+
+    if (m_file->size() < sizeof(header))
+        THROW(Result::BAD_FORMAT_OF_GAMEOBJECT_FILE);
+
+    std::memcpy(&header, m_file->data(), sizeof(header));
+
+    if (header.m_signature != MeshSettings::FileGameObjects ||
+        header.m_version != SpawnFileVersion ||
+        m_file->size() !=
+            sizeof(header) + header.m_count * sizeof(GameObjectSpawn))
+        THROW(Result::BAD_FORMAT_OF_GAMEOBJECT_FILE);
+
+    m_spawns = {reinterpret_cast<const GameObjectSpawn*>(m_file->data() +
+                                                         sizeof(header)),
+                header.m_count};
+}
+
+utility::ArrayView<GameObjectSpawn>
+GameObjectFile::MapSpawns(std::uint32_t map) const
+{
+    auto const first =
+        std::lower_bound(m_spawns.begin(), m_spawns.end(), map,
+                         [](const GameObjectSpawn& spawn, std::uint32_t map)
+                         { return spawn.m_map < map; });
+    auto const last =
+        std::upper_bound(first, m_spawns.end(), map,
+                         [](std::uint32_t map, const GameObjectSpawn& spawn)
+                         { return map < spawn.m_map; });
+
+    return {first, static_cast<size_t>(last - first)};
+}
+
+bool GameObjectFile::IsSpawnFile(const std::filesystem::path& path)
+{
+    std::ifstream in(path, std::ios::binary);
+
+    std::uint32_t signature = 0;
+    in.read(reinterpret_cast<char*>(&signature), sizeof(signature));
+
+    return !!in && signature == MeshSettings::FileGameObjects;
+}
+
+void GameObjectFile::ReadCSV(const std::filesystem::path& path,
+                             std::vector<GameObjectSpawn>& spawns)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+
+    if (!in)
+        THROW(Result::FAILED_TO_OPEN_GAMEOBJECT_FILE).ErrorCode();
+
+    // the contents end with a newline, so that every row ends with one
+    std::string contents(static_cast<size_t>(in.tellg()), '\0');
+    in.seekg(0);
+    in.read(&contents[0], contents.size());
+    contents.push_back('\n');
+
+    // carriage returns are treated as spaces, which the parsers skip
+    std::replace(contents.begin(), contents.end(), '\r', ' ');
+
+    spawns.clear();
+    spawns.reserve(std::count(contents.begin(), contents.end(), '\n'));
+
+    const char* cursor = contents.c_str();
+    auto const end = cursor + contents.size();
+
+    while (cursor < end)
+    {
+        // skip blank lines
+        if (*cursor == '\n' || *cursor == ' ' || *cursor == '\t')
+        {
+            ++cursor;
+            continue;
+        }
+
+        GameObjectSpawn spawn;
+
+        spawn.m_guid = ParseInteger(cursor, ',');
+        spawn.m_displayId =
+            static_cast<std::uint32_t>(ParseInteger(cursor, ','));
+        spawn.m_map = static_cast<std::uint32_t>(ParseInteger(cursor, ','));
+
+        for (auto& coordinate : spawn.m_position)
+            coordinate = ParseFloat(cursor, ',');
+
+        for (auto i = 0; i < 4; ++i)
+            spawn.m_rotation[i] = ParseFloat(cursor, i < 3 ? ',' : '\n');
+
+        spawns.push_back(spawn);
+    }
+}
+
+void GameObjectFile::Write(const std::filesystem::path& path,
+                           std::vector<GameObjectSpawn> spawns)
+{
+    std::sort(spawns.begin(), spawns.end(),
+              [](const GameObjectSpawn& a, const GameObjectSpawn& b)
+              {
+                  return a.m_map != b.m_map ? a.m_map < b.m_map
+                                            : a.m_guid < b.m_guid;
+              });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+
+    if (!out)
+        THROW(Result::FAILED_TO_OPEN_GAMEOBJECT_FILE).ErrorCode();
+
+    SpawnFileHeader const header {MeshSettings::FileGameObjects,
+                                  SpawnFileVersion,
+                                  static_cast<std::uint32_t>(spawns.size())};
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(spawns.data()),
+              static_cast<std::streamsize>(spawns.size() *
+                                           sizeof(GameObjectSpawn)));
+
+    if (!out)
+        THROW(Result::FAILED_TO_OPEN_GAMEOBJECT_FILE).ErrorCode();
+}
+} // namespace pathfind
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Common.hpp"
+#include "utility/ArrayView.hpp"
+#include "utility/MappedFile.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace pathfind
+{
+// the game object spawns of a realm, converted once from CSV into a binary
+// file (see MeshSettings::FileGameObjects) which is mapped rather than parsed
+// whenever a server starts.  the spawns of each map are contiguous, so that
+// those of one map can be given to Map::AddGameObjects() without copying
+class GameObjectFile
+{
+private:
+    std::shared_ptr<utility::MappedFile> m_file;
+    utility::ArrayView<GameObjectSpawn> m_spawns;
+
+public:
+    explicit GameObjectFile(const std::filesystem::path& path);
+
+    utility::ArrayView<GameObjectSpawn> Spawns() const { return m_spawns; }
+    utility::ArrayView<GameObjectSpawn> MapSpawns(std::uint32_t map) const;
+
+    // whether the file begins as a spawn file does, rather than being CSV
+    static bool IsSpawnFile(const std::filesystem::path& path);
+
+    // reads the rows of a CSV file, each of the fields of a GameObjectSpawn
+    // separated by commas.  the whole file is read at once and its fields
+    // parsed in place, rather than split into strings
+    static void ReadCSV(const std::filesystem::path& path,
+                        std::vector<GameObjectSpawn>& spawns);
+
+    // sorts the spawns by map and guid and writes them to a spawn file
+    static void Write(const std::filesystem::path& path,
+                      std::vector<GameObjectSpawn> spawns);
+};
+} // namespace pathfind
@@ -0,0 +1,83 @@
+#include "InstanceTree.hpp"
+
+#include "utility/BoundingBox.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace pathfind
+{
+template <typename Instance>
+void BoundsTree<Instance>::Build(std::vector<Instance> instances)
+{
+    m_instances = std::move(instances);
+    m_nodes.clear();
+
+    if (m_instances.empty())
+        return;
+
+    // a balanced binary tree with leaves of up to LeafSize has fewer than
+    // twice as many nodes as leaves
+    m_nodes.reserve(2 * (m_instances.size() / LeafSize + 1));
+
+    BuildRecursive(0, static_cast<std::uint32_t>(m_instances.size()));
+}
+
+template <typename Instance>
+size_t BoundsTree<Instance>::MemoryUsage() const
+{
+    return sizeof(Instance) * m_instances.capacity() +
+           sizeof(Node) * m_nodes.capacity();
+}
+
+template <typename Instance>
+void BoundsTree<Instance>::BuildRecursive(std::uint32_t begin, std::uint32_t end)
+{
+    auto const index = static_cast<std::uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    auto bounds = m_instances[begin].m_bounds;
+    for (auto i = begin + 1; i < end; ++i)
+        bounds.connectWith(m_instances[i].m_bounds);
+
+    m_nodes[index].m_bounds = bounds;
+
+    if (end - begin <= LeafSize)
+    {
+        m_nodes[index].m_first = begin;
+        m_nodes[index].m_count = end - begin;
+        return;
+    }
+
+    // split at the median centre along the longest axis of the bounds
+    auto const extent = bounds.getVector();
+    auto const axis = extent.X >= extent.Y && extent.X >= extent.Z ? 0
+                      : extent.Y >= extent.Z                        ? 1
+                                                                    : 2;
+
+    auto const middle = begin + (end - begin) / 2;
+
+    std::nth_element(m_instances.begin() + begin,
+                     m_instances.begin() + middle, m_instances.begin() + end,
+                     [axis](const Instance& a, const Instance& b)
+                     {
+                         return a.m_bounds.MinCorner[axis] +
+                                    a.m_bounds.MaxCorner[axis] <
+                                b.m_bounds.MinCorner[axis] +
+                                    b.m_bounds.MaxCorner[axis];
+                     });
+
+    BuildRecursive(begin, middle);
+
+    // m_nodes may have grown, so take no reference across the recursion
+    m_nodes[index].m_first = static_cast<std::uint32_t>(m_nodes.size());
+    m_nodes[index].m_count = 0;
+
+    BuildRecursive(middle, end);
+}
+
+template class BoundsTree<StaticInstance>;
+template class BoundsTree<InstanceBounds>;
+} // namespace pathfind
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "Model.hpp"
+#include "utility/BoundingBox.hpp"
+#include "utility/Matrix.hpp"
+#include "utility/Ray.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace pathfind
+{
+// everything a ray needs from a static instance, copied out of the map's
+// instance tables so that ray casts need no hash lookups.  the model is kept
+// alive by the tile which owns this
+struct StaticInstance
+{
+    math::BoundingBox m_bounds;
+    math::Matrix m_inverseTransformMatrix;
+    const Model* m_model;
+
+    // only set for wmos, for the area and zone lookup
+    const WmoModel* m_wmoModel;
+    unsigned int m_nameSet;
+
+    std::uint32_t m_index; // see QueryContext::m_staticWmoStamps
+};
+
+// only the bounds of a static instance, for finding instances near a point
+// without their models.  m_index is the position of the instance within the
+// map's table of them
+struct InstanceBounds
+{
+    math::BoundingBox m_bounds;
+    std::uint32_t m_index;
+};
+
+// a small bvh over the bounds of instances, either those of one tile, which
+// references tens to hundreds of instances, or those of a whole map.  a
+// binary tree of boxes built by median split is plenty for either
+template <typename Instance>
+class BoundsTree
+{
+private:
+    struct Node
+    {
+        math::BoundingBox m_bounds;
+
+        // for leaves, the first instance and the number of them.  for inner
+        // nodes, m_count is zero, the left child follows this node and
+        // m_first is the right child
+        std::uint32_t m_first;
+        std::uint32_t m_count;
+    };
+
+    static constexpr std::uint32_t LeafSize = 2;
+
+    // the tree is balanced, so a full stack would need more instances than
+    // can be addressed
+    static constexpr int MaxDepth = 64;
+
+    std::vector<Instance> m_instances;
+    std::vector<Node> m_nodes;
+
+    void BuildRecursive(std::uint32_t begin, std::uint32_t end);
+
+public:
+    // reorders the instances as it builds
+    void Build(std::vector<Instance> instances);
+
+    bool Empty() const { return m_instances.empty(); }
+    size_t Size() const { return m_instances.size(); }
+
+    // the bytes held by the instances and the nodes
+    size_t MemoryUsage() const;
+
+    // calls visit(instance) for each instance whose bounds the ray crosses,
+    // stopping as soon as visit() returns true.  returns whether it did
+    template <typename Visitor>
+    bool Intersect(const math::Ray& ray, Visitor&& visit) const
+    {
+        if (m_nodes.empty())
+            return false;
+
+        std::uint32_t stack[MaxDepth];
+        int top = 0;
+
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            auto node = stack[--top];
+
+            for (;;)
+            {
+                auto const& n = m_nodes[node];
+
+                if (!ray.IntersectBoundingBox(n.m_bounds))
+                    break;
+
+                if (n.m_count > 0)
+                {
+                    for (auto i = n.m_first; i < n.m_first + n.m_count; ++i)
+                    {
+                        auto const& instance = m_instances[i];
+
+                        if (ray.IntersectBoundingBox(instance.m_bounds) &&
+                            visit(instance))
+                            return true;
+                    }
+                    break;
+                }
+
+                stack[top++] = n.m_first;
+                node = node + 1;
+            }
+        }
+
+        return false;
+    }
+
+    // calls visit(instance) for each instance whose bounds overlap the box
+    template <typename Visitor>
+    void Overlap(const math::BoundingBox& bounds, Visitor&& visit) const
+    {
+        if (m_nodes.empty())
+            return;
+
+        std::uint32_t stack[MaxDepth];
+        int top = 0;
+
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            auto node = stack[--top];
+
+            for (;;)
+            {
+                auto const& n = m_nodes[node];
+
+                if (!bounds.intersect(n.m_bounds))
+                    break;
+
+                if (n.m_count > 0)
+                {
+                    for (auto i = n.m_first; i < n.m_first + n.m_count; ++i)
+                        if (bounds.intersect(m_instances[i].m_bounds))
+                            visit(m_instances[i]);
+                    break;
+                }
+
+                stack[top++] = n.m_first;
+                node = node + 1;
+            }
+        }
+    }
+};
+
+using InstanceTree = BoundsTree<StaticInstance>;
+using InstanceBoundsTree = BoundsTree<InstanceBounds>;
+} // namespace pathfind
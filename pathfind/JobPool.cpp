@@ -0,0 +1,228 @@
+#include "JobPool.hpp"
+
+#include "Map.hpp"
+#include "utility/Exception.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace pathfind
+{
+JobPool::JobPool(unsigned int threads) : m_nextId(1), m_stop(false)
+{
+    threads = (std::max)(threads, 1u);
+
+    m_threads.reserve(threads);
+    for (auto i = 0u; i < threads; ++i)
+        m_threads.emplace_back(&JobPool::Work, this);
+}
+
+JobPool::~JobPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stop = true;
+    }
+
+    // searches already started are finished, and those still queued are
+    // abandoned, as are the helpers of batches which have already finished
+    m_submitted.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void JobPool::Batch::Drain()
+{
+    for (auto task = m_next++; task < m_tasks; task = m_next++)
+    {
+        std::exception_ptr error;
+
+        try
+        {
+            (*m_work)(task);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        bool done;
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            if (error && !m_error)
+                m_error = error;
+
+            done = ++m_finished == m_tasks;
+        }
+
+        if (done)
+            m_done.notify_all();
+    }
+}
+
+void JobPool::Work()
+{
+    for (;;)
+    {
+        JobId id;
+        Job* job;
+
+        {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            m_submitted.wait(guard, [this]() {
+                return m_stop || !m_queue.empty() || !m_batches.empty();
+            });
+
+            if (m_stop)
+                return;
+
+            if (!m_batches.empty())
+            {
+                auto const batch = std::move(m_batches.front());
+                m_batches.pop_front();
+
+                guard.unlock();
+                batch->Drain();
+                continue;
+            }
+
+            id = m_queue.front();
+            m_queue.pop_front();
+
+            // the job cannot be taken until it has finished, so it stays put
+            job = &m_jobs.at(id);
+        }
+
+        PathResult result {false, Result::SUCCESS, {}};
+
+        try
+        {
+            result.m_found =
+                job->m_map->FindPath(job->m_start, job->m_end, result.m_path,
+                                     job->m_allowPartial, job->m_filter);
+        }
+        catch (const utility::exception& e)
+        {
+            result.m_error = e.ResultCode();
+        }
+        catch (...)
+        {
+            result.m_error = Result::UNKNOWN_EXCEPTION;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            job->m_result = std::move(result);
+            job->m_finished = true;
+        }
+
+        m_finished.notify_all();
+    }
+}
+
+JobPool::JobId JobPool::SubmitPath(const Map& map, const math::Vertex& start,
+                                   const math::Vertex& end, bool allowPartial,
+                                   const std::string& filter)
+{
+    JobId id;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        id = m_nextId++;
+        m_jobs.emplace(id, Job {&map, start, end, allowPartial, filter, false,
+                                {false, Result::SUCCESS, {}}});
+        m_queue.push_back(id);
+    }
+
+    m_submitted.notify_one();
+
+    return id;
+}
+
+JobPool::Status JobPool::Take(JobId job, const Taker& take)
+{
+    auto const i = m_jobs.find(job);
+
+    if (i == m_jobs.end())
+        return Status::Unknown;
+
+    if (!i->second.m_finished)
+        return Status::InProgress;
+
+    if (take(i->second.m_result))
+        m_jobs.erase(i);
+
+    return Status::Finished;
+}
+
+JobPool::Status JobPool::Poll(JobId job, const Taker& take)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return Take(job, take);
+}
+
+JobPool::Status JobPool::Wait(JobId job, const Taker& take)
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+
+    m_finished.wait(guard, [this, job]() {
+        auto const i = m_jobs.find(job);
+        return i == m_jobs.end() || i->second.m_finished;
+    });
+
+    return Take(job, take);
+}
+
+std::vector<std::thread::id> JobPool::GetThreadIds() const
+{
+    std::vector<std::thread::id> result;
+    result.reserve(m_threads.size());
+
+    for (auto const& thread : m_threads)
+        result.push_back(thread.get_id());
+
+    return result;
+}
+
+void JobPool::RunBatch(unsigned int tasks,
+                       const std::function<void(unsigned int)>& work)
+{
+    if (!tasks)
+        return;
+
+    auto const batch = std::make_shared<Batch>();
+    batch->m_work = &work;
+    batch->m_tasks = tasks;
+    batch->m_next = 0;
+    batch->m_finished = 0;
+
+    // the calling thread takes part, so one helper fewer than there are
+    // tasks is enough
+    auto const helpers = (std::min)(
+        tasks - 1, static_cast<unsigned int>(m_threads.size()));
+
+    if (helpers)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            for (auto i = 0u; i < helpers; ++i)
+                m_batches.push_back(batch);
+        }
+
+        m_submitted.notify_all();
+    }
+
+    batch->Drain();
+
+    std::unique_lock<std::mutex> guard(batch->m_mutex);
+    batch->m_done.wait(guard, [&batch]()
+                       { return batch->m_finished == batch->m_tasks; });
+
+    if (batch->m_error)
+        std::rethrow_exception(batch->m_error);
+}
+} // namespace pathfind
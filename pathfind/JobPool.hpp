@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Common.hpp"
+#include "utility/Vector.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace pathfind
+{
+class Map;
+
+// path searches run by a pool of worker threads, for callers which cannot
+// easily keep threads of their own, such as those of the C API.  a job is
+// submitted and later polled or waited for by its id, so that many searches
+// may be in flight at once without the caller blocking on any of them.  one
+// pool may serve several maps.  a pool also runs the batches of Map, whose
+// queries are divided between the pool's threads and the caller's.
+//
+// a map must outlive every job submitted for it.  the result of a finished
+// job is kept until it is taken, so every job should eventually be polled or
+// waited for.
+class JobPool
+{
+public:
+    using JobId = std::uint64_t;
+
+    enum class Status : std::uint8_t
+    {
+        // no job has this id, or its result has already been taken
+        Unknown = 0,
+        InProgress = 1,
+        Finished = 2,
+    };
+
+    struct PathResult
+    {
+        bool m_found;
+
+        // the code of the exception thrown by the search, if any
+        Result m_error;
+
+        std::vector<math::Vertex> m_path;
+    };
+
+    // returns true to take the result, after which the job is forgotten
+    using Taker = std::function<bool(const PathResult&)>;
+
+private:
+    struct Job
+    {
+        const Map* m_map;
+        math::Vertex m_start;
+        math::Vertex m_end;
+        bool m_allowPartial;
+        std::string m_filter;
+
+        bool m_finished;
+        PathResult m_result;
+    };
+
+    // the tasks of a batch are claimed by index, by the caller and by any
+    // helpers which the pool's threads pick up before the batch runs out.  a
+    // helper picked up later finds nothing left to claim and never touches
+    // the work, which belongs to the caller
+    struct Batch
+    {
+        const std::function<void(unsigned int)>* m_work;
+        unsigned int m_tasks;
+
+        std::atomic<unsigned int> m_next;
+
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+        unsigned int m_finished;
+        std::exception_ptr m_error;
+
+        void Drain();
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_submitted;
+    std::condition_variable m_finished;
+
+    JobId m_nextId;
+    std::unordered_map<JobId, Job> m_jobs;
+    std::deque<JobId> m_queue;
+    std::deque<std::shared_ptr<Batch>> m_batches;
+
+    bool m_stop;
+    std::vector<std::thread> m_threads;
+
+    void Work();
+
+    // the caller must hold m_mutex
+    Status Take(JobId job, const Taker& take);
+
+public:
+    explicit JobPool(unsigned int threads);
+    ~JobPool();
+
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    JobId SubmitPath(const Map& map, const math::Vertex& start,
+                     const math::Vertex& end, bool allowPartial = false,
+                     const std::string& filter = {});
+
+    // passes the result of the job to take if it has finished, and returns
+    // the status of the job as it was before then
+    Status Poll(JobId job, const Taker& take);
+
+    // as above, but waits for the job to finish first
+    Status Wait(JobId job, const Taker& take);
+
+    // calls work with every index below tasks, on as many of the pool's
+    // threads as are free and on the calling thread, and returns once all
+    // have returned.  batches are run ahead of queued path jobs.  the first
+    // exception thrown by a task is rethrown here, once the others finish
+    void RunBatch(unsigned int tasks,
+                  const std::function<void(unsigned int)>& work);
+
+    std::vector<std::thread::id> GetThreadIds() const;
+};
+} // namespace pathfind
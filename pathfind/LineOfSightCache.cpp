@@ -0,0 +1,139 @@
+#include "LineOfSightCache.hpp"
+
+#include "utility/Vector.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+namespace pathfind
+{
+std::int32_t LineOfSightCache::Round(float coordinate) const
+{
+    return static_cast<std::int32_t>(std::floor(coordinate / m_spacing));
+}
+
+void LineOfSightCache::Configure(size_t capacity,
+                                 std::chrono::milliseconds timeToLive,
+                                 float spacing)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    // entries were keyed by the old grid
+    m_entries.clear();
+    m_index.clear();
+
+    m_capacity = capacity;
+    m_timeToLive = timeToLive;
+    m_spacing = spacing > 0.f ? spacing : 1.f;
+}
+
+bool LineOfSightCache::Enabled() const
+{
+    return m_capacity > 0;
+}
+
+LineOfSightCache::Key LineOfSightCache::MakeKey(const math::Vertex& start,
+                                                const math::Vertex& stop,
+                                                bool doodads) const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    return {{Round(start.X), Round(start.Y), Round(start.Z)},
+            {Round(stop.X), Round(stop.Y), Round(stop.Z)},
+            doodads};
+}
+
+bool LineOfSightCache::Find(const Key& key, bool& result)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto const i = m_index.find(key);
+
+    if (i == m_index.end())
+    {
+        ++m_misses;
+        return false;
+    }
+
+    if (Clock::now() >= i->second->m_expiry)
+    {
+        m_entries.erase(i->second);
+        m_index.erase(i);
+        ++m_expirations;
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+
+    // move the entry to the front of the list
+    m_entries.splice(m_entries.begin(), m_entries, i->second);
+
+    result = i->second->m_result;
+
+    return true;
+}
+
+void LineOfSightCache::Insert(const Key& key, bool result, int startTileX,
+                              int startTileY, int stopTileX, int stopTileY)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (!m_capacity || m_index.find(key) != m_index.end())
+        return;
+
+    if (m_entries.size() >= m_capacity)
+    {
+        m_index.erase(m_entries.back().m_key);
+        m_entries.pop_back();
+    }
+
+    m_entries.push_front({key, result, Clock::now() + m_timeToLive,
+                          (std::min)(startTileX, stopTileX),
+                          (std::min)(startTileY, stopTileY),
+                          (std::max)(startTileX, stopTileX),
+                          (std::max)(startTileY, stopTileY)});
+    m_index[key] = m_entries.begin();
+}
+
+void LineOfSightCache::InvalidateTile(int tileX, int tileY)
+{
+    if (!Enabled())
+        return;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    for (auto i = m_entries.begin(); i != m_entries.end();)
+    {
+        if (tileX < i->m_minTileX || tileX > i->m_maxTileX ||
+            tileY < i->m_minTileY || tileY > i->m_maxTileY)
+        {
+            ++i;
+            continue;
+        }
+
+        m_index.erase(i->m_key);
+        i = m_entries.erase(i);
+        ++m_invalidations;
+    }
+}
+
+void LineOfSightCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_entries.clear();
+    m_index.clear();
+}
+
+LineOfSightCache::Stats LineOfSightCache::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    return {m_capacity.load(), m_entries.size(), m_hits,
+            m_misses, m_expirations, m_invalidations};
+}
+} // namespace pathfind
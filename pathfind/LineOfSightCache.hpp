@@ -0,0 +1,139 @@
+#pragma once
+
+#include "utility/Vector.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace pathfind
+{
+// a bounded, least recently used cache of line of sight results, keyed by the
+// ends of the ray, each rounded to a grid of the given spacing, and whether
+// doodads were considered.  an area effect checks line of sight from one
+// caster to every target nearby, and a fight asks the same of the same pairs
+// many times a second, most of them having barely moved.  results are kept
+// only briefly, so that the rounding never outlives the fight, and are
+// removed before then when any tile between the ends is loaded, unloaded or
+// has its temporary obstacles changed.
+//
+// the cache is used by concurrent queries, so it has its own mutex
+class LineOfSightCache
+{
+public:
+    struct Key
+    {
+        std::int32_t m_start[3];
+        std::int32_t m_stop[3];
+        bool m_doodads;
+
+        bool operator==(const Key& other) const
+        {
+            for (auto i = 0; i < 3; ++i)
+                if (m_start[i] != other.m_start[i] ||
+                    m_stop[i] != other.m_stop[i])
+                    return false;
+
+            return m_doodads == other.m_doodads;
+        }
+    };
+
+    struct Stats
+    {
+        size_t m_capacity;
+        size_t m_entries;
+        std::uint64_t m_hits;
+        std::uint64_t m_misses;
+
+        // entries found older than the time to live, and removed
+        std::uint64_t m_expirations;
+
+        // entries removed because a tile between their ends changed
+        std::uint64_t m_invalidations;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t hash = key.m_doodads;
+
+            for (auto i = 0; i < 3; ++i)
+            {
+                hash ^= std::hash<std::int32_t>()(key.m_start[i]) +
+                        0x9e3779b9 + (hash << 6) + (hash >> 2);
+                hash ^= std::hash<std::int32_t>()(key.m_stop[i]) +
+                        0x9e3779b9 + (hash << 6) + (hash >> 2);
+            }
+
+            return hash;
+        }
+    };
+
+    struct Entry
+    {
+        Key m_key;
+        bool m_result;
+        Clock::time_point m_expiry;
+
+        // the tiles from the one holding the start to the one holding the
+        // stop, both inclusive.  a tile within this rectangle but off the ray
+        // only costs an entry which might have been kept
+        int m_minTileX;
+        int m_minTileY;
+        int m_maxTileX;
+        int m_maxTileY;
+    };
+
+    mutable std::mutex m_mutex;
+
+    // checked by every query before taking the mutex
+    std::atomic<size_t> m_capacity {0};
+
+    Clock::duration m_timeToLive {0};
+    float m_spacing = 1.f;
+
+    // most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+    std::uint64_t m_expirations = 0;
+    std::uint64_t m_invalidations = 0;
+
+    std::int32_t Round(float coordinate) const;
+
+public:
+    // a capacity of zero, the default, disables the cache.  results are kept
+    // for no more than timeToLive, and the ends of rays are rounded to a grid
+    // spacing yards apart
+    void Configure(size_t capacity, std::chrono::milliseconds timeToLive,
+                   float spacing);
+
+    bool Enabled() const;
+
+    Key MakeKey(const math::Vertex& start, const math::Vertex& stop,
+                bool doodads) const;
+
+    bool Find(const Key& key, bool& result);
+
+    // the tiles are those holding the start and the stop of the ray
+    void Insert(const Key& key, bool result, int startTileX, int startTileY,
+                int stopTileX, int stopTileY);
+
+    // removes every entry whose ray may pass through the given tile
+    void InvalidateTile(int tileX, int tileY);
+
+    void Clear();
+
+    Stats GetStats() const;
+};
+} // namespace pathfind
@@ -7,22 +7,30 @@
 #include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
 #include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
+#include "utility/MappedFile.hpp"
 #include "utility/MathHelper.hpp"
 #include "utility/Ray.hpp"
+#include "utility/Trace.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cmath>
 #include <cstdint>
+#include <exception>
+#include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <limits>
 #include <list>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
 #include <sstream>
 #include <string>
-#include <unordered_set>
+#include <thread>
+#include <tuple>
 #include <vector>
-#include <random>
 
 static_assert(sizeof(char) == 1, "char must be one byte");
 
@@ -35,6 +43,7 @@ struct WmoFileInstance
     std::uint16_t m_doodadSet;
     std::uint16_t m_nameSet;
     float m_transformMatrix[16];
+    float m_inverseTransformMatrix[16];
     math::BoundingBox m_bounds;
     char m_fileName[MeshSettings::MaxMPQPathLength];
 };
@@ -43,6 +52,7 @@ struct DoodadFileInstance
 {
     std::uint32_t m_id;
     float m_transformMatrix[16];
+    float m_inverseTransformMatrix[16];
     math::BoundingBox m_bounds;
     char m_fileName[MeshSettings::MaxMPQPathLength];
 };
@@ -61,7 +71,8 @@ struct NavFileHeader
         if (sig != MeshSettings::FileSignature)
             THROW(Result::INCORRECT_FILE_SIGNATURE);
 
-        if (ver != MeshSettings::FileVersion)
+        if (ver < MeshSettings::MinFileVersion ||
+            ver > MeshSettings::FileVersion)
             THROW(Result::INCORRECT_FILE_VERSION);
 
         if (globalWmo)
@@ -80,24 +91,283 @@ struct NavFileHeader
 };
 #pragma pack(pop)
 
+// the parts of a nav file header which depend upon its version
+struct NavFileLayout
+{
+    std::uint32_t flags;
+    AgentSize agent;
+    RegionPartition partition;
+
+    // reads the header of a nav file, leaving the stream at the first tile
+    NavFileLayout(utility::MappedStream& in, NavFileHeader& header,
+                  bool globalWmo)
+        : flags(0), agent(AgentSize::Default),
+          partition(RegionPartition::Watershed)
+    {
+        in >> header;
+
+        header.Verify(globalWmo);
+
+        if (header.ver < '0010')
+            return;
+
+        std::uint32_t firstTile;
+        in >> flags >> firstTile;
+
+        if (flags & ~MeshSettings::FileFlags)
+            THROW(Result::INCORRECT_FILE_VERSION);
+
+        if (firstTile < in.rpos() || firstTile > in.file()->size())
+            THROW(Result::INVALID_MAP_FILE);
+
+        if (firstTile >= in.rpos() + sizeof(std::uint32_t))
+        {
+            std::uint32_t size;
+            in >> size;
+
+            if (size >= AgentProfileCount)
+                THROW(Result::UNKNOWN_AGENT_SIZE);
+
+            agent = static_cast<AgentSize>(size);
+        }
+
+        if (firstTile >= in.rpos() + sizeof(std::uint32_t))
+        {
+            std::uint32_t value;
+            in >> value;
+
+            if (value >= RegionPartitionCount)
+                THROW(Result::UNKNOWN_REGION_PARTITION);
+
+            partition = static_cast<RegionPartition>(value);
+        }
+
+        in.rpos(firstTile);
+    }
+
+    // returns where the tile at the stream ends, or zero when the file does
+    // not say.  the stream is left at the start of the tile
+    size_t TileEnd(utility::MappedStream& in) const
+    {
+        if (!(flags & MeshSettings::NavFileTileSizes))
+            return 0;
+
+        std::uint32_t size;
+        in >> size;
+
+        auto const end = in.rpos() + size;
+
+        if (end > in.file()->size())
+            THROW(Result::INVALID_MAP_FILE);
+
+        return end;
+    }
+};
+
 namespace {
 
+std::atomic<std::uint64_t> nextMapId {1};
+
+// the most recently used query context for the current thread, and the id of
+// the map to which it belongs
+thread_local std::uint64_t lastQueryMapId = 0;
+thread_local pathfind::QueryContext* lastQueryContext = nullptr;
+
+// maps a nav file, or inflates it into memory when it was compressed
+std::shared_ptr<utility::MappedFile>
+OpenNavFile(const std::filesystem::path& path)
+{
+    auto file = std::make_shared<utility::MappedFile>(path);
+
+    constexpr size_t headerSize =
+        2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+
+    if (file->size() < headerSize ||
+        *reinterpret_cast<const std::uint32_t*>(file->data()) !=
+            MeshSettings::FileCompressed)
+        return file;
+
+    utility::MappedStream in(file);
+
+    std::uint32_t sig, compression;
+    std::uint64_t length;
+    in >> sig >> compression >> length;
+
+    if (compression != static_cast<std::uint32_t>(NavCompression::Zlib))
+        THROW(Result::UNKNOWN_NAV_COMPRESSION);
+
+    // the contents are inflated straight into the block which the tiles then
+    // use in place, and the compressed pages are released as they are used
+    // up, so that only a window of them is resident at once
+    auto contents =
+        std::make_shared<utility::MappedFile>(static_cast<size_t>(length));
+    size_t released = 0;
+
+    utility::BinaryStream::Inflate(
+        file->data() + headerSize, file->size() - headerSize,
+        contents->data(), contents->size(),
+        [&file, &released](size_t consumed) {
+            file->Discard(headerSize + released, consumed - released);
+            released = consumed;
+        });
+
+    return contents;
+}
+
+// detour calls this for each random choice it makes.  each thread seeds its
+// own generator once, rather than creating a random device for every call
 float random_between_0_and_1() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<> dis(0.0, 1.0);
+    thread_local std::mt19937 gen(std::random_device {}());
+    std::uniform_real_distribution<float> dis(0.f, 1.f);
+
+    return dis(gen);
+}
+
+// models may be shared by concurrent queries, so unlike operator[] this must
+// never insert.  name sets without an entry report zero for both values.
+void GetAreaAndZone(const pathfind::WmoModel& model, unsigned int nameSet,
+                    unsigned int* zone, unsigned int* area)
+{
+    auto const i = model.m_nameSetToAreaZone.find(nameSet);
+
+    if (area)
+        *area = i == model.m_nameSetToAreaZone.end() ? 0 : i->second.first;
+    if (zone)
+        *zone = i == model.m_nameSetToAreaZone.end() ? 0 : i->second.second;
+}
+
+// begins a new ray cast, after which no instance has been visited
+void BeginVisit(pathfind::QueryContext& context)
+{
+    // when the generation wraps around, old stamps could match again
+    if (++context.m_visitGeneration == 0)
+    {
+        std::fill(context.m_staticWmoStamps.begin(),
+                  context.m_staticWmoStamps.end(), 0);
+        std::fill(context.m_staticDoodadStamps.begin(),
+                  context.m_staticDoodadStamps.end(), 0);
+        context.m_visitGeneration = 1;
+    }
+
+    context.m_visitedTemporaryWmos.clear();
+    context.m_visitedTemporaryDoodads.clear();
+}
+
+// returns true if this is the first visit to the instance during this ray cast
+bool FirstVisit(std::vector<std::uint32_t>& stamps, std::uint32_t generation,
+                std::uint32_t index)
+{
+    if (stamps[index] == generation)
+        return false;
+
+    stamps[index] = generation;
+    return true;
+}
+
+bool FirstVisit(std::vector<std::uint64_t>& visited, std::uint64_t guid)
+{
+    if (std::find(visited.begin(), visited.end(), guid) != visited.end())
+        return false;
+
+    visited.push_back(guid);
+    return true;
+}
+
+// records the kind, the id and the model space normal of the face of a model
+// which a ray hit, moving the normal into world space.  normals move by the
+// transpose of the inverse of the matrix which moves positions
+void DescribeHit(pathfind::RayHit& hit, pathfind::RayHit::Kind kind,
+                 std::uint64_t id, const pathfind::Model& model,
+                 unsigned int face, const math::Matrix& inverseTransform)
+{
+    auto const vertices = model.m_aabbTree.Vertices();
+    auto const indices = model.m_aabbTree.Indices();
+
+    auto const& a = vertices[indices[face * 3 + 0]];
+    auto const& b = vertices[indices[face * 3 + 1]];
+    auto const& c = vertices[indices[face * 3 + 2]];
+
+    auto const normal = math::Vector3::CrossProduct(b - a, c - a);
 
-    return static_cast<float>(dis(gen));
+    hit.m_kind = kind;
+    hit.m_id = id;
+
+    for (auto i = 0; i < 3; ++i)
+        hit.m_normal[i] = inverseTransform[0][i] * normal.X +
+                          inverseTransform[1][i] * normal.Y +
+                          inverseTransform[2][i] * normal.Z;
 }
 
+template <typename Instance>
+Instance* FindById(const std::vector<std::uint32_t>& ids,
+                   std::vector<Instance>& instances, std::uint32_t id)
+{
+    auto const itr = std::lower_bound(ids.begin(), ids.end(), id);
+
+    if (itr == ids.end() || *itr != id)
+        return nullptr;
+
+    return &instances[itr - ids.begin()];
+}
 } // anonymous namespace
 
 namespace pathfind
 {
-Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
-    : m_dataPath(dataPath), m_bvhLoader(dataPath), m_mapName(mapName),
-      m_globalWmoOriginX(0.f), m_globalWmoOriginY(0.f)
+Map::Map(const std::filesystem::path& dataPath, const std::string& mapName,
+         const QueryLimits& limits)
+    : Map(std::make_shared<ModelCache>(dataPath), dataPath, mapName, limits)
+{
+}
+
+Map::Map(std::shared_ptr<ModelCache> models,
+         const std::filesystem::path& dataPath, const std::string& mapName,
+         const QueryLimits& limits)
+    : m_models(std::move(models)), m_dataPath(dataPath), m_mapName(mapName),
+      m_queryLimits(limits), m_agentSize(AgentProfileCount),
+      m_regionPartition(RegionPartitionCount),
+      m_straightPathDistance(0.f),
+      m_portalGraph(dataPath / "Nav" / mapName), m_meshGeneration(0),
+      m_globalWmoOriginX(0.f), m_globalWmoOriginY(0.f), m_id(nextMapId++),
+      m_asyncStop(false), m_watchInterval(0), m_watchStop(false),
+      m_reclaimStop(false), m_reclaiming(false), m_obstacleBatchDepth(0),
+      m_rebuildStop(false),
+      m_nextOffMeshConnectionId(0),
+      m_obstacleVersion(0), m_heightFieldIdleTime(0), m_residencyBudget(0),
+      m_residentBytes(0), m_residencyClock(0), m_residencyHits(0),
+      m_residencyMisses(0), m_residencyEvictions(0), m_pathLoadBudget(0),
+      m_modelLoadThreads(4),
+      m_temporaryWmoSweepSize(16), m_temporaryDoodadSweepSize(16),
+      m_preloadStop(false)
 {
+    // otherwise the scratch space of each query would be empty, or the
+    // navmesh queries would fail to initialize on first use
+    if (limits.m_maxNodes <= 0 || limits.m_maxNodes > QueryLimits::MaxNodes)
+        THROW_MSG("Max nodes " + std::to_string(limits.m_maxNodes),
+                  Result::INVALID_QUERY_LIMITS);
+    if (limits.m_maxPathHops <= 0)
+        THROW_MSG("Max path hops " + std::to_string(limits.m_maxPathHops),
+                  Result::INVALID_QUERY_LIMITS);
+    if (limits.m_shortPathNodes <= 0 ||
+        limits.m_shortPathNodes > QueryLimits::MaxNodes)
+        THROW_MSG("Short path nodes " +
+                      std::to_string(limits.m_shortPathNodes),
+                  Result::INVALID_QUERY_LIMITS);
+
+    ::memset(m_adtBytes, 0, sizeof(m_adtBytes));
+    for (auto& column : m_adtLastUsed)
+        for (auto& lastUsed : column)
+            lastUsed = 0;
+    for (auto& column : m_adtPins)
+        for (auto& pins : column)
+            pins = 0;
+    for (auto& column : m_explicitADT)
+        for (auto& explicitLoad : column)
+            explicitLoad = false;
+
+    SetQueryFilter("avoid water", 0xFFFF, PolyFlags::Liquid);
+    SetQueryFilter("ground only", PolyFlags::Ground, 0);
+    SetQueryFilter("swimmer", PolyFlags::Liquid, 0);
+
     utility::BinaryStream in(m_dataPath / (mapName + ".map"));
 
     std::uint32_t magic;
@@ -121,6 +391,8 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
 
         in.ReadBytes(has_adt, sizeof(has_adt));
 
+        int adtCount = 0;
+
         for (auto y = 0; y < MeshSettings::Adts; ++y)
             for (auto x = 0; x < MeshSettings::Adts; ++x)
             {
@@ -130,13 +402,29 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
 
                 m_hasADT[x][y] =
                     (has_adt[byte_offset] & (1 << bit_offset)) != 0;
+
+                if (m_hasADT[x][y])
+                {
+                    ++adtCount;
+
+                    // read now so that no query waits on the file system
+                    m_portalGraph.LoadADT(x, y);
+                }
             }
 
         dtNavMeshParams params;
 
         constexpr float mapOrigin = -32.f * MeshSettings::AdtSize;
-        constexpr int maxTiles =
-            MeshSettings::TileCount * MeshSettings::TileCount;
+
+        // detour allocates a tile, and a quarter of a tile's worth of its
+        // position lookup, for each of these up front.  every tile lies
+        // within an ADT which the map has, and a rebuilt tile is removed
+        // before its replacement is added, so this is as many as there can
+        // ever be at once.  it is far fewer than one for every tile of the
+        // world, which most maps never come near
+        auto const maxTiles = (std::max)(1, adtCount) *
+                              MeshSettings::TilesPerADT *
+                              MeshSettings::TilesPerADT;
 
         params.orig[0] = mapOrigin;
         params.orig[1] = 0.f;
@@ -148,18 +436,30 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
         auto const result = m_navMesh.init(&params);
         assert(result == DT_SUCCESS);
 
+        m_tileGenerations.assign(maxTiles, 0);
+
         std::uint32_t wmoInstanceCount;
         in >> wmoInstanceCount;
 
+        // the instances are stored sorted by id and with their inverse
+        // transforms, so they need only be copied here
         if (wmoInstanceCount)
         {
             std::vector<WmoFileInstance> wmoInstances(wmoInstanceCount);
             in.ReadBytes(&wmoInstances[0],
                          wmoInstanceCount * sizeof(WmoFileInstance));
 
-            for (auto const& wmo : wmoInstances)
+            m_staticWmoIds.reserve(wmoInstanceCount);
+            m_staticWmos.resize(wmoInstanceCount);
+
+            for (auto i = 0u; i < wmoInstanceCount; ++i)
             {
-                WmoInstance ins;
+                auto const& wmo = wmoInstances[i];
+                auto& ins = m_staticWmos[i];
+
+                if (!m_staticWmoIds.empty() &&
+                    m_staticWmoIds.back() >= wmo.m_id)
+                    THROW(Result::INVALID_MAP_FILE);
 
                 ins.m_doodadSet = static_cast<unsigned int>(wmo.m_doodadSet);
                 ins.m_nameSet = static_cast<unsigned int>(wmo.m_nameSet);
@@ -167,12 +467,15 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
                     wmo.m_transformMatrix,
                     sizeof(wmo.m_transformMatrix) /
                         sizeof(wmo.m_transformMatrix[0]));
-                ins.m_inverseTransformMatrix =
-                    ins.m_transformMatrix.ComputeInverse();
+                ins.m_inverseTransformMatrix = math::Matrix::CreateFromArray(
+                    wmo.m_inverseTransformMatrix,
+                    sizeof(wmo.m_inverseTransformMatrix) /
+                        sizeof(wmo.m_inverseTransformMatrix[0]));
                 ins.m_bounds = wmo.m_bounds;
-                ins.m_modelFilename = wmo.m_fileName;
+                ins.m_index = i;
+                ins.m_modelFilename = InternModelName(wmo.m_fileName);
 
-                m_staticWmos.insert({static_cast<unsigned int>(wmo.m_id), ins});
+                m_staticWmoIds.push_back(wmo.m_id);
             }
         }
 
@@ -186,21 +489,31 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
             in.ReadBytes(&doodadInstances[0],
                          doodadInstanceCount * sizeof(DoodadFileInstance));
 
-            for (auto const& doodad : doodadInstances)
+            m_staticDoodadIds.reserve(doodadInstanceCount);
+            m_staticDoodads.resize(doodadInstanceCount);
+
+            for (auto i = 0u; i < doodadInstanceCount; ++i)
             {
-                DoodadInstance ins;
+                auto const& doodad = doodadInstances[i];
+                auto& ins = m_staticDoodads[i];
+
+                if (!m_staticDoodadIds.empty() &&
+                    m_staticDoodadIds.back() >= doodad.m_id)
+                    THROW(Result::INVALID_MAP_FILE);
 
                 ins.m_transformMatrix = math::Matrix::CreateFromArray(
                     doodad.m_transformMatrix,
                     sizeof(doodad.m_transformMatrix) /
                         sizeof(doodad.m_transformMatrix[0]));
-                ins.m_inverseTransformMatrix =
-                    ins.m_transformMatrix.ComputeInverse();
+                ins.m_inverseTransformMatrix = math::Matrix::CreateFromArray(
+                    doodad.m_inverseTransformMatrix,
+                    sizeof(doodad.m_inverseTransformMatrix) /
+                        sizeof(doodad.m_inverseTransformMatrix[0]));
                 ins.m_bounds = doodad.m_bounds;
-                ins.m_modelFilename = doodad.m_fileName;
+                ins.m_index = i;
+                ins.m_modelFilename = InternModelName(doodad.m_fileName);
 
-                m_staticDoodads.insert(
-                    {static_cast<unsigned int>(doodad.m_id), ins});
+                m_staticDoodadIds.push_back(doodad.m_id);
             }
         }
     }
@@ -221,13 +534,18 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
             globalWmo.m_transformMatrix,
             sizeof(globalWmo.m_transformMatrix) /
                 sizeof(globalWmo.m_transformMatrix[0]));
-        ins.m_inverseTransformMatrix = ins.m_transformMatrix.ComputeInverse();
+        ins.m_inverseTransformMatrix = math::Matrix::CreateFromArray(
+            globalWmo.m_inverseTransformMatrix,
+            sizeof(globalWmo.m_inverseTransformMatrix) /
+                sizeof(globalWmo.m_inverseTransformMatrix[0]));
         ins.m_bounds = globalWmo.m_bounds;
 
-        auto model = EnsureWmoModelLoaded(globalWmo.m_fileName);
+        auto model = m_models->EnsureWmoModelLoaded(globalWmo.m_fileName);
         ins.m_model = model;
+        ins.m_modelFilename = InternModelName(globalWmo.m_fileName);
 
-        m_staticWmos.insert({GlobalWmoId, ins});
+        m_staticWmoIds.push_back(GlobalWmoId);
+        m_staticWmos.push_back(std::move(ins));
 
         dtNavMeshParams params;
 
@@ -252,16 +570,16 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
         auto const result = m_navMesh.init(&params);
         assert(result == DT_SUCCESS);
 
-        auto const navPath = m_dataPath / "Nav" / m_mapName / "Map.nav";
+        m_tileGenerations.assign(params.maxTiles, 0);
 
-        utility::BinaryStream navIn(navPath);
+        auto const navPath = m_dataPath / "Nav" / m_mapName / "Map.nav";
 
-        navIn.Decompress();
+        utility::MappedStream navIn(OpenNavFile(navPath));
 
         NavFileHeader header;
-        navIn >> header;
-
-        header.Verify(true);
+        NavFileLayout const layout(navIn, header, true);
+        CheckAgentSize(layout.agent);
+        CheckRegionPartition(layout.partition);
 
         if (header.x != MeshSettings::WMOcoordinate ||
             header.y != MeshSettings::WMOcoordinate)
@@ -269,149 +587,248 @@ Map::Map(const std::filesystem::path& dataPath, const std::string& mapName)
 
         for (auto i = 0u; i < header.tileCount; ++i)
         {
-            auto tile = std::make_unique<Tile>(this, navIn, navPath);
+            auto const end = layout.TileEnd(navIn);
+            auto tile = std::make_unique<Tile>(this, navIn, layout.flags);
+            tile->LoadModels();
+
+            // sections added by later versions follow the mesh
+            if (end)
+                navIn.rpos(end);
 
             // for a global wmo, all tiles are guarunteed to contain the model
             tile->m_staticWmos.push_back(GlobalWmoId);
             tile->m_staticWmoModels.push_back(model);
 
-            m_tiles[{tile->m_x, tile->m_y}] = std::move(tile);
+            tile->AddToMap();
+            InsertTile(std::move(tile));
         }
     }
 
-    if (m_navQuery.init(&m_navMesh, 65535) != DT_SUCCESS)
-        THROW(Result::DTNAVMESHQUERY_INIT_FAILED);
+    std::vector<InstanceBounds> bounds;
+
+    bounds.reserve(m_staticWmos.size());
+    for (auto i = 0u; i < m_staticWmos.size(); ++i)
+        bounds.push_back({m_staticWmos[i].m_bounds, i});
+    m_staticWmoBounds.Build(std::move(bounds));
+
+    bounds.clear();
+    bounds.reserve(m_staticDoodads.size());
+    for (auto i = 0u; i < m_staticDoodads.size(); ++i)
+        bounds.push_back({m_staticDoodads[i].m_bounds, i});
+    m_staticDoodadBounds.Build(std::move(bounds));
+
+    // create the context for the constructing thread now, so that an
+    // initialization failure is reported here rather than on the first query
+    GetQueryContext();
 }
 
-std::shared_ptr<WmoModel> Map::LoadModelForWmoInstance(unsigned int instanceId)
+Map::~Map()
 {
-    auto const instance = m_staticWmos.find(instanceId);
+    // the watcher reloads ADTs, and so must stop before anything else
+    WatchNavFiles(std::chrono::milliseconds(0));
 
-    // ensure it exists.  this should never fail
-    if (instance == m_staticWmos.end())
-        THROW(Result::UNKNOWN_WMO_INSTANCE_REQUESTED);
+    StopBatchPool();
 
-    // if the model is loaded, return it
-    if (!instance->second.m_model.expired())
-        return instance->second.m_model.lock();
+    m_preloadStop = true;
 
-    auto model = EnsureWmoModelLoaded(instance->second.m_modelFilename);
+    {
+        std::lock_guard<std::mutex> guard(m_preloadMutex);
+        for (auto& thread : m_preloadThreads)
+            thread.m_thread.join();
+    }
 
-    instance->second.m_model = model;
+    {
+        std::lock_guard<std::mutex> guard(m_asyncMutex);
+        m_asyncStop = true;
+    }
 
-    return model;
-}
+    m_asyncCondition.notify_all();
 
-std::shared_ptr<DoodadModel>
-Map::LoadModelForDoodadInstance(unsigned int instanceId)
-{
-    auto const instance = m_staticDoodads.find(instanceId);
+    if (m_asyncThread.joinable())
+        m_asyncThread.join();
+
+    // loads never committed fail their futures with a defined error, rather
+    // than leaving them broken
+    if (!m_asyncLoads.empty())
+    {
+        std::exception_ptr cancelled;
+
+        try
+        {
+            THROW(Result::ADT_LOAD_CANCELLED);
+        }
+        catch (...)
+        {
+            cancelled = std::current_exception();
+        }
 
-    // ensure it exists.  this should never fail
-    if (instance == m_staticDoodads.end())
-        THROW(Result::UNKNOWN_DOODAD_INSTANCE_REQUESTED);
+        for (auto& load : m_asyncLoads)
+            for (auto& promise : load.m_promises)
+                promise.set_exception(cancelled);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_rebuildMutex);
+        m_rebuildStop = true;
+    }
 
-    // if the model is loaded, return it
-    if (!instance->second.m_model.expired())
-        return instance->second.m_model.lock();
+    m_rebuildCondition.notify_all();
 
-    auto model = EnsureDoodadModelLoaded(instance->second.m_modelFilename);
+    for (auto& thread : m_rebuildThreads)
+        thread.join();
 
-    instance->second.m_model = model;
+    // the reclaimer destroys whatever remains before it stops
+    {
+        std::lock_guard<std::mutex> guard(m_reclaimMutex);
+        m_reclaimStop = true;
+    }
 
-    return model;
+    m_reclaimCondition.notify_all();
+
+    if (m_reclaimThread.joinable())
+        m_reclaimThread.join();
 }
 
-std::shared_ptr<DoodadModel>
-Map::EnsureDoodadModelLoaded(const std::string& mpq_path)
+QueryContext& Map::GetQueryContext() const
 {
-    auto const bvhFilename = m_bvhLoader.GetBVHPath(mpq_path);
+    if (lastQueryMapId == m_id)
+        return *lastQueryContext;
+
+    std::lock_guard<std::mutex> guard(m_queryContextMutex);
 
-    // if this model is currently loaded, return it
-    auto const i = m_loadedDoodadModels.find(bvhFilename);
-    if (i != m_loadedDoodadModels.end() && !i->second.expired())
-        return i->second.lock();
+    auto& context = m_queryContexts[std::this_thread::get_id()];
 
-    // else, load it
-    utility::BinaryStream in(bvhFilename);
+    if (!context)
+    {
+        auto newContext = std::make_unique<QueryContext>();
+
+        if (newContext->m_navQuery.init(&m_navMesh,
+                                        m_queryLimits.m_maxNodes) !=
+                DT_SUCCESS ||
+            newContext->m_shortPathQuery.init(
+                &m_navMesh, m_queryLimits.m_shortPathNodes) != DT_SUCCESS)
+        {
+            m_queryContexts.erase(std::this_thread::get_id());
+            THROW(Result::DTNAVMESHQUERY_INIT_FAILED);
+        }
 
-    auto model = std::make_shared<pathfind::DoodadModel>();
+        newContext->m_polyRefs.resize(m_queryLimits.m_maxPathHops);
+        newContext->m_pathBuffer.resize(m_queryLimits.m_maxPathHops * 3);
 
-    if (!model->m_aabbTree.Deserialize(in))
-        THROW(Result::COULD_NOT_DESERIALIZE_DOODAD).ErrorCode();
+        // static instances never change after construction
+        newContext->m_staticWmoStamps.resize(m_staticWmos.size());
+        newContext->m_staticDoodadStamps.resize(m_staticDoodads.size());
 
-    m_loadedDoodadModels[bvhFilename] = model;
-    return model;
+        context = std::move(newContext);
+    }
+
+    lastQueryMapId = m_id;
+    lastQueryContext = context.get();
+
+    return *context;
 }
 
-std::shared_ptr<WmoModel> Map::EnsureWmoModelLoaded(const std::string& mpq_path)
+JobPool& Map::GetBatchPool() const
 {
-    auto const bvhFilename = m_bvhLoader.GetBVHPath(mpq_path);
+    std::lock_guard<std::mutex> guard(m_batchPoolMutex);
+
+    // the calling thread runs a slice of every batch too.  the number of
+    // cores may not be known, in which case it is zero
+    if (!m_batchPool)
+    {
+        auto const cores = std::thread::hardware_concurrency();
+        m_batchPool =
+            std::make_unique<JobPool>(cores > 1 ? cores - 1 : 1u);
+    }
 
-    // if this model is currently loaded, return it
-    auto const i = m_loadedWmoModels.find(bvhFilename);
-    if (i != m_loadedWmoModels.end() && !i->second.expired())
-        return i->second.lock();
+    return *m_batchPool;
+}
 
-    // else, load it
-    utility::BinaryStream in(bvhFilename);
+void Map::StopBatchPool()
+{
+    std::lock_guard<std::mutex> guard(m_batchPoolMutex);
 
-    auto model = std::make_shared<pathfind::WmoModel>();
+    if (!m_batchPool)
+        return;
 
-    if (!model->m_aabbTree.Deserialize(in))
-        THROW(Result::COULD_NOT_DESERIALIZE_WMO).ErrorCode();
+    auto const threads = m_batchPool->GetThreadIds();
+    m_batchPool.reset();
 
-    std::uint32_t rootId, nameSetCount;
-    in >> rootId >> nameSetCount;
+    std::lock_guard<std::mutex> contextGuard(m_queryContextMutex);
+    for (auto const& thread : threads)
+        m_queryContexts.erase(thread);
+}
 
-    for (auto i = 0u; i < nameSetCount; ++i)
+void Map::ReleaseQueryContext() const
+{
+    if (lastQueryMapId == m_id)
     {
-        std::uint32_t nameSet, areaId, zoneId;
-        in >> nameSet >> areaId >> zoneId;
-
-        model->m_nameSetToAreaZone[nameSet] = {areaId, zoneId};
+        lastQueryMapId = 0;
+        lastQueryContext = nullptr;
     }
 
-    std::uint32_t doodadSetCount;
-    in >> doodadSetCount;
+    std::lock_guard<std::mutex> guard(m_queryContextMutex);
+    m_queryContexts.erase(std::this_thread::get_id());
+}
 
-    model->m_doodadSets.resize(doodadSetCount);
-    model->m_loadedDoodadSets.resize(doodadSetCount);
+AgentSize Map::GetAgentSize() const
+{
+    auto const size = m_agentSize.load();
 
-    for (std::uint32_t set = 0; set < doodadSetCount; ++set)
-    {
-        std::uint32_t doodadSetSize;
-        in >> doodadSetSize;
+    return size < AgentProfileCount ? static_cast<AgentSize>(size)
+                                    : AgentSize::Default;
+}
 
-        model->m_doodadSets[set].resize(doodadSetSize);
+void Map::CheckAgentSize(AgentSize size)
+{
+    auto expected = AgentProfileCount;
+    auto const value = static_cast<std::uint32_t>(size);
 
-        for (std::uint32_t doodad = 0; doodad < doodadSetSize; ++doodad)
-        {
-            float transformMatrix[16];
-            in >> transformMatrix;
+    if (!m_agentSize.compare_exchange_strong(expected, value) &&
+        expected != value)
+        THROW(Result::AGENT_SIZE_MISMATCH);
+}
+
+RegionPartition Map::GetRegionPartition() const
+{
+    auto const partition = m_regionPartition.load();
+
+    return partition < RegionPartitionCount
+               ? static_cast<RegionPartition>(partition)
+               : RegionPartition::Watershed;
+}
 
-            model->m_doodadSets[set][doodad].m_transformMatrix =
-                math::Matrix::CreateFromArray(transformMatrix,
-                                              sizeof(transformMatrix) /
-                                                  sizeof(transformMatrix[0]));
+void Map::CheckRegionPartition(RegionPartition partition)
+{
+    auto expected = RegionPartitionCount;
+    auto const value = static_cast<std::uint32_t>(partition);
 
-            in >> model->m_doodadSets[set][doodad].m_bounds;
+    if (!m_regionPartition.compare_exchange_strong(expected, value) &&
+        expected != value)
+        THROW(Result::REGION_PARTITION_MISMATCH);
+}
 
-            char doodadFileName[MeshSettings::MaxMPQPathLength];
-            in >> doodadFileName;
+dtNavMesh& Map::AgentNavMesh(AgentSize agent)
+{
+    auto& navMesh = m_agentNavMeshes[static_cast<int>(agent)];
 
-            auto doodadModel = EnsureDoodadModelLoaded(doodadFileName);
+    if (!navMesh)
+    {
+        navMesh = std::make_unique<dtNavMesh>();
 
-            // loaded doodads serve as reference counters for automatic unload
-            model->m_loadedDoodadSets[set].push_back(doodadModel);
-            model->m_doodadSets[set][doodad].m_model =
-                m_loadedDoodadModels[doodadFileName] = doodadModel;
-        }
+        auto const result = navMesh->init(m_navMesh.getParams());
+        assert(result == DT_SUCCESS);
     }
 
-    m_loadedWmoModels[bvhFilename] = model;
+    return *navMesh;
+}
+
+const dtNavMesh* Map::FindAgentNavMesh(AgentSize agent) const
+{
+    if (agent == GetAgentSize())
+        return &m_navMesh;
 
-    return model;
+    return m_agentNavMeshes[static_cast<int>(agent)].get();
 }
 
 bool Map::HasADTs() const
@@ -426,642 +843,4090 @@ bool Map::HasADT(int x, int y) const
 
 bool Map::IsADTLoaded(int x, int y) const
 {
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
     return m_loadedADT[x][y];
 }
 
-bool Map::LoadADT(int x, int y)
+bool Map::ReadADT(int x, int y, std::vector<std::unique_ptr<Tile>>& tiles,
+                  size_t& bytes, fs::file_time_type& writeTime)
 {
-    if (m_loadedADT[x][y])
-        return true;
-
-    if (!m_hasADT[x][y])
-        return false;
-
-    std::stringstream str;
-    str << std::setfill('0') << std::setw(2) << x << "_" << std::setfill('0')
-        << std::setw(2) << y << ".nav";
+    utility::Trace::Scope trace("Map::ReadADT", "io", x, y);
 
-    auto const nav_path = m_dataPath / "Nav" / m_mapName / str.str();
+    auto const nav_path = NavFilePath(x, y);
 
     if (!fs::exists(nav_path))
         return false;
 
-    utility::BinaryStream stream(nav_path);
+    // a file written after this is seen by NavFileWatcher().  should the
+    // time not be read, the file is reloaded once when next polled
+    std::error_code error;
+    writeTime = fs::last_write_time(nav_path, error);
 
-    stream.Decompress();
+    utility::MappedStream stream(OpenNavFile(nav_path));
 
-    NavFileHeader header;
-    stream >> header;
+    bytes = stream.file()->size();
 
-    header.Verify(false);
+    NavFileHeader header;
+    NavFileLayout const layout(stream, header, false);
+    CheckAgentSize(layout.agent);
+    CheckRegionPartition(layout.partition);
 
     if (header.x != static_cast<std::uint32_t>(x) ||
         header.y != static_cast<std::uint32_t>(y))
         THROW(Result::INCORRECT_ADT_COORDINATES);
 
+    tiles.reserve(header.tileCount);
+
     for (auto i = 0u; i < header.tileCount; ++i)
     {
-        auto tile = std::make_unique<Tile>(this, stream, nav_path);
-        m_tiles[{tile->m_x, tile->m_y}] = std::move(tile);
+        auto const end = layout.TileEnd(stream);
+        tiles.push_back(std::make_unique<Tile>(this, stream, layout.flags));
+
+        if (end)
+            stream.rpos(end);
     }
 
-    m_loadedADT[x][y] = true;
+    Tile::ModelCache models;
+    PrefetchModels(tiles, models);
+
+    for (auto const& tile : tiles)
+        tile->LoadModels(models);
 
     return true;
 }
 
-void Map::UnloadADT(int x, int y)
+void Map::PrefetchModels(const std::vector<std::unique_ptr<Tile>>& tiles,
+                         Tile::ModelCache& models)
 {
-    if (!m_loadedADT[x][y])
+    utility::Trace::Scope trace("Map::PrefetchModels", "io");
+
+    // the distinct model files of the tiles which are not loaded.  those of
+    // unknown instances are left for LoadModels() to report
+    std::vector<const std::string*> wmoFiles, doodadFiles;
+
+    for (auto const& tile : tiles)
+    {
+        for (auto const id : tile->m_staticWmos)
+            if (auto const instance = FindStaticWmo(id))
+            {
+                auto const entry = models.m_wmoFiles.emplace(
+                    instance->m_modelFilename, nullptr);
+
+                if (entry.second &&
+                    !(entry.first->second =
+                          m_models->FindWmoModel(*instance->m_modelFilename)))
+                    wmoFiles.push_back(instance->m_modelFilename);
+            }
+
+        for (auto const id : tile->m_staticDoodads)
+            if (auto const instance = FindStaticDoodad(id))
+            {
+                auto const entry = models.m_doodadFiles.emplace(
+                    instance->m_modelFilename, nullptr);
+
+                if (entry.second &&
+                    !(entry.first->second = m_models->FindDoodadModel(
+                          *instance->m_modelFilename)))
+                    doodadFiles.push_back(instance->m_modelFilename);
+            }
+    }
+
+    auto const count = wmoFiles.size() + doodadFiles.size();
+    auto const threads =
+        (std::min)(static_cast<size_t>(m_modelLoadThreads.load()), count);
+
+    // LoadModels() loads whatever remains, in turn
+    if (threads < 2)
         return;
 
-    for (auto tileY = y * MeshSettings::TilesPerADT;
-         tileY < (y + 1) * MeshSettings::TilesPerADT; ++tileY)
-        for (auto tileX = x * MeshSettings::TilesPerADT;
-             tileX < (x + 1) * MeshSettings::TilesPerADT; ++tileX)
-        {
-            auto i = m_tiles.find({tileX, tileY});
+    std::vector<std::shared_ptr<WmoModel>> wmos(wmoFiles.size());
+    std::vector<std::shared_ptr<DoodadModel>> doodads(doodadFiles.size());
 
-            if (i != m_tiles.end())
-                m_tiles.erase(i);
+    // the wmos are handed out first, being the largest, and as each loads
+    // the doodads of its own doodad sets
+    std::atomic<size_t> next {0};
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    auto const worker = [&]() {
+        for (size_t i; (i = next++) < count;)
+        {
+            try
+            {
+                if (i < wmoFiles.size())
+                    wmos[i] = m_models->EnsureWmoModelLoaded(*wmoFiles[i]);
+                else
+                {
+                    auto const d = i - wmoFiles.size();
+                    doodads[d] =
+                        m_models->EnsureDoodadModelLoaded(*doodadFiles[d]);
+                }
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
         }
+    };
 
-    m_loadedADT[x][y] = false;
-}
+    std::vector<std::thread> workers;
+    for (auto i = 1u; i < threads; ++i)
+        workers.emplace_back(worker);
 
-int Map::LoadAllADTs()
-{
-    int result = 0;
+    worker();
 
-    for (auto y = 0; y < MeshSettings::Adts; ++y)
-        for (auto x = 0; x < MeshSettings::Adts; ++x)
-            if (m_hasADT[x][y] && LoadADT(x, y))
-                ++result;
+    for (auto& thread : workers)
+        thread.join();
 
-    return result;
+    if (error)
+        std::rethrow_exception(error);
+
+    for (auto i = 0u; i < wmoFiles.size(); ++i)
+        models.m_wmoFiles[wmoFiles[i]] = std::move(wmos[i]);
+
+    for (auto i = 0u; i < doodadFiles.size(); ++i)
+        models.m_doodadFiles[doodadFiles[i]] = std::move(doodads[i]);
 }
 
-std::shared_ptr<Model> Map::GetOrLoadModelByDisplayId(unsigned int displayId)
+void Map::CommitADT(int x, int y, std::vector<std::unique_ptr<Tile>>& tiles,
+                    size_t bytes, fs::file_time_type writeTime)
 {
-    // Get the BVH file for this display ID
-    auto const bvh_path = m_bvhLoader.GetBVHPath(displayId);
-
-    // TODO: add logic based on mpq_path
-    auto const doodad = false;
-    // auto const doodad = fileName[0] == 'd' || fileName[0] == 'D';
+    // another load of the same ADT may have finished first
+    if (m_loadedADT[x][y])
+        return;
 
-    if (doodad)
+    for (auto& tile : tiles)
     {
-        // auto const i = m_loadedDoodadModels.find(fileName);
-        // if (i != m_loadedDoodadModels.end() && !i->second.expired())
-        //    return i->second.lock();
-
-        return EnsureDoodadModelLoaded(bvh_path);
+        tile->AddToMap();
+        InsertTile(std::move(tile));
     }
-    else
+
+    tiles.clear();
+
+    m_loadedADT[x][y] = true;
+
+    // connections added while the ADT was not loaded
+    std::vector<Tile*> changed;
+
+    for (auto const& entry : m_offMeshConnections)
     {
-        // auto const i = m_loadedWmoModels.find(fileName);
-        // if (i != m_loadedWmoModels.end() && !i->second.expired())
-        //    return i->second.lock();
+        auto const tile = GetStartTile(entry.second);
+
+        if (!tile || tile->m_x / MeshSettings::TilesPerADT != x ||
+            tile->m_y / MeshSettings::TilesPerADT != y)
+            continue;
 
-        return EnsureWmoModelLoaded(bvh_path);
+        tile->m_offMeshConnections.push_back(entry.second);
+
+        if (std::find(changed.begin(), changed.end(), tile) == changed.end())
+            changed.push_back(tile);
     }
 
-    // return nullptr;
+    for (auto const tile : changed)
+        TileChanged(tile);
+
+    m_adtBytes[x][y] = bytes;
+    m_adtWriteTimes[x][y] = writeTime;
+    m_residentBytes += bytes;
+    m_adtLastUsed[x][y] = ++m_residencyClock;
 }
 
-bool Map::FindPath(const math::Vertex& start, const math::Vertex& end,
-                   std::vector<math::Vertex>& output, bool allowPartial) const
+fs::path Map::NavFilePath(int x, int y) const
 {
-    constexpr float extents[] = {5.f, 5.f, 5.f};
+    std::stringstream str;
+    str << std::setfill('0') << std::setw(2) << x << "_" << std::setfill('0')
+        << std::setw(2) << y << ".nav";
 
-    float recastStart[3];
-    float recastEnd[3];
+    return m_dataPath / "Nav" / m_mapName / str.str();
+}
 
-    math::Convert::VertexToRecast(start, recastStart);
-    math::Convert::VertexToRecast(end, recastEnd);
+bool Map::ReloadADT(int x, int y)
+{
+    utility::Trace::Scope trace("Map::ReloadADT", "load", x, y);
 
-    dtPolyRef startPolyRef, endPolyRef;
-    if (!(m_navQuery.findNearestPoly(recastStart, extents, &m_queryFilter,
-                                     &startPolyRef, nullptr) &
-          DT_SUCCESS))
+    if (!m_hasADT[x][y] || !IsADTLoaded(x, y))
         return false;
 
-    if (!startPolyRef)
+    std::vector<std::unique_ptr<Tile>> tiles;
+    size_t bytes;
+    fs::file_time_type writeTime;
+    if (!ReadADT(x, y, tiles, bytes, writeTime))
         return false;
 
-    if (!(m_navQuery.findNearestPoly(recastEnd, extents, &m_queryFilter,
-                                     &endPolyRef, nullptr) &
-          DT_SUCCESS))
-        return false;
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
 
-    if (!endPolyRef)
+    // it may have been unloaded meanwhile
+    if (!m_loadedADT[x][y])
         return false;
 
-    dtPolyRef polyRefBuffer[MaxPathHops];
+    // the obstacles of the old tiles, held here until they are rasterized
+    // into the new ones, so that their entries in the map do not expire
+    std::unordered_map<std::uint64_t, std::shared_ptr<WmoInstance>> wmos;
+    std::unordered_map<std::uint64_t, std::shared_ptr<DoodadInstance>> doodads;
+    std::unordered_map<std::uint64_t, std::shared_ptr<Model>> models;
 
-    int pathLength;
-    auto const findPathResult = m_navQuery.findPath(
-        startPolyRef, endPolyRef, recastStart, recastEnd, &m_queryFilter,
-        polyRefBuffer, &pathLength, MaxPathHops);
-    if (!(findPathResult & DT_SUCCESS) ||
-        (!allowPartial && !!(findPathResult & DT_PARTIAL_RESULT)))
-        return false;
+    if (auto const& block = m_tiles[x][y])
+        for (auto const& tile : *block)
+            if (tile)
+            {
+                wmos.insert(tile->m_temporaryWmos.begin(),
+                            tile->m_temporaryWmos.end());
+                doodads.insert(tile->m_temporaryDoodads.begin(),
+                               tile->m_temporaryDoodads.end());
+                models.insert(tile->m_temporaryModels.begin(),
+                              tile->m_temporaryModels.end());
+            }
 
-    float pathBuffer[MaxPathHops * 3];
-    auto const findStraightPathResult = m_navQuery.findStraightPath(
-        recastStart, recastEnd, polyRefBuffer, pathLength, pathBuffer, nullptr,
-        nullptr, &pathLength, MaxPathHops);
-    if (!(findStraightPathResult & DT_SUCCESS) ||
-        (!allowPartial && !!(findStraightPathResult & DT_PARTIAL_RESULT)))
-        return false;
+    auto const explicitLoad = m_explicitADT[x][y].load();
 
-    output.resize(pathLength);
+    UnloadADTLocked(x, y);
+    CommitADT(x, y, tiles, bytes, writeTime);
 
-    for (auto i = 0; i < pathLength; ++i)
-        math::Convert::VertexToWow(&pathBuffer[i * 3], output[i]);
+    m_explicitADT[x][y] = explicitLoad;
 
-    return true;
-}
+    // the obstacles may also reach the tiles of other ADTs, which keep them
+    auto const inADT = [x, y](const Tile* tile)
+    {
+        return tile->m_x / MeshSettings::TilesPerADT == x &&
+               tile->m_y / MeshSettings::TilesPerADT == y;
+    };
 
-const Tile* Map::GetTile(float x, float y) const
-{
-    // find the tile corresponding to this (x, y)
-    int tileX, tileY;
+    std::vector<Tile*> changed;
+    std::vector<Tile*> beneath;
 
-    // maps based on a global WMO have their tiles positioned differently
-    if (HasADTs())
-        math::Convert::WorldToTile({x, y, 0.f}, tileX, tileY);
-    else
+    for (auto const& entry : wmos)
     {
-        tileX = (m_globalWmoOriginY - y) / MeshSettings::TileSize;
-        tileY = (m_globalWmoOriginX - x) / MeshSettings::TileSize;
+        beneath.clear();
+        GetTilesInBounds(entry.second->m_bounds, beneath);
+
+        for (auto const tile : beneath)
+            if (inADT(tile))
+            {
+                tile->m_temporaryModels[entry.first] = models[entry.first];
+                tile->RasterizeTemporaryWmo(entry.first, entry.second);
+                changed.push_back(tile);
+            }
+    }
+
+    for (auto const& entry : doodads)
+    {
+        beneath.clear();
+        GetTilesInBounds(entry.second->m_bounds, beneath);
+
+        for (auto const tile : beneath)
+            if (inADT(tile))
+            {
+                tile->m_temporaryModels[entry.first] = models[entry.first];
+                tile->RasterizeTemporaryDoodad(entry.first, entry.second);
+                changed.push_back(tile);
+            }
+    }
+
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+    for (auto const tile : changed)
+        TileChanged(tile);
+
+    ReleaseIdleHeightFieldsLocked();
+    EnforceResidencyBudget();
+
+    return true;
+}
+
+void Map::WatchNavFiles(std::chrono::milliseconds interval)
+{
+    {
+        std::lock_guard<std::mutex> guard(m_watchMutex);
+        m_watchStop = true;
+    }
+
+    m_watchCondition.notify_all();
+
+    if (m_watchThread.joinable())
+        m_watchThread.join();
+
+    if (interval.count() <= 0)
+        return;
+
+    m_watchInterval = interval;
+    m_watchStop = false;
+    m_watchThread = std::thread(&Map::NavFileWatcher, this);
+}
+
+void Map::PrepareFork()
+{
+    WatchNavFiles(std::chrono::milliseconds(0));
+
+    // the pool is started again by the next batch
+    StopBatchPool();
+
+    // preloads run to their end, rather than being cancelled
+    {
+        std::lock_guard<std::mutex> guard(m_preloadMutex);
+
+        for (auto& thread : m_preloadThreads)
+            thread.m_thread.join();
+
+        m_preloadThreads.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_asyncMutex);
+        m_asyncStop = true;
+    }
+
+    m_asyncCondition.notify_all();
+
+    if (m_asyncThread.joinable())
+        m_asyncThread.join();
+
+    {
+        std::lock_guard<std::mutex> guard(m_asyncMutex);
+        m_asyncStop = false;
+    }
+
+    // queued rebuilds are finished here
+    SetRebuildThreads(0);
+
+    {
+        std::lock_guard<std::mutex> guard(m_reclaimMutex);
+        m_reclaimStop = true;
+    }
+
+    m_reclaimCondition.notify_all();
+
+    if (m_reclaimThread.joinable())
+        m_reclaimThread.join();
+
+    std::lock_guard<std::mutex> guard(m_reclaimMutex);
+    m_reclaimStop = false;
+}
+
+void Map::NavFileWatcher()
+{
+    // the write times of files which failed to reload, which are not tried
+    // again until they are written again
+    std::unordered_map<int, fs::file_time_type> failedTimes;
+
+    std::unique_lock<std::mutex> lock(m_watchMutex);
+
+    while (!m_watchCondition.wait_for(lock, m_watchInterval,
+                                      [this]() { return m_watchStop; }))
+    {
+        lock.unlock();
+
+        for (auto y = 0; y < MeshSettings::Adts; ++y)
+            for (auto x = 0; x < MeshSettings::Adts; ++x)
+            {
+                auto const key = y * MeshSettings::Adts + x;
+
+                if (!m_hasADT[x][y])
+                    continue;
+
+                // compared with the time at which the tiles were read, so
+                // that a file written before the first poll is seen too
+                fs::file_time_type loaded;
+
+                {
+                    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+                    if (!m_loadedADT[x][y])
+                    {
+                        failedTimes.erase(key);
+                        continue;
+                    }
+
+                    loaded = m_adtWriteTimes[x][y];
+                }
+
+                std::error_code error;
+                auto const time = fs::last_write_time(NavFilePath(x, y), error);
+
+                if (error || time == loaded)
+                    continue;
+
+                auto const failed = failedTimes.find(key);
+
+                if (failed != failedTimes.end() && failed->second == time)
+                    continue;
+
+                // the old tiles remain until the file is written again
+                try
+                {
+                    if (ReloadADT(x, y))
+                        failedTimes.erase(key);
+                    else
+                        failedTimes[key] = time;
+                }
+                catch (...)
+                {
+                    failedTimes[key] = time;
+                }
+            }
+
+        lock.lock();
+    }
+}
+
+bool Map::LoadADT(int x, int y)
+{
+    return LoadADT(x, y, true);
+}
+
+bool Map::LoadADT(int x, int y, bool explicitLoad)
+{
+    utility::Trace::Scope trace("Map::LoadADT", "load", x, y);
+
+    if (!m_hasADT[x][y])
+        return false;
+
+    {
+        std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+        // an ADT loaded on demand is kept from now on if asked for
+        // explicitly.  the flag is only cleared by unloading, which needs
+        // the exclusive lock
+        if (m_loadedADT[x][y])
+        {
+            if (explicitLoad)
+                m_explicitADT[x][y] = true;
+
+            return true;
+        }
+    }
+
+    // the file is read without holding the lock, so that queries may continue
+    // in the meantime
+    std::vector<std::unique_ptr<Tile>> tiles;
+    size_t bytes;
+    fs::file_time_type writeTime;
+    if (!ReadADT(x, y, tiles, bytes, writeTime))
+        return false;
+
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+    CommitADT(x, y, tiles, bytes, writeTime);
+
+    if (explicitLoad)
+        m_explicitADT[x][y] = true;
+
+    EnforceResidencyBudget();
+
+    return true;
+}
+
+std::future<bool> Map::LoadADTAsync(int x, int y)
+{
+    return LoadADTAsync(x, y, true);
+}
+
+std::future<bool> Map::LoadADTAsync(int x, int y, bool explicitLoad)
+{
+    std::promise<bool> promise;
+    auto result = promise.get_future();
+
+    if (!m_hasADT[x][y])
+    {
+        promise.set_value(false);
+        return result;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+        if (m_loadedADT[x][y])
+        {
+            if (explicitLoad)
+                m_explicitADT[x][y] = true;
+
+            promise.set_value(true);
+            return result;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_asyncMutex);
+
+        // if this ADT is already being loaded, share its result
+        for (auto& load : m_asyncLoads)
+            if (load.m_x == x && load.m_y == y)
+            {
+                load.m_explicit = load.m_explicit || explicitLoad;
+                load.m_promises.push_back(std::move(promise));
+                return result;
+            }
+
+        if (!m_asyncThread.joinable())
+            m_asyncThread = std::thread(&Map::AsyncLoadWorker, this);
+
+        m_asyncLoads.emplace_back();
+        m_asyncLoads.back().m_x = x;
+        m_asyncLoads.back().m_y = y;
+        m_asyncLoads.back().m_explicit = explicitLoad;
+        m_asyncLoads.back().m_promises.push_back(std::move(promise));
+    }
+
+    m_asyncCondition.notify_one();
+
+    return result;
+}
+
+void Map::AsyncLoadWorker()
+{
+    std::unique_lock<std::mutex> lock(m_asyncMutex);
+
+    while (true)
+    {
+        auto load = m_asyncLoads.end();
+
+        m_asyncCondition.wait(lock, [this, &load]() {
+            if (m_asyncStop)
+                return true;
+
+            load = std::find_if(
+                m_asyncLoads.begin(), m_asyncLoads.end(),
+                [](const AsyncADTLoad& l) { return !l.m_started; });
+
+            return load != m_asyncLoads.end();
+        });
+
+        if (m_asyncStop)
+            return;
+
+        // list iterators remain valid while other elements are added, and
+        // only finished loads are ever removed
+        load->m_started = true;
+        lock.unlock();
+
+        try
+        {
+            load->m_found = ReadADT(load->m_x, load->m_y, load->m_tiles,
+                                    load->m_bytes, load->m_writeTime);
+        }
+        catch (...)
+        {
+            load->m_error = std::current_exception();
+            load->m_tiles.clear();
+        }
+
+        lock.lock();
+        load->m_finished = true;
+    }
+}
+
+int Map::CommitLoadedADTs()
+{
+    std::list<AsyncADTLoad> finished;
+
+    {
+        std::lock_guard<std::mutex> guard(m_asyncMutex);
+
+        for (auto i = m_asyncLoads.begin(); i != m_asyncLoads.end();)
+        {
+            auto const current = i++;
+            if (current->m_finished)
+                finished.splice(finished.end(), m_asyncLoads, current);
+        }
+
+        // loads left waiting by PrepareFork() begin again
+        if (!m_asyncThread.joinable() && !m_asyncLoads.empty())
+            m_asyncThread = std::thread(&Map::AsyncLoadWorker, this);
+    }
+
+    if (finished.empty())
+        return 0;
+
+    auto result = 0;
+
+    {
+        std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+        for (auto& load : finished)
+        {
+            if (load.m_error || !load.m_found)
+                continue;
+
+            CommitADT(load.m_x, load.m_y, load.m_tiles, load.m_bytes,
+                      load.m_writeTime);
+
+            if (load.m_explicit)
+                m_explicitADT[load.m_x][load.m_y] = true;
+
+            ++result;
+        }
+
+        EnforceResidencyBudget();
+    }
+
+    // the promises are satisfied after the lock is released, so that their
+    // waiters may immediately query the map
+    for (auto& load : finished)
+        for (auto& promise : load.m_promises)
+        {
+            if (load.m_error)
+                promise.set_exception(load.m_error);
+            else
+                promise.set_value(load.m_found);
+        }
+
+    return result;
+}
+
+int Map::PrefetchADTs(float x, float y, float dx, float dy, float distance)
+{
+    if (!m_hasADTs)
+        return 0;
+
+    auto const length = std::sqrt(dx * dx + dy * dy);
+
+    if (length > 0.f)
+    {
+        dx /= length;
+        dy /= length;
+    }
+    else
+        distance = 0.f;
+
+    // sampling twice per ADT is enough not to step over any ADT along the way
+    constexpr float step = MeshSettings::AdtSize / 2.f;
+    auto const steps = static_cast<int>(std::ceil(distance / step));
+
+    auto result = 0;
+    auto lastX = -1, lastY = -1;
+
+    for (auto i = 0; i <= steps; ++i)
+    {
+        auto const t = (std::min)(distance, i * step);
+
+        int adtX, adtY;
+        math::Convert::WorldToAdt({x + dx * t, y + dy * t, 0.f}, adtX, adtY);
+
+        if (adtX == lastX && adtY == lastY)
+            continue;
+
+        lastX = adtX;
+        lastY = adtY;
+
+        if (adtX < 0 || adtY < 0 || adtX >= MeshSettings::Adts ||
+            adtY >= MeshSettings::Adts || !m_hasADT[adtX][adtY] ||
+            IsADTLoaded(adtX, adtY))
+            continue;
+
+        {
+            std::lock_guard<std::mutex> guard(m_asyncMutex);
+
+            auto const pending =
+                std::any_of(m_asyncLoads.begin(), m_asyncLoads.end(),
+                            [adtX, adtY](const AsyncADTLoad& load) {
+                                return load.m_x == adtX && load.m_y == adtY;
+                            });
+
+            if (pending)
+                continue;
+        }
+
+        // prefetched ADTs may be evicted again like those loaded on demand
+        LoadADTAsync(adtX, adtY, false);
+        ++result;
+    }
+
+    return result;
+}
+
+void Map::UnloadADT(int x, int y)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+    UnloadADTLocked(x, y);
+}
+
+const std::string* Map::InternModelName(const std::string& name)
+{
+    return &*m_modelNames.insert(name).first;
+}
+
+WmoInstance* Map::FindStaticWmo(std::uint32_t id)
+{
+    return FindById(m_staticWmoIds, m_staticWmos, id);
+}
+
+DoodadInstance* Map::FindStaticDoodad(std::uint32_t id)
+{
+    return FindById(m_staticDoodadIds, m_staticDoodads, id);
+}
+
+void Map::UnloadADTLocked(int x, int y)
+{
+    if (!m_loadedADT[x][y])
+        return;
+
+    // every tile within this ADT lives in the same block.  the tiles leave
+    // the navmesh now, and are destroyed by the reclaimer
+    if (auto block = std::move(m_tiles[x][y]))
+    {
+        for (auto const& tile : *block)
+            if (tile)
+                tile->Detach();
+
+        {
+            std::lock_guard<std::mutex> guard(m_reclaimMutex);
+
+            if (!m_reclaimThread.joinable())
+                m_reclaimThread = std::thread(&Map::ReclaimWorker, this);
+
+            m_reclaims.push_back(std::move(block));
+        }
+
+        m_reclaimCondition.notify_all();
+    }
+
+    m_loadedADT[x][y] = false;
+    m_explicitADT[x][y] = false;
+
+    m_residentBytes -= m_adtBytes[x][y];
+    m_adtBytes[x][y] = 0;
+}
+
+void Map::ReclaimWorker()
+{
+    std::unique_lock<std::mutex> lock(m_reclaimMutex);
+
+    while (true)
+    {
+        m_reclaimCondition.wait(
+            lock, [this]() { return m_reclaimStop || !m_reclaims.empty(); });
+
+        if (m_reclaims.empty())
+            return;
+
+        auto reclaims = std::move(m_reclaims);
+        m_reclaims.clear();
+        m_reclaiming = true;
+
+        lock.unlock();
+        reclaims.clear();
+        lock.lock();
+
+        m_reclaiming = false;
+        m_reclaimCondition.notify_all();
+    }
+}
+
+void Map::WaitForReclaims()
+{
+    std::unique_lock<std::mutex> lock(m_reclaimMutex);
+
+    m_reclaimCondition.wait(
+        lock, [this]() { return !m_reclaiming && m_reclaims.empty(); });
+}
+
+void Map::SweepExpiredTemporaryObstacles()
+{
+    SweepIfGrown(m_temporaryWmos, m_temporaryWmoSweepSize);
+    SweepIfGrown(m_temporaryDoodads, m_temporaryDoodadSweepSize);
+}
+
+size_t Map::Compact()
+{
+    WaitForReclaims();
+
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    return m_models->Compact() + RemoveExpired(m_temporaryWmos) +
+           RemoveExpired(m_temporaryDoodads);
+}
+
+void Map::SetQueryFilter(const std::string& name, unsigned short includeFlags,
+                         unsigned short excludeFlags)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    auto& filter = m_queryFilters[name];
+    filter.setIncludeFlags(includeFlags);
+    filter.setExcludeFlags(excludeFlags);
+}
+
+const dtQueryFilter& Map::GetQueryFilter(const QueryContext& context,
+                                         const std::string& name) const
+{
+    if (name.empty())
+        return context.m_queryFilter;
+
+    auto const i = m_queryFilters.find(name);
+
+    if (i == m_queryFilters.end())
+        THROW(Result::UNKNOWN_QUERY_FILTER);
+
+    return i->second;
+}
+
+void Map::SetPathCacheCapacity(size_t capacity)
+{
+    m_pathCache.SetCapacity(capacity);
+}
+
+PathCache::Stats Map::GetPathCacheStats() const
+{
+    return m_pathCache.GetStats();
+}
+
+void Map::SetLineOfSightCache(size_t capacity,
+                              std::chrono::milliseconds timeToLive,
+                              float spacing)
+{
+    m_lineOfSightCache.Configure(capacity, timeToLive, spacing);
+}
+
+LineOfSightCache::Stats Map::GetLineOfSightCacheStats() const
+{
+    return m_lineOfSightCache.GetStats();
+}
+
+bool Map::IsReachable(const math::Vertex& start, const math::Vertex& end,
+                      const std::string& filter) const
+{
+    Location startLocation {start};
+    Location endLocation {end};
+
+    return IsReachable(startLocation, endLocation, filter);
+}
+
+bool Map::IsReachable(Location& start, Location& end,
+                      const std::string& filter) const
+{
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.m_position.X, start.m_position.Y, pins);
+    EnsureResident(end.m_position.X, end.m_position.Y, pins);
+
+    constexpr float extents[] = {5.f, 5.f, 5.f};
+
+    float recastStart[3];
+    float recastEnd[3];
+
+    math::Convert::VertexToRecast(start.m_position, recastStart);
+    math::Convert::VertexToRecast(end.m_position, recastEnd);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    start.m_polyRef = FindNearestPoly(context, queryFilter, recastStart,
+                                      extents, start.m_polyRef);
+    end.m_polyRef = FindNearestPoly(context, queryFilter, recastEnd, extents,
+                                    end.m_polyRef);
+
+    return start.m_polyRef && end.m_polyRef &&
+           m_reachability.Connected(m_navMesh, start.m_polyRef,
+                                    end.m_polyRef);
+}
+
+void Map::EnableReachability(bool enabled)
+{
+    m_reachability.SetEnabled(enabled);
+}
+
+Map::CacheStats Map::GetCacheStats() const
+{
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto const models = m_models->GetStats();
+
+    CacheStats result;
+
+    result.m_liveWmoModels = models.m_liveWmoModels;
+    result.m_expiredWmoModels = models.m_expiredWmoModels;
+    result.m_liveDoodadModels = models.m_liveDoodadModels;
+    result.m_expiredDoodadModels = models.m_expiredDoodadModels;
+    result.m_modelBytes = models.m_modelBytes;
+    CountExpired(m_temporaryWmos, result.m_liveTemporaryWmos,
+                 result.m_expiredTemporaryWmos);
+    CountExpired(m_temporaryDoodads, result.m_liveTemporaryDoodads,
+                 result.m_expiredTemporaryDoodads);
+
+    return result;
+}
+
+void Map::SetResidencyBudget(size_t bytes)
+{
+    m_residencyBudget = bytes;
+
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+    EnforceResidencyBudget();
+}
+
+Map::ResidencyStats Map::GetResidencyStats() const
+{
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    ResidencyStats result;
+
+    result.m_budget = m_residencyBudget;
+    result.m_residentBytes = m_residentBytes;
+    result.m_residentADTs = 0;
+    result.m_hits = m_residencyHits;
+    result.m_misses = m_residencyMisses;
+    result.m_evictions = m_residencyEvictions;
+
+    for (auto y = 0; y < MeshSettings::Adts; ++y)
+        for (auto x = 0; x < MeshSettings::Adts; ++x)
+            if (m_loadedADT[x][y])
+                ++result.m_residentADTs;
+
+    return result;
+}
+
+Map::MemoryStats Map::GetMemoryStats() const
+{
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    MemoryStats result;
+
+    result.m_staticInstances =
+        sizeof(std::uint32_t) *
+            (m_staticWmoIds.capacity() + m_staticDoodadIds.capacity()) +
+        sizeof(WmoInstance) * m_staticWmos.capacity() +
+        sizeof(DoodadInstance) * m_staticDoodads.capacity();
+
+    for (auto const& name : m_modelNames)
+        result.m_staticInstances += sizeof(name) + name.capacity();
+
+    result.m_models = 0;
+    result.m_totalBytes = result.m_staticInstances;
+
+    std::unordered_set<const Model*> models;
+
+    for (auto adtY = 0; adtY < MeshSettings::Adts; ++adtY)
+        for (auto adtX = 0; adtX < MeshSettings::Adts; ++adtX)
+        {
+            auto const& block = m_tiles[adtX][adtY];
+
+            if (!block)
+                continue;
+
+            ADTMemory adt {adtX, adtY, m_adtBytes[adtX][adtY], {}, 0};
+            models.clear();
+
+            auto const addModel = [&models, &adt](const Model* model)
+            {
+                if (models.insert(model).second)
+                    adt.m_models += model->m_aabbTree.MemoryUsage();
+            };
+
+            auto empty = true;
+
+            for (auto const& tile : *block)
+            {
+                if (!tile)
+                    continue;
+
+                empty = false;
+                adt.m_tiles += tile->GetMemoryUsage();
+
+                for (auto const& model : tile->m_staticWmoModels)
+                    addModel(model.get());
+                for (auto const& model : tile->m_staticDoodadModels)
+                    addModel(model.get());
+                for (auto const& model : tile->m_temporaryModels)
+                    addModel(model.second.get());
+            }
+
+            if (empty)
+                continue;
+
+            result.m_totalBytes += adt.m_tiles.Total();
+            result.m_adts.push_back(adt);
+        }
+
+    result.m_models = m_models->GetStats().m_modelBytes;
+    result.m_totalBytes += result.m_models;
+
+    return result;
+}
+
+Map::ResidencyPins::~ResidencyPins()
+{
+    for (auto const& adt : m_adts)
+        --m_map.m_adtPins[adt.first][adt.second];
+}
+
+void Map::ResidencyPins::Pin(int x, int y)
+{
+    if (std::find(m_adts.begin(), m_adts.end(), std::make_pair(x, y)) !=
+        m_adts.end())
+        return;
+
+    ++m_map.m_adtPins[x][y];
+    m_adts.emplace_back(x, y);
+}
+
+void Map::EnsureResident(float x, float y, ResidencyPins& pins) const
+{
+    if (!m_hasADTs || !m_residencyBudget)
+        return;
+
+    int adtX, adtY;
+    math::Convert::WorldToAdt({x, y, 0.f}, adtX, adtY);
+
+    if (adtX < 0 || adtY < 0 || adtX >= MeshSettings::Adts ||
+        adtY >= MeshSettings::Adts || !m_hasADT[adtX][adtY])
+        return;
+
+    m_adtLastUsed[adtX][adtY] = ++m_residencyClock;
+
+    // pinned before it is found loaded, so that an eviction which has not
+    // seen the pin has finished by the time IsADTLoaded() takes the lock, and
+    // the ADT is then loaded again
+    pins.Pin(adtX, adtY);
+
+    if (IsADTLoaded(adtX, adtY))
+    {
+        ++m_residencyHits;
+        return;
+    }
+
+    ++m_residencyMisses;
+
+    // maps are never created const.  loading on demand is what the caller
+    // asked for by setting a budget, and LoadADT() does its own locking.
+    const_cast<Map*>(this)->LoadADT(adtX, adtY, false);
+}
+
+bool Map::LoadPathADT(int x, int y, unsigned int& budget,
+                      ResidencyPins& pins) const
+{
+    if (!budget || x < 0 || y < 0 || x >= MeshSettings::Adts ||
+        y >= MeshSettings::Adts || !m_hasADT[x][y] || IsADTLoaded(x, y))
+        return false;
+
+    // marked used first, so that the residency budget evicts others to make
+    // room for it.  as for EnsureResident(), loading is what the caller asked
+    // for by setting a budget
+    m_adtLastUsed[x][y] = ++m_residencyClock;
+    pins.Pin(x, y);
+
+    if (!const_cast<Map*>(this)->LoadADT(x, y, false))
+        return false;
+
+    --budget;
+
+    return true;
+}
+
+bool Map::LoadADTsAlong(const math::Vertex& start, const math::Vertex& end,
+                        unsigned int& budget, ResidencyPins& pins) const
+{
+    if (!m_hasADTs)
+        return false;
+
+    // steps of a quarter of an ADT miss no more than the corners of those
+    // the line crosses, which a path would be unlikely to need
+    auto const length = std::hypot(end.X - start.X, end.Y - start.Y);
+    auto const steps = (std::max)(
+        1, static_cast<int>(std::ceil(length / (MeshSettings::AdtSize / 4.f))));
+
+    auto loaded = false;
+    auto lastX = -1, lastY = -1;
+
+    for (auto i = 0; i <= steps && budget > 0; ++i)
+    {
+        auto const t = static_cast<float>(i) / steps;
+
+        int x, y;
+        math::Convert::WorldToAdt({start.X + t * (end.X - start.X),
+                                   start.Y + t * (end.Y - start.Y), 0.f},
+                                  x, y);
+
+        if (x == lastX && y == lastY)
+            continue;
+
+        lastX = x;
+        lastY = y;
+
+        loaded = LoadPathADT(x, y, budget, pins) || loaded;
+    }
+
+    return loaded;
+}
+
+bool Map::LoadADTsToward(const math::Vertex& start, const math::Vertex& end,
+                         unsigned int& budget, ResidencyPins& pins) const
+{
+    if (!m_hasADTs)
+        return false;
+
+    int startX, startY, endX, endY;
+    math::Convert::WorldToAdt(start, startX, startY);
+    math::Convert::WorldToAdt(end, endX, endY);
+
+    auto const distance = [endX, endY](int x, int y)
+    { return (x - endX) * (x - endX) + (y - endY) * (y - endY); };
+
+    std::vector<std::pair<int, int>> neighbours;
+
+    for (auto y = startY - 1; y <= startY + 1; ++y)
+        for (auto x = startX - 1; x <= startX + 1; ++x)
+            if (distance(x, y) < distance(startX, startY))
+                neighbours.emplace_back(x, y);
+
+    std::sort(neighbours.begin(), neighbours.end(),
+              [&distance](const std::pair<int, int>& a,
+                          const std::pair<int, int>& b)
+              {
+                  return distance(a.first, a.second) <
+                         distance(b.first, b.second);
+              });
+
+    auto loaded = false;
+
+    for (auto const& neighbour : neighbours)
+        loaded = LoadPathADT(neighbour.first, neighbour.second, budget,
+                             pins) ||
+                 loaded;
+
+    return loaded;
+}
+
+void Map::EnforceResidencyBudget()
+{
+    auto const budget = m_residencyBudget.load();
+
+    if (!budget)
+        return;
+
+    while (m_residentBytes > budget)
+    {
+        auto oldestX = -1, oldestY = -1, loaded = 0;
+        auto oldest = (std::numeric_limits<std::uint64_t>::max)();
+
+        for (auto y = 0; y < MeshSettings::Adts; ++y)
+            for (auto x = 0; x < MeshSettings::Adts; ++x)
+            {
+                if (!m_loadedADT[x][y])
+                    continue;
+
+                ++loaded;
+
+                if (m_adtPins[x][y] || m_explicitADT[x][y])
+                    continue;
+
+                if (m_adtLastUsed[x][y] < oldest)
+                {
+                    oldest = m_adtLastUsed[x][y];
+                    oldestX = x;
+                    oldestY = y;
+                }
+            }
+
+        // always keep the most recently used ADT, even when it alone exceeds
+        // the budget.  the others may all be pinned or explicit
+        if (loaded <= 1 || oldestX < 0)
+            break;
+
+        UnloadADTLocked(oldestX, oldestY);
+        ++m_residencyEvictions;
+    }
+}
+
+int Map::LoadAllADTs(unsigned int threads)
+{
+    utility::Trace::Scope trace("Map::LoadAllADTs", "load");
+
+    if (!threads)
+        threads = (std::max)(1u, std::thread::hardware_concurrency());
+
+    int result = 0;
+
+    struct Read
+    {
+        int m_x;
+        int m_y;
+        bool m_found = false;
+        size_t m_bytes = 0;
+        fs::file_time_type m_writeTime;
+        std::vector<std::unique_ptr<Tile>> m_tiles;
+    };
+
+    std::vector<Read> reads;
+
+    for (auto y = 0; y < MeshSettings::Adts; ++y)
+        for (auto x = 0; x < MeshSettings::Adts; ++x)
+        {
+            if (!m_hasADT[x][y])
+                continue;
+
+            if (IsADTLoaded(x, y))
+                ++result;
+            else
+            {
+                reads.emplace_back();
+                reads.back().m_x = x;
+                reads.back().m_y = y;
+            }
+        }
+
+    if (reads.empty())
+        return result;
+
+    // the reads are handed out in order, and handed back as each finishes
+    std::atomic<size_t> next {0};
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<size_t> ready;
+    std::exception_ptr error;
+
+    auto const worker = [&]() {
+        for (size_t i; (i = next++) < reads.size();)
+        {
+            auto& read = reads[i];
+
+            try
+            {
+                read.m_found = ReadADT(read.m_x, read.m_y, read.m_tiles,
+                                       read.m_bytes, read.m_writeTime);
+            }
+            catch (...)
+            {
+                read.m_found = false;
+                read.m_tiles.clear();
+
+                std::lock_guard<std::mutex> guard(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                ready.push_back(i);
+            }
+
+            condition.notify_one();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    auto const count = (std::min)(static_cast<size_t>(threads), reads.size());
+
+    for (auto i = 0u; i < count; ++i)
+        workers.emplace_back(worker);
+
+    // the tiles of every ADT read since the last batch are added to the map
+    // under one acquisition of the lock
+    std::vector<size_t> batch;
+
+    for (size_t committed = 0; committed < reads.size();
+         committed += batch.size())
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&ready]() { return !ready.empty(); });
+            batch.swap(ready);
+            ready.clear();
+        }
+
+        std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+        for (auto const i : batch)
+        {
+            auto& read = reads[i];
+
+            // an ADT loaded meanwhile by another thread is counted all the same
+            if (read.m_found)
+            {
+                CommitADT(read.m_x, read.m_y, read.m_tiles, read.m_bytes,
+                          read.m_writeTime);
+                m_explicitADT[read.m_x][read.m_y] = true;
+                ++result;
+            }
+        }
+
+        EnforceResidencyBudget();
+    }
+
+    for (auto& thread : workers)
+        thread.join();
+
+    if (error)
+        std::rethrow_exception(error);
+
+    return result;
+}
+
+std::unique_ptr<Map> Map::CloneForInstance() const
+{
+    auto clone =
+        std::make_unique<Map>(m_models, m_dataPath, m_mapName, m_queryLimits);
+
+    std::vector<std::pair<int, int>> adts;
+
+    {
+        std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+        // the clone is not yet visible to any other thread
+        clone->m_queryFilters = m_queryFilters;
+        clone->m_residencyBudget = m_residencyBudget.load();
+        clone->m_straightPathDistance = m_straightPathDistance.load();
+        clone->m_pathLoadBudget = m_pathLoadBudget.load();
+        clone->m_modelLoadThreads = m_modelLoadThreads.load();
+        clone->m_reachability.SetEnabled(m_reachability.Enabled());
+
+        if (!clone->m_residencyBudget)
+            for (auto y = 0; y < MeshSettings::Adts; ++y)
+                for (auto x = 0; x < MeshSettings::Adts; ++x)
+                    if (m_loadedADT[x][y])
+                        adts.emplace_back(x, y);
+    }
+
+    // the nav files are mapped copy-on-write, so the pages detour does not
+    // write are shared with this map by the operating system
+    for (auto const& adt : adts)
+        clone->LoadADT(adt.first, adt.second);
+
+    return clone;
+}
+
+void Map::QueryInstances(const math::BoundingBox& bounds,
+                         std::vector<InstanceInfo>& output) const
+{
+    m_staticWmoBounds.Overlap(bounds, [this, &output](const InstanceBounds& i) {
+        output.push_back({m_staticWmoIds[i.m_index], true, false, i.m_bounds,
+                          *m_staticWmos[i.m_index].m_modelFilename});
+    });
+
+    m_staticDoodadBounds.Overlap(
+        bounds, [this, &output](const InstanceBounds& i) {
+            output.push_back({m_staticDoodadIds[i.m_index], false, false,
+                              i.m_bounds,
+                              *m_staticDoodads[i.m_index].m_modelFilename});
+        });
+
+    // there are few enough game objects to check each of them
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    for (auto const& entry : m_temporaryWmos)
+        if (auto const instance = entry.second.lock())
+            if (bounds.intersect(instance->m_bounds))
+                output.push_back({entry.first, true, true, instance->m_bounds,
+                                  *instance->m_modelFilename});
+
+    for (auto const& entry : m_temporaryDoodads)
+        if (auto const instance = entry.second.lock())
+            if (bounds.intersect(instance->m_bounds))
+                output.push_back({entry.first, false, true, instance->m_bounds,
+                                  *instance->m_modelFilename});
+}
+
+void Map::QueryInstances(const math::Vertex& position, float radius,
+                         std::vector<InstanceInfo>& output) const
+{
+    const math::Vertex extent {radius, radius, radius};
+    const math::BoundingBox bounds {position - extent, position + extent};
+
+    auto const first = output.size();
+    QueryInstances(bounds, output);
+
+    // the box reaches further than the radius at its corners
+    auto const outside = [&position, radius](const InstanceInfo& instance) {
+        auto const& min = instance.m_bounds.MinCorner;
+        auto const& max = instance.m_bounds.MaxCorner;
+
+        math::Vertex nearest {(std::max)(min.X, (std::min)(position.X, max.X)),
+                              (std::max)(min.Y, (std::min)(position.Y, max.Y)),
+                              (std::max)(min.Z, (std::min)(position.Z, max.Z))};
+
+        return nearest.GetDistance(position) > radius;
+    };
+
+    output.erase(
+        std::remove_if(output.begin() + first, output.end(), outside),
+        output.end());
+}
+
+std::shared_ptr<Model> Map::GetOrLoadModelByDisplayId(unsigned int displayId)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    // Get the BVH file for this display ID
+    auto const bvh_path = m_models->GetBVH().GetBVHPath(displayId);
+
+    if (ModelCache::IsWmoBVH(bvh_path))
+        return m_models->LoadWmoModel(bvh_path);
+
+    return m_models->LoadDoodadModel(bvh_path);
+}
+
+std::future<size_t>
+Map::PreloadModels(const std::vector<std::string>& mpqPaths,
+                   const std::vector<unsigned int>& displayIds,
+                   unsigned int threads)
+{
+    std::vector<std::string> bvhFiles;
+    bvhFiles.reserve(mpqPaths.size() + displayIds.size());
+
+    // unknown models are skipped here, as those which fail to load are below
+    for (auto const& mpqPath : mpqPaths)
+    {
+        try
+        {
+            bvhFiles.push_back(m_models->GetBVH().GetBVHPath(mpqPath));
+        }
+        catch (const utility::exception&)
+        {
+        }
+    }
+
+    for (auto const displayId : displayIds)
+    {
+        try
+        {
+            bvhFiles.push_back(m_models->GetBVH().GetBVHPath(displayId));
+        }
+        catch (const utility::exception&)
+        {
+        }
+    }
+
+    return PreloadBVHFiles(std::move(bvhFiles), threads);
+}
+
+std::future<size_t> Map::PreloadModels(const std::filesystem::path& manifest,
+                                       unsigned int threads)
+{
+    std::ifstream in(manifest);
+    if (!in)
+        THROW(Result::FAILED_TO_OPEN_FILE_FOR_BINARY_STREAM);
+
+    std::vector<std::string> bvhFiles;
+    for (std::string line; std::getline(in, line);)
+        if (!line.empty())
+            bvhFiles.push_back((m_dataPath / "BVH" / line).string());
+
+    return PreloadBVHFiles(std::move(bvhFiles), threads);
+}
+
+std::future<size_t> Map::PreloadBVHFiles(std::vector<std::string> bvhFiles,
+                                         unsigned int threads)
+{
+    struct Preload
+    {
+        std::vector<std::string> m_bvhFiles;
+        std::atomic_size_t m_next {0};
+        std::atomic_size_t m_loaded {0};
+        std::atomic_uint m_running {0};
+        std::promise<size_t> m_promise;
+    };
+
+    auto const preload = std::make_shared<Preload>();
+
+    std::sort(bvhFiles.begin(), bvhFiles.end());
+    bvhFiles.erase(std::unique(bvhFiles.begin(), bvhFiles.end()),
+                   bvhFiles.end());
+    preload->m_bvhFiles = std::move(bvhFiles);
+
+    auto result = preload->m_promise.get_future();
+
+    threads = (std::max)(1u, threads);
+    preload->m_running = threads;
+
+    auto const work = [this, preload]() {
+        for (auto i = preload->m_next++;
+             !m_preloadStop && i < preload->m_bvhFiles.size();
+             i = preload->m_next++)
+        {
+            auto const& bvhFile = preload->m_bvhFiles[i];
+
+            try
+            {
+                std::shared_ptr<Model> model;
+                if (ModelCache::IsWmoBVH(bvhFile))
+                    model = m_models->LoadWmoModel(bvhFile);
+                else
+                    model = m_models->LoadDoodadModel(bvhFile);
+
+                std::lock_guard<std::mutex> guard(m_preloadedModelMutex);
+                m_preloadedModels.push_back(std::move(model));
+                ++preload->m_loaded;
+            }
+            catch (const std::exception&)
+            {
+            }
+        }
+
+        if (--preload->m_running == 0)
+            preload->m_promise.set_value(preload->m_loaded);
+    };
+
+    std::lock_guard<std::mutex> guard(m_preloadMutex);
+
+    // the threads of earlier preloads which have finished need only be joined
+    auto const joined = [](PreloadThread& thread) {
+        if (!*thread.m_finished)
+            return false;
+
+        thread.m_thread.join();
+        return true;
+    };
+
+    m_preloadThreads.erase(std::remove_if(m_preloadThreads.begin(),
+                                          m_preloadThreads.end(), joined),
+                           m_preloadThreads.end());
+
+    for (auto i = 0u; i < threads; ++i)
+    {
+        auto const finished = std::make_shared<std::atomic_bool>(false);
+
+        std::thread thread([work, finished]() {
+            work();
+            *finished = true;
+        });
+
+        m_preloadThreads.push_back({std::move(thread), finished});
+    }
+
+    return result;
+}
+
+size_t Map::SaveModelManifest(const std::filesystem::path& manifest) const
+{
+    auto bvhFiles = m_models->LoadedBVHFiles();
+
+    std::sort(bvhFiles.begin(), bvhFiles.end());
+    bvhFiles.erase(std::unique(bvhFiles.begin(), bvhFiles.end()),
+                   bvhFiles.end());
+
+    std::ofstream out(manifest, std::ofstream::trunc);
+    for (auto const& bvhFile : bvhFiles)
+        out << bvhFile << "\n";
+
+    if (!out)
+        THROW(Result::FAILED_TO_OPEN_FILE_FOR_BINARY_STREAM);
+
+    return bvhFiles.size();
+}
+
+void Map::ReleasePreloadedModels()
+{
+    std::lock_guard<std::mutex> guard(m_preloadedModelMutex);
+    m_preloadedModels.clear();
+}
+
+bool Map::ResolveLocation(const math::Vertex& position, Location& location,
+                          const std::string& filter) const
+{
+    ResidencyPins pins(*this);
+
+    EnsureResident(position.X, position.Y, pins);
+
+    constexpr float extents[] = {5.f, 5.f, 5.f};
+
+    float recastPosition[3];
+    math::Convert::VertexToRecast(position, recastPosition);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& navQuery = context.m_navQuery;
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    location.m_position = position;
+
+    // a creature which has barely moved is most likely still over the same
+    // polygon, which the hint keeps without searching
+    location.m_polyRef = FindNearestPoly(context, queryFilter, recastPosition,
+                                         extents, location.m_polyRef);
+
+    return location.m_polyRef != 0;
+}
+
+bool Map::FindPath(const math::Vertex& start, const math::Vertex& end,
+                   std::vector<math::Vertex>& output, bool allowPartial,
+                   const std::string& filter) const
+{
+    Location startLocation {start};
+    Location endLocation {end};
+
+    return FindPath(startLocation, endLocation, output, allowPartial, filter);
+}
+
+bool Map::FindPath(Location& startLocation, Location& endLocation,
+                   std::vector<math::Vertex>& output, bool allowPartial,
+                   const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindPath);
+
+    auto const& start = startLocation.m_position;
+    auto const& end = endLocation.m_position;
+
+    QueryRecorder::Record record(m_recorder, QueryRecorder::Query::FindPath,
+                                 start, end, allowPartial, filter);
+
+    std::vector<math::Vertex> waypoints;
+    FindPortalRoute(start, end, waypoints);
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    for (auto const& waypoint : waypoints)
+        EnsureResident(waypoint.X, waypoint.Y, pins);
+
+    auto budget = m_pathLoadBudget.load();
+
+    if (budget > 0)
+    {
+        if (waypoints.empty())
+            LoadADTsAlong(start, end, budget, pins);
+        else
+            for (auto i = 1u; i < waypoints.size(); ++i)
+                LoadADTsAlong(waypoints[i - 1], waypoints[i], budget, pins);
+    }
+
+    for (;;)
+    {
+        {
+            std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+            output.clear();
+
+            auto& context = GetQueryContext();
+            auto const& queryFilter = GetQueryFilter(context, filter);
+
+            if (!waypoints.empty() &&
+                FindPath(context, queryFilter, waypoints, output))
+                return record.Finish(true, output);
+
+            // while more ADTs may be loaded, a partial path is only of use
+            // for where it stops
+            auto const retry = budget > 0;
+            auto const found = FindPath(
+                context, queryFilter, start, end, output,
+                allowPartial && !retry, &startLocation.m_polyRef,
+                &endLocation.m_polyRef);
+
+            if (found || !retry)
+                return record.Finish(found, output);
+
+            output.clear();
+
+            if (!FindPath(context, queryFilter, start, end, output, true,
+                          &startLocation.m_polyRef, &endLocation.m_polyRef) ||
+                output.empty())
+                return record.Finish(false, output);
+        }
+
+        if (!LoadADTsToward(output.back(), end, budget, pins))
+        {
+            // this is as far as the path goes
+            if (!allowPartial)
+                output.clear();
+
+            return record.Finish(allowPartial, output);
+        }
+    }
+}
+
+bool Map::FindRefinedPath(const math::Vertex& start, const math::Vertex& end,
+                          float spacing, std::vector<math::Vertex>& output,
+                          bool allowPartial, const std::string& filter) const
+{
+    Location startLocation {start};
+    Location endLocation {end};
+
+    return FindRefinedPath(startLocation, endLocation, spacing, output,
+                           allowPartial, filter);
+}
+
+bool Map::FindRefinedPath(Location& startLocation, Location& endLocation,
+                          float spacing, std::vector<math::Vertex>& output,
+                          bool allowPartial, const std::string& filter) const
+{
+    // this is not recorded, since a recording replays paths by FindPath()
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindPath);
+
+    auto const& start = startLocation.m_position;
+    auto const& end = endLocation.m_position;
+
+    std::vector<math::Vertex> waypoints;
+    FindPortalRoute(start, end, waypoints);
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    for (auto const& waypoint : waypoints)
+        EnsureResident(waypoint.X, waypoint.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    output.clear();
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+    auto const refine = (std::max)(0.f, spacing);
+
+    if (!waypoints.empty() &&
+        FindPath(context, queryFilter, waypoints, output, refine))
+        return true;
+
+    return FindPath(context, queryFilter, start, end, output, allowPartial,
+                    &startLocation.m_polyRef, &endLocation.m_polyRef, refine);
+}
+
+bool Map::FindAgentPath(AgentSize agent, const math::Vertex& start,
+                        const math::Vertex& end,
+                        std::vector<math::Vertex>& output, bool allowPartial,
+                        const std::string& filter) const
+{
+    if (agent == GetAgentSize())
+        return FindPath(start, end, output, allowPartial, filter);
+
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindPath);
+
+    output.clear();
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto const navMesh = FindAgentNavMesh(agent);
+
+    if (!navMesh)
+        return false;
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+    auto& navQuery = context.m_agentQueries[static_cast<int>(agent)];
+
+    if (!navQuery)
+    {
+        auto newQuery = std::make_unique<dtNavMeshQuery>();
+
+        if (newQuery->init(navMesh, m_queryLimits.m_maxNodes) != DT_SUCCESS)
+            THROW(Result::DTNAVMESHQUERY_INIT_FAILED);
+
+        navQuery = std::move(newQuery);
+    }
+
+    return FindPath(context, *navQuery, queryFilter, start, end, output,
+                    allowPartial, nullptr, nullptr);
+}
+
+bool Map::FindShortPath(const math::Vertex& start, const math::Vertex& end,
+                        float maxDistance, std::vector<math::Vertex>& output,
+                        const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindPath);
+
+    output.clear();
+
+    if (start.GetDistance(end) > maxDistance)
+        return false;
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    if (!FindPath(context, context.m_shortPathQuery, queryFilter, start, end,
+                  output, false, nullptr, nullptr))
+    {
+        output.clear();
+        return false;
+    }
+
+    auto length = 0.f;
+    for (auto i = 1u; i < output.size(); ++i)
+        length += output[i - 1].GetDistance(output[i]);
+
+    if (length > maxDistance)
+    {
+        output.clear();
+        return false;
+    }
+
+    return true;
+}
+
+std::unique_ptr<PathRequest>
+Map::CreatePathRequest(const math::Vertex& start, const math::Vertex& end,
+                       bool allowPartial) const
+{
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    // the constructor is only accessible to the map
+    return std::unique_ptr<PathRequest>(
+        new PathRequest(*this, start, end, allowPartial));
+}
+
+std::unique_ptr<PathCorridor>
+Map::CreatePathCorridor(const math::Vertex& start, const math::Vertex& end,
+                        const std::string& filter) const
+{
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+
+    return std::unique_ptr<PathCorridor>(new PathCorridor(
+        *this, context, GetQueryFilter(context, filter), start, end));
+}
+
+std::unique_ptr<Crowd> Map::CreateCrowd(int maxAgents, float maxAgentRadius,
+                                        const std::string& filter)
+{
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto const& context = GetQueryContext();
+
+    return std::unique_ptr<Crowd>(new Crowd(*this, m_navMesh, maxAgents,
+                                            maxAgentRadius,
+                                            GetQueryFilter(context, filter)));
+}
+
+size_t Map::FindPaths(const math::Vertex* starts, const math::Vertex* ends,
+                      size_t count, std::vector<math::Vertex>& output,
+                      std::vector<std::uint32_t>& offsets, bool allowPartial,
+                      unsigned int threads, const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindPaths);
+
+    output.clear();
+    offsets.assign(count + 1, 0);
+
+    if (!count)
+        return 0;
+
+    threads = (std::max)(
+        1u, (std::min)(threads, static_cast<unsigned int>(count)));
+
+    // portal routes do not need the navmesh, so they are found before taking
+    // the lock
+    std::vector<std::vector<math::Vertex>> routes(count);
+
+    ResidencyPins pins(*this);
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        FindPortalRoute(starts[i], ends[i], routes[i]);
+
+        EnsureResident(starts[i].X, starts[i].Y, pins);
+        EnsureResident(ends[i].X, ends[i].Y, pins);
+
+        for (auto const& waypoint : routes[i])
+            EnsureResident(waypoint.X, waypoint.Y, pins);
+    }
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    // each thread handles a contiguous slice of the batch.  while running,
+    // offsets[i + 1] holds the length of path i.  these are converted to
+    // offsets once all slices are done.
+    auto const sliceSize = (count + threads - 1) / threads;
+    std::vector<std::vector<math::Vertex>> sliceOutput(threads);
+    std::vector<size_t> sliceFound(threads, 0);
+
+    auto const findSlice = [&](unsigned int slice, QueryContext& context)
+    {
+        auto const begin = slice * sliceSize;
+        auto const end = (std::min)(count, begin + sliceSize);
+        auto& out = sliceOutput[slice];
+        auto const& queryFilter = GetQueryFilter(context, filter);
+
+        for (auto i = begin; i < end; ++i)
+        {
+            auto const before = out.size();
+
+            if ((!routes[i].empty() &&
+                 FindPath(context, queryFilter, routes[i], out)) ||
+                FindPath(context, queryFilter, starts[i], ends[i], out,
+                         allowPartial))
+                ++sliceFound[slice];
+
+            offsets[i + 1] = static_cast<std::uint32_t>(out.size() - before);
+        }
+    };
+
+    // the shared lock held by this thread covers the pool's threads too, so
+    // they must not attempt to lock the map themselves
+    if (threads == 1)
+        findSlice(0, GetQueryContext());
+    else
+        GetBatchPool().RunBatch(
+            threads, [&](unsigned int slice)
+            { findSlice(slice, GetQueryContext()); });
+
+    for (auto i = 0u; i < count; ++i)
+        offsets[i + 1] += offsets[i];
+
+    output.reserve(offsets[count]);
+
+    size_t result = 0;
+    for (auto slice = 0u; slice < threads; ++slice)
+    {
+        output.insert(output.end(), sliceOutput[slice].begin(),
+                      sliceOutput[slice].end());
+        result += sliceFound[slice];
+    }
+
+    return result;
+}
+
+dtPolyRef Map::FindNearestPoly(QueryContext& context,
+                               const dtQueryFilter& filter,
+                               const float* position, const float* extents,
+                               dtPolyRef hint) const
+{
+    return FindNearestPoly(context.m_navQuery, filter, position, extents,
+                           hint);
+}
+
+dtPolyRef Map::FindNearestPoly(const dtNavMeshQuery& navQuery,
+                               const dtQueryFilter& filter,
+                               const float* position, const float* extents,
+                               dtPolyRef hint)
+{
+    // the salt within the reference makes this fail for polygons of tiles
+    // which have since been removed, even if another tile now occupies the
+    // same slot.  but a tile rebuilt beneath temporary obstacles is added
+    // again under its old reference, salt and all, so that the hint may then
+    // name another polygon of the new mesh, or one which no longer exists
+    // there.  it is only kept while the position is still over it
+    if (hint && navQuery.isValidPolyRef(hint, &filter))
+    {
+        float closest[3];
+        bool overPoly;
+
+        if (dtStatusSucceed(navQuery.closestPointOnPoly(hint, position,
+                                                        closest, &overPoly)) &&
+            overPoly && std::fabs(closest[1] - position[1]) <= extents[1])
+            return hint;
+    }
+
+    dtPolyRef result;
+    if (!(navQuery.findNearestPoly(position, extents, &filter, &result,
+                                   nullptr) &
+          DT_SUCCESS))
+        return 0;
+
+    return result;
+}
+
+bool Map::FindPath(QueryContext& context, const dtQueryFilter& queryFilter,
+                   const math::Vertex& start, const math::Vertex& end,
+                   std::vector<math::Vertex>& output, bool allowPartial,
+                   dtPolyRef* startPoly, dtPolyRef* endPoly,
+                   float refine) const
+{
+    return FindPath(context, context.m_navQuery, queryFilter, start, end,
+                    output, allowPartial, startPoly, endPoly, refine);
+}
+
+bool Map::FindPath(QueryContext& context, const dtNavMeshQuery& navQuery,
+                   const dtQueryFilter& queryFilter, const math::Vertex& start,
+                   const math::Vertex& end, std::vector<math::Vertex>& output,
+                   bool allowPartial, dtPolyRef* startPoly,
+                   dtPolyRef* endPoly, float refine) const
+{
+    constexpr float extents[] = {5.f, 5.f, 5.f};
+
+    float recastStart[3];
+    float recastEnd[3];
+
+    math::Convert::VertexToRecast(start, recastStart);
+    math::Convert::VertexToRecast(end, recastEnd);
+
+    auto const maxPathHops = m_queryLimits.m_maxPathHops;
+
+    auto const startPolyRef =
+        FindNearestPoly(navQuery, queryFilter, recastStart, extents,
+                        startPoly ? *startPoly : 0);
+
+    if (startPoly)
+        *startPoly = startPolyRef;
+
+    if (!startPolyRef)
+    {
+        m_metrics.RecordFailure(QueryMetrics::Failure::NoStartPoly);
+        return false;
+    }
+
+    auto const endPolyRef = FindNearestPoly(
+        navQuery, queryFilter, recastEnd, extents, endPoly ? *endPoly : 0);
+
+    if (endPoly)
+        *endPoly = endPolyRef;
+
+    if (!endPolyRef)
+    {
+        m_metrics.RecordFailure(QueryMetrics::Failure::NoEndPoly);
+        return false;
+    }
+
+    if (!allowPartial && m_reachability.Enabled() &&
+        navQuery.getAttachedNavMesh() == &m_navMesh &&
+        !m_reachability.Connected(m_navMesh, startPolyRef, endPolyRef))
+    {
+        m_metrics.RecordFailure(QueryMetrics::Failure::Unreachable);
+        return false;
+    }
+
+    auto const polyRefBuffer = &context.m_polyRefs[0];
+
+    int pathLength;
+
+    // when the end can be seen along the surface from the start, the polygons
+    // the ray crossed are the corridor.  the ray is in two dimensions, so the
+    // polygon at which it ends must be that of the end, rather than one above
+    // or below it
+    auto const straightDistance = m_straightPathDistance.load();
+    auto straight = false;
+
+    if (straightDistance > 0.f && start.GetDistance(end) <= straightDistance)
+    {
+        // detour reports a ray which reached its end as hitting at infinity
+        constexpr auto reached = (std::numeric_limits<float>::max)();
+        float t, hitNormal[3];
+
+        straight = !!(navQuery.raycast(startPolyRef, recastStart, recastEnd,
+                                       &queryFilter, &t, hitNormal,
+                                       polyRefBuffer, &pathLength,
+                                       maxPathHops) &
+                      DT_SUCCESS) &&
+                   t == reached && pathLength > 0 &&
+                   polyRefBuffer[pathLength - 1] == endPolyRef;
+
+        if (straight)
+            m_metrics.RecordStraightPath();
+    }
+
+    const PathCache::Key cacheKey {startPolyRef, endPolyRef,
+                                   queryFilter.getIncludeFlags(),
+                                   queryFilter.getExcludeFlags()};
+    auto const useCache =
+        &navQuery == &context.m_navQuery && m_pathCache.Enabled();
+
+    auto partial = false;
+
+    if (!straight &&
+        (!useCache || !m_pathCache.Find(cacheKey, polyRefBuffer, maxPathHops,
+                                        pathLength, partial)))
+    {
+        auto const findPathResult = navQuery.findPath(
+            startPolyRef, endPolyRef, recastStart, recastEnd, &queryFilter,
+            polyRefBuffer, &pathLength, maxPathHops);
+        if (!(findPathResult & DT_SUCCESS))
+        {
+            m_metrics.RecordFailure(QueryMetrics::Failure::NoPath);
+            return false;
+        }
+
+        partial = !!(findPathResult & DT_PARTIAL_RESULT);
+
+        if (useCache)
+            m_pathCache.Insert(m_navMesh, cacheKey, polyRefBuffer, pathLength,
+                               partial);
+    }
+
+    if (partial)
+        m_metrics.RecordFailure(pathLength >= maxPathHops
+                                    ? QueryMetrics::Failure::HopLimit
+                                    : QueryMetrics::Failure::PartialPath);
+
+    if (!allowPartial && partial)
+        return false;
+
+    auto const corridorLength = pathLength;
+    auto const pathBuffer = &context.m_pathBuffer[0];
+    auto const findStraightPathResult = navQuery.findStraightPath(
+        recastStart, recastEnd, polyRefBuffer, pathLength, pathBuffer, nullptr,
+        nullptr, &pathLength, maxPathHops);
+
+    if (!!(findStraightPathResult & DT_BUFFER_TOO_SMALL))
+        m_metrics.RecordFailure(QueryMetrics::Failure::HopLimit);
+    if (!(findStraightPathResult & DT_SUCCESS) ||
+        (!allowPartial && !!(findStraightPathResult & DT_PARTIAL_RESULT)))
+        return false;
+
+    auto const first = output.size();
+    output.resize(first + pathLength);
+
+    for (auto i = 0; i < pathLength; ++i)
+        math::Convert::VertexToWow(&pathBuffer[i * 3], output[first + i]);
+
+    if (refine >= 0.f)
+        RefinePath(navQuery, polyRefBuffer, corridorLength, refine, output,
+                   first);
+
+    return true;
+}
+
+void Map::RefinePath(const dtNavMeshQuery& navQuery,
+                     const dtPolyRef* corridor, int corridorLength,
+                     float spacing, std::vector<math::Vertex>& output,
+                     size_t first) const
+{
+    if (spacing > 0.f)
+    {
+        std::vector<math::Vertex> points;
+        points.reserve(output.size() - first);
+
+        for (auto i = first; i < output.size(); ++i)
+        {
+            if (i > first)
+            {
+                auto const& a = output[i - 1];
+                auto const& b = output[i];
+                auto const steps =
+                    static_cast<int>(std::ceil(a.GetDistance(b) / spacing));
+
+                for (auto s = 1; s < steps; ++s)
+                {
+                    auto const t = static_cast<float>(s) / steps;
+                    points.emplace_back(a.X + t * (b.X - a.X),
+                                        a.Y + t * (b.Y - a.Y),
+                                        a.Z + t * (b.Z - a.Z));
+                }
+            }
+
+            points.push_back(output[i]);
+        }
+
+        output.resize(first);
+        output.insert(output.end(), points.begin(), points.end());
+    }
+
+    auto polygon = 0;
+
+    for (auto i = first; i < output.size(); ++i)
+    {
+        auto& point = output[i];
+
+        float recastPoint[3];
+        math::Convert::VertexToRecast(point, recastPoint);
+
+        // the corridor goes no further back than the polygon of the previous
+        // point.  a point may be on the edge of several, and is given the
+        // height of the first
+        for (auto p = polygon; p < corridorLength; ++p)
+        {
+            float height;
+            if (dtStatusSucceed(
+                    navQuery.getPolyHeight(corridor[p], recastPoint, &height)))
+            {
+                polygon = p;
+                point.Z = height;
+                break;
+            }
+        }
+
+        // as in FindHeight(), the height of the mesh is the hint from which
+        // the precise height is found
+        auto const tile = GetTile(point.X, point.Y);
+
+        float z;
+        if (tile && FindNextZ(tile, point.X, point.Y, point.Z, true, z))
+            point.Z = z;
+    }
+}
+
+bool Map::MeshReplacedSince(std::uint64_t generation, const dtPolyRef* polys,
+                            int count) const
+{
+    if (generation == m_meshGeneration)
+        return false;
+
+    for (auto i = 0; i < count; ++i)
+        if (m_tileGenerations[m_navMesh.decodePolyIdTile(polys[i])] >
+            generation)
+            return true;
+
+    return false;
+}
+
+std::uint64_t Map::GetTileGeneration(dtTileRef ref) const
+{
+    auto const tile = m_navMesh.decodePolyIdTile(ref);
+
+    return tile < m_tileGenerations.size() ? m_tileGenerations[tile] : 0;
+}
+
+bool Map::FindPortalRoute(const math::Vertex& start, const math::Vertex& end,
+                          std::vector<math::Vertex>& waypoints) const
+{
+    if (!m_hasADTs)
+        return false;
+
+    float startX, startY, endX, endY;
+    WorldToTile(start.X, start.Y, startX, startY);
+    WorldToTile(end.X, end.Y, endX, endY);
+
+    // nearby paths are well within what a single search can handle
+    if (std::fabs(startX - endX) < HierarchicalPathTiles &&
+        std::fabs(startY - endY) < HierarchicalPathTiles)
+        return false;
+
+    float recastStart[3];
+    float recastEnd[3];
+
+    math::Convert::VertexToRecast(start, recastStart);
+    math::Convert::VertexToRecast(end, recastEnd);
+
+    std::vector<std::array<float, 3>> route;
+    if (!m_portalGraph.FindRoute(
+            recastStart, static_cast<int>(std::floor(startX)),
+            static_cast<int>(std::floor(startY)), recastEnd,
+            static_cast<int>(std::floor(endX)),
+            static_cast<int>(std::floor(endY)), route))
+        return false;
+
+    m_metrics.RecordPortalRoute();
+
+    // a route crosses each tile border through a pair of portals, one either
+    // side of it.  only portals some distance apart are kept, so that each
+    // refining search is long enough for detour to smooth the path, but
+    // short enough to stay well within its node and hop limits.
+    constexpr float span = RefineTileSpan * MeshSettings::TileSize;
+
+    waypoints.push_back(start);
+
+    const float* last = recastStart;
+    for (auto const& point : route)
+    {
+        if (dtVdist(last, point.data()) < span ||
+            dtVdist(point.data(), recastEnd) < span)
+            continue;
+
+        math::Vertex waypoint;
+        math::Convert::VertexToWow(point.data(), waypoint);
+        waypoints.push_back(waypoint);
+
+        last = point.data();
+    }
+
+    waypoints.push_back(end);
+
+    return true;
+}
+
+bool Map::FindPath(QueryContext& context, const dtQueryFilter& queryFilter,
+                   const std::vector<math::Vertex>& waypoints,
+                   std::vector<math::Vertex>& output, float refine) const
+{
+    auto const first = output.size();
+
+    for (auto i = 1u; i < waypoints.size(); ++i)
+    {
+        auto const before = output.size();
+
+        // a waypoint which cannot be reached means that the route has gone
+        // through a portal which is blocked or not loaded
+        if (!FindPath(context, queryFilter, waypoints[i - 1], waypoints[i],
+                      output, false, nullptr, nullptr, refine))
+        {
+            output.resize(first);
+            return false;
+        }
+
+        // each segment begins where the previous one ended
+        if (before > first && output.size() > before)
+            output.erase(output.begin() + before);
+    }
+
+    return true;
+}
+
+void Map::WorldToTile(float x, float y, float& tileX, float& tileY) const
+{
+    constexpr float mapOrigin = (MeshSettings::Adts / 2) * MeshSettings::AdtSize;
+
+    // maps based on a global WMO have their tiles positioned differently
+    auto const originX = HasADTs() ? mapOrigin : m_globalWmoOriginX;
+    auto const originY = HasADTs() ? mapOrigin : m_globalWmoOriginY;
+
+    tileX = (originY - y) / MeshSettings::TileSize;
+    tileY = (originX - x) / MeshSettings::TileSize;
+}
+
+const Tile* Map::GetTile(float x, float y) const
+{
+    // find the tile corresponding to this (x, y)
+    float tileX, tileY;
+    WorldToTile(x, y, tileX, tileY);
+
+    return GetTileAt(static_cast<int>(std::floor(tileX)),
+                     static_cast<int>(std::floor(tileY)));
+}
+
+Tile* Map::GetTileAt(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= MeshSettings::TileCount ||
+        y >= MeshSettings::TileCount)
+        return nullptr;
+
+    auto const& block =
+        m_tiles[x / MeshSettings::TilesPerADT][y / MeshSettings::TilesPerADT];
+
+    if (!block)
+        return nullptr;
+
+    return (*block)[(y % MeshSettings::TilesPerADT) *
+                        MeshSettings::TilesPerADT +
+                    x % MeshSettings::TilesPerADT]
+        .get();
+}
+
+void Map::InsertTile(std::unique_ptr<Tile> tile)
+{
+    if (tile->m_x < 0 || tile->m_y < 0 ||
+        tile->m_x >= MeshSettings::TileCount ||
+        tile->m_y >= MeshSettings::TileCount)
+        THROW(Result::INCORRECT_ADT_COORDINATES);
+
+    m_lineOfSightCache.InvalidateTile(tile->m_x, tile->m_y);
+
+    auto& block = m_tiles[tile->m_x / MeshSettings::TilesPerADT]
+                         [tile->m_y / MeshSettings::TilesPerADT];
+
+    if (!block)
+        block = std::make_unique<TileBlock>();
+
+    (*block)[(tile->m_y % MeshSettings::TilesPerADT) *
+                 MeshSettings::TilesPerADT +
+             tile->m_x % MeshSettings::TilesPerADT] = std::move(tile);
+}
+
+void Map::FindTilesOnRay(const math::Ray& ray,
+                         std::vector<const Tile*>& tiles) const
+{
+    auto const& start = ray.GetStartPoint();
+    auto const& end = ray.GetEndPoint();
+
+    float startX, startY, endX, endY;
+    WorldToTile(start.X, start.Y, startX, startY);
+    WorldToTile(end.X, end.Y, endX, endY);
+
+    // walk the grid from the start tile to the end tile, one tile boundary at
+    // a time, as described by Amanatides and Woo.  at each step we cross
+    // whichever boundary (x or y) the ray reaches first.
+    auto x = static_cast<int>(std::floor(startX));
+    auto y = static_cast<int>(std::floor(startY));
+    auto const lastX = static_cast<int>(std::floor(endX));
+    auto const lastY = static_cast<int>(std::floor(endY));
+
+    auto const deltaX = endX - startX;
+    auto const deltaY = endY - startY;
+
+    auto const stepX = deltaX > 0.f ? 1 : -1;
+    auto const stepY = deltaY > 0.f ? 1 : -1;
+
+    constexpr float infinity = (std::numeric_limits<float>::max)();
+
+    // distance along the ray (as a fraction of its length) needed to cross
+    // one whole tile in each dimension
+    auto const tDeltaX = deltaX != 0.f ? std::fabs(1.f / deltaX) : infinity;
+    auto const tDeltaY = deltaY != 0.f ? std::fabs(1.f / deltaY) : infinity;
+
+    // distance along the ray to the first boundary in each dimension
+    auto tMaxX = infinity, tMaxY = infinity;
+
+    if (deltaX > 0.f)
+        tMaxX = (x + 1 - startX) * tDeltaX;
+    else if (deltaX < 0.f)
+        tMaxX = (startX - x) * tDeltaX;
+
+    if (deltaY > 0.f)
+        tMaxY = (y + 1 - startY) * tDeltaY;
+    else if (deltaY < 0.f)
+        tMaxY = (startY - y) * tDeltaY;
+
+    // the number of tiles crossed is known in advance.  using it to bound the
+    // loop keeps floating point error from ever walking past the end tile.
+    auto remaining = 1 + std::abs(lastX - x) + std::abs(lastY - y);
+
+    for (; remaining > 0; --remaining)
+    {
+        if (auto const tile = GetTileAt(x, y))
+            tiles.push_back(tile);
+
+        if (tMaxX < tMaxY)
+        {
+            x += stepX;
+            tMaxX += tDeltaX;
+        }
+        else
+        {
+            y += stepY;
+            tMaxY += tDeltaY;
+        }
+    }
+}
+
+bool Map::GetADTHeight(const Tile* tile, float x, float y, float& height,
+                       unsigned int* zone, unsigned int* area) const
+{
+    // check optional ADT quad height data for this tile
+    if (!tile->m_hasQuadHeights)
+        return false;
+
+    float northwestX, northwestY;
+    math::Convert::TileToWorldNorthwestCorner(tile->m_x, tile->m_y, northwestX,
+                                              northwestY);
+
+    auto constexpr quadWidth = MeshSettings::AdtChunkSize / 8;
+
+    // quad coordinates
+    auto const quadX = static_cast<int>((northwestY - y) / quadWidth);
+    auto const quadY = static_cast<int>((northwestX - x) / quadWidth);
+
+    assert(quadX < 8 && quadY < 8);
+
+    // if there is an ADT hole here, do not consider ADT height
+    if (tile->m_quadHoles[quadX][quadY])
+        return false;
+
+    auto constexpr yMultiplier = 1 + 16 / MeshSettings::TilesPerChunk;
+    auto constexpr midOffset = 1 + 8 / MeshSettings::TilesPerChunk;
+
+    // the heights of the five quad vertices, with the following layout:
+    // a   b
+    //   c
+    // d   e
+    auto const a = tile->QuadHeight(yMultiplier * quadY + quadX);
+    auto const b = tile->QuadHeight(yMultiplier * quadY + quadX + 1);
+    auto const c = tile->QuadHeight(yMultiplier * quadY + quadX + midOffset);
+    auto const d = tile->QuadHeight(yMultiplier * (quadY + 1) + quadX);
+    auto const e = tile->QuadHeight(yMultiplier * (quadY + 1) + quadX + 1);
+
+    // the position within the quad, u across from a to b and v down from a
+    // to d
+    auto const u = (northwestY - y) / quadWidth - quadX;
+    auto const v = (northwestX - x) / quadWidth - quadY;
+
+    // the quad is a fan of four triangles around c, so the diagonals tell
+    // which one the point is over, and each is a plane through its edge of
+    // the quad and c
+    if (v <= u && v <= 1.f - u)
+        height = a + (b - a) * u + (2.f * c - a - b) * v;
+    else if (v >= u && v >= 1.f - u)
+        height = d + (e - d) * u + (2.f * c - d - e) * (1.f - v);
+    else if (u >= v)
+        height = b + (e - b) * v + (2.f * c - b - e) * (1.f - u);
+    else
+        height = a + (d - a) * v + (2.f * c - a - d) * u;
+
+    if (area)
+        *area = tile->m_areaId;
+    if (zone)
+        *zone = tile->m_zoneId;
+
+    return true;
+}
+
+bool Map::FindNextZ(const Tile* tile, float x, float y, float zHint,
+                    bool includeAdt, float& result) const
+{
+    result = zHint;
+
+    // there is nothing for the ray to hit
+    if (includeAdt && tile->TerrainOnly())
+        return GetADTHeight(tile, x, y, result);
+
+    // check BVH data for this tile
+    bool rayHit;
+
+    math::Ray ray {{x, y, zHint}, {x, y, tile->m_bounds.getMinimum().Z}};
+
+    if ((rayHit = RayCast(ray, &tile, 1, true)))
+        result = ray.GetHitPoint().Z;
+
+    // if we don't care about adts, we're done
+    if (!includeAdt)
+        return rayHit;
+
+    float adtHeight;
+    auto const adtHit = GetADTHeight(tile, x, y, adtHeight);
+
+    // one of these two should always hit, at least in places where this query
+    // is expected to be made
+    assert(rayHit || adtHit);
+
+    // if no adt was hit, success depends only on whether the ray hit
+    if (!adtHit)
+        return rayHit;
+    // if the ray did not hit, success depends only on whether the adt has
+    // height here
+    else if (!rayHit)
+    {
+        result = adtHeight;
+        return adtHit;
+    }
+
+    // if both hit, there are a number of possibilities:
+    // * there is a cave, with adt terrain up above
+    // * we are in a building high above adt terrain
+    // * there is an object with adt right above
+    // * there is an object right above the adt
+    // im pretty sure the most general solution to accommodate all
+    // possibilities is to check if the two values are within the detail max
+    // error.  if so, use the higher of the two.  and if not, use whichever is
+    // closer to the original hint.
+
+    if (fabs(result - adtHeight) < MeshSettings::DetailSampleMaxError)
+    {
+        result = (std::max)(result, adtHeight);
+        return true;
+    }
+
+    auto const rayError = fabs(result - zHint);
+    auto const adtError = fabs(adtHeight - zHint);
+
+    if (adtError < rayError)
+        result = adtHeight;
+
+    return true;
+}
+
+bool Map::FindPointInBetweenVectors(const math::Vertex& start, const math::Vertex& end, 
+                                    const float distance,
+                                    math::Vertex& inBetweenPoint) const
+{
+    const float generalDistance = start.GetDistance(end);
+    if (generalDistance < distance) {
+        return false;
+    }
+
+    const float factor = distance / generalDistance;
+    const float dx = start.X + factor * (end.X - start.X);
+    const float dy = start.Y + factor * (end.Y - start.Y);
+    constexpr float extents[] = {1.f, 1.f, 1.f};
+
+    const math::Vertex v1 {dx, dy, start.Z};
+    const math::Vertex v2 {dx, dy, end.Z};
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(dx, dy, pins);
+
+    float recastMiddle[3];
+    math::Convert::VertexToRecast(v1, recastMiddle);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+
+    dtPolyRef polyRef;
+    if (context.m_navQuery.findNearestPoly(recastMiddle, extents,
+                                           &context.m_queryFilter, &polyRef,
+                                           nullptr) != DT_SUCCESS) {
+        math::Convert::VertexToRecast(v2, recastMiddle);
+        if (context.m_navQuery.findNearestPoly(recastMiddle, extents,
+                                               &context.m_queryFilter,
+                                               &polyRef,
+                                               nullptr) != DT_SUCCESS) {
+            return false;
+        }
+    }
+
+    float outputPoint[3];
+    if (context.m_navQuery.closestPointOnPoly(polyRef, recastMiddle, outputPoint, NULL) !=
+        DT_SUCCESS) {
+        return false;
+    }
+
+    math::Convert::VertexToWow(outputPoint, inBetweenPoint);
+    return true;
+}
+
+bool Map::FindRandomPointAroundCircle(const math::Vertex& centerPosition,
+                                      const float radius,
+                                      math::Vertex& randomPoint,
+                                      const std::string& filter) const
+{
+    Location center {centerPosition};
+    return FindRandomPointAroundCircle(center, radius, randomPoint, filter);
+}
+
+bool Map::FindRandomPointAroundCircle(Location& center, const float radius,
+                                      math::Vertex& randomPoint,
+                                      const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics,
+                                QueryMetrics::Query::FindRandomPoint);
+
+    auto const& centerPosition = center.m_position;
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(centerPosition.X, centerPosition.Y, pins);
+
+    float recastCenter[3];
+    math::Convert::VertexToRecast(centerPosition, recastCenter);
+
+    constexpr float extents[] = {1.f, 1.f, 1.f};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    auto const startRef = center.m_polyRef = FindNearestPoly(
+        context, queryFilter, recastCenter, extents, center.m_polyRef);
+
+    if (!startRef)
+        return false;
+
+    float outputPoint[3];
+
+    dtPolyRef randomRef;
+    if (context.m_navQuery.findRandomPointAroundCircle(startRef,
+                                               recastCenter,
+                                               radius,
+                                               &queryFilter,
+                                               &random_between_0_and_1,
+                                               &randomRef,
+                                               outputPoint) != DT_SUCCESS) {
+        return false;
+    }
+
+    math::Convert::VertexToWow(outputPoint, randomPoint);
+
+    return true;
+}
+
+
+size_t Map::FindRandomPoints(const math::Vertex& centerPosition, float radius,
+                             size_t count, std::uint64_t seed,
+                             std::vector<math::Vertex>& output,
+                             const std::string& filter) const
+{
+    Location center {centerPosition};
+    return FindRandomPoints(center, radius, count, seed, output, filter);
+}
+
+size_t Map::FindRandomPoints(Location& center, float radius, size_t count,
+                             std::uint64_t seed,
+                             std::vector<math::Vertex>& output,
+                             const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics,
+                                QueryMetrics::Query::FindRandomPoint);
+
+    output.clear();
+
+    auto const& centerPosition = center.m_position;
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(centerPosition.X, centerPosition.Y, pins);
+
+    float recastCenter[3];
+    math::Convert::VertexToRecast(centerPosition, recastCenter);
+
+    constexpr float extents[] = {1.f, 1.f, 1.f};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& navQuery = context.m_navQuery;
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    auto const startRef = center.m_polyRef = FindNearestPoly(
+        context, queryFilter, recastCenter, extents, center.m_polyRef);
+
+    if (!startRef || !count)
+        return 0;
+
+    // the polygons reachable from the center which touch the circle.  when
+    // there are more than the buffer holds, the points are drawn from the
+    // nearest of them
+    auto& polys = context.m_polyRefs;
+    int polyCount;
+
+    if (!(navQuery.findPolysAroundCircle(startRef, recastCenter, radius,
+                                         &queryFilter, &polys[0], nullptr,
+                                         nullptr, &polyCount,
+                                         static_cast<int>(polys.size())) &
+          DT_SUCCESS))
+        return 0;
+
+    // each polygon is divided into a fan of triangles, of which one is
+    // chosen by its share of the total area, with a binary search of the
+    // running total
+    struct Triangle
+    {
+        dtPolyRef m_ref;
+        const float* m_vertices[3];
+    };
+
+    std::vector<Triangle> triangles;
+    std::vector<float> areas;
+    auto total = 0.f;
+
+    for (auto i = 0; i < polyCount; ++i)
+    {
+        const dtMeshTile* tile;
+        const dtPoly* poly;
+        m_navMesh.getTileAndPolyByRefUnsafe(polys[i], &tile, &poly);
+
+        if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+            continue;
+
+        auto const a = &tile->verts[poly->verts[0] * 3];
+
+        for (auto v = 2; v < poly->vertCount; ++v)
+        {
+            auto const b = &tile->verts[poly->verts[v - 1] * 3];
+            auto const c = &tile->verts[poly->verts[v] * 3];
+
+            // recast is y-up, so the area is of the projection onto xz
+            auto const area =
+                0.5f * std::fabs((b[0] - a[0]) * (c[2] - a[2]) -
+                                 (c[0] - a[0]) * (b[2] - a[2]));
+
+            if (area <= 0.f)
+                continue;
+
+            total += area;
+            triangles.push_back({polys[i], {a, b, c}});
+            areas.push_back(total);
+        }
+    }
+
+    if (triangles.empty())
+        return 0;
+
+    // the same seed draws the same points from the same navmesh, whichever
+    // thread asks
+    std::mt19937_64 generator(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    // points outside of the circle, which polygons crossing its edge have,
+    // are drawn again, keeping the rest uniform over the area within it.
+    // a circle mostly covered by few large polygons may need several draws
+    // per point, so the draws are limited rather than the points guaranteed
+    constexpr size_t drawsPerPoint = 16;
+    auto const radiusSquared = radius * radius;
+
+    for (size_t draw = 0; output.size() < count && draw < count * drawsPerPoint;
+         ++draw)
+    {
+        auto const i = (std::min)(
+            static_cast<size_t>(
+                std::upper_bound(areas.begin(), areas.end(),
+                                 unit(generator) * total) -
+                areas.begin()),
+            triangles.size() - 1);
+        auto const& triangle = triangles[i];
+
+        auto s = unit(generator);
+        auto t = unit(generator);
+
+        if (s + t > 1.f)
+        {
+            s = 1.f - s;
+            t = 1.f - t;
+        }
+
+        auto const a = triangle.m_vertices[0];
+        auto const b = triangle.m_vertices[1];
+        auto const c = triangle.m_vertices[2];
+
+        float point[3];
+        for (auto axis = 0; axis < 3; ++axis)
+            point[axis] =
+                a[axis] + s * (b[axis] - a[axis]) + t * (c[axis] - a[axis]);
+
+        auto const dx = point[0] - recastCenter[0];
+        auto const dz = point[2] - recastCenter[2];
+
+        if (dx * dx + dz * dz > radiusSquared)
+            continue;
+
+        // the polygon is flat, while its detail mesh follows the terrain
+        float height;
+        if (dtStatusSucceed(
+                navQuery.getPolyHeight(triangle.m_ref, point, &height)))
+            point[1] = height;
+
+        math::Vertex randomPoint;
+        math::Convert::VertexToWow(point, randomPoint);
+        output.push_back(randomPoint);
+    }
+
+    return output.size();
+}
+
+bool Map::FindNearestPoint(const math::Vertex& position,
+                           const math::Vertex& extents, math::Vertex& nearest,
+                           const std::string& filter) const
+{
+    Location location {position};
+    return FindNearestPoint(location, extents, nearest, filter);
+}
+
+bool Map::FindNearestPoint(Location& location, const math::Vertex& extents,
+                           math::Vertex& nearest,
+                           const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics,
+                                QueryMetrics::Query::FindNearestPoint);
+
+    auto const& position = location.m_position;
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(position.X, position.Y, pins);
+
+    float recastPosition[3];
+    math::Convert::VertexToRecast(position, recastPosition);
+
+    // the extents are half sizes, so only their axes are converted
+    const float recastExtents[] = {std::fabs(extents.Y), std::fabs(extents.Z),
+                                   std::fabs(extents.X)};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    location.m_polyRef = FindNearestPoly(context, queryFilter, recastPosition,
+                                         recastExtents, location.m_polyRef);
+
+    if (!location.m_polyRef)
+        return false;
+
+    float closest[3];
+    if (!dtStatusSucceed(context.m_navQuery.closestPointOnPoly(
+            location.m_polyRef, recastPosition, closest, nullptr)))
+        return false;
+
+    math::Convert::VertexToWow(closest, nearest);
+
+    return true;
+}
+
+bool Map::DistanceToWall(const math::Vertex& position, float radius,
+                         float& distance, math::Vertex& hitPoint,
+                         math::Vertex& hitNormal,
+                         const std::string& filter) const
+{
+    Location location {position};
+    return DistanceToWall(location, radius, distance, hitPoint, hitNormal,
+                          filter);
+}
+
+bool Map::DistanceToWall(Location& location, float radius, float& distance,
+                         math::Vertex& hitPoint, math::Vertex& hitNormal,
+                         const std::string& filter) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::DistanceToWall);
+
+    auto const& position = location.m_position;
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(position.X, position.Y, pins);
+
+    float recastPosition[3];
+    math::Convert::VertexToRecast(position, recastPosition);
+
+    constexpr float extents[] = {5.f, 5.f, 5.f};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& queryFilter = GetQueryFilter(context, filter);
+
+    location.m_polyRef = FindNearestPoly(context, queryFilter, recastPosition,
+                                         extents, location.m_polyRef);
+
+    if (!location.m_polyRef)
+        return false;
+
+    float hitDistance;
+    float recastHitPoint[3] = {};
+    float recastHitNormal[3] = {};
+
+    if (!dtStatusSucceed(context.m_navQuery.findDistanceToWall(
+            location.m_polyRef, recastPosition, radius, &queryFilter,
+            &hitDistance, recastHitPoint, recastHitNormal)))
+        return false;
+
+    distance = hitDistance;
+
+    // with no wall in range detour leaves the point untouched, and computes
+    // the normal from it regardless
+    if (hitDistance >= radius)
+    {
+        hitPoint = hitNormal = {};
+        return true;
+    }
+
+    math::Convert::VertexToWow(recastHitPoint, hitPoint);
+    math::Convert::VertexToWow(recastHitNormal, hitNormal);
+
+    return true;
+}
+
+bool Map::FindHeight(const math::Vertex& source, float x, float y, float& z) const
+{
+    Location location {source};
+    return FindHeight(location, x, y, z);
+}
+
+bool Map::FindHeight(Location& location, float x, float y, float& z) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindHeight);
+
+    auto const& source = location.m_position;
+
+    QueryRecorder::Record record(m_recorder, QueryRecorder::Query::FindHeight,
+                                 source, {x, y, 0.f});
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(source.X, source.Y, pins);
+    EnsureResident(x, y, pins);
+
+    // ray cast along navmesh from source to target
+    float recastSource[3];
+    math::Convert::VertexToRecast(source, recastSource);
+
+    constexpr float extents[] = {1.f, 1.f, 1.f};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+    auto const& navQuery = context.m_navQuery;
+
+    auto const startRef = location.m_polyRef =
+        FindNearestPoly(context, context.m_queryFilter, recastSource, extents,
+                        location.m_polyRef);
+
+    if (!startRef)
+        return record.Finish(false);
+
+    // on open terrain, the precise height found below could only be that of
+    // the ADT, so the ray along the navmesh would decide nothing
+    if (auto const tile = GetTile(x, y);
+        tile && tile->TerrainOnly() && GetADTHeight(tile, x, y, z))
+        return record.Finish(true, &z, 1);
+
+    float recastTarget[3];
+    // use the source Z as an initial guess
+    math::Convert::VertexToRecast({x, y, source.Z}, recastTarget);
+
+    dtPolyRef hit_path[100];
+    dtRaycastHit hit;
+    hit.path = hit_path;
+    hit.maxPath = sizeof(hit_path) / sizeof(hit_path[0]);
+
+    if (navQuery.raycast(startRef, recastSource, recastTarget,
+                         &context.m_queryFilter, 0, &hit) != DT_SUCCESS)
+        return record.Finish(false);
+
+    if (!hit.pathCount)
+        return record.Finish(false);
+
+    // if we reach here, it means we have a path and know the poly ref for
+    // the poly where the ray hit.  so let's use that reference and query
+    // the height at the requested x,y.
+    if (navQuery.getPolyHeight(hit.path[hit.pathCount - 1], recastTarget,
+                               &z) != DT_SUCCESS)
+        return record.Finish(false);
+
+    auto const tile = GetTile(x, y);
+
+    if (!tile)
+        return record.Finish(false);
+
+    // take the imprecise z value from the mesh, and return the precise value
+    if (!FindNextZ(tile, x, y, z, true, z))
+        return record.Finish(false);
+
+    return record.Finish(true, &z, 1);
+}
+
+bool Map::FindHeights(float x, float y, std::vector<float>& output,
+                      bool precise) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::FindHeights);
+    QueryRecorder::Record record(m_recorder, QueryRecorder::Query::FindHeights,
+                                 {x, y, 0.f}, {}, precise);
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(x, y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto const tile = GetTile(x, y);
+
+    if (!tile)
+        return record.Finish(false);
+
+    auto const start = output.size();
+    FindHeights(GetQueryContext(), tile, x, y, precise, output);
+
+    return record.Finish(output.size() > start, output.data() + start,
+                         output.size() - start);
+}
+
+void Map::FindHeights(QueryContext& context, const Tile* tile, float x,
+                      float y, bool precise, std::vector<float>& output) const
+{
+    float adtHeight;
+
+    // with nothing but terrain on the tile, there is no ray to cast
+    if (tile->TerrainOnly())
+    {
+        if (GetADTHeight(tile, x, y, adtHeight))
+            output.push_back(adtHeight);
+
+        return;
+    }
+
+    // the builder's surfaces spare casting a ray, which is most of the cost
+    if (!precise && tile->FindSurfaces(x, y, output))
+    {
+        if (GetADTHeight(tile, x, y, adtHeight))
+            output.push_back(adtHeight);
+
+        return;
     }
 
-    auto const tile = m_tiles.find({tileX, tileY});
+    // one ray through the whole tile finds every surface, rather than casting
+    // again from below each surface found
+    auto const top = tile->m_bounds.getMaximum().Z;
+    auto const bottom = tile->m_bounds.getMinimum().Z;
+
+    math::Ray ray {{x, y, top}, {x, y, bottom}};
+
+    auto& hits = context.m_rayHits;
+    hits.clear();
+    RayCastAll(ray, tile, hits);
+
+    // highest first, skipping surfaces which coincide
+    std::sort(hits.begin(), hits.end());
+
+    auto const first = output.size();
+    for (auto const distance : hits)
+    {
+        auto const z = top + (bottom - top) * distance;
+
+        if (output.size() == first || output.back() != z)
+            output.push_back(z);
+    }
 
-    return tile == m_tiles.end() ? nullptr : tile->second.get();
+    if (GetADTHeight(tile, x, y, adtHeight))
+        output.push_back(adtHeight);
 }
 
-bool Map::GetADTHeight(const Tile* tile, float x, float y, float& height,
-                       unsigned int* zone, unsigned int* area) const
+void Map::FindHeightsGrid(float x0, float y0, float dx, float dy, int nx,
+                          int ny, std::vector<float>& heights,
+                          std::vector<unsigned int>& counts,
+                          bool precise) const
 {
-    // check optional ADT quad height data for this tile
-    if (tile->m_quadHeights.empty())
+    QueryMetrics::Scope metrics(m_metrics,
+                                QueryMetrics::Query::FindHeightsGrid);
+
+    heights.clear();
+    counts.assign(static_cast<size_t>((std::max)(nx, 0)) * (std::max)(ny, 0),
+                  0);
+
+    if (counts.empty())
+        return;
+
+    ResidencyPins pins(*this);
+
+    for (auto j = 0; j < ny; ++j)
+        for (auto i = 0; i < nx; ++i)
+            EnsureResident(x0 + i * dx, y0 + j * dy, pins);
+
+    // (tile, point index) for every point within a loaded tile, sorted so
+    // that the points of each tile are processed together
+    std::vector<std::pair<const Tile*, std::uint32_t>> points;
+    points.reserve(counts.size());
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    for (auto j = 0; j < ny; ++j)
+        for (auto i = 0; i < nx; ++i)
+            if (auto const tile = GetTile(x0 + i * dx, y0 + j * dy))
+                points.emplace_back(tile,
+                                    static_cast<std::uint32_t>(j * nx + i));
+
+    std::stable_sort(points.begin(), points.end(),
+                     [](auto const& a, auto const& b) {
+                         return std::less<const Tile*>()(a.first, b.first);
+                     });
+
+    auto& context = GetQueryContext();
+
+    // heights are found in tile order, but returned in point order
+    std::vector<float> found;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> ranges(counts.size());
+
+    for (auto const& point : points)
+    {
+        auto const i = point.second % nx;
+        auto const j = point.second / nx;
+
+        auto const begin = static_cast<std::uint32_t>(found.size());
+        FindHeights(context, point.first, x0 + i * dx, y0 + j * dy, precise,
+                    found);
+
+        ranges[point.second] = {begin,
+                                static_cast<std::uint32_t>(found.size())};
+        counts[point.second] = static_cast<unsigned int>(found.size() - begin);
+    }
+
+    heights.reserve(found.size());
+    for (auto const& range : ranges)
+        heights.insert(heights.end(), found.begin() + range.first,
+                       found.begin() + range.second);
+}
+
+bool Map::ZoneAndArea(const math::Vertex& position, unsigned int& zone,
+                      unsigned int& area) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::ZoneAndArea);
+    QueryRecorder::Record record(m_recorder, QueryRecorder::Query::ZoneAndArea,
+                                 position);
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(position.X, position.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    // find the tile corresponding to this (x, y)
+    auto const tile = GetTile(position.X, position.Y);
+
+    if (!tile || !ZoneAndArea(tile, position, zone, area))
+        return record.Finish(false);
+
+    return record.Finish(true, zone, area);
+}
+
+bool Map::ZoneAndArea(Location& location, unsigned int& zone,
+                      unsigned int& area) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::ZoneAndArea);
+
+    auto const& position = location.m_position;
+
+    QueryRecorder::Record record(m_recorder, QueryRecorder::Query::ZoneAndArea,
+                                 position);
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(position.X, position.Y, pins);
+
+    float recastPosition[3];
+    math::Convert::VertexToRecast(position, recastPosition);
+
+    constexpr float extents[] = {1.f, 1.f, 1.f};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto& context = GetQueryContext();
+
+    auto const polyRef = location.m_polyRef =
+        FindNearestPoly(context, context.m_queryFilter, recastPosition, extents,
+                        location.m_polyRef);
+
+    if (!polyRef || !PolyZoneAndArea(context, polyRef, zone, area))
+        return record.Finish(false);
+
+    return record.Finish(true, zone, area);
+}
+
+bool Map::ZoneAndAreaForPoly(dtPolyRef poly, unsigned int& zone,
+                             unsigned int& area) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::ZoneAndArea);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    return PolyZoneAndArea(GetQueryContext(), poly, zone, area);
+}
+
+bool Map::PolyZoneAndArea(QueryContext& context, dtPolyRef poly,
+                          unsigned int& zone, unsigned int& area) const
+{
+    const dtMeshTile* meshTile;
+    const dtPoly* meshPoly;
+
+    if (dtStatusFailed(
+            m_navMesh.getTileAndPolyByRef(poly, &meshTile, &meshPoly)))
         return false;
 
-    float northwestX, northwestY;
-    math::Convert::TileToWorldNorthwestCorner(tile->m_x, tile->m_y, northwestX,
-                                              northwestY);
+    float centre[3] = {};
 
-    auto constexpr quadWidth = MeshSettings::AdtChunkSize / 8;
+    for (auto i = 0; i < meshPoly->vertCount; ++i)
+        for (auto j = 0; j < 3; ++j)
+            centre[j] += meshTile->verts[meshPoly->verts[i] * 3 + j];
 
-    // quad coordinates
-    auto const quadX = static_cast<int>((northwestY - y) / quadWidth);
-    auto const quadY = static_cast<int>((northwestX - x) / quadWidth);
+    for (auto& coord : centre)
+        coord /= meshPoly->vertCount;
 
-    assert(quadX < 8 && quadY < 8);
+    // the detail mesh is closer to the surface than the polygon itself.  an
+    // off-mesh connection has neither, and keeps the mean height of its ends
+    float height;
+    if (dtStatusSucceed(
+            context.m_navQuery.getPolyHeight(poly, centre, &height)))
+        centre[1] = height;
 
-    // if there is an ADT hole here, do not consider ADT height
-    if (tile->m_quadHoles[quadX][quadY])
+    math::Vertex position;
+    math::Convert::VertexToWow(centre, position);
+
+    auto const tile = GetTile(position.X, position.Y);
+
+    if (!tile)
         return false;
 
-    auto constexpr yMultiplier = 1 + 16 / MeshSettings::TilesPerChunk;
-    auto constexpr midOffset = 1 + 8 / MeshSettings::TilesPerChunk;
+    {
+        std::lock_guard<std::mutex> lock(tile->m_polyZoneAreaMutex);
 
-    // compute the five quad vertices, with the following layout, in the recast
-    // coordinate system:
-    // a   b
-    //   c
-    // d   e
+        auto const i = tile->m_polyZoneAreas.find(poly);
+        if (i != tile->m_polyZoneAreas.end())
+        {
+            zone = i->second.first;
+            area = i->second.second;
+            return true;
+        }
+    }
+
+    // the mesh may be a little below the surface it was built from.  no other
+    // floor can be within a step of it, so a ray from a step above meets that
+    // surface first
+    position.Z += MeshSettings::WalkableClimb;
+
+    if (!ZoneAndArea(tile, position, zone, area))
+        return false;
+
+    std::lock_guard<std::mutex> lock(tile->m_polyZoneAreaMutex);
+    tile->m_polyZoneAreas[poly] = {zone, area};
+
+    return true;
+}
+
+bool Map::ZoneAndArea(const Tile* tile, const math::Vertex& position,
+                      unsigned int& zone, unsigned int& area) const
+{
+    float adtHeight;
+    unsigned int adtZone, adtArea;
+    auto const adtResult = GetADTHeight(tile, position.X, position.Y, adtHeight,
+                                        &adtZone, &adtArea);
 
-    const float a[] = {-(northwestY - quadWidth * quadX),
-                       tile->m_quadHeights[yMultiplier * quadY + quadX],
-                       -(northwestX - quadWidth * quadY)};
-
-    const float b[] = {-(northwestY - quadWidth * (quadX + 1)),
-                       tile->m_quadHeights[yMultiplier * quadY + quadX + 1],
-                       -(northwestX - quadWidth * quadY)};
-
-    const float c[] = {
-        -(northwestY - quadWidth * (quadX + 0.5f)),
-        tile->m_quadHeights[yMultiplier * quadY + quadX + midOffset],
-        -(northwestX - quadWidth * (quadY + 0.5f))};
-
-    const float d[] = {-(northwestY - quadWidth * quadX),
-                       tile->m_quadHeights[yMultiplier * (quadY + 1) + quadX],
-                       -(northwestX - quadWidth * (quadY + 1))};
-
-    const float e[] = {
-        -(northwestY - quadWidth * (quadX + 1)),
-        tile->m_quadHeights[yMultiplier * (quadY + 1) + quadX + 1],
-        -(northwestX - quadWidth * (quadY + 1))};
-
-    // the point we want to intersect with each triangle
-    const float p[] = {-y, (std::numeric_limits<float>::min)(), -x};
-
-    float h;
-
-    // this if-statement will ensure that at most one of these calls will
-    // succeed, which is what we want
-    if (dtClosestHeightPointTriangle(p, a, b, c, h) ||
-        dtClosestHeightPointTriangle(p, b, e, c, h) ||
-        dtClosestHeightPointTriangle(p, c, e, d, h) ||
-        dtClosestHeightPointTriangle(p, a, c, d, h))
-    {
-        height = h;
-        if (area)
-            *area = tile->m_areaId;
-        if (zone)
-            *zone = tile->m_zoneId;
+    // outdoors, where no WMO is beneath the position, the ray could only hit
+    // the terrain, so it need not be cast
+    if (adtResult && tile->BelowStaticWmos(position))
+    {
+        zone = adtZone;
+        area = adtArea;
         return true;
     }
 
-    return false;
+    math::Ray ray {
+        {position.X, position.Y, position.Z},
+        {position.X, position.Y, tile->m_bounds.getMinimum().Z}};
+
+    unsigned int localZone, localArea;
+    auto const rayResult =
+        RayCast(ray, &tile, 1, false, &localZone, &localArea);
+    if (rayResult)
+    {
+        zone = localZone;
+        area = localArea;
+    }
+
+    if (adtResult && adtHeight > ray.GetHitPoint().Z)
+    {
+        zone = adtZone;
+        area = adtArea;
+    }
+
+    assert(rayResult || adtResult);
+
+    return rayResult || adtResult;
 }
 
-bool Map::FindNextZ(const Tile* tile, float x, float y, float zHint,
-                    bool includeAdt, float& result) const
+bool Map::GetLiquidLevel(float x, float y, float z, float& level,
+                         LiquidType& type) const
 {
-    result = zHint;
+    ResidencyPins pins(*this);
 
-    // check BVH data for this tile
-    bool rayHit;
+    EnsureResident(x, y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    auto const tile = GetTile(x, y);
+
+    return tile && tile->FindLiquid({x, y, z}, level, type);
+}
+
+bool Map::LineOfSight(const math::Vertex& start, const math::Vertex& stop, bool doodads) const
+{
+    QueryMetrics::Scope metrics(m_metrics, QueryMetrics::Query::LineOfSight);
+    QueryRecorder::Record record(m_recorder, QueryRecorder::Query::LineOfSight,
+                                 start, stop, doodads);
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(stop.X, stop.Y, pins);
+
+    auto const useCache = m_lineOfSightCache.Enabled();
+    LineOfSightCache::Key cacheKey {};
+    bool result;
+
+    if (useCache)
+    {
+        cacheKey = m_lineOfSightCache.MakeKey(start, stop, doodads);
+
+        if (m_lineOfSightCache.Find(cacheKey, result))
+            return record.Finish(result);
+    }
+
+    math::Ray ray {start, stop};
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    // RayCast() returns true when an obstacle is hit
+    result = !RayCast(ray, doodads, true);
+
+    // inserted before the lock is released, so that a change to the tiles
+    // cannot come between the cast and the insertion and leave the entry
+    // stale
+    if (useCache)
+    {
+        float startX, startY, stopX, stopY;
+        WorldToTile(start.X, start.Y, startX, startY);
+        WorldToTile(stop.X, stop.Y, stopX, stopY);
+
+        m_lineOfSightCache.Insert(cacheKey, result,
+                                  static_cast<int>(std::floor(startX)),
+                                  static_cast<int>(std::floor(startY)),
+                                  static_cast<int>(std::floor(stopX)),
+                                  static_cast<int>(std::floor(stopY)));
+    }
+
+    return record.Finish(result);
+}
+
+void Map::LineOfSightBatch(const math::Vertex* starts,
+                           const math::Vertex* stops, size_t count,
+                           bool doodads, std::vector<bool>& results) const
+{
+    QueryMetrics::Scope metrics(m_metrics,
+                                QueryMetrics::Query::LineOfSightBatch);
+
+    results.assign(count, true);
+
+    if (!count)
+        return;
+
+    std::vector<math::Ray> rays;
+    rays.reserve(count);
+
+    ResidencyPins pins(*this);
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        EnsureResident(starts[i].X, starts[i].Y, pins);
+        EnsureResident(stops[i].X, stops[i].Y, pins);
+
+        rays.emplace_back(starts[i], stops[i]);
+    }
+
+    // (instance index, ray index) for every static instance whose bounds a
+    // ray crosses.  an instance is referenced by each tile it overlaps, so it
+    // may be found more than once
+    using StaticCandidates = std::vector<
+        std::tuple<std::uint32_t, std::uint32_t, const StaticInstance*>>;
+    StaticCandidates staticWmos, staticDoodads;
+
+    // (instance id, ray index) for every temporary instance referenced by a
+    // tile which a ray crosses
+    using Candidates = std::vector<std::pair<std::uint64_t, std::uint32_t>>;
+    Candidates temporaryWmos, temporaryDoodads;
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    std::vector<const Tile*> tiles;
+
+    for (auto r = 0u; r < count; ++r)
+    {
+        tiles.clear();
+        FindTilesOnRay(rays[r], tiles);
+
+        for (auto const tile : tiles)
+        {
+            if (!rays[r].IntersectBoundingBox(tile->m_bounds))
+                continue;
+
+            tile->m_staticWmoTree.Intersect(
+                rays[r], [&staticWmos, r](const StaticInstance& instance) {
+                    staticWmos.emplace_back(instance.m_index, r, &instance);
+                    return false;
+                });
+
+            // see RayCast() regarding doodads and temporary objects
+            if (!doodads)
+                continue;
+
+            tile->m_staticDoodadTree.Intersect(
+                rays[r], [&staticDoodads, r](const StaticInstance& instance) {
+                    staticDoodads.emplace_back(instance.m_index, r, &instance);
+                    return false;
+                });
+            for (auto const& wmo : tile->m_temporaryWmos)
+                temporaryWmos.emplace_back(wmo.first, r);
+            for (auto const& doodad : tile->m_temporaryDoodads)
+                temporaryDoodads.emplace_back(doodad.first, r);
+        }
+    }
+
+    auto const occluded = [](const math::Ray& ray, const auto& instance,
+                             const Model& model)
+    {
+        math::Ray rayInverse(
+            math::Vector3::Transform(ray.GetStartPoint(),
+                                     instance.m_inverseTransformMatrix),
+            math::Vector3::Transform(ray.GetEndPoint(),
+                                     instance.m_inverseTransformMatrix));
+
+        return model.m_aabbTree.Occluded(rayInverse);
+    };
+
+    // test each instance against every ray which crosses its bounds and which
+    // has not already been blocked by something else.  sorting keeps the
+    // tests of one instance together
+    auto const testStaticCandidates = [&](StaticCandidates& candidates)
+    {
+        auto const key = [](const auto& candidate) {
+            return std::make_pair(std::get<0>(candidate),
+                                  std::get<1>(candidate));
+        };
+
+        std::sort(candidates.begin(), candidates.end(),
+                  [&key](const auto& a, const auto& b)
+                  { return key(a) < key(b); });
+        candidates.erase(std::unique(candidates.begin(), candidates.end(),
+                                     [&key](const auto& a, const auto& b)
+                                     { return key(a) == key(b); }),
+                         candidates.end());
+
+        for (auto const& candidate : candidates)
+        {
+            auto const r = std::get<1>(candidate);
+            auto const instance = std::get<2>(candidate);
+
+            if (results[r] && occluded(rays[r], *instance, *instance->m_model))
+                results[r] = false;
+        }
+    };
+
+    testStaticCandidates(staticWmos);
+    testStaticCandidates(staticDoodads);
+
+    // visit each instance once, testing it against every ray which might
+    // reach it and which has not already been blocked by something else
+    auto const testCandidates = [&](Candidates& candidates,
+                                    auto const& findInstance)
+    {
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                         candidates.end());
+
+        for (size_t begin = 0, end; begin < candidates.size(); begin = end)
+        {
+            for (end = begin + 1; end < candidates.size() &&
+                                  candidates[end].first ==
+                                      candidates[begin].first;
+                 ++end)
+                ;
+
+            auto const instance = findInstance(candidates[begin].first);
+            auto const model = instance->m_model.lock();
+
+            if (!model)
+                continue;
+
+            for (auto c = begin; c < end; ++c)
+            {
+                auto const r = candidates[c].second;
+
+                if (!results[r])
+                    continue;
+
+                if (!rays[r].IntersectBoundingBox(instance->m_bounds))
+                    continue;
+
+                if (occluded(rays[r], *instance, *model))
+                    results[r] = false;
+            }
+        }
+    };
+
+    // temporary instances are kept alive by the tiles which reference them,
+    // and those cannot change while we hold the lock
+    testCandidates(temporaryWmos, [this](std::uint64_t guid) {
+        return m_temporaryWmos.at(guid).lock().get();
+    });
+    testCandidates(temporaryDoodads, [this](std::uint64_t guid) {
+        return m_temporaryDoodads.at(guid).lock().get();
+    });
+}
+
+void Map::LineOfSightFan(const math::Vertex& origin, float originHeight,
+                         const math::Vertex* targets, const float* eyeHeights,
+                         size_t count, bool doodads,
+                         std::vector<bool>& results) const
+{
+    QueryMetrics::Scope metrics(m_metrics,
+                                QueryMetrics::Query::LineOfSightFan);
+
+    results.assign(count, true);
+
+    if (!count)
+        return;
+
+    const math::Vertex eye {origin.X, origin.Y, origin.Z + originHeight};
+
+    ResidencyPins pins(*this);
+
+    EnsureResident(origin.X, origin.Y, pins);
+
+    std::vector<math::Ray> rays;
+    rays.reserve(count);
+
+    math::BoundingBox fan {eye, eye};
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        EnsureResident(targets[i].X, targets[i].Y, pins);
+
+        const math::Vertex stop {
+            targets[i].X, targets[i].Y,
+            targets[i].Z + (eyeHeights ? eyeHeights[i] : 0.f)};
+
+        rays.emplace_back(eye, stop);
+        fan.update(stop);
+    }
+
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
+
+    // every tile crossed by any of the rays.  those around the origin are
+    // crossed by most of them, but are searched only once
+    std::vector<const Tile*> tiles;
+    for (auto const& ray : rays)
+        FindTilesOnRay(ray, tiles);
+
+    std::sort(tiles.begin(), tiles.end(), std::less<const Tile*>());
+    tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+
+    auto& context = GetQueryContext();
+    BeginVisit(context);
+
+    auto const generation = context.m_visitGeneration;
+
+    // once every ray is blocked, there is nothing left to test
+    auto clear = count;
+
+    // tests each ray not yet blocked against the model of an instance
+    auto const test = [&](const math::BoundingBox& bounds,
+                          const math::Matrix& inverseTransform,
+                          const Model& model)
+    {
+        auto const start = math::Vector3::Transform(eye, inverseTransform);
+
+        for (auto r = 0u; r < count && clear > 0; ++r)
+        {
+            if (!results[r] || !rays[r].IntersectBoundingBox(bounds))
+                continue;
 
-    math::Ray ray {{x, y, zHint}, {x, y, tile->m_bounds.getMinimum().Z}};
+            math::Ray rayInverse(
+                start, math::Vector3::Transform(rays[r].GetEndPoint(),
+                                                inverseTransform));
 
-    if ((rayHit = RayCast(ray, {tile}, true)))
-        result = ray.GetHitPoint().Z;
+            if (model.m_aabbTree.Occluded(rayInverse))
+            {
+                results[r] = false;
+                --clear;
+            }
+        }
+    };
 
-    // if we don't care about adts, we're done
-    if (!includeAdt)
-        return rayHit;
+    for (auto const tile : tiles)
+    {
+        if (!clear)
+            break;
 
-    float adtHeight;
-    auto const adtHit = GetADTHeight(tile, x, y, adtHeight);
+        if (!fan.intersect(tile->m_bounds))
+            continue;
 
-    // one of these two should always hit, at least in places where this query
-    // is expected to be made
-    assert(rayHit || adtHit);
+        tile->m_staticWmoTree.Overlap(
+            fan, [&](const StaticInstance& instance) {
+                if (FirstVisit(context.m_staticWmoStamps, generation,
+                               instance.m_index))
+                    test(instance.m_bounds, instance.m_inverseTransformMatrix,
+                         *instance.m_model);
+            });
 
-    // if no adt was hit, success depends only on whether the ray hit
-    if (!adtHit)
-        return rayHit;
-    // if the ray did not hit, success depends only on whether the adt has
-    // height here
-    else if (!rayHit)
-    {
-        result = adtHeight;
-        return adtHit;
-    }
+        // see RayCast() regarding doodads and temporary objects
+        if (!doodads)
+            continue;
 
-    // if both hit, there are a number of possibilities:
-    // * there is a cave, with adt terrain up above
-    // * we are in a building high above adt terrain
-    // * there is an object with adt right above
-    // * there is an object right above the adt
-    // im pretty sure the most general solution to accommodate all
-    // possibilities is to check if the two values are within the detail max
-    // error.  if so, use the higher of the two.  and if not, use whichever is
-    // closer to the original hint.
+        tile->m_staticDoodadTree.Overlap(
+            fan, [&](const StaticInstance& instance) {
+                if (FirstVisit(context.m_staticDoodadStamps, generation,
+                               instance.m_index))
+                    test(instance.m_bounds, instance.m_inverseTransformMatrix,
+                         *instance.m_model);
+            });
 
-    if (fabs(result - adtHeight) < MeshSettings::DetailSampleMaxError)
-    {
-        result = (std::max)(result, adtHeight);
-        return true;
-    }
+        for (auto const& wmo : tile->m_temporaryWmos)
+        {
+            if (!FirstVisit(context.m_visitedTemporaryWmos, wmo.first) ||
+                !fan.intersect(wmo.second->m_bounds))
+                continue;
 
-    auto const rayError = fabs(result - zHint);
-    auto const adtError = fabs(adtHeight - zHint);
+            if (auto const model = wmo.second->m_model.lock())
+                test(wmo.second->m_bounds,
+                     wmo.second->m_inverseTransformMatrix, *model);
+        }
 
-    if (adtError < rayError)
-        result = adtHeight;
+        for (auto const& doodad : tile->m_temporaryDoodads)
+        {
+            if (!FirstVisit(context.m_visitedTemporaryDoodads, doodad.first) ||
+                !fan.intersect(doodad.second->m_bounds))
+                continue;
 
-    return true;
+            if (auto const model = doodad.second->m_model.lock())
+                test(doodad.second->m_bounds,
+                     doodad.second->m_inverseTransformMatrix, *model);
+        }
+    }
 }
 
-bool Map::FindPointInBetweenVectors(const math::Vertex& start, const math::Vertex& end, 
-                                    const float distance,
-                                    math::Vertex& inBetweenPoint) const
+bool Map::SweepCapsule(const math::Vertex& start, const math::Vertex& end,
+                       float radius, float height, math::Vertex& stop,
+                       bool navMesh, bool doodads) const
 {
-    const float generalDistance = start.GetDistance(end);
-    if (generalDistance < distance) {
+    ResidencyPins pins(*this);
+
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(end.X, end.Y, pins);
+
+    stop = end;
+
+    auto const movement = end - start;
+    if (movement.Length() <= 0.f || radius <= 0.f)
         return false;
-    }
 
-    const float factor = distance / generalDistance;
-    const float dx = start.X + factor * (end.X - start.X);
-    const float dy = start.Y + factor * (end.Y - start.Y);
-    constexpr float extents[] = {1.f, 1.f, 1.f};
+    // the heights of the centres of the spheres above start
+    auto const lowest =
+        (std::min)(GetAgentProfile().m_walkableClimb + radius,
+                   (std::max)(radius, height - radius));
+    auto const highest = (std::max)(lowest, height - radius);
+    auto const spheres =
+        1 + static_cast<int>(std::ceil((highest - lowest) / radius));
 
-    const math::Vertex v1 {dx, dy, start.Z};
-    const math::Vertex v2 {dx, dy, end.Z};
+    // the fraction of the movement at which the capsule first touches
+    auto fraction = 1.f;
 
-    float recastMiddle[3];
-    math::Convert::VertexToRecast(v1, recastMiddle);
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
 
-    dtPolyRef polyRef;
-    if (m_navQuery.findNearestPoly(recastMiddle, extents, &m_queryFilter,
-                                   &polyRef, nullptr) != DT_SUCCESS) {
-        math::Convert::VertexToRecast(v2, recastMiddle);
-        if (m_navQuery.findNearestPoly(recastMiddle, extents, &m_queryFilter,
-                                       &polyRef, nullptr) != DT_SUCCESS) {
-            return false;
-        }
-    }
+    auto& context = GetQueryContext();
 
-    float outputPoint[3];
-    if (m_navQuery.closestPointOnPoly(polyRef, recastMiddle, outputPoint, NULL) !=
-        DT_SUCCESS) {
-        return false;
-    }
+    if (navMesh)
+    {
+        constexpr float extents[] = {5.f, 5.f, 5.f};
 
-    math::Convert::VertexToWow(outputPoint, inBetweenPoint);
-    return true;
-}
+        float recastStart[3];
+        float recastEnd[3];
 
-bool Map::FindRandomPointAroundCircle(const math::Vertex& centerPosition,
-                                      const float radius,
-                                      math::Vertex& randomPoint) const
-{
-    float recastCenter[3];
-    math::Convert::VertexToRecast(centerPosition, recastCenter);
+        math::Convert::VertexToRecast(start, recastStart);
+        math::Convert::VertexToRecast(end, recastEnd);
 
-    constexpr float extents[] = {1.f, 1.f, 1.f};
+        auto const& queryFilter = GetQueryFilter(context, {});
+        auto const startPolyRef =
+            FindNearestPoly(context, queryFilter, recastStart, extents);
 
-    dtPolyRef startRef;
-    if (m_navQuery.findNearestPoly(recastCenter, extents, &m_queryFilter,
-                                   &startRef, nullptr) != DT_SUCCESS) {
-        return false;
+        float t, hitNormal[3];
+        int pathLength;
+
+        // detour reports a ray which reached its end as hitting at infinity
+        if (startPolyRef &&
+            dtStatusSucceed(context.m_navQuery.raycast(
+                startPolyRef, recastStart, recastEnd, &queryFilter, &t,
+                hitNormal, &context.m_polyRefs[0], &pathLength,
+                static_cast<int>(context.m_polyRefs.size()))) &&
+            t < fraction)
+            fraction = t;
     }
 
-    float outputPoint[3];
+    // each sphere is swept through each model in the space of the model, in
+    // which its radius is scaled along with everything else
+    auto const sweep = [&](const math::Matrix& inverse, const Model& model)
+    {
+        auto const origin = math::Vector3::Transform(start, inverse);
+        auto const scale =
+            (math::Vector3::Transform(start + math::Vector3 {1.f, 0.f, 0.f},
+                                      inverse) -
+             origin)
+                .Length();
+
+        for (auto s = 0; s < spheres; ++s)
+        {
+            auto const lift =
+                spheres > 1 ? lowest + (highest - lowest) * s / (spheres - 1)
+                            : lowest;
+            const math::Vector3 offset {0.f, 0.f, lift};
 
-    dtPolyRef randomRef;
-    if (m_navQuery.findRandomPointAroundCircle(startRef,
-                                               recastCenter,
-                                               radius,
-                                               &m_queryFilter,
-                                               &random_between_0_and_1,
-                                               &randomRef,
-                                               outputPoint) != DT_SUCCESS) {
+            math::Ray ray(math::Vector3::Transform(start + offset, inverse),
+                          math::Vector3::Transform(end + offset, inverse));
+            ray.SetHitPoint(fraction);
+
+            if (model.m_aabbTree.SweepSphere(ray, radius * scale))
+                fraction = ray.GetDistance();
+        }
+    };
+
+    // everything the capsule could touch lies within the box it sweeps
+    math::BoundingBox bounds;
+    bounds.MinCorner = bounds.MaxCorner = start;
+    bounds.update(end);
+    bounds.MinCorner = bounds.MinCorner - math::Vector3 {radius, radius, 0.f};
+    bounds.MaxCorner =
+        bounds.MaxCorner + math::Vector3 {radius, radius, highest + radius};
+
+    m_staticWmoBounds.Overlap(bounds, [&](const InstanceBounds& i) {
+        auto const& instance = m_staticWmos[i.m_index];
+        if (auto const model = instance.m_model.lock())
+            sweep(instance.m_inverseTransformMatrix, *model);
+    });
+
+    if (doodads)
+        m_staticDoodadBounds.Overlap(bounds, [&](const InstanceBounds& i) {
+            auto const& instance = m_staticDoodads[i.m_index];
+            if (auto const model = instance.m_model.lock())
+                sweep(instance.m_inverseTransformMatrix, *model);
+        });
+
+    for (auto const& entry : m_temporaryWmos)
+        if (auto const instance = entry.second.lock())
+            if (bounds.intersect(instance->m_bounds))
+                if (auto const model = instance->m_model.lock())
+                    sweep(instance->m_inverseTransformMatrix, *model);
+
+    if (doodads)
+        for (auto const& entry : m_temporaryDoodads)
+            if (auto const instance = entry.second.lock())
+                if (bounds.intersect(instance->m_bounds))
+                    if (auto const model = instance->m_model.lock())
+                        sweep(instance->m_inverseTransformMatrix, *model);
+
+    if (fraction >= 1.f)
         return false;
-    }
 
-    math::Convert::VertexToWow(outputPoint, randomPoint);
+    stop = start + movement * fraction;
 
     return true;
 }
 
-
-bool Map::FindHeight(const math::Vertex& source, float x, float y, float& z) const
+void Map::RayCastAll(const math::Ray& ray, const Tile* tile,
+                     std::vector<float>& distances) const
 {
-    // ray cast along navmesh from source to target
-    float recastSource[3];
-    math::Convert::VertexToRecast(source, recastSource);
+    if (!ray.IntersectBoundingBox(tile->m_bounds))
+        return;
 
-    constexpr float extents[] = {1.f, 1.f, 1.f};
+    // each instance appears at most once per tile, so there is no need to
+    // track which have been visited
+    auto const cast = [&ray, &distances](const auto& instance)
+    {
+        if (!ray.IntersectBoundingBox(instance.m_bounds))
+            return;
 
-    dtPolyRef startRef;
-    if (m_navQuery.findNearestPoly(recastSource, extents, &m_queryFilter,
-                                   &startRef, nullptr) != DT_SUCCESS)
-        return false;
+        auto const model = instance.m_model.lock();
+        if (!model)
+            return;
 
-    float recastTarget[3];
-    // use the source Z as an initial guess
-    math::Convert::VertexToRecast({x, y, source.Z}, recastTarget);
+        math::Ray rayInverse(
+            math::Vector3::Transform(ray.GetStartPoint(),
+                                     instance.m_inverseTransformMatrix),
+            math::Vector3::Transform(ray.GetEndPoint(),
+                                     instance.m_inverseTransformMatrix));
 
-    dtPolyRef hit_path[100];
-    dtRaycastHit hit;
-    hit.path = hit_path;
-    hit.maxPath = sizeof(hit_path) / sizeof(hit_path[0]);
+        model->m_aabbTree.IntersectRayAll(rayInverse, distances);
+    };
 
-    if (m_navQuery.raycast(startRef, recastSource, recastTarget, &m_queryFilter,
-                           0, &hit) != DT_SUCCESS)
-        return false;
+    // the instance trees have already tested the bounds
+    auto const castStatic = [&ray, &distances](const StaticInstance& instance)
+    {
+        math::Ray rayInverse(
+            math::Vector3::Transform(ray.GetStartPoint(),
+                                     instance.m_inverseTransformMatrix),
+            math::Vector3::Transform(ray.GetEndPoint(),
+                                     instance.m_inverseTransformMatrix));
 
-    if (!hit.pathCount)
+        instance.m_model->m_aabbTree.IntersectRayAll(rayInverse, distances);
         return false;
+    };
 
-    // if we reach here, it means we have a path and know the poly ref for
-    // the poly where the ray hit.  so let's use that reference and query
-    // the height at the requested x,y.
-    if (m_navQuery.getPolyHeight(hit.path[hit.pathCount - 1], recastTarget,
-                                 &z) != DT_SUCCESS)
-        return false;
+    tile->m_staticWmoTree.Intersect(ray, castStatic);
+    tile->m_staticDoodadTree.Intersect(ray, castStatic);
 
-    auto const tile = GetTile(x, y);
+    for (auto const& wmo : tile->m_temporaryWmos)
+        cast(*wmo.second);
+    for (auto const& doodad : tile->m_temporaryDoodads)
+        cast(*doodad.second);
+}
 
-    if (!tile)
-        return false;
+bool Map::RayCast(math::Ray& ray, bool doodads, bool anyHit) const
+{
+    auto& tiles = GetQueryContext().m_rayTiles;
 
-    // take the imprecise z value from the mesh, and return the precise value
-    if (!FindNextZ(tile, x, y, z, true, z))
-        return false;
+    // find affected tiles
+    tiles.clear();
+    FindTilesOnRay(ray, tiles);
 
-    return true;
+    return RayCast(ray, tiles.data(), tiles.size(), doodads, nullptr, nullptr,
+                   anyHit);
 }
 
-bool Map::FindHeights(float x, float y, std::vector<float>& output) const
+bool Map::RayCast(const math::Vertex& start, const math::Vertex& stop,
+                  bool doodads, RayHit& hit) const
 {
-    auto const tile = GetTile(x, y);
+    ResidencyPins pins(*this);
 
-    if (!tile)
-        return false;
+    EnsureResident(start.X, start.Y, pins);
+    EnsureResident(stop.X, stop.Y, pins);
 
+    math::Ray ray {start, stop};
 
-    // FIXME: not sure what the use case for this search is.  should it be
-    // always precise, never, or user-defined?
+    std::shared_lock<std::shared_mutex> guard(m_mutex);
 
-    float current = tile->m_bounds.getMaximum().Z;
-    do
-    {
-        float next;
-        if (!FindNextZ(tile, x, y, current, false, next))
-            break;
+    auto& tiles = GetQueryContext().m_rayTiles;
+    tiles.clear();
+    FindTilesOnRay(ray, tiles);
 
-        // if we just found the same z, nudge down slightly
-        if (next == current)
-        {
-            current = std::nextafter(next, next - 1.f);
+    // the terrain is tested last, against the ray shortened by any model
+    auto const model = RayCast(ray, tiles.data(), tiles.size(), doodads,
+                               nullptr, nullptr, false, &hit);
+    auto const terrain = RayCastTerrain(ray, tiles.data(), tiles.size(), hit);
 
-            // if this nudge put us below the tile boundary, don't try another ray cast
-            // as this will cause the ray to go upward instead of downward.
-            if (current < tile->m_bounds.getMaximum().Z)
-                break;
-        }
-        else
-        {
-            output.push_back(next);
-            current = next;
-        }
-    } while (true);
+    if (!model && !terrain)
+        return false;
 
-    float adtHeight;
-    if (GetADTHeight(tile, x, y, adtHeight))
-        output.push_back(adtHeight);
+    hit.m_point = ray.GetHitPoint();
+    hit.m_distance = ray.GetDistance() * ray.GetLength();
+    hit.m_normal = math::Vector3::Normalize(hit.m_normal);
+
+    if (math::Vector3::DotProduct(hit.m_normal, ray.GetDirection()) > 0.f)
+        hit.m_normal = -1.f * hit.m_normal;
 
-    return !output.empty();
+    return true;
 }
 
-bool Map::ZoneAndArea(const math::Vertex& position, unsigned int& zone,
-                      unsigned int& area) const
+bool Map::RayCastTerrain(math::Ray& ray, const Tile* const* tiles,
+                         size_t tileCount, RayHit& hitInfo) const
 {
-    // find the tile corresponding to this (x, y)
-    auto const tile = GetTile(position.X, position.Y);
+    auto constexpr quadWidth = MeshSettings::AdtChunkSize / 8;
+    auto constexpr quads = 8 / MeshSettings::TilesPerChunk;
 
-    if (!tile)
-        return false;
+    // see GetADTHeight() regarding the layout of the quad heights
+    auto constexpr yMultiplier = 1 + 16 / MeshSettings::TilesPerChunk;
+    auto constexpr midOffset = 1 + 8 / MeshSettings::TilesPerChunk;
 
-    std::vector<const Tile*> tiles {tile};
+    auto const& start = ray.GetStartPoint();
+    auto const& end = ray.GetEndPoint();
 
-    math::Ray ray {
-        {position.X, position.Y, position.Z},
-        {position.X, position.Y, tile->m_bounds.getMinimum().Z}};
+    auto const minX = (std::min)(start.X, end.X);
+    auto const maxX = (std::max)(start.X, end.X);
+    auto const minY = (std::min)(start.Y, end.Y);
+    auto const maxY = (std::max)(start.Y, end.Y);
 
-    unsigned int localZone, localArea;
-    auto const rayResult = RayCast(ray, tiles, false, &localZone, &localArea);
-    if (rayResult)
-    {
-        zone = localZone;
-        area = localArea;
-    }
+    auto const quad = [](float offset) {
+        return (std::max)(0, (std::min)(quads - 1, static_cast<int>(
+                                                       offset / quadWidth)));
+    };
 
-    float adtHeight;
-    unsigned int adtZone, adtArea;
-    auto const adtResult = GetADTHeight(tile, position.X, position.Y, adtHeight,
-                                        &adtZone, &adtArea);
+    auto hit = false;
 
-    if (adtResult && adtHeight > ray.GetHitPoint().Z)
+    for (auto t = 0u; t < tileCount; ++t)
     {
-        zone = adtZone;
-        area = adtArea;
-    }
+        auto const tile = tiles[t];
 
-    assert(rayResult || adtResult);
+        if (!tile->m_hasQuadHeights)
+            continue;
 
-    return rayResult || adtResult;
-}
+        float northwestX, northwestY;
+        math::Convert::TileToWorldNorthwestCorner(tile->m_x, tile->m_y,
+                                                  northwestX, northwestY);
 
-bool Map::LineOfSight(const math::Vertex& start, const math::Vertex& stop, bool doodads) const
-{
-    math::Ray ray {start, stop};
-    // RayCast() returns true when an obstacle is hit
-    return !RayCast(ray, doodads);
-}
+        // only the quads beneath the bounds of the ray can be hit
+        for (auto quadY = quad(northwestX - maxX);
+             quadY <= quad(northwestX - minX); ++quadY)
+            for (auto quadX = quad(northwestY - maxY);
+                 quadX <= quad(northwestY - minY); ++quadX)
+            {
+                if (tile->m_quadHoles[quadX][quadY])
+                    continue;
 
-bool Map::RayCast(math::Ray& ray, bool doodads) const
-{
-    std::vector<const Tile*> tiles;
+                auto const x = northwestX - quadY * quadWidth;
+                auto const y = northwestY - quadX * quadWidth;
+                auto const index = yMultiplier * quadY + quadX;
+
+                // the quad is a fan of four triangles around c, with the
+                // same layout as in GetADTHeight()
+                const math::Vertex corners[] = {
+                    {x, y, tile->QuadHeight(index)},
+                    {x, y - quadWidth, tile->QuadHeight(index + 1)},
+                    {x - quadWidth, y - quadWidth,
+                     tile->QuadHeight(index + yMultiplier + 1)},
+                    {x - quadWidth, y, tile->QuadHeight(index + yMultiplier)},
+                };
+                const math::Vertex c {x - quadWidth / 2, y - quadWidth / 2,
+                                      tile->QuadHeight(index + midOffset)};
+
+                for (auto i = 0; i < 4; ++i)
+                {
+                    auto const& a = corners[i];
+                    auto const& b = corners[(i + 1) % 4];
 
-    // find affected tiles
-    for (auto const& tile : m_tiles)
-        if (ray.IntersectBoundingBox(tile.second->m_bounds))
-            tiles.push_back(tile.second.get());
+                    // the triangle test is one sided, and the terrain may be
+                    // hit from below
+                    float distance;
+                    if (!ray.IntersectTriangle(a, b, c, &distance) &&
+                        !ray.IntersectTriangle(b, a, c, &distance))
+                        continue;
+
+                    if (distance >= ray.GetDistance())
+                        continue;
+
+                    hit = true;
+                    ray.SetHitPoint(distance);
+
+                    hitInfo.m_kind = RayHit::Kind::Terrain;
+                    hitInfo.m_id = 0;
+                    hitInfo.m_normal =
+                        math::Vector3::CrossProduct(b - a, c - a);
+                }
+            }
+    }
 
-    return RayCast(ray, tiles, doodads);
+    return hit;
 }
 
-bool Map::RayCast(math::Ray& ray, const std::vector<const Tile*>& tiles,
-                  bool doodads, unsigned int* zone, unsigned int* area) const
+bool Map::RayCast(math::Ray& ray, const Tile* const* tiles, size_t tileCount,
+                  bool doodads, unsigned int* zone, unsigned int* area,
+                  bool anyHit, RayHit* hitInfo) const
 {
     auto const& start = ray.GetStartPoint();
     auto const& end = ray.GetEndPoint();
 
     auto hit = false;
 
-    // FIXME: Examine WoW++ functions Map::isInLineOfSight and
-    // forEachTileInRayXY() to see if that approach is more performant
+    m_metrics.RecordTilesTraversed(tileCount);
+
+    // track visited instances to prevent repeated checks on the same objects
+    auto& context = GetQueryContext();
+    BeginVisit(context);
 
-    // save ids to prevent repeated checks on the same objects
-    std::unordered_set<std::uint32_t> staticWmos, staticDoodads;
-    std::unordered_set<std::uint64_t> temporaryWmos, temporaryDoodads;
+    auto const generation = context.m_visitGeneration;
 
     // for each tile...
-    for (auto const tile : tiles)
+    for (auto t = 0u; t < tileCount; ++t)
     {
+        auto const tile = tiles[t];
+
         // if the tile itself does not intersect our ray, do nothing
         if (!ray.IntersectBoundingBox(tile->m_bounds))
             continue;
 
-        // measure intersection for all static wmos on the tile
-        for (auto const& id : tile->m_staticWmos)
+        // measure intersection for the static instances on the tile whose
+        // bounds the ray crosses.  returns true to stop the search
+        auto const cast = [&](const StaticInstance& instance,
+                              std::vector<std::uint32_t>& stamps,
+                              RayHit::Kind kind,
+                              const std::vector<std::uint32_t>& ids)
         {
-            // skip static wmos we have already seen (possibly from a previous
+            // skip instances we have already seen (possibly from a previous
             // tile)
-            if (staticWmos.find(id) != staticWmos.end())
-                continue;
-
-            // record this static wmo as having been tested
-            staticWmos.insert(id);
-
-            auto const& instance = m_staticWmos.at(id);
-
-            // skip this wmo if the bbox doesn't intersect, saves us from
-            // calculating the inverse ray
-            if (!ray.IntersectBoundingBox(instance.m_bounds))
-                continue;
+            if (!FirstVisit(stamps, generation, instance.m_index))
+                return false;
 
             math::Ray rayInverse(math::Vector3::Transform(
                                      start, instance.m_inverseTransformMatrix),
                                  math::Vector3::Transform(
                                      end, instance.m_inverseTransformMatrix));
 
-            // if this is a closer hit, update the original ray's distance
-            if (auto model = instance.m_model.lock())
-            {
-                if (model->m_aabbTree.IntersectRay(rayInverse) &&
-                    rayInverse.GetDistance() < ray.GetDistance())
-                {
-                    hit = true;
-                    ray.SetHitPoint(rayInverse.GetDistance());
+            auto const& tree = instance.m_model->m_aabbTree;
 
-                    if (area)
-                        *area = model->m_nameSetToAreaZone[instance.m_nameSet]
-                                    .first;
-                    if (zone)
-                        *zone = model->m_nameSetToAreaZone[instance.m_nameSet]
-                                    .second;
-                }
-            }
-        }
+            if (anyHit)
+                return tree.Occluded(rayInverse);
 
-        // measure intersection for all static doodads on this tile
-        if (doodads)
-        {
-            for (auto const& id : tile->m_staticDoodads)
+            // if this is a closer hit, update the original ray's distance
+            unsigned int face;
+            if (tree.IntersectRay(rayInverse, &face) &&
+                rayInverse.GetDistance() < ray.GetDistance())
             {
-                // skip static doodads we have already seen (possibly from a
-                // previous tile)
-                if (staticDoodads.find(id) != staticDoodads.end())
-                    continue;
-
-                // record this static doodad as having been tested
-                staticDoodads.insert(id);
+                hit = true;
+                ray.SetHitPoint(rayInverse.GetDistance());
 
-                auto const& instance = m_staticDoodads.at(id);
+                if (instance.m_wmoModel)
+                    GetAreaAndZone(*instance.m_wmoModel, instance.m_nameSet,
+                                   zone, area);
 
-                // skip this doodad if the bbox doesn't intersect, saves us from
-                // calculating the inverse ray
-                if (!ray.IntersectBoundingBox(instance.m_bounds))
-                    continue;
-
-                math::Ray rayInverse(
-                    math::Vector3::Transform(start,
-                                             instance.m_inverseTransformMatrix),
-                    math::Vector3::Transform(
-                        end, instance.m_inverseTransformMatrix));
-
-                // if this is a closer hit, update the original ray's distance
-                if (instance.m_model.lock()->m_aabbTree.IntersectRay(
-                        rayInverse) &&
-                    rayInverse.GetDistance() < ray.GetDistance())
-                {
-                    hit = true;
-                    ray.SetHitPoint(rayInverse.GetDistance());
-                }
+                if (hitInfo)
+                    DescribeHit(*hitInfo, kind, ids[instance.m_index],
+                                *instance.m_model, face,
+                                instance.m_inverseTransformMatrix);
             }
-        }
+
+            return false;
+        };
+
+        if (tile->m_staticWmoTree.Intersect(
+                ray, [&](const StaticInstance& instance) {
+                    return cast(instance, context.m_staticWmoStamps,
+                                RayHit::Kind::Wmo, m_staticWmoIds);
+                }))
+            return true;
+
+        if (doodads && tile->m_staticDoodadTree.Intersect(
+                           ray, [&](const StaticInstance& instance) {
+                               return cast(instance,
+                                           context.m_staticDoodadStamps,
+                                           RayHit::Kind::Doodad,
+                                           m_staticDoodadIds);
+                           }))
+            return true;
 
         // measure intersection for all temporary wmos on this tile
         if (doodads)
@@ -1072,14 +4937,11 @@ bool Map::RayCast(math::Ray& ray, const std::vector<const Tile*>& tiles,
             // sure if this ever actually happens in practice.
             for (auto const& wmo : tile->m_temporaryWmos)
             {
-                // skip static wmos we have already seen (possibly from a
+                // skip temporary wmos we have already seen (possibly from a
                 // previous tile)
-                if (temporaryWmos.find(wmo.first) != temporaryWmos.end())
+                if (!FirstVisit(context.m_visitedTemporaryWmos, wmo.first))
                     continue;
 
-                // record this temporary wmo as having been tested
-                temporaryWmos.insert(wmo.first);
-
                 // skip this wmo if the bbox doesn't intersect, saves us from
                 // calculating the inverse ray
                 if (!ray.IntersectBoundingBox(wmo.second->m_bounds))
@@ -1094,21 +4956,23 @@ bool Map::RayCast(math::Ray& ray, const std::vector<const Tile*>& tiles,
                 // if this is a closer hit, update the original ray's distance
                 if (auto model = wmo.second->m_model.lock())
                 {
-                    if (model->m_aabbTree.IntersectRay(rayInverse) &&
+                    if (anyHit && model->m_aabbTree.Occluded(rayInverse))
+                        return true;
+
+                    unsigned int face;
+                    if (!anyHit &&
+                        model->m_aabbTree.IntersectRay(rayInverse, &face) &&
                         rayInverse.GetDistance() < ray.GetDistance())
                     {
                         hit = true;
                         ray.SetHitPoint(rayInverse.GetDistance());
-                        if (area)
-                            *area =
-                                model
-                                    ->m_nameSetToAreaZone[wmo.second->m_nameSet]
-                                    .first;
-                        if (zone)
-                            *zone =
-                                model
-                                    ->m_nameSetToAreaZone[wmo.second->m_nameSet]
-                                    .second;
+                        GetAreaAndZone(*model, wmo.second->m_nameSet, zone,
+                                       area);
+
+                        if (hitInfo)
+                            DescribeHit(*hitInfo, RayHit::Kind::TemporaryWmo,
+                                        wmo.first, *model, face,
+                                        wmo.second->m_inverseTransformMatrix);
                     }
                 }
             }
@@ -1119,15 +4983,12 @@ bool Map::RayCast(math::Ray& ray, const std::vector<const Tile*>& tiles,
         {
             for (auto const& doodad : tile->m_temporaryDoodads)
             {
-                // skip static wmos we have already seen (possibly from a
-                // previous tile)
-                if (temporaryDoodads.find(doodad.first) !=
-                    temporaryDoodads.end())
+                // skip temporary doodads we have already seen (possibly from
+                // a previous tile)
+                if (!FirstVisit(context.m_visitedTemporaryDoodads,
+                                doodad.first))
                     continue;
 
-                // record this temporary wmo as having been tested
-                temporaryDoodads.insert(doodad.first);
-
                 // skip this doodad if the bbox doesn't intersect, saves us from
                 // calculating the inverse ray
                 if (!ray.IntersectBoundingBox(doodad.second->m_bounds))
@@ -1139,13 +5000,24 @@ bool Map::RayCast(math::Ray& ray, const std::vector<const Tile*>& tiles,
                     math::Vector3::Transform(
                         end, doodad.second->m_inverseTransformMatrix));
 
+                auto const model = doodad.second->m_model.lock();
+
+                if (anyHit && model->m_aabbTree.Occluded(rayInverse))
+                    return true;
+
                 // if this is a closer hit, update the original ray's distance
-                if (doodad.second->m_model.lock()->m_aabbTree.IntersectRay(
-                        rayInverse) &&
+                unsigned int face;
+                if (!anyHit &&
+                    model->m_aabbTree.IntersectRay(rayInverse, &face) &&
                     rayInverse.GetDistance() < ray.GetDistance())
                 {
                     hit = true;
                     ray.SetHitPoint(rayInverse.GetDistance());
+
+                    if (hitInfo)
+                        DescribeHit(*hitInfo, RayHit::Kind::TemporaryDoodad,
+                                    doodad.first, *model, face,
+                                    doodad.second->m_inverseTransformMatrix);
                 }
             }
         }
@@ -1,45 +1,101 @@
 #pragma once
 
-#include "BVH.hpp"
 #include "Common.hpp"
+#include "Crowd.hpp"
+#include "JobPool.hpp"
 #include "Model.hpp"
+#include "LineOfSightCache.hpp"
+#include "ModelCache.hpp"
+#include "PathCache.hpp"
+#include "PathCorridor.hpp"
+#include "PathRequest.hpp"
+#include "PortalGraph.hpp"
+#include "QueryContext.hpp"
+#include "QueryMetrics.hpp"
+#include "QueryRecorder.hpp"
+#include "Reachability.hpp"
 #include "Tile.hpp"
 #include "recastnavigation/Detour/Include/DetourNavMesh.h"
 #include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "utility/ArrayView.hpp"
 #include "utility/Ray.hpp"
 #include "utility/Vector.hpp"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
+#include <future>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
-namespace std
+namespace pathfind
 {
-template <>
-struct hash<std::pair<int, int>>
+// what Map::RayCast() found
+struct RayHit
 {
-    std::size_t operator()(const std::pair<int, int>& coord) const
+    enum class Kind : std::uint8_t
     {
-        return std::hash<int>()(coord.first ^ coord.second);
-    }
+        Terrain,
+        Wmo,
+        Doodad,
+        TemporaryWmo,
+        TemporaryDoodad,
+    };
+
+    Kind m_kind;
+
+    // the unique id MapBuilder gave a static instance, the guid of a
+    // game object, or zero for the terrain
+    std::uint64_t m_id;
+
+    math::Vertex m_point;
+
+    // of the face which was hit, facing back towards the start
+    math::Vertex m_normal;
+
+    // from the start to m_point
+    float m_distance;
 };
-} // namespace std
 
-namespace pathfind
-{
-// note that instances of this type are assumed to be thread-local, therefore
-// the type is not thread safe
+// a single instance of this type may be shared between threads.  the navmesh,
+// instances and models are stored once, while each calling thread gets its own
+// QueryContext (see GetQueryContext()).  queries may run concurrently with one
+// another, whereas operations which add or remove tiles or obstacles are
+// serialized against everything else.
 class Map
 {
+    friend class Crowd;
+    friend class PathCorridor;
+    friend class PathRequest;
     friend class Tile;
 
 private:
     static constexpr int MaxStackedPolys = 128;
-    static constexpr int MaxPathHops = 4096;
 
-    BVH m_bvhLoader;
+    // paths whose ends are at least this many tiles apart along either axis
+    // are first routed through the portal graph
+    static constexpr int HierarchicalPathTiles = MeshSettings::TilesPerADT;
+
+    // roughly how many tiles apart consecutive waypoints of a portal route
+    // are, and so how far each refining search has to go
+    static constexpr int RefineTileSpan = 4;
+
+    // the BVH index and the loaded models, which may be shared with other
+    // maps (see MapManager).  these are also used by background ADT loads
+    const std::shared_ptr<ModelCache> m_models;
 
     // this is false when the map is based on a global wmo
     bool m_hasADTs;
@@ -53,19 +109,140 @@ private:
     const std::filesystem::path m_dataPath;
     const std::string m_mapName;
 
+    // the sizes of the query context of each thread
+    const QueryLimits m_queryLimits;
+
+    // the AgentSize of the nav files, which the first of them to be read
+    // decides, or AgentProfileCount until then
+    std::atomic<std::uint32_t> m_agentSize;
+
+    // throws unless the nav file is for the same agent as those before it
+    void CheckAgentSize(AgentSize size);
+
+    // likewise for the RegionPartition of the nav files, which rebuilds of
+    // their tiles beneath temporary obstacles also use
+    std::atomic<std::uint32_t> m_regionPartition;
+
+    void CheckRegionPartition(RegionPartition partition);
+
+    // the coarse routing graph between tiles, which is only present for maps
+    // built from ADTs
+    PortalGraph m_portalGraph;
+
     dtNavMesh m_navMesh;
-    dtNavMeshQuery m_navQuery;
-    dtQueryFilter m_queryFilter;
 
-    // TODO: Does this need to be a pointer?
-    std::unordered_map<std::pair<int, int>, std::unique_ptr<Tile>> m_tiles;
+    // the number of times a tile of m_navMesh has had its mesh replaced by
+    // Tile::AddMesh(), and for each tile, by detour tile index, what that
+    // number was when its mesh was last replaced.  a rebuilt mesh is added
+    // under the reference of the one it replaces, salt and all, so these are
+    // what tell the polygons of the two apart.  guarded by m_mutex
+    std::uint64_t m_meshGeneration;
+    std::vector<std::uint64_t> m_tileGenerations;
+
+    // whether any of the polygons is of a tile whose mesh has been replaced
+    // since m_meshGeneration was the given generation.  the caller must hold
+    // m_mutex
+    bool MeshReplacedSince(std::uint64_t generation, const dtPolyRef* polys,
+                           int count) const;
+
+    // the navmeshes of the other agents which the nav files have meshes for,
+    // created with the parameters of m_navMesh as the first tile of each is
+    // added.  these are declared before m_tiles, as destroying a tile removes
+    // its meshes from them
+    std::unique_ptr<dtNavMesh> m_agentNavMeshes[AgentProfileCount];
+
+    // returns the navmesh of the given other agent, creating it if needed.
+    // the caller must hold m_mutex exclusively
+    dtNavMesh& AgentNavMesh(AgentSize agent);
+
+    // returns the navmesh of the given agent, or nullptr if no loaded tile
+    // has a mesh for it.  the caller must hold m_mutex
+    const dtNavMesh* FindAgentNavMesh(AgentSize agent) const;
+
+    // unique for the lifetime of the process, so that a thread-local cache of
+    // the most recently used context can never match a destroyed map
+    const std::uint64_t m_id;
+
+    // held shared by queries and exclusively by anything which modifies the
+    // navmesh, the tiles or the instance and model containers below
+    mutable std::shared_mutex m_mutex;
+
+    // corridors found by FindPath(), which is disabled until given a capacity
+    mutable PathCache m_pathCache;
+
+    // results of LineOfSight(), which is disabled until given a capacity
+    mutable LineOfSightCache m_lineOfSightCache;
+
+    // the connected components of the loaded navmesh, which FindPath() only
+    // consults once enabled
+    mutable Reachability m_reachability;
 
-    // indexed by unique instance id.  this data is always loaded.  whenever a
-    // tile using one of these instances is loaded, the corresponding model is
-    // loaded also.  whenever all tiles referencing a model (possibly through
-    // distinct instances) are unloaded, the model is unloaded.
-    std::unordered_map<std::uint32_t, WmoInstance> m_staticWmos;
-    std::unordered_map<std::uint32_t, DoodadInstance> m_staticDoodads;
+    // disabled until EnableMetrics() is called
+    mutable QueryMetrics m_metrics;
+
+    // disabled until StartRecording() is called
+    mutable QueryRecorder m_recorder;
+
+    // paths whose ends are at most this far apart are first tried as a
+    // navmesh ray cast.  zero, the default, disables this
+    std::atomic<float> m_straightPathDistance;
+
+    // named filters selecting which polygons a query may use, by their
+    // PolyFlags.  these are guarded by m_mutex
+    std::unordered_map<std::string, dtQueryFilter> m_queryFilters;
+
+    mutable std::mutex m_queryContextMutex;
+    mutable std::unordered_map<std::thread::id, std::unique_ptr<QueryContext>>
+        m_queryContexts;
+
+    // the threads between which FindPaths() divides its batches, started by
+    // the first batch wanting more than one.  like any thread, each keeps
+    // its query context from one batch to the next
+    mutable std::mutex m_batchPoolMutex;
+    mutable std::unique_ptr<JobPool> m_batchPool;
+
+    JobPool& GetBatchPool() const;
+
+    // stops the threads of the batch pool, releasing their query contexts
+    void StopBatchPool();
+
+    // tiles whose height fields are loaded for obstacles.  guarded by m_mutex.
+    // this is declared before m_tiles, as destroying a tile removes it
+    std::unordered_set<Tile*> m_heightFieldTiles;
+
+    // tiles are stored in a two-level grid indexed by tile (x, y).  the first
+    // level has one slot per ADT, and a block of TilesPerADT * TilesPerADT
+    // tiles is allocated the first time a tile within that ADT is inserted.
+    // global wmo maps use the same grid, as their tile coordinates are also
+    // within [0, TileCount).
+    using TileBlock = std::array<std::unique_ptr<Tile>,
+                                 MeshSettings::TilesPerADT *
+                                     MeshSettings::TilesPerADT>;
+    std::unique_ptr<TileBlock> m_tiles[MeshSettings::Adts][MeshSettings::Adts];
+
+    // sorted by unique instance id, which for each instance is held in the
+    // parallel id array, and found by binary search.  this data is always
+    // loaded.  whenever a tile using one of these instances is loaded, the
+    // corresponding model is loaded also.  whenever all tiles referencing a
+    // model (possibly through distinct instances) are unloaded, the model is
+    // unloaded.
+    std::vector<std::uint32_t> m_staticWmoIds;
+    std::vector<WmoInstance> m_staticWmos;
+
+    // the model filenames of the instances, each held once however many
+    // instances use it.  the elements of an unordered_set never move, so the
+    // instances point to them directly, and the static instances may read
+    // them without m_mutex while game objects add more with it held
+    std::unordered_set<std::string> m_modelNames;
+
+    const std::string* InternModelName(const std::string& name);
+
+    std::vector<std::uint32_t> m_staticDoodadIds;
+    std::vector<DoodadInstance> m_staticDoodads;
+
+    // the bounds of the instances above, for QueryInstances()
+    InstanceBoundsTree m_staticWmoBounds;
+    InstanceBoundsTree m_staticDoodadBounds;
 
     // indexed by GUID
     std::unordered_map<std::uint64_t, std::weak_ptr<WmoInstance>>
@@ -73,55 +250,649 @@ private:
     std::unordered_map<std::uint64_t, std::weak_ptr<DoodadInstance>>
         m_temporaryDoodads;
 
-    // map, by filename, of loaded models
-    std::unordered_map<std::string, std::weak_ptr<WmoModel>> m_loadedWmoModels;
-    std::unordered_map<std::string, std::weak_ptr<DoodadModel>>
-        m_loadedDoodadModels;
+    // models kept loaded by PreloadModels(), which are guarded by
+    // m_preloadedModelMutex, and the threads loading them.  each thread sets
+    // its flag as it finishes, so that it is joined by the next preload
+    // rather than kept until ~Map()
+    struct PreloadThread
+    {
+        std::thread m_thread;
+        std::shared_ptr<std::atomic_bool> m_finished;
+    };
+
+    std::mutex m_preloadedModelMutex;
+    std::vector<std::shared_ptr<Model>> m_preloadedModels;
+    std::mutex m_preloadMutex;
+    std::vector<PreloadThread> m_preloadThreads;
+    std::atomic_bool m_preloadStop;
+
+    // loads the models of the given BVH files on background threads
+    std::future<size_t> PreloadBVHFiles(std::vector<std::string> bvhFiles,
+                                        unsigned int threads);
+
+    // the weak pointers of the temporary obstacles expire as they are removed
+    // but their entries remain.  each container is swept whenever it grows to
+    // twice its size after the previous sweep, which keeps the cost amortized
+    // constant per insertion.
+    size_t m_temporaryWmoSweepSize;
+    size_t m_temporaryDoodadSweepSize;
+
+    // the caller must hold m_mutex exclusively
+    void SweepExpiredTemporaryObstacles();
+
+    // while a batch is open, game objects are only rasterized into the tiles
+    // beneath them, which are rebuilt once the batch is committed.  tiles are
+    // recorded by coordinates, as they may be unloaded in the meantime
+    int m_obstacleBatchDepth;
+    std::set<std::pair<int, int>> m_dirtyTiles;
+
+    // background rebuilds of tiles with temporary obstacles, which are read
+    // by m_rebuildThreads and then wait for CommitRebuiltTiles().  each is
+    // built from a copy of the height field, so that the tile itself may keep
+    // changing meanwhile
+    struct TileRebuild
+    {
+        int m_x;
+        int m_y;
+        const Tile* m_tile;
+        std::uint64_t m_version;
+        bool m_started = false;
+        bool m_finished = false;
+
+        std::unique_ptr<rcHeightfield, decltype(&rcFreeHeightField)>
+            m_heightField {nullptr, &rcFreeHeightField};
+        std::vector<OffMeshConnection> m_offMeshConnections;
+        std::vector<std::uint8_t> m_tileData;
+    };
+
+    std::mutex m_rebuildMutex;
+    std::condition_variable m_rebuildCondition;
+    std::list<TileRebuild> m_rebuilds;
+    std::vector<std::thread> m_rebuildThreads;
+    bool m_rebuildStop;
+
+    // the last version given to a tile.  guarded by m_mutex
+    std::uint64_t m_obstacleVersion;
 
-    // ensures that the model for a particular WMO instance is loaded
-    std::shared_ptr<WmoModel> LoadModelForWmoInstance(unsigned int instanceId);
+    void RebuildWorker();
 
-    // ensures that the model for a particular doodad instance is loaded
-    std::shared_ptr<DoodadModel>
-    LoadModelForDoodadInstance(unsigned int instanceId);
+    // brings the mesh of the tile up to date with its obstacles, or queues
+    // it to be when rebuilding in the background.  the caller must hold
+    // m_mutex exclusively
+    void RebuildTile(Tile* tile);
 
-    // ensure that the given WMO model is loaded
-    std::shared_ptr<WmoModel> EnsureWmoModelLoaded(const std::string& mpq_path);
+    // rebuilds the tile, or marks it to be when the open batch is committed.
+    // a tile without a height field keeps its mesh
+    void TileChanged(Tile* tile);
 
-    // ensure that the given doodad model is loaded
-    std::shared_ptr<DoodadModel>
-    EnsureDoodadModelLoaded(const std::string& mpq_path);
+    // off-mesh connections added by AddOffMeshConnection(), by id.  these
+    // are kept while their tiles are unloaded, and given to them again as
+    // they are loaded.  guarded by m_mutex
+    std::unordered_map<std::uint32_t, OffMeshConnection> m_offMeshConnections;
+    std::uint32_t m_nextOffMeshConnectionId;
+
+    // the loaded tile containing the start of the connection, or nullptr,
+    // as when the tile has no height field from which to rebuild it.  one
+    // without is given to `omitted' when it is not null
+    Tile* GetStartTile(const OffMeshConnection& connection,
+                       Tile** omitted = nullptr) const;
+
+    // height fields are released once unused for this long, unless it is
+    // zero (see m_heightFieldTiles).  guarded by m_mutex
+    std::chrono::milliseconds m_heightFieldIdleTime;
+
+    size_t ReleaseIdleHeightFieldsLocked();
+
+    // appends the loaded tiles whose bounds intersect the given bounds in two
+    // dimensions.  those without a height field still hold the obstacles,
+    // for line of sight and rays, but TileChanged() does not rebuild them
+    void GetTilesInBounds(const math::BoundingBox& bounds,
+                          std::vector<Tile*>& tiles) const;
+
+    // an ADT requested by LoadADTAsync(), which is read on m_asyncThread and
+    // then waits for CommitLoadedADTs()
+    struct AsyncADTLoad
+    {
+        int m_x;
+        int m_y;
+        bool m_started = false;
+        bool m_finished = false;
+
+        // false when the map has no nav file for this ADT
+        bool m_found = false;
+        std::exception_ptr m_error;
+
+        // whether any request for it was explicit (see m_explicitADT)
+        bool m_explicit = false;
+
+        std::vector<std::unique_ptr<Tile>> m_tiles;
+        size_t m_bytes = 0;
+        std::filesystem::file_time_type m_writeTime;
+        std::vector<std::promise<bool>> m_promises;
+    };
+
+    std::mutex m_asyncMutex;
+    std::condition_variable m_asyncCondition;
+    std::list<AsyncADTLoad> m_asyncLoads;
+    std::thread m_asyncThread;
+    bool m_asyncStop;
+
+    void AsyncLoadWorker();
+
+    // see WatchNavFiles()
+    std::mutex m_watchMutex;
+    std::condition_variable m_watchCondition;
+    std::thread m_watchThread;
+    std::chrono::milliseconds m_watchInterval;
+    bool m_watchStop;
+
+    void NavFileWatcher();
+
+    std::filesystem::path NavFilePath(int x, int y) const;
+
+    // the tiles of unloaded ADTs, already detached from the map, which are
+    // destroyed on m_reclaimThread.  freeing the meshes, height fields and
+    // instance trees of an ADT, and perhaps the last references to its
+    // models, takes far longer than removing it from the navmesh, and need
+    // not be done while the caller waits, nor while m_mutex is held
+    std::mutex m_reclaimMutex;
+    std::condition_variable m_reclaimCondition;
+    std::vector<std::unique_ptr<TileBlock>> m_reclaims;
+    std::thread m_reclaimThread;
+    bool m_reclaimStop;
+
+    // whether the reclaimer is destroying tiles taken from m_reclaims
+    bool m_reclaiming;
+
+    void ReclaimWorker();
+
+    // waits until every tile given to the reclaimer has been destroyed
+    void WaitForReclaims();
+
+    // how many threads ReadADT() may load models on (see
+    // SetModelLoadThreads())
+    std::atomic<unsigned int> m_modelLoadThreads;
+
+    // loads the models of the given tiles which are not already loaded,
+    // several at once, into models for Tile::LoadModels().  this does not
+    // require m_mutex
+    void PrefetchModels(const std::vector<std::unique_ptr<Tile>>& tiles,
+                        Tile::ModelCache& models);
+
+    // reads the tiles of an ADT and loads their models, along with the time
+    // at which its nav file was written, taken before it is mapped.  this
+    // does not require m_mutex.  returns false if there is no nav file for
+    // the ADT.
+    bool ReadADT(int x, int y, std::vector<std::unique_ptr<Tile>>& tiles,
+                 size_t& bytes, std::filesystem::file_time_type& writeTime);
+
+    // adds tiles returned by ReadADT() to the map.  the caller must hold
+    // m_mutex exclusively
+    void CommitADT(int x, int y, std::vector<std::unique_ptr<Tile>>& tiles,
+                   size_t bytes, std::filesystem::file_time_type writeTime);
+
+    // the write times of the nav files of the loaded ADTs as they were read,
+    // against which NavFileWatcher() compares.  guarded by m_mutex
+    std::filesystem::file_time_type m_adtWriteTimes[MeshSettings::Adts]
+                                                   [MeshSettings::Adts];
+
+    // residency policy (see SetResidencyBudget()).  a budget of zero disables
+    // it.  the size of an ADT is the size of its mapped nav file, which does
+    // not include the models it shares with other ADTs.
+    std::atomic<size_t> m_residencyBudget;
+    size_t m_residentBytes;
+    size_t m_adtBytes[MeshSettings::Adts][MeshSettings::Adts];
+
+    // a logical clock, advanced whenever an ADT is used
+    mutable std::atomic<std::uint64_t> m_residencyClock;
+    mutable std::atomic<std::uint64_t>
+        m_adtLastUsed[MeshSettings::Adts][MeshSettings::Adts];
+
+    mutable std::atomic<std::uint64_t> m_residencyHits;
+    mutable std::atomic<std::uint64_t> m_residencyMisses;
+    std::atomic<std::uint64_t> m_residencyEvictions;
+
+    // the number of queries using each ADT (see ResidencyPins), and whether
+    // it was loaded by LoadADT(), LoadADTAsync() or LoadAllADTs() rather than
+    // on demand.  the budget evicts neither.  m_explicitADT is only cleared
+    // with m_mutex held exclusively, and only set with it held
+    mutable std::atomic<std::uint32_t>
+        m_adtPins[MeshSettings::Adts][MeshSettings::Adts];
+    std::atomic_bool m_explicitADT[MeshSettings::Adts][MeshSettings::Adts];
+
+    // the ADTs which one query has made resident.  a pinned ADT is not
+    // evicted until the query ends and its pins are destroyed, even if
+    // another query (or a later step of the same one) loads others meanwhile.
+    // pins are released without m_mutex, and so must be declared before the
+    // lock guard of the query
+    class ResidencyPins
+    {
+    private:
+        const Map& m_map;
+        std::vector<std::pair<int, int>> m_adts;
+
+    public:
+        explicit ResidencyPins(const Map& map) : m_map(map) {}
+        ~ResidencyPins();
+
+        ResidencyPins(const ResidencyPins&) = delete;
+        ResidencyPins& operator=(const ResidencyPins&) = delete;
+
+        void Pin(int x, int y);
+    };
+
+    // when the residency policy is enabled, records the use of the ADT
+    // containing (x, y) and pins it, loading it if needed.  this must be
+    // called without holding m_mutex.
+    void EnsureResident(float x, float y, ResidencyPins& pins) const;
+
+    // unloads least recently used ADTs which are neither pinned nor loaded
+    // explicitly until the budget is met, or none is left.  the caller must
+    // hold m_mutex exclusively
+    void EnforceResidencyBudget();
+
+    // as LoadADT(), which marks the ADT as loaded explicitly, and
+    // LoadADTAsync(), unless loaded on demand
+    bool LoadADT(int x, int y, bool explicitLoad);
+    std::future<bool> LoadADTAsync(int x, int y, bool explicitLoad);
+
+    // the most ADTs one FindPath() may load (see SetPathLoadBudget())
+    std::atomic<unsigned int> m_pathLoadBudget;
+
+    // load, while budget remains, the ADTs of the map which are not loaded,
+    // and which are crossed by the line from start to end, or are next to the
+    // one containing start and nearer the one containing end, nearest first.
+    // each takes one from the budget and is pinned for the rest of the
+    // query.  these return whether any was loaded, and must be called without
+    // holding m_mutex
+    bool LoadADTsAlong(const math::Vertex& start, const math::Vertex& end,
+                       unsigned int& budget, ResidencyPins& pins) const;
+    bool LoadADTsToward(const math::Vertex& start, const math::Vertex& end,
+                        unsigned int& budget, ResidencyPins& pins) const;
+    bool LoadPathADT(int x, int y, unsigned int& budget,
+                     ResidencyPins& pins) const;
+
+    void UnloadADTLocked(int x, int y);
+
+    // both return nullptr when there is no instance with the given id
+    WmoInstance* FindStaticWmo(std::uint32_t id);
+    DoodadInstance* FindStaticDoodad(std::uint32_t id);
+
+    // converts the given world (x, y) into the tile grid of this map.  the
+    // result is fractional, with the integral part being the tile coordinate
+    void WorldToTile(float x, float y, float& tileX, float& tileY) const;
 
     const Tile* GetTile(float x, float y) const;
 
+    // returns the loaded tile at the given tile coordinates, or nullptr
+    Tile* GetTileAt(int x, int y) const;
+
+    void InsertTile(std::unique_ptr<Tile> tile);
+
+    // appends all loaded tiles which the (x, y) projection of the given ray
+    // passes through, in the order they are crossed
+    void FindTilesOnRay(const math::Ray& ray,
+                        std::vector<const Tile*>& tiles) const;
+
     bool GetADTHeight(const Tile* tile, float x, float y, float& height,
                       unsigned int* zone = nullptr,
                       unsigned int* area = nullptr) const;
 
+    // the zone and area at the given position of the tile, by the terrain or
+    // the wmo beneath it.  the caller must hold m_mutex
+    bool ZoneAndArea(const Tile* tile, const math::Vertex& position,
+                     unsigned int& zone, unsigned int& area) const;
+
+    // as ZoneAndAreaForPoly(), for a caller already holding m_mutex
+    bool PolyZoneAndArea(QueryContext& context, dtPolyRef poly,
+                         unsigned int& zone, unsigned int& area) const;
+
     // find the next floor z below the given hint
     bool FindNextZ(const Tile* tile, float x, float y, float zHint,
                       bool includeAdt, float& result) const;
 
-    bool RayCast(math::Ray& ray, bool doodads) const;
-    bool RayCast(math::Ray& ray, const std::vector<const Tile*>& tiles,
+    // returns the query context for the calling thread, creating it if needed
+    QueryContext& GetQueryContext() const;
+
+    // returns the named filter, or the default filter of the context when the
+    // name is empty.  the caller must hold m_mutex
+    const dtQueryFilter& GetQueryFilter(const QueryContext& context,
+                                        const std::string& name) const;
+
+    // returns the polygon nearest the given recast position, or zero if there
+    // is none within extents.  when hint still refers to a polygon which
+    // passes the filter, and the position is over it to within the vertical
+    // extent, it is returned without searching.  the caller must hold m_mutex
+    dtPolyRef FindNearestPoly(QueryContext& context,
+                              const dtQueryFilter& filter,
+                              const float* position, const float* extents,
+                              dtPolyRef hint = 0) const;
+    static dtPolyRef FindNearestPoly(const dtNavMeshQuery& navQuery,
+                                     const dtQueryFilter& filter,
+                                     const float* position,
+                                     const float* extents, dtPolyRef hint);
+
+    // appends the path to output.  when given, startPoly and endPoly are used
+    // as hints for the polygons of each end, and are updated with those which
+    // were found.  unless refine is negative, the path is refined with it as
+    // by RefinePath().  the caller must hold m_mutex
+    bool FindPath(QueryContext& context, const dtQueryFilter& filter,
+                  const math::Vertex& start, const math::Vertex& end,
+                  std::vector<math::Vertex>& output, bool allowPartial,
+                  dtPolyRef* startPoly = nullptr, dtPolyRef* endPoly = nullptr,
+                  float refine = -1.f) const;
+
+    // as above, searching with the given query, and without the path cache
+    // when it is not m_navQuery of the context.  reachability is only
+    // consulted when the query is of m_navMesh
+    bool FindPath(QueryContext& context, const dtNavMeshQuery& navQuery,
+                  const dtQueryFilter& filter, const math::Vertex& start,
+                  const math::Vertex& end, std::vector<math::Vertex>& output,
+                  bool allowPartial, dtPolyRef* startPoly, dtPolyRef* endPoly,
+                  float refine = -1.f) const;
+
+    // gives the points of output from first on the precise height of the
+    // surface beneath them, first adding points between them at most spacing
+    // apart when it is positive.  the polygon beneath each point is found by
+    // walking the corridor of the path, along which the points lie in order,
+    // rather than by searching.  the caller must hold m_mutex
+    void RefinePath(const dtNavMeshQuery& navQuery, const dtPolyRef* corridor,
+                    int corridorLength, float spacing,
+                    std::vector<math::Vertex>& output, size_t first) const;
+
+    // when start and end are far enough apart, finds the waypoints through
+    // which a path between them should pass, beginning with start and ending
+    // with end.  this does not require m_mutex.
+    bool FindPortalRoute(const math::Vertex& start, const math::Vertex& end,
+                         std::vector<math::Vertex>& waypoints) const;
+
+    // appends the path through each of the given waypoints in turn, leaving
+    // output unchanged if any segment of it cannot be found in full.  the
+    // caller must hold m_mutex
+    bool FindPath(QueryContext& context, const dtQueryFilter& filter,
+                  const std::vector<math::Vertex>& waypoints,
+                  std::vector<math::Vertex>& output,
+                  float refine = -1.f) const;
+
+    // when anyHit is set, these return as soon as anything is found along
+    // the ray, without shortening it to the closest hit.  this is all a line
+    // of sight check needs.
+    bool RayCast(math::Ray& ray, bool doodads, bool anyHit = false) const;
+    bool RayCast(math::Ray& ray, const Tile* const* tiles, size_t tileCount,
                  bool doodads, unsigned int* zone = nullptr,
-                 unsigned int* area = nullptr) const;
+                 unsigned int* area = nullptr, bool anyHit = false,
+                 RayHit* hitInfo = nullptr) const;
 
-    // TODO: need mechanism to cleanup expired weak pointers saved in the
-    // containers of this class
+    // as above, but against the ADT terrain of the tiles, which only the
+    // public RayCast() considers.  the normal of hitInfo is not normalized
+    bool RayCastTerrain(math::Ray& ray, const Tile* const* tiles,
+                        size_t tileCount, RayHit& hitInfo) const;
+
+    // appends the distance along the ray of every surface of every instance
+    // referenced by the tile which it crosses, in no particular order
+    void RayCastAll(const math::Ray& ray, const Tile* tile,
+                    std::vector<float>& distances) const;
+
+    // appends every height found at (x, y), which must be within the tile.
+    // the caller must hold m_mutex
+    void FindHeights(QueryContext& context, const Tile* tile, float x, float y,
+                     bool precise, std::vector<float>& output) const;
 
 public:
     Map() = delete;
     Map(const Map&) = delete;
-    Map(const std::filesystem::path& dataPath, const std::string& mapName);
+    Map(const std::filesystem::path& dataPath, const std::string& mapName,
+        const QueryLimits& limits = {});
+
+    // as above, but loading models through the given cache, which may be
+    // shared with other maps of the same data.  see MapManager
+    Map(std::shared_ptr<ModelCache> models,
+        const std::filesystem::path& dataPath, const std::string& mapName,
+        const QueryLimits& limits = {});
+
+    const QueryLimits& GetQueryLimits() const { return m_queryLimits; }
+    ~Map();
+
+    // the agent which the map was built for (see AgentProfiles).  this is
+    // AgentSize::Default until the first nav file is loaded
+    AgentSize GetAgentSize() const;
+    const AgentProfile& GetAgentProfile() const
+    {
+        return ::GetAgentProfile(GetAgentSize());
+    }
+
+    // how the regions of the tiles were partitioned when they were built.
+    // this is RegionPartition::Watershed until the first nav file is loaded
+    RegionPartition GetRegionPartition() const;
 
     bool HasADT(int x, int y) const;
     bool HasADTs() const;
     bool IsADTLoaded(int x, int y) const;
     bool LoadADT(int x, int y);
     void UnloadADT(int x, int y);
-    int LoadAllADTs();
 
+    // replaces the tiles of a loaded ADT with those of its nav file as it now
+    // is, so that a rebuilt file is used without recreating the map.  the
+    // file is read, and so verified, without holding the lock, and should it
+    // be invalid the exception is thrown with the old tiles still in place.
+    // the new tiles are then swapped in at once, with the temporary obstacles
+    // of the old ones rasterized into them, and the models which both use
+    // are not read again.  returns false, doing nothing, if the ADT is not
+    // loaded or its file is gone.  the file should be replaced by renaming
+    // another over it, as the old tiles use the old one until destroyed
+    bool ReloadADT(int x, int y);
+
+    // polls, every given interval, the nav files of the loaded ADTs, and
+    // reloads those which have been written since they were loaded (see
+    // ReloadADT()).  a file which fails to load is tried again once it is
+    // next written.  an interval of zero stops polling
+    void WatchNavFiles(std::chrono::milliseconds interval);
+
+    // stops every background thread of the map, once each has finished what
+    // it was doing, so that the process may fork and each child go on using
+    // the map.  the tiles which detour has already linked and the mapped
+    // models are then shared, copy on write, by the parent and every child,
+    // rather than loaded again by each, so load whatever will be searched
+    // before forking.  no other thread may use the map meanwhile.  loads
+    // begun by LoadADTAsync() which had not started resume at the next
+    // LoadADTAsync() or CommitLoadedADTs(), and the reclaimer starts again
+    // as needed, but WatchNavFiles() and SetRebuildThreads() must be called
+    // again if wanted
+    void PrepareFork();
+
+    // loads every ADT of the map, returning how many are loaded.  the files
+    // are read and their tiles parsed on the given number of threads (or one
+    // per hardware thread if zero), while the calling thread adds them to the
+    // map as they are ready.  if any fails, the rest are still loaded before
+    // the first error is thrown
+    int LoadAllADTs(unsigned int threads = 0);
+
+    // creates another map of the same data for a separate instance of it,
+    // such as one copy of a dungeon per group.  the clone shares this map's
+    // models, and so loads none of its own, and has its query filters,
+    // straight path distance, reachability setting, residency budget and
+    // path load budget.
+    // with a budget it loads ADTs as it is queried, and otherwise it loads
+    // those which are loaded here now.  temporary
+    // obstacles are not copied, and those added to the clone rebuild only
+    // the clone's own copies of the tiles beneath them.
+    std::unique_ptr<Map> CloneForInstance() const;
+
+    // reads the given ADT, and loads the models it references, on a
+    // background thread.  the tiles are only added to the map by the next call
+    // to CommitLoadedADTs() after the read has finished, at which point the
+    // future is satisfied with what LoadADT() would have returned.  queries
+    // are unaffected until then.  if the map is destroyed first, the future
+    // throws ADT_LOAD_CANCELLED.
+    std::future<bool> LoadADTAsync(int x, int y);
+
+    // adds any ADTs which have finished loading in the background to the map,
+    // returning how many were added.  this is intended to be called regularly
+    // by the thread which owns the map, for example once per world update.
+    int CommitLoadedADTs();
+
+    struct CacheStats
+    {
+        size_t m_liveWmoModels;
+        size_t m_expiredWmoModels;
+        size_t m_liveDoodadModels;
+        size_t m_expiredDoodadModels;
+        size_t m_liveTemporaryWmos;
+        size_t m_expiredTemporaryWmos;
+        size_t m_liveTemporaryDoodads;
+        size_t m_expiredTemporaryDoodads;
+
+        // bytes held by the collision trees of the live models
+        size_t m_modelBytes;
+    };
+
+    // sets how many polygon corridors FindPath() may cache.  paths between
+    // the same pair of polygons reuse the cached corridor until a tile it
+    // passes through is unloaded or rebuilt.  zero, the default, disables
+    // the cache
+    void SetPathCacheCapacity(size_t capacity);
+    PathCache::Stats GetPathCacheStats() const;
+
+    // sets how many results LineOfSight() may cache, for how long, and to
+    // what grid the ends of each ray are rounded for the lookup, so that
+    // rays between ends within spacing yards of one another share a result.
+    // results are dropped before they expire once a tile between their
+    // ends is loaded, unloaded or has its temporary obstacles changed.  a
+    // capacity of zero, the default, disables the cache.  the batched and
+    // fanned checks are not cached, as they already share their traversals
+    void SetLineOfSightCache(size_t capacity,
+                             std::chrono::milliseconds timeToLive,
+                             float spacing = 0.25f);
+    LineOfSightCache::Stats GetLineOfSightCacheStats() const;
+
+    // counts and times every query from here on, along with why any path
+    // searches failed and how much of the BVHs ray casts tested.  the failures
+    // of each detour search are counted, including those of the segments of a
+    // long path which is then searched again as a whole
+    void EnableMetrics(bool enabled) { m_metrics.Enable(enabled); }
+    bool MetricsEnabled() const { return m_metrics.Enabled(); }
+    QueryMetrics::Snapshot GetMetrics() const { return m_metrics.Get(); }
+    void ResetMetrics() { m_metrics.Reset(); }
+
+    // logs the queries made from here on to the given file, replacing it,
+    // until StopRecording(), so that they can be replayed later by
+    // pathfind_replay.  see QueryRecorder for which queries are recorded.
+    // returns false if the file cannot be written
+    bool StartRecording(const std::filesystem::path& path)
+    {
+        return m_recorder.Start(path, m_mapName);
+    }
+    void StopRecording() { m_recorder.Stop(); }
+
+    // removes every expired entry from the model and temporary obstacle
+    // containers, returning how many were removed.  the model containers
+    // are those of every map sharing them.  this also happens
+    // incrementally as the containers grow, so calling it is optional.  the
+    // tiles of unloaded ADTs still waiting to be destroyed are destroyed
+    // first, so that their models are included
+    size_t Compact();
+    CacheStats GetCacheStats() const;
+
+    struct ResidencyStats
+    {
+        size_t m_budget;
+        size_t m_residentBytes;
+        int m_residentADTs;
+
+        // queries which found their ADT loaded, or had to load it
+        std::uint64_t m_hits;
+        std::uint64_t m_misses;
+        std::uint64_t m_evictions;
+    };
+
+    // sets the number of bytes of ADT data this map may keep loaded.  once
+    // set, queries which touch an unloaded ADT load it on demand, and the
+    // least recently used ADTs are unloaded whenever the total exceeds the
+    // budget.  a budget of zero, the default, disables both.  ADTs in use by
+    // a query, and those loaded explicitly by LoadADT(), LoadADTAsync() or
+    // LoadAllADTs(), are never unloaded for the budget, which they may
+    // therefore exceed until UnloadADT() is called.
+    void SetResidencyBudget(size_t bytes);
+    ResidencyStats GetResidencyStats() const;
+
+    // when positive, FindPath() may load up to this many ADTs which are not
+    // loaded, so that a map keeping few of them resident does not fail paths
+    // which cross the others.  those crossed by the straight line (or portal
+    // route) between the ends are loaded before searching.  should the
+    // search still fail, those next to the end of the partial path it finds,
+    // towards the destination, are loaded and the search is tried again, as
+    // long as the budget lasts.  the loads are synchronous, and count
+    // towards the residency budget as any other.  zero, the default, disables
+    // this
+    void SetPathLoadBudget(unsigned int adts) { m_pathLoadBudget = adts; }
+
+    // the models of an ADT which are not already loaded are read and
+    // deserialized on up to this many threads at once, one of them the
+    // thread loading the ADT, before its tiles are given them.  one loads
+    // them in turn as the tiles are read.  the default is four
+    void SetModelLoadThreads(unsigned int threads)
+    {
+        m_modelLoadThreads = (std::max)(1u, threads);
+    }
+
+    struct ADTMemory
+    {
+        int m_x;
+        int m_y;
+
+        // the mapped nav file, which the system may page out and in again
+        // as it pleases, so counts towards the residency budget but is not
+        // otherwise held by the map
+        size_t m_navFile;
+
+        // the sum over the tiles of the ADT
+        Tile::MemoryUsage m_tiles;
+
+        // the collision trees of the models referenced by the tiles of the
+        // ADT.  models are shared between ADTs, so are counted by each ADT
+        // which references them
+        size_t m_models;
+    };
+
+    struct MemoryStats
+    {
+        // every ADT with tiles loaded.  for global wmo maps, this is the one
+        // block of the grid the tiles were stored by
+        std::vector<ADTMemory> m_adts;
+
+        // the map's instance tables, which are always loaded
+        size_t m_staticInstances;
+
+        // the collision trees of every loaded model, each counted once, and
+        // the bytes held by the map as a whole, nav files aside.  when the
+        // models are shared with other maps, these are all of their models
+        size_t m_models;
+        size_t m_totalBytes;
+    };
+
+    // the bytes held by the map, to size its residency budget and to find
+    // leaks.  this walks every loaded tile, so is meant for monitoring rather
+    // than for every update
+    MemoryStats GetMemoryStats() const;
+
+    // begins loading, in the background, every ADT within `distance' along the
+    // direction (dx, dy) from (x, y), including the ADT containing (x, y).
+    // ADTs which are loaded or already being loaded are skipped.  returns the
+    // number of ADTs for which a load was started.
+    int PrefetchADTs(float x, float y, float dx, float dy, float distance);
+
+    // releases the query context belonging to the calling thread.  threads
+    // which are about to exit may call this to return the memory immediately,
+    // otherwise it is released along with the map.
+    void ReleaseQueryContext() const;
+
+    // game objects may be doodads or wmos.  the doodads of the given set are
+    // rasterized along with a wmo, which may be left as -1 when it has at
+    // most one set.  line of sight only tests the wmo itself.  tiles whose
+    // height fields were left out of their nav files (see
+    // MeshBuilder::OmitHeightFields()) keep their meshes, but the object
+    // still blocks line of sight and is hit by rays over them.
+    //
     // rotation specified in radians rotated around Z axis
     void AddGameObject(std::uint64_t guid, unsigned int displayId,
                        const math::Vertex& position, float orientation,
@@ -133,11 +904,261 @@ public:
                        const math::Vertex& position,
                        const math::Matrix& rotation, int doodadSet = -1);
 
+    // adds many game objects at once, such as the spawns of one map from a
+    // GameObjectFile, whose map ids are not checked.  their models are first
+    // loaded on `threads' threads, and the objects are then added in order
+    // of the tiles beneath them, within one obstacle batch which is
+    // committed on as many threads.  should any object fail to be added, as
+    // AddGameObject() would, those before it are kept and committed, and
+    // the error thrown
+    void AddGameObjects(utility::ArrayView<GameObjectSpawn> spawns,
+                        unsigned int threads = 1);
+
+    // removes a game object added by AddGameObject().  the tiles beneath it
+    // are rebuilt from their original height fields, with any other objects
+    // rasterized again.  once a tile has no objects left it returns to the
+    // mesh it was loaded with, without being built.  this does nothing if
+    // there is no object with the given guid.
+    void RemoveGameObject(std::uint64_t guid);
+
+    struct InstanceInfo
+    {
+        // the unique id MapBuilder gave a static instance, or the guid of a
+        // game object
+        std::uint64_t m_id;
+        bool m_wmo;
+        bool m_gameObject;
+        math::BoundingBox m_bounds;
+
+        // the path of the model within the MPQs for static instances, and
+        // of its BVH file for game objects
+        std::string m_model;
+    };
+
+    // appends to output every static wmo and doodad instance, and every game
+    // object, whose bounds overlap the given box.  static instances are found
+    // through a tree over all of them, built with the map, so this does not
+    // depend on which ADTs are loaded.  wmos are listed by themselves, not
+    // by the doodads of their sets.
+    void QueryInstances(const math::BoundingBox& bounds,
+                        std::vector<InstanceInfo>& output) const;
+
+    // as above, for the instances whose bounds are within radius of position
+    void QueryInstances(const math::Vertex& position, float radius,
+                        std::vector<InstanceInfo>& output) const;
+
+    // adds a link from start to end, which paths may then take even though
+    // it cannot be walked, returning its id.  like game objects, the tile
+    // containing the start is rebuilt, or marked for the open batch.  end
+    // must lie within that tile or one of its neighbours.  a loaded tile
+    // without a height field cannot be rebuilt, and so throws
+    // TILE_HAS_NO_HEIGHT_FIELD.  should the tile only turn out to have none
+    // once its ADT is loaded, the connection is kept but not used
+    std::uint32_t AddOffMeshConnection(const math::Vertex& start,
+                                       const math::Vertex& end, float radius,
+                                       bool bidirectional = true);
+
+    // removes a connection added by AddOffMeshConnection().  connections
+    // built by MapBuilder cannot be removed.  this does nothing if there is
+    // no connection with the given id.
+    void RemoveOffMeshConnection(std::uint32_t id);
+
+    // between these calls, AddGameObject() and RemoveGameObject() update the
+    // height fields of the tiles beneath each object without rebuilding them.
+    // the commit then rebuilds every affected tile once, dividing the builds
+    // between `threads' threads.  until then, paths and other navmesh queries
+    // do not see the changes, while line of sight does.  batches may be
+    // nested, in which case only the outermost commit rebuilds.
+    void BeginObstacleBatch();
+    void CommitObstacleBatch(unsigned int threads = 1);
+
+    // with a non-zero number of threads, tiles are rebuilt for game objects
+    // on that many background threads.  queries continue to use the old
+    // tiles until the next call to CommitRebuiltTiles(), which swaps in those
+    // which have finished and returns how many there were.  like
+    // CommitLoadedADTs(), this is meant to be called regularly by the thread
+    // which owns the map.  zero, the default, rebuilds tiles immediately.
+    void SetRebuildThreads(unsigned int threads);
+    int CommitRebuiltTiles();
+
+    // the height field of a tile is decoded from its nav file when a game
+    // object first touches it.  once set, height fields which no game object
+    // has needed for the given time are released, to be decoded again, with
+    // the remaining objects rasterized into them, when next needed.  this is
+    // checked whenever game objects are added or removed, or on calling
+    // ReleaseIdleHeightFields(), which returns how many were released.  zero,
+    // the default, keeps them for as long as their tiles are loaded.
+    void SetHeightFieldIdleTime(std::chrono::milliseconds idleTime);
+    size_t ReleaseIdleHeightFields();
+
     std::shared_ptr<Model> GetOrLoadModelByDisplayId(unsigned int displayId);
 
+    // loads the given models on `threads' background threads, and keeps them
+    // loaded until ReleasePreloadedModels(), so that the first ADT or game
+    // object to use each of them need not wait for it to be read.  models
+    // are named by their paths in the game data, or by game object display
+    // id.  the future is satisfied, once every model has been tried, with
+    // the number which were loaded.  those which are unknown or fail to load
+    // are skipped, as the preload is only a hint
+    std::future<size_t>
+    PreloadModels(const std::vector<std::string>& mpqPaths,
+                  const std::vector<unsigned int>& displayIds,
+                  unsigned int threads = 1);
+
+    // as above, for the models listed by a manifest from SaveModelManifest()
+    std::future<size_t> PreloadModels(const std::filesystem::path& manifest,
+                                      unsigned int threads = 1);
+
+    // writes the BVH files of every model now loaded to a manifest, one per
+    // line, returning how many there were.  a server might save one as it
+    // shuts down, and preload it as it next starts
+    size_t SaveModelManifest(const std::filesystem::path& manifest) const;
+
+    void ReleasePreloadedModels();
+
+    // registers a filter under the given name, replacing any existing filter
+    // of that name, which path and random point queries may then select.  a
+    // polygon passes the filter when it has at least one of includeFlags and
+    // none of excludeFlags (see PolyFlags).  the filters "avoid water" (no
+    // liquid), "ground only" (terrain only) and "swimmer" (liquid only) are
+    // registered by default.
+    void SetQueryFilter(const std::string& name, unsigned short includeFlags,
+                        unsigned short excludeFlags);
+
+    // a position together with the navmesh polygon it was resolved to.  the
+    // polygon reference includes the salt of its tile, which changes when the
+    // tile is removed, but not when it is rebuilt beneath temporary
+    // obstacles, which keeps the reference of the old mesh.  so the polygon
+    // is only kept while it is still valid and the position is over it, and
+    // otherwise the location is resolved again.  callers may keep one of
+    // these per creature and pass it to queries in place of a position, which
+    // then skip the search for the nearest polygon while it remains so.  the
+    // position may be changed freely, as it is checked against the polygon.
+    struct Location
+    {
+        math::Vertex m_position;
+        dtPolyRef m_polyRef = 0;
+    };
+
+    // updates location to refer to the given position.  when the polygon it
+    // already refers to is still valid and position is over it, that polygon
+    // is kept without searching.  returns false if no polygon is near.
+    bool ResolveLocation(const math::Vertex& position, Location& location,
+                         const std::string& filter = {}) const;
+
+    // whether a path could exist between the polygons nearest the two
+    // positions, judged by whether they are connected within the loaded
+    // navmesh regardless of polygon flags.  false means that FindPath() will
+    // certainly fail, while true only means that it may succeed.  the
+    // components are found the first time this is asked after tiles are
+    // loaded, unloaded or rebuilt, after which each check is constant time.
+    bool IsReachable(const math::Vertex& start, const math::Vertex& end,
+                     const std::string& filter = {}) const;
+    bool IsReachable(Location& start, Location& end,
+                     const std::string& filter = {}) const;
+
+    // when enabled, FindPath() fails immediately for paths which are not
+    // reachable, rather than searching everything reachable from the start.
+    // partial paths are still searched.  this is disabled by default, as
+    // finding the components after every obstacle rebuild is only worth it
+    // when many searches would fail
+    void EnableReachability(bool enabled);
+
+    // paths spanning more than an ADT are routed through the portals between
+    // tiles first, and only the segments between consecutive waypoints of
+    // that route are searched with detour.  when there is no route, or it
+    // cannot be refined, the whole path is searched at once.  an empty filter
+    // name selects the default filter, which allows every polygon.
     bool FindPath(const math::Vertex& start, const math::Vertex& end,
-                  std::vector<math::Vertex>& output,
-                  bool allowPartial = false) const;
+                  std::vector<math::Vertex>& output, bool allowPartial = false,
+                  const std::string& filter = {}) const;
+
+    // as above, reusing the polygons of the given locations where still
+    // valid, and updating them otherwise
+    bool FindPath(Location& start, Location& end,
+                  std::vector<math::Vertex>& output, bool allowPartial = false,
+                  const std::string& filter = {}) const;
+
+    // as FindPath(), with each point at the height FindHeight() would find
+    // for it, rather than that of the navmesh, which is only within the
+    // detail mesh error of the surface.  when spacing is positive, points are
+    // added along each segment so that none is more than spacing from the
+    // next, each also at its precise height.  this is done in the one search,
+    // from the polygons of the path, in place of a FindHeight() per point
+    bool FindRefinedPath(const math::Vertex& start, const math::Vertex& end,
+                         float spacing, std::vector<math::Vertex>& output,
+                         bool allowPartial = false,
+                         const std::string& filter = {}) const;
+    bool FindRefinedPath(Location& start, Location& end, float spacing,
+                         std::vector<math::Vertex>& output,
+                         bool allowPartial = false,
+                         const std::string& filter = {}) const;
+
+    // as FindPath(), over the navmesh of the given agent.  for the agent the
+    // map was built for this is FindPath() itself.  the other agents have
+    // meshes only when the map was built for them too (see
+    // MeshBuilder::AddAgentSize()), and their paths are searched directly,
+    // without the portal graph, path cache or reachability, and without
+    // regard to temporary obstacles.  fails when no loaded tile has a mesh
+    // for the agent
+    bool FindAgentPath(AgentSize agent, const math::Vertex& start,
+                       const math::Vertex& end,
+                       std::vector<math::Vertex>& output,
+                       bool allowPartial = false,
+                       const std::string& filter = {}) const;
+
+    // as FindPath(), for ends close together such as those of a melee chase.
+    // the search uses the small node pool of QueryLimits, and fails rather
+    // than return a partial path when the pool runs out.  it also fails
+    // without searching when the ends are more than maxDistance apart, and
+    // fails when the path found is longer than that.  neither the portal
+    // graph nor the path cache is used
+    bool FindShortPath(const math::Vertex& start, const math::Vertex& end,
+                       float maxDistance, std::vector<math::Vertex>& output,
+                       const std::string& filter = {}) const;
+
+    // paths whose ends are at most this far apart are first tried as a ray
+    // cast along the navmesh surface, and when nothing is in the way that is
+    // the path, without any A* search.  this is usually so for short chases.
+    // zero, the default, disables this.  see QueryMetrics::m_straightPaths
+    void SetStraightPathDistance(float distance)
+    {
+        m_straightPathDistance = distance;
+    }
+    float GetStraightPathDistance() const { return m_straightPathDistance; }
+
+    // starts a search for a path from start to end which the caller advances
+    // with PathRequest::Update(), a limited number of iterations at a time.
+    // if no polygon is found near either end, the request has already failed
+    std::unique_ptr<PathRequest>
+    CreatePathRequest(const math::Vertex& start, const math::Vertex& end,
+                      bool allowPartial = false) const;
+
+    // creates a corridor from start to end which the caller keeps up to date
+    // as either end moves with PathCorridor::MovePosition() and
+    // PathCorridor::MoveTarget(), instead of searching for a new path each
+    // time.  an empty filter name selects the default filter
+    std::unique_ptr<PathCorridor>
+    CreatePathCorridor(const math::Vertex& start, const math::Vertex& end,
+                       const std::string& filter = {}) const;
+
+    // creates a crowd of at most maxAgents agents, none wider than
+    // maxAgentRadius, which are steered around one another.  every agent
+    // uses the named filter, or the default filter when the name is empty
+    std::unique_ptr<Crowd> CreateCrowd(int maxAgents, float maxAgentRadius,
+                                       const std::string& filter = {});
+
+    // finds a path between each pair of starts[i] and ends[i].  the hops of
+    // every path are stored consecutively in output, with path i occupying
+    // [offsets[i], offsets[i + 1]).  a path which could not be found has an
+    // empty range.  when threads is greater than one, the batch is divided
+    // into that many slices, which the calling thread shares with a pool of
+    // threads kept by the map.  returns the number of paths found.
+    size_t FindPaths(const math::Vertex* starts, const math::Vertex* ends,
+                     size_t count, std::vector<math::Vertex>& output,
+                     std::vector<std::uint32_t>& offsets,
+                     bool allowPartial = false, unsigned int threads = 1,
+                     const std::string& filter = {}) const;
 
     // for finding height(s) at a given (x, y), there are two scenarios:
     // 1: we want to find exactly one z for a given path which has this (x, y)
@@ -150,21 +1171,142 @@ public:
     // probably doing something wrong
     bool FindHeight(const math::Vertex& source, float x, float y,
                     float& z) const; // scenario one
-    bool FindHeights(float x, float y,
-                     std::vector<float>& output) const; // scenario two
+    bool FindHeight(Location& source, float x, float y, float& z) const;
+    //
+    // when precise is false and the map was built with surface heights, the
+    // heights of models are taken from the tile's height field rather than
+    // found by casting rays.  they are then within a cell height
+    // (MeshSettings::CellHeight) of the surface, and only walkable surfaces
+    // are found
+    bool FindHeights(float x, float y, std::vector<float>& output,
+                     bool precise = true) const; // scenario two
+
+    // Performs FindHeights() for each point of the nx by ny grid starting at
+    // (x0, y0) with spacing (dx, dy).  The heights of point (i, j), at
+    // (x0 + i * dx, y0 + j * dy), are appended to heights, and their number
+    // stored in counts[j * nx + i].  Points are processed one tile at a time,
+    // so each tile is looked up once and its instances stay in cache.
+    void FindHeightsGrid(float x0, float y0, float dx, float dy, int nx,
+                         int ny, std::vector<float>& heights,
+                         std::vector<unsigned int>& counts,
+                         bool precise = true) const;
 
     bool ZoneAndArea(const math::Vertex& position, unsigned int& zone,
                      unsigned int& area) const;
 
+    // the zone and area of a navmesh polygon, being those at its centre.
+    // these are found once per polygon, and then kept by its tile until the
+    // tile is rebuilt or unloaded, so that a creature standing on the same
+    // polygon as before is answered without casting rays.  the location is
+    // resolved as by ResolveLocation().  false if the polygon is not valid
+    bool ZoneAndArea(Location& location, unsigned int& zone,
+                     unsigned int& area) const;
+    bool ZoneAndAreaForPoly(dtPolyRef poly, unsigned int& zone,
+                            unsigned int& area) const;
+
+    // the height and type of the liquid surface at (x, y) which z is beneath,
+    // being the lowest above it, or else of the highest liquid below z, so
+    // that level >= z when the position is submerged.  this is looked up from
+    // the cells of the tile, which are two by two per quad of ADT liquid, and
+    // so casts no rays.  the liquid of WMOs is all taken to be water.  false
+    // if there is no liquid over (x, y), or the map was built without it
+    bool GetLiquidLevel(float x, float y, float z, float& level,
+                        LiquidType& type) const;
+
     // Returns true when there is line of sight from the start position to
     // the stop position.  The intended use of this is for spells and NPC
     // aggro, so doodads and temporary obstacles will be ignored.
     bool LineOfSight(const math::Vertex& start, const math::Vertex& stop,
                      bool doodads) const;
 
+    // Performs the same check as LineOfSight() for each pair of starts[i] and
+    // stops[i], storing the result in results[i].  Rays are grouped by the
+    // instances referenced from the tiles they cross, so that each instance
+    // is visited once per batch regardless of how many rays pass near it.
+    void LineOfSightBatch(const math::Vertex* starts,
+                          const math::Vertex* stops, size_t count,
+                          bool doodads, std::vector<bool>& results) const;
+
+    // Performs the same check as LineOfSight() from one origin, raised by
+    // originHeight, to each of count targets, each raised by eyeHeights[i]
+    // (or not at all if eyeHeights is null), as for a spell with many
+    // targets.  The tiles and instances around the fan are found once, and
+    // the origin is moved into the space of each instance once rather than
+    // once per target.
+    void LineOfSightFan(const math::Vertex& origin, float originHeight,
+                        const math::Vertex* targets, const float* eyeHeights,
+                        size_t count, bool doodads,
+                        std::vector<bool>& results) const;
+
+    // casts a ray from start to stop, returning true and describing the
+    // closest surface along it if there is one.  unlike LineOfSight(), this
+    // considers the ADT terrain, and temporary obstacles whenever doodads is
+    // true
+    bool RayCast(const math::Vertex& start, const math::Vertex& stop,
+                 bool doodads, RayHit& hit) const;
+
+    // sweeps an upright capsule of the given radius and height, standing at
+    // start, towards end, as for a charge or a knockback.  stop is set to
+    // where the capsule first touches a wmo, a doodad (unless doodads is
+    // false) or, when navMesh is true, an edge of the navmesh, and otherwise
+    // to end.  returns whether anything was touched.
+    //
+    // geometry lower than a step of the map's agent is left to the navmesh,
+    // which was built for a body of the agent's radius and so stops the
+    // centre of one at its edges.  the capsule is approximated by spheres at
+    // most radius apart along its axis, and stop lies on the line from start
+    // to end, so its height may need to be found again.
+    bool SweepCapsule(const math::Vertex& start, const math::Vertex& end,
+                      float radius, float height, math::Vertex& stop,
+                      bool navMesh = true, bool doodads = true) const;
+
     bool FindRandomPointAroundCircle(const math::Vertex& centerPosition,
-                                     float radius,
-                                     math::Vertex& randomPoint) const;
+                                     float radius, math::Vertex& randomPoint,
+                                     const std::string& filter = {}) const;
+    bool FindRandomPointAroundCircle(Location& center, float radius,
+                                     math::Vertex& randomPoint,
+                                     const std::string& filter = {}) const;
+
+    // finds up to count points, uniformly distributed over the area of the
+    // navmesh within radius of the center which can be reached from it,
+    // replacing the contents of output.  unlike the random walk of
+    // FindRandomPointAroundCircle(), the area reachable is found once for
+    // the whole batch, and the same seed gives the same points for as long
+    // as the navmesh is unchanged.  returns how many points were found,
+    // which may be fewer than count when little of the area reachable is
+    // within the circle.
+    size_t FindRandomPoints(const math::Vertex& center, float radius,
+                            size_t count, std::uint64_t seed,
+                            std::vector<math::Vertex>& output,
+                            const std::string& filter = {}) const;
+    size_t FindRandomPoints(Location& center, float radius, size_t count,
+                            std::uint64_t seed,
+                            std::vector<math::Vertex>& output,
+                            const std::string& filter = {}) const;
+
+    // finds the point of the navmesh nearest to position, searching a box of
+    // the given half extents around it.  returns false if no polygon passing
+    // the filter intersects the box.
+    bool FindNearestPoint(const math::Vertex& position,
+                          const math::Vertex& extents, math::Vertex& nearest,
+                          const std::string& filter = {}) const;
+    bool FindNearestPoint(Location& location, const math::Vertex& extents,
+                          math::Vertex& nearest,
+                          const std::string& filter = {}) const;
+
+    // finds the distance from position to the nearest edge of the navmesh
+    // which cannot be crossed, searching polygons within radius of it,
+    // together with the point of the edge nearest to position and the
+    // horizontal normal of the edge, facing position.  when there is no such
+    // edge within radius, distance is radius and the point and normal are
+    // left at zero.  returns false if there is no polygon near position.
+    bool DistanceToWall(const math::Vertex& position, float radius,
+                        float& distance, math::Vertex& hitPoint,
+                        math::Vertex& hitNormal,
+                        const std::string& filter = {}) const;
+    bool DistanceToWall(Location& location, float radius, float& distance,
+                        math::Vertex& hitPoint, math::Vertex& hitNormal,
+                        const std::string& filter = {}) const;
 
     bool FindPointInBetweenVectors(const math::Vertex& start,
                                    const math::Vertex& end,
@@ -172,6 +1314,15 @@ public:
                                    math::Vertex& inBetweenPoint) const;
 
     const dtNavMesh& GetNavMesh() const { return m_navMesh; }
-    const dtNavMeshQuery& GetNavMeshQuery() const { return m_navQuery; }
+
+    // the generation of the mesh of the tile of the given tile or polygon
+    // reference, which is zero until the tile is rebuilt and grows each time
+    // it is.  unlike the reference, this tells a rebuilt tile from the one it
+    // replaced.  as with GetNavMesh(), the map must not be changed meanwhile
+    std::uint64_t GetTileGeneration(dtTileRef ref) const;
+    const dtNavMeshQuery& GetNavMeshQuery() const
+    {
+        return GetQueryContext().m_navQuery;
+    }
 };
 } // namespace pathfind
@@ -0,0 +1,19 @@
+#include "MapManager.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace pathfind
+{
+MapManager::MapManager(const std::filesystem::path& dataPath)
+    : m_dataPath(dataPath), m_models(std::make_shared<ModelCache>(dataPath))
+{
+}
+
+std::unique_ptr<Map> MapManager::CreateMap(const std::string& mapName,
+                                           const QueryLimits& limits) const
+{
+    return std::make_unique<Map>(m_models, m_dataPath, mapName, limits);
+}
+} // namespace pathfind
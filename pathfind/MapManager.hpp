@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Map.hpp"
+#include "ModelCache.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <string>
+
+namespace pathfind
+{
+// creates maps of one data directory which share a single BVH index and model
+// cache, so that servers hosting many instances of the same maps read and
+// hold each model once rather than once per map.  the navmesh of each map is
+// still its own, as detour links the tiles of a navmesh by writing into their
+// data, although the nav files are mapped copy-on-write and so the pages
+// which are never written are shared by the operating system regardless.
+//
+// maps keep the cache alive, so they may outlive the manager which created
+// them.  a manager may be used by any number of threads
+class MapManager
+{
+private:
+    const std::filesystem::path m_dataPath;
+    const std::shared_ptr<ModelCache> m_models;
+
+public:
+    explicit MapManager(const std::filesystem::path& dataPath);
+
+    MapManager(const MapManager&) = delete;
+    MapManager& operator=(const MapManager&) = delete;
+
+    // creates a map which loads its models through the shared cache.  this
+    // throws as the constructor of Map does
+    std::unique_ptr<Map> CreateMap(const std::string& mapName,
+                                   const QueryLimits& limits = {}) const;
+
+    // the models of every map created by this manager
+    ModelCache::Stats GetModelStats() const { return m_models->GetStats(); }
+
+    // removes the entries of models which no map uses any more
+    size_t Compact() { return m_models->Compact(); }
+};
+} // namespace pathfind
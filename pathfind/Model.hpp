@@ -4,6 +4,7 @@
 #include "utility/BoundingBox.hpp"
 #include "utility/Matrix.hpp"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -27,10 +28,12 @@ struct DoodadInstance
     math::Matrix m_transformMatrix;
     math::Matrix m_inverseTransformMatrix;
     math::BoundingBox m_bounds;
-    std::string m_modelFilename;
-    std::vector<math::Vertex>
-        m_translatedVertices; // wow coordinate space.  indices are obtained
-                              // from model.
+    std::uint32_t m_index = 0; // see QueryContext::m_staticDoodadStamps
+
+    // interned by the map (see Map::InternModelName()), so that the many
+    // instances of a model share one copy of its name.  null for the doodads
+    // of wmo models, which have no use for it
+    const std::string* m_modelFilename = nullptr;
     std::weak_ptr<DoodadModel> m_model;
 };
 
@@ -51,7 +54,8 @@ struct WmoInstance
     math::Matrix m_transformMatrix;
     math::Matrix m_inverseTransformMatrix;
     math::BoundingBox m_bounds;
-    std::string m_modelFilename;
+    std::uint32_t m_index = 0; // see QueryContext::m_staticWmoStamps
+    const std::string* m_modelFilename = nullptr; // as above
     std::weak_ptr<WmoModel> m_model;
 };
 } // namespace pathfind
\ No newline at end of file
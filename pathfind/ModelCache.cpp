@@ -0,0 +1,246 @@
+#include "ModelCache.hpp"
+
+#include "Common.hpp"
+#include "utility/BinaryStream.hpp"
+#include "utility/Exception.hpp"
+#include "utility/Matrix.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+// adds a model which was read without the mutex held, unless another thread
+// added a model from the same file meanwhile, in which case that one is
+// returned.  the caller must hold the mutex
+template <typename T>
+std::shared_ptr<T>
+AddLoadedModel(std::unordered_map<std::string, std::weak_ptr<T>>& models,
+               size_t& sweepSize, const std::string& bvhFilename,
+               std::shared_ptr<T> model)
+{
+    auto& entry = models[bvhFilename];
+
+    if (auto existing = entry.lock())
+        return existing;
+
+    entry = model;
+    pathfind::SweepIfGrown(models, sweepSize);
+
+    return model;
+}
+
+template <typename T>
+std::shared_ptr<T>
+FindLoadedModel(const std::unordered_map<std::string, std::weak_ptr<T>>& models,
+                const std::string& bvhFilename)
+{
+    auto const i = models.find(bvhFilename);
+    return i == models.end() ? nullptr : i->second.lock();
+}
+
+template <typename Container>
+void AddLoadedFiles(const Container& container,
+                    std::vector<std::string>& bvhFiles)
+{
+    for (auto const& entry : container)
+        if (!entry.second.expired())
+            bvhFiles.push_back(
+                std::filesystem::path(entry.first).filename().string());
+}
+} // anonymous namespace
+
+namespace pathfind
+{
+ModelCache::ModelCache(const std::filesystem::path& dataPath)
+    : m_bvh(dataPath), m_wmoSweepSize(16), m_doodadSweepSize(16)
+{
+}
+
+std::shared_ptr<DoodadModel>
+ModelCache::EnsureDoodadModelLoaded(const std::string& mpq_path)
+{
+    // models are held by their BVH files, so that every path which the
+    // builder gave the same file shares one model
+    return LoadDoodadModel(m_bvh.GetBVHPath(mpq_path));
+}
+
+std::shared_ptr<DoodadModel>
+ModelCache::LoadDoodadModel(const std::string& bvhFilename)
+{
+    {
+        std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+        // if this model is currently loaded, return it
+        auto const i = m_doodadModels.find(bvhFilename);
+        if (i != m_doodadModels.end())
+            if (auto model = i->second.lock())
+                return model;
+    }
+
+    // else, load it
+    auto const stream = m_bvh.Open(bvhFilename);
+    auto& in = *stream;
+
+    auto model = std::make_shared<pathfind::DoodadModel>();
+
+    if (!model->m_aabbTree.Deserialize(in))
+        THROW(Result::COULD_NOT_DESERIALIZE_DOODAD).ErrorCode();
+
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+    return AddLoadedModel(m_doodadModels, m_doodadSweepSize, bvhFilename,
+                          std::move(model));
+}
+
+std::shared_ptr<WmoModel>
+ModelCache::EnsureWmoModelLoaded(const std::string& mpq_path)
+{
+    return LoadWmoModel(m_bvh.GetBVHPath(mpq_path));
+}
+
+std::shared_ptr<WmoModel>
+ModelCache::LoadWmoModel(const std::string& bvhFilename)
+{
+    {
+        std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+        // if this model is currently loaded, return it
+        auto const i = m_wmoModels.find(bvhFilename);
+        if (i != m_wmoModels.end())
+            if (auto model = i->second.lock())
+                return model;
+    }
+
+    // else, load it
+    auto const stream = m_bvh.Open(bvhFilename);
+    auto& in = *stream;
+
+    auto model = std::make_shared<pathfind::WmoModel>();
+
+    if (!model->m_aabbTree.Deserialize(in))
+        THROW(Result::COULD_NOT_DESERIALIZE_WMO).ErrorCode();
+
+    std::uint32_t rootId, nameSetCount;
+    in >> rootId >> nameSetCount;
+
+    for (auto i = 0u; i < nameSetCount; ++i)
+    {
+        std::uint32_t nameSet, areaId, zoneId;
+        in >> nameSet >> areaId >> zoneId;
+
+        model->m_nameSetToAreaZone[nameSet] = {areaId, zoneId};
+    }
+
+    std::uint32_t doodadSetCount;
+    in >> doodadSetCount;
+
+    model->m_doodadSets.resize(doodadSetCount);
+    model->m_loadedDoodadSets.resize(doodadSetCount);
+
+    for (std::uint32_t set = 0; set < doodadSetCount; ++set)
+    {
+        std::uint32_t doodadSetSize;
+        in >> doodadSetSize;
+
+        model->m_doodadSets[set].resize(doodadSetSize);
+
+        for (std::uint32_t doodad = 0; doodad < doodadSetSize; ++doodad)
+        {
+            float transformMatrix[16];
+            in >> transformMatrix;
+
+            model->m_doodadSets[set][doodad].m_transformMatrix =
+                math::Matrix::CreateFromArray(transformMatrix,
+                                              sizeof(transformMatrix) /
+                                                  sizeof(transformMatrix[0]));
+
+            in >> model->m_doodadSets[set][doodad].m_bounds;
+
+            char doodadFileName[MeshSettings::MaxMPQPathLength];
+            in >> doodadFileName;
+
+            auto doodadModel = EnsureDoodadModelLoaded(doodadFileName);
+
+            // loaded doodads serve as reference counters for automatic unload
+            model->m_loadedDoodadSets[set].push_back(doodadModel);
+            model->m_doodadSets[set][doodad].m_model = doodadModel;
+        }
+    }
+
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+    return AddLoadedModel(m_wmoModels, m_wmoSweepSize, bvhFilename,
+                          std::move(model));
+}
+
+std::shared_ptr<WmoModel>
+ModelCache::FindWmoModel(const std::string& mpq_path) const
+{
+    auto const bvhFilename = m_bvh.GetBVHPath(mpq_path);
+
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+    return FindLoadedModel(m_wmoModels, bvhFilename);
+}
+
+std::shared_ptr<DoodadModel>
+ModelCache::FindDoodadModel(const std::string& mpq_path) const
+{
+    auto const bvhFilename = m_bvh.GetBVHPath(mpq_path);
+
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+    return FindLoadedModel(m_doodadModels, bvhFilename);
+}
+
+bool ModelCache::IsWmoBVH(const std::string& bvhFilename)
+{
+    // see BVHConstructor, which names each file after the kind of its model
+    auto const filename = std::filesystem::path(bvhFilename).filename();
+    return filename.string().rfind("WMO_", 0) == 0;
+}
+
+size_t ModelCache::Compact()
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    return RemoveExpired(m_wmoModels) + RemoveExpired(m_doodadModels);
+}
+
+ModelCache::Stats ModelCache::GetStats() const
+{
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    Stats result;
+
+    CountExpired(m_wmoModels, result.m_liveWmoModels,
+                 result.m_expiredWmoModels);
+    CountExpired(m_doodadModels, result.m_liveDoodadModels,
+                 result.m_expiredDoodadModels);
+
+    result.m_modelBytes = 0;
+
+    for (auto const& entry : m_wmoModels)
+        if (auto const model = entry.second.lock())
+            result.m_modelBytes += model->m_aabbTree.MemoryUsage();
+
+    for (auto const& entry : m_doodadModels)
+        if (auto const model = entry.second.lock())
+            result.m_modelBytes += model->m_aabbTree.MemoryUsage();
+
+    return result;
+}
+
+std::vector<std::string> ModelCache::LoadedBVHFiles() const
+{
+    std::vector<std::string> result;
+
+    std::lock_guard<std::recursive_mutex> guard(m_mutex);
+
+    AddLoadedFiles(m_wmoModels, result);
+    AddLoadedFiles(m_doodadModels, result);
+
+    return result;
+}
+} // namespace pathfind
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "BVH.hpp"
+#include "Model.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pathfind
+{
+// removes the expired weak pointers from a container, returning the number
+// removed
+template <typename Container>
+size_t RemoveExpired(Container& container)
+{
+    size_t result = 0;
+
+    for (auto i = container.begin(); i != container.end();)
+    {
+        if (i->second.expired())
+        {
+            i = container.erase(i);
+            ++result;
+        }
+        else
+            ++i;
+    }
+
+    return result;
+}
+
+// sweeps the container once it has doubled in size since the last sweep
+template <typename Container>
+void SweepIfGrown(Container& container, size_t& sweepSize)
+{
+    if (container.size() < sweepSize)
+        return;
+
+    RemoveExpired(container);
+    sweepSize = (std::max)(static_cast<size_t>(16), 2 * container.size());
+}
+
+template <typename Container>
+void CountExpired(const Container& container, size_t& live, size_t& expired)
+{
+    live = expired = 0;
+
+    for (auto const& entry : container)
+        if (entry.second.expired())
+            ++expired;
+        else
+            ++live;
+}
+
+// the BVH index and the collision models of a data directory.  each map has
+// one of its own unless it was created by a MapManager, in which case every
+// map of the manager shares the same one, so that a model used by several
+// maps (or by several copies of one map) is read and held only once.  models
+// are held weakly, by the tiles and obstacles using them, and so are unloaded
+// once no map uses them.  a cache may be used by any number of threads
+class ModelCache
+{
+public:
+    struct Stats
+    {
+        size_t m_liveWmoModels;
+        size_t m_expiredWmoModels;
+        size_t m_liveDoodadModels;
+        size_t m_expiredDoodadModels;
+
+        // bytes held by the collision trees of the live models
+        size_t m_modelBytes;
+    };
+
+    explicit ModelCache(const std::filesystem::path& dataPath);
+
+    ModelCache(const ModelCache&) = delete;
+    ModelCache& operator=(const ModelCache&) = delete;
+
+    const BVH& GetBVH() const { return m_bvh; }
+
+    // ensure that the given model is loaded, by its path in the MPQs
+    std::shared_ptr<WmoModel> EnsureWmoModelLoaded(const std::string& mpq_path);
+    std::shared_ptr<DoodadModel>
+    EnsureDoodadModelLoaded(const std::string& mpq_path);
+
+    // as above, but by the path of the BVH file, which is all that is known
+    // of the models of game objects.  the model is read without holding the
+    // mutex, so that several threads may load different models at once
+    std::shared_ptr<WmoModel> LoadWmoModel(const std::string& bvhFilename);
+    std::shared_ptr<DoodadModel>
+    LoadDoodadModel(const std::string& bvhFilename);
+
+    // the given model if it is loaded, by its path in the MPQs, or else
+    // nullptr.  this never reads a file
+    std::shared_ptr<WmoModel> FindWmoModel(const std::string& mpq_path) const;
+    std::shared_ptr<DoodadModel>
+    FindDoodadModel(const std::string& mpq_path) const;
+
+    // whether the given BVH file is of a wmo, rather than a doodad
+    static bool IsWmoBVH(const std::string& bvhFilename);
+
+    // removes the entries of unloaded models, returning how many there were
+    size_t Compact();
+
+    Stats GetStats() const;
+
+    // the names (without directory) of the BVH files of the live models
+    std::vector<std::string> LoadedBVHFiles() const;
+
+private:
+    const BVH m_bvh;
+
+    // map, by filename, of loaded models.  the mutex is recursive because
+    // loading a wmo model also loads the doodad models it references
+    mutable std::recursive_mutex m_mutex;
+    std::unordered_map<std::string, std::weak_ptr<WmoModel>> m_wmoModels;
+    std::unordered_map<std::string, std::weak_ptr<DoodadModel>> m_doodadModels;
+
+    // the weak pointers above expire as tiles are unloaded but their entries
+    // remain.  each container is swept whenever it grows to twice its size
+    // after the previous sweep, which keeps the cost amortized constant per
+    // insertion.
+    size_t m_wmoSweepSize;
+    size_t m_doodadSweepSize;
+};
+} // namespace pathfind
@@ -0,0 +1,48 @@
+#include "OffMeshParams.hpp"
+
+#include "Common.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+#include "recastnavigation/Detour/Include/DetourNavMeshBuilder.h"
+#include "utility/MathHelper.hpp"
+
+namespace pathfind
+{
+OffMeshParams::OffMeshParams(
+    const std::vector<OffMeshConnection>& connections)
+    : m_verts(connections.size() * 6), m_radii(connections.size()),
+      m_flags(connections.size(), PolyFlags::OffMesh),
+      m_areas(connections.size(), 0), m_dirs(connections.size()),
+      m_ids(connections.size())
+{
+    for (auto i = 0u; i < connections.size(); ++i)
+    {
+        auto const& connection = connections[i];
+
+        math::Convert::VertexToRecast(
+            {connection.m_start[0], connection.m_start[1],
+             connection.m_start[2]},
+            &m_verts[i * 6]);
+        math::Convert::VertexToRecast(
+            {connection.m_end[0], connection.m_end[1], connection.m_end[2]},
+            &m_verts[i * 6 + 3]);
+
+        m_radii[i] = connection.m_radius;
+        m_dirs[i] = connection.m_bidirectional ? DT_OFFMESH_CON_BIDIR : 0;
+        m_ids[i] = connection.m_id;
+    }
+}
+
+void OffMeshParams::Apply(dtNavMeshCreateParams& params) const
+{
+    if (m_ids.empty())
+        return;
+
+    params.offMeshConVerts = &m_verts[0];
+    params.offMeshConRad = &m_radii[0];
+    params.offMeshConFlags = &m_flags[0];
+    params.offMeshConAreas = &m_areas[0];
+    params.offMeshConDir = &m_dirs[0];
+    params.offMeshConUserID = &m_ids[0];
+    params.offMeshConCount = static_cast<int>(m_ids.size());
+}
+} // namespace pathfind
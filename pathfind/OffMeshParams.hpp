@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <vector>
+
+struct dtNavMeshCreateParams;
+
+namespace pathfind
+{
+// the off-mesh connection arrays which detour is given when a tile is built,
+// shared by the builder and by the rebuilds of tiles beneath temporary
+// obstacles.  these must outlive the dtCreateNavMeshData() call they are for
+class OffMeshParams
+{
+private:
+    std::vector<float> m_verts;
+    std::vector<float> m_radii;
+    std::vector<unsigned short> m_flags;
+    std::vector<unsigned char> m_areas;
+    std::vector<unsigned char> m_dirs;
+    std::vector<unsigned int> m_ids;
+
+public:
+    OffMeshParams(const std::vector<OffMeshConnection>& connections);
+
+    // points the off-mesh connections of the params at these arrays.  those
+    // of params are left alone when there are no connections
+    void Apply(dtNavMeshCreateParams& params) const;
+};
+} // namespace pathfind
@@ -0,0 +1,120 @@
+#include "PathCache.hpp"
+
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace pathfind
+{
+void PathCache::SetCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_capacity = capacity;
+
+    while (m_entries.size() > m_capacity)
+    {
+        m_index.erase(m_entries.back().m_key);
+        m_entries.pop_back();
+    }
+}
+
+bool PathCache::Enabled() const
+{
+    return m_capacity > 0;
+}
+
+bool PathCache::Find(const Key& key, dtPolyRef* corridor, int maxLength,
+                     int& length, bool& partial)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    auto const i = m_index.find(key);
+
+    if (i == m_index.end() ||
+        static_cast<int>(i->second->m_corridor.size()) > maxLength)
+    {
+        ++m_misses;
+        return false;
+    }
+
+    ++m_hits;
+
+    // move the entry to the front of the list
+    m_entries.splice(m_entries.begin(), m_entries, i->second);
+
+    auto const& entry = *i->second;
+
+    length = static_cast<int>(entry.m_corridor.size());
+    std::copy(entry.m_corridor.begin(), entry.m_corridor.end(), corridor);
+    partial = entry.m_partial;
+
+    return true;
+}
+
+void PathCache::Insert(const dtNavMesh& navMesh, const Key& key,
+                       const dtPolyRef* corridor, int length, bool partial)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (!m_capacity || m_index.find(key) != m_index.end())
+        return;
+
+    if (m_entries.size() >= m_capacity)
+    {
+        m_index.erase(m_entries.back().m_key);
+        m_entries.pop_back();
+    }
+
+    Entry entry {key, std::vector<dtPolyRef>(corridor, corridor + length),
+                 partial, {}};
+
+    for (auto const ref : entry.m_corridor)
+        entry.m_tiles.push_back(navMesh.decodePolyIdTile(ref));
+
+    std::sort(entry.m_tiles.begin(), entry.m_tiles.end());
+    entry.m_tiles.erase(std::unique(entry.m_tiles.begin(), entry.m_tiles.end()),
+                        entry.m_tiles.end());
+
+    m_entries.push_front(std::move(entry));
+    m_index[key] = m_entries.begin();
+}
+
+void PathCache::InvalidateTile(unsigned int tileIndex)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    for (auto i = m_entries.begin(); i != m_entries.end();)
+    {
+        if (!std::binary_search(i->m_tiles.begin(), i->m_tiles.end(),
+                                tileIndex))
+        {
+            ++i;
+            continue;
+        }
+
+        m_index.erase(i->m_key);
+        i = m_entries.erase(i);
+        ++m_invalidations;
+    }
+}
+
+void PathCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_entries.clear();
+    m_index.clear();
+}
+
+PathCache::Stats PathCache::GetStats() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    return {m_capacity.load(), m_entries.size(), m_hits, m_misses,
+            m_invalidations};
+}
+} // namespace pathfind
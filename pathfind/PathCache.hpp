@@ -0,0 +1,113 @@
+#pragma once
+
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace pathfind
+{
+// a bounded, least recently used cache of polygon corridors, keyed by the
+// start and end polygons and the query filter flags.  creatures of the same
+// pack tend to path from the same polygon to the same target, and with this
+// only the first of them needs to search the navmesh.  the straight path is
+// still built for each query, so the start and end points may differ.
+//
+// entries are removed when any tile their corridor passes through is removed
+// from the navmesh, either because it was unloaded or because it has been
+// rebuilt.  the cache is used by concurrent queries, so it has its own mutex.
+class PathCache
+{
+public:
+    struct Key
+    {
+        dtPolyRef m_start;
+        dtPolyRef m_end;
+        unsigned short m_includeFlags;
+        unsigned short m_excludeFlags;
+
+        bool operator==(const Key& other) const
+        {
+            return m_start == other.m_start && m_end == other.m_end &&
+                   m_includeFlags == other.m_includeFlags &&
+                   m_excludeFlags == other.m_excludeFlags;
+        }
+    };
+
+    struct Stats
+    {
+        size_t m_capacity;
+        size_t m_entries;
+        std::uint64_t m_hits;
+        std::uint64_t m_misses;
+
+        // entries removed because a tile they used was removed
+        std::uint64_t m_invalidations;
+    };
+
+private:
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            auto hash = std::hash<dtPolyRef>()(key.m_start);
+            hash ^= std::hash<dtPolyRef>()(key.m_end) + 0x9e3779b9 +
+                    (hash << 6) + (hash >> 2);
+            return hash ^ (static_cast<size_t>(key.m_includeFlags) << 16 |
+                           key.m_excludeFlags);
+        }
+    };
+
+    struct Entry
+    {
+        Key m_key;
+        std::vector<dtPolyRef> m_corridor;
+
+        // whether the corridor stops short of the end polygon
+        bool m_partial;
+
+        // the distinct tile indices of the corridor's polygons
+        std::vector<unsigned int> m_tiles;
+    };
+
+    mutable std::mutex m_mutex;
+
+    // checked by every query before taking the mutex
+    std::atomic<size_t> m_capacity {0};
+
+    // most recently used first
+    std::list<Entry> m_entries;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+
+    std::uint64_t m_hits = 0;
+    std::uint64_t m_misses = 0;
+    std::uint64_t m_invalidations = 0;
+
+public:
+    // a capacity of zero, the default, disables the cache
+    void SetCapacity(size_t capacity);
+
+    bool Enabled() const;
+
+    // copies the corridor for the given key into corridor, which must have
+    // room for maxLength polygons, returning whether it was found
+    bool Find(const Key& key, dtPolyRef* corridor, int maxLength, int& length,
+              bool& partial);
+
+    // the navmesh is only needed to find which tiles the corridor uses
+    void Insert(const dtNavMesh& navMesh, const Key& key,
+                const dtPolyRef* corridor, int length, bool partial);
+
+    // removes every entry whose corridor passes through the given tile
+    void InvalidateTile(unsigned int tileIndex);
+
+    void Clear();
+
+    Stats GetStats() const;
+};
+} // namespace pathfind
@@ -0,0 +1,232 @@
+#include "PathCorridor.hpp"
+
+#include "Map.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "utility/Exception.hpp"
+#include "utility/MathHelper.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace
+{
+// recast space is y up, so this is the distance across the ground
+float Distance2d(const float* a, const float* b)
+{
+    auto const dx = a[0] - b[0];
+    auto const dz = a[2] - b[2];
+
+    return std::sqrt(dx * dx + dz * dz);
+}
+} // namespace
+
+namespace pathfind
+{
+PathCorridor::PathCorridor(const Map& map, QueryContext& context,
+                           const dtQueryFilter& queryFilter,
+                           const math::Vertex& start, const math::Vertex& end)
+    : m_map(map), m_queryFilter(queryFilter), m_replans(0),
+      m_meshGeneration(0)
+{
+    if (!m_corridor.init(m_map.m_queryLimits.m_maxPathHops))
+        THROW(Result::DTPATHCORRIDOR_INIT_FAILED);
+
+    float recastStart[3];
+    math::Convert::VertexToRecast(start, recastStart);
+    math::Convert::VertexToRecast(end, m_target);
+
+    Replan(context, recastStart);
+}
+
+bool PathCorridor::Replan(QueryContext& context, const float* position)
+{
+    constexpr float extents[] = {5.f, 5.f, 5.f};
+
+    // copied, since position may be that of the corridor, which the reset
+    // below moves
+    float start[3];
+    memcpy(start, position, sizeof(start));
+
+    ++m_replans;
+    m_meshGeneration = m_map.m_meshGeneration;
+
+    // the polygons of the old corridor are no help as hints here, since the
+    // end which moved is not over them
+    auto const startPolyRef =
+        m_map.FindNearestPoly(context, m_queryFilter, start, extents);
+
+    m_corridor.reset(startPolyRef, start);
+
+    if (!startPolyRef)
+        return false;
+
+    auto const endPolyRef =
+        m_map.FindNearestPoly(context, m_queryFilter, m_target, extents);
+
+    if (!endPolyRef)
+        return false;
+
+    auto& navQuery = context.m_navQuery;
+    auto const polyRefBuffer = &context.m_polyRefs[0];
+
+    int pathLength;
+    auto const findPathResult =
+        navQuery.findPath(startPolyRef, endPolyRef, start, m_target,
+                          &m_queryFilter, polyRefBuffer, &pathLength,
+                          m_map.m_queryLimits.m_maxPathHops);
+    if (!(findPathResult & DT_SUCCESS) || !pathLength)
+        return false;
+
+    // a partial path stops short of the target, so the corridor ends at the
+    // nearest point of its last polygon instead
+    float target[3];
+    memcpy(target, m_target, sizeof(target));
+
+    if (polyRefBuffer[pathLength - 1] != endPolyRef &&
+        !(navQuery.closestPointOnPoly(polyRefBuffer[pathLength - 1],
+                                      m_target, target, nullptr) &
+          DT_SUCCESS))
+        return false;
+
+    m_corridor.setCorridor(target, polyRefBuffer, pathLength);
+
+    return true;
+}
+
+bool PathCorridor::IsValid(QueryContext& context)
+{
+    return !m_map.MeshReplacedSince(m_meshGeneration, m_corridor.getPath(),
+                                    m_corridor.getPathCount()) &&
+           m_corridor.isValid(ValidityLookAhead, &context.m_navQuery,
+                              &m_queryFilter);
+}
+
+bool PathCorridor::MovePosition(const math::Vertex& position)
+{
+    Map::ResidencyPins pins(m_map);
+
+    m_map.EnsureResident(position.X, position.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    auto& context = m_map.GetQueryContext();
+
+    float recastPosition[3];
+    math::Convert::VertexToRecast(position, recastPosition);
+
+    if (IsValid(context) &&
+        m_corridor.movePosition(recastPosition, &context.m_navQuery,
+                                &m_queryFilter) &&
+        Distance2d(m_corridor.getPos(), recastPosition) <= ReplanDistance)
+        return true;
+
+    return Replan(context, recastPosition);
+}
+
+bool PathCorridor::MoveTarget(const math::Vertex& target)
+{
+    Map::ResidencyPins pins(m_map);
+
+    m_map.EnsureResident(target.X, target.Y, pins);
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    auto& context = m_map.GetQueryContext();
+
+    math::Convert::VertexToRecast(target, m_target);
+
+    if (IsValid(context) &&
+        m_corridor.moveTargetPosition(m_target, &context.m_navQuery,
+                                      &m_queryFilter) &&
+        Distance2d(m_corridor.getTarget(), m_target) <= ReplanDistance)
+        return true;
+
+    return Replan(context, m_corridor.getPos());
+}
+
+bool PathCorridor::Revalidate(QueryContext& context)
+{
+    if (IsValid(context))
+        return true;
+
+    return Replan(context, m_corridor.getPos());
+}
+
+bool PathCorridor::GetCorners(std::vector<math::Vertex>& output,
+                              int maxCorners)
+{
+    output.clear();
+
+    if (maxCorners <= 0)
+        return false;
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    auto& context = m_map.GetQueryContext();
+
+    if (!Revalidate(context))
+        return false;
+
+    std::vector<float> corners(maxCorners * 3);
+    std::vector<unsigned char> flags(maxCorners);
+    std::vector<dtPolyRef> polyRefs(maxCorners);
+
+    auto const count = m_corridor.findCorners(
+        &corners[0], &flags[0], &polyRefs[0], maxCorners, &context.m_navQuery,
+        &m_queryFilter);
+
+    output.resize(count);
+
+    for (auto i = 0; i < count; ++i)
+        math::Convert::VertexToWow(&corners[i * 3], output[i]);
+
+    return count > 0;
+}
+
+bool PathCorridor::GetPath(std::vector<math::Vertex>& output)
+{
+    output.clear();
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    auto& context = m_map.GetQueryContext();
+
+    if (!Revalidate(context))
+        return false;
+
+    auto const pathBuffer = &context.m_pathBuffer[0];
+
+    int pathLength;
+    if (!(context.m_navQuery.findStraightPath(
+              m_corridor.getPos(), m_corridor.getTarget(),
+              m_corridor.getPath(), m_corridor.getPathCount(), pathBuffer,
+              nullptr, nullptr, &pathLength,
+              m_map.m_queryLimits.m_maxPathHops) &
+          DT_SUCCESS))
+        return false;
+
+    output.resize(pathLength);
+
+    for (auto i = 0; i < pathLength; ++i)
+        math::Convert::VertexToWow(&pathBuffer[i * 3], output[i]);
+
+    return true;
+}
+
+math::Vertex PathCorridor::GetPosition() const
+{
+    math::Vertex result;
+    math::Convert::VertexToWow(m_corridor.getPos(), result);
+    return result;
+}
+
+math::Vertex PathCorridor::GetTarget() const
+{
+    math::Vertex result;
+    math::Convert::VertexToWow(m_target, result);
+    return result;
+}
+} // namespace pathfind
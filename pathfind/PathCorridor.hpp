@@ -0,0 +1,99 @@
+#pragma once
+
+#include "QueryContext.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "recastnavigation/DetourCrowd/Include/DetourPathCorridor.h"
+#include "utility/Vector.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace pathfind
+{
+class Map;
+
+// the polygons between a moving follower and a moving target.  rather than
+// searching for a new path whenever either end moves, the corridor is
+// stretched or shrunk to follow them, which costs little more than a walk
+// along the surface of the navmesh.  only when an end moves somewhere the
+// corridor cannot follow, such as a teleport, or its polygons are no longer
+// valid because their tiles were unloaded, is the path searched again.  a
+// tile rebuilt beneath temporary obstacles keeps its polygon references, which
+// detour then still finds valid, so the corridor also remembers the mesh
+// generation of the map when it was planned, and is planned again once any
+// of its tiles has been rebuilt since.
+//
+// a corridor must not outlive the map which created it.  it is not itself
+// safe to use from several threads at once, but different corridors may be
+// used alongside one another and alongside other queries.
+class PathCorridor
+{
+    friend class Map;
+
+private:
+    // how far, in yards, an end may end up from where it was asked to move
+    // before the path is searched again
+    static constexpr float ReplanDistance = 1.f;
+
+    // how many polygons from the start are checked for validity on each move
+    static constexpr int ValidityLookAhead = 16;
+
+    const Map& m_map;
+
+    dtPathCorridor m_corridor;
+    dtQueryFilter m_queryFilter;
+
+    // the requested target, which for a partial path lies beyond the end of
+    // the corridor
+    float m_target[3];
+
+    unsigned int m_replans;
+
+    // Map::m_meshGeneration when the path was last searched
+    std::uint64_t m_meshGeneration;
+
+    // whether the corridor may still be followed, its polygons being valid
+    // and of the meshes it was planned on.  the caller must hold the map's
+    // mutex
+    bool IsValid(QueryContext& context);
+
+    // searches for the path again from the current position, unless the
+    // corridor is still valid.  the caller must hold the map's mutex
+    bool Revalidate(QueryContext& context);
+
+    // the caller must hold the map's mutex
+    PathCorridor(const Map& map, QueryContext& context,
+                 const dtQueryFilter& queryFilter, const math::Vertex& start,
+                 const math::Vertex& end);
+
+    // searches for a path from position to the requested target, resetting
+    // the corridor to begin there.  the caller must hold the map's mutex
+    bool Replan(QueryContext& context, const float* position);
+
+public:
+    PathCorridor(const PathCorridor&) = delete;
+    PathCorridor& operator=(const PathCorridor&) = delete;
+
+    // moves the follower along the corridor to position.  returns false when
+    // no path could be found from there to the target
+    bool MovePosition(const math::Vertex& position);
+
+    // moves the end of the corridor to target.  returns false when no path
+    // could be found from the follower to there
+    bool MoveTarget(const math::Vertex& target);
+
+    // the next corners of the straight path along the corridor, at most
+    // maxCorners of them, which is all a follower needs to steer by
+    bool GetCorners(std::vector<math::Vertex>& output, int maxCorners = 4);
+
+    // the whole straight path along the corridor
+    bool GetPath(std::vector<math::Vertex>& output);
+
+    math::Vertex GetPosition() const;
+    math::Vertex GetTarget() const;
+
+    // the number of times the path has been searched, including when the
+    // corridor was created
+    unsigned int GetReplans() const { return m_replans; }
+};
+} // namespace pathfind
@@ -0,0 +1,106 @@
+#include "PathRequest.hpp"
+
+#include "Map.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "utility/Exception.hpp"
+#include "utility/MathHelper.hpp"
+
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
+namespace pathfind
+{
+PathRequest::PathRequest(const Map& map, const math::Vertex& start,
+                         const math::Vertex& end, bool allowPartial)
+    : m_map(map), m_allowPartial(allowPartial), m_status(Status::Failed),
+      m_iterations(0)
+{
+    // the same node limit as the per-thread queries, so that a sliced search
+    // can find any path that FindPath() can
+    if (m_navQuery.init(&map.m_navMesh, map.m_queryLimits.m_maxNodes) !=
+        DT_SUCCESS)
+        THROW(Result::DTNAVMESHQUERY_INIT_FAILED);
+
+    constexpr float extents[] = {5.f, 5.f, 5.f};
+
+    math::Convert::VertexToRecast(start, m_start);
+    math::Convert::VertexToRecast(end, m_end);
+
+    dtPolyRef startPolyRef, endPolyRef;
+    if (!(m_navQuery.findNearestPoly(m_start, extents, &m_queryFilter,
+                                     &startPolyRef, nullptr) &
+          DT_SUCCESS) ||
+        !startPolyRef)
+        return;
+
+    if (!(m_navQuery.findNearestPoly(m_end, extents, &m_queryFilter,
+                                     &endPolyRef, nullptr) &
+          DT_SUCCESS) ||
+        !endPolyRef)
+        return;
+
+    if (dtStatusFailed(m_navQuery.initSlicedFindPath(
+            startPolyRef, endPolyRef, m_start, m_end, &m_queryFilter)))
+        return;
+
+    m_status = Status::InProgress;
+}
+
+PathRequest::Status PathRequest::Update(int maxIterations)
+{
+    if (m_status != Status::InProgress)
+        return m_status;
+
+    std::shared_lock<std::shared_mutex> guard(m_map.m_mutex);
+
+    int iterations = 0;
+    auto const result =
+        m_navQuery.updateSlicedFindPath(maxIterations, &iterations);
+
+    m_iterations += iterations;
+
+    if (dtStatusFailed(result))
+        m_status = Status::Failed;
+    else if (dtStatusSucceed(result))
+        Finish();
+
+    return m_status;
+}
+
+void PathRequest::Cancel()
+{
+    if (m_status == Status::InProgress)
+        m_status = Status::Cancelled;
+}
+
+void PathRequest::Finish()
+{
+    m_status = Status::Failed;
+
+    auto const maxPathHops = m_map.m_queryLimits.m_maxPathHops;
+    std::vector<dtPolyRef> polyRefs(maxPathHops);
+
+    int pathLength;
+    auto const finalizeResult = m_navQuery.finalizeSlicedFindPath(
+        &polyRefs[0], &pathLength, maxPathHops);
+    if (!(finalizeResult & DT_SUCCESS) ||
+        (!m_allowPartial && !!(finalizeResult & DT_PARTIAL_RESULT)))
+        return;
+
+    std::vector<float> pathBuffer(maxPathHops * 3);
+    auto const findStraightPathResult = m_navQuery.findStraightPath(
+        m_start, m_end, &polyRefs[0], pathLength, &pathBuffer[0], nullptr,
+        nullptr, &pathLength, maxPathHops);
+    if (!(findStraightPathResult & DT_SUCCESS) ||
+        (!m_allowPartial && !!(findStraightPathResult & DT_PARTIAL_RESULT)))
+        return;
+
+    m_path.resize(pathLength);
+
+    for (auto i = 0; i < pathLength; ++i)
+        math::Convert::VertexToWow(&pathBuffer[i * 3], m_path[i]);
+
+    m_status = Status::Succeeded;
+}
+} // namespace pathfind
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+#include "utility/Vector.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace pathfind
+{
+class Map;
+
+// a path search which is advanced a limited number of iterations at a time,
+// so that an expensive search can be spread across several server ticks, and
+// abandoned if it is no longer wanted.  detour keeps the state of a sliced
+// search in the dtNavMeshQuery, along with the node pool it shares with every
+// other query, so each request has a query of its own.  this lets requests
+// run alongside one another and alongside regular queries, at the cost of a
+// node pool per request.
+//
+// a request must not outlive the map which created it.  if the tiles it has
+// searched are unloaded or rebuilt between updates, the request fails.
+class PathRequest
+{
+    friend class Map;
+
+public:
+    enum class Status : std::uint8_t
+    {
+        InProgress = 0,
+        Succeeded = 1,
+        Failed = 2,
+        Cancelled = 3,
+    };
+
+private:
+    const Map& m_map;
+
+    dtNavMeshQuery m_navQuery;
+    dtQueryFilter m_queryFilter;
+
+    float m_start[3];
+    float m_end[3];
+    bool m_allowPartial;
+
+    Status m_status;
+    int m_iterations;
+
+    std::vector<math::Vertex> m_path;
+
+    // the caller must hold the map's mutex
+    PathRequest(const Map& map, const math::Vertex& start,
+                const math::Vertex& end, bool allowPartial);
+
+    // the caller must hold the map's mutex
+    void Finish();
+
+public:
+    PathRequest(const PathRequest&) = delete;
+    PathRequest& operator=(const PathRequest&) = delete;
+
+    // advances the search by at most maxIterations nodes, returning the
+    // resulting status.  once the request is no longer in progress, this
+    // does nothing
+    Status Update(int maxIterations);
+
+    // stops the request.  this has no effect once it has finished
+    void Cancel();
+
+    Status GetStatus() const { return m_status; }
+    bool IsDone() const { return m_status != Status::InProgress; }
+
+    // the number of nodes searched so far
+    int GetIterations() const { return m_iterations; }
+
+    // only set once the request has succeeded
+    const std::vector<math::Vertex>& GetPath() const { return m_path; }
+};
+} // namespace pathfind
@@ -0,0 +1,306 @@
+#include "PortalGraph.hpp"
+
+#include "Common.hpp"
+#include "utility/BinaryStream.hpp"
+#include "utility/Exception.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// the portals of every tile are numbered from zero, so a node of the graph is
+// identified by its tile together with its index
+std::uint64_t NodeId(int x, int y, std::uint16_t portal)
+{
+    return (static_cast<std::uint64_t>(x) * MeshSettings::TileCount + y)
+               << 16 |
+           portal;
+}
+
+constexpr std::uint64_t StartNode = ~0ull - 1;
+constexpr std::uint64_t GoalNode = ~0ull;
+
+float Distance(const float* a, const float* b)
+{
+    auto const dx = a[0] - b[0];
+    auto const dy = a[1] - b[1];
+    auto const dz = a[2] - b[2];
+
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+// the tile on the other side of the given detour portal side
+void Neighbour(int side, int& x, int& y)
+{
+    switch (side)
+    {
+        case 0:
+            ++x;
+            break;
+        case 2:
+            ++y;
+            break;
+        case 4:
+            --x;
+            break;
+        case 6:
+            --y;
+            break;
+    }
+}
+} // namespace
+
+namespace pathfind
+{
+PortalGraph::PortalGraph(const std::filesystem::path& navPath)
+    : m_navPath(navPath)
+{
+}
+
+void PortalGraph::LoadADT(int x, int y)
+{
+    std::stringstream str;
+    str << std::setfill('0') << std::setw(2) << x << "_" << std::setfill('0')
+        << std::setw(2) << y << ".portals";
+
+    auto const path = m_navPath / str.str();
+
+    // nav data built before portals were introduced has no such files, and
+    // long paths on it are simply searched in full
+    if (!std::filesystem::exists(path))
+        return;
+
+    utility::BinaryStream in(path);
+
+    std::uint32_t sig, ver, kind, adtX, adtY, tileCount;
+    in >> sig >> ver >> kind >> adtX >> adtY >> tileCount;
+
+    if (sig != MeshSettings::FileSignature || kind != MeshSettings::FilePortals)
+        THROW(Result::INCORRECT_FILE_SIGNATURE);
+
+    // the layout of portal files has not changed since the oldest version
+    if (ver < MeshSettings::MinFileVersion || ver > MeshSettings::FileVersion)
+        THROW(Result::INCORRECT_FILE_VERSION);
+
+    if (adtX != static_cast<std::uint32_t>(x) ||
+        adtY != static_cast<std::uint32_t>(y))
+        THROW(Result::INCORRECT_ADT_COORDINATES);
+
+    auto adt = std::make_unique<ADTPortals>();
+
+    for (auto i = 0u; i < tileCount; ++i)
+    {
+        std::uint32_t tileX, tileY, portalCount;
+        in >> tileX >> tileY >> portalCount;
+
+        auto const localX = static_cast<int>(tileX) -
+                            x * MeshSettings::TilesPerADT;
+        auto const localY = static_cast<int>(tileY) -
+                            y * MeshSettings::TilesPerADT;
+
+        if (localX < 0 || localY < 0 || localX >= MeshSettings::TilesPerADT ||
+            localY >= MeshSettings::TilesPerADT)
+            THROW(Result::INCORRECT_ADT_COORDINATES);
+
+        auto& portals =
+            adt->m_tiles[localY * MeshSettings::TilesPerADT + localX];
+        portals.resize(portalCount);
+
+        for (auto& portal : portals)
+            in >> portal.m_side >> portal.m_min >> portal.m_max >>
+                portal.m_lowest >> portal.m_highest >> portal.m_point[0] >>
+                portal.m_point[1] >> portal.m_point[2];
+
+        std::uint32_t edgeCount;
+        in >> edgeCount;
+
+        for (auto j = 0u; j < edgeCount; ++j)
+        {
+            std::uint16_t from, to;
+            float cost;
+            in >> from >> to >> cost;
+
+            if (from >= portalCount || to >= portalCount)
+                THROW(Result::INCORRECT_ADT_COORDINATES);
+
+            // each edge is stored once, but may be walked either way
+            portals[from].m_edges.emplace_back(to, cost);
+            portals[to].m_edges.emplace_back(from, cost);
+        }
+    }
+
+    m_adts[x][y] = std::move(adt);
+}
+
+const std::vector<PortalGraph::Portal>*
+PortalGraph::GetTilePortals(int x, int y) const
+{
+    if (x < 0 || y < 0 || x >= MeshSettings::TileCount ||
+        y >= MeshSettings::TileCount)
+        return nullptr;
+
+    auto const& adt = m_adts[x / MeshSettings::TilesPerADT]
+                            [y / MeshSettings::TilesPerADT];
+
+    if (!adt)
+        return nullptr;
+
+    return &adt->m_tiles[(y % MeshSettings::TilesPerADT) *
+                             MeshSettings::TilesPerADT +
+                         x % MeshSettings::TilesPerADT];
+}
+
+bool PortalGraph::FindRoute(const float* start, int startX, int startY,
+                            const float* end, int endX, int endY,
+                            std::vector<std::array<float, 3>>& route) const
+{
+    auto const startPortals = GetTilePortals(startX, startY);
+    auto const endPortals = GetTilePortals(endX, endY);
+
+    if (!startPortals || startPortals->empty() || !endPortals ||
+        endPortals->empty())
+        return false;
+
+    struct Node
+    {
+        float m_cost;
+        std::uint64_t m_parent;
+        const float* m_point;
+        bool m_closed;
+    };
+
+    std::unordered_map<std::uint64_t, Node> nodes;
+
+    using OpenEntry = std::pair<float, std::uint64_t>;
+    std::priority_queue<OpenEntry, std::vector<OpenEntry>,
+                        std::greater<OpenEntry>>
+        open;
+
+    // straight lines never overestimate the cost of walking, so this finds
+    // the cheapest route through the graph
+    auto const relax = [&](std::uint64_t id, const float* point, float cost,
+                           std::uint64_t parent)
+    {
+        auto const i = nodes.find(id);
+
+        if (i != nodes.end() &&
+            (i->second.m_closed || i->second.m_cost <= cost))
+            return;
+
+        nodes[id] = {cost, parent, point, false};
+        open.emplace(cost + (point ? Distance(point, end) : 0.f), id);
+    };
+
+    for (auto i = 0u; i < startPortals->size(); ++i)
+    {
+        auto const& portal = (*startPortals)[i];
+        relax(NodeId(startX, startY, static_cast<std::uint16_t>(i)),
+              portal.m_point, Distance(start, portal.m_point), StartNode);
+    }
+
+    // the search is bounded by how far apart the ends are, rather than by a
+    // single limit, so that a short route which cannot be found gives up as
+    // quickly as it would have succeeded
+    auto const tiles = static_cast<size_t>(std::abs(endX - startX) +
+                                           std::abs(endY - startY) + 1);
+    auto const maxExpanded =
+        (std::min)(MaxRouteNodes, tiles * RouteNodesPerTile);
+
+    size_t expanded = 0;
+
+    while (!open.empty())
+    {
+        auto const id = open.top().second;
+        open.pop();
+
+        auto& node = nodes[id];
+
+        // superseded by a cheaper entry
+        if (node.m_closed)
+            continue;
+
+        node.m_closed = true;
+
+        if (id == GoalNode)
+            break;
+
+        if (++expanded > maxExpanded)
+            return false;
+
+        auto const tile = id >> 16;
+        auto const x = static_cast<int>(tile / MeshSettings::TileCount);
+        auto const y = static_cast<int>(tile % MeshSettings::TileCount);
+        auto const cost = node.m_cost;
+
+        auto const& portal =
+            (*GetTilePortals(x, y))[static_cast<std::uint16_t>(id & 0xFFFF)];
+
+        if (x == endX && y == endY)
+            relax(GoalNode, nullptr, cost + Distance(portal.m_point, end), id);
+
+        for (auto const& edge : portal.m_edges)
+            relax(NodeId(x, y, edge.first),
+                  (*GetTilePortals(x, y))[edge.first].m_point,
+                  cost + edge.second, id);
+
+        auto neighbourX = x, neighbourY = y;
+        Neighbour(portal.m_side, neighbourX, neighbourY);
+
+        auto const neighbour = GetTilePortals(neighbourX, neighbourY);
+
+        if (!neighbour)
+            continue;
+
+        // the neighbouring portal must face this one across the border,
+        // overlapping it both along the border and in height
+        auto const facing = (portal.m_side + 4) & 7;
+        constexpr float slack = MeshSettings::CellSize;
+        constexpr float climb = MeshSettings::WalkableClimb;
+
+        for (auto i = 0u; i < neighbour->size(); ++i)
+        {
+            auto const& other = (*neighbour)[i];
+
+            if (other.m_side != facing || other.m_min > portal.m_max + slack ||
+                other.m_max < portal.m_min - slack ||
+                other.m_lowest > portal.m_highest + climb ||
+                other.m_highest < portal.m_lowest - climb)
+                continue;
+
+            relax(NodeId(neighbourX, neighbourY, static_cast<std::uint16_t>(i)),
+                  other.m_point, cost + Distance(portal.m_point, other.m_point),
+                  id);
+        }
+    }
+
+    auto const goal = nodes.find(GoalNode);
+
+    if (goal == nodes.end() || !goal->second.m_closed)
+        return false;
+
+    auto const first = route.size();
+
+    for (auto id = goal->second.m_parent; id != StartNode;
+         id = nodes[id].m_parent)
+    {
+        auto const point = nodes[id].m_point;
+        route.push_back({point[0], point[1], point[2]});
+    }
+
+    std::reverse(route.begin() + first, route.end());
+
+    return true;
+}
+} // namespace pathfind
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Common.hpp"
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace pathfind
+{
+// the coarse graph of the portals through which navmesh tiles connect to one
+// another, as written by MapBuilder alongside each ADT nav file.  long paths
+// are first routed through this graph, so that detour only has to search the
+// short corridor segments between consecutive portals of the route.
+//
+// the portals of every ADT are read by LoadADT() when the map is opened and
+// are kept for the lifetime of the graph, so that routing never touches the
+// file system or needs a lock.  they do not change as tiles are
+// loaded, unloaded or rebuilt with temporary obstacles, so a route may pass
+// through a portal which is currently blocked, in which case refining it
+// fails and the caller falls back to a plain search.
+class PortalGraph
+{
+private:
+    struct Portal
+    {
+        std::uint8_t m_side;
+        float m_min;
+        float m_max;
+        float m_lowest;
+        float m_highest;
+        float m_point[3];
+
+        // other portals of the same tile reachable from this one, and the
+        // cost of walking there
+        std::vector<std::pair<std::uint16_t, float>> m_edges;
+    };
+
+    struct ADTPortals
+    {
+        std::array<std::vector<Portal>,
+                   MeshSettings::TilesPerADT * MeshSettings::TilesPerADT>
+            m_tiles;
+    };
+
+    const std::filesystem::path m_navPath;
+
+    std::unique_ptr<ADTPortals> m_adts[MeshSettings::Adts][MeshSettings::Adts];
+
+    // returns the portals of the given tile.  tiles of ADTs without a portal
+    // file have none
+    const std::vector<Portal>* GetTilePortals(int x, int y) const;
+
+public:
+    // the portals a route may expand for each tile between its ends, and the
+    // most it may expand however far apart they are.  a route which needs
+    // more than this is winding enough that a plain search is no worse
+    static constexpr size_t RouteNodesPerTile = 64;
+    static constexpr size_t MaxRouteNodes = 16384;
+
+    PortalGraph(const std::filesystem::path& navPath);
+
+    // reads the portals of the given ADT, if it has a portal file.  this must
+    // be done for every ADT before any route is searched for
+    void LoadADT(int x, int y);
+
+    // finds the portals through which a path from start, within the tile
+    // (startX, startY), to end, within (endX, endY), should pass.  positions
+    // are in recast space.  the portal points, not including either end, are
+    // appended to route in order.  returns false when either tile has no
+    // portals or no route was found.
+    bool FindRoute(const float* start, int startX, int startY,
+                   const float* end, int endX, int endY,
+                   std::vector<std::array<float, 3>>& route) const;
+};
+} // namespace pathfind
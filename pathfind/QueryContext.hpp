@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Common.hpp"
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+#include "recastnavigation/Detour/Include/DetourNavMeshQuery.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pathfind
+{
+class Tile;
+
+// how much each thread's queries of a map may search, which is fixed when the
+// map is constructed.  every limit must be positive, and the node pools can
+// hold at most MaxNodes, as detour indexes their nodes with 16 bits
+struct QueryLimits
+{
+    static constexpr int MaxNodes = 65535;
+
+    // the nodes of the pool of the navmesh query, which bounds how many
+    // polygons one search may visit
+    int m_maxNodes = 65535;
+
+    // the most polygons in a corridor, and points in a straight path
+    int m_maxPathHops = 4096;
+
+    // the nodes of the second, small query used by Map::FindShortPath().  a
+    // pool this size, with its hash table and open list, is a few kilobytes,
+    // and so stays in the cache between searches
+    int m_shortPathNodes = 128;
+};
+
+// a dtNavMeshQuery owns its node pool and open list, so while the navmesh and
+// models of a map can be shared between threads, the query objects cannot.
+// one of these exists per (map, thread) pair and holds everything a query
+// needs to mutate.
+struct QueryContext
+{
+    dtNavMeshQuery m_navQuery;
+    dtNavMeshQuery m_shortPathQuery;
+    dtQueryFilter m_queryFilter;
+
+    // the queries of the navmeshes of other agents, by AgentSize, created
+    // when first searched.  see Map::FindAgentPath()
+    std::unique_ptr<dtNavMeshQuery> m_agentQueries[AgentProfileCount];
+
+    // scratch space reused between queries, rather than reserving it on the
+    // stack for every call
+    std::vector<dtPolyRef> m_polyRefs;
+    std::vector<float> m_pathBuffer;
+
+    // ray casts test each instance at most once.  rather than building a set
+    // of the instances seen so far, every static instance has a dense index
+    // into these stamps, and it has been visited by the current ray when its
+    // stamp equals m_visitGeneration.
+    std::uint32_t m_visitGeneration = 0;
+    std::vector<std::uint32_t> m_staticWmoStamps;
+    std::vector<std::uint32_t> m_staticDoodadStamps;
+
+    // temporary obstacles come and go, so they have no dense index.  there
+    // are few of them though, and a linear search is cheap.
+    std::vector<std::uint64_t> m_visitedTemporaryWmos;
+    std::vector<std::uint64_t> m_visitedTemporaryDoodads;
+
+    std::vector<const Tile*> m_rayTiles;
+
+    // distances along a ray of every surface it crosses
+    std::vector<float> m_rayHits;
+};
+} // namespace pathfind
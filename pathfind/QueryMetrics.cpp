@@ -0,0 +1,176 @@
+#include "QueryMetrics.hpp"
+
+#include <cassert>
+
+namespace pathfind
+{
+QueryMetrics::Scope::Scope(QueryMetrics& metrics, Query query)
+    : m_metrics(metrics.Enabled() ? &metrics : nullptr), m_query(query)
+{
+    if (!m_metrics)
+        return;
+
+    m_startCounts = math::AABBTree::ThreadTraceCounts();
+    m_start = std::chrono::steady_clock::now();
+}
+
+QueryMetrics::Scope::~Scope()
+{
+    if (!m_metrics)
+        return;
+
+    auto const nanoseconds = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start)
+            .count());
+
+    auto const& counts = math::AABBTree::ThreadTraceCounts();
+    m_metrics->m_bvhNodes.fetch_add(counts.m_nodes - m_startCounts.m_nodes,
+                                    std::memory_order_relaxed);
+    m_metrics->m_bvhFaces.fetch_add(counts.m_faces - m_startCounts.m_faces,
+                                    std::memory_order_relaxed);
+
+    auto bucket = 0;
+    for (auto const microseconds = nanoseconds / 1000;
+         bucket < LatencyBuckets - 1 && microseconds > LatencyBound(bucket);
+         ++bucket)
+        ;
+
+    auto& stats = m_metrics->m_queries[static_cast<int>(m_query)];
+    stats.m_calls.fetch_add(1, std::memory_order_relaxed);
+    stats.m_nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    stats.m_latency[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+const char* QueryMetrics::QueryName(Query query)
+{
+    switch (query)
+    {
+        case Query::FindPath:
+            return "find_path";
+        case Query::FindPaths:
+            return "find_paths";
+        case Query::FindHeight:
+            return "find_height";
+        case Query::FindHeights:
+            return "find_heights";
+        case Query::FindHeightsGrid:
+            return "find_heights_grid";
+        case Query::LineOfSight:
+            return "line_of_sight";
+        case Query::LineOfSightBatch:
+            return "line_of_sight_batch";
+        case Query::ZoneAndArea:
+            return "zone_and_area";
+        case Query::FindRandomPoint:
+            return "find_random_point";
+        case Query::FindNearestPoint:
+            return "find_nearest_point";
+        case Query::DistanceToWall:
+            return "distance_to_wall";
+        case Query::LineOfSightFan:
+            return "line_of_sight_fan";
+        default:
+            assert(false);
+            return "unknown";
+    }
+}
+
+const char* QueryMetrics::FailureName(Failure failure)
+{
+    switch (failure)
+    {
+        case Failure::NoStartPoly:
+            return "no_start_poly";
+        case Failure::NoEndPoly:
+            return "no_end_poly";
+        case Failure::NoPath:
+            return "no_path";
+        case Failure::PartialPath:
+            return "partial_path";
+        case Failure::HopLimit:
+            return "hop_limit";
+        case Failure::Unreachable:
+            return "unreachable";
+        default:
+            assert(false);
+            return "unknown";
+    }
+}
+
+std::uint64_t QueryMetrics::LatencyBound(int bucket)
+{
+    return bucket < LatencyBuckets - 1 ? std::uint64_t {1} << bucket : 0;
+}
+
+void QueryMetrics::RecordFailure(Failure failure)
+{
+    if (Enabled())
+        m_failures[static_cast<int>(failure)].fetch_add(
+            1, std::memory_order_relaxed);
+}
+
+void QueryMetrics::RecordTilesTraversed(size_t tiles)
+{
+    if (Enabled())
+        m_tilesTraversed.fetch_add(tiles, std::memory_order_relaxed);
+}
+
+void QueryMetrics::RecordStraightPath()
+{
+    if (Enabled())
+        m_straightPaths.fetch_add(1, std::memory_order_relaxed);
+}
+
+void QueryMetrics::RecordPortalRoute()
+{
+    if (Enabled())
+        m_portalRoutes.fetch_add(1, std::memory_order_relaxed);
+}
+
+QueryMetrics::Snapshot QueryMetrics::Get() const
+{
+    Snapshot result;
+
+    for (auto i = 0; i < QueryCount; ++i)
+    {
+        result.m_queries[i].m_calls = m_queries[i].m_calls;
+        result.m_queries[i].m_nanoseconds = m_queries[i].m_nanoseconds;
+
+        for (auto b = 0; b < LatencyBuckets; ++b)
+            result.m_queries[i].m_latency[b] = m_queries[i].m_latency[b];
+    }
+
+    for (auto i = 0; i < FailureCount; ++i)
+        result.m_failures[i] = m_failures[i];
+
+    result.m_tilesTraversed = m_tilesTraversed;
+    result.m_bvhNodes = m_bvhNodes;
+    result.m_bvhFaces = m_bvhFaces;
+    result.m_straightPaths = m_straightPaths;
+    result.m_portalRoutes = m_portalRoutes;
+
+    return result;
+}
+
+void QueryMetrics::Reset()
+{
+    for (auto& stats : m_queries)
+    {
+        stats.m_calls = 0;
+        stats.m_nanoseconds = 0;
+
+        for (auto& count : stats.m_latency)
+            count = 0;
+    }
+
+    for (auto& count : m_failures)
+        count = 0;
+
+    m_tilesTraversed = 0;
+    m_bvhNodes = 0;
+    m_bvhFaces = 0;
+    m_straightPaths = 0;
+    m_portalRoutes = 0;
+}
+} // namespace pathfind
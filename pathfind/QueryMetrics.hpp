@@ -0,0 +1,156 @@
+#pragma once
+
+#include "utility/AABBTree.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace pathfind
+{
+// counts and times the queries made of a map, and why path searches failed,
+// for a server to export to its monitoring.  this is disabled by default, and
+// then costs each query a relaxed load.  the counters are updated by
+// concurrent queries, so they are atomic and read without a lock.  a snapshot
+// taken during queries may be a little inconsistent between counters.
+class QueryMetrics
+{
+public:
+    enum class Query : std::uint8_t
+    {
+        FindPath = 0,
+        FindPaths,
+        FindHeight,
+        FindHeights,
+        FindHeightsGrid,
+        LineOfSight,
+        LineOfSightBatch,
+        ZoneAndArea,
+        FindRandomPoint,
+        FindNearestPoint,
+        DistanceToWall,
+        LineOfSightFan,
+
+        Count
+    };
+
+    enum class Failure : std::uint8_t
+    {
+        // no polygon was found near the start or end of a path
+        NoStartPoly = 0,
+        NoEndPoly,
+
+        // detour found no corridor at all
+        NoPath,
+
+        // the corridor does not reach the end.  these are counted even when
+        // partial paths are allowed
+        PartialPath,
+
+        // the corridor or the straight path filled its buffer
+        // (QueryLimits::m_maxPathHops), so was cut short
+        HopLimit,
+
+        // the ends are in different components of the navmesh (see
+        // Map::EnableReachability()), so no search was made
+        Unreachable,
+
+        Count
+    };
+
+    static constexpr int QueryCount = static_cast<int>(Query::Count);
+    static constexpr int FailureCount = static_cast<int>(Failure::Count);
+
+    // latencies are counted in buckets of at most 1, 2, 4, ... microseconds,
+    // with the last holding everything slower than the one before it
+    static constexpr int LatencyBuckets = 16;
+
+    struct QueryStats
+    {
+        std::uint64_t m_calls;
+        std::uint64_t m_nanoseconds;
+        std::uint64_t m_latency[LatencyBuckets];
+    };
+
+    struct Snapshot
+    {
+        QueryStats m_queries[QueryCount];
+        std::uint64_t m_failures[FailureCount];
+
+        // tiles whose instances were tested by ray casts, and the nodes and
+        // faces of model BVHs tested by them
+        std::uint64_t m_tilesTraversed;
+        std::uint64_t m_bvhNodes;
+        std::uint64_t m_bvhFaces;
+
+        // path searches answered by a navmesh ray cast, without A*
+        std::uint64_t m_straightPaths;
+
+        // path searches routed through the portal graph, whose corridor was
+        // then only searched between consecutive portals of the route
+        std::uint64_t m_portalRoutes;
+    };
+
+    // records the query for as long as it is in scope, if metrics were
+    // enabled when it began
+    class Scope
+    {
+    private:
+        QueryMetrics* const m_metrics;
+        const Query m_query;
+        std::chrono::steady_clock::time_point m_start;
+        math::AABBTree::TraceCounts m_startCounts;
+
+    public:
+        Scope(QueryMetrics& metrics, Query query);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // the names by which queries and failures are exported, such as
+    // "find_path" and "no_start_poly"
+    static const char* QueryName(Query query);
+    static const char* FailureName(Failure failure);
+
+    // the upper bound of a latency bucket, in microseconds, or zero for the
+    // last, which has none
+    static std::uint64_t LatencyBound(int bucket);
+
+private:
+    struct AtomicQueryStats
+    {
+        std::atomic<std::uint64_t> m_calls {0};
+        std::atomic<std::uint64_t> m_nanoseconds {0};
+        std::atomic<std::uint64_t> m_latency[LatencyBuckets] {};
+    };
+
+    std::atomic<bool> m_enabled {false};
+
+    AtomicQueryStats m_queries[QueryCount];
+    std::atomic<std::uint64_t> m_failures[FailureCount] {};
+    std::atomic<std::uint64_t> m_tilesTraversed {0};
+    std::atomic<std::uint64_t> m_bvhNodes {0};
+    std::atomic<std::uint64_t> m_bvhFaces {0};
+    std::atomic<std::uint64_t> m_straightPaths {0};
+    std::atomic<std::uint64_t> m_portalRoutes {0};
+
+public:
+    bool Enabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    void Enable(bool enabled) { m_enabled = enabled; }
+
+    // these do nothing while disabled
+    void RecordFailure(Failure failure);
+    void RecordTilesTraversed(size_t tiles);
+    void RecordStraightPath();
+    void RecordPortalRoute();
+
+    Snapshot Get() const;
+    void Reset();
+};
+} // namespace pathfind
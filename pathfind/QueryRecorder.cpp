@@ -0,0 +1,286 @@
+#include "QueryRecorder.hpp"
+
+#include "Common.hpp"
+#include "utility/Exception.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace pathfind
+{
+namespace
+{
+void WriteString(utility::BinaryStream& out, const std::string& str)
+{
+    out << static_cast<std::uint16_t>(str.length());
+    out.Write(str.data(), str.length());
+}
+
+std::string ReadString(utility::BinaryStream& in)
+{
+    std::uint16_t length;
+    in >> length;
+
+    return in.ReadString(length);
+}
+} // namespace
+
+QueryRecorder::Record::Record(QueryRecorder& recorder, Query query,
+                              const math::Vertex& start,
+                              const math::Vertex& end, bool flag,
+                              const std::string& filter)
+    : m_recorder(recorder.Enabled() ? &recorder : nullptr)
+{
+    if (!m_recorder)
+        return;
+
+    m_entry.m_query = query;
+    m_entry.m_start = start;
+    m_entry.m_end = end;
+    m_entry.m_flag = flag;
+    m_entry.m_filter = filter;
+    m_entry.m_zone = m_entry.m_area = 0;
+
+    m_start = std::chrono::steady_clock::now();
+}
+
+bool QueryRecorder::Record::Finish()
+{
+    m_entry.m_nanoseconds = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start)
+            .count());
+
+    m_recorder->Write(m_entry);
+
+    return m_entry.m_result;
+}
+
+bool QueryRecorder::Record::Finish(bool result)
+{
+    if (!m_recorder)
+        return result;
+
+    m_entry.m_result = result;
+    return Finish();
+}
+
+bool QueryRecorder::Record::Finish(bool result,
+                                   const std::vector<math::Vertex>& path)
+{
+    if (!m_recorder)
+        return result;
+
+    m_entry.m_result = result;
+    m_entry.m_path = path;
+    return Finish();
+}
+
+bool QueryRecorder::Record::Finish(bool result, const float* heights,
+                                   size_t count)
+{
+    if (!m_recorder)
+        return result;
+
+    m_entry.m_result = result;
+    m_entry.m_heights.assign(heights, heights + count);
+    return Finish();
+}
+
+bool QueryRecorder::Record::Finish(bool result, unsigned int zone,
+                                   unsigned int area)
+{
+    if (!m_recorder)
+        return result;
+
+    m_entry.m_result = result;
+    m_entry.m_zone = zone;
+    m_entry.m_area = area;
+    return Finish();
+}
+
+QueryRecorder::~QueryRecorder()
+{
+    Stop();
+}
+
+bool QueryRecorder::Start(const std::filesystem::path& path,
+                          const std::string& mapName)
+{
+    Stop();
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_out.open(path, std::ios::binary | std::ios::trunc);
+
+    if (!m_out)
+        return false;
+
+    m_buffer.wpos(0);
+    m_buffer << Magic << Version;
+    WriteString(m_buffer, mapName);
+
+    m_enabled = true;
+
+    return true;
+}
+
+void QueryRecorder::Stop()
+{
+    m_enabled = false;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (!m_out.is_open())
+        return;
+
+    Flush();
+    m_out.close();
+}
+
+void QueryRecorder::Write(const Entry& entry)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    // recording may have stopped since the query began
+    if (!m_out.is_open())
+        return;
+
+    m_buffer << static_cast<std::uint8_t>(entry.m_query) << entry.m_nanoseconds
+             << entry.m_start;
+
+    switch (entry.m_query)
+    {
+        case Query::FindPath:
+            m_buffer << entry.m_end
+                     << static_cast<std::uint8_t>(entry.m_flag);
+            WriteString(m_buffer, entry.m_filter);
+            break;
+        case Query::FindHeight:
+            m_buffer << entry.m_end.X << entry.m_end.Y;
+            break;
+        case Query::FindHeights:
+            m_buffer << static_cast<std::uint8_t>(entry.m_flag);
+            break;
+        case Query::LineOfSight:
+            m_buffer << entry.m_end
+                     << static_cast<std::uint8_t>(entry.m_flag);
+            break;
+        default:
+            break;
+    }
+
+    m_buffer << static_cast<std::uint8_t>(entry.m_result);
+
+    switch (entry.m_query)
+    {
+        case Query::FindPath:
+            m_buffer << static_cast<std::uint32_t>(entry.m_path.size());
+            m_buffer.Write(entry.m_path.data(),
+                           sizeof(math::Vertex) * entry.m_path.size());
+            break;
+        case Query::FindHeight:
+        case Query::FindHeights:
+            m_buffer << static_cast<std::uint32_t>(entry.m_heights.size());
+            m_buffer.Write(entry.m_heights.data(),
+                           sizeof(float) * entry.m_heights.size());
+            break;
+        case Query::ZoneAndArea:
+            m_buffer << static_cast<std::uint32_t>(entry.m_zone)
+                     << static_cast<std::uint32_t>(entry.m_area);
+            break;
+        default:
+            break;
+    }
+
+    if (m_buffer.wpos() >= FlushSize)
+        Flush();
+}
+
+void QueryRecorder::Flush()
+{
+    m_out << m_buffer;
+    m_out.flush();
+    m_buffer.wpos(0);
+}
+
+void QueryRecorder::Read(const std::filesystem::path& path,
+                         std::string& mapName, std::vector<Entry>& entries)
+{
+    utility::BinaryStream in(path);
+
+    std::uint32_t magic, version;
+    in >> magic >> version;
+
+    if (magic != Magic || version != Version)
+        THROW(Result::INVALID_QUERY_RECORDING);
+
+    mapName = ReadString(in);
+    entries.clear();
+
+    while (!in.IsEOF())
+    {
+        Entry entry {};
+        std::uint8_t query, flag = 0, result;
+
+        in >> query >> entry.m_nanoseconds >> entry.m_start;
+        entry.m_query = static_cast<Query>(query);
+
+        switch (entry.m_query)
+        {
+            case Query::FindPath:
+                in >> entry.m_end >> flag;
+                entry.m_filter = ReadString(in);
+                break;
+            case Query::FindHeight:
+                in >> entry.m_end.X >> entry.m_end.Y;
+                break;
+            case Query::FindHeights:
+                in >> flag;
+                break;
+            case Query::ZoneAndArea:
+                break;
+            case Query::LineOfSight:
+                in >> entry.m_end >> flag;
+                break;
+            default:
+                THROW(Result::INVALID_QUERY_RECORDING);
+        }
+
+        in >> result;
+        entry.m_flag = !!flag;
+        entry.m_result = !!result;
+
+        std::uint32_t count;
+
+        switch (entry.m_query)
+        {
+            case Query::FindPath:
+                in >> count;
+                entry.m_path.resize(count);
+                in.ReadBytes(entry.m_path.data(),
+                             sizeof(math::Vertex) * count);
+                break;
+            case Query::FindHeight:
+            case Query::FindHeights:
+                in >> count;
+                entry.m_heights.resize(count);
+                in.ReadBytes(entry.m_heights.data(), sizeof(float) * count);
+                break;
+            case Query::ZoneAndArea:
+            {
+                std::uint32_t zone, area;
+                in >> zone >> area;
+                entry.m_zone = zone;
+                entry.m_area = area;
+                break;
+            }
+            default:
+                break;
+        }
+
+        entries.push_back(std::move(entry));
+    }
+}
+} // namespace pathfind
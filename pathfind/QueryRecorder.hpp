@@ -0,0 +1,113 @@
+#pragma once
+
+#include "QueryMetrics.hpp"
+#include "utility/BinaryStream.hpp"
+#include "utility/Vector.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pathfind
+{
+// logs the queries made of a map, with their arguments, results and latency,
+// to a compact binary file, so that the load of a server can be replayed
+// offline against later builds of namigator or of the data (see the
+// pathfind_replay benchmark).  like the metrics, this is disabled by default,
+// and then costs each query a relaxed load.
+//
+// the queries recorded are those with a single result: FindPath(),
+// FindHeight(), FindHeights(), ZoneAndArea() and LineOfSight().  the batches
+// are made of these, and random points cannot be compared between builds
+class QueryRecorder
+{
+public:
+    using Query = QueryMetrics::Query;
+
+    struct Entry
+    {
+        Query m_query;
+        std::uint64_t m_nanoseconds;
+
+        // the positions the query was given.  FindHeight() is from m_start to
+        // the (x, y) of m_end, and FindHeights() and ZoneAndArea() use only
+        // m_start
+        math::Vertex m_start;
+        math::Vertex m_end;
+
+        // allowPartial, precise or doodads, as the query takes
+        bool m_flag;
+        std::string m_filter;
+
+        bool m_result;
+        std::vector<math::Vertex> m_path;
+        std::vector<float> m_heights;
+        unsigned int m_zone;
+        unsigned int m_area;
+    };
+
+    // records one query from its construction until Finish(), if recording
+    // when it began.  Finish() returns the result it is given, so that it
+    // may wrap each return of the query
+    class Record
+    {
+    private:
+        QueryRecorder* const m_recorder;
+        Entry m_entry;
+        std::chrono::steady_clock::time_point m_start;
+
+        bool Finish();
+
+    public:
+        Record(QueryRecorder& recorder, Query query,
+               const math::Vertex& start, const math::Vertex& end = {},
+               bool flag = false, const std::string& filter = {});
+
+        Record(const Record&) = delete;
+        Record& operator=(const Record&) = delete;
+
+        bool Finish(bool result);
+        bool Finish(bool result, const std::vector<math::Vertex>& path);
+        bool Finish(bool result, const float* heights, size_t count);
+        bool Finish(bool result, unsigned int zone, unsigned int area);
+    };
+
+    // flushes any recording in progress
+    ~QueryRecorder();
+
+    // begins recording to the given file, replacing it, and stopping any
+    // recording already in progress.  returns false if it cannot be written
+    bool Start(const std::filesystem::path& path, const std::string& mapName);
+    void Stop();
+
+    bool Enabled() const
+    {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+
+    // reads a whole recording.  throws if it is not one
+    static void Read(const std::filesystem::path& path, std::string& mapName,
+                     std::vector<Entry>& entries);
+
+private:
+    static constexpr std::uint32_t Magic = 'QREC';
+    static constexpr std::uint32_t Version = 1;
+
+    // entries are buffered until there are this many bytes of them
+    static constexpr size_t FlushSize = 1 << 20;
+
+    std::atomic<bool> m_enabled {false};
+
+    std::mutex m_mutex;
+    std::ofstream m_out;
+    utility::BinaryStream m_buffer;
+
+    void Write(const Entry& entry);
+    void Flush();
+};
+} // namespace pathfind
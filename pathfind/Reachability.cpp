@@ -0,0 +1,110 @@
+#include "Reachability.hpp"
+
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+namespace
+{
+std::uint32_t FindRoot(std::vector<std::uint32_t>& parents, std::uint32_t i)
+{
+    while (parents[i] != i)
+    {
+        // halving the path as it is walked keeps the trees shallow
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+
+    return i;
+}
+} // anonymous namespace
+
+namespace pathfind
+{
+void Reachability::EnsureCurrent(const dtNavMesh& navMesh)
+{
+    if (m_current.load(std::memory_order_acquire))
+        return;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (!m_current.load(std::memory_order_relaxed))
+    {
+        Rebuild(navMesh);
+        m_current.store(true, std::memory_order_release);
+    }
+}
+
+void Reachability::Rebuild(const dtNavMesh& navMesh)
+{
+    auto const maxTiles = navMesh.getMaxTiles();
+
+    m_tileOffsets.assign(maxTiles + 1, 0);
+
+    for (auto i = 0; i < maxTiles; ++i)
+    {
+        auto const tile = navMesh.getTile(i);
+        m_tileOffsets[i + 1] =
+            m_tileOffsets[i] + (tile->header ? tile->header->polyCount : 0);
+    }
+
+    m_components.resize(m_tileOffsets.back());
+    std::iota(m_components.begin(), m_components.end(), 0u);
+
+    // every link is joined, including those of off mesh connections, which
+    // link the polygons either end to the connection's own polygon
+    for (auto i = 0; i < maxTiles; ++i)
+    {
+        auto const tile = navMesh.getTile(i);
+
+        if (!tile->header)
+            continue;
+
+        for (auto p = 0; p < tile->header->polyCount; ++p)
+        {
+            auto const& poly = tile->polys[p];
+            auto const index = m_tileOffsets[i] + p;
+
+            for (auto l = poly.firstLink; l != DT_NULL_LINK;
+                 l = tile->links[l].next)
+            {
+                auto const ref = tile->links[l].ref;
+
+                if (!ref)
+                    continue;
+
+                auto const neighbour =
+                    m_tileOffsets[navMesh.decodePolyIdTile(ref)] +
+                    navMesh.decodePolyIdPoly(ref);
+
+                auto const a = FindRoot(m_components, index);
+                auto const b = FindRoot(m_components, neighbour);
+
+                if (a != b)
+                    m_components[(std::max)(a, b)] = (std::min)(a, b);
+            }
+        }
+    }
+
+    // label each polygon with its root, so that lookups are a single read
+    for (auto i = 0u; i < m_components.size(); ++i)
+        m_components[i] = FindRoot(m_components, i);
+}
+
+bool Reachability::Connected(const dtNavMesh& navMesh, dtPolyRef a,
+                             dtPolyRef b)
+{
+    EnsureCurrent(navMesh);
+
+    auto const label = [this, &navMesh](dtPolyRef ref) {
+        return m_components[m_tileOffsets[navMesh.decodePolyIdTile(ref)] +
+                            navMesh.decodePolyIdPoly(ref)];
+    };
+
+    return label(a) == label(b);
+}
+} // namespace pathfind
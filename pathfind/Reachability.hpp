@@ -0,0 +1,54 @@
+#pragma once
+
+#include "recastnavigation/Detour/Include/DetourNavMesh.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace pathfind
+{
+// labels each polygon of the loaded navmesh with the connected component it
+// belongs to, so that a path between polygons of different components can be
+// rejected without searching.  otherwise a target on an island is only found
+// to be unreachable once detour has expanded everything reachable from the
+// start, which on a large map means hitting its node limit.
+//
+// links are followed in both directions and polygon flags are ignored, so the
+// polygons of one component are not necessarily reachable from one another,
+// but those of different components never are.  the labels are rebuilt, for
+// the whole navmesh, by the first query after a tile is added or removed.
+class Reachability
+{
+private:
+    // guards rebuilding.  the labels are only rebuilt while the map is locked
+    // shared, and only modified by the map while it is locked exclusively,
+    // so once they are current they may be read without the mutex
+    std::mutex m_mutex;
+    std::atomic<bool> m_current {false};
+
+    // checked by FindPath() before using the labels
+    std::atomic<bool> m_enabled {false};
+
+    // the index of the first polygon of each tile within m_components, with
+    // one more entry holding the total
+    std::vector<std::uint32_t> m_tileOffsets;
+    std::vector<std::uint32_t> m_components;
+
+    // rebuilds the labels if a tile has been added or removed since
+    void EnsureCurrent(const dtNavMesh& navMesh);
+    void Rebuild(const dtNavMesh& navMesh);
+
+public:
+    void SetEnabled(bool enabled) { m_enabled = enabled; }
+    bool Enabled() const { return m_enabled; }
+
+    // called whenever a tile is added to or removed from the navmesh
+    void Invalidate() { m_current = false; }
+
+    // whether the two polygons, which must be valid, are in the same
+    // component.  the caller must hold the mutex of the map, at least shared
+    bool Connected(const dtNavMesh& navMesh, dtPolyRef a, dtPolyRef b);
+};
+} // namespace pathfind
@@ -0,0 +1,27 @@
+#include "RegionBuilder.hpp"
+
+#include "Common.hpp"
+#include "recastnavigation/Recast/Include/Recast.h"
+
+namespace pathfind
+{
+bool BuildRegions(rcContext& ctx, const rcConfig& config,
+                  RegionPartition partition, rcCompactHeightfield& chf)
+{
+    switch (partition)
+    {
+        case RegionPartition::Monotone:
+            return rcBuildRegionsMonotone(&ctx, chf, config.borderSize,
+                                          config.minRegionArea,
+                                          config.mergeRegionArea);
+        case RegionPartition::Layers:
+            return rcBuildLayerRegions(&ctx, chf, config.borderSize,
+                                       config.minRegionArea);
+        default:
+            return rcBuildDistanceField(&ctx, chf) &&
+                   rcBuildRegions(&ctx, chf, config.borderSize,
+                                  config.minRegionArea,
+                                  config.mergeRegionArea);
+    }
+}
+} // namespace pathfind
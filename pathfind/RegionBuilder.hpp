@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Common.hpp"
+
+class rcContext;
+struct rcConfig;
+struct rcCompactHeightfield;
+
+namespace pathfind
+{
+// partitions the walkable area of the compact height field into regions as
+// the nav files of the map were built (see RegionPartition).  this is shared
+// by the builder and by the rebuilds of tiles beneath temporary obstacles,
+// which must partition a tile just as it was built to match its neighbours
+bool BuildRegions(rcContext& ctx, const rcConfig& config,
+                  RegionPartition partition, rcCompactHeightfield& chf);
+} // namespace pathfind
@@ -0,0 +1,138 @@
+#include "SpanFilter.hpp"
+
+#include "Common.hpp"
+#include "recastnavigation/Recast/Include/Recast.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace
+{
+// the height above the highest span of a column, as recast has it
+constexpr int MaxHeight = 0xFFFF;
+
+// as rcFilterLedgeSpans(), but leaving the terrain alone.  the test of each
+// span reads only the heights of its neighbours, never their areas, so the
+// spans may be marked as they are found
+void FilterLedgeSpans(int walkableHeight, int walkableClimb,
+                      rcHeightfield& heightField)
+{
+    auto const width = heightField.width;
+    auto const height = heightField.height;
+
+    for (auto y = 0; y < height; ++y)
+        for (auto x = 0; x < width; ++x)
+            for (auto s = heightField.spans[x + y * width]; s; s = s->next)
+            {
+                if (s->area == RC_NULL_AREA ||
+                    !!(s->area & PolyFlags::Ground))
+                    continue;
+
+                auto const bottom = static_cast<int>(s->smax);
+                auto const top =
+                    s->next ? static_cast<int>(s->next->smin) : MaxHeight;
+
+                // the lowest drop to a neighbour, and the range of the
+                // neighbours which may be climbed to
+                auto minHeight = MaxHeight;
+                auto accessibleMin = bottom;
+                auto accessibleMax = bottom;
+
+                for (auto dir = 0; dir < 4; ++dir)
+                {
+                    auto const dx = x + rcGetDirOffsetX(dir);
+                    auto const dy = y + rcGetDirOffsetY(dir);
+
+                    // beyond the edge of the height field is a drop
+                    if (dx < 0 || dy < 0 || dx >= width || dy >= height)
+                    {
+                        minHeight =
+                            (std::min)(minHeight, -walkableClimb - bottom);
+                        continue;
+                    }
+
+                    auto neighbour = heightField.spans[dx + dy * width];
+
+                    // beneath the lowest span of the neighbour
+                    auto neighbourBottom = -walkableClimb;
+                    auto neighbourTop = neighbour
+                                            ? static_cast<int>(neighbour->smin)
+                                            : MaxHeight;
+
+                    if ((std::min)(top, neighbourTop) -
+                            (std::max)(bottom, neighbourBottom) >
+                        walkableHeight)
+                        minHeight =
+                            (std::min)(minHeight, neighbourBottom - bottom);
+
+                    for (; neighbour; neighbour = neighbour->next)
+                    {
+                        neighbourBottom = static_cast<int>(neighbour->smax);
+                        neighbourTop =
+                            neighbour->next
+                                ? static_cast<int>(neighbour->next->smin)
+                                : MaxHeight;
+
+                        if ((std::min)(top, neighbourTop) -
+                                (std::max)(bottom, neighbourBottom) <=
+                            walkableHeight)
+                            continue;
+
+                        minHeight =
+                            (std::min)(minHeight, neighbourBottom - bottom);
+
+                        if (std::abs(neighbourBottom - bottom) <=
+                            walkableClimb)
+                        {
+                            accessibleMin =
+                                (std::min)(accessibleMin, neighbourBottom);
+                            accessibleMax =
+                                (std::max)(accessibleMax, neighbourBottom);
+                        }
+                    }
+                }
+
+                // a drop to any side, or too steep a climb across those
+                // which may be reached
+                if (minHeight < -walkableClimb ||
+                    accessibleMax - accessibleMin > walkableClimb)
+                    s->area = RC_NULL_AREA;
+            }
+}
+} // anonymous namespace
+
+namespace pathfind
+{
+void FilterWalkableSpans(rcContext& ctx, int walkableHeight, int walkableClimb,
+                         rcHeightfield& heightField)
+{
+    FilterLedgeSpans(walkableHeight, walkableClimb, heightField);
+
+    rcFilterWalkableLowHeightSpans(&ctx, walkableHeight, heightField);
+    rcFilterLowHangingWalkableObstacles(&ctx, walkableClimb, heightField);
+}
+
+void FilterGroundBeneathLiquid(rcHeightfield& heightField)
+{
+    for (auto i = 0; i < heightField.width * heightField.height; ++i)
+    {
+        // the spans since the last liquid or wmo span, which are neither
+        auto below = heightField.spans[i];
+
+        for (auto s = below; s; s = s->next)
+        {
+            if (!(s->area & (PolyFlags::Liquid | PolyFlags::Wmo)))
+                continue;
+
+            // liquid outside of a wmo removes everything beneath it.  no wmo
+            // span is ever among them, and so a wmo span, liquid or not,
+            // only ends the run
+            if (!(s->area & PolyFlags::Wmo))
+                for (auto ns = below; ns != s; ns = ns->next)
+                    ns->area = RC_NULL_AREA;
+
+            below = s->next;
+        }
+    }
+}
+} // namespace pathfind
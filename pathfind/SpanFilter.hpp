@@ -0,0 +1,22 @@
+#pragma once
+
+class rcContext;
+struct rcHeightfield;
+
+namespace pathfind
+{
+// the span filters which run for every tile, both when the builder builds it
+// and when a temporary obstacle is inserted into it at runtime.  each walks
+// every column of the height field once, in place, without allocating
+
+// removes the walkable area of spans which the agent cannot stand on: that
+// of ledges, as rcFilterLedgeSpans() would, except for those of the ADT
+// terrain (PolyFlags::Ground), then those with too little room above and the
+// low obstacles which may be stepped over
+void FilterWalkableSpans(rcContext& ctx, int walkableHeight, int walkableClimb,
+                         rcHeightfield& heightField);
+
+// removes the walkable area of the spans beneath liquid: every span beneath
+// liquid outside of a wmo, down to the nearest wmo span
+void FilterGroundBeneathLiquid(rcHeightfield& heightField);
+} // namespace pathfind
@@ -1,23 +1,37 @@
 #include "Map.hpp"
 #include "MapBuilder/MeshBuilder.hpp"
+#include "OffMeshParams.hpp"
+#include "RegionBuilder.hpp"
+#include "SpanFilter.hpp"
 #include "Tile.hpp"
 #include "recastnavigation/Detour/Include/DetourNavMeshBuilder.h"
 #include "recastnavigation/Recast/Include/Recast.h"
 #include "utility/BoundingBox.hpp"
 #include "utility/Exception.hpp"
 #include "utility/MathHelper.hpp"
+#include "utility/Quaternion.hpp"
+#include "utility/Trace.hpp"
 #include "utility/Vector.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
 #include <iomanip>
+#include <list>
+#include <mutex>
+#include <shared_mutex>
 #include <sstream>
+#include <string>
 #include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace
 {
-class RecastContext : public rcContext
+class LogContext : public rcContext
 {
 private:
     const rcLogCategory m_logLevel;
@@ -55,7 +69,7 @@ private:
     }
 
 public:
-    RecastContext(int logLevel)
+    LogContext(int logLevel)
         : m_logLevel(static_cast<rcLogCategory>(logLevel))
     {
     }
@@ -64,16 +78,16 @@ public:
 #define ZERO(x) memset(&x, 0, sizeof(x))
 
 // NOTE: this does not set bmin/bmax
-void InitializeRecastConfig(rcConfig& config)
+void InitializeRecastConfig(rcConfig& config, const AgentProfile& agent)
 {
     ZERO(config);
 
     config.cs = MeshSettings::CellSize;
     config.ch = MeshSettings::CellHeight;
     config.walkableSlopeAngle = MeshSettings::WalkableSlope;
-    config.walkableClimb = MeshSettings::VoxelWalkableClimb;
-    config.walkableHeight = MeshSettings::VoxelWalkableHeight;
-    config.walkableRadius = MeshSettings::VoxelWalkableRadius;
+    config.walkableClimb = agent.VoxelWalkableClimb();
+    config.walkableHeight = agent.VoxelWalkableHeight();
+    config.walkableRadius = agent.VoxelWalkableRadius();
     config.maxEdgeLen = config.walkableRadius * 4;
     config.maxSimplificationError = MeshSettings::MaxSimplificationError;
     config.minRegionArea = MeshSettings::MinRegionSize;
@@ -102,8 +116,10 @@ using SmartPolyMeshPtr = std::unique_ptr<rcPolyMesh, decltype(&rcFreePolyMesh)>;
 using SmartPolyMeshDetailPtr =
     std::unique_ptr<rcPolyMeshDetail, decltype(&rcFreePolyMeshDetail)>;
 
-bool RebuildMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
-                     int tileY, rcHeightfield& solid,
+bool RebuildMeshTile(rcContext& ctx, const rcConfig& config,
+                     const AgentProfile& agent, RegionPartition partition,
+                     int tileX, int tileY, rcHeightfield& solid,
+                     const std::vector<OffMeshConnection>& offMeshConnections,
                      std::vector<unsigned char>& out)
 {
     // initialize compact height field
@@ -115,11 +131,11 @@ bool RebuildMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
                                    *chf))
         return false;
 
-    if (!rcBuildDistanceField(&ctx, *chf))
+    // as built by MapBuilder
+    if (!rcErodeWalkableArea(&ctx, config.walkableRadius, *chf))
         return false;
 
-    if (!rcBuildRegions(&ctx, *chf, config.borderSize, config.minRegionArea,
-                        config.mergeRegionArea))
+    if (!pathfind::BuildRegions(ctx, config, partition, *chf))
         return false;
 
     SmartContourSetPtr cset(rcAllocContourSet(), rcFreeContourSet);
@@ -182,9 +198,9 @@ bool RebuildMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
     params.detailVertsCount = polyMeshDetail->nverts;
     params.detailTris = polyMeshDetail->tris;
     params.detailTriCount = polyMeshDetail->ntris;
-    params.walkableHeight = MeshSettings::WalkableHeight;
-    params.walkableRadius = MeshSettings::WalkableRadius;
-    params.walkableClimb = MeshSettings::WalkableClimb;
+    params.walkableHeight = agent.m_walkableHeight;
+    params.walkableRadius = agent.m_walkableRadius;
+    params.walkableClimb = agent.m_walkableClimb;
     params.tileX = tileX;
     params.tileY = tileY;
     params.tileLayer = 0;
@@ -194,6 +210,10 @@ bool RebuildMeshTile(rcContext& ctx, const rcConfig& config, int tileX,
     params.ch = config.ch;
     params.buildBvTree = true;
 
+    // detour keeps only those which start within the tile
+    const pathfind::OffMeshParams offMesh(offMeshConnections);
+    offMesh.Apply(params);
+
     unsigned char* outData;
     int outDataSize;
     if (!dtCreateNavMeshData(&params, &outData, &outDataSize))
@@ -229,151 +249,835 @@ void Map::AddGameObject(std::uint64_t guid, unsigned int displayId,
 
 void Map::AddGameObject(std::uint64_t guid, unsigned int displayId,
                         const math::Vector3& position,
-                        const math::Matrix& rotation, int /*doodadSet*/)
+                        const math::Matrix& rotation, int doodadSet)
 {
-    if (m_temporaryDoodads.find(guid) != m_temporaryDoodads.end() ||
-        m_temporaryWmos.find(guid) != m_temporaryWmos.end())
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    // an expired entry belongs to an obstacle whose tiles have all been
+    // unloaded, and is only waiting to be swept
+    auto const doodadEntry = m_temporaryDoodads.find(guid);
+    auto const wmoEntry = m_temporaryWmos.find(guid);
+
+    if ((doodadEntry != m_temporaryDoodads.end() &&
+         !doodadEntry->second.expired()) ||
+        (wmoEntry != m_temporaryWmos.end() && !wmoEntry->second.expired()))
         THROW(Result::GAMEOBJECT_WITH_SPECIFIED_GUID_ALREADY_EXISTS);
 
     auto const matrix =
         math::Matrix::CreateTranslationMatrix(position) * rotation;
 
-    auto const bvh_path = m_bvhLoader.GetBVHPath(displayId);
-    // TODO: Add logic based on bvh_path
-    auto const doodad = true;
-    // auto const doodad = m_temporaryObstaclePaths[displayId][0] == 'd' ||
-    // m_temporaryObstaclePaths[displayId][0] == 'D';
+    auto const bvh_path = m_models->GetBVH().GetBVHPath(displayId);
 
-    if (doodad)
+    // only the tiles beneath the bounds of the instance are visited
+    std::vector<Tile*> tiles;
+
+    if (ModelCache::IsWmoBVH(bvh_path))
     {
-        auto instance = std::make_shared<DoodadInstance>();
+        auto model = m_models->LoadWmoModel(bvh_path);
+
+        // if there is only one, the specified set is irrelevant.  use it!
+        if (doodadSet < 0 && model->m_doodadSets.size() > 1)
+            THROW(Result::NO_DOODAD_SET_SPECIFIED_FOR_WMO_GAME_OBJECT);
+
+        if (doodadSet < 0)
+            doodadSet = 0;
+
+        if (doodadSet > 0 &&
+            static_cast<size_t>(doodadSet) >= model->m_doodadSets.size())
+            THROW(Result::INVALID_DOODAD_SET_FOR_WMO_GAME_OBJECT);
+
+        auto instance = std::make_shared<WmoInstance>();
 
+        instance->m_doodadSet = static_cast<unsigned int>(doodadSet);
+        instance->m_nameSet = 0;
         instance->m_transformMatrix = matrix;
         instance->m_inverseTransformMatrix = matrix.ComputeInverse();
-        instance->m_modelFilename = bvh_path;
-        auto model = EnsureDoodadModelLoaded(bvh_path);
+        instance->m_modelFilename = InternModelName(bvh_path);
         instance->m_model = model;
 
-        instance->m_translatedVertices.reserve(
-            model->m_aabbTree.Vertices().size());
+        // the doodads of the set are placed in model space, and may reach
+        // beyond the model itself
+        auto bounds = model->m_aabbTree.GetBoundingBox();
 
-        for (auto const& v : model->m_aabbTree.Vertices())
-            instance->m_translatedVertices.emplace_back(
-                math::Vector3::Transform(v, matrix));
+        if (instance->m_doodadSet < model->m_doodadSets.size())
+            for (auto const& doodad :
+                 model->m_doodadSets[instance->m_doodadSet])
+                bounds.connectWith(doodad.m_bounds);
+
+        bounds.transform(matrix);
+
+        instance->m_bounds = bounds;
+        m_temporaryWmos[guid] = instance;
+        SweepExpiredTemporaryObstacles();
+
+        GetTilesInBounds(bounds, tiles);
+
+        for (auto const tile : tiles)
+        {
+            tile->m_temporaryModels[guid] = model;
+            tile->RasterizeTemporaryWmo(guid, instance);
+        }
+    }
+    else
+    {
+        auto instance = std::make_shared<DoodadInstance>();
 
-        // models are guarunteed to have more than zero vertices
-        math::BoundingBox bounds {instance->m_translatedVertices[0],
-                                  instance->m_translatedVertices[0]};
+        instance->m_transformMatrix = matrix;
+        instance->m_inverseTransformMatrix = matrix.ComputeInverse();
+        instance->m_modelFilename = InternModelName(bvh_path);
+        auto model = m_models->LoadDoodadModel(bvh_path);
+        instance->m_model = model;
 
-        for (auto i = 1u; i < instance->m_translatedVertices.size(); ++i)
-            bounds.update(instance->m_translatedVertices[i]);
+        // the transformed bounds of the model are a little looser than those
+        // of its transformed vertices, but only cost eight transforms.  the
+        // vertices themselves are only transformed when a tile is rebuilt
+        auto bounds = model->m_aabbTree.GetBoundingBox();
+        bounds.transform(matrix);
 
         instance->m_bounds = bounds;
         m_temporaryDoodads[guid] = instance;
+        SweepExpiredTemporaryObstacles();
+
+        GetTilesInBounds(bounds, tiles);
 
-        for (auto const& tile : m_tiles)
+        for (auto const tile : tiles)
         {
-            if (!tile.second->m_bounds.intersect2d(instance->m_bounds))
-                continue;
+            tile->m_temporaryModels[guid] = model;
+            tile->RasterizeTemporaryDoodad(guid, instance);
+        }
+    }
+
+    for (auto const tile : tiles)
+        TileChanged(tile);
+
+    ReleaseIdleHeightFieldsLocked();
+}
+
+void Map::RemoveGameObject(std::uint64_t guid)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    // every tile beneath the obstacle may have been unloaded, and it with
+    // them, in which case only the entry remains
+    math::BoundingBox bounds;
+
+    auto const doodadEntry = m_temporaryDoodads.find(guid);
+    auto const wmoEntry = m_temporaryWmos.find(guid);
+
+    if (doodadEntry != m_temporaryDoodads.end())
+    {
+        auto const instance = doodadEntry->second.lock();
+        m_temporaryDoodads.erase(doodadEntry);
+
+        if (!instance)
+            return;
+
+        bounds = instance->m_bounds;
+    }
+    else if (wmoEntry != m_temporaryWmos.end())
+    {
+        auto const instance = wmoEntry->second.lock();
+        m_temporaryWmos.erase(wmoEntry);
+
+        if (!instance)
+            return;
+
+        bounds = instance->m_bounds;
+    }
+    else
+        return;
+
+    std::vector<Tile*> tiles;
+    GetTilesInBounds(bounds, tiles);
+
+    for (auto const tile : tiles)
+        if (tile->RemoveTemporaryObstacle(guid))
+            TileChanged(tile);
+
+    ReleaseIdleHeightFieldsLocked();
+}
+
+std::uint32_t Map::AddOffMeshConnection(const math::Vertex& start,
+                                       const math::Vertex& end, float radius,
+                                       bool bidirectional)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    OffMeshConnection connection {{start.X, start.Y, start.Z},
+                                  {end.X, end.Y, end.Z},
+                                  radius,
+                                  bidirectional,
+                                  0};
+
+    Tile* omitted;
+    auto const tile = GetStartTile(connection, &omitted);
+
+    // the connection could only be added to the mesh by rebuilding it
+    if (omitted)
+        THROW_MSG("Off-mesh connection starts in tile (" +
+                      std::to_string(omitted->m_x) + ", " +
+                      std::to_string(omitted->m_y) + ")",
+                  Result::TILE_HAS_NO_HEIGHT_FIELD);
+
+    connection.m_id = ++m_nextOffMeshConnectionId;
+    m_offMeshConnections[connection.m_id] = connection;
+
+    if (tile)
+    {
+        tile->m_offMeshConnections.push_back(connection);
+        TileChanged(tile);
+    }
+
+    return connection.m_id;
+}
+
+void Map::RemoveOffMeshConnection(std::uint32_t id)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    auto const entry = m_offMeshConnections.find(id);
+
+    if (entry == m_offMeshConnections.end())
+        return;
+
+    auto const tile = GetStartTile(entry->second);
+    m_offMeshConnections.erase(entry);
+
+    if (!tile)
+        return;
+
+    auto& connections = tile->m_offMeshConnections;
+    connections.erase(std::remove_if(connections.begin(), connections.end(),
+                                     [id](const OffMeshConnection& c)
+                                     { return c.m_id == id; }),
+                      connections.end());
+
+    TileChanged(tile);
+}
+
+Tile* Map::GetStartTile(const OffMeshConnection& connection,
+                        Tile** omitted) const
+{
+    float tileX, tileY;
+    WorldToTile(connection.m_start[0], connection.m_start[1], tileX, tileY);
+
+    auto const tile = GetTileAt(static_cast<int>(std::floor(tileX)),
+                                static_cast<int>(std::floor(tileY)));
+
+    if (omitted)
+        *omitted = tile && !tile->HasHeightField() ? tile : nullptr;
+
+    return tile && tile->HasHeightField() ? tile : nullptr;
+}
+
+void Map::SetHeightFieldIdleTime(std::chrono::milliseconds idleTime)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+    m_heightFieldIdleTime = idleTime;
+}
+
+size_t Map::ReleaseIdleHeightFields()
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+    return ReleaseIdleHeightFieldsLocked();
+}
+
+size_t Map::ReleaseIdleHeightFieldsLocked()
+{
+    if (m_heightFieldIdleTime.count() <= 0)
+        return 0;
+
+    auto const since = std::chrono::steady_clock::now() - m_heightFieldIdleTime;
+
+    // releasing a height field removes its tile from the set
+    std::vector<Tile*> tiles(m_heightFieldTiles.begin(),
+                             m_heightFieldTiles.end());
+
+    size_t result = 0;
+    for (auto const tile : tiles)
+        if (tile->ReleaseHeightFieldIfIdle(since))
+            ++result;
+
+    return result;
+}
+
+void Map::GetTilesInBounds(const math::BoundingBox& bounds,
+                           std::vector<Tile*>& tiles) const
+{
+    // note that world x maps to tile y and world y to tile x, both inverted
+    float minTileX, minTileY, maxTileX, maxTileY;
+    WorldToTile(bounds.MaxCorner.X, bounds.MaxCorner.Y, minTileX, minTileY);
+    WorldToTile(bounds.MinCorner.X, bounds.MinCorner.Y, maxTileX, maxTileY);
+
+    auto const startX = (std::max)(0, static_cast<int>(std::floor(minTileX)));
+    auto const startY = (std::max)(0, static_cast<int>(std::floor(minTileY)));
+    auto const stopX = (std::min)(MeshSettings::TileCount - 1,
+                                  static_cast<int>(std::floor(maxTileX)));
+    auto const stopY = (std::min)(MeshSettings::TileCount - 1,
+                                  static_cast<int>(std::floor(maxTileY)));
+
+    for (auto y = startY; y <= stopY; ++y)
+        for (auto x = startX; x <= stopX; ++x)
+        {
+            auto const tile = GetTileAt(x, y);
+
+            if (tile && tile->m_bounds.intersect2d(bounds))
+                tiles.push_back(tile);
+        }
+}
+
+void Map::AddGameObjects(utility::ArrayView<GameObjectSpawn> spawns,
+                         unsigned int threads)
+{
+    threads = (std::max)(1u, threads);
+
+    // the models are held here until every object using them is added, so
+    // that none is read twice, nor read while holding the mutex
+    std::vector<std::string> bvhFiles;
+
+    {
+        std::unordered_set<unsigned int> displayIds;
+
+        for (auto const& spawn : spawns)
+            if (displayIds.insert(spawn.m_displayId).second)
+            {
+                // an unknown model is reported by AddGameObject() below
+                try
+                {
+                    bvhFiles.push_back(
+                        m_models->GetBVH().GetBVHPath(spawn.m_displayId));
+                }
+                catch (const utility::exception&)
+                {
+                }
+            }
+    }
+
+    std::vector<std::shared_ptr<Model>> models(bvhFiles.size());
+    std::atomic_size_t next {0};
+
+    auto const load = [this, &bvhFiles, &models, &next]()
+    {
+        for (auto i = next++; i < bvhFiles.size(); i = next++)
+            try
+            {
+                if (ModelCache::IsWmoBVH(bvhFiles[i]))
+                    models[i] = m_models->LoadWmoModel(bvhFiles[i]);
+                else
+                    models[i] = m_models->LoadDoodadModel(bvhFiles[i]);
+            }
+            catch (const std::exception&)
+            {
+                // as above
+            }
+    };
+
+    {
+        std::vector<std::thread> loaders;
+        for (auto i = 1u; i < threads; ++i)
+            loaders.emplace_back(load);
+
+        load();
+
+        for (auto& loader : loaders)
+            loader.join();
+    }
+
+    // objects sharing a tile are added one after another, so that its height
+    // field is decoded once and stays warm while they are rasterized into it
+    std::vector<std::pair<std::pair<int, int>, size_t>> order;
+    order.reserve(spawns.size());
+
+    for (auto i = 0u; i < spawns.size(); ++i)
+    {
+        int tileX, tileY;
+        math::Convert::WorldToTile({spawns[i].m_position[0],
+                                    spawns[i].m_position[1],
+                                    spawns[i].m_position[2]},
+                                   tileX, tileY);
+        order.push_back({{tileX, tileY}, i});
+    }
+
+    std::sort(order.begin(), order.end());
+
+    BeginObstacleBatch();
+
+    try
+    {
+        for (auto const& entry : order)
+        {
+            auto const& spawn = spawns[entry.second];
+
+            AddGameObject(
+                spawn.m_guid, spawn.m_displayId,
+                {spawn.m_position[0], spawn.m_position[1],
+                 spawn.m_position[2]},
+                math::Quaternion(spawn.m_rotation[0], spawn.m_rotation[1],
+                                 spawn.m_rotation[2], spawn.m_rotation[3]));
+        }
+    }
+    catch (...)
+    {
+        CommitObstacleBatch(threads);
+        throw;
+    }
+
+    CommitObstacleBatch(threads);
+}
+
+void Map::BeginObstacleBatch()
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+    ++m_obstacleBatchDepth;
+}
+
+void Map::CommitObstacleBatch(unsigned int threads)
+{
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    if (!m_obstacleBatchDepth || --m_obstacleBatchDepth > 0)
+        return;
+
+    // tiles which have been unloaded since took their obstacles with them,
+    // and those whose obstacles have all been removed need no build
+    std::vector<Tile*> tiles;
+    tiles.reserve(m_dirtyTiles.size());
+
+    for (auto const& coordinates : m_dirtyTiles)
+    {
+        auto const tile = GetTileAt(coordinates.first, coordinates.second);
+
+        if (!tile)
+            continue;
 
-            tile.second->AddTemporaryDoodad(guid, instance);
+        // background rebuilds take care of themselves
+        if (!m_rebuildThreads.empty() || !tile->HasRuntimeChanges())
+            RebuildTile(tile);
+        else
+        {
+            tile->m_obstacleVersion = ++m_obstacleVersion;
+            tiles.push_back(tile);
         }
     }
+
+    m_dirtyTiles.clear();
+
+    if (tiles.empty())
+        return;
+
+    // each tile is built from its own height field, so the builds are
+    // independent of one another.  only replacing the meshes within the
+    // navmesh must happen one at a time.
+    std::vector<std::vector<std::uint8_t>> tileData(tiles.size());
+
+    threads = (std::max)(
+        1u, (std::min)(threads, static_cast<unsigned int>(tiles.size())));
+
+    std::atomic<size_t> next {0};
+    auto const build = [&]()
+    {
+        for (auto i = next++; i < tiles.size(); i = next++)
+            tiles[i]->BuildMesh(tileData[i]);
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+
+    for (auto i = 1u; i < threads; ++i)
+        workers.emplace_back(build);
+
+    build();
+
+    for (auto& worker : workers)
+        worker.join();
+
+    for (auto i = 0u; i < tiles.size(); ++i)
+        tiles[i]->ReplaceMesh(tileData[i]);
+}
+
+void Map::RebuildTile(Tile* tile)
+{
+    // any rebuild still in progress is now out of date
+    tile->m_obstacleVersion = ++m_obstacleVersion;
+
+    if (!tile->HasRuntimeChanges())
+    {
+        tile->RestoreMesh();
+        return;
+    }
+
+    if (m_rebuildThreads.empty())
+    {
+        std::vector<std::uint8_t> tileData;
+        tile->BuildMesh(tileData);
+        tile->ReplaceMesh(tileData);
+        return;
+    }
+
+    TileRebuild rebuild;
+    rebuild.m_x = tile->m_x;
+    rebuild.m_y = tile->m_y;
+    rebuild.m_tile = tile;
+    rebuild.m_version = tile->m_obstacleVersion;
+    rebuild.m_heightField.reset(rcAllocHeightfield());
+    tile->CopyHeightField(*rebuild.m_heightField);
+    rebuild.m_offMeshConnections = tile->m_offMeshConnections;
+
+    {
+        std::lock_guard<std::mutex> guard(m_rebuildMutex);
+        m_rebuilds.push_back(std::move(rebuild));
+    }
+
+    m_rebuildCondition.notify_one();
+}
+
+void Map::TileChanged(Tile* tile)
+{
+    // the obstacles of the tile apply to line of sight at once, whereas its
+    // mesh may not be rebuilt until later
+    m_lineOfSightCache.InvalidateTile(tile->m_x, tile->m_y);
+
+    // the obstacles of a tile without a height field are only tested by
+    // line of sight and rays, as its mesh cannot be built again
+    if (!tile->HasHeightField())
+        return;
+
+    if (m_obstacleBatchDepth > 0)
+        m_dirtyTiles.emplace(tile->m_x, tile->m_y);
     else
+        RebuildTile(tile);
+}
+
+void Map::SetRebuildThreads(unsigned int threads)
+{
+    // m_rebuildThreads is read by RebuildTile() under the map's lock.  the
+    // workers never take it, so they can still be joined while it is held
+    std::lock_guard<std::shared_mutex> mapGuard(m_mutex);
+
     {
-        THROW(Result::TEMPORARY_WMO_OBSTACLES_ARE_NOT_SUPPORTED);
+        std::lock_guard<std::mutex> guard(m_rebuildMutex);
+        m_rebuildStop = true;
+    }
+
+    m_rebuildCondition.notify_all();
+
+    // workers finish the rebuild they are on before stopping
+    for (auto& thread : m_rebuildThreads)
+        thread.join();
 
-        // auto const model = LoadWmoModel(0); // TODO make this support loading
-        // a filename
+    m_rebuildThreads.clear();
 
-        //// if there is only one, the specified set is irrelevant.  use it!
-        // if (doodadSet < 0 && model->m_doodadSets.size() > 1)
-        //    THROW(NO_DOODAD_SET_SPECIFIED_FOR_WMO_GAME_OBJECT);
-        //
-        // if (doodadSet < 0)
-        //    doodadSet = 0;
+    std::lock_guard<std::mutex> guard(m_rebuildMutex);
+
+    m_rebuildStop = false;
+
+    for (auto i = 0u; i < threads; ++i)
+        m_rebuildThreads.emplace_back(&Map::RebuildWorker, this);
+
+    // with no workers left, whatever is queued is built here, ready for the
+    // next CommitRebuiltTiles()
+    if (!threads)
+        for (auto& rebuild : m_rebuilds)
+            if (!rebuild.m_started)
+            {
+                rebuild.m_started = true;
+                Tile::BuildMesh(GetAgentProfile(), GetRegionPartition(),
+                                rebuild.m_x, rebuild.m_y,
+                                *rebuild.m_heightField,
+                                rebuild.m_offMeshConnections,
+                                rebuild.m_tileData);
+                rebuild.m_heightField.reset();
+                rebuild.m_finished = true;
+            }
+}
 
-        // WmoInstance instance { static_cast<unsigned short>(doodadSet),
-        // matrix, matrix.ComputeInverse(), math::BoundingBox(), model };
+void Map::RebuildWorker()
+{
+    std::unique_lock<std::mutex> lock(m_rebuildMutex);
+
+    while (true)
+    {
+        auto rebuild = m_rebuilds.end();
+
+        m_rebuildCondition.wait(lock, [this, &rebuild]() {
+            if (m_rebuildStop)
+                return true;
+
+            rebuild = std::find_if(
+                m_rebuilds.begin(), m_rebuilds.end(),
+                [](const TileRebuild& r) { return !r.m_started; });
+
+            return rebuild != m_rebuilds.end();
+        });
+
+        if (m_rebuildStop)
+            return;
+
+        // as with ADT loads, only finished rebuilds are ever removed
+        rebuild->m_started = true;
+        lock.unlock();
+
+        Tile::BuildMesh(GetAgentProfile(), GetRegionPartition(), rebuild->m_x,
+                        rebuild->m_y, *rebuild->m_heightField,
+                        rebuild->m_offMeshConnections, rebuild->m_tileData);
+        rebuild->m_heightField.reset();
+
+        lock.lock();
+        rebuild->m_finished = true;
     }
 }
 
-void Tile::AddTemporaryDoodad(std::uint64_t guid,
-                              std::shared_ptr<DoodadInstance> doodad)
+int Map::CommitRebuiltTiles()
 {
-    if (!m_heightField.spans)
-        LoadHeightField();
+    std::list<TileRebuild> finished;
 
-    auto const model = doodad->m_model.lock();
+    {
+        std::lock_guard<std::mutex> guard(m_rebuildMutex);
 
-    std::vector<float> recastVertices;
-    math::Convert::VerticesToRecast(doodad->m_translatedVertices,
-                                    recastVertices);
+        for (auto i = m_rebuilds.begin(); i != m_rebuilds.end();)
+        {
+            auto const current = i++;
+            if (current->m_finished)
+                finished.splice(finished.end(), m_rebuilds, current);
+        }
+    }
 
-    std::vector<unsigned char> areas(model->m_aabbTree.Indices().size());
+    if (finished.empty())
+        return 0;
 
-    m_temporaryDoodads[guid] = std::move(doodad);
+    auto result = 0;
 
-    RecastContext ctx(rcLogCategory::RC_LOG_ERROR);
-    rcClearUnwalkableTriangles(
-        &ctx, MeshSettings::WalkableSlope, &recastVertices[0],
-        static_cast<int>(recastVertices.size() / 3),
-        &model->m_aabbTree.Indices()[0],
-        static_cast<int>(model->m_aabbTree.Indices().size() / 3), &areas[0]);
-    rcRasterizeTriangles(
-        &ctx, &recastVertices[0], static_cast<int>(recastVertices.size() / 3),
-        &model->m_aabbTree.Indices()[0], &areas[0],
-        static_cast<int>(model->m_aabbTree.Indices().size() / 3),
-        m_heightField);
-
-    // we don't want to filter ledge spans from ADT terrain.  this will restore
-    // the area for these spans, which we are using for flags
+    std::lock_guard<std::shared_mutex> guard(m_mutex);
+
+    for (auto& rebuild : finished)
     {
-        std::vector<std::pair<rcSpan*, unsigned int>> groundSpanAreas;
+        // the tile may have been unloaded, or changed again since the
+        // rebuild began, in which case a newer rebuild is on its way.
+        // versions are unique within the map, so a tile loaded since in the
+        // same place never matches
+        auto const tile = GetTileAt(rebuild.m_x, rebuild.m_y);
+
+        if (tile != rebuild.m_tile ||
+            tile->m_obstacleVersion != rebuild.m_version)
+            continue;
 
-        groundSpanAreas.reserve(m_heightField.width * m_heightField.height);
+        tile->ReplaceMesh(rebuild.m_tileData);
+        ++result;
+    }
 
-        for (auto i = 0; i < m_heightField.width * m_heightField.height; ++i)
-            for (rcSpan* s = m_heightField.spans[i]; s; s = s->next)
-                if (!!(s->area & PolyFlags::Ground))
-                    groundSpanAreas.push_back(std::pair<rcSpan*, unsigned int>(
-                        s, static_cast<unsigned int>(s->area)));
+    return result;
+}
 
-        rcFilterLedgeSpans(&ctx, MeshSettings::VoxelWalkableHeight,
-                           MeshSettings::VoxelWalkableClimb, m_heightField);
+void Tile::RasterizeTemporaryDoodad(std::uint64_t guid,
+                                    std::shared_ptr<DoodadInstance> doodad)
+{
+    utility::Trace::Scope trace("Tile::RasterizeTemporaryDoodad", "obstacle",
+                                m_x, m_y);
 
-        for (auto p : groundSpanAreas)
-            p.first->area = p.second;
+    if (m_hasHeightField)
+    {
+        EnsureHeightField();
+        RasterizeDoodad(*doodad);
     }
 
-    rcFilterWalkableLowHeightSpans(&ctx, MeshSettings::VoxelWalkableHeight,
-                                   m_heightField);
-    rcFilterLowHangingWalkableObstacles(&ctx, MeshSettings::VoxelWalkableClimb,
-                                        m_heightField);
+    m_temporaryDoodads[guid] = std::move(doodad);
+}
+
+void Tile::RasterizeTemporaryWmo(std::uint64_t guid,
+                                 std::shared_ptr<WmoInstance> wmo)
+{
+    utility::Trace::Scope trace("Tile::RasterizeTemporaryWmo", "obstacle", m_x,
+                                m_y);
+
+    if (m_hasHeightField)
+    {
+        EnsureHeightField();
+        RasterizeWmo(*wmo);
+    }
+
+    m_temporaryWmos[guid] = std::move(wmo);
+}
+
+bool Tile::RemoveTemporaryObstacle(std::uint64_t guid)
+{
+    if (!m_temporaryDoodads.erase(guid) && !m_temporaryWmos.erase(guid))
+        return false;
+
+    m_temporaryModels.erase(guid);
+
+    // recast cannot take triangles back out of a height field, so everything
+    // else is rasterized again into a fresh copy of the original
+    FreeHeightField();
+
+    if (m_hasHeightField && HasTemporaryObstacles())
+        EnsureHeightField();
+
+    return true;
+}
+
+void Tile::RasterizeModel(const Model& model, const math::Matrix& transform,
+                          std::uint8_t areaFlags)
+{
+    // transform the model into world space, then into recast space
+    auto const& vertices = model.m_aabbTree.Vertices();
+    auto const& indices = model.m_aabbTree.Indices();
+
+    if (vertices.empty() || indices.empty())
+        return;
+
+    std::vector<float> recastVertices(vertices.size() * 3);
+
+    for (auto i = 0u; i < vertices.size(); ++i)
+        math::Convert::VertexToRecast(
+            math::Vector3::Transform(vertices[i], transform),
+            &recastVertices[i * 3]);
+
+    std::vector<unsigned char> areas(indices.size() / 3, areaFlags);
+
+    LogContext ctx(rcLogCategory::RC_LOG_ERROR);
+
+    // as when building the map, wmo surfaces are walkable whatever their
+    // slope
+    if (!(areaFlags & PolyFlags::Wmo))
+        rcClearUnwalkableTriangles(
+            &ctx, MeshSettings::WalkableSlope, &recastVertices[0],
+            static_cast<int>(recastVertices.size() / 3), &indices[0],
+            static_cast<int>(indices.size() / 3), &areas[0]);
+
+    rcRasterizeTriangles(&ctx, &recastVertices[0],
+                         static_cast<int>(recastVertices.size() / 3),
+                         &indices[0], &areas[0],
+                         static_cast<int>(indices.size() / 3), m_heightField);
+}
+
+void Tile::RasterizeDoodad(const DoodadInstance& doodad)
+{
+    RasterizeModel(*doodad.m_model.lock(), doodad.m_transformMatrix, 0);
+}
+
+void Tile::RasterizeWmo(const WmoInstance& wmo)
+{
+    auto const model = wmo.m_model.lock();
+
+    RasterizeModel(*model, wmo.m_transformMatrix, PolyFlags::Wmo);
+
+    if (wmo.m_doodadSet >= model->m_doodadSets.size())
+        return;
+
+    // the doodads of the set are placed relative to the wmo, and are
+    // obstacles like any other temporary doodad
+    for (auto const& doodad : model->m_doodadSets[wmo.m_doodadSet])
+        RasterizeModel(*doodad.m_model.lock(),
+                       wmo.m_transformMatrix * doodad.m_transformMatrix, 0);
+}
+
+void Tile::CopyHeightField(rcHeightfield& out)
+{
+    EnsureHeightField();
+
+    LogContext ctx(rcLogCategory::RC_LOG_ERROR);
+
+    rcCreateHeightfield(&ctx, out, m_heightField.width, m_heightField.height,
+                        m_heightField.bmin, m_heightField.bmax,
+                        m_heightField.cs, m_heightField.ch);
+
+    // spans within a column never overlap, so none of these are merged
+    for (auto y = 0; y < m_heightField.height; ++y)
+        for (auto x = 0; x < m_heightField.width; ++x)
+            for (auto s = m_heightField.spans[y * m_heightField.width + x]; s;
+                 s = s->next)
+                rcAddSpan(&ctx, out, x, y, s->smin, s->smax, s->area, 0);
+}
+
+void Tile::BuildMesh(std::vector<std::uint8_t>& tileData)
+{
+    utility::Trace::Scope trace("Tile::BuildMesh", "obstacle", m_x, m_y);
+
+    EnsureHeightField();
+    BuildMesh(m_map->GetAgentProfile(), m_map->GetRegionPartition(), m_x,
+              m_y, m_heightField, m_offMeshConnections, tileData);
+}
+
+void Tile::BuildMesh(const AgentProfile& agent, RegionPartition partition,
+                     int tileX, int tileY, rcHeightfield& heightField,
+                     const std::vector<OffMeshConnection>& offMeshConnections,
+                     std::vector<std::uint8_t>& tileData)
+{
+    LogContext ctx(rcLogCategory::RC_LOG_ERROR);
+
+    FilterWalkableSpans(ctx, agent.VoxelWalkableHeight(),
+                        agent.VoxelWalkableClimb(), heightField);
 
     rcConfig config;
 
-    InitializeRecastConfig(config);
+    InitializeRecastConfig(config, agent);
+
+    // when the map was built for several agents, the height field has the
+    // border of the widest of them
+    config.borderSize = (heightField.width - config.tileSize) / 2;
+    config.width = config.height = heightField.width;
 
     // build the mesh into a secondary buffer, rather than overwriting the
     // previous tile, so that we can delay the old tile's removal
-    std::vector<std::uint8_t> newTileData;
     auto const buildResult =
-        RebuildMeshTile(ctx, config, m_x, m_y, m_heightField, newTileData);
+        RebuildMeshTile(ctx, config, agent, partition, tileX, tileY,
+                        heightField, offMeshConnections, tileData);
     assert(buildResult);
+}
+
+void Tile::ReplaceMesh(std::vector<std::uint8_t>& tileData)
+{
+    // detour still refers to the previous mesh until AddMesh() removes it,
+    // so it is only freed on return
+    auto previous = std::move(m_tileData);
+
+    m_tileData = std::move(tileData);
+    AddMesh(m_tileData.data(), m_tileData.size());
+}
+
+void Tile::RestoreMesh()
+{
+    FreeHeightField();
+
+    AddMesh(m_meshData, m_meshSize);
+
+    m_tileData.clear();
+    m_tileData.shrink_to_fit();
+}
+
+void Tile::AddMesh(std::uint8_t* data, size_t size)
+{
+    m_map->m_reachability.Invalidate();
+
+    // the map is held exclusively, so no query is using these
+    m_polyZoneAreas.clear();
 
     if (m_ref)
     {
+        // the tile keeps its reference when it is added again, so cached
+        // corridors through it would otherwise still appear valid
+        m_map->m_pathCache.InvalidateTile(
+            m_map->m_navMesh.decodePolyIdTile(m_ref));
+
         auto const removeResult =
             m_map->m_navMesh.removeTile(m_ref, nullptr, nullptr);
         assert(removeResult == DT_SUCCESS);
     }
 
-    m_tileData = std::move(newTileData);
+    // a tile may have had no mesh to begin with
+    if (!size)
+    {
+        m_ref = 0;
+        return;
+    }
 
     auto const insertResult = m_map->m_navMesh.addTile(
-        &m_tileData[0], static_cast<int>(m_tileData.size()), 0, m_ref, &m_ref);
+        data, static_cast<int>(size), 0, m_ref, &m_ref);
 
     assert(insertResult == DT_SUCCESS);
+
+    // the reference is unchanged, so this is what marks the mesh as new
+    m_map->m_tileGenerations[m_map->m_navMesh.decodePolyIdTile(m_ref)] =
+        ++m_map->m_meshGeneration;
 }
 } // namespace pathfind
@@ -6,20 +6,60 @@
 #include "recastnavigation/Detour/Include/DetourNavMesh.h"
 #include "recastnavigation/Recast/Include/Recast.h"
 #include "recastnavigation/Recast/Include/RecastAlloc.h"
-#include "utility/BinaryStream.hpp"
 #include "utility/Exception.hpp"
+#include "utility/MappedFile.hpp"
 #include "utility/MathHelper.hpp"
 
 #include <cassert>
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
+#include <limits>
+#include <stdexcept>
 #include <vector>
 
+namespace
+{
+// the length in bytes of the spans of a serialized height field of the given
+// number of columns, from the read position of the stream on, and the number
+// of spans.  each column is its span count followed by three words for each
+// span.  this is the only pass over them which checks the end of the mapping
+size_t MeasureSpans(utility::MappedStream& in, int columns, size_t& spanCount)
+{
+    auto const start = in.rpos();
+    auto const remaining = in.Remaining();
+    auto cursor = in.ReadCursor(remaining);
+    in.rpos(start);
+
+    spanCount = 0;
+
+    for (auto i = 0; i < columns; ++i)
+    {
+        if (cursor.Remaining() < sizeof(std::uint32_t))
+            throw std::domain_error("Read past end of buffer");
+
+        auto const columnSize = cursor.Read<std::uint32_t>();
+        auto const length =
+            3 * sizeof(std::uint32_t) * static_cast<size_t>(columnSize);
+
+        if (cursor.Remaining() < length)
+            throw std::domain_error("Read past end of buffer");
+
+        cursor.Skip(length);
+        spanCount += columnSize;
+    }
+
+    return remaining - cursor.Remaining();
+}
+} // anonymous namespace
+
 namespace pathfind
 {
-Tile::Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
+Tile::Tile(Map* map, utility::MappedStream& in, std::uint32_t fileFlags,
            bool load_heightfield)
-    : m_map(map), m_navPath(navPath), m_ref(0), m_x(in.Read<std::uint32_t>()),
-      m_y(in.Read<std::uint32_t>()), m_areaId(0)
+    : m_map(map), m_navFile(in.file()), m_heightFieldTracked(false), m_ref(0),
+      m_x(in.Read<std::uint32_t>()),
+      m_y(in.Read<std::uint32_t>()), m_areaId(0), m_hasQuadHeights(false)
 {
     std::uint32_t wmoCount;
     in >> wmoCount;
@@ -29,10 +69,6 @@ Tile::Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
         m_staticWmos.resize(wmoCount);
         in.ReadBytes(&m_staticWmos[0],
                      m_staticWmos.size() * sizeof(std::uint32_t));
-
-        for (auto const wmo : m_staticWmos)
-            m_staticWmoModels.push_back(
-                std::move(map->LoadModelForWmoInstance(wmo)));
     }
 
     // for global WMOs, doodads are not referenced or loaded on a per-tile
@@ -45,10 +81,6 @@ Tile::Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
         m_staticDoodads.resize(doodadCount);
         in.ReadBytes(&m_staticDoodads[0],
                      m_staticDoodads.size() * sizeof(std::uint32_t));
-
-        for (auto const doodad : m_staticDoodads)
-            m_staticDoodadModels.push_back(
-                std::move(map->LoadModelForDoodadInstance(doodad)));
     }
 
     std::uint8_t quadHeight;
@@ -64,14 +96,43 @@ Tile::Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
         in >> m_areaId;
 
         in.ReadBytes(&m_quadHoles, sizeof(m_quadHoles));
-        m_quadHeights.resize(MeshSettings::QuadValuesPerTile);
-        in.ReadBytes(&m_quadHeights[0], sizeof(float) * m_quadHeights.size());
+
+        float heights[MeshSettings::QuadValuesPerTile];
+        in.ReadBytes(heights, sizeof(heights));
+
+        auto minHeight = heights[0];
+        auto maxHeight = heights[0];
+        for (auto const h : heights)
+        {
+            minHeight = (std::min)(minHeight, h);
+            maxHeight = (std::max)(maxHeight, h);
+        }
+
+        constexpr float steps = (std::numeric_limits<std::uint16_t>::max)();
+
+        m_hasQuadHeights = true;
+        m_quadHeightBase = minHeight;
+        m_quadHeightScale =
+            maxHeight > minHeight ? (maxHeight - minHeight) / steps : 1.f;
+
+        for (auto i = 0; i < MeshSettings::QuadValuesPerTile; ++i)
+            m_quadHeights[i] = static_cast<std::uint16_t>(
+                (heights[i] - minHeight) / m_quadHeightScale + 0.5f);
     }
 
     // read height field
     in >> m_heightField.width >> m_heightField.height >> m_heightField.bmin >>
         m_heightField.bmax >> m_heightField.cs >> m_heightField.ch;
 
+    // older files do not store the length of the spans, which must then be
+    // measured to skip them
+    std::uint32_t spansLength = 0;
+    auto const hasSpansLength =
+        !!(fileFlags & MeshSettings::NavFileSpanLengths);
+
+    if (hasSpansLength)
+        in >> spansLength;
+
     // for now, width and height must always be equal.  this check is here as a
     // way to make sure we are reading the file correctly so far
     assert(m_heightField.width == m_heightField.height);
@@ -88,19 +149,24 @@ Tile::Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
     m_bounds.MaxCorner.Z = (std::max)(a.Z, b.Z);
 
     m_heightFieldSpanStart = in.rpos();
+    m_hasHeightField = !(fileFlags & MeshSettings::NavFileOmittedSpans) ||
+                       spansLength > 0;
 
-    if (load_heightfield)
+    if (load_heightfield && m_hasHeightField)
         LoadHeightField(in);
     else
     {
         m_heightField.spans = nullptr;
 
-        for (auto i = 0; i < m_heightField.width * m_heightField.height; ++i)
+        // reading the spans in place skips them, checking only their end
+        if (hasSpansLength)
+            in.ReadInPlace(spansLength);
+        else
         {
-            std::uint32_t columnSize;
-            in >> columnSize;
-
-            in.rpos(in.rpos() + 3 * columnSize * sizeof(std::uint32_t));
+            size_t spanCount;
+            in.rpos(in.rpos() +
+                    MeasureSpans(in, m_heightField.width * m_heightField.height,
+                                 spanCount));
         }
     }
 
@@ -108,73 +174,497 @@ Tile::Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
     std::uint32_t meshSize;
     in >> meshSize;
 
-    if (meshSize > 0)
+    // the mesh is padded to an aligned offset within the file
+    in.rpos((in.rpos() + MeshSettings::TileDataAlignment - 1) &
+            ~static_cast<size_t>(MeshSettings::TileDataAlignment - 1));
+
+    m_meshSize = meshSize;
+    m_meshData = meshSize > 0 ? in.ReadInPlace(meshSize) : nullptr;
+
+    if (m_hasQuadHeights && (fileFlags & MeshSettings::NavFileWmoFloors))
+    {
+        m_wmoFloors.resize(MeshSettings::WmoFloorCells *
+                           MeshSettings::WmoFloorCells);
+        in.ReadBytes(&m_wmoFloors[0], sizeof(float) * m_wmoFloors.size());
+    }
+
+    if (m_hasQuadHeights && (fileFlags & MeshSettings::NavFileSurfaces))
+    {
+        std::uint32_t surfaceCount;
+        in >> surfaceCount;
+
+        if (surfaceCount > 0)
+        {
+            m_surfaceStarts.resize(
+                m_heightField.width * m_heightField.height + 1);
+            in.ReadBytes(&m_surfaceStarts[0],
+                         sizeof(std::uint32_t) * m_surfaceStarts.size());
+
+            m_surfaces.resize(surfaceCount);
+            in.ReadBytes(&m_surfaces[0],
+                         sizeof(std::uint16_t) * m_surfaces.size());
+        }
+    }
+
+    if (m_hasQuadHeights && (fileFlags & MeshSettings::NavFileAgentMeshes))
+    {
+        std::uint32_t agentMeshCount;
+        in >> agentMeshCount;
+
+        m_agentMeshes.resize(agentMeshCount);
+
+        for (auto& mesh : m_agentMeshes)
+        {
+            std::uint32_t agent, size;
+            in >> agent >> size;
+
+            if (agent >= AgentProfileCount)
+                THROW(Result::UNKNOWN_AGENT_SIZE);
+
+            in.rpos((in.rpos() + MeshSettings::TileDataAlignment - 1) &
+                    ~static_cast<size_t>(MeshSettings::TileDataAlignment - 1));
+
+            mesh.m_agent = static_cast<AgentSize>(agent);
+            mesh.m_size = size;
+            mesh.m_data = size > 0 ? in.ReadInPlace(size) : nullptr;
+            mesh.m_ref = 0;
+        }
+    }
+
+    if (m_hasQuadHeights && (fileFlags & MeshSettings::NavFileLiquids))
+    {
+        std::uint32_t liquidCount;
+        in >> liquidCount;
+
+        if (liquidCount > 0)
+        {
+            m_liquidStarts.resize(
+                MeshSettings::LiquidCells * MeshSettings::LiquidCells + 1);
+            in.ReadBytes(&m_liquidStarts[0],
+                         sizeof(std::uint32_t) * m_liquidStarts.size());
+
+            m_liquidHeights.resize(liquidCount);
+            in.ReadBytes(&m_liquidHeights[0],
+                         sizeof(float) * m_liquidHeights.size());
+
+            m_liquidTypes.resize(liquidCount);
+            in.ReadBytes(&m_liquidTypes[0],
+                         sizeof(LiquidType) * m_liquidTypes.size());
+        }
+    }
+}
+
+bool Tile::FindSurfaces(float x, float y, std::vector<float>& output) const
+{
+    if (m_surfaces.empty())
+        return false;
+
+    // recast space is y up, so the columns are indexed by -y and -x
+    auto const column = [this](float coordinate, float origin, int size)
+    {
+        auto const i =
+            static_cast<int>((coordinate - origin) / m_heightField.cs);
+        return (std::max)(0, (std::min)(size - 1, i));
+    };
+
+    auto const cx = column(-y, m_heightField.bmin[0], m_heightField.width);
+    auto const cz = column(-x, m_heightField.bmin[2], m_heightField.height);
+    auto const i = cx + cz * m_heightField.width;
+
+    for (auto s = m_surfaceStarts[i]; s < m_surfaceStarts[i + 1]; ++s)
+        output.push_back(m_heightField.bmin[1] +
+                         m_heightField.ch * m_surfaces[s]);
+
+    return true;
+}
+
+bool Tile::FindLiquid(const math::Vertex& position, float& level,
+                      LiquidType& type) const
+{
+    if (m_liquidHeights.empty())
+        return false;
+
+    constexpr auto cells = MeshSettings::LiquidCells;
+    constexpr auto cellSize = MeshSettings::TileSize / cells;
+
+    // as the builder found them, in recast space from the corner of the tile
+    auto const cell = [](float coordinate, int tile)
+    {
+        auto const origin =
+            tile * MeshSettings::TileSize - 32.f * MeshSettings::AdtSize;
+        auto const i = static_cast<int>((coordinate - origin) / cellSize);
+        return (std::max)(0, (std::min)(cells - 1, i));
+    };
+
+    auto const i = cell(-position.Y, m_x) + cell(-position.X, m_y) * cells;
+
+    auto const first = m_liquidStarts[i];
+    auto const last = m_liquidStarts[i + 1];
+
+    if (first == last)
+        return false;
+
+    // the surfaces are highest first, so this stops at the lowest above the
+    // position, or at the first when all of them are below it
+    auto s = first;
+    while (s + 1 < last && m_liquidHeights[s + 1] >= position.Z)
+        ++s;
+
+    level = m_liquidHeights[s];
+    type = m_liquidTypes[s];
+
+    return true;
+}
+
+Tile::MemoryUsage&
+Tile::MemoryUsage::operator+=(const Tile::MemoryUsage& other)
+{
+    m_tileData += other.m_tileData;
+    m_heightField += other.m_heightField;
+    m_quadHeights += other.m_quadHeights;
+    m_surfaces += other.m_surfaces;
+    m_staticInstances += other.m_staticInstances;
+
+    return *this;
+}
+
+size_t Tile::MemoryUsage::Total() const
+{
+    return m_tileData + m_heightField + m_quadHeights + m_surfaces +
+           m_staticInstances;
+}
+
+Tile::MemoryUsage Tile::GetMemoryUsage() const
+{
+    MemoryUsage result;
+
+    result.m_tileData = m_tileData.capacity() +
+                        sizeof(AgentMesh) * m_agentMeshes.capacity();
+
+    result.m_heightField = sizeof(rcSpan) * m_heightFieldSpans.capacity();
+
+    if (m_heightField.spans)
+        result.m_heightField += sizeof(rcSpan*) * m_heightField.width *
+                                m_heightField.height;
+
+    for (auto pool = m_heightField.pools; pool; pool = pool->next)
+        result.m_heightField += sizeof(rcSpanPool);
+
+    result.m_quadHeights = m_hasQuadHeights ? sizeof(m_quadHeights) : 0;
+
+    result.m_surfaces = sizeof(float) * m_wmoFloors.capacity() +
+                        sizeof(std::uint32_t) * m_surfaceStarts.capacity() +
+                        sizeof(std::uint16_t) * m_surfaces.capacity() +
+                        sizeof(std::uint32_t) * m_liquidStarts.capacity() +
+                        sizeof(float) * m_liquidHeights.capacity() +
+                        sizeof(LiquidType) * m_liquidTypes.capacity();
+
+    result.m_staticInstances =
+        sizeof(std::uint32_t) *
+            (m_staticWmos.capacity() + m_staticDoodads.capacity()) +
+        sizeof(std::shared_ptr<WmoModel>) * m_staticWmoModels.capacity() +
+        sizeof(std::shared_ptr<DoodadModel>) *
+            m_staticDoodadModels.capacity() +
+        m_staticWmoTree.MemoryUsage() + m_staticDoodadTree.MemoryUsage();
+
+    return result;
+}
+
+bool Tile::BelowStaticWmos(const math::Vertex& position) const
+{
+    if (m_staticWmos.empty())
+        return true;
+
+    if (m_wmoFloors.empty())
+        return false;
+
+    float northwestX, northwestY;
+    math::Convert::TileToWorldNorthwestCorner(m_x, m_y, northwestX,
+                                              northwestY);
+
+    auto constexpr cells = MeshSettings::WmoFloorCells;
+    auto constexpr cellSize = MeshSettings::TileSize / cells;
+
+    // the cells are indexed across as the quads are, see Map::GetADTHeight()
+    auto const cellX = (std::min)(
+        cells - 1, static_cast<int>((northwestY - position.Y) / cellSize));
+    auto const cellY = (std::min)(
+        cells - 1, static_cast<int>((northwestX - position.X) / cellSize));
+
+    return position.Z < m_wmoFloors[cells * cellX + cellY];
+}
+
+void Tile::LoadModels()
+{
+    ModelCache cache;
+    LoadModels(cache);
+}
+
+void Tile::LoadModels(ModelCache& cache)
+{
+    m_staticWmoModels.reserve(m_staticWmos.size());
+    for (auto const wmo : m_staticWmos)
+    {
+        auto& model = cache.m_wmos[wmo];
+
+        if (!model)
+        {
+            auto const instance = m_map->FindStaticWmo(wmo);
+
+            // ensure it exists.  this should never fail
+            if (!instance)
+                THROW(Result::UNKNOWN_WMO_INSTANCE_REQUESTED);
+
+            auto& fileModel = cache.m_wmoFiles[instance->m_modelFilename];
+
+            if (!fileModel)
+                fileModel = m_map->m_models->EnsureWmoModelLoaded(
+                    *instance->m_modelFilename);
+
+            model = fileModel;
+        }
+
+        m_staticWmoModels.push_back(model);
+    }
+
+    m_staticDoodadModels.reserve(m_staticDoodads.size());
+    for (auto const doodad : m_staticDoodads)
+    {
+        auto& model = cache.m_doodads[doodad];
+
+        if (!model)
+        {
+            auto const instance = m_map->FindStaticDoodad(doodad);
+
+            // ensure it exists.  this should never fail
+            if (!instance)
+                THROW(Result::UNKNOWN_DOODAD_INSTANCE_REQUESTED);
+
+            auto& fileModel = cache.m_doodadFiles[instance->m_modelFilename];
+
+            if (!fileModel)
+                fileModel = m_map->m_models->EnsureDoodadModelLoaded(
+                    *instance->m_modelFilename);
+
+            model = fileModel;
+        }
+
+        m_staticDoodadModels.push_back(model);
+    }
+}
+
+void Tile::AddToMap()
+{
+    // queries read the model of an instance through this weak pointer, which
+    // is why it is only assigned here, rather than in LoadModels()
+    std::vector<StaticInstance> instances;
+    instances.reserve(m_staticWmos.size());
+
+    for (auto i = 0u; i < m_staticWmos.size(); ++i)
     {
-        m_tileData.resize(meshSize);
-        in.ReadBytes(&m_tileData[0], m_tileData.size());
+        auto& instance = *m_map->FindStaticWmo(m_staticWmos[i]);
+        instance.m_model = m_staticWmoModels[i];
 
+        auto const model = m_staticWmoModels[i].get();
+        instances.push_back({instance.m_bounds,
+                             instance.m_inverseTransformMatrix, model, model,
+                             instance.m_nameSet, instance.m_index});
+    }
+
+    m_staticWmoTree.Build(std::move(instances));
+
+    instances.clear();
+    instances.reserve(m_staticDoodads.size());
+
+    for (auto i = 0u; i < m_staticDoodads.size(); ++i)
+    {
+        auto& instance = *m_map->FindStaticDoodad(m_staticDoodads[i]);
+        instance.m_model = m_staticDoodadModels[i];
+
+        instances.push_back({instance.m_bounds,
+                             instance.m_inverseTransformMatrix,
+                             m_staticDoodadModels[i].get(), nullptr, 0,
+                             instance.m_index});
+    }
+
+    m_staticDoodadTree.Build(std::move(instances));
+
+    if (m_meshSize > 0)
+    {
+        // detour does not own this data, nor free it when the tile is removed
         auto const result = m_map->m_navMesh.addTile(
-            &m_tileData[0], static_cast<int>(m_tileData.size()), 0, 0, &m_ref);
+            m_meshData, static_cast<int>(m_meshSize), 0, 0, &m_ref);
+        assert(result == DT_SUCCESS);
+
+        m_map->m_reachability.Invalidate();
+
+        // these are kept so that they survive the tile being rebuilt
+        auto const tile = m_map->m_navMesh.getTileByRef(m_ref);
+
+        for (auto i = 0; i < tile->header->offMeshConCount; ++i)
+        {
+            auto const& con = tile->offMeshCons[i];
+
+            math::Vertex start, end;
+            math::Convert::VertexToWow(&con.pos[0], start);
+            math::Convert::VertexToWow(&con.pos[3], end);
+
+            m_offMeshConnections.push_back(
+                {{start.X, start.Y, start.Z},
+                 {end.X, end.Y, end.Z},
+                 con.rad,
+                 !!(con.flags & DT_OFFMESH_CON_BIDIR),
+                 con.userId});
+        }
+    }
+
+    for (auto& mesh : m_agentMeshes)
+    {
+        if (!mesh.m_size)
+            continue;
+
+        auto const result = m_map->AgentNavMesh(mesh.m_agent)
+                                .addTile(mesh.m_data,
+                                         static_cast<int>(mesh.m_size), 0, 0,
+                                         &mesh.m_ref);
         assert(result == DT_SUCCESS);
     }
 }
 
 Tile::~Tile()
 {
+    Detach();
+    FreeHeightField();
+}
+
+void Tile::Detach()
+{
+    // a tile without a mesh may still hold models
+    m_map->m_lineOfSightCache.InvalidateTile(m_x, m_y);
+
     if (!!m_ref)
     {
+        m_map->m_pathCache.InvalidateTile(
+            m_map->m_navMesh.decodePolyIdTile(m_ref));
+
         auto const result =
             m_map->m_navMesh.removeTile(m_ref, nullptr, nullptr);
         assert(result == DT_SUCCESS);
+
+        m_map->m_reachability.Invalidate();
+        m_ref = 0;
     }
 
-    if (!!m_heightField.spans)
-        for (auto i = 0; i < m_heightField.width * m_heightField.height; ++i)
-            rcFree(m_heightField.spans[i]);
+    for (auto& mesh : m_agentMeshes)
+        if (!!mesh.m_ref)
+        {
+            auto const result = m_map->AgentNavMesh(mesh.m_agent)
+                                    .removeTile(mesh.m_ref, nullptr, nullptr);
+            assert(result == DT_SUCCESS);
+            mesh.m_ref = 0;
+        }
+
+    // the height field itself is freed with the tile
+    if (m_heightFieldTracked)
+    {
+        m_map->m_heightFieldTiles.erase(this);
+        m_heightFieldTracked = false;
+    }
 }
 
 void Tile::LoadHeightField()
 {
-    utility::BinaryStream in(m_navPath);
-    in.rpos(m_heightFieldSpanStart);
+    utility::MappedStream in(m_navFile, m_heightFieldSpanStart);
     LoadHeightField(in);
 }
 
-void Tile::LoadHeightField(utility::BinaryStream& in)
+void Tile::LoadHeightField(utility::MappedStream& in)
 {
     assert(!m_heightField.spans);
 
+    auto const columns = m_heightField.width * m_heightField.height;
+
+    // count the spans first, so that they can all be stored in one block.
+    // the decoding below need then not check each read
+    size_t spanCount;
+    auto cursor = in.ReadCursor(MeasureSpans(in, columns, spanCount));
+
+    m_heightFieldSpans.resize(spanCount);
     m_heightField.spans = reinterpret_cast<rcSpan**>(
-        rcAlloc(m_heightField.width * m_heightField.height * sizeof(rcSpan*),
-                RC_ALLOC_PERM));
+        rcAlloc(columns * sizeof(rcSpan*), RC_ALLOC_PERM));
 
-    for (auto i = 0; i < m_heightField.width * m_heightField.height; ++i)
+    auto span = m_heightFieldSpans.data();
+
+    for (auto i = 0; i < columns; ++i)
     {
-        std::uint32_t columnSize;
-        in >> columnSize;
+        auto const columnSize = cursor.Read<std::uint32_t>();
+
+        m_heightField.spans[i] = columnSize ? span : nullptr;
 
-        if (!columnSize)
+        for (auto s = 0u; s < columnSize; ++s, ++span)
         {
-            m_heightField.spans[i] = nullptr;
-            continue;
+            auto const smin = cursor.Read<std::uint32_t>();
+            auto const smax = cursor.Read<std::uint32_t>();
+            auto const area = cursor.Read<std::uint32_t>();
+
+            span->smin = smin;
+            span->smax = smax;
+            span->area = area;
+            span->next = s + 1 < columnSize ? span + 1 : nullptr;
         }
+    }
+}
+
+void Tile::EnsureHeightField()
+{
+    m_heightFieldLastUsed = std::chrono::steady_clock::now();
 
-        m_heightField.spans[i] = reinterpret_cast<rcSpan*>(
-            rcAlloc(columnSize * sizeof(rcSpan), RC_ALLOC_PERM));
+    if (m_heightField.spans)
+        return;
 
-        for (auto s = 0u; s < columnSize; ++s)
-        {
-            std::uint32_t smin, smax, area;
-            in >> smin >> smax >> area;
+    LoadHeightField();
 
-            m_heightField.spans[i][s].smin = smin;
-            m_heightField.spans[i][s].smax = smax;
-            m_heightField.spans[i][s].area = area;
-            m_heightField.spans[i][s].next = nullptr;
+    for (auto const& wmo : m_temporaryWmos)
+        RasterizeWmo(*wmo.second);
+    for (auto const& doodad : m_temporaryDoodads)
+        RasterizeDoodad(*doodad.second);
 
-            if (s > 0)
-                m_heightField.spans[i][s - 1].next = &m_heightField.spans[i][s];
-        }
+    m_map->m_heightFieldTiles.insert(this);
+    m_heightFieldTracked = true;
+}
+
+bool Tile::ReleaseHeightFieldIfIdle(
+    std::chrono::steady_clock::time_point since)
+{
+    if (!m_heightField.spans || m_heightFieldLastUsed > since)
+        return false;
+
+    FreeHeightField();
+    return true;
+}
+
+void Tile::FreeHeightField()
+{
+    if (m_heightFieldTracked)
+    {
+        m_map->m_heightFieldTiles.erase(this);
+        m_heightFieldTracked = false;
     }
+
+    rcFree(m_heightField.spans);
+    m_heightField.spans = nullptr;
+
+    // spans added by rasterizing obstacles come from these pools
+    while (m_heightField.pools)
+    {
+        auto const next = m_heightField.pools->next;
+        rcFree(m_heightField.pools);
+        m_heightField.pools = next;
+    }
+
+    m_heightField.freelist = nullptr;
+
+    m_heightFieldSpans.clear();
+    m_heightFieldSpans.shrink_to_fit();
 }
 } // namespace pathfind
@@ -1,17 +1,22 @@
 #pragma once
 
 #include "Common.hpp"
+#include "InstanceTree.hpp"
 #include "Model.hpp"
 #include "recastnavigation/Detour/Include/DetourNavMesh.h"
 #include "recastnavigation/Recast/Include/Recast.h"
-#include "utility/BinaryStream.hpp"
 #include "utility/BoundingBox.hpp"
+#include "utility/MappedFile.hpp"
 #include "utility/Ray.hpp"
 
+#include <chrono>
 #include <cstdint>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -24,26 +29,176 @@ class Tile
 {
 private:
     Map* const m_map;
-    const fs::path m_navPath;
 
+    // the mapped nav file this tile was read from.  until the tile is rebuilt
+    // with temporary obstacles, detour uses the mesh directly from it
+    const std::shared_ptr<utility::MappedFile> m_navFile;
+
+    // the original mesh, within the mapped file
+    std::uint8_t* m_meshData;
+    size_t m_meshSize;
+
+    // only used once the tile has been rebuilt
     std::vector<std::uint8_t> m_tileData;
 
-    // store this for possible delayed load of the data
+    // the meshes for agents of other sizes, built by the builder from the
+    // same height field (see MeshSettings::NavFileAgentMeshes), each added
+    // to the navmesh of its agent within the map.  these are never rebuilt,
+    // so temporary obstacles do not change them
+    struct AgentMesh
+    {
+        AgentSize m_agent;
+        std::uint8_t* m_data;
+        size_t m_size;
+        dtTileRef m_ref;
+    };
+
+    std::vector<AgentMesh> m_agentMeshes;
+
+    // store this for possible delayed load of the data.  the spans within
+    // the mapped file are also the pristine height field, from which it is
+    // restored whenever an obstacle is removed
     size_t m_heightFieldSpanStart;
+    bool m_hasHeightField;
     rcHeightfield m_heightField;
 
-    void LoadHeightField(utility::BinaryStream& in);
+    // the spans read from the file.  those added by rasterizing obstacles are
+    // allocated by recast from the pools of m_heightField
+    std::vector<rcSpan> m_heightFieldSpans;
+
+    // when the height field was last needed for an obstacle, and whether the
+    // map is tracking it as loaded (see Map::ReleaseIdleHeightFields())
+    std::chrono::steady_clock::time_point m_heightFieldLastUsed;
+    bool m_heightFieldTracked;
+
+    void LoadHeightField(utility::MappedStream& in);
     void LoadHeightField();
+    void FreeHeightField();
+
+    // decodes the height field from the mapped file if it has been released,
+    // and rasterizes the current obstacles into it.  recast can only
+    // rasterize into a full rcHeightfield, so the mapped spans are the
+    // compact form of the height field, and need not be copied
+    void EnsureHeightField();
+
+    void RasterizeModel(const Model& model, const math::Matrix& transform,
+                        std::uint8_t areaFlags);
+    void RasterizeDoodad(const DoodadInstance& doodad);
+    void RasterizeWmo(const WmoInstance& wmo);
+
+    // replaces the mesh of this tile within the navmesh
+    void AddMesh(std::uint8_t* data, size_t size);
 
 public:
     // the height field should only be loaded for tiles that will have temporary
     // obstacles inserted frequently
-    Tile(Map* map, utility::BinaryStream& in, const fs::path& navPath,
+    //
+    // a tile is loaded in three steps.  the constructor only parses the tile,
+    // and LoadModels() loads the models it references.  neither requires
+    // exclusive access to the map, and both may run on a background thread.
+    // AddToMap() then adds the tile to the navmesh, and does require it.
+    // fileFlags are the NavFileFlags of the file which in reads
+    Tile(Map* map, utility::MappedStream& in, std::uint32_t fileFlags,
          bool load_heightfield = false);
     ~Tile();
 
-    void AddTemporaryDoodad(std::uint64_t guid,
-                            std::shared_ptr<DoodadInstance> doodad);
+    // removes the tile from the navmeshes and everything else of the map
+    // which refers to it, so that it may then be destroyed without the map,
+    // on any thread.  the caller must hold the map mutex exclusively
+    void Detach();
+
+    // the models loaded for the tiles of one ADT, which share many of their
+    // instances and models, by instance id and by interned filename.  each is
+    // looked up and loaded once for the whole ADT, rather than once per tile
+    struct ModelCache
+    {
+        std::unordered_map<std::uint32_t, std::shared_ptr<WmoModel>> m_wmos;
+        std::unordered_map<std::uint32_t, std::shared_ptr<DoodadModel>>
+            m_doodads;
+        std::unordered_map<const std::string*, std::shared_ptr<WmoModel>>
+            m_wmoFiles;
+        std::unordered_map<const std::string*, std::shared_ptr<DoodadModel>>
+            m_doodadFiles;
+    };
+
+    void LoadModels();
+    void LoadModels(ModelCache& cache);
+    void AddToMap();
+
+    // adding an obstacle takes three steps, so that a batch of obstacles can
+    // share one rebuild, and the rebuild may happen in the background (see
+    // Map::RebuildTile()).  BuildMesh() reads and writes only the given
+    // height field, so different tiles may be built concurrently, whereas
+    // ReplaceMesh() modifies the navmesh and requires exclusive access to
+    // the map
+    void RasterizeTemporaryDoodad(std::uint64_t guid,
+                                  std::shared_ptr<DoodadInstance> doodad);
+    void RasterizeTemporaryWmo(std::uint64_t guid,
+                               std::shared_ptr<WmoInstance> wmo);
+    void BuildMesh(std::vector<std::uint8_t>& tileData);
+    static void
+    BuildMesh(const AgentProfile& agent, RegionPartition partition, int tileX,
+              int tileY, rcHeightfield& heightField,
+              const std::vector<OffMeshConnection>& offMeshConnections,
+              std::vector<std::uint8_t>& tileData);
+    void ReplaceMesh(std::vector<std::uint8_t>& tileData);
+
+    // copies the height field into one created by rcAllocHeightfield()
+    void CopyHeightField(rcHeightfield& out);
+
+    // releases the height field if it has not been needed since the given
+    // time, returning whether it was.  it is decoded again when next needed
+    bool ReleaseHeightFieldIfIdle(std::chrono::steady_clock::time_point since);
+
+    // restores the height field from the mapped file and rasterizes every
+    // remaining obstacle into it again.  the mesh is left as it is.  returns
+    // false if the tile does not have the obstacle
+    bool RemoveTemporaryObstacle(std::uint64_t guid);
+
+    // once the last obstacle is gone, the tile goes back to the mesh from the
+    // file, without building anything, and the height field is released
+    void RestoreMesh();
+
+    // changed by the map whenever the obstacles of the tile change, so that
+    // out of date background rebuilds can be recognised
+    std::uint64_t m_obstacleVersion = 0;
+
+    // whether the file has the height field of the tile, without which it
+    // cannot be rebuilt (see MeshSettings::NavFileOmittedSpans)
+    bool HasHeightField() const { return m_hasHeightField; }
+
+    bool HasTemporaryObstacles() const
+    {
+        return !m_temporaryDoodads.empty() || !m_temporaryWmos.empty();
+    }
+
+    // whether the terrain is all there is on the tile, as on most of the open
+    // world, so that the only height at any (x, y) is that of the ADT and no
+    // ray need be cast.  the file lists every static instance reaching the
+    // tile, so this needs nothing more from the builder
+    bool TerrainOnly() const
+    {
+        return m_hasQuadHeights && m_staticWmos.empty() &&
+               m_staticDoodads.empty() && !HasTemporaryObstacles();
+    }
+
+    // whether the mesh must be built rather than taken from the file, because
+    // of obstacles or off-mesh connections added since it was loaded
+    bool HasRuntimeChanges() const
+    {
+        if (HasTemporaryObstacles())
+            return true;
+
+        for (auto const& connection : m_offMeshConnections)
+            if (connection.m_id != 0)
+                return true;
+
+        return false;
+    }
+
+    // the off-mesh connections starting within this tile.  those in the file
+    // are read from its mesh by AddToMap(), and the rest are added by the map
+    std::vector<OffMeshConnection> m_offMeshConnections;
 
     dtTileRef m_ref;
 
@@ -57,7 +212,82 @@ public:
 
     std::uint8_t m_quadHoles[8 / MeshSettings::TilesPerChunk]
                             [8 / MeshSettings::TilesPerChunk];
-    std::vector<float> m_quadHeights;
+
+    // ADT quad heights, if the tile has them, as steps of m_quadHeightScale
+    // above the lowest of them.  the error is at most half a step, which for
+    // the height range of a single tile is far below anything noticeable
+    bool m_hasQuadHeights;
+    float m_quadHeightBase;
+    float m_quadHeightScale;
+    std::uint16_t m_quadHeights[MeshSettings::QuadValuesPerTile];
+
+    float QuadHeight(int index) const
+    {
+        return m_quadHeightBase + m_quadHeightScale * m_quadHeights[index];
+    }
+
+    // the lowest z of static WMO geometry over each cell of the tile, if the
+    // file has them.  see MeshSettings::NavFileWmoFloors
+    std::vector<float> m_wmoFloors;
+
+    // whether no static WMO on the tile reaches down to the given position,
+    // so that only the terrain can be beneath it
+    bool BelowStaticWmos(const math::Vertex& position) const;
+
+    // the heights of the walkable model surfaces of each column of the
+    // height field, if the file has them.  see MeshSettings::NavFileSurfaces
+    std::vector<std::uint32_t> m_surfaceStarts;
+    std::vector<std::uint16_t> m_surfaces;
+
+    // appends the surfaces of the column at (x, y) to output, highest first,
+    // as they were found by the builder to within one cell height.  returns
+    // false if the file has none for the tile
+    bool FindSurfaces(float x, float y, std::vector<float>& output) const;
+
+    // the liquid surfaces over each cell of the tile, if the file has them,
+    // laid out as above.  see MeshSettings::NavFileLiquids
+    std::vector<std::uint32_t> m_liquidStarts;
+    std::vector<float> m_liquidHeights;
+    std::vector<LiquidType> m_liquidTypes;
+
+    // the surface of the liquid which the position is beneath, being the
+    // lowest above it, or else of the highest liquid below it.  returns false
+    // if there is no liquid over (x, y)
+    bool FindLiquid(const math::Vertex& position, float& level,
+                    LiquidType& type) const;
+
+    // the bytes held by this tile, other than by its mapped nav file and the
+    // models it references, which are shared with other tiles
+    struct MemoryUsage
+    {
+        // the mesh, once it has been rebuilt
+        size_t m_tileData;
+
+        // the decoded spans and any added by obstacles, while loaded
+        size_t m_heightField;
+        size_t m_quadHeights;
+
+        // the walkable surfaces, wmo floors and liquid of the columns
+        size_t m_surfaces;
+
+        // the instance ids, model references and instance trees
+        size_t m_staticInstances;
+
+        MemoryUsage& operator+=(const MemoryUsage& other);
+        size_t Total() const;
+    };
+
+    MemoryUsage GetMemoryUsage() const;
+
+    // the zone and area of the polygons of the tile, by polygon reference, as
+    // they are asked for by Map::ZoneAndAreaForPoly().  a rebuilt mesh keeps
+    // the references of the old one, so the whole is cleared by AddMesh().
+    // queries hold the map lock only shared, and so share this under its own
+    // mutex
+    mutable std::mutex m_polyZoneAreaMutex;
+    mutable std::unordered_map<dtPolyRef,
+                               std::pair<std::uint32_t, std::uint32_t>>
+        m_polyZoneAreas;
 
     // static instance ids, loaded per map
     std::vector<std::uint32_t> m_staticWmos;
@@ -67,10 +297,18 @@ public:
     std::vector<std::shared_ptr<WmoModel>> m_staticWmoModels;
     std::vector<std::shared_ptr<DoodadModel>> m_staticDoodadModels;
 
+    // the static instances above, with what a ray needs stored inline.
+    // built by AddToMap()
+    InstanceTree m_staticWmoTree;
+    InstanceTree m_staticDoodadTree;
+
     // indxed by GUID
     std::unordered_map<std::uint64_t, std::shared_ptr<WmoInstance>>
         m_temporaryWmos;
     std::unordered_map<std::uint64_t, std::shared_ptr<DoodadInstance>>
         m_temporaryDoodads;
+
+    // as with the static models, the instances above only hold weak pointers
+    std::unordered_map<std::uint64_t, std::shared_ptr<Model>> m_temporaryModels;
 };
 } // namespace pathfind
\ No newline at end of file
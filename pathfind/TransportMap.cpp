@@ -0,0 +1,125 @@
+#include "TransportMap.hpp"
+
+#include "Map.hpp"
+#include "utility/Exception.hpp"
+#include "utility/Matrix.hpp"
+#include "utility/Vector.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pathfind
+{
+TransportMap::TransportMap(const std::filesystem::path& dataPath,
+                           const std::string& transportName,
+                           const QueryLimits& limits)
+    : TransportMap(std::make_unique<Map>(dataPath, transportName, limits))
+{
+}
+
+TransportMap::TransportMap(std::unique_ptr<Map> map)
+    : m_map(std::move(map)),
+      m_transform(math::Matrix::CreateScalingMatrix(1.f)),
+      m_inverseTransform(m_transform)
+{
+    // a transport is built as the global wmo of a map of its own
+    if (m_map->HasADTs())
+        THROW(Result::INVALID_MAP_FILE);
+}
+
+void TransportMap::GetTransforms(math::Matrix& transform,
+                                 math::Matrix& inverse) const
+{
+    std::lock_guard<std::mutex> guard(m_transformMutex);
+
+    transform = m_transform;
+    inverse = m_inverseTransform;
+}
+
+void TransportMap::SetTransform(const math::Matrix& transform)
+{
+    // inverted once here, rather than by every query
+    auto const inverse = transform.ComputeInverse();
+
+    std::lock_guard<std::mutex> guard(m_transformMutex);
+
+    m_transform = transform;
+    m_inverseTransform = inverse;
+}
+
+void TransportMap::SetTransform(const math::Vertex& position,
+                                float orientation)
+{
+    SetTransform(math::Matrix::CreateTranslationMatrix(position) *
+                 math::Matrix::CreateRotationZ(orientation));
+}
+
+math::Matrix TransportMap::GetTransform() const
+{
+    std::lock_guard<std::mutex> guard(m_transformMutex);
+    return m_transform;
+}
+
+math::Vertex TransportMap::ToLocal(const math::Vertex& world) const
+{
+    math::Matrix transform, inverse;
+    GetTransforms(transform, inverse);
+
+    return math::Vertex::Transform(world, inverse);
+}
+
+math::Vertex TransportMap::ToWorld(const math::Vertex& local) const
+{
+    math::Matrix transform, inverse;
+    GetTransforms(transform, inverse);
+
+    return math::Vertex::Transform(local, transform);
+}
+
+bool TransportMap::FindPath(const math::Vertex& start, const math::Vertex& end,
+                            std::vector<math::Vertex>& output,
+                            bool allowPartial, const std::string& filter) const
+{
+    return m_map->FindPath(start, end, output, allowPartial, filter);
+}
+
+bool TransportMap::FindWorldPath(const math::Vertex& start,
+                                 const math::Vertex& end,
+                                 std::vector<math::Vertex>& output,
+                                 bool allowPartial,
+                                 const std::string& filter) const
+{
+    math::Matrix transform, inverse;
+    GetTransforms(transform, inverse);
+
+    if (!m_map->FindPath(math::Vertex::Transform(start, inverse),
+                         math::Vertex::Transform(end, inverse), output,
+                         allowPartial, filter))
+        return false;
+
+    for (auto& point : output)
+        point = math::Vertex::Transform(point, transform);
+
+    return true;
+}
+
+bool TransportMap::LineOfSight(const math::Vertex& start,
+                               const math::Vertex& stop, bool doodads) const
+{
+    return m_map->LineOfSight(start, stop, doodads);
+}
+
+bool TransportMap::WorldLineOfSight(const math::Vertex& start,
+                                    const math::Vertex& stop,
+                                    bool doodads) const
+{
+    math::Matrix transform, inverse;
+    GetTransforms(transform, inverse);
+
+    return m_map->LineOfSight(math::Vertex::Transform(start, inverse),
+                              math::Vertex::Transform(stop, inverse), doodads);
+}
+} // namespace pathfind
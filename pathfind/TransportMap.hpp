@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Map.hpp"
+#include "utility/Matrix.hpp"
+#include "utility/Vector.hpp"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace pathfind
+{
+// the navmesh of a transport, such as a ship or zeppelin.  MapBuilder builds
+// it from the wmo of the transport alone, in the coordinates of the model (see
+// its --transport option), so it never has to be rebuilt as the transport
+// moves.  queries are answered either in those local coordinates, or in
+// world coordinates by way of the transform of the transport, which the
+// server updates as it moves.
+//
+// the navmesh is an ordinary map of a global wmo, and so everything else may
+// be asked of GetMap() in local coordinates.  a transport map may be used by
+// any number of threads, including while its transform is being changed
+class TransportMap
+{
+private:
+    const std::unique_ptr<Map> m_map;
+
+    mutable std::mutex m_transformMutex;
+
+    // from local to world coordinates, and back again
+    math::Matrix m_transform;
+    math::Matrix m_inverseTransform;
+
+    void GetTransforms(math::Matrix& transform, math::Matrix& inverse) const;
+
+public:
+    // loads the transport of the given name, as for a map of that name
+    TransportMap(const std::filesystem::path& dataPath,
+                 const std::string& transportName,
+                 const QueryLimits& limits = {});
+
+    // takes a map already loaded, for instance by MapManager::CreateMap(), so
+    // that the models of the transport are shared with other maps
+    explicit TransportMap(std::unique_ptr<Map> map);
+
+    TransportMap(const TransportMap&) = delete;
+    TransportMap& operator=(const TransportMap&) = delete;
+
+    Map& GetMap() { return *m_map; }
+    const Map& GetMap() const { return *m_map; }
+
+    // the transform from the coordinates of the transport to those of the
+    // world.  until this is set it is the identity
+    void SetTransform(const math::Matrix& transform);
+
+    // as above, for a transport at the given position and turned by the given
+    // orientation about the z axis, as the server places game objects
+    void SetTransform(const math::Vertex& position, float orientation);
+
+    math::Matrix GetTransform() const;
+
+    math::Vertex ToLocal(const math::Vertex& world) const;
+    math::Vertex ToWorld(const math::Vertex& local) const;
+
+    // as Map::FindPath(), in the coordinates of the transport
+    bool FindPath(const math::Vertex& start, const math::Vertex& end,
+                  std::vector<math::Vertex>& output, bool allowPartial = false,
+                  const std::string& filter = {}) const;
+
+    // as above, with the ends and the path in world coordinates.  the ends
+    // are moved into the transport by the same transform as the path is
+    // moved out, so that a transform set meanwhile does not bend the path
+    bool FindWorldPath(const math::Vertex& start, const math::Vertex& end,
+                       std::vector<math::Vertex>& output,
+                       bool allowPartial = false,
+                       const std::string& filter = {}) const;
+
+    // as Map::LineOfSight(), against the model of the transport alone
+    bool LineOfSight(const math::Vertex& start, const math::Vertex& stop,
+                     bool doodads) const;
+    bool WorldLineOfSight(const math::Vertex& start, const math::Vertex& stop,
+                          bool doodads) const;
+};
+} // namespace pathfind
@@ -2,6 +2,86 @@
 
 #include "utility/Exception.hpp"
 #include "utility/MathHelper.hpp"
+#include "utility/Trace.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+struct pathfind_scratch
+{
+    std::vector<math::Vertex> m_path;
+    std::vector<float> m_heights;
+};
+
+namespace {
+// returns the given scratch object, or that of the calling thread when there
+// is none.  either way its vectors keep their capacity between calls
+pathfind_scratch& get_scratch(pathfind_scratch* const scratch)
+{
+    thread_local pathfind_scratch threadScratch;
+
+    return scratch ? *scratch : threadScratch;
+}
+
+// copies the path of a finished job into buffer, keeping the job when the
+// buffer is too small for it
+PathfindResultType take_job_path(
+    pathfind::JobPool::Status (pathfind::JobPool::*take)(
+        pathfind::JobPool::JobId, const pathfind::JobPool::Taker&),
+    pathfind::JobPool* const pool, uint64_t job, Vertex* const buffer,
+    unsigned int buffer_length, unsigned int* const amount_of_vertices)
+{
+    auto result = Result::SUCCESS;
+
+    try {
+        auto const status = (pool->*take)(job,
+            [&](const pathfind::JobPool::PathResult& path) {
+                if (path.m_error != Result::SUCCESS) {
+                    result = path.m_error;
+                    return true;
+                }
+
+                if (!path.m_found) {
+                    result = Result::UNKNOWN_PATH;
+                    return true;
+                }
+
+                *amount_of_vertices =
+                    static_cast<unsigned int>(path.m_path.size());
+
+                if (path.m_path.size() > buffer_length) {
+                    result = Result::BUFFER_TOO_SMALL;
+                    return false;
+                }
+
+                for (auto i = 0u; i < path.m_path.size(); ++i) {
+                    auto const& point = path.m_path[i];
+                    buffer[i] = Vertex { point.X, point.Y, point.Z };
+                }
+
+                return true;
+            });
+
+        if (status == pathfind::JobPool::Status::Unknown) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_JOB);
+        }
+
+        if (status == pathfind::JobPool::Status::InProgress) {
+            return static_cast<PathfindResultType>(Result::PATH_REQUEST_NOT_FINISHED);
+        }
+
+        return static_cast<PathfindResultType>(result);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+} // namespace
 
 extern "C" {
 
@@ -23,10 +103,96 @@ pathfind::Map* pathfind_new_map(const char* const data_path, const char* const m
     }
 }
 
+pathfind::Map* pathfind_new_map_with_limits(const char* const data_path,
+                                            const char* const map_name,
+                                            int32_t max_nodes,
+                                            int32_t max_path_hops,
+                                            int32_t short_path_nodes,
+                                            PathfindResultTypePtr result) {
+    pathfind::QueryLimits limits;
+    limits.m_maxNodes = max_nodes;
+    limits.m_maxPathHops = max_path_hops;
+    limits.m_shortPathNodes = short_path_nodes;
+
+    try
+    {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return new pathfind::Map(data_path, map_name, limits);
+    }
+    catch (utility::exception& e)
+    {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
 void pathfind_free_map(pathfind::Map* const map) {
     delete map;
 }
 
+pathfind::MapManager* pathfind_new_map_manager(const char* const data_path,
+                                               PathfindResultTypePtr result) {
+    try
+    {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return new pathfind::MapManager(data_path);
+    }
+    catch (utility::exception& e)
+    {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+void pathfind_free_map_manager(pathfind::MapManager* const manager) {
+    delete manager;
+}
+
+pathfind::Map* pathfind_manager_new_map(pathfind::MapManager* const manager,
+                                        const char* const map_name,
+                                        PathfindResultTypePtr result) {
+    try
+    {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return manager->CreateMap(map_name).release();
+    }
+    catch (utility::exception& e)
+    {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+pathfind::Map* pathfind_clone_map(pathfind::Map* const map,
+                                  PathfindResultTypePtr result) {
+    try
+    {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return map->CloneForInstance().release();
+    }
+    catch (utility::exception& e)
+    {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
 PathfindResultType pathfind_load_all_adts(pathfind::Map* const map, int32_t* const amount_of_adts_loaded) {
     try {
         *amount_of_adts_loaded = map->LoadAllADTs();
@@ -91,9 +257,16 @@ PathfindResultType pathfind_load_adt_at(pathfind::Map* const map, float x, float
     }
 }
 
-PathfindResultType pathfind_unload_adt(pathfind::Map* const map, int x, int y) {
+PathfindResultType pathfind_load_adt_async(pathfind::Map* const map, int adt_x, int adt_y) {
     try {
-        map->UnloadADT(x, y);
+        if (!map->HasADT(adt_x, adt_y)) {
+            return static_cast<PathfindResultType>(Result::MAP_DOES_NOT_HAVE_ADT);
+        }
+
+        // the result is reported through pathfind_commit_loaded_adts
+        map->LoadADTAsync(adt_x, adt_y);
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
     }
     catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
@@ -101,17 +274,12 @@ PathfindResultType pathfind_unload_adt(pathfind::Map* const map, int x, int y) {
     catch (...) {
         return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
     }
-
-    return static_cast<PathfindResultType>(Result::SUCCESS);
 }
 
-PathfindResultType pathfind_is_adt_loaded(pathfind::Map* const map, int x, int y, uint8_t* const loaded) {
+PathfindResultType pathfind_commit_loaded_adts(pathfind::Map* const map, int32_t* const amount_of_adts_committed) {
     try {
-        if (map->IsADTLoaded(x, y)) {
-            *loaded = 1;
-        } else{
-            *loaded = 0;
-        }
+        *amount_of_adts_committed = map->CommitLoadedADTs();
+        return static_cast<PathfindResultType>(Result::SUCCESS);
     }
     catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
@@ -119,13 +287,11 @@ PathfindResultType pathfind_is_adt_loaded(pathfind::Map* const map, int x, int y
     catch (...) {
         return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
     }
-
-    return static_cast<PathfindResultType>(Result::SUCCESS);
 }
 
-PathfindResultType pathfind_has_adts(pathfind::Map* const map, bool* has_adts) {
+PathfindResultType pathfind_prefetch_adts(pathfind::Map* const map, float x, float y, float dx, float dy, float distance, int32_t* const amount_of_adts_prefetched) {
     try {
-        *has_adts = map->HasADTs();
+        *amount_of_adts_prefetched = map->PrefetchADTs(x, y, dx, dy, distance);
         return static_cast<PathfindResultType>(Result::SUCCESS);
     }
     catch (utility::exception& e) {
@@ -136,28 +302,10 @@ PathfindResultType pathfind_has_adts(pathfind::Map* const map, bool* has_adts) {
     }
 }
 
-PathfindResultType pathfind_get_zone_and_area(pathfind::Map* const map,
-                       float x,
-                       float y,
-                       float z,
-                       unsigned int* const out_zone,
-                       unsigned int* const out_area)
-{
-    unsigned int zone = -1;
-    unsigned int area = -1;
-
-    math::Vertex p {x, y, z};
-
+PathfindResultType pathfind_set_residency_budget(pathfind::Map* const map, uint64_t budget) {
     try {
-        const auto success = map->ZoneAndArea(p, zone, area);
-        *out_zone = zone;
-        *out_area = area;
-
-        if (success) {
-            return static_cast<PathfindResultType>(Result::SUCCESS);
-        } else {
-            return static_cast<PathfindResultType>(Result::UNKNOWN_ZONE_AND_AREA);
-        }
+        map->SetResidencyBudget(static_cast<size_t>(budget));
+        return static_cast<PathfindResultType>(Result::SUCCESS);
     }
     catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
@@ -167,26 +315,16 @@ PathfindResultType pathfind_get_zone_and_area(pathfind::Map* const map,
     }
 }
 
-PathfindResultType pathfind_find_point_in_between_vectors(pathfind::Map* const map,
-                                                          float distance,
-                                                          float x1,
-                                                          float y1,
-                                                          float z1,
-                                                          float x2,
-                                                          float y2,
-                                                          float z2,
-                                                          Vertex* out_vertex) {
+PathfindResultType pathfind_get_residency_stats(pathfind::Map* const map, ResidencyStats* const stats) {
     try {
-        const math::Vertex start {x1, y1, z1};
-        const math::Vertex end {x2, y2, z2};
-        math::Vertex in_between_point {};
-        if (!map->FindPointInBetweenVectors(start, end, distance, in_between_point)) {
-            return static_cast<PathfindResultType>(Result::FAILED_TO_FIND_POINT_BETWEEN_VECTORS);
-        }
+        auto const result = map->GetResidencyStats();
 
-        out_vertex->x = in_between_point.X;
-        out_vertex->y = in_between_point.Y;
-        out_vertex->z = in_between_point.Z;
+        stats->budget = result.m_budget;
+        stats->resident_bytes = result.m_residentBytes;
+        stats->resident_adts = result.m_residentADTs;
+        stats->hits = result.m_hits;
+        stats->misses = result.m_misses;
+        stats->evictions = result.m_evictions;
 
         return static_cast<PathfindResultType>(Result::SUCCESS);
     }
@@ -198,43 +336,10 @@ PathfindResultType pathfind_find_point_in_between_vectors(pathfind::Map* const m
     }
 }
 
-PathfindResultType pathfind_find_path(pathfind::Map* const map,
-               float start_x,
-               float start_y,
-               float start_z,
-               float stop_x,
-               float stop_y,
-               float stop_z,
-               Vertex* const buffer,
-               unsigned int buffer_length,
-               unsigned int* const amount_of_vertices)
-{
-    const math::Vertex start {start_x, start_y, start_z};
-    const math::Vertex stop {stop_x, stop_y, stop_z};
-
-    std::vector<math::Vertex> path;
-
+PathfindResultType pathfind_compact(pathfind::Map* const map, uint64_t* const amount_removed) {
     try {
-        if (map->FindPath(start, stop, path)) {
-            if (path.size() > buffer_length) {
-                *amount_of_vertices = static_cast<unsigned int>(path.size());
-                return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
-            }
-
-            auto vbuf = static_cast<Vertex*>(static_cast<void*>(buffer));
-
-            for (int i = 0; i < path.size(); ++i) {
-                const auto point = path[i];
-                const auto v = Vertex { point.X, point.Y, point.Z};
-                vbuf[i] = v;
-            }
-
-            *amount_of_vertices = static_cast<unsigned int>(path.size());
-
-            return static_cast<PathfindResultType>(Result::SUCCESS);
-        } else {
-            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
-        }
+        *amount_removed = map->Compact();
+        return static_cast<PathfindResultType>(Result::SUCCESS);
     }
     catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
@@ -244,31 +349,11 @@ PathfindResultType pathfind_find_path(pathfind::Map* const map,
     }
 }
 
-PathfindResultType pathfind_find_heights(pathfind::Map* const map,
-                  float x,
-                  float y,
-                  float* const buffer,
-                  unsigned int buffer_length,
-                  unsigned int* const amount_of_heights)
-{
-    std::vector<float> height_values;
-
+PathfindResultType pathfind_preload_model_manifest(pathfind::Map* const map, const char* const manifest, uint32_t threads) {
     try {
-        if (map->FindHeights(x, y, height_values)) {
-            if (buffer_length < height_values.size()) {
-                return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
-            }
-
-            for (auto i = 0; i < height_values.size(); ++i) {
-                buffer[i] = height_values[i];
-            }
-
-            *amount_of_heights = static_cast<unsigned int>(height_values.size());
-
-            return static_cast<PathfindResultType>(Result::SUCCESS);
-        }
-
-        return static_cast<PathfindResultType>(Result::UNKNOWN_HEIGHT);
+        // the models are loaded in the background, and the count is not needed
+        map->PreloadModels(std::filesystem::path(manifest), threads);
+        return static_cast<PathfindResultType>(Result::SUCCESS);
     }
     catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
@@ -278,72 +363,1518 @@ PathfindResultType pathfind_find_heights(pathfind::Map* const map,
     }
 }
 
-PathfindResultType pathfind_find_height(pathfind::Map* const map, float start_x,
-    float start_y, float start_z,
-    float stop_x, float stop_y,
-    float* const stop_z)
-{
-    try
-    {
-        math::Vertex start {start_x, start_y, start_z};
-        float result;
-        if (map->FindHeight(start, stop_x, stop_y, result))
-        {
-            *stop_z = result;
-            return static_cast<PathfindResultType>(Result::SUCCESS);
-        }
-
-        return static_cast<PathfindResultType>(Result::UNKNOWN_HEIGHT);
+PathfindResultType pathfind_save_model_manifest(pathfind::Map* const map, const char* const manifest, uint64_t* const amount_of_models) {
+    try {
+        *amount_of_models = map->SaveModelManifest(manifest);
+        return static_cast<PathfindResultType>(Result::SUCCESS);
     }
-    catch (utility::exception& e)
-    {
+    catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
     }
-    catch (...)
-    {
+    catch (...) {
         return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
     }
 }
 
-PathfindResultType pathfind_line_of_sight(pathfind::Map* map,
-                                          float start_x, float start_y, float start_z,
-                                          float stop_x, float stop_y, float stop_z,
-                                          uint8_t* const line_of_sight, uint8_t doodads) {
-    try
-    {
-        if (map->LineOfSight({start_x, start_y, start_z}, {stop_x, stop_y, stop_z}, doodads)) {
-            *line_of_sight = 1;
-        } else {
-            *line_of_sight = 0;
-        }
-
+PathfindResultType pathfind_release_preloaded_models(pathfind::Map* const map) {
+    try {
+        map->ReleasePreloadedModels();
         return static_cast<PathfindResultType>(Result::SUCCESS);
     }
-    catch (utility::exception& e)
-    {
+    catch (utility::exception& e) {
         return static_cast<PathfindResultType>(e.ResultCode());
     }
-    catch (...)
-    {
+    catch (...) {
         return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
     }
 }
 
-PathfindResultType pathfind_find_random_point_around_circle(pathfind::Map* const map,
-                                                            float x,
-                                                            float y,
-                                                            float z,
-                                                            float radius,
-                                                            float* const random_x,
-                                                            float* const random_y,
+PathfindResultType pathfind_get_cache_stats(pathfind::Map* const map, CacheStats* const stats) {
+    try {
+        auto const result = map->GetCacheStats();
+
+        stats->live_wmo_models = result.m_liveWmoModels;
+        stats->expired_wmo_models = result.m_expiredWmoModels;
+        stats->live_doodad_models = result.m_liveDoodadModels;
+        stats->expired_doodad_models = result.m_expiredDoodadModels;
+        stats->live_temporary_wmos = result.m_liveTemporaryWmos;
+        stats->expired_temporary_wmos = result.m_expiredTemporaryWmos;
+        stats->live_temporary_doodads = result.m_liveTemporaryDoodads;
+        stats->expired_temporary_doodads = result.m_expiredTemporaryDoodads;
+        stats->model_bytes = result.m_modelBytes;
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_memory_stats(pathfind::Map* const map, MemoryStats* const stats,
+                                             ADTMemoryStats* const buffer, unsigned int buffer_length,
+                                             unsigned int* const amount_of_adts) {
+    try {
+        auto const result = map->GetMemoryStats();
+
+        stats->static_instance_bytes = result.m_staticInstances;
+        stats->model_bytes = result.m_models;
+        stats->total_bytes = result.m_totalBytes;
+
+        *amount_of_adts = static_cast<unsigned int>(result.m_adts.size());
+
+        if (result.m_adts.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < result.m_adts.size(); ++i) {
+            const auto& adt = result.m_adts[i];
+
+            buffer[i] = ADTMemoryStats {
+                adt.m_x, adt.m_y, adt.m_navFile, adt.m_tiles.m_tileData,
+                adt.m_tiles.m_heightField, adt.m_tiles.m_quadHeights,
+                adt.m_tiles.m_surfaces, adt.m_tiles.m_staticInstances,
+                adt.m_models,
+            };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_set_path_cache_capacity(pathfind::Map* const map, uint64_t capacity) {
+    try {
+        map->SetPathCacheCapacity(static_cast<size_t>(capacity));
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_set_straight_path_distance(pathfind::Map* const map, float distance) {
+    map->SetStraightPathDistance(distance);
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_enable_reachability(pathfind::Map* const map, uint8_t enabled) {
+    map->EnableReachability(!!enabled);
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_is_reachable(pathfind::Map* const map,
+                                         float start_x,
+                                         float start_y,
+                                         float start_z,
+                                         float stop_x,
+                                         float stop_y,
+                                         float stop_z,
+                                         uint8_t* const reachable) {
+    try {
+        *reachable = map->IsReachable({start_x, start_y, start_z},
+                                      {stop_x, stop_y, stop_z}) ? 1 : 0;
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_set_query_filter(pathfind::Map* const map, const char* const name,
+                                             uint16_t include_flags, uint16_t exclude_flags) {
+    try {
+        map->SetQueryFilter(name, include_flags, exclude_flags);
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_add_off_mesh_connection(pathfind::Map* const map, float start_x,
+                                                    float start_y, float start_z, float end_x,
+                                                    float end_y, float end_z, float radius,
+                                                    uint8_t bidirectional, uint32_t* const id) {
+    try {
+        *id = map->AddOffMeshConnection({start_x, start_y, start_z}, {end_x, end_y, end_z},
+                                        radius, bidirectional != 0);
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_remove_off_mesh_connection(pathfind::Map* const map, uint32_t id) {
+    try {
+        map->RemoveOffMeshConnection(id);
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_path_cache_stats(pathfind::Map* const map, PathCacheStats* const stats) {
+    try {
+        auto const result = map->GetPathCacheStats();
+
+        stats->capacity = result.m_capacity;
+        stats->entries = result.m_entries;
+        stats->hits = result.m_hits;
+        stats->misses = result.m_misses;
+        stats->invalidations = result.m_invalidations;
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_enable_metrics(pathfind::Map* const map, uint8_t enabled) {
+    map->EnableMetrics(!!enabled);
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_get_metrics(pathfind::Map* const map, PathfindMetrics* const metrics) {
+    using pathfind::QueryMetrics;
+
+    static_assert(sizeof(metrics->queries) / sizeof(metrics->queries[0]) ==
+                      QueryMetrics::QueryCount,
+                  "PathfindMetrics must have room for every query");
+    static_assert(sizeof(metrics->failures) / sizeof(metrics->failures[0]) ==
+                      QueryMetrics::FailureCount,
+                  "PathfindMetrics must have room for every failure");
+    static_assert(sizeof(metrics->queries[0].latency) / sizeof(uint64_t) ==
+                      QueryMetrics::LatencyBuckets,
+                  "QueryMetric must have room for every latency bucket");
+
+    auto const result = map->GetMetrics();
+
+    for (auto i = 0; i < QueryMetrics::QueryCount; ++i) {
+        metrics->queries[i].calls = result.m_queries[i].m_calls;
+        metrics->queries[i].total_ns = result.m_queries[i].m_nanoseconds;
+
+        for (auto b = 0; b < QueryMetrics::LatencyBuckets; ++b) {
+            metrics->queries[i].latency[b] = result.m_queries[i].m_latency[b];
+        }
+    }
+
+    for (auto i = 0; i < QueryMetrics::FailureCount; ++i) {
+        metrics->failures[i] = result.m_failures[i];
+    }
+
+    metrics->tiles_traversed = result.m_tilesTraversed;
+    metrics->bvh_nodes = result.m_bvhNodes;
+    metrics->bvh_faces = result.m_bvhFaces;
+    metrics->straight_paths = result.m_straightPaths;
+    metrics->portal_routes = result.m_portalRoutes;
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_reset_metrics(pathfind::Map* const map) {
+    map->ResetMetrics();
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_start_recording(pathfind::Map* const map, const char* const path) {
+    try {
+        if (!map->StartRecording(path)) {
+            return static_cast<PathfindResultType>(Result::FAILED_TO_OPEN_FILE_FOR_BINARY_STREAM);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_stop_recording(pathfind::Map* const map) {
+    try {
+        map->StopRecording();
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_unload_adt(pathfind::Map* const map, int x, int y) {
+    try {
+        map->UnloadADT(x, y);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_reload_adt(pathfind::Map* const map, int x, int y, uint8_t* const reloaded) {
+    try {
+        *reloaded = map->ReloadADT(x, y) ? 1 : 0;
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_is_adt_loaded(pathfind::Map* const map, int x, int y, uint8_t* const loaded) {
+    try {
+        if (map->IsADTLoaded(x, y)) {
+            *loaded = 1;
+        } else{
+            *loaded = 0;
+        }
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_has_adts(pathfind::Map* const map, bool* has_adts) {
+    try {
+        *has_adts = map->HasADTs();
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_agent_size(pathfind::Map* const map, uint32_t* const agent_size) {
+    try {
+        *agent_size = static_cast<uint32_t>(map->GetAgentSize());
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_zone_and_area(pathfind::Map* const map,
+                       float x,
+                       float y,
+                       float z,
+                       unsigned int* const out_zone,
+                       unsigned int* const out_area)
+{
+    unsigned int zone = -1;
+    unsigned int area = -1;
+
+    math::Vertex p {x, y, z};
+
+    try {
+        const auto success = map->ZoneAndArea(p, zone, area);
+        *out_zone = zone;
+        *out_area = area;
+
+        if (success) {
+            return static_cast<PathfindResultType>(Result::SUCCESS);
+        } else {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_ZONE_AND_AREA);
+        }
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_liquid_level(pathfind::Map* const map,
+                       float x,
+                       float y,
+                       float z,
+                       float* const out_level,
+                       uint8_t* const out_type)
+{
+    try {
+        float level;
+        LiquidType type;
+
+        if (!map->GetLiquidLevel(x, y, z, level, type)) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_LIQUID_LEVEL);
+        }
+
+        *out_level = level;
+        *out_type = static_cast<uint8_t>(type);
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_point_in_between_vectors(pathfind::Map* const map,
+                                                          float distance,
+                                                          float x1,
+                                                          float y1,
+                                                          float z1,
+                                                          float x2,
+                                                          float y2,
+                                                          float z2,
+                                                          Vertex* out_vertex) {
+    try {
+        const math::Vertex start {x1, y1, z1};
+        const math::Vertex end {x2, y2, z2};
+        math::Vertex in_between_point {};
+        if (!map->FindPointInBetweenVectors(start, end, distance, in_between_point)) {
+            return static_cast<PathfindResultType>(Result::FAILED_TO_FIND_POINT_BETWEEN_VECTORS);
+        }
+
+        out_vertex->x = in_between_point.X;
+        out_vertex->y = in_between_point.Y;
+        out_vertex->z = in_between_point.Z;
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_path(pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    return pathfind_find_path_scratch(map, start_x, start_y, start_z, stop_x,
+                                      stop_y, stop_z, nullptr, nullptr, buffer,
+                                      buffer_length, amount_of_vertices);
+}
+
+PathfindResultType pathfind_find_path_filtered(pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               const char* const filter,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    return pathfind_find_path_scratch(map, start_x, start_y, start_z, stop_x,
+                                      stop_y, stop_z, filter, nullptr, buffer,
+                                      buffer_length, amount_of_vertices);
+}
+
+PathfindResultType pathfind_find_short_path(pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               float max_distance,
+               const char* const filter,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    try {
+        auto& path = get_scratch(nullptr).m_path;
+
+        if (!map->FindShortPath(start, stop, max_distance, path,
+                                filter ? filter : "")) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        *amount_of_vertices = static_cast<unsigned int>(path.size());
+
+        if (path.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < path.size(); ++i) {
+            buffer[i] = Vertex { path[i].X, path[i].Y, path[i].Z };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_agent_path(pathfind::Map* const map,
+               uint32_t agent_size,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               const char* const filter,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    if (agent_size >= AgentProfileCount) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_AGENT_SIZE);
+    }
+
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    try {
+        auto& path = get_scratch(nullptr).m_path;
+
+        if (!map->FindAgentPath(static_cast<AgentSize>(agent_size), start,
+                                stop, path, false, filter ? filter : "")) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        *amount_of_vertices = static_cast<unsigned int>(path.size());
+
+        if (path.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < path.size(); ++i) {
+            buffer[i] = Vertex { path[i].X, path[i].Y, path[i].Z };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+pathfind_scratch* pathfind_new_scratch(PathfindResultTypePtr result) {
+    try {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return new pathfind_scratch();
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+void pathfind_free_scratch(pathfind_scratch* const scratch) {
+    delete scratch;
+}
+
+PathfindResultType pathfind_find_path_scratch(pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               const char* const filter,
+               pathfind_scratch* const scratch,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    try {
+        // FindPath() clears the path first, which keeps its capacity
+        auto& path = get_scratch(scratch).m_path;
+
+        if (map->FindPath(start, stop, path, false, filter ? filter : "")) {
+            *amount_of_vertices = static_cast<unsigned int>(path.size());
+
+            if (path.size() > buffer_length) {
+                return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+            }
+
+            for (auto i = 0u; i < path.size(); ++i) {
+                buffer[i] = Vertex { path[i].X, path[i].Y, path[i].Z };
+            }
+
+            return static_cast<PathfindResultType>(Result::SUCCESS);
+        } else {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+namespace {
+pathfind::Map::Location to_location(const Location& location) {
+    pathfind::Map::Location result;
+    result.m_position = {location.x, location.y, location.z};
+    result.m_polyRef = static_cast<dtPolyRef>(location.poly_ref);
+    return result;
+}
+
+void from_location(const pathfind::Map::Location& location, Location& result) {
+    result.x = location.m_position.X;
+    result.y = location.m_position.Y;
+    result.z = location.m_position.Z;
+    result.poly_ref = static_cast<uint64_t>(location.m_polyRef);
+}
+}
+
+PathfindResultType pathfind_resolve_location(pathfind::Map* const map,
+               float x,
+               float y,
+               float z,
+               Location* const location)
+{
+    try {
+        auto resolved = to_location(*location);
+        auto const found = map->ResolveLocation({x, y, z}, resolved);
+
+        from_location(resolved, *location);
+
+        if (!found) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_path_location(pathfind::Map* const map,
+               Location* const start,
+               Location* const stop,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    std::vector<math::Vertex> path;
+
+    try {
+        auto start_location = to_location(*start);
+        auto stop_location = to_location(*stop);
+
+        auto const found = map->FindPath(start_location, stop_location, path);
+
+        from_location(start_location, *start);
+        from_location(stop_location, *stop);
+
+        if (!found) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        *amount_of_vertices = static_cast<unsigned int>(path.size());
+
+        if (path.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < path.size(); ++i) {
+            const auto& point = path[i];
+            buffer[i] = Vertex { point.X, point.Y, point.Z };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_nearest_point(pathfind::Map* const map,
+               float x,
+               float y,
+               float z,
+               float extent_x,
+               float extent_y,
+               float extent_z,
+               const char* const filter,
+               Vertex* const nearest)
+{
+    Location location { x, y, z, 0 };
+    return pathfind_find_nearest_point_location(map, &location, extent_x, extent_y,
+                                                extent_z, filter, nearest);
+}
+
+PathfindResultType pathfind_find_nearest_point_location(pathfind::Map* const map,
+               Location* const location,
+               float extent_x,
+               float extent_y,
+               float extent_z,
+               const char* const filter,
+               Vertex* const nearest)
+{
+    try {
+        auto resolved = to_location(*location);
+        math::Vertex point;
+
+        auto const found = map->FindNearestPoint(
+            resolved, {extent_x, extent_y, extent_z}, point, filter ? filter : "");
+
+        from_location(resolved, *location);
+
+        if (!found) {
+            return static_cast<PathfindResultType>(Result::NO_POLYGON_NEAR_POSITION);
+        }
+
+        *nearest = Vertex { point.X, point.Y, point.Z };
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_distance_to_wall(pathfind::Map* const map,
+               float x,
+               float y,
+               float z,
+               float radius,
+               const char* const filter,
+               float* const distance,
+               Vertex* const hit_point,
+               Vertex* const hit_normal)
+{
+    Location location { x, y, z, 0 };
+    return pathfind_distance_to_wall_location(map, &location, radius, filter,
+                                              distance, hit_point, hit_normal);
+}
+
+PathfindResultType pathfind_distance_to_wall_location(pathfind::Map* const map,
+               Location* const location,
+               float radius,
+               const char* const filter,
+               float* const distance,
+               Vertex* const hit_point,
+               Vertex* const hit_normal)
+{
+    try {
+        auto resolved = to_location(*location);
+        math::Vertex point, normal;
+
+        auto const found = map->DistanceToWall(resolved, radius, *distance, point,
+                                               normal, filter ? filter : "");
+
+        from_location(resolved, *location);
+
+        if (!found) {
+            return static_cast<PathfindResultType>(Result::NO_POLYGON_NEAR_POSITION);
+        }
+
+        *hit_point = Vertex { point.X, point.Y, point.Z };
+        *hit_normal = Vertex { normal.X, normal.Y, normal.Z };
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_paths(pathfind::Map* const map,
+               const Vertex* const starts,
+               const Vertex* const stops,
+               unsigned int path_count,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const offsets,
+               unsigned int* const amount_of_vertices,
+               unsigned int threads)
+{
+    std::vector<math::Vertex> start_vertices(path_count);
+    std::vector<math::Vertex> stop_vertices(path_count);
+
+    for (auto i = 0u; i < path_count; ++i) {
+        start_vertices[i] = { starts[i].x, starts[i].y, starts[i].z };
+        stop_vertices[i] = { stops[i].x, stops[i].y, stops[i].z };
+    }
+
+    std::vector<math::Vertex> paths;
+    std::vector<std::uint32_t> path_offsets;
+
+    try {
+        map->FindPaths(start_vertices.data(), stop_vertices.data(), path_count,
+                       paths, path_offsets, false, threads);
+
+        *amount_of_vertices = static_cast<unsigned int>(paths.size());
+
+        if (paths.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < paths.size(); ++i) {
+            const auto& point = paths[i];
+            buffer[i] = Vertex { point.X, point.Y, point.Z };
+        }
+
+        for (auto i = 0u; i <= path_count; ++i) {
+            offsets[i] = path_offsets[i];
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+pathfind::JobPool* pathfind_new_job_pool(unsigned int threads,
+               PathfindResultTypePtr result)
+{
+    try {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return new pathfind::JobPool(threads);
+    }
+    catch (utility::exception& e) {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+void pathfind_free_job_pool(pathfind::JobPool* const pool) {
+    delete pool;
+}
+
+PathfindResultType pathfind_submit_path(pathfind::JobPool* const pool,
+               pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               const char* const filter,
+               uint64_t* const job)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    try {
+        *job = pool->SubmitPath(*map, start, stop, false, filter ? filter : "");
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_poll(pathfind::JobPool* const pool,
+               uint64_t job,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    return take_job_path(&pathfind::JobPool::Poll, pool, job, buffer,
+                         buffer_length, amount_of_vertices);
+}
+
+PathfindResultType pathfind_wait(pathfind::JobPool* const pool,
+               uint64_t job,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    return take_job_path(&pathfind::JobPool::Wait, pool, job, buffer,
+                         buffer_length, amount_of_vertices);
+}
+
+pathfind::PathRequest* pathfind_new_path_request(pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               PathfindResultTypePtr result)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    try {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return map->CreatePathRequest(start, stop).release();
+    }
+    catch (utility::exception& e) {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+void pathfind_free_path_request(pathfind::PathRequest* const request) {
+    delete request;
+}
+
+PathfindResultType pathfind_update_path_request(pathfind::PathRequest* const request,
+               int max_iterations,
+               uint8_t* const status)
+{
+    try {
+        *status = static_cast<uint8_t>(request->Update(max_iterations));
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_cancel_path_request(pathfind::PathRequest* const request) {
+    request->Cancel();
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_get_path_request_path(pathfind::PathRequest* const request,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    if (!request->IsDone()) {
+        return static_cast<PathfindResultType>(Result::PATH_REQUEST_NOT_FINISHED);
+    }
+
+    if (request->GetStatus() != pathfind::PathRequest::Status::Succeeded) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+    }
+
+    auto const& path = request->GetPath();
+
+    *amount_of_vertices = static_cast<unsigned int>(path.size());
+
+    if (path.size() > buffer_length) {
+        return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+    }
+
+    for (auto i = 0u; i < path.size(); ++i) {
+        buffer[i] = Vertex { path[i].X, path[i].Y, path[i].Z };
+    }
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+pathfind::PathCorridor* pathfind_new_path_corridor(pathfind::Map* const map,
+               float start_x,
+               float start_y,
+               float start_z,
+               float stop_x,
+               float stop_y,
+               float stop_z,
+               PathfindResultTypePtr result)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    try {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return map->CreatePathCorridor(start, stop).release();
+    }
+    catch (utility::exception& e) {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+void pathfind_free_path_corridor(pathfind::PathCorridor* const corridor) {
+    delete corridor;
+}
+
+PathfindResultType pathfind_move_path_corridor_position(pathfind::PathCorridor* const corridor,
+               float x, float y, float z)
+{
+    try {
+        if (!corridor->MovePosition({x, y, z})) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_move_path_corridor_target(pathfind::PathCorridor* const corridor,
+               float x, float y, float z)
+{
+    try {
+        if (!corridor->MoveTarget({x, y, z})) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_path_corridor_corners(pathfind::PathCorridor* const corridor,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    try {
+        std::vector<math::Vertex> corners;
+        corridor->GetCorners(corners, static_cast<int>(buffer_length));
+
+        *amount_of_vertices = static_cast<unsigned int>(corners.size());
+
+        for (auto i = 0u; i < corners.size(); ++i) {
+            buffer[i] = Vertex { corners[i].X, corners[i].Y, corners[i].Z };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_path_corridor_path(pathfind::PathCorridor* const corridor,
+               Vertex* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_vertices)
+{
+    try {
+        std::vector<math::Vertex> path;
+        if (!corridor->GetPath(path)) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        *amount_of_vertices = static_cast<unsigned int>(path.size());
+
+        if (path.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < path.size(); ++i) {
+            buffer[i] = Vertex { path[i].X, path[i].Y, path[i].Z };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+pathfind::Crowd* pathfind_new_crowd(pathfind::Map* const map,
+               int max_agents,
+               float max_agent_radius,
+               PathfindResultTypePtr result)
+{
+    try {
+        *result = static_cast<PathfindResultType>(Result::SUCCESS);
+        return map->CreateCrowd(max_agents, max_agent_radius).release();
+    }
+    catch (utility::exception& e) {
+        *result = static_cast<PathfindResultType>(e.ResultCode());
+        return nullptr;
+    }
+    catch (...) {
+        *result = static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        return nullptr;
+    }
+}
+
+void pathfind_free_crowd(pathfind::Crowd* const crowd) {
+    delete crowd;
+}
+
+PathfindResultType pathfind_add_crowd_agent(pathfind::Crowd* const crowd,
+               float x, float y, float z,
+               float radius, float speed,
+               int* const agent)
+{
+    try {
+        *agent = crowd->AddAgent({x, y, z}, radius, speed);
+
+        if (*agent < 0) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_remove_crowd_agent(pathfind::Crowd* const crowd, int agent) {
+    crowd->RemoveAgent(agent);
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_set_crowd_agent_target(pathfind::Crowd* const crowd,
+               int agent, float x, float y, float z)
+{
+    try {
+        if (!crowd->SetTarget(agent, {x, y, z})) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_update_crowd(pathfind::Crowd* const crowd, float seconds) {
+    try {
+        crowd->Update(seconds);
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_get_crowd_agent_position(pathfind::Crowd* const crowd,
+               int agent,
+               Vertex* const position,
+               Vertex* const velocity)
+{
+    math::Vertex agentPosition, agentVelocity;
+
+    if (!crowd->GetAgentPosition(agent, agentPosition) ||
+        !crowd->GetAgentVelocity(agent, agentVelocity)) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_PATH);
+    }
+
+    *position = Vertex { agentPosition.X, agentPosition.Y, agentPosition.Z };
+    *velocity = Vertex { agentVelocity.X, agentVelocity.Y, agentVelocity.Z };
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+PathfindResultType pathfind_find_heights(pathfind::Map* const map,
+                  float x,
+                  float y,
+               float* const buffer,
+               unsigned int buffer_length,
+               unsigned int* const amount_of_heights)
+{
+    return pathfind_find_heights_scratch(map, x, y, nullptr, buffer,
+                                         buffer_length, amount_of_heights);
+}
+
+PathfindResultType pathfind_find_heights_scratch(pathfind::Map* const map,
+                  float x,
+                  float y,
+                  pathfind_scratch* const scratch,
+                  float* const buffer,
+                  unsigned int buffer_length,
+                  unsigned int* const amount_of_heights)
+{
+    try {
+        // FindHeights() appends, so the previous heights are cleared first
+        auto& height_values = get_scratch(scratch).m_heights;
+        height_values.clear();
+
+        if (map->FindHeights(x, y, height_values)) {
+            *amount_of_heights = static_cast<unsigned int>(height_values.size());
+
+            if (buffer_length < height_values.size()) {
+                return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+            }
+
+            std::copy(height_values.begin(), height_values.end(), buffer);
+
+            return static_cast<PathfindResultType>(Result::SUCCESS);
+        }
+
+        return static_cast<PathfindResultType>(Result::UNKNOWN_HEIGHT);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_heights_grid(pathfind::Map* const map,
+                  float x0,
+                  float y0,
+                  float dx,
+                  float dy,
+                  unsigned int nx,
+                  unsigned int ny,
+                  float* const buffer,
+                  unsigned int buffer_length,
+                  unsigned int* const counts,
+                  unsigned int* const amount_of_heights)
+{
+    std::vector<float> height_values;
+    std::vector<unsigned int> height_counts;
+
+    try {
+        map->FindHeightsGrid(x0, y0, dx, dy, static_cast<int>(nx),
+                             static_cast<int>(ny), height_values,
+                             height_counts);
+
+        if (buffer_length < height_values.size()) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        std::copy(height_values.begin(), height_values.end(), buffer);
+        std::copy(height_counts.begin(), height_counts.end(), counts);
+
+        *amount_of_heights = static_cast<unsigned int>(height_values.size());
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_height(pathfind::Map* const map, float start_x,
+    float start_y, float start_z,
+    float stop_x, float stop_y,
+    float* const stop_z)
+{
+    try
+    {
+        math::Vertex start {start_x, start_y, start_z};
+        float result;
+        if (map->FindHeight(start, stop_x, stop_y, result))
+        {
+            *stop_z = result;
+            return static_cast<PathfindResultType>(Result::SUCCESS);
+        }
+
+        return static_cast<PathfindResultType>(Result::UNKNOWN_HEIGHT);
+    }
+    catch (utility::exception& e)
+    {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...)
+    {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_line_of_sight(pathfind::Map* map,
+                                          float start_x, float start_y, float start_z,
+                                          float stop_x, float stop_y, float stop_z,
+                                          uint8_t* const line_of_sight, uint8_t doodads) {
+    try
+    {
+        if (map->LineOfSight({start_x, start_y, start_z}, {stop_x, stop_y, stop_z}, doodads)) {
+            *line_of_sight = 1;
+        } else {
+            *line_of_sight = 0;
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e)
+    {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...)
+    {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_sweep_capsule(pathfind::Map* const map,
+                                          float start_x, float start_y, float start_z,
+                                          float stop_x, float stop_y, float stop_z,
+                                          float radius, float height,
+                                          uint8_t nav_mesh, uint8_t doodads,
+                                          Vertex* const stop_point,
+                                          uint8_t* const hit) {
+    try
+    {
+        math::Vertex stop;
+
+        *hit = map->SweepCapsule({start_x, start_y, start_z}, {stop_x, stop_y, stop_z},
+                                 radius, height, stop, !!nav_mesh, !!doodads) ? 1 : 0;
+        *stop_point = Vertex { stop.X, stop.Y, stop.Z };
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e)
+    {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...)
+    {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_ray_cast(pathfind::Map* const map,
+                                     float start_x, float start_y, float start_z,
+                                     float stop_x, float stop_y, float stop_z,
+                                     uint8_t doodads,
+                                     RayHit* const ray_hit,
+                                     uint8_t* const hit) {
+    try
+    {
+        pathfind::RayHit result;
+
+        *hit = map->RayCast({start_x, start_y, start_z}, {stop_x, stop_y, stop_z},
+                            !!doodads, result) ? 1 : 0;
+
+        if (*hit) {
+            ray_hit->kind = static_cast<uint8_t>(result.m_kind);
+            ray_hit->id = result.m_id;
+            ray_hit->point = Vertex { result.m_point.X, result.m_point.Y, result.m_point.Z };
+            ray_hit->normal = Vertex { result.m_normal.X, result.m_normal.Y, result.m_normal.Z };
+            ray_hit->distance = result.m_distance;
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e)
+    {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...)
+    {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_line_of_sight_batch(pathfind::Map* const map,
+                                                const Vertex* const starts,
+                                                const Vertex* const stops,
+                                                unsigned int count,
+                                                uint8_t* const line_of_sight,
+                                                uint8_t doodads) {
+    std::vector<math::Vertex> start_vertices(count);
+    std::vector<math::Vertex> stop_vertices(count);
+
+    for (auto i = 0u; i < count; ++i) {
+        start_vertices[i] = { starts[i].x, starts[i].y, starts[i].z };
+        stop_vertices[i] = { stops[i].x, stops[i].y, stops[i].z };
+    }
+
+    try
+    {
+        std::vector<bool> results;
+        map->LineOfSightBatch(start_vertices.data(), stop_vertices.data(),
+                              count, doodads, results);
+
+        for (auto i = 0u; i < count; ++i) {
+            line_of_sight[i] = results[i] ? 1 : 0;
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e)
+    {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...)
+    {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_line_of_sight_fan(pathfind::Map* const map,
+                                              float origin_x, float origin_y, float origin_z,
+                                              float origin_height,
+                                              const Vertex* const targets,
+                                              const float* const eye_heights,
+                                              unsigned int count,
+                                              uint8_t* const line_of_sight,
+                                              uint8_t doodads) {
+    std::vector<math::Vertex> target_vertices(count);
+
+    for (auto i = 0u; i < count; ++i) {
+        target_vertices[i] = { targets[i].x, targets[i].y, targets[i].z };
+    }
+
+    try
+    {
+        std::vector<bool> results;
+        map->LineOfSightFan({origin_x, origin_y, origin_z}, origin_height,
+                            target_vertices.data(), eye_heights, count,
+                            doodads, results);
+
+        for (auto i = 0u; i < count; ++i) {
+            line_of_sight[i] = results[i] ? 1 : 0;
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e)
+    {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...)
+    {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_find_random_point_around_circle(pathfind::Map* const map,
+                                                            float x,
+                                                            float y,
+                                                            float z,
+                                                            float radius,
+                                                            float* const random_x,
+                                                            float* const random_y,
                                                             float* const random_z) {
+    return pathfind_find_random_point_around_circle_filtered(map, x, y, z, radius, nullptr,
+                                                             random_x, random_y, random_z);
+}
+
+PathfindResultType pathfind_find_random_point_around_circle_filtered(pathfind::Map* const map,
+                                                                     float x,
+                                                                     float y,
+                                                                     float z,
+                                                                     float radius,
+                                                                     const char* const filter,
+                                                                     float* const random_x,
+                                                                     float* const random_y,
+                                                                     float* const random_z) {
 
     try
     {
         const math::Vertex start {x, y, z};
         math::Vertex random_point {};
 
-        if (!map->FindRandomPointAroundCircle(start, radius, random_point)) {
+        if (!map->FindRandomPointAroundCircle(start, radius, random_point,
+                                              filter ? filter : "")) {
             return static_cast<PathfindResultType>(Result::UNABLE_TO_FIND_RANDOM_POINT_IN_CIRCLE);
         }
 
@@ -363,4 +1894,131 @@ PathfindResultType pathfind_find_random_point_around_circle(pathfind::Map* const
     }
 }
 
+PathfindResultType pathfind_find_random_points(pathfind::Map* const map,
+                                               float x,
+                                               float y,
+                                               float z,
+                                               float radius,
+                                               uint64_t seed,
+                                               const char* const filter,
+                                               Vertex* const buffer,
+                                               unsigned int buffer_length,
+                                               unsigned int* const amount_of_points) {
+    const math::Vertex center {x, y, z};
+
+    try {
+        auto& points = get_scratch(nullptr).m_path;
+
+        *amount_of_points = static_cast<unsigned int>(
+            map->FindRandomPoints(center, radius, buffer_length, seed, points,
+                                  filter ? filter : ""));
+
+        if (points.empty()) {
+            return static_cast<PathfindResultType>(Result::UNABLE_TO_FIND_RANDOM_POINT_IN_CIRCLE);
+        }
+
+        for (auto i = 0u; i < points.size(); ++i) {
+            buffer[i] = Vertex { points[i].X, points[i].Y, points[i].Z };
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_query_instances(pathfind::Map* const map,
+                                            float x,
+                                            float y,
+                                            float z,
+                                            float radius,
+                                            InstanceInfo* const buffer,
+                                            unsigned int buffer_length,
+                                            unsigned int* const amount_of_instances) {
+    try {
+        std::vector<pathfind::Map::InstanceInfo> instances;
+        map->QueryInstances({x, y, z}, radius, instances);
+
+        *amount_of_instances = static_cast<unsigned int>(instances.size());
+
+        if (instances.size() > buffer_length) {
+            return static_cast<PathfindResultType>(Result::BUFFER_TOO_SMALL);
+        }
+
+        for (auto i = 0u; i < instances.size(); ++i) {
+            auto const& instance = instances[i];
+            auto& out = buffer[i];
+
+            auto const& min = instance.m_bounds.MinCorner;
+            auto const& max = instance.m_bounds.MaxCorner;
+
+            out.id = instance.m_id;
+            out.wmo = instance.m_wmo ? 1 : 0;
+            out.game_object = instance.m_gameObject ? 1 : 0;
+            out.min = Vertex { min.X, min.Y, min.Z };
+            out.max = Vertex { max.X, max.Y, max.Z };
+
+            auto const length = (std::min)(instance.m_model.size(), sizeof(out.model) - 1);
+            std::memcpy(out.model, instance.m_model.data(), length);
+            out.model[length] = '\0';
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (utility::exception& e) {
+        return static_cast<PathfindResultType>(e.ResultCode());
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
+PathfindResultType pathfind_install_allocator(uint64_t thread_cache_bytes,
+                                              uint64_t shared_cache_bytes) {
+    pathfind::Allocator::Config config;
+    config.m_threadCacheBytes = thread_cache_bytes;
+    config.m_sharedCacheBytes = shared_cache_bytes;
+
+    if (!pathfind::Allocator::Install(config)) {
+        return static_cast<PathfindResultType>(Result::ALLOCATOR_ALREADY_INSTALLED);
+    }
+
+    return static_cast<PathfindResultType>(Result::SUCCESS);
+}
+
+void pathfind_get_allocator_stats(AllocatorStats* const stats) {
+    auto const s = pathfind::Allocator::GetStats();
+
+    stats->permanent_bytes = s.m_permanentBytes;
+    stats->temporary_bytes = s.m_temporaryBytes;
+    stats->cached_bytes = s.m_cachedBytes;
+    stats->allocations = s.m_allocations;
+    stats->reused = s.m_reused;
+}
+
+void pathfind_start_trace() {
+    utility::Trace::Start();
+}
+
+void pathfind_stop_trace() {
+    utility::Trace::Stop();
+}
+
+PathfindResultType pathfind_save_trace(const char* const path) {
+    try {
+        if (!utility::Trace::Save(path)) {
+            return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+        }
+
+        return static_cast<PathfindResultType>(Result::SUCCESS);
+    }
+    catch (...) {
+        return static_cast<PathfindResultType>(Result::UNKNOWN_EXCEPTION);
+    }
+}
+
 } // extern "C"
@@ -1,5 +1,8 @@
 #pragma once
+#include "Allocator.hpp"
+#include "JobPool.hpp"
 #include "Map.hpp"
+#include "MapManager.hpp"
 #include "Common.hpp"
 
 extern "C" {
@@ -10,9 +13,117 @@ typedef struct {
     float z;
 } Vertex;
 
+/*
+    A position together with the navmesh polygon it was resolved to.
+
+    `poly_ref` is opaque. A zero `poly_ref` means that the position has not
+    been resolved yet. `x`, `y` and `z` may be changed freely, as `poly_ref`
+    is only used while the position is still over its polygon, and is
+    otherwise resolved again.
+*/
+typedef struct {
+    float x;
+    float y;
+    float z;
+    uint64_t poly_ref;
+} Location;
+
 typedef uint8_t PathfindResultType;
 typedef uint8_t* PathfindResultTypePtr;
 
+/*
+    Storage reused between queries, so that repeated calls do not allocate.
+
+    A scratch object may only be used by one call at a time.
+*/
+typedef struct pathfind_scratch pathfind_scratch;
+
+typedef struct {
+    uint64_t budget;
+    uint64_t resident_bytes;
+    int32_t resident_adts;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} ResidencyStats;
+
+typedef struct {
+    uint64_t live_wmo_models;
+    uint64_t expired_wmo_models;
+    uint64_t live_doodad_models;
+    uint64_t expired_doodad_models;
+    uint64_t live_temporary_wmos;
+    uint64_t expired_temporary_wmos;
+    uint64_t live_temporary_doodads;
+    uint64_t expired_temporary_doodads;
+    uint64_t model_bytes;
+} CacheStats;
+
+/*
+    The bytes held for one loaded ADT.  See `pathfind_get_memory_stats`.
+*/
+typedef struct {
+    int32_t x;
+    int32_t y;
+    uint64_t nav_file_bytes;
+    uint64_t tile_data_bytes;
+    uint64_t height_field_bytes;
+    uint64_t quad_height_bytes;
+    uint64_t surface_bytes;
+    uint64_t static_instance_bytes;
+    uint64_t model_bytes;
+} ADTMemoryStats;
+
+typedef struct {
+    uint64_t static_instance_bytes;
+    uint64_t model_bytes;
+    uint64_t total_bytes;
+} MemoryStats;
+
+typedef struct {
+    uint64_t capacity;
+    uint64_t entries;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+} PathCacheStats;
+
+/*
+    The number of queries of one kind made of a map, their total time, and how
+    many took at most 1, 2, 4, ... microseconds. The last bucket holds those
+    slower than the one before it.
+*/
+typedef struct {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t latency[16];
+} QueryMetric;
+
+/*
+    `queries` holds, in order, `find_path`, `find_paths`, `find_height`,
+    `find_heights`, `find_heights_grid`, `line_of_sight`,
+    `line_of_sight_batch`, `zone_and_area`, `find_random_point`,
+    `find_nearest_point`, `distance_to_wall` and `line_of_sight_fan`.
+
+    `failures` counts the path searches which found no polygon near their
+    start, none near their end, no path at all, only a partial path, and a
+    path cut short by the hop limit, and the searches skipped because their
+    ends were not connected (see `pathfind_enable_reachability`), in that
+    order.
+
+    `straight_paths` counts the path searches answered by a navmesh ray cast,
+    and `portal_routes` those routed across ADTs through the portal graph.
+*/
+typedef struct {
+    QueryMetric queries[12];
+    uint64_t failures[6];
+    uint64_t tiles_traversed;
+    uint64_t bvh_nodes;
+    uint64_t bvh_faces;
+    uint64_t straight_paths;
+    uint64_t portal_routes;
+} PathfindMetrics;
+
 /*
     Creates a new Map for `map_name` using data from the `data_path`.
 
@@ -22,6 +133,22 @@ pathfind::Map* pathfind_new_map(const char* const data_path,
                                 const char* const map_name,
                                 PathfindResultTypePtr result);
 
+/*
+    Same as `pathfind_new_map`, but with each thread's queries limited to
+    `max_nodes` polygons per search and `max_path_hops` per path, and with
+    `pathfind_find_short_path` searching at most `short_path_nodes` polygons.
+    `pathfind_new_map` uses 65535, 4096 and 128. Each must be positive, and
+    neither node count may exceed 65535, or `INVALID_QUERY_LIMITS` is returned.
+
+    This pointer MUST be freed using `pathfind_free_map`, otherwise it will leak.
+ */
+pathfind::Map* pathfind_new_map_with_limits(const char* const data_path,
+                                            const char* const map_name,
+                                            int32_t max_nodes,
+                                            int32_t max_path_hops,
+                                            int32_t short_path_nodes,
+                                            PathfindResultTypePtr result);
+
 /*
     Cleans up a map created by `pathfind_new_map`.
 
@@ -29,6 +156,43 @@ pathfind::Map* pathfind_new_map(const char* const data_path,
 */
 void pathfind_free_map(pathfind::Map* const map);
 
+/*
+    Creates a manager for the data in `data_path`, whose maps share one BVH
+    index and one cache of collision models.
+
+    This pointer MUST be freed using `pathfind_free_map_manager`, otherwise it will leak.
+ */
+pathfind::MapManager* pathfind_new_map_manager(const char* const data_path,
+                                               PathfindResultTypePtr result);
+
+/*
+    Cleans up a manager created by `pathfind_new_map_manager`. Maps created by
+    it remain valid.
+
+    This function will delete the object but will not change the pointer.
+*/
+void pathfind_free_map_manager(pathfind::MapManager* const manager);
+
+/*
+    Creates a new Map for `map_name`, sharing models with the other maps of the
+    manager.
+
+    This pointer MUST be freed using `pathfind_free_map`, otherwise it will leak.
+ */
+pathfind::Map* pathfind_manager_new_map(pathfind::MapManager* const manager,
+                                        const char* const map_name,
+                                        PathfindResultTypePtr result);
+
+/*
+    Creates another Map of the same data as `map`, for a separate instance. The
+    clone shares the models of `map`, and loads the ADTs loaded in `map` unless
+    it has a residency budget. See `Map::CloneForInstance`.
+
+    This pointer MUST be freed using `pathfind_free_map`, otherwise it will leak.
+ */
+pathfind::Map* pathfind_clone_map(pathfind::Map* const map,
+                                  PathfindResultTypePtr result);
+
 /*
     Loads all ADTs on a map.
 */
@@ -47,11 +211,221 @@ PathfindResultType pathfind_load_adt(pathfind::Map* const map, int adt_x, int ad
 PathfindResultType pathfind_load_adt_at(pathfind::Map* const map, float x, float y,
                                         float* const out_adt_x, float* const out_adt_y);
 
+/*
+    Starts loading a specific ADT on a background thread.
+
+    The ADT becomes usable after a later call to `pathfind_commit_loaded_adts`
+    once the load has finished.
+*/
+PathfindResultType pathfind_load_adt_async(pathfind::Map* const map, int adt_x, int adt_y);
+
+/*
+    Adds any ADTs which have finished loading in the background to the map.
+
+    This should be called regularly by the thread which owns the map.
+*/
+PathfindResultType pathfind_commit_loaded_adts(pathfind::Map* const map,
+                                               int32_t* const amount_of_adts_committed);
+
+/*
+    Starts loading, in the background, every ADT within `distance` along the
+    direction (`dx`, `dy`) from (`x`, `y`).
+*/
+PathfindResultType pathfind_prefetch_adts(pathfind::Map* const map, float x, float y,
+                                          float dx, float dy, float distance,
+                                          int32_t* const amount_of_adts_prefetched);
+
+/*
+    Sets the number of bytes of ADT data the map may keep loaded.
+
+    Once set, queries load the ADTs they touch on demand, and the least recently
+    used ADTs are unloaded when over budget. A `budget` of `0` disables this.
+*/
+PathfindResultType pathfind_set_residency_budget(pathfind::Map* const map, uint64_t budget);
+
+/*
+    Returns counters describing the ADT residency of the map.
+*/
+PathfindResultType pathfind_get_residency_stats(pathfind::Map* const map,
+                                                ResidencyStats* const stats);
+
+/*
+    Removes the entries of unloaded models and obstacles from the map's caches.
+
+    This also happens incrementally, so calling it is optional.
+*/
+PathfindResultType pathfind_compact(pathfind::Map* const map, uint64_t* const amount_removed);
+
+/*
+    Returns the number of live and expired entries in the map's caches, and the
+    bytes held by the collision data of the live models.
+*/
+PathfindResultType pathfind_get_cache_stats(pathfind::Map* const map, CacheStats* const stats);
+
+/*
+    Returns the bytes held by the map in `stats`, and those of each loaded ADT in
+    `buffer`.
+
+    Models are shared between ADTs, so the `model_bytes` of each ADT counts every
+    model its tiles reference, while that of `stats` counts each loaded model once.
+    The mapped nav files are not included in `total_bytes`.
+
+    `amount_of_adts` is set to the number of loaded ADTs.  If it is more than
+    `buffer_length`, `BUFFER_TOO_SMALL` is returned and `stats` is still filled.
+*/
+PathfindResultType pathfind_get_memory_stats(pathfind::Map* const map, MemoryStats* const stats,
+                                             ADTMemoryStats* const buffer, unsigned int buffer_length,
+                                             unsigned int* const amount_of_adts);
+
+/*
+    Starts loading the models listed by a manifest from
+    `pathfind_save_model_manifest`, on `threads` background threads.
+
+    They are kept loaded until `pathfind_release_preloaded_models`, so that the
+    first ADT or game object to use each need not wait for it to be read.
+*/
+PathfindResultType pathfind_preload_model_manifest(pathfind::Map* const map,
+                                                   const char* const manifest,
+                                                   uint32_t threads);
+
+/*
+    Writes a manifest of every model now loaded, to be preloaded by a later run.
+*/
+PathfindResultType pathfind_save_model_manifest(pathfind::Map* const map,
+                                                const char* const manifest,
+                                                uint64_t* const amount_of_models);
+
+/*
+    Lets the preloaded models unload once nothing else uses them.
+*/
+PathfindResultType pathfind_release_preloaded_models(pathfind::Map* const map);
+
+/*
+    Sets how many polygon corridors the map may cache for path queries.
+
+    Paths between the same pair of polygons reuse the cached corridor until a
+    tile it passes through is unloaded or rebuilt. A `capacity` of `0`, the
+    default, disables the cache.
+*/
+PathfindResultType pathfind_set_path_cache_capacity(pathfind::Map* const map, uint64_t capacity);
+
+/*
+    Sets the distance within which path queries first try a ray cast along the
+    navmesh, returning the straight line without any search when nothing is in
+    the way. A `distance` of `0`, the default, disables this.
+*/
+PathfindResultType pathfind_set_straight_path_distance(pathfind::Map* const map, float distance);
+
+/*
+    Makes path queries fail immediately, without searching, when their ends
+    are not connected within the loaded navmesh if `enabled` is not `0`.
+    Partial paths are still searched. This is disabled by default.
+*/
+PathfindResultType pathfind_enable_reachability(pathfind::Map* const map, uint8_t enabled);
+
+/*
+    Sets `reachable` to `1` if the navmesh nearest `start` is connected to that
+    nearest `stop` within the loaded navmesh, and to `0` otherwise. Polygon
+    flags are ignored, so `0` means that no path exists while `1` only means
+    that one may.
+
+    The connections are found on the first call after tiles are loaded,
+    unloaded or rebuilt, after which each call takes constant time.
+*/
+PathfindResultType pathfind_is_reachable(pathfind::Map* const map,
+                                         float start_x,
+                                         float start_y,
+                                         float start_z,
+                                         float stop_x,
+                                         float stop_y,
+                                         float stop_z,
+                                         uint8_t* const reachable);
+
+/*
+    Returns the size of the path cache and its hit, miss and invalidation
+    counters.
+*/
+PathfindResultType pathfind_get_path_cache_stats(pathfind::Map* const map,
+                                                 PathCacheStats* const stats);
+
+/*
+    Starts counting and timing the queries made of the map if `enabled` is not
+    `0`, and stops otherwise. This is disabled by default.
+*/
+PathfindResultType pathfind_enable_metrics(pathfind::Map* const map, uint8_t enabled);
+
+/*
+    Returns the counters gathered since metrics were enabled or last reset.
+*/
+PathfindResultType pathfind_get_metrics(pathfind::Map* const map,
+                                        PathfindMetrics* const metrics);
+
+/*
+    Sets every metrics counter of the map back to zero.
+*/
+PathfindResultType pathfind_reset_metrics(pathfind::Map* const map);
+
+/*
+    Logs the path, height, zone and line of sight queries made of the map from
+    here on to `path`, replacing it, so that they can be replayed later by
+    pathfind_replay. Any recording already in progress is stopped first.
+*/
+PathfindResultType pathfind_start_recording(pathfind::Map* const map, const char* const path);
+
+/*
+    Stops recording queries, and flushes those recorded to the file.
+*/
+PathfindResultType pathfind_stop_recording(pathfind::Map* const map);
+
+/*
+    Registers a query filter called `name`, replacing any existing filter of
+    that name.
+
+    A polygon passes the filter when its flags include at least one of
+    `include_flags` and none of `exclude_flags` (see `PolyFlags`). The filters
+    "avoid water", "ground only" and "swimmer" are registered by default.
+*/
+PathfindResultType pathfind_set_query_filter(pathfind::Map* const map,
+                                             const char* const name,
+                                             uint16_t include_flags,
+                                             uint16_t exclude_flags);
+
+/*
+    Adds a link from `start` to `end` which paths may take even though it cannot
+    be walked, such as an elevator or a ledge. Its id is written to `id`.
+
+    The tile containing the start is rebuilt, and the end must lie within that
+    tile or one of its neighbours. A tile built without its height field cannot
+    be rebuilt, and returns `TILE_HAS_NO_HEIGHT_FIELD`. Unless `bidirectional`
+    is non-zero, the link may only be taken from its start.
+*/
+PathfindResultType pathfind_add_off_mesh_connection(pathfind::Map* const map,
+                                                    float start_x, float start_y,
+                                                    float start_z, float end_x,
+                                                    float end_y, float end_z,
+                                                    float radius,
+                                                    uint8_t bidirectional,
+                                                    uint32_t* const id);
+
+/*
+    Removes a link added by `pathfind_add_off_mesh_connection`.
+*/
+PathfindResultType pathfind_remove_off_mesh_connection(pathfind::Map* const map,
+                                                       uint32_t id);
+
 /*
     Unloads specific ADT.
 */
 PathfindResultType pathfind_unload_adt(pathfind::Map* const map, int x, int y);
 
+/*
+    Replaces the tiles of a loaded ADT with those of its current nav file,
+    keeping temporary obstacles.
+
+    `reloaded` is set to 0 if the ADT is not loaded.
+*/
+PathfindResultType pathfind_reload_adt(pathfind::Map* const map, int x, int y, uint8_t* const reloaded);
+
 /*
     Checks if a specific ADT is loaded.
 
@@ -65,6 +439,13 @@ PathfindResultType pathfind_is_adt_loaded(pathfind::Map* const map, int x, int y
 */
 PathfindResultType pathfind_has_adts(pathfind::Map* const map, bool* has_adts);
 
+/*
+    Sets `agent_size` to the size of agent the map was built for: `0` for the
+    default, `1` for small and `2` for large. This is `0` until an ADT is
+    loaded.
+*/
+PathfindResultType pathfind_get_agent_size(pathfind::Map* const map, uint32_t* const agent_size);
+
 /*
     Returns the zone and area of a particular x, y, z.
 */
@@ -73,6 +454,16 @@ PathfindResultType pathfind_get_zone_and_area(pathfind::Map* const map, float x,
                                               unsigned int* const out_zone,
                                               unsigned int* const out_area);
 
+/*
+    Returns the height and type of the liquid surface at a particular x, y
+    which z is beneath, or else of the highest liquid below z.  `out_type`
+    is 0 for water, 1 for ocean, 2 for magma and 3 for slime.
+*/
+PathfindResultType pathfind_get_liquid_level(pathfind::Map* const map, float x,
+                                             float y, float z,
+                                             float* const out_level,
+                                             uint8_t* const out_type);
+
 /*
     Finds a point between the two vectors with a given distance.
 */
@@ -97,6 +488,420 @@ PathfindResultType pathfind_find_path(pathfind::Map* const map, float start_x,
                                       unsigned int buffer_length,
                                       unsigned int* const amount_of_vertices);
 
+/*
+    Same as `pathfind_find_path`, but only using polygons which pass the query
+    filter called `filter`. A `filter` of `NULL` or `""` uses the default
+    filter, which allows every polygon.
+*/
+PathfindResultType pathfind_find_path_filtered(pathfind::Map* const map,
+                                               float start_x, float start_y,
+                                               float start_z, float stop_x,
+                                               float stop_y, float stop_z,
+                                               const char* const filter,
+                                               Vertex* const buffer,
+                                               unsigned int buffer_length,
+                                               unsigned int* const amount_of_vertices);
+
+/*
+    Same as `pathfind_find_path_filtered`, for ends close together such as
+    those of a melee chase. The search uses a small node pool, and returns
+    `UNKNOWN_PATH` rather than search further when the ends are more than
+    `max_distance` apart or the path would be longer than that.
+*/
+PathfindResultType pathfind_find_short_path(pathfind::Map* const map,
+                                            float start_x, float start_y,
+                                            float start_z, float stop_x,
+                                            float stop_y, float stop_z,
+                                            float max_distance,
+                                            const char* const filter,
+                                            Vertex* const buffer,
+                                            unsigned int buffer_length,
+                                            unsigned int* const amount_of_vertices);
+
+/*
+    Same as `pathfind_find_path_filtered`, for an agent of the size given as
+    for `pathfind_get_agent_size`. Sizes other than that of the map have
+    meshes only when the map was built for them too, and paths are searched
+    without regard to temporary obstacles. Returns `UNKNOWN_AGENT_SIZE` for
+    a size which does not exist.
+*/
+PathfindResultType pathfind_find_agent_path(pathfind::Map* const map,
+                                            uint32_t agent_size,
+                                            float start_x, float start_y,
+                                            float start_z, float stop_x,
+                                            float stop_y, float stop_z,
+                                            const char* const filter,
+                                            Vertex* const buffer,
+                                            unsigned int buffer_length,
+                                            unsigned int* const amount_of_vertices);
+
+/*
+    Creates storage to be passed to the `_scratch` queries.
+
+    This pointer MUST be freed using `pathfind_free_scratch`, otherwise it will
+    leak.
+*/
+pathfind_scratch* pathfind_new_scratch(PathfindResultTypePtr result);
+
+/*
+    Cleans up storage created by `pathfind_new_scratch`.
+
+    This function will delete the object but will not change the pointer.
+*/
+void pathfind_free_scratch(pathfind_scratch* const scratch);
+
+/*
+    Same as `pathfind_find_path_filtered`, but keeping the path in `scratch`
+    while it is found, so that calls reusing the same scratch object do not
+    allocate once it has grown to fit. A `scratch` of `NULL` uses storage kept
+    for the calling thread, as the other queries do.
+
+    If `buffer` is too small `amount_of_vertices` is set to the required length
+    and `BUFFER_TOO_SMALL` is returned.
+*/
+PathfindResultType pathfind_find_path_scratch(pathfind::Map* const map,
+                                              float start_x, float start_y,
+                                              float start_z, float stop_x,
+                                              float stop_y, float stop_z,
+                                              const char* const filter,
+                                              pathfind_scratch* const scratch,
+                                              Vertex* const buffer,
+                                              unsigned int buffer_length,
+                                              unsigned int* const amount_of_vertices);
+
+/*
+    Updates `location` to refer to `x`, `y`, and `z`.
+
+    When the polygon `location` already refers to is still loaded and the new
+    position is over it, the polygon is kept without searching. Servers can
+    keep one of these per creature and pass it to the `_location` queries,
+    which then skip searching for the nearest polygon while it remains valid.
+*/
+PathfindResultType pathfind_resolve_location(pathfind::Map* const map,
+                                             float x, float y, float z,
+                                             Location* const location);
+
+/*
+    Same as `pathfind_find_path`, but starting from and stopping at the given
+    locations. Both are updated if their polygons had to be found again.
+*/
+PathfindResultType pathfind_find_path_location(pathfind::Map* const map,
+                                               Location* const start,
+                                               Location* const stop,
+                                               Vertex* const buffer,
+                                               unsigned int buffer_length,
+                                               unsigned int* const amount_of_vertices);
+
+/*
+    Writes the point of the navmesh nearest to `x`, `y`, and `z` to `nearest`,
+    searching a box of half extents `extent_x`, `extent_y` and `extent_z`
+    around it, and using only polygons which pass the query filter called
+    `filter` (which may be null).
+
+    Returns `NO_POLYGON_NEAR_POSITION` if no polygon intersects the box.
+*/
+PathfindResultType pathfind_find_nearest_point(pathfind::Map* const map,
+                                               float x,
+                                               float y,
+                                               float z,
+                                               float extent_x,
+                                               float extent_y,
+                                               float extent_z,
+                                               const char* const filter,
+                                               Vertex* const nearest);
+
+/*
+    Same as `pathfind_find_nearest_point`, but from the given location, which
+    is updated if its polygon had to be found again.
+*/
+PathfindResultType pathfind_find_nearest_point_location(pathfind::Map* const map,
+                                                        Location* const location,
+                                                        float extent_x,
+                                                        float extent_y,
+                                                        float extent_z,
+                                                        const char* const filter,
+                                                        Vertex* const nearest);
+
+/*
+    Sets `distance` to the distance from `x`, `y`, and `z` to the nearest edge
+    of the navmesh which cannot be crossed, searching within `radius`, and
+    sets `hit_point` and `hit_normal` to the point of that edge nearest to the
+    position and the horizontal normal of the edge, facing the position.
+
+    When there is no such edge within `radius`, `distance` is `radius` and
+    `hit_point` and `hit_normal` are zero. Returns `NO_POLYGON_NEAR_POSITION`
+    if there is no navmesh near the position.
+*/
+PathfindResultType pathfind_distance_to_wall(pathfind::Map* const map,
+                                             float x,
+                                             float y,
+                                             float z,
+                                             float radius,
+                                             const char* const filter,
+                                             float* const distance,
+                                             Vertex* const hit_point,
+                                             Vertex* const hit_normal);
+
+/*
+    Same as `pathfind_distance_to_wall`, but from the given location, which is
+    updated if its polygon had to be found again.
+*/
+PathfindResultType pathfind_distance_to_wall_location(pathfind::Map* const map,
+                                                      Location* const location,
+                                                      float radius,
+                                                      const char* const filter,
+                                                      float* const distance,
+                                                      Vertex* const hit_point,
+                                                      Vertex* const hit_normal);
+
+/*
+    Calculates a path for each of the `path_count` pairs of `starts` and
+    `stops`.
+
+    The vertices of all paths are written consecutively into `buffer`.
+    `offsets` must have room for `path_count + 1` values and receives the
+    position of each path within `buffer`, such that path `i` consists of the
+    vertices from `offsets[i]` up to (but not including) `offsets[i + 1]`.
+    Paths which could not be found are empty.
+
+    If `threads` is greater than `1` the batch is divided between that many
+    threads.
+
+    If `buffer` is too small `amount_of_vertices` is set to the required length
+    and `BUFFER_TOO_SMALL` is returned.
+*/
+PathfindResultType pathfind_find_paths(pathfind::Map* const map,
+                                       const Vertex* const starts,
+                                       const Vertex* const stops,
+                                       unsigned int path_count,
+                                       Vertex* const buffer,
+                                       unsigned int buffer_length,
+                                       unsigned int* const offsets,
+                                       unsigned int* const amount_of_vertices,
+                                       unsigned int threads);
+
+/*
+    Creates a pool of `threads` worker threads which search for the paths
+    submitted to it by `pathfind_submit_path`.
+
+    One pool may serve any number of maps. This pointer MUST be freed using
+    `pathfind_free_job_pool`, otherwise it will leak.
+*/
+pathfind::JobPool* pathfind_new_job_pool(unsigned int threads,
+                                         PathfindResultTypePtr result);
+
+/*
+    Cleans up a job pool created by `pathfind_new_job_pool`.
+
+    Searches which have started are finished first, and those still waiting
+    are abandoned. This function will delete the object but will not change
+    the pointer.
+*/
+void pathfind_free_job_pool(pathfind::JobPool* const pool);
+
+/*
+    Queues a search for a path from `start_x`, `start_y`, and `start_z` to
+    `stop_x`, `stop_y`, and `stop_z` using the query filter called `filter`,
+    and returns at once. The id of the job is written to `job`, to be passed to
+    `pathfind_poll` or `pathfind_wait`.
+
+    A `filter` of `NULL` or `""` uses the default filter. The map must not be
+    freed while it has jobs in progress, and each job should eventually be
+    polled or waited for until its path is copied.
+*/
+PathfindResultType pathfind_submit_path(pathfind::JobPool* const pool,
+                                        pathfind::Map* const map,
+                                        float start_x, float start_y,
+                                        float start_z, float stop_x,
+                                        float stop_y, float stop_z,
+                                        const char* const filter,
+                                        uint64_t* const job);
+
+/*
+    Copies the path found by a job submitted by `pathfind_submit_path`, after
+    which the job is forgotten.
+
+    `PATH_REQUEST_NOT_FINISHED` is returned while the job is in progress,
+    `UNKNOWN_JOB` if there is no such job, and `UNKNOWN_PATH` or the error of
+    the search if no path was found. If `buffer` is too small
+    `amount_of_vertices` is set to the required length, `BUFFER_TOO_SMALL` is
+    returned and the job is kept so that it may be polled again.
+*/
+PathfindResultType pathfind_poll(pathfind::JobPool* const pool, uint64_t job,
+                                 Vertex* const buffer,
+                                 unsigned int buffer_length,
+                                 unsigned int* const amount_of_vertices);
+
+/*
+    Same as `pathfind_poll`, but waits for the job to finish first.
+*/
+PathfindResultType pathfind_wait(pathfind::JobPool* const pool, uint64_t job,
+                                 Vertex* const buffer,
+                                 unsigned int buffer_length,
+                                 unsigned int* const amount_of_vertices);
+
+/*
+    Starts a search for a path from `start_x`, `start_y`, and `start_z` to
+    `stop_x`, `stop_y`, and `stop_z` which is advanced a limited number of
+    iterations at a time by `pathfind_update_path_request`.
+
+    The request must not outlive the map. This pointer MUST be freed using
+    `pathfind_free_path_request`, otherwise it will leak.
+*/
+pathfind::PathRequest* pathfind_new_path_request(pathfind::Map* const map,
+                                                 float start_x, float start_y,
+                                                 float start_z, float stop_x,
+                                                 float stop_y, float stop_z,
+                                                 PathfindResultTypePtr result);
+
+/*
+    Cleans up a path request created by `pathfind_new_path_request`.
+
+    This function will delete the object but will not change the pointer.
+*/
+void pathfind_free_path_request(pathfind::PathRequest* const request);
+
+/*
+    Advances a path request by at most `max_iterations` nodes.
+
+    `status` is set to `0` while the request is in progress, `1` once it has
+    succeeded, `2` if it has failed and `3` if it was cancelled.
+*/
+PathfindResultType pathfind_update_path_request(pathfind::PathRequest* const request,
+                                                int max_iterations,
+                                                uint8_t* const status);
+
+/*
+    Cancels a path request, so that further updates do nothing.
+*/
+PathfindResultType pathfind_cancel_path_request(pathfind::PathRequest* const request);
+
+/*
+    Copies the path found by a path request which has succeeded.
+
+    `PATH_REQUEST_NOT_FINISHED` is returned while the request is in progress,
+    and `UNKNOWN_PATH` if it failed or was cancelled.
+*/
+PathfindResultType pathfind_get_path_request_path(pathfind::PathRequest* const request,
+                                                  Vertex* const buffer,
+                                                  unsigned int buffer_length,
+                                                  unsigned int* const amount_of_vertices);
+
+/*
+    Creates a corridor from `start_x`, `start_y`, and `start_z` to `stop_x`,
+    `stop_y`, and `stop_z` which follows either end as it moves, rather than
+    searching for a new path each time.
+
+    The corridor must not outlive the map. This pointer MUST be freed using
+    `pathfind_free_path_corridor`, otherwise it will leak.
+*/
+pathfind::PathCorridor* pathfind_new_path_corridor(pathfind::Map* const map,
+                                                   float start_x, float start_y,
+                                                   float start_z, float stop_x,
+                                                   float stop_y, float stop_z,
+                                                   PathfindResultTypePtr result);
+
+/*
+    Cleans up a path corridor created by `pathfind_new_path_corridor`.
+
+    This function will delete the object but will not change the pointer.
+*/
+void pathfind_free_path_corridor(pathfind::PathCorridor* const corridor);
+
+/*
+    Moves the start of a corridor to `x`, `y`, and `z`.
+
+    `UNKNOWN_PATH` is returned if no path could be found from there to the
+    target.
+*/
+PathfindResultType pathfind_move_path_corridor_position(pathfind::PathCorridor* const corridor,
+                                                        float x, float y, float z);
+
+/*
+    Moves the target of a corridor to `x`, `y`, and `z`.
+
+    `UNKNOWN_PATH` is returned if no path could be found from the start to
+    there.
+*/
+PathfindResultType pathfind_move_path_corridor_target(pathfind::PathCorridor* const corridor,
+                                                      float x, float y, float z);
+
+/*
+    Copies at most `buffer_length` of the next corners along a corridor, which
+    is all that is needed to steer by.
+*/
+PathfindResultType pathfind_get_path_corridor_corners(pathfind::PathCorridor* const corridor,
+                                                      Vertex* const buffer,
+                                                      unsigned int buffer_length,
+                                                      unsigned int* const amount_of_vertices);
+
+/*
+    Copies the whole path along a corridor.
+*/
+PathfindResultType pathfind_get_path_corridor_path(pathfind::PathCorridor* const corridor,
+                                                   Vertex* const buffer,
+                                                   unsigned int buffer_length,
+                                                   unsigned int* const amount_of_vertices);
+
+/*
+    Creates a crowd of at most `max_agents` agents, none wider than
+    `max_agent_radius`, which are steered around one another.
+
+    The crowd must not outlive the map. This pointer MUST be freed using
+    `pathfind_free_crowd`, otherwise it will leak.
+*/
+pathfind::Crowd* pathfind_new_crowd(pathfind::Map* const map, int max_agents,
+                                    float max_agent_radius,
+                                    PathfindResultTypePtr result);
+
+/*
+    Cleans up a crowd created by `pathfind_new_crowd`.
+
+    This function will delete the object but will not change the pointer.
+*/
+void pathfind_free_crowd(pathfind::Crowd* const crowd);
+
+/*
+    Adds an agent to a crowd at `x`, `y`, and `z` which moves at no more than
+    `speed` yards per second. Its index is written to `agent`.
+
+    `UNKNOWN_PATH` is returned if the crowd is full or there is no navmesh
+    near the position.
+*/
+PathfindResultType pathfind_add_crowd_agent(pathfind::Crowd* const crowd,
+                                            float x, float y, float z,
+                                            float radius, float speed,
+                                            int* const agent);
+
+/*
+    Removes an agent added by `pathfind_add_crowd_agent`.
+*/
+PathfindResultType pathfind_remove_crowd_agent(pathfind::Crowd* const crowd,
+                                               int agent);
+
+/*
+    Sets the position towards which an agent steers.
+
+    `UNKNOWN_PATH` is returned if there is no navmesh near the position.
+*/
+PathfindResultType pathfind_set_crowd_agent_target(pathfind::Crowd* const crowd,
+                                                   int agent, float x,
+                                                   float y, float z);
+
+/*
+    Moves every agent of a crowd up to `seconds` further towards its target.
+*/
+PathfindResultType pathfind_update_crowd(pathfind::Crowd* const crowd,
+                                         float seconds);
+
+/*
+    Copies the position and velocity of an agent after the last update.
+*/
+PathfindResultType pathfind_get_crowd_agent_position(pathfind::Crowd* const crowd,
+                                                     int agent,
+                                                     Vertex* const position,
+                                                     Vertex* const velocity);
+
 /*
     Slices the map at `x`, `y` and returns all possible `z` values.
 */
@@ -105,6 +910,39 @@ PathfindResultType pathfind_find_heights(pathfind::Map* const map, float x, floa
                                          unsigned int buffer_length,
                                          unsigned int* const amount_of_heights);
 
+/*
+    Same as `pathfind_find_heights`, but keeping the heights in `scratch` while
+    they are found. A `scratch` of `NULL` uses storage kept for the calling
+    thread.
+
+    If `buffer` is too small `amount_of_heights` is set to the required length
+    and `BUFFER_TOO_SMALL` is returned.
+*/
+PathfindResultType pathfind_find_heights_scratch(pathfind::Map* const map,
+                                                 float x, float y,
+                                                 pathfind_scratch* const scratch,
+                                                 float* const buffer,
+                                                 unsigned int buffer_length,
+                                                 unsigned int* const amount_of_heights);
+
+/*
+    Performs `pathfind_find_heights` for each point of the `nx` by `ny` grid
+    starting at `x0`, `y0` with spacing `dx`, `dy`.
+
+    `counts` must have room for `nx * ny` values.  `counts[j * nx + i]` is set
+    to the number of heights found at `x0 + i * dx`, `y0 + j * dy`, and the
+    heights of every point are written to `buffer` one point after another in
+    that same order.  `amount_of_heights` is set to the total.
+*/
+PathfindResultType pathfind_find_heights_grid(pathfind::Map* const map,
+                                              float x0, float y0,
+                                              float dx, float dy,
+                                              unsigned int nx, unsigned int ny,
+                                              float* const buffer,
+                                              unsigned int buffer_length,
+                                              unsigned int* const counts,
+                                              unsigned int* const amount_of_heights);
+
 /*
     Returns the `stop_z` for the path between `start_x`, `start_y`, `start_z`
     and `stop_x`, `stop_y`.
@@ -126,6 +964,94 @@ PathfindResultType pathfind_line_of_sight(pathfind::Map* const map,
                                           float stop_x, float stop_y, float stop_z,
                                           uint8_t* const line_of_sight, uint8_t doodads);
 
+/*
+    Calculates line of sight for each of the `count` pairs of `starts` and
+    `stops`.  `line_of_sight[i]` is set to `1` if there is line of sight for
+    pair `i`, and `0` otherwise.
+
+    This is considerably faster than repeated calls to
+    `pathfind_line_of_sight` when many of the rays are close to one another.
+
+    If `doodads` is not `0` doodads will be included in the calculations.
+*/
+PathfindResultType pathfind_line_of_sight_batch(pathfind::Map* const map,
+                                                const Vertex* const starts,
+                                                const Vertex* const stops,
+                                                unsigned int count,
+                                                uint8_t* const line_of_sight,
+                                                uint8_t doodads);
+
+/*
+    Calculates line of sight from `origin`, raised by `origin_height`, to each
+    of the `count` `targets`, each raised by `eye_heights[i]`.  `eye_heights`
+    may be null, in which case the targets are used as they are.
+    `line_of_sight[i]` is set to `1` if there is line of sight to target `i`,
+    and `0` otherwise.
+
+    This is the check of a spell with many targets, and is faster than
+    `pathfind_line_of_sight_batch` for it.
+
+    If `doodads` is not `0` doodads will be included in the calculations.
+*/
+PathfindResultType pathfind_line_of_sight_fan(pathfind::Map* const map,
+                                              float origin_x, float origin_y, float origin_z,
+                                              float origin_height,
+                                              const Vertex* const targets,
+                                              const float* const eye_heights,
+                                              unsigned int count,
+                                              uint8_t* const line_of_sight,
+                                              uint8_t doodads);
+
+/*
+    Sweeps an upright capsule of `radius` and `height`, standing at `start`,
+    towards `stop`, as for a charge or a knockback. `stop_point` is set to
+    where it first touches a WMO, a doodad (if `doodads` is not `0`) or an
+    edge of the navmesh (if `nav_mesh` is not `0`), and otherwise to `stop`.
+    `hit` is set to `1` if anything was touched, and `0` otherwise.
+
+    Geometry lower than a step is left to the navmesh. `stop_point` lies on
+    the line from `start` to `stop`, so its height may need to be found again.
+*/
+PathfindResultType pathfind_sweep_capsule(pathfind::Map* const map,
+                                          float start_x, float start_y, float start_z,
+                                          float stop_x, float stop_y, float stop_z,
+                                          float radius, float height,
+                                          uint8_t nav_mesh, uint8_t doodads,
+                                          Vertex* const stop_point,
+                                          uint8_t* const hit);
+
+/*
+    The closest surface found by `pathfind_ray_cast`.
+
+    `kind` is one of `0` for the terrain, `1` for a WMO, `2` for a doodad,
+    `3` for a game object WMO and `4` for a game object doodad. `id` is the
+    unique id of a static instance or the guid of a game object, and `0` for
+    the terrain. `normal` is of the face which was hit, facing back towards
+    the start, and `distance` is from the start to `point`.
+*/
+typedef struct {
+    uint8_t kind;
+    uint64_t id;
+    Vertex point;
+    Vertex normal;
+    float distance;
+} RayHit;
+
+/*
+    Casts a ray from `start_x`, `start_y`, `start_z` to `stop_x`, `stop_y`,
+    `stop_z`. `hit` is set to `1` and `ray_hit` describes the closest surface
+    along it if there is one, and `hit` is set to `0` otherwise.
+
+    Unlike `pathfind_line_of_sight` this considers the ADT terrain.
+    If `doodads` is not `0` doodads and game objects will be considered too.
+*/
+PathfindResultType pathfind_ray_cast(pathfind::Map* const map,
+                                     float start_x, float start_y, float start_z,
+                                     float stop_x, float stop_y, float stop_z,
+                                     uint8_t doodads,
+                                     RayHit* const ray_hit,
+                                     uint8_t* const hit);
+
 /*
     Returns a random point within `radius` of `x`, `y`, and `z`.
 */
@@ -138,5 +1064,117 @@ PathfindResultType pathfind_find_random_point_around_circle(pathfind::Map* const
                                                             float* const random_y,
                                                             float* const random_z);
 
+/*
+    Same as `pathfind_find_random_point_around_circle`, but only using polygons
+    which pass the query filter called `filter`.
+*/
+PathfindResultType pathfind_find_random_point_around_circle_filtered(pathfind::Map* const map,
+                                                                     float x,
+                                                                     float y,
+                                                                     float z,
+                                                                     float radius,
+                                                                     const char* const filter,
+                                                                     float* const random_x,
+                                                                     float* const random_y,
+                                                                     float* const random_z);
+
+/*
+    Writes up to `buffer_length` points to `buffer`, uniformly distributed over
+    the area within `radius` of `x`, `y`, and `z` which can be reached from it,
+    using only polygons which pass the query filter called `filter` (which
+    may be null). The same `seed` gives the same points for as long as the
+    navmesh is unchanged.
+
+    `amount_of_points` is set to the number of points written, which may be
+    fewer than `buffer_length` when little of the area reachable lies within
+    the circle.
+*/
+PathfindResultType pathfind_find_random_points(pathfind::Map* const map,
+                                               float x,
+                                               float y,
+                                               float z,
+                                               float radius,
+                                               uint64_t seed,
+                                               const char* const filter,
+                                               Vertex* const buffer,
+                                               unsigned int buffer_length,
+                                               unsigned int* const amount_of_points);
+
+/*
+    A static WMO or doodad instance, or a game object, found by
+    `pathfind_query_instances`.
+
+    `id` is the unique id of a static instance or the guid of a game object.
+    `model` is the path of the model within the MPQs for static instances, and
+    of its BVH file for game objects, truncated to fit.
+*/
+typedef struct {
+    uint64_t id;
+    uint8_t wmo;
+    uint8_t game_object;
+    Vertex min;
+    Vertex max;
+    char model[256];
+} InstanceInfo;
+
+/*
+    Writes to `buffer` every static WMO and doodad instance, and every game
+    object, whose bounds are within `radius` of `x`, `y`, and `z`, whether or
+    not the ADTs beneath them are loaded.
+
+    `amount_of_instances` is set to the number found. If `buffer` is too small
+    `BUFFER_TOO_SMALL` is returned and nothing is written.
+*/
+PathfindResultType pathfind_query_instances(pathfind::Map* const map,
+                                            float x,
+                                            float y,
+                                            float z,
+                                            float radius,
+                                            InstanceInfo* const buffer,
+                                            unsigned int buffer_length,
+                                            unsigned int* const amount_of_instances);
+
+typedef struct {
+    uint64_t permanent_bytes;
+    uint64_t temporary_bytes;
+    uint64_t cached_bytes;
+    uint64_t allocations;
+    uint64_t reused;
+} AllocatorStats;
+
+/*
+    Installs a pooling allocator for Recast and Detour, which keeps freed
+    blocks for reuse: up to `thread_cache_bytes` of temporary blocks per
+    thread, and up to `shared_cache_bytes` of permanent ones.
+
+    This MUST be called before any map, crowd or other object is created, and
+    returns `ALLOCATOR_ALREADY_INSTALLED` if called again.
+*/
+PathfindResultType pathfind_install_allocator(uint64_t thread_cache_bytes,
+                                              uint64_t shared_cache_bytes);
+
+/*
+    Writes the bytes in use and held for reuse by the allocator, which are all
+    zero unless `pathfind_install_allocator` has been called.
+*/
+void pathfind_get_allocator_stats(AllocatorStats* const stats);
+
+/*
+    Begins collecting trace events around ADT loads, file decompression and
+    temporary obstacle rebuilds, for every map, discarding any collected before.
+*/
+void pathfind_start_trace();
+
+/*
+    Stops collecting trace events, keeping those already collected.
+*/
+void pathfind_stop_trace();
+
+/*
+    Writes the trace events collected so far to `path` as Chrome trace JSON,
+    for viewing in chrome://tracing or Perfetto.
+*/
+PathfindResultType pathfind_save_trace(const char* const path);
+
 } // extern "C"
 
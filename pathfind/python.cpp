@@ -1,12 +1,24 @@
+#include "Allocator.hpp"
 #include "Map.hpp"
+#include "MapManager.hpp"
+#include "TransportMap.hpp"
 #include "utility/MathHelper.hpp"
+#include "utility/Trace.hpp"
 
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <vector>
 #include <optional>
 
@@ -14,31 +26,475 @@ namespace py = pybind11;
 
 namespace
 {
+// for bindings which neither take nor make Python objects while they run, so
+// that other Python threads may run meanwhile.  those which build results
+// release the GIL themselves until they come to do so
+using release_gil = py::call_guard<py::gil_scoped_release>;
+
 py::list python_find_path(const pathfind::Map& map, float start_x,
                           float start_y, float start_z, float stop_x,
-                          float stop_y, float stop_z)
+                          float stop_y, float stop_z, const std::string& filter)
+{
+    py::list result;
+
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    std::vector<math::Vertex> path;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindPath(start, stop, path, false, filter);
+    }
+
+    if (found)
+        for (auto const& point : path)
+            result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+// as above, for a transport in its own coordinates or in those of the world
+py::list transport_find_path(const pathfind::TransportMap& transport,
+                             bool world, float start_x, float start_y,
+                             float start_z, float stop_x, float stop_y,
+                             float stop_z, const std::string& filter)
+{
+    py::list result;
+
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    std::vector<math::Vertex> path;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = world
+                    ? transport.FindWorldPath(start, stop, path, false, filter)
+                    : transport.FindPath(start, stop, path, false, filter);
+    }
+
+    if (found)
+        for (auto const& point : path)
+            result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+py::list find_refined_path(const pathfind::Map& map, float start_x,
+                           float start_y, float start_z, float stop_x,
+                           float stop_y, float stop_z, float spacing,
+                           const std::string& filter)
+{
+    py::list result;
+
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    std::vector<math::Vertex> path;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindRefinedPath(start, stop, spacing, path, false, filter);
+    }
+
+    if (found)
+        for (auto const& point : path)
+            result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+py::list find_short_path(const pathfind::Map& map, float start_x,
+                         float start_y, float start_z, float stop_x,
+                         float stop_y, float stop_z, float max_distance,
+                         const std::string& filter)
+{
+    py::list result;
+
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    std::vector<math::Vertex> path;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindShortPath(start, stop, max_distance, path, filter);
+    }
+
+    if (found)
+        for (auto const& point : path)
+            result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+py::list find_agent_path(const pathfind::Map& map, const std::string& agent,
+                         float start_x, float start_y, float start_z,
+                         float stop_x, float stop_y, float stop_z,
+                         const std::string& filter)
 {
     py::list result;
 
+    const AgentProfile* profile = nullptr;
+
+    for (auto const& entry : AgentProfiles)
+        if (agent == entry.m_name)
+            profile = &entry;
+
+    if (!profile)
+        throw std::invalid_argument("Unrecognized agent size " + agent);
+
     const math::Vertex start {start_x, start_y, start_z};
     const math::Vertex stop {stop_x, stop_y, stop_z};
 
     std::vector<math::Vertex> path;
+    bool found;
 
-    if (map.FindPath(start, stop, path))
+    {
+        py::gil_scoped_release release;
+        found =
+            map.FindAgentPath(profile->m_size, start, stop, path, false, filter);
+    }
+
+    if (found)
         for (auto const& point : path)
             result.append(py::make_tuple(point.X, point.Y, point.Z));
 
     return result;
 }
 
+pathfind::QueryLimits make_query_limits(int max_nodes, int max_path_hops,
+                                        int short_path_nodes)
+{
+    pathfind::QueryLimits result;
+    result.m_maxNodes = max_nodes;
+    result.m_maxPathHops = max_path_hops;
+    result.m_shortPathNodes = short_path_nodes;
+
+    return result;
+}
+
+std::unique_ptr<pathfind::Map> make_map(const std::string& data_path,
+                                        const std::string& map_name,
+                                        int max_nodes, int max_path_hops,
+                                        int short_path_nodes)
+{
+    return std::make_unique<pathfind::Map>(
+        data_path, map_name,
+        make_query_limits(max_nodes, max_path_hops, short_path_nodes));
+}
+
+std::unique_ptr<pathfind::Map>
+manager_create_map(const pathfind::MapManager& manager,
+                   const std::string& map_name, int max_nodes,
+                   int max_path_hops, int short_path_nodes)
+{
+    return manager.CreateMap(
+        map_name,
+        make_query_limits(max_nodes, max_path_hops, short_path_nodes));
+}
+
+std::uint32_t add_off_mesh_connection(pathfind::Map& map, float start_x,
+                                      float start_y, float start_z,
+                                      float end_x, float end_y, float end_z,
+                                      float radius, bool bidirectional)
+{
+    return map.AddOffMeshConnection({start_x, start_y, start_z},
+                                    {end_x, end_y, end_z}, radius,
+                                    bidirectional);
+}
+
+py::object resolve_location(const pathfind::Map& map, float x, float y,
+                            float z, pathfind::Map::Location* previous,
+                            const std::string& filter)
+{
+    pathfind::Map::Location location;
+    auto& result = previous ? *previous : location;
+    bool resolved;
+
+    {
+        py::gil_scoped_release release;
+        resolved = map.ResolveLocation({x, y, z}, result, filter);
+    }
+
+    if (!resolved)
+        return py::none();
+
+    return py::cast(result);
+}
+
+py::list find_path_between_locations(const pathfind::Map& map,
+                                     pathfind::Map::Location& start,
+                                     pathfind::Map::Location& stop,
+                                     const std::string& filter)
+{
+    py::list result;
+
+    std::vector<math::Vertex> path;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindPath(start, stop, path, false, filter);
+    }
+
+    if (found)
+        for (auto const& point : path)
+            result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+py::object find_nearest_point_from_location(const pathfind::Map& map,
+                                           pathfind::Map::Location& location,
+                                           float extent_x, float extent_y,
+                                           float extent_z,
+                                           const std::string& filter)
+{
+    math::Vertex nearest;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindNearestPoint(location, {extent_x, extent_y, extent_z},
+                                     nearest, filter);
+    }
+
+    if (!found)
+        return py::none();
+
+    return py::make_tuple(nearest.X, nearest.Y, nearest.Z);
+}
+
+py::object find_nearest_point(const pathfind::Map& map, float x, float y,
+                              float z, float extent_x, float extent_y,
+                              float extent_z, const std::string& filter)
+{
+    pathfind::Map::Location location {{x, y, z}};
+    return find_nearest_point_from_location(map, location, extent_x, extent_y,
+                                            extent_z, filter);
+}
+
+py::object distance_to_wall_from_location(const pathfind::Map& map,
+                                          pathfind::Map::Location& location,
+                                          float radius,
+                                          const std::string& filter)
+{
+    float distance;
+    math::Vertex point, normal;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.DistanceToWall(location, radius, distance, point, normal,
+                                   filter);
+    }
+
+    if (!found)
+        return py::none();
+
+    return py::make_tuple(distance, py::make_tuple(point.X, point.Y, point.Z),
+                          py::make_tuple(normal.X, normal.Y, normal.Z));
+}
+
+py::object distance_to_wall(const pathfind::Map& map, float x, float y,
+                            float z, float radius, const std::string& filter)
+{
+    pathfind::Map::Location location {{x, y, z}};
+    return distance_to_wall_from_location(map, location, radius, filter);
+}
+
+bool is_reachable(const pathfind::Map& map, float start_x, float start_y,
+                  float start_z, float stop_x, float stop_y, float stop_z,
+                  const std::string& filter)
+{
+    py::gil_scoped_release release;
+    return map.IsReachable({start_x, start_y, start_z},
+                           {stop_x, stop_y, stop_z}, filter);
+}
+
+bool is_reachable_between_locations(const pathfind::Map& map,
+                                    pathfind::Map::Location& start,
+                                    pathfind::Map::Location& stop,
+                                    const std::string& filter)
+{
+    py::gil_scoped_release release;
+    return map.IsReachable(start, stop, filter);
+}
+
+py::list query_instances(const pathfind::Map& map, float x, float y, float z,
+                         float radius)
+{
+    std::vector<pathfind::Map::InstanceInfo> instances;
+
+    {
+        py::gil_scoped_release release;
+        map.QueryInstances({x, y, z}, radius, instances);
+    }
+
+    py::list result;
+
+    for (auto const& instance : instances)
+    {
+        auto const& min = instance.m_bounds.MinCorner;
+        auto const& max = instance.m_bounds.MaxCorner;
+
+        py::dict entry;
+        entry["id"] = instance.m_id;
+        entry["wmo"] = instance.m_wmo;
+        entry["game_object"] = instance.m_gameObject;
+        entry["model"] = instance.m_model;
+        entry["min"] = py::make_tuple(min.X, min.Y, min.Z);
+        entry["max"] = py::make_tuple(max.X, max.Y, max.Z);
+
+        result.append(entry);
+    }
+
+    return result;
+}
+
+py::list python_find_paths(
+    const pathfind::Map& map,
+    const std::vector<std::tuple<float, float, float, float, float, float>>&
+        queries,
+    unsigned int threads, const std::string& filter)
+{
+    std::vector<math::Vertex> starts, stops;
+    starts.reserve(queries.size());
+    stops.reserve(queries.size());
+
+    for (auto const& query : queries)
+    {
+        starts.push_back(
+            {std::get<0>(query), std::get<1>(query), std::get<2>(query)});
+        stops.push_back(
+            {std::get<3>(query), std::get<4>(query), std::get<5>(query)});
+    }
+
+    std::vector<math::Vertex> paths;
+    std::vector<std::uint32_t> offsets;
+
+    {
+        py::gil_scoped_release release;
+        map.FindPaths(starts.data(), stops.data(), queries.size(), paths,
+                      offsets, false, threads, filter);
+    }
+
+    py::list result;
+
+    for (auto i = 0u; i < queries.size(); ++i)
+    {
+        py::list path;
+
+        for (auto p = offsets[i]; p < offsets[i + 1]; ++p)
+            path.append(py::make_tuple(paths[p].X, paths[p].Y, paths[p].Z));
+
+        result.append(path);
+    }
+
+    return result;
+}
+
+std::unique_ptr<pathfind::PathRequest>
+create_path_request(const pathfind::Map& map, float start_x, float start_y,
+                    float start_z, float stop_x, float stop_y, float stop_z)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    return map.CreatePathRequest(start, stop);
+}
+
+py::list path_request_path(const pathfind::PathRequest& request)
+{
+    py::list result;
+
+    for (auto const& point : request.GetPath())
+        result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+std::unique_ptr<pathfind::PathCorridor>
+create_path_corridor(const pathfind::Map& map, float start_x, float start_y,
+                     float start_z, float stop_x, float stop_y, float stop_z,
+                     const std::string& filter)
+{
+    const math::Vertex start {start_x, start_y, start_z};
+    const math::Vertex stop {stop_x, stop_y, stop_z};
+
+    return map.CreatePathCorridor(start, stop, filter);
+}
+
+py::list vertices_to_list(const std::vector<math::Vertex>& vertices)
+{
+    py::list result;
+
+    for (auto const& point : vertices)
+        result.append(py::make_tuple(point.X, point.Y, point.Z));
+
+    return result;
+}
+
+py::list path_corridor_corners(pathfind::PathCorridor& corridor,
+                               int max_corners)
+{
+    std::vector<math::Vertex> corners;
+
+    {
+        py::gil_scoped_release release;
+        corridor.GetCorners(corners, max_corners);
+    }
+
+    return vertices_to_list(corners);
+}
+
+py::list path_corridor_path(pathfind::PathCorridor& corridor)
+{
+    std::vector<math::Vertex> path;
+
+    {
+        py::gil_scoped_release release;
+        corridor.GetPath(path);
+    }
+
+    return vertices_to_list(path);
+}
+
+py::object crowd_agent_position(const pathfind::Crowd& crowd, int agent)
+{
+    math::Vertex position;
+    if (!crowd.GetAgentPosition(agent, position))
+        return py::none();
+
+    return py::make_tuple(position.X, position.Y, position.Z);
+}
+
+py::object crowd_agent_velocity(const pathfind::Crowd& crowd, int agent)
+{
+    math::Vertex velocity;
+    if (!crowd.GetAgentVelocity(agent, velocity))
+        return py::none();
+
+    return py::make_tuple(velocity.X, velocity.Y, velocity.Z);
+}
+
 py::tuple load_adt(pathfind::Map& map, int adt_x, int adt_y)
 {
-    if (!map.HasADT(adt_x, adt_y))
-        throw std::runtime_error("Requested ADT does not exist for map");
+    {
+        py::gil_scoped_release release;
+
+        if (!map.HasADT(adt_x, adt_y))
+            throw std::runtime_error("Requested ADT does not exist for map");
 
-    if (!map.LoadADT(adt_x, adt_y))
-        throw std::runtime_error("Failed to load requested ADT");
+        if (!map.LoadADT(adt_x, adt_y))
+            throw std::runtime_error("Failed to load requested ADT");
+    }
 
     return py::make_tuple(adt_x, adt_y);
 }
@@ -49,19 +505,242 @@ py::tuple load_adt_at(pathfind::Map& map, float x, float y)
 
     math::Convert::WorldToAdt({x, y, 0.f}, adt_x, adt_y);
 
-    if (!map.HasADT(adt_x, adt_y))
-        throw std::runtime_error("Requested ADT does not exist for map");
+    {
+        py::gil_scoped_release release;
 
-    if (!map.LoadADT(adt_x, adt_y))
-        throw std::runtime_error("Failed to load requested ADT");
+        if (!map.HasADT(adt_x, adt_y))
+            throw std::runtime_error("Requested ADT does not exist for map");
+
+        if (!map.LoadADT(adt_x, adt_y))
+            throw std::runtime_error("Failed to load requested ADT");
+    }
 
     return py::make_tuple(adt_x, adt_y);
 }
 
+void load_adt_async(pathfind::Map& map, int adt_x, int adt_y)
+{
+    if (!map.HasADT(adt_x, adt_y))
+        throw std::runtime_error("Requested ADT does not exist for map");
+
+    map.LoadADTAsync(adt_x, adt_y);
+}
+
 void unload_adt(pathfind::Map& map, int adt_x, int adt_y) {
     map.UnloadADT(adt_x, adt_y);
 }
 
+py::dict residency_stats(const pathfind::Map& map)
+{
+    auto const stats = map.GetResidencyStats();
+
+    py::dict result;
+
+    result["budget"] = stats.m_budget;
+    result["resident_bytes"] = stats.m_residentBytes;
+    result["resident_adts"] = stats.m_residentADTs;
+    result["hits"] = stats.m_hits;
+    result["misses"] = stats.m_misses;
+    result["evictions"] = stats.m_evictions;
+
+    return result;
+}
+
+py::dict cache_stats(const pathfind::Map& map)
+{
+    auto const stats = map.GetCacheStats();
+
+    py::dict result;
+
+    result["live_wmo_models"] = stats.m_liveWmoModels;
+    result["expired_wmo_models"] = stats.m_expiredWmoModels;
+    result["live_doodad_models"] = stats.m_liveDoodadModels;
+    result["expired_doodad_models"] = stats.m_expiredDoodadModels;
+    result["live_temporary_wmos"] = stats.m_liveTemporaryWmos;
+    result["expired_temporary_wmos"] = stats.m_expiredTemporaryWmos;
+    result["live_temporary_doodads"] = stats.m_liveTemporaryDoodads;
+    result["expired_temporary_doodads"] = stats.m_expiredTemporaryDoodads;
+    result["model_bytes"] = stats.m_modelBytes;
+
+    return result;
+}
+
+py::dict manager_model_stats(const pathfind::MapManager& manager)
+{
+    auto const stats = manager.GetModelStats();
+
+    py::dict result;
+
+    result["live_wmo_models"] = stats.m_liveWmoModels;
+    result["expired_wmo_models"] = stats.m_expiredWmoModels;
+    result["live_doodad_models"] = stats.m_liveDoodadModels;
+    result["expired_doodad_models"] = stats.m_expiredDoodadModels;
+    result["model_bytes"] = stats.m_modelBytes;
+
+    return result;
+}
+
+bool install_allocator(std::uint64_t threadCacheBytes,
+                       std::uint64_t sharedCacheBytes)
+{
+    pathfind::Allocator::Config config;
+    config.m_threadCacheBytes = threadCacheBytes;
+    config.m_sharedCacheBytes = sharedCacheBytes;
+
+    return pathfind::Allocator::Install(config);
+}
+
+py::dict allocator_stats()
+{
+    auto const stats = pathfind::Allocator::GetStats();
+
+    py::dict result;
+
+    result["permanent_bytes"] = stats.m_permanentBytes;
+    result["temporary_bytes"] = stats.m_temporaryBytes;
+    result["cached_bytes"] = stats.m_cachedBytes;
+    result["allocations"] = stats.m_allocations;
+    result["reused"] = stats.m_reused;
+
+    return result;
+}
+
+bool start_recording(pathfind::Map& map, const std::string& path)
+{
+    return map.StartRecording(path);
+}
+
+py::dict memory_stats(const pathfind::Map& map)
+{
+    auto const stats = map.GetMemoryStats();
+
+    py::list adts;
+    for (auto const& adt : stats.m_adts)
+    {
+        py::dict entry;
+
+        entry["x"] = adt.m_x;
+        entry["y"] = adt.m_y;
+        entry["nav_file_bytes"] = adt.m_navFile;
+        entry["tile_data_bytes"] = adt.m_tiles.m_tileData;
+        entry["height_field_bytes"] = adt.m_tiles.m_heightField;
+        entry["quad_height_bytes"] = adt.m_tiles.m_quadHeights;
+        entry["surface_bytes"] = adt.m_tiles.m_surfaces;
+        entry["static_instance_bytes"] = adt.m_tiles.m_staticInstances;
+        entry["model_bytes"] = adt.m_models;
+
+        adts.append(entry);
+    }
+
+    py::dict result;
+
+    result["adts"] = adts;
+    result["static_instance_bytes"] = stats.m_staticInstances;
+    result["model_bytes"] = stats.m_models;
+    result["total_bytes"] = stats.m_totalBytes;
+
+    return result;
+}
+
+size_t preload_models(pathfind::Map& map,
+                      const std::vector<std::string>& mpq_paths,
+                      const std::vector<unsigned int>& display_ids,
+                      unsigned int threads)
+{
+    return map.PreloadModels(mpq_paths, display_ids, threads).get();
+}
+
+size_t preload_model_manifest(pathfind::Map& map, const std::string& manifest,
+                              unsigned int threads)
+{
+    return map.PreloadModels(std::filesystem::path(manifest), threads).get();
+}
+
+size_t save_model_manifest(const pathfind::Map& map,
+                           const std::string& manifest)
+{
+    return map.SaveModelManifest(manifest);
+}
+
+py::dict path_cache_stats(const pathfind::Map& map)
+{
+    auto const stats = map.GetPathCacheStats();
+
+    py::dict result;
+
+    result["capacity"] = stats.m_capacity;
+    result["entries"] = stats.m_entries;
+    result["hits"] = stats.m_hits;
+    result["misses"] = stats.m_misses;
+    result["invalidations"] = stats.m_invalidations;
+
+    return result;
+}
+
+py::dict line_of_sight_cache_stats(const pathfind::Map& map)
+{
+    auto const stats = map.GetLineOfSightCacheStats();
+
+    py::dict result;
+
+    result["capacity"] = stats.m_capacity;
+    result["entries"] = stats.m_entries;
+    result["hits"] = stats.m_hits;
+    result["misses"] = stats.m_misses;
+    result["expirations"] = stats.m_expirations;
+    result["invalidations"] = stats.m_invalidations;
+
+    return result;
+}
+
+py::dict metrics(const pathfind::Map& map)
+{
+    using pathfind::QueryMetrics;
+
+    auto const snapshot = map.GetMetrics();
+
+    py::dict queries;
+    for (auto i = 0; i < QueryMetrics::QueryCount; ++i)
+    {
+        auto const& stats = snapshot.m_queries[i];
+
+        // (upper bound in seconds, count) pairs, the last bound being inf
+        py::list latency;
+        for (auto b = 0; b < QueryMetrics::LatencyBuckets; ++b)
+        {
+            auto const bound = QueryMetrics::LatencyBound(b);
+            latency.append(py::make_tuple(
+                bound ? bound / 1e6 : std::numeric_limits<double>::infinity(),
+                stats.m_latency[b]));
+        }
+
+        py::dict query;
+        query["calls"] = stats.m_calls;
+        query["seconds"] = stats.m_nanoseconds / 1e9;
+        query["latency"] = latency;
+
+        queries[QueryMetrics::QueryName(static_cast<QueryMetrics::Query>(i))] =
+            query;
+    }
+
+    py::dict failures;
+    for (auto i = 0; i < QueryMetrics::FailureCount; ++i)
+        failures[QueryMetrics::FailureName(
+            static_cast<QueryMetrics::Failure>(i))] = snapshot.m_failures[i];
+
+    py::dict result;
+
+    result["queries"] = queries;
+    result["failures"] = failures;
+    result["tiles_traversed"] = snapshot.m_tilesTraversed;
+    result["bvh_nodes"] = snapshot.m_bvhNodes;
+    result["bvh_faces"] = snapshot.m_bvhFaces;
+    result["straight_paths"] = snapshot.m_straightPaths;
+    result["portal_routes"] = snapshot.m_portalRoutes;
+
+    return result;
+}
+
 bool adt_loaded(pathfind::Map& map, int adt_x, int adt_y) {
     return map.IsADTLoaded(adt_x, adt_y);
 }
@@ -70,19 +749,52 @@ bool has_adts(pathfind::Map& map) {
     return map.HasADTs();
 }
 
-py::list python_query_heights(const pathfind::Map& map, float x, float y)
+py::list python_query_heights(const pathfind::Map& map, float x, float y,
+                              bool precise)
 {
     py::list result;
 
     std::vector<float> height_values;
 
-    if (map.FindHeights(x, y, height_values))
-        for (auto const& z : height_values)
+    {
+        py::gil_scoped_release release;
+        map.FindHeights(x, y, height_values, precise);
+    }
+
+    for (auto const& z : height_values)
             result.append(z);
 
     return result;
 }
 
+py::list python_query_heights_grid(const pathfind::Map& map, float x0,
+                                   float y0, float dx, float dy, int nx, int ny,
+                                   bool precise)
+{
+    std::vector<float> heights;
+    std::vector<unsigned int> counts;
+
+    {
+        py::gil_scoped_release release;
+        map.FindHeightsGrid(x0, y0, dx, dy, nx, ny, heights, counts, precise);
+    }
+
+    py::list result;
+
+    size_t offset = 0;
+    for (auto const count : counts)
+    {
+        py::list point;
+        for (auto i = 0u; i < count; ++i)
+            point.append(heights[offset + i]);
+
+        offset += count;
+        result.append(point);
+    }
+
+    return result;
+}
+
 std::optional<float> python_query_z(const pathfind::Map& map, float start_x, float start_y, float start_z,
     float stop_x, float stop_y)
 {
@@ -101,11 +813,280 @@ bool los(const pathfind::Map& map, float start_x, float start_y, float start_z,
             doodads);
 }
 
+py::object sweep_capsule(const pathfind::Map& map, float start_x,
+                         float start_y, float start_z, float stop_x,
+                         float stop_y, float stop_z, float radius, float height,
+                         bool nav_mesh, bool doodads)
+{
+    math::Vertex stop;
+    bool hit;
+
+    {
+        py::gil_scoped_release release;
+        hit = map.SweepCapsule({start_x, start_y, start_z},
+                               {stop_x, stop_y, stop_z}, radius, height, stop,
+                               nav_mesh, doodads);
+    }
+
+    if (!hit)
+        return py::none();
+
+    return py::make_tuple(stop.X, stop.Y, stop.Z);
+}
+
+py::object ray_cast(const pathfind::Map& map, float start_x, float start_y,
+                    float start_z, float stop_x, float stop_y, float stop_z,
+                    bool doodads)
+{
+    pathfind::RayHit hit;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.RayCast({start_x, start_y, start_z},
+                            {stop_x, stop_y, stop_z}, doodads, hit);
+    }
+
+    if (!found)
+        return py::none();
+
+    static const char* const kinds[] = {"terrain", "wmo", "doodad",
+                                        "temporary_wmo", "temporary_doodad"};
+
+    py::dict result;
+    result["kind"] = kinds[static_cast<int>(hit.m_kind)];
+    result["id"] = hit.m_id;
+    result["point"] = py::make_tuple(hit.m_point.X, hit.m_point.Y, hit.m_point.Z);
+    result["normal"] =
+        py::make_tuple(hit.m_normal.X, hit.m_normal.Y, hit.m_normal.Z);
+    result["distance"] = hit.m_distance;
+
+    return result;
+}
+
+py::list los_batch(
+    const pathfind::Map& map,
+    const std::vector<std::tuple<float, float, float, float, float, float>>&
+        queries,
+    bool doodads)
+{
+    std::vector<math::Vertex> starts, stops;
+    starts.reserve(queries.size());
+    stops.reserve(queries.size());
+
+    for (auto const& query : queries)
+    {
+        starts.push_back(
+            {std::get<0>(query), std::get<1>(query), std::get<2>(query)});
+        stops.push_back(
+            {std::get<3>(query), std::get<4>(query), std::get<5>(query)});
+    }
+
+    std::vector<bool> results;
+
+    {
+        py::gil_scoped_release release;
+        map.LineOfSightBatch(starts.data(), stops.data(), queries.size(),
+                             doodads, results);
+    }
+
+    py::list result;
+    for (auto const los : results)
+        result.append(static_cast<bool>(los));
+
+    return result;
+}
+
+py::list los_fan(const pathfind::Map& map, float origin_x, float origin_y,
+                 float origin_z, float origin_height,
+                 const std::vector<std::tuple<float, float, float, float>>&
+                     targets,
+                 bool doodads)
+{
+    std::vector<math::Vertex> positions;
+    std::vector<float> eyeHeights;
+    positions.reserve(targets.size());
+    eyeHeights.reserve(targets.size());
+
+    for (auto const& target : targets)
+    {
+        positions.push_back(
+            {std::get<0>(target), std::get<1>(target), std::get<2>(target)});
+        eyeHeights.push_back(std::get<3>(target));
+    }
+
+    std::vector<bool> results;
+
+    {
+        py::gil_scoped_release release;
+        map.LineOfSightFan({origin_x, origin_y, origin_z}, origin_height,
+                           positions.data(), eyeHeights.data(),
+                           targets.size(), doodads, results);
+    }
+
+    py::list result;
+    for (auto const los : results)
+        result.append(static_cast<bool>(los));
+
+    return result;
+}
+
+using FloatArray =
+    py::array_t<float, py::array::c_style | py::array::forcecast>;
+
+// the number of queries in an (N, columns) array of them
+size_t query_rows(const FloatArray& queries, py::ssize_t columns)
+{
+    if (queries.ndim() != 2 || queries.shape(1) != columns)
+        throw std::invalid_argument("queries must be an (N, " +
+                                    std::to_string(columns) + ") array");
+
+    return static_cast<size_t>(queries.shape(0));
+}
+
+// splits (N, 6) queries into their starts and stops
+void query_vertices(const float* queries, size_t count,
+                    std::vector<math::Vertex>& starts,
+                    std::vector<math::Vertex>& stops)
+{
+    starts.resize(count);
+    stops.resize(count);
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        auto const query = &queries[6 * i];
+        starts[i] = {query[0], query[1], query[2]};
+        stops[i] = {query[3], query[4], query[5]};
+    }
+}
+
+py::tuple find_paths_array(const pathfind::Map& map, const FloatArray& queries,
+                           unsigned int threads, const std::string& filter)
+{
+    auto const count = query_rows(queries, 6);
+
+    std::vector<math::Vertex> paths;
+    std::vector<std::uint32_t> offsets;
+
+    {
+        py::gil_scoped_release release;
+
+        std::vector<math::Vertex> starts, stops;
+        query_vertices(queries.data(), count, starts, stops);
+
+        map.FindPaths(starts.data(), stops.data(), count, paths, offsets,
+                      false, threads, filter);
+    }
+
+    py::array_t<float> points(
+        {static_cast<py::ssize_t>(paths.size()), py::ssize_t {3}});
+    auto const out = points.mutable_data();
+
+    for (auto i = 0u; i < paths.size(); ++i)
+    {
+        out[3 * i + 0] = paths[i].X;
+        out[3 * i + 1] = paths[i].Y;
+        out[3 * i + 2] = paths[i].Z;
+    }
+
+    return py::make_tuple(points, py::array_t<std::uint32_t>(
+                                      offsets.size(), offsets.data()));
+}
+
+py::array_t<bool> los_array(const pathfind::Map& map,
+                            const FloatArray& queries, bool doodads)
+{
+    auto const count = query_rows(queries, 6);
+
+    std::vector<bool> results;
+
+    {
+        py::gil_scoped_release release;
+
+        std::vector<math::Vertex> starts, stops;
+        query_vertices(queries.data(), count, starts, stops);
+
+        map.LineOfSightBatch(starts.data(), stops.data(), count, doodads,
+                             results);
+    }
+
+    py::array_t<bool> result(count);
+    auto const out = result.mutable_data();
+
+    for (auto i = 0u; i < count; ++i)
+        out[i] = results[i];
+
+    return result;
+}
+
+py::array_t<float> query_z_array(const pathfind::Map& map,
+                                 const FloatArray& queries)
+{
+    auto const count = query_rows(queries, 5);
+
+    py::array_t<float> result(count);
+    auto const out = result.mutable_data();
+    auto const in = queries.data();
+
+    py::gil_scoped_release release;
+
+    for (auto i = 0u; i < count; ++i)
+    {
+        auto const query = &in[5 * i];
+
+        if (!map.FindHeight({query[0], query[1], query[2]}, query[3],
+                            query[4], out[i]))
+            out[i] = std::numeric_limits<float>::quiet_NaN();
+    }
+
+    return result;
+}
+
 py::object get_zone_and_area(pathfind::Map& map, float x, float y, float z)
 {
     math::Vertex p {x, y, z};
     unsigned int zone = -1, area = -1;
-    if (!map.ZoneAndArea(p, zone, area))
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.ZoneAndArea(p, zone, area);
+    }
+
+    if (!found)
+        return py::none();
+    return py::make_tuple(zone, area);
+}
+
+py::object get_liquid_level(const pathfind::Map& map, float x, float y,
+                            float z)
+{
+    float level;
+    LiquidType type;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.GetLiquidLevel(x, y, z, level, type);
+    }
+
+    if (!found)
+        return py::none();
+    return py::make_tuple(level, type);
+}
+
+py::object get_zone_and_area_from_location(pathfind::Map& map,
+                                           pathfind::Map::Location& location)
+{
+    unsigned int zone = -1, area = -1;
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.ZoneAndArea(location, zone, area);
+    }
+
+    if (!found)
         return py::none();
     return py::make_tuple(zone, area);
 }
@@ -115,38 +1096,239 @@ py::object find_point_in_between_vectors(pathfind::Map& map, float distance, flo
     const math::Vertex start {x1, y1, z1};
     const math::Vertex end {x2, y2, z2};
     math::Vertex in_between_point {};
-    if (!map.FindPointInBetweenVectors(start, end, distance, in_between_point)) {
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindPointInBetweenVectors(start, end, distance,
+                                              in_between_point);
+    }
+
+    if (!found) {
         return py::none();
     }
 
     return py::make_tuple(in_between_point.X, in_between_point.Y, in_between_point.Z);
 }
 
-py::object find_random_point_around_circle(pathfind::Map& map, float x, float y, float z, float radius) {
+py::object find_random_point_around_circle(pathfind::Map& map, float x, float y, float z, float radius, const std::string& filter) {
     const math::Vertex start {x, y, z};
 
     math::Vertex random_point {};
-    if (!map.FindRandomPointAroundCircle(start, radius, random_point)) {
+    bool found;
+
+    {
+        py::gil_scoped_release release;
+        found = map.FindRandomPointAroundCircle(start, radius, random_point,
+                                                filter);
+    }
+
+    if (!found) {
         return py::none();
     }
 
-    return py::make_tuple(random_point.X, random_point.Y, random_point.Z);
-}
+    return py::make_tuple(random_point.X, random_point.Y, random_point.Z);
+}
+
+py::list find_random_points(pathfind::Map& map, float x, float y, float z, float radius, size_t count, std::uint64_t seed, const std::string& filter) {
+    const math::Vertex center {x, y, z};
+
+    std::vector<math::Vertex> points;
+
+    {
+        py::gil_scoped_release release;
+        map.FindRandomPoints(center, radius, count, seed, points, filter);
+    }
+
+    py::list result;
+
+    for (auto const& point : points) {
+        result.append(py::make_tuple(point.X, point.Y, point.Z));
+    }
+
+    return result;
+}
+
+} // namespace
+
+PYBIND11_MODULE(pathfind, m)
+{
+    py::enum_<PolyFlags>(m, "PolyFlags", py::arithmetic())
+        .value("GROUND", PolyFlags::Ground)
+        .value("STEEP", PolyFlags::Steep)
+        .value("LIQUID", PolyFlags::Liquid)
+        .value("WMO", PolyFlags::Wmo)
+        .value("DOODAD", PolyFlags::Doodad)
+        .value("OFF_MESH", PolyFlags::OffMesh);
+
+    py::enum_<LiquidType>(m, "LiquidType")
+        .value("WATER", LiquidType::Water)
+        .value("OCEAN", LiquidType::Ocean)
+        .value("MAGMA", LiquidType::Magma)
+        .value("SLIME", LiquidType::Slime);
+
+    py::class_<pathfind::Map::Location>(m, "Location",
+        "A position together with the navmesh polygon it was resolved to.  Create these with `Map.resolve_location`.")
+        .def_property_readonly("x",
+            [](const pathfind::Map::Location& l) { return l.m_position.X; })
+        .def_property_readonly("y",
+            [](const pathfind::Map::Location& l) { return l.m_position.Y; })
+        .def_property_readonly("z",
+            [](const pathfind::Map::Location& l) { return l.m_position.Z; });
+
+    py::class_<pathfind::PathRequest> pathRequest(m, "PathRequest");
+
+    py::enum_<pathfind::PathRequest::Status>(pathRequest, "Status")
+        .value("IN_PROGRESS", pathfind::PathRequest::Status::InProgress)
+        .value("SUCCEEDED", pathfind::PathRequest::Status::Succeeded)
+        .value("FAILED", pathfind::PathRequest::Status::Failed)
+        .value("CANCELLED", pathfind::PathRequest::Status::Cancelled);
 
-} // namespace
+    pathRequest
+        .def("update",
+            &pathfind::PathRequest::Update,
+            release_gil(),
+            "Advances the search by at most `max_iterations` nodes, returning the resulting status.",
+            py::arg("max_iterations")
+        )
+        .def("cancel",
+            &pathfind::PathRequest::Cancel,
+            "Stops the request.  This has no effect once it has finished."
+        )
+        .def("status",
+            &pathfind::PathRequest::GetStatus,
+            "Returns the status of the request."
+        )
+        .def("iterations",
+            &pathfind::PathRequest::GetIterations,
+            "Returns the number of nodes searched so far."
+        )
+        .def("path",
+            &path_request_path,
+            "Returns the list of points found once the request has succeeded, otherwise an empty list."
+        );
+
+    py::class_<pathfind::PathCorridor>(m, "PathCorridor")
+        .def("move_position",
+            [](pathfind::PathCorridor& c, float x, float y, float z) {
+                return c.MovePosition({x, y, z});
+            },
+            release_gil(),
+            "Moves the start of the corridor, searching for a new path only if it cannot simply be followed.  Returns False if no path was found.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z")
+        )
+        .def("move_target",
+            [](pathfind::PathCorridor& c, float x, float y, float z) {
+                return c.MoveTarget({x, y, z});
+            },
+            release_gil(),
+            "Moves the target of the corridor, searching for a new path only if it cannot simply be followed.  Returns False if no path was found.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z")
+        )
+        .def("corners",
+            &path_corridor_corners,
+            "Returns at most `max_corners` of the next corners of the path along the corridor.",
+            py::arg("max_corners") = 4
+        )
+        .def("path",
+            &path_corridor_path,
+            "Returns the list of points of the whole path along the corridor."
+        )
+        .def("position",
+            [](const pathfind::PathCorridor& c) {
+                auto const p = c.GetPosition();
+                return py::make_tuple(p.X, p.Y, p.Z);
+            },
+            "Returns the start of the corridor."
+        )
+        .def("target",
+            [](const pathfind::PathCorridor& c) {
+                auto const p = c.GetTarget();
+                return py::make_tuple(p.X, p.Y, p.Z);
+            },
+            "Returns the requested target of the corridor."
+        )
+        .def("replans",
+            &pathfind::PathCorridor::GetReplans,
+            "Returns the number of times a path has been searched for, including when the corridor was created."
+        );
+
+    py::class_<pathfind::Crowd>(m, "Crowd")
+        .def("add_agent",
+            [](pathfind::Crowd& c, float x, float y, float z, float radius,
+               float speed) { return c.AddAgent({x, y, z}, radius, speed); },
+            release_gil(),
+            "Adds an agent which moves at no more than `speed` yards per second, returning its index or -1 if the crowd is full or there is no navmesh nearby.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z"),
+            py::arg("radius"),
+            py::arg("speed")
+        )
+        .def("remove_agent",
+            &pathfind::Crowd::RemoveAgent,
+            "Removes an agent from the crowd.",
+            py::arg("agent")
+        )
+        .def("set_target",
+            [](pathfind::Crowd& c, int agent, float x, float y, float z) {
+                return c.SetTarget(agent, {x, y, z});
+            },
+            release_gil(),
+            "Sets the position towards which an agent steers.  Returns False if there is no navmesh nearby.",
+            py::arg("agent"),
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z")
+        )
+        .def("reset_target",
+            &pathfind::Crowd::ResetTarget,
+            "Stops an agent where it is.",
+            py::arg("agent")
+        )
+        .def("update",
+            &pathfind::Crowd::Update,
+            release_gil(),
+            "Moves every agent up to `seconds` further towards its target.",
+            py::arg("seconds")
+        )
+        .def("agent_position",
+            &crowd_agent_position,
+            "Returns the position of an agent, or None if there is no such agent.",
+            py::arg("agent")
+        )
+        .def("agent_velocity",
+            &crowd_agent_velocity,
+            "Returns the velocity of an agent, or None if there is no such agent.",
+            py::arg("agent")
+        );
 
-PYBIND11_MODULE(pathfind, m)
-{
     py::class_<pathfind::Map>(m, "Map")
-        .def(py::init<const std::string&, const std::string&>(),
+        .def(py::init(&make_map),
+            release_gil(),
+            "Loads the map `map_name` from `data_path`.  Each search for a path may visit at most `max_nodes` polygons and return at most `max_path_hops` points, while `find_short_path` visits at most `short_path_nodes`.  Each limit must be positive, and neither node count may exceed 65535.",
             py::arg("data_path"),
-            py::arg("map_name")
+            py::arg("map_name"),
+            py::arg("max_nodes") = 65535,
+            py::arg("max_path_hops") = 4096,
+            py::arg("short_path_nodes") = 128
         )
         .def("load_all_adts",
             &pathfind::Map::LoadAllADTs,
+            release_gil(),
             R"del(Loads all ADTs for the map in order for pathfinding to be immediately available everywhere on the map.
 
-This may take a while depending on the map size.)del"
+This may take a while depending on the map size.  The files are read on `threads` threads, or one per hardware thread if `threads` is 0.)del",
+            py::arg("threads") = 0
+        )
+        .def("clone_for_instance",
+            &pathfind::Map::CloneForInstance,
+            release_gil(),
+            "Creates another `Map` of the same data for a separate instance, such as one copy of a dungeon per group.  The clone shares the models of this map, and has its query filters and residency budget.  Without a budget, it loads the ADTs loaded in this map now.  Temporary obstacles are not copied."
         )
         .def("load_adt_at",
             &load_adt_at,
@@ -160,27 +1342,226 @@ This may take a while depending on the map size.)del"
             py::arg("adt_x"),
             py::arg("adt_y")
         )
+        .def("load_adt_async",
+            &load_adt_async,
+            R"del(Starts loading a specific ADT on a background thread.
+
+The ADT is only added to the map by a later call to `commit_loaded_adts`.)del",
+            py::arg("adt_x"),
+            py::arg("adt_y")
+        )
+        .def("commit_loaded_adts",
+            &pathfind::Map::CommitLoadedADTs,
+            release_gil(),
+            "Adds any ADTs which have finished loading in the background to the map, returning how many were added."
+        )
+        .def("prefetch_adts",
+            &pathfind::Map::PrefetchADTs,
+            release_gil(),
+            R"del(Starts loading, in the background, every ADT within `distance` along the direction (`dx`, `dy`) from (`x`, `y`).
+
+Returns the number of ADTs for which a load was started.)del",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("dx"),
+            py::arg("dy"),
+            py::arg("distance")
+        )
         .def(
             "find_path",
            &python_find_path,
-           R"del(Attempts to find a path between `start` and `stop`.
+           R"del(Attempts to find a path between `start` and `stop`, using only polygons which pass the query filter called `filter`.
+
+Returns a list of points if a path was found, otherwise an empty list.  An empty `filter` allows every polygon.)del",
+           py::arg("start_x"),
+           py::arg("start_y"),
+           py::arg("start_z"),
+           py::arg("stop_x"),
+           py::arg("stop_y"),
+           py::arg("stop_z"),
+           py::arg("filter") = ""
+        )
+        .def(
+            "find_short_path",
+           &find_short_path,
+           R"del(As `find_path`, for ends close together such as those of a melee chase.  The search uses a small node pool which stays in the CPU cache.
+
+Returns an empty list if the ends are more than `max_distance` apart, or if no path that long or shorter is found within the pool.)del",
+           py::arg("start_x"),
+           py::arg("start_y"),
+           py::arg("start_z"),
+           py::arg("stop_x"),
+           py::arg("stop_y"),
+           py::arg("stop_z"),
+           py::arg("max_distance"),
+           py::arg("filter") = ""
+        )
+        .def(
+            "find_agent_path",
+           &find_agent_path,
+           R"del(As `find_path`, for an agent of the size named by `agent` (see `agent_size`).  Sizes other than that of the map have meshes only when the map was built for them too, and their paths are searched directly, without regard to temporary obstacles.
+
+Returns an empty list if no path was found, or if no loaded ADT has a mesh for the agent.)del",
+           py::arg("agent"),
+           py::arg("start_x"),
+           py::arg("start_y"),
+           py::arg("start_z"),
+           py::arg("stop_x"),
+           py::arg("stop_y"),
+           py::arg("stop_z"),
+           py::arg("filter") = ""
+        )
+        .def(
+            "resolve_location",
+           &resolve_location,
+           R"del(Resolves `x`, `y`, `z` to a `Location` which can be kept and passed to later queries.
+
+When `previous` is given it is updated in place, keeping its polygon if that is still loaded and the new position is over it.  Returns `None` if there is no navmesh near the position.)del",
+           py::arg("x"),
+           py::arg("y"),
+           py::arg("z"),
+           py::arg("previous") = nullptr,
+           py::arg("filter") = ""
+        )
+        .def(
+            "find_path_between_locations",
+           &find_path_between_locations,
+           R"del(Same as `find_path`, but between two `Location`s, which skips searching for their polygons while they remain valid.
+
+Either location is updated if its polygon had to be found again.)del",
+           py::arg("start"),
+           py::arg("stop"),
+           py::arg("filter") = ""
+        )
+        .def(
+            "find_refined_path",
+           &find_refined_path,
+           R"del(Same as `find_path`, but with the height of each point found precisely, as `query_z` would find it.
+
+When `spacing` is positive, points are added along each segment so that none is more than `spacing` from the next.)del",
+           py::arg("start_x"),
+           py::arg("start_y"),
+           py::arg("start_z"),
+           py::arg("stop_x"),
+           py::arg("stop_y"),
+           py::arg("stop_z"),
+           py::arg("spacing") = 0.f,
+           py::arg("filter") = ""
+        )
+        .def(
+            "find_nearest_point",
+           &find_nearest_point,
+           "Returns the (x, y, z) point of the navmesh nearest to the given point, searching a box of the given half extents around it and using only polygons which pass the query filter called `filter`, or `None` if no polygon intersects the box.",
+           py::arg("x"),
+           py::arg("y"),
+           py::arg("z"),
+           py::arg("extent_x") = 5.f,
+           py::arg("extent_y") = 5.f,
+           py::arg("extent_z") = 5.f,
+           py::arg("filter") = ""
+        )
+        .def(
+            "find_nearest_point",
+           &find_nearest_point_from_location,
+           "Same as above, but from a `Location`, which skips searching for its polygon while it remains valid, and is updated otherwise.",
+           py::arg("location"),
+           py::arg("extent_x") = 5.f,
+           py::arg("extent_y") = 5.f,
+           py::arg("extent_z") = 5.f,
+           py::arg("filter") = ""
+        )
+        .def(
+            "distance_to_wall",
+           &distance_to_wall,
+           R"del(Returns a tuple of the distance from the given point to the nearest edge of the navmesh which cannot be crossed, the (x, y, z) point of that edge nearest to it, and the horizontal normal of the edge facing it, searching within `radius`.
+
+When there is no such edge within `radius` the distance is `radius` and the point and normal are zero.  Returns `None` if there is no navmesh near the point.)del",
+           py::arg("x"),
+           py::arg("y"),
+           py::arg("z"),
+           py::arg("radius"),
+           py::arg("filter") = ""
+        )
+        .def(
+            "distance_to_wall",
+           &distance_to_wall_from_location,
+           "Same as above, but from a `Location`, which skips searching for its polygon while it remains valid, and is updated otherwise.",
+           py::arg("location"),
+           py::arg("radius"),
+           py::arg("filter") = ""
+        )
+        .def(
+            "create_path_request",
+           &create_path_request,
+           release_gil(),
+           R"del(Starts a search for a path between `start` and `stop` which is advanced by calling `update` on the returned `PathRequest`.
 
-Returns a list of points if a path was found, otherwise an empty list.)del",
+This allows an expensive search to be spread across several calls, or abandoned.)del",
            py::arg("start_x"),
            py::arg("start_y"),
            py::arg("start_z"),
            py::arg("stop_x"),
            py::arg("stop_y"),
-           py::arg("stop_z")
+           py::arg("stop_z"),
+           py::keep_alive<0, 1>()
+        )
+        .def(
+            "create_path_corridor",
+           &create_path_corridor,
+           release_gil(),
+           R"del(Creates a corridor between `start` and `stop` which follows either end as it moves with `move_position` and `move_target`, rather than searching for a new path each time.)del",
+           py::arg("start_x"),
+           py::arg("start_y"),
+           py::arg("start_z"),
+           py::arg("stop_x"),
+           py::arg("stop_y"),
+           py::arg("stop_z"),
+           py::arg("filter") = "",
+           py::keep_alive<0, 1>()
+        )
+        .def(
+            "create_crowd",
+           &pathfind::Map::CreateCrowd,
+           release_gil(),
+           R"del(Creates a crowd of at most `max_agents` agents, none wider than `max_agent_radius`, which are steered around one another.)del",
+           py::arg("max_agents"),
+           py::arg("max_agent_radius"),
+           py::arg("filter") = "",
+           py::keep_alive<0, 1>()
+        )
+        .def(
+            "find_paths",
+           &python_find_paths,
+           R"del(Attempts to find a path for each `(start_x, start_y, start_z, stop_x, stop_y, stop_z)` tuple in `queries`.
+
+Returns a list containing one list of points per query, which is empty when no path was found.  If `threads` is greater than one the queries are divided between that many threads.)del",
+           py::arg("queries"),
+           py::arg("threads") = 1,
+           py::arg("filter") = ""
         )
         .def("query_heights",
             &python_query_heights,
-            "Finds all Z values for a given `x`, `y` coordinate.",
+            "Finds all Z values for a given `x`, `y` coordinate.  When not `precise` and the map was built with `surface_heights`, the Z values of walkable model surfaces are read from the map data rather than found by casting a ray, and are accurate to within a voxel's height.",
             py::arg("x"),
-            py::arg("y")
+            py::arg("y"),
+            py::arg("precise") = true
+        )
+        .def("query_heights_grid",
+            &python_query_heights_grid,
+            R"del(Finds all Z values for each point of the `nx` by `ny` grid starting at `x0`, `y0` with spacing `dx`, `dy`.
+
+Returns one list of Z values per point, for point `(x0 + i * dx, y0 + j * dy)` at index `j * nx + i`.  `precise` is as for `query_heights`.)del",
+            py::arg("x0"),
+            py::arg("y0"),
+            py::arg("dx"),
+            py::arg("dy"),
+            py::arg("nx"),
+            py::arg("ny"),
+            py::arg("precise") = true
         )
         .def("query_z",
             &python_query_z,
+            release_gil(),
             R"del(Returns the `stop_z` value for a given `start_x`, `start_y`, `start_z` and `stop_x`, `stop_y`.
 
 This is the value that would be achieved by walking from start to stop.)del",
@@ -197,6 +1578,18 @@ This is the value that would be achieved by walking from start to stop.)del",
             py::arg("y"),
             py::arg("z")
         )
+        .def("get_zone_and_area",
+            &get_zone_and_area_from_location,
+            "Same as above, but for the navmesh polygon of a `Location`, whose zone and area are kept once found, so that asking again while it remains on the same polygon casts no rays.",
+            py::arg("location")
+        )
+        .def("get_liquid_level",
+            &get_liquid_level,
+            "Returns a tuple of the height and `LiquidType` of the liquid surface at the given `x`, `y` which `z` is beneath, or else of the highest liquid below `z`, so that the height is at least `z` when the point is submerged.  Returns `None` if there is no liquid there.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z")
+        )
         .def("find_point_in_between_vectors",
             &find_point_in_between_vectors,
             "Returns a point in between two vectors given a distance.",
@@ -210,30 +1603,264 @@ This is the value that would be achieved by walking from start to stop.)del",
         )
         .def("find_random_point_around_circle",
             &find_random_point_around_circle,
-            "Returns a random point from a circle within or slightly outside of the given radius.",
+            "Returns a random point from a circle within or slightly outside of the given radius, using only polygons which pass the query filter called `filter`.",
             py::arg("x"),
             py::arg("y"),
             py::arg("z"),
-            py::arg("radius")
+            py::arg("radius"),
+            py::arg("filter") = ""
+        )
+        .def("find_random_points",
+            &find_random_points,
+            "Returns a list of up to `count` (x, y, z) tuples, uniformly distributed over the area within `radius` of the given point which can be reached from it, using only polygons which pass the query filter called `filter`.  The same `seed` gives the same points for as long as the navmesh is unchanged.  Fewer points are returned when little of the area reachable lies within the circle.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z"),
+            py::arg("radius"),
+            py::arg("count"),
+            py::arg("seed"),
+            py::arg("filter") = ""
+        )
+        .def("set_query_filter",
+            &pathfind::Map::SetQueryFilter,
+            release_gil(),
+            R"del(Registers a query filter called `name`, replacing any existing filter of that name.
+
+A polygon passes the filter when its flags include at least one of `include_flags` and none of `exclude_flags` (see `PolyFlags`).  The filters `"avoid water"`, `"ground only"` and `"swimmer"` exist by default.)del",
+            py::arg("name"),
+            py::arg("include_flags"),
+            py::arg("exclude_flags") = 0
+        )
+        .def("add_off_mesh_connection",
+            &add_off_mesh_connection,
+            release_gil(),
+            R"del(Adds a link from the start to the end point which paths may take even though it cannot be walked, such as an elevator or a ledge, returning its id.
+
+The tile containing the start is rebuilt, and the end must lie within that tile or one of its neighbours.  A tile built without its height field cannot be rebuilt, and raises an error.  Unless `bidirectional`, the link may only be taken from its start.)del",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("end_x"),
+            py::arg("end_y"),
+            py::arg("end_z"),
+            py::arg("radius"),
+            py::arg("bidirectional") = true
+        )
+        .def("remove_off_mesh_connection",
+            &pathfind::Map::RemoveOffMeshConnection,
+            release_gil(),
+            "Removes a link added by `add_off_mesh_connection`.",
+            py::arg("id")
         )
         .def("has_adts",
             &has_adts,
             "Checks if the map has any ADT."
         )
+        .def("agent_size",
+            [](const pathfind::Map& map) {
+                return std::string(map.GetAgentProfile().m_name);
+            },
+            "The name of the size of agent the map was built for: `default`, `small` or `large`.  This is `default` until an ADT is loaded."
+        )
         .def("adt_loaded",
             &adt_loaded,
             "Checks if a specific ADT is loaded.",
             py::arg("adt_x"),
             py::arg("adt_y")
         )
+        .def("set_residency_budget",
+            &pathfind::Map::SetResidencyBudget,
+            release_gil(),
+            R"del(Sets the number of bytes of ADT data the map may keep loaded.
+
+Once set, queries load the ADTs they touch on demand, and the least recently used ADTs are unloaded when over budget.  A `budget` of `0` disables this.)del",
+            py::arg("budget")
+        )
+        .def("set_path_load_budget",
+            &pathfind::Map::SetPathLoadBudget,
+            "Sets the number of unloaded ADTs each `find_path` call may load to complete its path.  A `budget` of `0`, the default, disables this.",
+            py::arg("adts")
+        )
+        .def("set_model_load_threads",
+            &pathfind::Map::SetModelLoadThreads,
+            "Sets how many threads each ADT load may read and deserialize the collision models it needs on, before its tiles are built.  The default is `4`, and `1` loads them one at a time.",
+            py::arg("threads")
+        )
+        .def("residency_stats",
+            &residency_stats,
+            "Returns a dict of the residency budget, resident bytes and ADTs, and the hit, miss and eviction counters."
+        )
+        .def("compact",
+            &pathfind::Map::Compact,
+            release_gil(),
+            R"del(Removes the entries of unloaded models and obstacles from the map's caches, returning how many were removed.
+
+This also happens incrementally, so calling it is optional.)del"
+        )
+        .def("cache_stats",
+            &cache_stats,
+            "Returns a dict of the live and expired entries in the map's caches, and the bytes held by the collision data of the live models."
+        )
+        .def("memory_stats",
+            &memory_stats,
+            R"del(Returns a dict of the bytes held by the map, with a list of those held for each loaded ADT under `adts`.
+
+Models are shared between ADTs, so the `model_bytes` of each ADT counts every model its tiles reference, while that of the map counts each loaded model once.  The mapped nav files are not included in `total_bytes`.)del"
+        )
+        .def("preload_models",
+            &preload_models,
+            release_gil(),
+            R"del(Loads the models at `mpq_paths` in the game data, and those of the game objects with `display_ids`, on `threads` threads, and keeps them loaded until `release_preloaded_models`.
+
+Returns the number of models loaded once every one has been tried.  Unknown models are skipped.)del",
+            py::arg("mpq_paths") = std::vector<std::string>(),
+            py::arg("display_ids") = std::vector<unsigned int>(),
+            py::arg("threads") = 1
+        )
+        .def("preload_model_manifest",
+            &preload_model_manifest,
+            release_gil(),
+            "As `preload_models`, for the models listed by a manifest from `save_model_manifest`.",
+            py::arg("manifest"),
+            py::arg("threads") = 1
+        )
+        .def("save_model_manifest",
+            &save_model_manifest,
+            release_gil(),
+            "Writes a manifest of every model now loaded, to be preloaded by a later run, returning how many there were.",
+            py::arg("manifest")
+        )
+        .def("release_preloaded_models",
+            &pathfind::Map::ReleasePreloadedModels,
+            release_gil(),
+            "Lets the models loaded by `preload_models` unload once nothing else uses them."
+        )
+        .def("set_path_cache_capacity",
+            &pathfind::Map::SetPathCacheCapacity,
+            R"del(Sets how many polygon corridors the map may cache for path queries.
+
+Paths between the same pair of polygons reuse the cached corridor until a tile it passes through is unloaded or rebuilt.  A `capacity` of `0`, the default, disables the cache.)del",
+            py::arg("capacity")
+        )
+        .def("set_line_of_sight_cache",
+            [](pathfind::Map& map, size_t capacity, unsigned int ttl_ms,
+               float spacing) {
+                map.SetLineOfSightCache(
+                    capacity, std::chrono::milliseconds(ttl_ms), spacing);
+            },
+            R"del(Sets how many `line_of_sight` results the map may cache, for how many milliseconds, and to what grid of `spacing` yards the ends of each ray are rounded for the lookup.
+
+Results are dropped early when a tile between the ends is loaded, unloaded or has its temporary obstacles changed.  A `capacity` of `0`, the default, disables the cache.)del",
+            py::arg("capacity"),
+            py::arg("ttl_ms") = 250,
+            py::arg("spacing") = 0.25f
+        )
+        .def("set_straight_path_distance",
+            &pathfind::Map::SetStraightPathDistance,
+            R"del(Sets the distance within which path queries first try a ray cast along the navmesh surface, returning the straight line without any search when nothing is in the way.
+
+This is usually so for short chases.  A `distance` of `0`, the default, disables it.  The hits are counted as `straight_paths` in `metrics()`.)del",
+            py::arg("distance")
+        )
+        .def("enable_reachability",
+            &pathfind::Map::EnableReachability,
+            R"del(Makes `find_path` fail immediately, without searching, when the ends are not connected within the loaded navmesh (see `is_reachable`).
+
+Partial paths are still searched.  This is disabled by default.  The skipped searches are counted as `unreachable` failures in `metrics()`.)del",
+            py::arg("enabled")
+        )
+        .def("is_reachable",
+            &is_reachable,
+            R"del(Returns whether the navmesh nearest `start` is connected to that nearest `stop` within the loaded navmesh.
+
+Polygon flags are ignored, so `False` means that no path exists while `True` only means that one may.  The connections are found on the first call after tiles are loaded, unloaded or rebuilt, after which each call takes constant time.)del",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("stop_x"),
+            py::arg("stop_y"),
+            py::arg("stop_z"),
+            py::arg("filter") = ""
+        )
+        .def("is_reachable",
+            &is_reachable_between_locations,
+            "Same as above, but between two `Location`s, which skips searching for their polygons while they remain valid.",
+            py::arg("start"),
+            py::arg("stop"),
+            py::arg("filter") = ""
+        )
+        .def("query_instances",
+            &query_instances,
+            R"del(Returns a list of the static WMO and doodad instances, and game objects, whose bounds are within `radius` of the given point, whether or not the ADTs beneath them are loaded.
+
+Each is a dict of its `id` (the unique id of a static instance or the guid of a game object), whether it is a `wmo` and a `game_object`, its `model` path, and the `min` and `max` corners of its bounds.)del",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z"),
+            py::arg("radius")
+        )
+        .def("path_cache_stats",
+            &path_cache_stats,
+            "Returns a dict of the path cache capacity and entries, and the hit, miss and invalidation counters."
+        )
+        .def("line_of_sight_cache_stats",
+            &line_of_sight_cache_stats,
+            "Returns a dict of the line of sight cache capacity and entries, and the hit, miss, expiration and invalidation counters."
+        )
+        .def("enable_metrics",
+            &pathfind::Map::EnableMetrics,
+            "Starts counting and timing the queries made of the map, or stops when `enabled` is `False`.  This is disabled by default.",
+            py::arg("enabled") = true
+        )
+        .def("metrics",
+            &metrics,
+            R"del(Returns a dict of the counters gathered since metrics were enabled or last reset.
+
+`queries` maps the name of each query, such as `find_path`, to a dict of its `calls`, their total `seconds`, and a `latency` histogram of (upper bound in seconds, count) pairs, the last of which is unbounded.  `failures` maps reasons path searches failed, such as `no_start_poly` or `partial_path`, to their counts.  `tiles_traversed`, `bvh_nodes` and `bvh_faces` count the work done by ray casts, `straight_paths` the path searches answered by a navmesh ray cast (see `set_straight_path_distance`), and `portal_routes` those routed across ADTs through the portal graph.)del"
+        )
+        .def("reset_metrics",
+            &pathfind::Map::ResetMetrics,
+            "Sets every metrics counter back to zero."
+        )
+        .def("start_recording",
+            &start_recording,
+            "Logs the path, height, zone and line of sight queries made of the map from here on to `path`, replacing it, so that they can be replayed later by `pathfind_replay`.  Returns `False` if the file could not be written.",
+            py::arg("path")
+        )
+        .def("stop_recording",
+            &pathfind::Map::StopRecording,
+            "Stops recording queries, and flushes those recorded to the file."
+        )
         .def("unload_adt",
             &unload_adt,
+            release_gil(),
             "Unloads a specific ADT.",
             py::arg("adt_x"),
             py::arg("adt_y")
         )
+        .def("reload_adt",
+            &pathfind::Map::ReloadADT,
+            release_gil(),
+            "Replaces the tiles of a loaded ADT with those of its current nav file, keeping temporary obstacles.  Returns `False` if the ADT is not loaded.",
+            py::arg("adt_x"),
+            py::arg("adt_y")
+        )
+        .def("watch_nav_files",
+            [](pathfind::Map& map, int interval_ms) {
+                map.WatchNavFiles(std::chrono::milliseconds(interval_ms));
+            },
+            release_gil(),
+            "Polls the nav files of the loaded ADTs every `interval_ms` milliseconds, reloading those which change.  An interval of `0` stops polling.",
+            py::arg("interval_ms")
+        )
+        .def("prepare_fork",
+            &pathfind::Map::PrepareFork,
+            release_gil(),
+            "Stops the background threads of the map, so that the process may fork, for example to start a `multiprocessing` pool with the `fork` start method.  Every child then shares the loaded tiles and models of the map with the parent, copy on write, rather than loading its own, so load everything to be searched first.  Nav file watching and rebuild threads must be set again afterwards if wanted."
+        )
         .def("line_of_sight",
             &los,
+            release_gil(),
             R"del(Checks for line of sight from `start` to `stop`.
 
 If `doodads` is `False` doodads will not be considered during calculations.)del",
@@ -244,5 +1871,221 @@ If `doodads` is `False` doodads will not be considered during calculations.)del"
             py::arg("stop_y"),
             py::arg("stop_z"),
             py::arg("doodads")
+        )
+        .def("line_of_sight_batch",
+            &los_batch,
+            R"del(Checks for line of sight for each `(start_x, start_y, start_z, stop_x, stop_y, stop_z)` tuple in `queries`.
+
+Returns a list of booleans, one per query.  If `doodads` is `False` doodads will not be considered during calculations.)del",
+            py::arg("queries"),
+            py::arg("doodads")
+        )
+        .def("ray_cast",
+            &ray_cast,
+            R"del(Casts a ray from the start to the stop position, returning `None` if it hits nothing.
+
+Otherwise returns a dict describing the closest surface along it, with its `kind` ("terrain", "wmo", "doodad", "temporary_wmo" or "temporary_doodad"), the `id` of the instance (the unique id of a static instance, the guid of a game object, or 0 for the terrain), the hit `point`, the `normal` of the face facing back towards the start, and the `distance` from the start.  Unlike `line_of_sight` this considers the ADT terrain.  If `doodads` is `False` doodads and game objects will not be considered.)del",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("stop_x"),
+            py::arg("stop_y"),
+            py::arg("stop_z"),
+            py::arg("doodads") = true
+        )
+        .def("line_of_sight_fan",
+            &los_fan,
+            R"del(Checks for line of sight from the origin, raised by `origin_height`, to each `(x, y, z, eye_height)` tuple in `targets`, each raised by its `eye_height`.
+
+Returns a list of booleans, one per target.  This is faster than `line_of_sight_batch` for the targets of one caster.  If `doodads` is `False` doodads will not be considered during calculations.)del",
+            py::arg("origin_x"),
+            py::arg("origin_y"),
+            py::arg("origin_z"),
+            py::arg("origin_height"),
+            py::arg("targets"),
+            py::arg("doodads")
+        )
+        .def("sweep_capsule",
+            &sweep_capsule,
+            R"del(Sweeps an upright capsule of `radius` and `height`, standing at `start`, towards `stop`, as for a charge or a knockback.
+
+Returns the (x, y, z) point where it first touches a WMO, a doodad (unless `doodads` is `False`) or an edge of the navmesh (unless `nav_mesh` is `False`), or `None` if it reaches `stop`.  Geometry lower than a step is left to the navmesh.  The point lies on the line from `start` to `stop`, so its height may need to be found again.)del",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("stop_x"),
+            py::arg("stop_y"),
+            py::arg("stop_z"),
+            py::arg("radius"),
+            py::arg("height"),
+            py::arg("nav_mesh") = true,
+            py::arg("doodads") = true
+        )
+        .def("find_paths_array",
+            &find_paths_array,
+            R"del(As `find_paths`, for an `(N, 6)` NumPy array of `start_x, start_y, start_z, stop_x, stop_y, stop_z` rows.
+
+Returns a tuple of an `(M, 3)` float32 array holding the points of every path one after another, and an array of `N + 1` offsets into it, so that rows `offsets[i]` to before `offsets[i + 1]` are the path of query `i`.  An empty path means that none was found.  The GIL is released while the paths are found.)del",
+            py::arg("queries"),
+            py::arg("threads") = 1,
+            py::arg("filter") = ""
+        )
+        .def("line_of_sight_array",
+            &los_array,
+            R"del(As `line_of_sight_batch`, for an `(N, 6)` NumPy array of `start_x, start_y, start_z, stop_x, stop_y, stop_z` rows.
+
+Returns a boolean array with one element per query.  The GIL is released while the checks are made.)del",
+            py::arg("queries"),
+            py::arg("doodads")
+        )
+        .def("query_z_array",
+            &query_z_array,
+            R"del(As `query_z`, for an `(N, 5)` NumPy array of `start_x, start_y, start_z, stop_x, stop_y` rows.
+
+Returns a float32 array with one Z value per query, which is NaN where none was found.  The GIL is released while the values are found.)del",
+            py::arg("queries")
+        );
+
+    py::class_<pathfind::MapManager>(m, "MapManager")
+        .def(py::init<const std::string&>(),
+            release_gil(),
+            py::arg("data_path")
+        )
+        .def("create_map",
+            &manager_create_map,
+            release_gil(),
+            "Creates a `Map` of `map_name` whose collision models are shared with every other map created by this manager, so that instances of the same map read and hold each model once.  The map remains valid after the manager is gone.  The limits are those of the `Map` constructor.",
+            py::arg("map_name"),
+            py::arg("max_nodes") = 65535,
+            py::arg("max_path_hops") = 4096,
+            py::arg("short_path_nodes") = 128
+        )
+        .def("model_stats",
+            &manager_model_stats,
+            "Returns a dict of the live and expired model entries of the shared cache, and the bytes held by the live models, across every map created by this manager."
+        )
+        .def("compact",
+            &pathfind::MapManager::Compact,
+            "Removes the entries of models which no map uses any more, returning how many were removed."
+        );
+
+    py::class_<pathfind::TransportMap>(m, "TransportMap",
+        "The navmesh of a transport, built by MapBuilder from its wmo alone in the coordinates of the model, and so valid wherever the transport moves.  Queries are answered in those local coordinates, or in world coordinates through the transform given to `set_transform`.")
+        .def(py::init<const std::string&, const std::string&>(),
+            release_gil(),
+            "Loads the transport `transport_name` from `data_path`, as MapBuilder named it.",
+            py::arg("data_path"),
+            py::arg("transport_name")
+        )
+        .def_property_readonly("map",
+            [](pathfind::TransportMap& t) -> pathfind::Map& {
+                return t.GetMap();
+            },
+            py::return_value_policy::reference_internal,
+            "The `Map` of the transport, in its local coordinates.")
+        .def("set_transform",
+            [](pathfind::TransportMap& t, float x, float y, float z,
+               float orientation) { t.SetTransform({x, y, z}, orientation); },
+            release_gil(),
+            "Places the transport at (`x`, `y`, `z`) in the world, turned by `orientation` radians about the z axis.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z"),
+            py::arg("orientation")
+        )
+        .def("to_local",
+            [](const pathfind::TransportMap& t, float x, float y, float z) {
+                auto const local = t.ToLocal({x, y, z});
+                return py::make_tuple(local.X, local.Y, local.Z);
+            },
+            "Converts a point in world coordinates to those of the transport.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z")
+        )
+        .def("to_world",
+            [](const pathfind::TransportMap& t, float x, float y, float z) {
+                auto const world = t.ToWorld({x, y, z});
+                return py::make_tuple(world.X, world.Y, world.Z);
+            },
+            "Converts a point in the coordinates of the transport to those of the world.",
+            py::arg("x"),
+            py::arg("y"),
+            py::arg("z")
+        )
+        .def("find_path",
+            [](const pathfind::TransportMap& t, float start_x, float start_y,
+               float start_z, float stop_x, float stop_y, float stop_z,
+               const std::string& filter) {
+                return transport_find_path(t, false, start_x, start_y,
+                                           start_z, stop_x, stop_y, stop_z,
+                                           filter);
+            },
+            "As `Map.find_path`, with the ends and the path in the coordinates of the transport.",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("stop_x"),
+            py::arg("stop_y"),
+            py::arg("stop_z"),
+            py::arg("filter") = ""
+        )
+        .def("find_world_path",
+            [](const pathfind::TransportMap& t, float start_x, float start_y,
+               float start_z, float stop_x, float stop_y, float stop_z,
+               const std::string& filter) {
+                return transport_find_path(t, true, start_x, start_y,
+                                           start_z, stop_x, stop_y, stop_z,
+                                           filter);
+            },
+            "As `find_path`, with the ends and the path in world coordinates.",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("stop_x"),
+            py::arg("stop_y"),
+            py::arg("stop_z"),
+            py::arg("filter") = ""
+        )
+        .def("line_of_sight",
+            [](const pathfind::TransportMap& t, float start_x, float start_y,
+               float start_z, float stop_x, float stop_y, float stop_z,
+               bool doodads, bool world) {
+                return world ? t.WorldLineOfSight({start_x, start_y, start_z},
+                                                  {stop_x, stop_y, stop_z},
+                                                  doodads)
+                             : t.LineOfSight({start_x, start_y, start_z},
+                                             {stop_x, stop_y, stop_z},
+                                             doodads);
+            },
+            release_gil(),
+            "Checks for line of sight from `start` to `stop` against the transport alone, in its coordinates or, when `world` is `True`, in those of the world.",
+            py::arg("start_x"),
+            py::arg("start_y"),
+            py::arg("start_z"),
+            py::arg("stop_x"),
+            py::arg("stop_y"),
+            py::arg("stop_z"),
+            py::arg("doodads"),
+            py::arg("world") = false
         );
+
+    m.def("install_allocator",
+         &install_allocator,
+         "Installs a pooling allocator for Recast and Detour, which keeps freed blocks for reuse to limit heap fragmentation under frequent temporary obstacle changes: up to `thread_cache_bytes` of temporary blocks per thread, and up to `shared_cache_bytes` of permanent ones.  This must be called before any `Map` is created.  Returns `False` if it was already installed.",
+         py::arg("thread_cache_bytes") = std::uint64_t {8 << 20},
+         py::arg("shared_cache_bytes") = std::uint64_t {32 << 20});
+    m.def("allocator_stats",
+         &allocator_stats,
+         "Returns a dict of the bytes in use by Recast and Detour, by whether they were allocated for permanent or temporary use, the bytes of freed blocks held for reuse, and how many allocations there were and how many reused a block.  These are all zero unless `install_allocator()` was called.");
+    m.def("start_trace",
+         &utility::Trace::Start,
+         "Begins collecting trace events around ADT loads, file decompression and temporary obstacle rebuilds, discarding any collected before.  Tracing is off by default.");
+    m.def("stop_trace",
+         &utility::Trace::Stop,
+         "Stops collecting trace events, keeping those already collected.");
+    m.def("save_trace",
+         &utility::Trace::Save,
+         "Writes the trace events collected so far to `path` as Chrome trace JSON, for viewing in chrome://tracing or Perfetto.  Returns `False` if the file could not be written.",
+         py::arg("path"));
 }
@@ -111,6 +111,43 @@ def test_use_data(nav_data):
 
     print('Undercity area check succeeded')
 
+def time_line_of_sight(map_data, queries, iterations=100):
+    map_data.reset_metrics()
+    start = time.time()
+    for _ in range(iterations):
+        for query in queries:
+            map_data.line_of_sight(*query, False)
+    elapsed = (time.time() - start) / (iterations * len(queries))
+    return elapsed, map_data.metrics()
+
+def test_line_of_sight_scaling(nav_data):
+    azeroth = pathfind.Map(nav_data, 'Azeroth')
+    azeroth.enable_metrics()
+
+    # the ADT of every end of every ray, so that loading the rest adds no
+    # tile which any of them crosses
+    azeroth.load_adt_at(1926, 1548.88)
+
+    queries = [
+        (1942.09863, 1541.59216, 92.514, 1940.185, 1522.914, 90.229),
+        (1926.0, 1548.88, 95.0, 1950.0, 1560.0, 95.0),
+        (1930.0, 1530.0, 150.0, 1930.0, 1530.0, 50.0),
+    ]
+
+    # line of sight cost should depend on the tiles the ray crosses, not on
+    # how many tiles are loaded
+    few_tiles, few_metrics = time_line_of_sight(azeroth, queries)
+    azeroth.load_all_adts()
+    all_tiles, all_metrics = time_line_of_sight(azeroth, queries)
+
+    print('Line of sight: %.2f us with one ADT loaded, %.2f us with all ADTs loaded' % (
+        few_tiles * 1e6, all_tiles * 1e6))
+
+    # the timings are only informative.  the work done is what must not grow
+    for counter in ('tiles_traversed', 'bvh_nodes', 'bvh_faces'):
+        assert all_metrics[counter] == few_metrics[counter], (
+            counter, few_metrics[counter], all_metrics[counter])
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument('-d', '--wowdata', help='Path to wow data', required=True)
@@ -134,6 +171,7 @@ def main():
             test_build_data(args.wowdata, args.navdata, args.jobs)
 
         test_use_data(args.navdata)
+        test_line_of_sight_scaling(args.navdata)
     finally:
         if args.build_nav_data:
             shutil.rmtree(args.navdata)
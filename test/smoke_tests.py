@@ -3,6 +3,7 @@
 import os
 import sys
 import tempfile
+import threading
 import shutil
 import time
 import math
@@ -24,25 +25,46 @@ def test_build(temp_dir):
 		raise Exception("map_files_exist returned True when it should be False")
 
 	start = time.time()
-	mapbuild.build_map(data_dir, temp_dir, "development", 8, "")
+	reports = []
+	stats = mapbuild.build_map(data_dir, temp_dir, "development", 8, "", progress=reports.append)
 	stop = time.time()
 
+	if stats["cancelled"] or not reports or reports[-1]["completed_tiles"] != reports[-1]["total_tiles"]:
+		raise Exception("Build progress did not reach every tile: {}".format(stats))
+
 	print("Map development built in {} seconds".format(int(stop-start)))
 
 	start = time.time()
-	mapbuild.build_map(data_dir, temp_dir, "bladesedgearena", 8, "");
+	mapbuild.build_map(data_dir, temp_dir, "bladesedgearena", 8, "", pack_bvh=True);
 	stop = time.time()
 
 	print("Map bladesedgearena built in {} seconds".format(int(stop-start)))
 
+	# every later query loads its models from the pack
+	if not os.path.isfile(os.path.join(temp_dir, "BVH", "bvh.pack")):
+		raise Exception("BVH pack was not written")
+
 	if not mapbuild.map_files_exist(temp_dir, "development"):
 		raise Exception("map_files_exist returned False when it should be True")
 	if not mapbuild.bvh_files_exist(temp_dir):
 		raise Exception("map_files_exist returned False when it should be True")
 
 def test_pathfind(temp_dir):
+	if not pathfind.install_allocator() or pathfind.install_allocator():
+		raise Exception("install_allocator did not install exactly once")
+
 	map_data = pathfind.Map(temp_dir, "development")
 
+	if pathfind.allocator_stats()["permanent_bytes"] == 0:
+		raise Exception("Allocator was not used by the navmesh")
+
+	try:
+		pathfind.Map(temp_dir, "development", max_path_hops=0)
+	except RuntimeError:
+		pass
+	else:
+		raise Exception("Map accepted a path hop limit of zero")
+
 	x = 16271.025391
 	y = 16845.421875
 
@@ -51,12 +73,45 @@ def test_pathfind(temp_dir):
 	map_data.load_adt(0, 1)
 	if not map_data.adt_loaded(0, 1):
 		raise Exception("adt_loaded returned False after loading ADT")
+	if not map_data.reload_adt(0, 1) or not map_data.adt_loaded(0, 1):
+		raise Exception("reload_adt did not reload loaded ADT")
 	map_data.unload_adt(0, 1)
+	if map_data.reload_adt(0, 1):
+		raise Exception("reload_adt returned True for unloaded ADT")
 	if map_data.adt_loaded(0, 1):
 		raise Exception("adt_loaded returned True when should be False after unloading")
 
+	map_data.load_adt_async(0, 1)
+	for _ in range(0, 1000):
+		if map_data.commit_loaded_adts() > 0:
+			break
+		time.sleep(0.01)
+	if not map_data.adt_loaded(0, 1):
+		raise Exception("adt_loaded returned False after committing asynchronous load")
+	map_data.unload_adt(0, 1)
+
+	map_data.set_residency_budget(1)
+	map_data.query_heights(x, y)
+	stats = map_data.residency_stats()
+	if stats["misses"] != 1 or stats["resident_adts"] != 1:
+		raise Exception("Residency did not load ADT on demand: {}".format(stats))
+	map_data.set_residency_budget(0)
+
+	map_data.compact()
+	stats = map_data.cache_stats()
+	if stats["expired_wmo_models"] != 0 or stats["expired_doodad_models"] != 0:
+		raise Exception("Compact left expired models: {}".format(stats))
+
 	adt_x, adt_y = map_data.load_adt_at(x, y)
 
+	stats = map_data.memory_stats()
+	adts = [(adt["x"], adt["y"]) for adt in stats["adts"]]
+	if (adt_x, adt_y) not in adts or stats["total_bytes"] == 0:
+		raise Exception("Memory stats missing loaded ADT: {}".format(stats))
+
+	if map_data.agent_size() != "default":
+		raise Exception("Map built for agent size {}".format(map_data.agent_size()))
+
 	z_values = map_data.query_heights(x, y)
 
 	expected_z_values = [35.610786, 46.300201]
@@ -77,6 +132,12 @@ def test_pathfind(temp_dir):
 
 	print("Z value check succeeded")
 
+	grid = map_data.query_heights_grid(x - 1, y, 1, 1, 3, 1)
+	if len(grid) != 3 or sorted(grid[1]) != z_values:
+		raise Exception("Grid heights {} differ from single heights {}".format(grid, z_values))
+
+	print("Grid Z value check succeeded")
+
 	def compute_path_length(path):
 		result = 0
 		for i in range(1, len(path)):
@@ -96,12 +157,188 @@ def test_pathfind(temp_dir):
 		raise Exception("Path invalid.  Length: {} Distance: {}".format(
 			len(path), path_length))
 
+	if map_data.find_short_path(16303.294922, 16789.242188, 45.219631,
+		16200.139648, 16834.345703, 37.028622, path_length / 2):
+		raise Exception("Short path search ignored its maximum distance")
+
+	if map_data.find_agent_path("default", 16303.294922, 16789.242188, 45.219631,
+		16200.139648, 16834.345703, 37.028622) != path:
+		raise Exception("Agent path differs from path of the map's agent")
+
+	if map_data.find_agent_path("small", 16303.294922, 16789.242188, 45.219631,
+		16200.139648, 16834.345703, 37.028622):
+		raise Exception("Found path for agent the map was not built for")
+
 	print("Pathfind check succeeded")
 
+	query = (16303.294922, 16789.242188, 45.219631, 16200.139648, 16834.345703, 37.028622)
+	for threads in (1, 4):
+		paths = map_data.find_paths([query] * 8, threads)
+
+		if len(paths) != 8:
+			raise Exception("Expected 8 paths, found {}".format(len(paths)))
+
+		for batch_path in paths:
+			if batch_path != path:
+				raise Exception("Batch path differs from single path")
+
+	print("Batch pathfind check succeeded")
+
+	# queries release the GIL, so that python threads search at once
+	thread_paths = [None] * 4
+	def find_thread_path(i):
+		thread_paths[i] = map_data.find_path(*query)
+	threads = [threading.Thread(target=find_thread_path, args=(i,)) for i in range(0, 4)]
+	for thread in threads:
+		thread.start()
+	for thread in threads:
+		thread.join()
+	if any(thread_path != path for thread_path in thread_paths):
+		raise Exception("Path found by a python thread differs from single path")
+
+	print("Threaded pathfind check succeeded")
+
+	map_data.set_path_cache_capacity(16)
+	for _ in range(0, 2):
+		if map_data.find_path(*query) != path:
+			raise Exception("Cached path differs from uncached path")
+	stats = map_data.path_cache_stats()
+	if stats["hits"] != 1 or stats["misses"] != 1 or stats["entries"] != 1:
+		raise Exception("Path cache did not reuse corridor: {}".format(stats))
+	map_data.set_path_cache_capacity(0)
+
+	print("Path cache check succeeded")
+
+	map_data.enable_metrics()
+	map_data.find_path(*query)
+	metrics = map_data.metrics()
+	map_data.enable_metrics(False)
+	find_path_metrics = metrics["queries"]["find_path"]
+	if find_path_metrics["calls"] != 1 or sum(count for _, count in find_path_metrics["latency"]) != 1:
+		raise Exception("Metrics did not record path query: {}".format(find_path_metrics))
+	if metrics["straight_paths"] != 0:
+		raise Exception("Straight path taken while disabled")
+	map_data.reset_metrics()
+
+	map_data.set_straight_path_distance(1000)
+	if compute_path_length(map_data.find_path(*query)) > path_length + 0.1:
+		raise Exception("Straight path check made the path longer")
+	map_data.set_straight_path_distance(0)
+
+	print("Metrics check succeeded")
+
+	# paths at least an ADT apart are routed through the portals of the tiles
+	# between them.  the furthest point reachable from the start is used, so
+	# this is only checked when the map has more than one ADT to cross
+	adt_size = 533.33333
+	portal_map = pathfind.Map(temp_dir, "development")
+	portal_map.load_all_adts()
+	points = portal_map.find_random_points(query[0], query[1], query[2], 4 * adt_size, 256, 1234)
+	far = [p for p in points if max(abs(p[0] - query[0]), abs(p[1] - query[1])) > 1.1 * adt_size]
+	if far:
+		goal = max(far, key=lambda p: (p[0] - query[0]) ** 2 + (p[1] - query[1]) ** 2)
+		portal_map.enable_metrics()
+		portal_path = portal_map.find_path(query[0], query[1], query[2], *goal)
+		metrics = portal_map.metrics()
+		if metrics["portal_routes"] != 1:
+			raise Exception("Path across ADTs was not routed through portals: {}".format(metrics))
+		if len(portal_path) < 2 or not approximate(portal_path[-1][0], goal[0], 0.5) or \
+			not approximate(portal_path[-1][1], goal[1], 0.5):
+			raise Exception("Portal path does not reach {}: {}".format(goal, portal_path))
+		print("Portal route check succeeded")
+	else:
+		print("Portal route check skipped: no point an ADT away is reachable")
+	del portal_map
+
+	recording = os.path.join(temp_dir, "queries.rec")
+	if not map_data.start_recording(recording):
+		raise Exception("Failed to start recording to {}".format(recording))
+	map_data.find_path(*query)
+	map_data.stop_recording()
+	if os.path.getsize(recording) <= 10 + len("development"):
+		raise Exception("Recording holds no queries")
+	os.remove(recording)
+
+	print("Recording check succeeded")
+
+	request = map_data.create_path_request(*query)
+	for _ in range(0, 10000):
+		if request.update(16) != pathfind.PathRequest.Status.IN_PROGRESS:
+			break
+
+	if request.status() != pathfind.PathRequest.Status.SUCCEEDED or request.path() != path:
+		raise Exception("Sliced path differs from single path")
+
+	print("Sliced pathfind check succeeded")
+
+	corridor = map_data.create_path_corridor(*query)
+	corridor_path = corridor.path()
+	if len(corridor_path) < 2 or not approximate(corridor_path[-1][0], path[-1][0], 0.1) or not approximate(corridor_path[-1][1], path[-1][1], 0.1):
+		raise Exception("Corridor path does not reach the end of the path")
+	if not corridor.move_target(*query[3:6]) or corridor.replans() != 1:
+		raise Exception("Corridor searched again for an unchanged target")
+
+	print("Path corridor check succeeded")
+
+	map_data.set_query_filter("nothing", 0)
+	if map_data.find_path(*query, filter="nothing"):
+		raise Exception("Path found using a filter which excludes every polygon")
+	all_flags = 0
+	for flag in pathfind.PolyFlags.__members__.values():
+		all_flags |= int(flag)
+	map_data.set_query_filter("everything", all_flags)
+	if map_data.find_path(*query, filter="everything") != path:
+		raise Exception("Filtered path differs from unfiltered path")
+
+	print("Query filter check succeeded")
+
+	start = map_data.resolve_location(*query[0:3])
+	stop = map_data.resolve_location(*query[3:6])
+	if start is None or stop is None:
+		raise Exception("Failed to resolve path locations")
+	for _ in range(0, 2):
+		if map_data.find_path_between_locations(start, stop) != path:
+			raise Exception("Location path differs from position path")
+	if map_data.resolve_location(query[0] + 0.1, query[1], query[2], start) is None:
+		raise Exception("Failed to update path location")
+
+	print("Location check succeeded")
+
+	refined = map_data.find_refined_path(*query, spacing=2.0)
+	if len(refined) < len(path) or math.dist(refined[-1][0:2], path[-1][0:2]) > 0.01:
+		raise Exception("Refined path check failed")
+	for a, b in zip(refined, refined[1:]):
+		if math.dist(a[0:2], b[0:2]) > 2.01:
+			raise Exception("Refined path spacing check failed")
+
+	print("Refined path check succeeded")
+
+	nearest = map_data.find_nearest_point(query[0], query[1], query[2] + 2.0)
+	if nearest is None or math.dist(nearest, query[0:3]) > 3.0:
+		raise Exception("Nearest point check failed")
+	wall = map_data.distance_to_wall(start, 10.0)
+	if wall is None or not 0.0 <= wall[0] <= 10.0:
+		raise Exception("Distance to wall check failed")
+
+	print("Nearest point check succeeded")
+
+	if not map_data.is_reachable(*query) or not map_data.is_reachable(start, stop):
+		raise Exception("Path ends reported as unreachable")
+	map_data.enable_reachability(True)
+	if map_data.find_path(*query) != path:
+		raise Exception("Path differs with reachability enabled")
+	map_data.enable_reachability(False)
+
+	print("Reachability check succeeded")
+
 	zone, area = map_data.get_zone_and_area(x, y, expected_z_values[-1])
 
 	if zone != 22 or area != 22:
 		raise Exception("Zone check failed.  Zone: {} Area: {}".format(zone, area))
+	location = map_data.resolve_location(x, y, expected_z_values[-1])
+	for _ in range(0, 2):
+		if location is None or map_data.get_zone_and_area(location) != (zone, area):
+			raise Exception("Location zone check failed")
 
 	print("Zone check succeeded")
 
@@ -120,6 +357,18 @@ def test_pathfind(temp_dir):
 
 	print("Should-pass LoS check succeeded")
 
+	map_data.set_line_of_sight_cache(16, 60000)
+	for _ in range(0, 2):
+		if map_data.line_of_sight(16268.3809, 16812.7148, 36.1483,
+			16266.5781, 16782.623, 38.5035019, False):
+			raise Exception("Cached LoS check passed")
+	stats = map_data.line_of_sight_cache_stats()
+	if stats["hits"] != 1 or stats["misses"] != 1 or stats["entries"] != 1:
+		raise Exception("LoS cache did not reuse result: {}".format(stats))
+	map_data.set_line_of_sight_cache(0, 0)
+
+	print("LoS cache check succeeded")
+
 	radius = 10.0
 	origin = [16303.294922, 16789.242188, 45.219631]
 	should_pass = map_data.find_random_point_around_circle(origin[0], origin[1], origin[2], radius)
@@ -141,6 +390,16 @@ dist: {distance}"
 
 	print("Should-pass find random point around circle succeeded")
 
+	points = map_data.find_random_points(origin[0], origin[1], origin[2], radius, 32, 1234)
+	if not points or points != map_data.find_random_points(origin[0], origin[1], origin[2], radius, 32, 1234):
+		raise Exception("Seeded random points were not reproducible")
+
+	for point in points:
+		if math.dist(origin[:2], point[:2]) > radius + 0.01:
+			raise Exception(f"Seeded random point {point} outside of circle")
+
+	print("Seeded random points check succeeded")
+
 	should_pass_doodad = map_data.line_of_sight(16275.6895, 16853.9023, 37.8341751,
 		16251.0332, 16858.2988, 34.9305573, False)
 	if should_pass_doodad is False:
@@ -148,6 +407,48 @@ dist: {distance}"
 
 	print("Should-pass doodad LoS check succeeded")
 
+	start = [16275.6895, 16853.9023, 37.8341751]
+	stop = [16251.0332, 16858.2988, 34.9305573]
+	contact = map_data.sweep_capsule(*start, *stop, 0.5, 2.0)
+	if contact is not None and math.dist(start, contact) > math.dist(start, stop) + 0.01:
+		raise Exception(f"Capsule sweep stopped beyond its end at {contact}")
+
+	print("Capsule sweep check succeeded")
+
+	fan_targets = [(16251.0332, 16858.2988, 34.9305573, 0.0), (16263.3613, 16856.1006, 36.3823662, 0.0)]
+	for doodads in (False, True):
+		expected = [map_data.line_of_sight(16275.6895, 16853.9023, 37.8341751, x, y, z, doodads) for (x, y, z, _) in fan_targets]
+		if map_data.line_of_sight_fan(16275.6895, 16853.9023, 37.8341751, 0.0, fan_targets, doodads) != expected:
+			raise Exception("LoS fan check disagreed with single LoS checks")
+
+	print("LoS fan check succeeded")
+
+	ground = map_data.ray_cast(16303.294922, 16789.242188, 45.219631 + 50.0, 16303.294922, 16789.242188, 45.219631 - 50.0)
+	if ground is None or ground["normal"][2] <= 0.0:
+		raise Exception("Downward ray cast did not hit the ground from above")
+
+	print("Ray cast check succeeded")
+
+	near = map_data.query_instances(16263.3613, 16856.1006, 36.3823662, 50.0)
+	far = map_data.query_instances(16263.3613, 16856.1006, 36.3823662, 200.0)
+	if not near or any(instance not in far for instance in near):
+		raise Exception("Instance query check failed")
+
+	print("Instance query check succeeded")
+
+	los_queries = [
+		(16268.3809, 16812.7148, 36.1483, 16266.5781, 16782.623, 38.5035019),
+		(16873.2168, 16926.9551, 15.9072571, 16987.4277, 16950.0742, 69.4590912),
+		(16275.6895, 16853.9023, 37.8341751, 16251.0332, 16858.2988, 34.9305573),
+	]
+	batch_los = map_data.line_of_sight_batch(los_queries, False)
+	single_los = [map_data.line_of_sight(*q, False) for q in los_queries]
+
+	if batch_los != single_los:
+		raise Exception("Batch LoS {} differs from single LoS {}".format(batch_los, single_los))
+
+	print("Batch LoS check succeeded")
+
 	query_z = map_data.query_z(16232.7373, 16828.2734, 37.1330833, 16208.6, 16830.7)
 
 	if query_z is None:
@@ -158,6 +459,44 @@ dist: {distance}"
 
 	print("Query Z succeeded")
 
+	manifest = os.path.join(temp_dir, "models.txt")
+	saved = map_data.save_model_manifest(manifest)
+	preloaded = pathfind.Map(temp_dir, "development").preload_model_manifest(manifest, 4)
+	if preloaded != saved:
+		raise Exception("Preloaded {} of {} models in manifest".format(preloaded, saved))
+
+	print("Model preload succeeded")
+
+	manager = pathfind.MapManager(temp_dir)
+	instances = [manager.create_map("development") for _ in range(2)]
+	instances[0].load_all_adts()
+	shared = manager.model_stats()
+	instances[1].load_all_adts()
+
+	if manager.model_stats() != shared or instances[1].cache_stats()["model_bytes"] != shared["model_bytes"]:
+		raise Exception("Instances loaded models of their own: {} then {}".format(shared, manager.model_stats()))
+
+	print("Shared model check succeeded")
+
+	clone = instances[0].clone_for_instance()
+
+	if not clone.adt_loaded(0, 1) or manager.model_stats() != shared:
+		raise Exception("Clone did not share the loaded ADTs and models of its map")
+
+	print("Map clone check succeeded")
+
+	if hasattr(os, "fork"):
+		clone.prepare_fork()
+		pid = os.fork()
+		if pid == 0:
+			forked_path = clone.find_path(16303.294922, 16789.242188, 45.219631,
+				16200.139648, 16834.345703, 37.028622)
+			os._exit(0 if len(forked_path) >= 5 else 1)
+		if os.waitpid(pid, 0)[1] != 0:
+			raise Exception("Forked child could not search the map of its parent")
+
+		print("Forked map check succeeded")
+
 	map_data = pathfind.Map(temp_dir, "bladesedgearena")
 	map_data.load_adt_at(6225, 250)
 	path = map_data.find_path(6225.82764, 250.215775, 11.2738495, 6216.33350, 234.604645, 4.16993713)
@@ -166,6 +505,31 @@ dist: {distance}"
 	if len(path) < 10 or path_length > 60:
 		raise Exception("Path invalid.  Length: {} Distance: {}".format(len(path), path_length))
 
+def test_omitted_height_fields(temp_dir):
+	data_dir = os.path.dirname(__file__)
+	output_dir = os.path.join(temp_dir, "omitted")
+
+	# with no game objects, every ADT tile leaves out its height field
+	mapbuild.build_map(data_dir, output_dir, "development", 8, "", height_field_radius=0.0)
+
+	map_data = pathfind.Map(output_dir, "development")
+	map_data.load_adt_at(16268.3809, 16812.7148)
+
+	if map_data.line_of_sight(16268.3809, 16812.7148, 36.1483,
+		16266.5781, 16782.623, 38.5035019, False):
+		raise Exception("Should-fail LoS check passed without height fields")
+
+	# the connection could only be added by rebuilding the tile
+	try:
+		map_data.add_off_mesh_connection(16268.3809, 16812.7148, 36.1483,
+			16266.5781, 16782.623, 38.5035019, 1.0)
+	except RuntimeError:
+		pass
+	else:
+		raise Exception("Off-mesh connection added to a tile without a height field")
+
+	print("Omitted height field check succeeded")
+
 def main():
 	temp_dir = tempfile.mkdtemp()
 	print("Temporary directory: {}".format(temp_dir))
@@ -173,6 +537,7 @@ def main():
 	try:
 		test_build(temp_dir)
 		test_pathfind(temp_dir)
+		test_omitted_height_fields(temp_dir)
 	finally:
 		print("Removing temporary directory...")
 		shutil.rmtree(temp_dir)
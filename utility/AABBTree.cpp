@@ -3,13 +3,48 @@
 #include "BinaryStream.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
+#include <future>
+
+// SSE2 and NEON are part of the baseline of x86-64 and AArch64, so no runtime
+// detection is needed to use them.  anything else gets the scalar loop.
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define AABBTREE_SSE2
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#    define AABBTREE_NEON
+#    include <arm_neon.h>
+#endif
 
 namespace math
 {
 namespace
 {
+std::atomic<AABBTree::BuildMethod> DefaultBuildMethod {
+    AABBTree::BuildMethod::BinnedSAH};
+
+// subtrees with at least this many faces are worth a thread of their own
+constexpr unsigned int ParallelBuildFaces = 1 << 14;
+
+// how many levels from the root may split work onto other threads, for at
+// most 2^ParallelBuildDepth threads per model
+constexpr unsigned int ParallelBuildDepth = 3;
+
+constexpr int SurfaceAreaBins = 16;
+
+thread_local AABBTree::TraceCounts ThreadCounts;
+
+template <typename T>
+bool IsAligned(const void* p)
+{
+    return reinterpret_cast<std::uintptr_t>(p) % alignof(T) == 0;
+}
+
 class ModelFaceSorter
 {
 public:
@@ -39,8 +74,253 @@ private:
     const int* m_indices;
     unsigned int m_axis;
 };
+
+// the slab test for every child of a node is done in the space of the
+// quantized bounds: t = q * m_scale[axis] + m_offset[axis] gives the distance
+// along the ray, as a fraction of its length, at which it crosses the plane q.
+struct QuantizedRay
+{
+    float m_scale[3];
+    float m_offset[3];
+};
+
+QuantizedRay SetupQuantizedRay(const Ray& ray, const BoundingBox& bounds,
+                               const Vector3& scale)
+{
+    QuantizedRay result;
+
+    auto const& start = ray.GetStartPoint();
+    auto const& inverse = ray.GetInverseVector();
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        result.m_scale[axis] = scale[axis] * inverse[axis];
+        result.m_offset[axis] =
+            (bounds.MinCorner[axis] - start[axis]) * inverse[axis];
+    }
+
+    return result;
+}
+
+// returns a mask of the children of the node which the ray enters before
+// maxDistance, and the distance at which it enters each of them
+template <typename NodeT>
+unsigned int IntersectChildren(const NodeT& node, const QuantizedRay& ray,
+                               float maxDistance, float entry[4])
+{
+#if defined(AABBTREE_SSE2)
+    auto const zero = _mm_setzero_si128();
+    auto const lanes = [&zero](const std::uint16_t* q)
+    {
+        auto const packed =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(q));
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(packed, zero));
+    };
+
+    auto tnear = _mm_setzero_ps();
+    auto tfar = _mm_set1_ps(maxDistance);
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto const scale = _mm_set1_ps(ray.m_scale[axis]);
+        auto const offset = _mm_set1_ps(ray.m_offset[axis]);
+
+        auto const t0 =
+            _mm_add_ps(_mm_mul_ps(lanes(node.childMin[axis]), scale), offset);
+        auto const t1 =
+            _mm_add_ps(_mm_mul_ps(lanes(node.childMax[axis]), scale), offset);
+
+        tnear = _mm_max_ps(tnear, _mm_min_ps(t0, t1));
+        tfar = _mm_min_ps(tfar, _mm_max_ps(t0, t1));
+    }
+
+    _mm_storeu_ps(entry, tnear);
+    return static_cast<unsigned int>(_mm_movemask_ps(_mm_cmple_ps(tnear, tfar)));
+#elif defined(AABBTREE_NEON)
+    auto const lanes = [](const std::uint16_t* q)
+    { return vcvtq_f32_u32(vmovl_u16(vld1_u16(q))); };
+
+    auto tnear = vdupq_n_f32(0.f);
+    auto tfar = vdupq_n_f32(maxDistance);
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto const scale = vdupq_n_f32(ray.m_scale[axis]);
+        auto const offset = vdupq_n_f32(ray.m_offset[axis]);
+
+        auto const t0 = vmlaq_f32(offset, lanes(node.childMin[axis]), scale);
+        auto const t1 = vmlaq_f32(offset, lanes(node.childMax[axis]), scale);
+
+        tnear = vmaxq_f32(tnear, vminq_f32(t0, t1));
+        tfar = vminq_f32(tfar, vmaxq_f32(t0, t1));
+    }
+
+    vst1q_f32(entry, tnear);
+
+    std::uint32_t hit[4];
+    vst1q_u32(hit, vcleq_f32(tnear, tfar));
+
+    return (hit[0] & 1) | (hit[1] & 2) | (hit[2] & 4) | (hit[3] & 8);
+#else
+    unsigned int result = 0;
+
+    for (auto child = 0; child < 4; ++child)
+    {
+        float tnear = 0.f;
+        float tfar = maxDistance;
+
+        for (auto axis = 0; axis < 3; ++axis)
+        {
+            auto const t0 = node.childMin[axis][child] * ray.m_scale[axis] +
+                            ray.m_offset[axis];
+            auto const t1 = node.childMax[axis][child] * ray.m_scale[axis] +
+                            ray.m_offset[axis];
+
+            tnear = (std::max)(tnear, (std::min)(t0, t1));
+            tfar = (std::min)(tfar, (std::max)(t0, t1));
+        }
+
+        entry[child] = tnear;
+
+        if (tnear <= tfar)
+            result |= 1 << child;
+    }
+
+    return result;
+#endif
+}
+
+// the fraction of velocity at which a sphere of the given radius, centered at
+// start and moving by velocity, first touches the triangle, if before limit.
+// returns a negative value otherwise, including when the sphere touches the
+// triangle at the start.  the face is tested first, then its edges as
+// capsules and its vertices as spheres, after Ericson, "Real-Time Collision
+// Detection", 5.5
+float SweepSphereTriangle(const Vector3& start, const Vector3& velocity,
+                          float radius, const Vector3& a, const Vector3& b,
+                          const Vector3& c, float limit)
+{
+    auto const cross = Vector3::CrossProduct(b - a, c - a);
+    auto const area = cross.Length();
+
+    // degenerate triangles are covered by their neighbours
+    if (area <= 0.f)
+        return -1.f;
+
+    auto normal = cross * (1.f / area);
+    auto distance = Vector3::DotProduct(start - a, normal);
+
+    // face the normal towards the start, as either side may be hit
+    if (distance < 0.f)
+    {
+        normal = normal * -1.f;
+        distance = -distance;
+    }
+
+    auto const inside = [&a, &b, &c, &cross](const Vector3& p)
+    {
+        return Vector3::DotProduct(
+                   Vector3::CrossProduct(b - a, p - a), cross) >= 0.f &&
+               Vector3::DotProduct(
+                   Vector3::CrossProduct(c - b, p - b), cross) >= 0.f &&
+               Vector3::DotProduct(
+                   Vector3::CrossProduct(a - c, p - c), cross) >= 0.f;
+    };
+
+    auto const approach = Vector3::DotProduct(velocity, normal);
+
+    if (distance <= radius)
+    {
+        // the sphere already touches the face
+        if (inside(start - normal * distance))
+            return -1.f;
+    }
+    else if (approach < 0.f)
+    {
+        // touching the face is the first contact, if it is within the
+        // triangle
+        auto const t = (radius - distance) / approach;
+
+        if (t >= limit)
+            return -1.f;
+
+        if (inside(start + velocity * t - normal * radius))
+            return t;
+    }
+
+    auto result = limit;
+
+    auto const vv = Vector3::DotProduct(velocity, velocity);
+
+    for (auto e = 0; e < 3; ++e)
+    {
+        auto const& p0 = e == 0 ? a : e == 1 ? b : c;
+        auto const& p1 = e == 0 ? b : e == 1 ? c : a;
+
+        // the vertex, as a sphere
+        auto const m = start - p0;
+        auto const mm = Vector3::DotProduct(m, m) - radius * radius;
+        auto const mv = Vector3::DotProduct(m, velocity);
+
+        if (mm > 0.f && mv < 0.f)
+        {
+            auto const discriminant = mv * mv - vv * mm;
+
+            if (discriminant >= 0.f)
+            {
+                auto const t = (-mv - std::sqrt(discriminant)) / vv;
+
+                if (t >= 0.f && t < result)
+                    result = t;
+            }
+        }
+
+        // the edge, as a cylinder, between its vertices
+        auto const edge = p1 - p0;
+        auto const ee = Vector3::DotProduct(edge, edge);
+        auto const me = Vector3::DotProduct(m, edge);
+        auto const ve = Vector3::DotProduct(velocity, edge);
+
+        auto const qa = ee * vv - ve * ve;
+        auto const qb = ee * mv - ve * me;
+        auto const qc = ee * mm - me * me;
+
+        // moving along the edge, or starting within its cylinder, leaves the
+        // contact to the vertices
+        if (qa <= 0.f || qc <= 0.f || qb >= 0.f)
+            continue;
+
+        auto const discriminant = qb * qb - qa * qc;
+
+        if (discriminant < 0.f)
+            continue;
+
+        auto const t = (-qb - std::sqrt(discriminant)) / qa;
+        auto const s = me + t * ve;
+
+        if (t >= 0.f && t < result && s >= 0.f && s <= ee)
+            result = t;
+    }
+
+    return result < limit ? result : -1.f;
+}
 } // namespace
 
+void AABBTree::SetDefaultBuildMethod(BuildMethod method)
+{
+    DefaultBuildMethod = method;
+}
+
+AABBTree::BuildMethod AABBTree::GetDefaultBuildMethod()
+{
+    return DefaultBuildMethod;
+}
+
+const AABBTree::TraceCounts& AABBTree::ThreadTraceCounts()
+{
+    return ThreadCounts;
+}
+
 AABBTree::AABBTree(const std::vector<Vertex>& vertices,
                    const std::vector<int>& indices)
 {
@@ -49,56 +329,48 @@ AABBTree::AABBTree(const std::vector<Vertex>& vertices,
 
 BoundingBox AABBTree::GetBoundingBox() const
 {
-    if (m_nodes.empty())
-        return BoundingBox {};
-    return m_nodes.front().bounds;
+    return m_bounds;
+}
+
+size_t AABBTree::MemoryUsage() const
+{
+    return sizeof(Node) * m_nodes.capacity() +
+           sizeof(Vertex) * m_vertices.capacity() +
+           sizeof(int) * m_indices.capacity() +
+           sizeof(Vertex) * m_faceVertices.capacity();
 }
 
 void AABBTree::Serialize(utility::BinaryStream& stream) const
 {
     auto const size =
-        sizeof(std::uint32_t) *
-            5 + // magic, Vector3 count, index count, node count, end magic
-        sizeof(Vertex) * m_vertices.size() +      // vertices
-        sizeof(std::int32_t) * m_indices.size() + // indices
-        (sizeof(std::uint8_t) + sizeof(std::uint32_t) + sizeof(BoundingBox)) *
-            m_nodes.size(); // nodes (numFaces + startFace/childen + bounds) *
-                            // count
+        sizeof(std::uint32_t) * 6 + // magic, Vector3 count, index count, root,
+                                    // node count, end magic
+        sizeof(Vertex) * m_vertexView.size() +      // vertices
+        sizeof(std::int32_t) * m_indexView.size() + // indices
+        sizeof(BoundingBox) +                       // bounds
+        sizeof(Node) * m_nodeView.size();           // nodes
 
     auto ourStream = utility::BinaryStream(size);
 
     ourStream << StartMagic;
 
-    ourStream << static_cast<std::uint32_t>(m_vertices.size());
-    ourStream.Write(&m_vertices[0], m_vertices.size() * sizeof(Vector3));
+    ourStream << static_cast<std::uint32_t>(m_vertexView.size());
+    ourStream.Write(m_vertexView.data(),
+                    m_vertexView.size() * sizeof(Vector3));
 
-    ourStream << static_cast<std::uint32_t>(m_indices.size());
+    ourStream << static_cast<std::uint32_t>(m_indexView.size());
 
-    for (const auto& index : m_indices)
+    for (const auto& index : m_indexView)
     {
         const std::int32_t idx = index;
         ourStream << idx;
     }
 
-    ourStream << static_cast<std::uint32_t>(m_nodes.size());
-
-    for (const auto& node : m_nodes)
-    {
-        assert(node.numFaces < 8);
-
-        ourStream << static_cast<std::uint8_t>(node.numFaces);
+    ourStream << m_bounds << m_root;
 
-        if (!!node.numFaces)
-        {
-            // Write leaf node
-            ourStream << node.startFace << node.bounds;
-        }
-        else
-        {
-            // Write inner node
-            ourStream << node.children << node.bounds;
-        }
-    }
+    ourStream << static_cast<std::uint32_t>(m_nodeView.size());
+    if (!m_nodeView.empty())
+        ourStream.Write(m_nodeView.data(), m_nodeView.size() * sizeof(Node));
 
     ourStream << EndMagic;
 
@@ -109,6 +381,9 @@ void AABBTree::Serialize(utility::BinaryStream& stream) const
 
 bool AABBTree::Deserialize(utility::BinaryStream& stream)
 {
+    static_assert(sizeof(int) == sizeof(std::int32_t),
+                  "Indices are read in place as 32 bit integers");
+
     std::uint32_t magic;
     stream >> magic;
     if (magic != StartMagic)
@@ -119,52 +394,100 @@ bool AABBTree::Deserialize(utility::BinaryStream& stream)
 
     assert(vertexCount > 0);
 
-    m_vertices.resize(vertexCount);
-    stream.ReadBytes(&m_vertices[0], vertexCount * sizeof(Vertex));
+    auto const vertices = stream.ReadInPlace(vertexCount * sizeof(Vertex));
 
     std::uint32_t indexCount;
     stream >> indexCount;
 
     assert(indexCount > 0);
 
-    m_indices.reserve(indexCount);
-    for (auto i = 0u; i < indexCount; ++i)
-    {
-        std::int32_t index;
-        stream >> index;
-        m_indices.push_back(static_cast<int>(index));
-    }
+    auto const indices =
+        stream.ReadInPlace(indexCount * sizeof(std::int32_t));
+
+    stream >> m_bounds >> m_root;
 
     std::uint32_t nodeCount;
     stream >> nodeCount;
 
-    m_nodes.resize(nodeCount);
+    auto const nodes = stream.ReadInPlace(nodeCount * sizeof(Node));
 
-    for (auto i = 0u; i < nodeCount; ++i)
-    {
-        std::uint8_t numFaces;
-        stream >> numFaces;
+    std::uint32_t endMagic;
+    stream >> endMagic;
 
-        m_nodes[i].numFaces = static_cast<unsigned int>(numFaces);
+    if (endMagic != EndMagic)
+        return false;
 
-        if (!!numFaces)
-        {
-            // Read leaf node
-            stream >> m_nodes[i].startFace >> m_nodes[i].bounds;
-        }
-        else
+    // the arrays of a mapped stream are used where they lie, provided that
+    // they are aligned as their elements must be.  anything else is copied
+    auto const& mapping = stream.GetMapping();
+
+    if (mapping && IsAligned<Vertex>(vertices) && IsAligned<int>(indices) &&
+        IsAligned<Node>(nodes))
+    {
+        std::vector<Node>().swap(m_nodes);
+        std::vector<Vertex>().swap(m_vertices);
+        std::vector<int>().swap(m_indices);
+
+        m_nodeView = {reinterpret_cast<const Node*>(nodes), nodeCount};
+        m_vertexView = {reinterpret_cast<const Vertex*>(vertices),
+                        vertexCount};
+        m_indexView = {reinterpret_cast<const int*>(indices), indexCount};
+        m_mapping = mapping;
+    }
+    else
+    {
+        m_nodes.resize(nodeCount);
+        m_vertices.resize(vertexCount);
+        m_indices.resize(indexCount);
+
+        if (nodeCount > 0)
+            memcpy(&m_nodes[0], nodes, nodeCount * sizeof(Node));
+        if (vertexCount > 0)
+            memcpy(&m_vertices[0], vertices, vertexCount * sizeof(Vertex));
+        if (indexCount > 0)
+            memcpy(&m_indices[0], indices, indexCount * sizeof(int));
+
+        UseOwnedArrays();
+    }
+
+    // traversal does not bounds check, so reject any file whose nodes point
+    // outside of the node or face arrays.  children always follow their
+    // parent, which CalculateDepth() relies upon.
+    auto const validChild = [this](std::uint32_t parent, std::uint32_t ref)
+    {
+        if (!!(ref & LeafFlag))
         {
-            // Read inner node
-            stream >> m_nodes[i].children >> m_nodes[i].bounds;
+            auto const startFace = (ref & ~LeafFlag) >> LeafCountBits;
+            auto const numFaces = ref & LeafCountMask;
+            return (size_t(startFace) + numFaces) * 3 <= m_indexView.size();
         }
-    }
 
-    std::uint32_t endMagic;
-    stream >> endMagic;
+        return ref > parent && ref < m_nodeView.size();
+    };
 
-    if (endMagic != EndMagic)
+    if (!(m_root & LeafFlag) ? m_nodeView.empty() || m_root != 0
+                             : !validChild(0, m_root))
+        return false;
+
+    for (std::uint32_t i = 0; i < m_nodeView.size(); ++i)
+        for (auto const child : m_nodeView[i].children)
+            if (!validChild(i, child))
+                return false;
+
+    for (const auto& index : m_indexView)
+        if (index < 0 || size_t(index) >= m_vertexView.size())
+            return false;
+
+    m_scale = (m_bounds.MaxCorner - m_bounds.MinCorner) * (1.f / 65534.f);
+    m_depth = CalculateDepth();
+
+    // the trees MapBuilder writes are far shallower than this, so anything
+    // deeper is corrupt, and would only cost a heap stack on every trace
+    if (m_depth > MaxTraceDepth)
         return false;
 
+    GatherFaces();
+
     return true;
 }
 
@@ -198,6 +521,12 @@ BoundingBox AABBTree::CalculateFaceBounds(unsigned int* faces,
 
 void AABBTree::Build(const std::vector<Vertex>& verts,
                      const std::vector<int>& indices)
+{
+    Build(verts, indices, DefaultBuildMethod);
+}
+
+void AABBTree::Build(const std::vector<Vertex>& verts,
+                     const std::vector<int>& indices, BuildMethod method)
 {
     m_vertices = verts;
     m_indices = indices;
@@ -217,12 +546,19 @@ void AABBTree::Build(const std::vector<Vertex>& verts,
     }
 
     m_freeNode = 1;
-    m_nodes.clear();
-    m_nodes.reserve(int(numFaces * 1.5f));
+    m_buildNodes.clear();
+    m_buildNodes.reserve(int(numFaces * 1.5f));
 
-    BuildRecursive(0, m_faceIndices.data(),
-                   static_cast<unsigned int>(numFaces));
-    m_faceBounds.clear();
+    if (method == BuildMethod::BinnedSAH)
+    {
+        m_buildNodes.resize(1);
+        BuildBinned(m_buildNodes, 0, m_faceIndices.data(),
+                    static_cast<unsigned int>(numFaces), ParallelBuildDepth);
+        m_freeNode = static_cast<unsigned int>(m_buildNodes.size());
+    }
+    else
+        BuildRecursive(0, m_faceIndices.data(),
+                       static_cast<unsigned int>(numFaces));
 
     // Reorder the model indices according to the face indices
     std::vector<int> sortedIndices(m_indices.size());
@@ -235,7 +571,187 @@ void AABBTree::Build(const std::vector<Vertex>& verts,
     }
 
     m_indices.swap(sortedIndices);
-    m_faceIndices.clear();
+
+    Compact();
+
+    // none of the build state is needed for queries, so release it rather
+    // than keeping it alive for as long as the model is loaded
+    std::vector<BuildNode>().swap(m_buildNodes);
+    std::vector<BoundingBox>().swap(m_faceBounds);
+    std::vector<unsigned int>().swap(m_faceIndices);
+
+    UseOwnedArrays();
+    GatherFaces();
+
+    m_depth = CalculateDepth();
+}
+
+void AABBTree::UseOwnedArrays()
+{
+    m_nodeView = m_nodes;
+    m_vertexView = m_vertices;
+    m_indexView = m_indices;
+    m_mapping.reset();
+}
+
+void AABBTree::GatherFaces()
+{
+    if (m_mapping)
+    {
+        std::vector<Vertex>().swap(m_faceVertices);
+        return;
+    }
+
+    m_faceVertices.resize(m_indexView.size());
+
+    for (auto i = 0u; i < m_indexView.size(); ++i)
+        m_faceVertices[i] = m_vertexView[m_indexView[i]];
+}
+
+void AABBTree::Compact()
+{
+    m_nodes.clear();
+
+    if (m_buildNodes.empty() || m_indices.empty())
+    {
+        m_bounds = BoundingBox {};
+        m_scale = Vector3 {};
+        m_root = 0;
+        return;
+    }
+
+    // divide the bounds into one less step than fit in 16 bits, so that the
+    // largest quantized value is always beyond the true maximum, even after
+    // rounding
+    m_bounds = m_buildNodes[0].bounds;
+    m_scale = (m_bounds.MaxCorner - m_bounds.MinCorner) * (1.f / 65534.f);
+
+    auto const leafReference = [](const BuildNode& node)
+    {
+        assert(node.numFaces <= LeafCountMask);
+        assert(node.startFace < (LeafFlag >> LeafCountBits));
+
+        return LeafFlag | (node.startFace << LeafCountBits) | node.numFaces;
+    };
+
+    if (!!m_buildNodes[0].numFaces)
+    {
+        m_root = leafReference(m_buildNodes[0]);
+        return;
+    }
+
+    // collapse the binary tree into a four-wide one.  each node takes the two
+    // children of a binary node, and then keeps replacing its largest inner
+    // child with that child's own children until it has four.  nodes are
+    // numbered in the order they are created, so every child reference points
+    // forward.
+    struct Pending
+    {
+        std::uint32_t node;
+        std::uint32_t buildNode;
+    };
+
+    std::vector<Pending> pending {{0, 0}};
+    m_nodes.reserve(m_freeNode / 3 + 1);
+    m_nodes.emplace_back();
+    m_root = 0;
+
+    while (!pending.empty())
+    {
+        auto const current = pending.back();
+        pending.pop_back();
+
+        auto const& parent = m_buildNodes[current.buildNode];
+
+        std::uint32_t candidates[4] = {parent.children + 0, parent.children + 1};
+        unsigned int candidateCount = 2;
+
+        while (candidateCount < 4)
+        {
+            int largest = -1;
+            float largestArea = -1.f;
+
+            for (auto c = 0u; c < candidateCount; ++c)
+            {
+                auto const& candidate = m_buildNodes[candidates[c]];
+                if (!!candidate.numFaces)
+                    continue;
+
+                auto const area = candidate.bounds.getSurfaceArea();
+                if (area > largestArea)
+                {
+                    largest = static_cast<int>(c);
+                    largestArea = area;
+                }
+            }
+
+            if (largest < 0)
+                break;
+
+            auto const children = m_buildNodes[candidates[largest]].children;
+            candidates[largest] = children + 0;
+            candidates[candidateCount++] = children + 1;
+        }
+
+        for (auto c = 0u; c < 4; ++c)
+        {
+            if (c >= candidateCount)
+            {
+                m_nodes[current.node].children[c] = EmptyChild;
+                QuantizeBounds(BoundingBox {}, m_nodes[current.node], c);
+                continue;
+            }
+
+            auto const& child = m_buildNodes[candidates[c]];
+            std::uint32_t reference;
+
+            if (!!child.numFaces)
+                reference = leafReference(child);
+            else
+            {
+                reference = static_cast<std::uint32_t>(m_nodes.size());
+                m_nodes.emplace_back();
+                pending.push_back({reference, candidates[c]});
+            }
+
+            auto& node = m_nodes[current.node];
+            node.children[c] = reference;
+            QuantizeBounds(child.bounds, node, c);
+        }
+    }
+}
+
+void AABBTree::QuantizeBounds(const BoundingBox& bounds, Node& node,
+                              unsigned int child) const
+{
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto const origin = m_bounds.MinCorner[axis];
+        auto const scale = m_scale[axis];
+
+        // a flat tree has nothing to quantize along this axis
+        if (scale <= 0.f)
+        {
+            node.childMin[axis][child] = node.childMax[axis][child] = 0;
+            continue;
+        }
+
+        auto const lower = (bounds.MinCorner[axis] - origin) / scale;
+        auto const upper = (bounds.MaxCorner[axis] - origin) / scale;
+
+        int qmin = (std::max)(0, static_cast<int>(std::floor(lower)));
+        int qmax = (std::min)(65535, static_cast<int>(std::ceil(upper)));
+
+        // the quantized box must contain the real one, so step outwards for
+        // any value which was rounded the wrong way
+        while (qmin > 0 && origin + qmin * scale > bounds.MinCorner[axis])
+            --qmin;
+        while (qmax < 65535 && origin + qmax * scale < bounds.MaxCorner[axis])
+            ++qmax;
+
+        node.childMin[axis][child] = static_cast<std::uint16_t>(qmin);
+        node.childMax[axis][child] = static_cast<std::uint16_t>(qmax);
+    }
 }
 
 unsigned int AABBTree::GetLongestAxis(const Vector3& v)
@@ -246,7 +762,7 @@ unsigned int AABBTree::GetLongestAxis(const Vector3& v)
     return (v.Y > v.Z) ? 1 : 2;
 }
 
-unsigned int AABBTree::PartitionMedian(Node& node, unsigned int* faces,
+unsigned int AABBTree::PartitionMedian(BuildNode& node, unsigned int* faces,
                                        unsigned int numFaces)
 {
     unsigned int axis = GetLongestAxis(node.bounds.getVector());
@@ -256,7 +772,7 @@ unsigned int AABBTree::PartitionMedian(Node& node, unsigned int* faces,
     return numFaces / 2;
 }
 
-unsigned int AABBTree::PartitionSurfaceArea(Node& /*node*/, unsigned int* faces,
+unsigned int AABBTree::PartitionSurfaceArea(BuildNode& /*node*/, unsigned int* faces,
                                             unsigned int numFaces)
 {
     unsigned int bestAxis = 0;
@@ -315,13 +831,13 @@ void AABBTree::BuildRecursive(unsigned int nodeIndex, unsigned int* faces,
     const unsigned int maxFacesPerLeaf = 6;
 
     // Allocate more nodes if out of nodes
-    if (nodeIndex >= m_nodes.size())
+    if (nodeIndex >= m_buildNodes.size())
     {
-        int size = std::max(int(1.5f * m_nodes.size()), 512);
-        m_nodes.resize(size);
+        int size = std::max(int(1.5f * m_buildNodes.size()), 512);
+        m_buildNodes.resize(size);
     }
 
-    auto& node = m_nodes[nodeIndex];
+    auto& node = m_buildNodes[nodeIndex];
     node.bounds = CalculateFaceBounds(faces, numFaces);
 
     if (numFaces <= maxFacesPerLeaf)
@@ -339,134 +855,485 @@ void AABBTree::BuildRecursive(unsigned int nodeIndex, unsigned int* faces,
         unsigned int rightCount = numFaces - leftCount;
 
         // Allocate 2 nodes
-        node.children = m_freeNode;
+        auto const children = m_freeNode;
+        node.children = children;
         m_freeNode += 2;
 
-        // Split faces in half and build each side recursively
-        BuildRecursive(node.children + 0, faces, leftCount);
-        BuildRecursive(node.children + 1, faces + leftCount, rightCount);
+        // Split faces in half and build each side recursively.  note that
+        // this may grow m_buildNodes, invalidating node
+        BuildRecursive(children + 0, faces, leftCount);
+        BuildRecursive(children + 1, faces + leftCount, rightCount);
     }
 }
 
+void AABBTree::BuildBinned(std::vector<BuildNode>& nodes,
+                           std::uint32_t nodeIndex, unsigned int* faces,
+                           unsigned int numFaces,
+                           unsigned int spawnDepth) const
+{
+    const unsigned int maxFacesPerLeaf = 6;
+
+    if (numFaces > 0)
+    {
+        auto bounds = m_faceBounds[faces[0]];
+        for (auto i = 1u; i < numFaces; ++i)
+            bounds.connectWith(m_faceBounds[faces[i]]);
+
+        nodes[nodeIndex].bounds = bounds;
+    }
+
+    if (numFaces <= maxFacesPerLeaf)
+    {
+        nodes[nodeIndex].startFace =
+            static_cast<std::uint32_t>(faces - m_faceIndices.data());
+        nodes[nodeIndex].numFaces = numFaces;
+        return;
+    }
+
+    auto const leftCount = PartitionBinned(faces, numFaces);
+    auto const rightCount = numFaces - leftCount;
+
+    // Allocate 2 nodes
+    auto const children = static_cast<std::uint32_t>(nodes.size());
+    nodes[nodeIndex].children = children;
+    nodes.resize(nodes.size() + 2);
+
+    if (!spawnDepth || numFaces < ParallelBuildFaces)
+    {
+        BuildBinned(nodes, children + 0, faces, leftCount, 0);
+        BuildBinned(nodes, children + 1, faces + leftCount, rightCount, 0);
+        return;
+    }
+
+    // the left side is built into its own node array on another thread,
+    // where its root is node zero
+    std::vector<BuildNode> left(1);
+    auto leftTask = std::async(std::launch::async,
+                               [this, &left, faces, leftCount, spawnDepth]() {
+                                   BuildBinned(left, 0, faces, leftCount,
+                                               spawnDepth - 1);
+                               });
+
+    BuildBinned(nodes, children + 1, faces + leftCount, rightCount,
+                spawnDepth - 1);
+
+    leftTask.get();
+
+    // the root of the left side takes its place next to its sibling, and
+    // the rest of it is appended.  child pairs stay adjacent, and still come
+    // after their parent.
+    auto const offset = static_cast<std::uint32_t>(nodes.size() - 1);
+    auto const relocate = [offset](BuildNode node)
+    {
+        if (!node.numFaces)
+            node.children += offset;
+        return node;
+    };
+
+    nodes[children + 0] = relocate(left[0]);
+    for (size_t i = 1; i < left.size(); ++i)
+        nodes.push_back(relocate(left[i]));
+}
+
+unsigned int AABBTree::PartitionBinned(unsigned int* faces,
+                                       unsigned int numFaces) const
+{
+    auto centroidMin = m_faceBounds[faces[0]].getCenter();
+    auto centroidMax = centroidMin;
+
+    for (auto i = 1u; i < numFaces; ++i)
+    {
+        auto const center = m_faceBounds[faces[i]].getCenter();
+        centroidMin = takeMinimum(centroidMin, center);
+        centroidMax = takeMaximum(centroidMax, center);
+    }
+
+    struct Bin
+    {
+        BoundingBox bounds;
+        unsigned int count = 0;
+    };
+
+    auto bestCost = std::numeric_limits<float>::max();
+    auto bestAxis = -1;
+    auto bestBin = 0;
+
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto const extent = centroidMax[axis] - centroidMin[axis];
+        if (extent <= 0.f)
+            continue;
+
+        auto const scale = SurfaceAreaBins / extent;
+        auto const binOf = [&](unsigned int face)
+        {
+            auto const center = m_faceBounds[face].getCenter()[axis];
+            auto const bin =
+                static_cast<int>((center - centroidMin[axis]) * scale);
+            return (std::min)(bin, SurfaceAreaBins - 1);
+        };
+
+        Bin bins[SurfaceAreaBins];
+        for (auto i = 0u; i < numFaces; ++i)
+        {
+            auto& bin = bins[binOf(faces[i])];
+
+            if (!bin.count)
+                bin.bounds = m_faceBounds[faces[i]];
+            else
+                bin.bounds.connectWith(m_faceBounds[faces[i]]);
+
+            ++bin.count;
+        }
+
+        // sweep from the right, recording the area and count of everything
+        // from each bin onwards
+        float rightArea[SurfaceAreaBins];
+        unsigned int rightCount[SurfaceAreaBins];
+        BoundingBox accumulated;
+        unsigned int count = 0;
+
+        for (auto b = SurfaceAreaBins - 1; b > 0; --b)
+        {
+            if (!!bins[b].count)
+            {
+                if (!count)
+                    accumulated = bins[b].bounds;
+                else
+                    accumulated.connectWith(bins[b].bounds);
+
+                count += bins[b].count;
+            }
+
+            rightArea[b] = !!count ? accumulated.getSurfaceArea() : 0.f;
+            rightCount[b] = count;
+        }
+
+        // then from the left, evaluating the split after each bin
+        count = 0;
+        for (auto b = 0; b < SurfaceAreaBins - 1; ++b)
+        {
+            if (!!bins[b].count)
+            {
+                if (!count)
+                    accumulated = bins[b].bounds;
+                else
+                    accumulated.connectWith(bins[b].bounds);
+
+                count += bins[b].count;
+            }
+
+            if (!count || !rightCount[b + 1])
+                continue;
+
+            auto const cost = accumulated.getSurfaceArea() * count +
+                              rightArea[b + 1] * rightCount[b + 1];
+
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    // every centroid is in the same place, so any split is as good as any
+    // other
+    if (bestAxis < 0)
+        return numFaces / 2;
+
+    auto const extent = centroidMax[bestAxis] - centroidMin[bestAxis];
+    auto const scale = SurfaceAreaBins / extent;
+
+    auto const middle = std::partition(
+        faces, faces + numFaces,
+        [&](unsigned int face)
+        {
+            auto const center = m_faceBounds[face].getCenter()[bestAxis];
+            auto const bin =
+                static_cast<int>((center - centroidMin[bestAxis]) * scale);
+            return (std::min)(bin, SurfaceAreaBins - 1) <= bestBin;
+        });
+
+    return static_cast<unsigned int>(middle - faces);
+}
+
 bool AABBTree::IntersectRay(Ray& ray, unsigned int* faceIndex) const
 {
-    float distance = ray.GetDistance();
-    TraceRecursive(0, ray, faceIndex);
-    return ray.GetDistance() < distance;
+    if (m_indexView.empty())
+        return false;
+
+    return Trace<TraceMode::Closest>(ray, faceIndex, nullptr);
+}
+
+bool AABBTree::Occluded(const Ray& ray) const
+{
+    if (m_indexView.empty())
+        return false;
+
+    Ray copy = ray;
+    return Trace<TraceMode::Any>(copy, nullptr, nullptr);
+}
+
+bool AABBTree::IntersectRayAll(const Ray& ray,
+                               std::vector<float>& distances) const
+{
+    if (m_indexView.empty())
+        return false;
+
+    Ray copy = ray;
+    return Trace<TraceMode::All>(copy, nullptr, &distances);
+}
+
+bool AABBTree::SweepSphere(Ray& ray, float radius) const
+{
+    if (m_indexView.empty())
+        return false;
+
+    auto const& start = ray.GetStartPoint();
+    auto const& velocity = ray.GetVector();
+    auto const& inverse = ray.GetInverseVector();
+
+    // the node bounds are grown by the radius, which rules out the quantized
+    // test of Trace(), so the children are tested one at a time
+    std::vector<std::uint32_t> stack;
+    stack.reserve(3 * m_depth + 1);
+    stack.push_back(m_root);
+
+    std::uint64_t nodes = 0;
+    std::uint64_t faces = 0;
+    auto hit = false;
+
+    while (!stack.empty())
+    {
+        auto const ref = stack.back();
+        stack.pop_back();
+
+        if (!!(ref & LeafFlag))
+        {
+            auto const startFace = (ref & ~LeafFlag) >> LeafCountBits;
+            auto const endFace = startFace + (ref & LeafCountMask);
+
+            faces += endFace - startFace;
+
+            for (auto i = startFace; i < endFace; ++i)
+            {
+                auto const t = SweepSphereTriangle(
+                    start, velocity, radius, FaceVertex(i, 0),
+                    FaceVertex(i, 1), FaceVertex(i, 2), ray.GetDistance());
+
+                if (t >= 0.f)
+                {
+                    ray.SetHitPoint(t);
+                    hit = true;
+                }
+            }
+
+            continue;
+        }
+
+        auto const& node = m_nodeView[ref];
+        ++nodes;
+
+        for (auto child = 0; child < 4; ++child)
+        {
+            if (node.children[child] == EmptyChild)
+                continue;
+
+            auto tnear = 0.f;
+            auto tfar = ray.GetDistance();
+
+            for (auto axis = 0; axis < 3; ++axis)
+            {
+                auto const origin = m_bounds.MinCorner[axis] - start[axis];
+                auto const t0 = (origin + node.childMin[axis][child] *
+                                              m_scale[axis] -
+                                 radius) *
+                                inverse[axis];
+                auto const t1 = (origin + node.childMax[axis][child] *
+                                              m_scale[axis] +
+                                 radius) *
+                                inverse[axis];
+
+                tnear = (std::max)(tnear, (std::min)(t0, t1));
+                tfar = (std::min)(tfar, (std::max)(t0, t1));
+            }
+
+            if (tnear <= tfar)
+                stack.push_back(node.children[child]);
+        }
+    }
+
+    ThreadCounts.m_nodes += nodes;
+    ThreadCounts.m_faces += faces;
+
+    return hit;
 }
 
-void AABBTree::Trace(Ray& ray, unsigned int* faceIndex) const
+template <AABBTree::TraceMode Mode>
+bool AABBTree::Trace(Ray& ray, unsigned int* faceIndex,
+                     std::vector<float>* hits) const
 {
     struct StackEntry
     {
-        unsigned int node;
+        std::uint32_t ref;
         float dist;
     };
 
-    StackEntry stack[50];
-    stack[0].node = 0;
+    // each inner node pops one entry and pushes at most four, so the stack
+    // never holds more than three entries per level plus the root.  trees
+    // deeper than the local buffer are unusual enough that a heap allocation
+    // for them is acceptable.
+    StackEntry localStack[3 * MaxTraceDepth + 1];
+    std::vector<StackEntry> heapStack;
+    StackEntry* stack = localStack;
+
+    if (m_depth > MaxTraceDepth)
+    {
+        heapStack.resize(3 * m_depth + 1);
+        stack = heapStack.data();
+    }
+
+    stack[0].ref = m_root;
     stack[0].dist = 0.0f;
 
-    float max = std::numeric_limits<float>::max();
+    auto const quantizedRay = SetupQuantizedRay(ray, m_bounds, m_scale);
+    auto hit = false;
+
+    // counted locally, and added to those of the thread once on return
+    struct Counts
+    {
+        std::uint64_t m_nodes = 0;
+        std::uint64_t m_faces = 0;
+
+        ~Counts()
+        {
+            ThreadCounts.m_nodes += m_nodes;
+            ThreadCounts.m_faces += m_faces;
+        }
+    } counts;
 
     unsigned int stackCount = 1;
     while (!!stackCount)
     {
         // Pop node from back
-        StackEntry& e = stack[--stackCount];
+        const StackEntry& e = stack[--stackCount];
 
         // Ignore if another node has already come closer
         if (e.dist >= ray.GetDistance())
             continue;
 
-        const Node& node = m_nodes.at(e.node);
-        if (!node.numFaces)
+        if (!!(e.ref & LeafFlag))
         {
-            // Find closest node
-            auto& leftChild = m_nodes.at(node.children + 0);
-            auto& rightChild = m_nodes.at(node.children + 1);
-
-            float dist[2] = {max, max};
-            ray.IntersectBoundingBox(leftChild.bounds, &dist[0]);
-            ray.IntersectBoundingBox(rightChild.bounds, &dist[1]);
+            counts.m_faces += e.ref & LeafCountMask;
 
-            unsigned int closest = dist[1] < dist[0]; // 0 or 1
-            unsigned int furthest = closest ^ 1;
-
-            if (dist[furthest] < ray.GetDistance())
+            if (TraceLeaf<Mode>(e.ref, ray, faceIndex, hits))
             {
-                StackEntry& n = stack[stackCount++];
-                n.node = node.children + furthest;
-                n.dist = dist[furthest];
-            }
+                if (Mode == TraceMode::Any)
+                    return true;
 
-            if (dist[closest] < ray.GetDistance())
-            {
-                StackEntry& n = stack[stackCount++];
-                n.node = node.children + closest;
-                n.dist = dist[closest];
+                hit = true;
             }
+
+            continue;
+        }
+
+        const Node& node = m_nodeView[e.ref];
+        ++counts.m_nodes;
+
+        float entry[4];
+        auto const childHits =
+            IntersectChildren(node, quantizedRay, ray.GetDistance(), entry);
+
+        // push the children which were hit furthest first, so that the
+        // closest is visited first
+        unsigned int order[4];
+        unsigned int hitCount = 0;
+
+        for (auto c = 0u; c < 4; ++c)
+        {
+            if (!(childHits & (1 << c)) || node.children[c] == EmptyChild)
+                continue;
+
+            auto i = hitCount++;
+            for (; i > 0 && entry[order[i - 1]] < entry[c]; --i)
+                order[i] = order[i - 1];
+            order[i] = c;
+        }
+
+        for (auto i = 0u; i < hitCount; ++i)
+        {
+            StackEntry& n = stack[stackCount++];
+            n.ref = node.children[order[i]];
+            n.dist = entry[order[i]];
         }
-        else
-            TraceLeafNode(node, ray, faceIndex);
     }
-}
 
-void AABBTree::TraceRecursive(unsigned int nodeIndex, Ray& ray,
-                              unsigned int* faceIndex) const
-{
-    auto& node = m_nodes.at(nodeIndex);
-    if (!!node.numFaces)
-        TraceLeafNode(node, ray, faceIndex);
-    else
-        TraceInnerNode(node, ray, faceIndex);
+    return hit;
 }
 
-void AABBTree::TraceLeafNode(const Node& node, Ray& ray,
-                             unsigned int* faceIndex) const
+template <AABBTree::TraceMode Mode>
+bool AABBTree::TraceLeaf(std::uint32_t leaf, Ray& ray, unsigned int* faceIndex,
+                         std::vector<float>* hits) const
 {
-    for (auto i = node.startFace; i < node.startFace + node.numFaces; ++i)
-    {
-        auto& v0 = m_vertices[m_indices[i * 3 + 0]];
-        auto& v1 = m_vertices[m_indices[i * 3 + 1]];
-        auto& v2 = m_vertices[m_indices[i * 3 + 2]];
+    auto const startFace = (leaf & ~LeafFlag) >> LeafCountBits;
+    auto const endFace = startFace + (leaf & LeafCountMask);
+    auto hit = false;
 
+    for (auto i = startFace; i < endFace; ++i)
+    {
         float distance;
-        if (!ray.IntersectTriangle(v0, v1, v2, &distance))
+        if (!ray.IntersectTriangle(FaceVertex(i, 0), FaceVertex(i, 1),
+                                   FaceVertex(i, 2), &distance))
             continue;
 
         if (distance < ray.GetDistance())
         {
+            if (Mode == TraceMode::Any)
+                return true;
+
+            hit = true;
+
+            if (Mode == TraceMode::All)
+            {
+                hits->push_back(distance);
+                continue;
+            }
+
             ray.SetHitPoint(distance);
 
             if (faceIndex)
                 *faceIndex = i;
         }
     }
+
+    return hit;
 }
 
-void AABBTree::TraceInnerNode(const Node& node, Ray& ray,
-                              unsigned int* faceIndex) const
+unsigned int AABBTree::CalculateDepth() const
 {
-    auto& leftChild = m_nodes.at(node.children + 0);
-    auto& rightChild = m_nodes.at(node.children + 1);
-
-    float max = std::numeric_limits<float>::max();
-    float distance[2] = {max, max};
-
-    ray.IntersectBoundingBox(leftChild.bounds, &distance[0]);
-    ray.IntersectBoundingBox(rightChild.bounds, &distance[1]);
-
-    unsigned int closest = 0;
-    unsigned int furthest = 1;
+    if (m_nodeView.empty())
+        return 0;
 
-    if (distance[1] < distance[0])
-        std::swap(closest, furthest);
+    // children always follow their parent, so a single forward pass sees
+    // every parent before its children.  a node may have more than one
+    // parent in a malformed file, so it takes the deepest of them.  leaves
+    // are one level below the deepest inner node referencing them.
+    std::vector<unsigned int> depth(m_nodeView.size(), 0);
+    unsigned int result = 0;
 
-    if (distance[closest] < ray.GetDistance())
-        TraceRecursive(node.children + closest, ray, faceIndex);
+    for (size_t i = 0; i < m_nodeView.size(); ++i)
+    {
+        for (auto const child : m_nodeView[i].children)
+        {
+            if (!!(child & LeafFlag))
+                result = (std::max)(result, depth[i] + 1);
+            else
+                depth[child] = (std::max)(depth[child], depth[i] + 1);
+        }
+    }
 
-    if (distance[furthest] < ray.GetDistance())
-        TraceRecursive(node.children + furthest, ray, faceIndex);
+    return result;
 }
-} // namespace math
\ No newline at end of file
+} // namespace math
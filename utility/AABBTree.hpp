@@ -1,11 +1,14 @@
 #pragma once
 
+#include "ArrayView.hpp"
 #include "BinaryStream.hpp"
 #include "BoundingBox.hpp"
+#include "MappedFile.hpp"
 #include "Ray.hpp"
 #include "Vector.hpp"
 
 #include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace math
@@ -13,7 +16,23 @@ namespace math
 class AABBTree
 {
 private:
+    // inner nodes hold the bounds of up to four children, quantized to 16
+    // bits relative to the bounds of the whole tree and stored one axis at a
+    // time, so that all four can be tested against a ray at once.  leaves are
+    // not nodes at all.  they are encoded into the child references of their
+    // parent as LeafFlag | (startFace << LeafCountBits) | numFaces, and unused
+    // child slots hold EmptyChild.
     struct Node
+    {
+        std::uint16_t childMin[3][4];
+        std::uint16_t childMax[3][4];
+        std::uint32_t children[4];
+    };
+
+    static_assert(sizeof(Node) == 64, "Node should be one cache line");
+
+    // the tree as produced by the partitioning, before it is compacted
+    struct BuildNode
     {
         union
         {
@@ -25,10 +44,44 @@ private:
         BoundingBox bounds;
     };
 
-    static constexpr std::uint32_t StartMagic = 'BVH1';
+    static constexpr std::uint32_t LeafFlag = 0x80000000;
+    static constexpr unsigned int LeafCountBits = 3;
+    static constexpr std::uint32_t LeafCountMask = (1 << LeafCountBits) - 1;
+    static constexpr std::uint32_t EmptyChild = LeafFlag;
+
+    static constexpr std::uint32_t StartMagic = 'BVH3';
     static constexpr std::uint32_t EndMagic = 'FOOB';
 
+    // deepest tree which Trace() can traverse without allocating
+    static constexpr unsigned int MaxTraceDepth = 32;
+
 public:
+    enum class BuildMethod
+    {
+        // sorts the faces along every axis at every level and tests each split
+        // position.  slow on very large models
+        SweepSAH,
+        // approximates the surface area heuristic by binning face centroids,
+        // building the largest subtrees on several threads
+        BinnedSAH,
+    };
+
+    // the method used by the constructor and by Build() when none is given.
+    // this defaults to BinnedSAH
+    static void SetDefaultBuildMethod(BuildMethod method);
+    static BuildMethod GetDefaultBuildMethod();
+
+    // the number of nodes and faces tested by every ray traced on the calling
+    // thread so far, which the difference of before and after a query
+    // attributes to it
+    struct TraceCounts
+    {
+        std::uint64_t m_nodes = 0;
+        std::uint64_t m_faces = 0;
+    };
+
+    static const TraceCounts& ThreadTraceCounts();
+
     AABBTree() = default;
     AABBTree(AABBTree&& other) = default;
     ~AABBTree() = default;
@@ -40,45 +93,130 @@ public:
 public:
     void Build(const std::vector<Vertex>& verts,
                const std::vector<int>& indices);
+    void Build(const std::vector<Vertex>& verts,
+               const std::vector<int>& indices, BuildMethod method);
     bool IntersectRay(Ray& ray, unsigned int* faceIndex = nullptr) const;
 
+    // returns true if any face lies along the ray before its current hit
+    // distance.  this stops at the first such face rather than searching for
+    // the closest one, so the ray itself is left unchanged.
+    bool Occluded(const Ray& ray) const;
+
+    // appends the distance of every face crossed by the ray before its
+    // current hit distance, in no particular order, from a single traversal.
+    // returns true if there were any.
+    bool IntersectRayAll(const Ray& ray, std::vector<float>& distances) const;
+
+    // sweeps a sphere of the given radius along the ray, shortening the ray
+    // to where the sphere first touches a face, and returning true if it did.
+    // faces which the sphere already touches at the start of the ray are
+    // ignored, so that a sphere resting against a surface may move away from
+    // or along it.  unlike the ray tests, faces are hit from either side.
+    bool SweepSphere(Ray& ray, float radius) const;
+
     BoundingBox GetBoundingBox() const;
 
+    // bytes allocated for the nodes, vertices, indices and gathered faces.
+    // those read in place from a mapping are shared with the file cache, and
+    // not counted
+    size_t MemoryUsage() const;
+
     void Serialize(utility::BinaryStream& stream) const;
+
+    // when the stream reads a mapping in place, the tree does too, holding
+    // the mapping rather than copying the nodes, vertices and indices out of
+    // it.  every tree deserialized from the same file then shares them
     bool Deserialize(utility::BinaryStream& stream);
 
-    const std::vector<Vector3>& Vertices() const { return m_vertices; }
-    const std::vector<int>& Indices() const { return m_indices; }
+    utility::ArrayView<Vertex> Vertices() const { return m_vertexView; }
+    utility::ArrayView<int> Indices() const { return m_indexView; }
 
 private:
-    unsigned int PartitionMedian(Node& node, unsigned int* faces,
+    unsigned int PartitionMedian(BuildNode& node, unsigned int* faces,
                                  unsigned int numFaces);
-    unsigned int PartitionSurfaceArea(Node& node, unsigned int* faces,
+    unsigned int PartitionSurfaceArea(BuildNode& node, unsigned int* faces,
                                       unsigned int numFaces);
 
     void BuildRecursive(unsigned int nodeIndex, unsigned int* faces,
                         unsigned int numFaces);
+
+    // builds the subtree for the given faces into nodes[nodeIndex], appending
+    // its descendants to nodes.  while spawnDepth is non-zero, large subtrees
+    // are built on other threads and spliced in afterwards.
+    void BuildBinned(std::vector<BuildNode>& nodes, std::uint32_t nodeIndex,
+                     unsigned int* faces, unsigned int numFaces,
+                     unsigned int spawnDepth) const;
+    unsigned int PartitionBinned(unsigned int* faces,
+                                 unsigned int numFaces) const;
     BoundingBox CalculateFaceBounds(unsigned int* faces,
                                     unsigned int numFaces) const;
 
-    void Trace(Ray& ray, unsigned int* faceIndex) const;
-    void TraceRecursive(unsigned int nodeIndex, Ray& ray,
-                        unsigned int* faceIndex) const;
-    void TraceInnerNode(const Node& node, Ray& ray,
-                        unsigned int* faceIndex) const;
-    void TraceLeafNode(const Node& node, Ray& ray,
-                       unsigned int* faceIndex) const;
+    void Compact();
+    void QuantizeBounds(const BoundingBox& bounds, Node& node,
+                        unsigned int child) const;
+
+    enum class TraceMode
+    {
+        Closest, // shorten the ray to the closest hit
+        Any,     // stop at the first hit
+        All,     // record every hit, leaving the ray unchanged
+    };
+
+    template <TraceMode Mode>
+    bool Trace(Ray& ray, unsigned int* faceIndex,
+               std::vector<float>* hits) const;
+    template <TraceMode Mode>
+    bool TraceLeaf(std::uint32_t leaf, Ray& ray, unsigned int* faceIndex,
+                   std::vector<float>* hits) const;
+
+    // number of edges on the longest path from the root to a leaf
+    unsigned int CalculateDepth() const;
 
     static unsigned int GetLongestAxis(const Vector3& v);
 
+    // points the views at the vectors, releasing any mapping
+    void UseOwnedArrays();
+
+    // fills m_faceVertices from the vertices and indices in the views, unless
+    // they are mapped, when it is left empty
+    void GatherFaces();
+
+    // the given corner of the given face, from m_faceVertices when they were
+    // gathered and otherwise through the index view
+    const Vertex& FaceVertex(unsigned int face, unsigned int corner) const
+    {
+        auto const i = face * 3 + corner;
+        return m_faceVertices.empty() ? m_vertexView[m_indexView[i]]
+                                      : m_faceVertices[i];
+    }
+
 private:
-    unsigned int m_freeNode = 0;
+    unsigned int m_depth = 0;
 
+    BoundingBox m_bounds;
+    Vector3 m_scale;
+    std::uint32_t m_root = 0;
     std::vector<Node> m_nodes;
 
     std::vector<Vertex> m_vertices;
     std::vector<int> m_indices;
 
+    // what queries read, which is either the vectors above or a mapping
+    utility::ArrayView<Node> m_nodeView;
+    utility::ArrayView<Vertex> m_vertexView;
+    utility::ArrayView<int> m_indexView;
+    std::shared_ptr<utility::MappedFile> m_mapping;
+
+    // the three vertices of each face, in the order of the faces, gathered
+    // whenever the tree is built or copied from a stream.  the faces of a leaf
+    // are consecutive, so that its triangles are tested from one block of
+    // memory, rather than each through its indices.  a mapped tree does
+    // without, as it would cost as much memory as the mapping saves
+    std::vector<Vertex> m_faceVertices;
+
+    // only used during Build()
+    unsigned int m_freeNode = 0;
+    std::vector<BuildNode> m_buildNodes;
     std::vector<BoundingBox> m_faceBounds;
     std::vector<unsigned int> m_faceIndices;
 };
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace utility
+{
+// a read only view of contiguous elements held elsewhere, such as in a
+// vector or a mapped file, which must outlive the view
+template <typename T>
+class ArrayView
+{
+private:
+    const T* m_data;
+    size_t m_size;
+
+public:
+    ArrayView() : m_data(nullptr), m_size(0) {}
+    ArrayView(const T* data, size_t size) : m_data(data), m_size(size) {}
+    ArrayView(const std::vector<T>& vector)
+        : m_data(vector.data()), m_size(vector.size())
+    {
+    }
+
+    const T* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return !m_size; }
+
+    const T* begin() const { return m_data; }
+    const T* end() const { return m_data + m_size; }
+
+    const T& operator[](size_t index) const
+    {
+        assert(index < m_size);
+        return m_data[index];
+    }
+};
+} // namespace utility
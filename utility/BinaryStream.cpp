@@ -1,6 +1,7 @@
 #include "utility/BinaryStream.hpp"
 
 #include "utility/Exception.hpp"
+#include "utility/Trace.hpp"
 #include "utility/miniz.c"
 
 #include <algorithm>
@@ -18,11 +19,20 @@ BinaryStream::BinaryStream(
 {
 }
 
-BinaryStream::BinaryStream(std::vector<std::uint8_t>& buffer)
+BinaryStream::BinaryStream(std::vector<std::uint8_t>&& buffer)
     : m_buffer(std::move(buffer)), m_rpos(0), m_wpos(m_buffer.size())
 {
 }
 
+BinaryStream::BinaryStream(std::shared_ptr<MappedFile> mapping, size_t offset,
+                           size_t length)
+    : m_rpos(0), m_wpos(length), m_mapping(std::move(mapping)),
+      m_mappingOffset(offset)
+{
+    if (offset + length > m_mapping->size())
+        throw std::domain_error("View past end of mapping");
+}
+
 BinaryStream::BinaryStream(size_t length)
     : m_buffer(length), m_rpos(0), m_wpos(0)
 {
@@ -49,9 +59,12 @@ BinaryStream::BinaryStream(const std::filesystem::path& path)
 BinaryStream::BinaryStream(BinaryStream&& other) noexcept
     : m_buffer(std::move(other.m_buffer)),
       m_sharedBuffer(std::move(other.m_sharedBuffer)), m_rpos(other.m_rpos),
-      m_wpos(other.m_wpos)
+      m_wpos(other.m_wpos), m_mapping(std::move(other.m_mapping)),
+      m_mappingOffset(other.m_mappingOffset),
+      m_chunkDirectories(std::move(other.m_chunkDirectories))
 {
     other.m_rpos = other.m_wpos = 0;
+    other.m_chunkDirectories.clear();
 }
 
 BinaryStream& BinaryStream::operator=(BinaryStream&& other) noexcept
@@ -60,12 +73,36 @@ BinaryStream& BinaryStream::operator=(BinaryStream&& other) noexcept
         m_sharedBuffer = std::move(other.m_sharedBuffer);
     else
         m_buffer = std::move(other.m_buffer);
+    m_mapping = std::move(other.m_mapping);
+    m_mappingOffset = other.m_mappingOffset;
     m_rpos = other.m_rpos;
     m_wpos = other.m_wpos;
+    m_chunkDirectories = std::move(other.m_chunkDirectories);
     other.m_rpos = other.m_wpos = 0;
+    other.m_chunkDirectories.clear();
     return *this;
 }
 
+const std::uint8_t* BinaryStream::data() const
+{
+    if (m_mapping)
+        return m_mapping->data() + m_mappingOffset;
+
+    auto const buff = buffer();
+    return buff->empty() ? nullptr : &(*buff)[0];
+}
+
+size_t BinaryStream::size() const
+{
+    return m_mapping ? m_wpos : buffer()->size();
+}
+
+void BinaryStream::CheckWritable() const
+{
+    if (m_mapping)
+        throw std::domain_error("Write to read only stream");
+}
+
 std::string BinaryStream::ReadString()
 {
     std::string ret;
@@ -99,6 +136,10 @@ void BinaryStream::Write(size_t position, const void* data, size_t length)
     if (!length)
         return;
 
+    CheckWritable();
+
+    m_chunkDirectories.clear();
+
     auto const targetBuffer = buffer();
 
     if (position + length > targetBuffer->size())
@@ -121,10 +162,7 @@ void BinaryStream::WriteString(const std::string& str, size_t length)
 void BinaryStream::Append(const BinaryStream& other)
 {
     if (other.m_wpos > 0)
-    {
-        auto const sourceBuffer = other.buffer();
-        Write(&sourceBuffer->at(0), other.m_wpos);
-    }
+        Write(other.data(), other.m_wpos);
 }
 
 void BinaryStream::ReadBytes(void* dest, size_t length)
@@ -132,12 +170,18 @@ void BinaryStream::ReadBytes(void* dest, size_t length)
     if (length == 0)
         return;
 
-    auto const buff = buffer();
-    if (m_rpos + length > buff->size())
+    memcpy(dest, ReadInPlace(length), length);
+}
+
+const std::uint8_t* BinaryStream::ReadInPlace(size_t length)
+{
+    if (m_rpos + length > size())
         throw std::domain_error("Read past end of buffer");
 
-    memcpy(dest, &buff->at(m_rpos), length);
+    auto const result = data() + m_rpos;
     m_rpos += length;
+
+    return result;
 }
 
 bool BinaryStream::GetChunkLocation(const std::string& chunkName,
@@ -153,15 +197,16 @@ bool BinaryStream::GetChunkLocation(const std::string& chunkName,
 {
     size_t p = 0;
 
-    auto const buff = buffer();
+    auto const buff = data();
+    auto const length = size();
 
     // find first chunk of any type
-    for (size_t i = startLoc; i < buff->size(); ++i)
+    for (size_t i = startLoc; i < length; ++i)
     {
-        if ((i + 4) > buff->size())
+        if ((i + 4) > length)
             return false;
 
-        auto const currentChunk = &buff->at(i);
+        auto const currentChunk = &buff[i];
 
         if (VALID_CHUNK_CHAR(currentChunk[0]) &&
             VALID_CHUNK_CHAR(currentChunk[1]) &&
@@ -173,41 +218,86 @@ bool BinaryStream::GetChunkLocation(const std::string& chunkName,
         }
     }
 
-    for (auto i = p; i < buff->size();)
+    if (chunkName.length() < 4)
+        return false;
+
+    // the name as it is stored, which is reversed
+    auto const name = static_cast<std::uint32_t>(
+        static_cast<std::uint8_t>(chunkName[0]) << 24 |
+        static_cast<std::uint8_t>(chunkName[1]) << 16 |
+        static_cast<std::uint8_t>(chunkName[2]) << 8 |
+        static_cast<std::uint8_t>(chunkName[3]));
+
+    auto const find = [name, p, &result](const ChunkDirectory& directory)
     {
-        auto const currentChunk = &buff->at(i);
+        auto const chunks = directory.Chunks.find(name);
 
-        if (chunkName[0] == currentChunk[3] &&
-            chunkName[1] == currentChunk[2] &&
-            chunkName[2] == currentChunk[1] && chunkName[3] == currentChunk[0])
-        {
-            result = i;
-            return true;
-        }
+        if (chunks == directory.Chunks.end())
+            return false;
+
+        auto const location = std::lower_bound(chunks->second.begin(),
+                                               chunks->second.end(), p);
+
+        if (location == chunks->second.end())
+            return false;
 
-        auto const size =
-            *reinterpret_cast<const std::uint32_t*>(&buff->at(i + 4));
-        i += size + 8;
+        result = *location;
+        return true;
+    };
+
+    // hopping from a chunk already in a directory reaches the same chunks as
+    // the hops which built the directory, so the search is a lookup
+    for (auto const& directory : m_chunkDirectories)
+        if (std::binary_search(directory.Offsets.begin(),
+                               directory.Offsets.end(), p))
+            return find(directory);
+
+    ChunkDirectory directory;
+
+    for (auto i = p; i + 8 <= length;)
+    {
+        std::uint32_t header[2];
+        memcpy(header, &buff[i], sizeof(header));
+
+        directory.Offsets.push_back(i);
+        directory.Chunks[header[0]].push_back(i);
+
+        i += header[1] + 8;
     }
 
-    return false;
+    auto const found = find(directory);
+
+    if (m_chunkDirectories.size() < MAX_CHUNK_DIRECTORIES)
+        m_chunkDirectories.push_back(std::move(directory));
+
+    return found;
 }
 
 bool BinaryStream::IsEOF()
 {
-    auto const buff = buffer();
-    return m_rpos == buff->size();
+    return m_rpos == size();
+}
+
+std::shared_ptr<std::vector<std::uint8_t>> BinaryStream::Share()
+{
+    CheckWritable();
+
+    if (!m_sharedBuffer)
+        m_sharedBuffer =
+            std::make_shared<std::vector<std::uint8_t>>(std::move(m_buffer));
+
+    return m_sharedBuffer;
 }
 
-void BinaryStream::Compress()
+void BinaryStream::Compress(int level)
 {
     std::vector<std::uint8_t> buff(
         compressBound(static_cast<mz_ulong>(m_wpos)));
     auto newSize = static_cast<mz_ulong>(buff.size());
     auto const result =
-        compress(&buff[0], &newSize,
-                 reinterpret_cast<const unsigned char*>(&m_buffer[0]),
-                 static_cast<mz_ulong>(m_wpos));
+        compress2(&buff[0], &newSize,
+                  reinterpret_cast<const unsigned char*>(data()),
+                  static_cast<mz_ulong>(m_wpos), level);
 
     if (result != MZ_OK)
         THROW(Result::BINARYSTREAM_COMPRESS_FAILED);
@@ -216,16 +306,21 @@ void BinaryStream::Compress()
     buff.resize(m_wpos);
 
     m_buffer = std::move(buff);
+    m_sharedBuffer.reset();
+    m_mapping.reset();
     m_rpos = 0;
+    m_chunkDirectories.clear();
 }
 
 void BinaryStream::Decompress()
 {
+    Trace::Scope trace("BinaryStream::Decompress", "io");
+
     std::vector<std::uint8_t> buffer(m_wpos);
     mz_stream stream;
     memset(&stream, 0, sizeof(stream));
 
-    stream.next_in = &m_buffer[0];
+    stream.next_in = data();
     stream.avail_in = static_cast<unsigned int>(m_wpos);
     stream.next_out = &buffer[0];
     stream.avail_out = static_cast<unsigned int>(buffer.size());
@@ -263,6 +358,79 @@ void BinaryStream::Decompress()
 
     m_buffer = std::move(buffer);
     m_buffer.resize(m_wpos);
+    m_sharedBuffer.reset();
+    m_mapping.reset();
+    m_chunkDirectories.clear();
+}
+
+std::vector<std::uint8_t> BinaryStream::Inflate(const std::uint8_t* data,
+                                                size_t length,
+                                                size_t inflatedLength)
+{
+    std::vector<std::uint8_t> result(inflatedLength);
+
+    auto resultLength = static_cast<mz_ulong>(inflatedLength);
+    auto const status =
+        uncompress(result.empty() ? nullptr : &result[0], &resultLength, data,
+                   static_cast<mz_ulong>(length));
+
+    if (status != MZ_OK || resultLength != inflatedLength)
+        THROW(Result::MZ_INFLATE_FAILED);
+
+    return result;
+}
+
+void BinaryStream::Inflate(const std::uint8_t* data, size_t length,
+                           std::uint8_t* output, size_t inflatedLength,
+                           const std::function<void(size_t)>& consumed)
+{
+    // small enough that little of the input is resident at once, and large
+    // enough that releasing it costs nothing by comparison
+    constexpr size_t window = 1 << 20;
+
+    mz_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    stream.next_out = output;
+    stream.avail_out = static_cast<unsigned int>(inflatedLength);
+
+    if (mz_inflateInit(&stream) != MZ_OK)
+        THROW(Result::MZ_INFLATEINIT_FAILED);
+
+    size_t offset = 0;
+    int status = MZ_OK;
+
+    while (status != MZ_STREAM_END)
+    {
+        auto const available = (std::min)(window, length - offset);
+        auto const produced = stream.total_out;
+
+        stream.next_in = data + offset;
+        stream.avail_in = static_cast<unsigned int>(available);
+
+        status = mz_inflate(&stream, MZ_NO_FLUSH);
+
+        auto const used = available - stream.avail_in;
+        offset += used;
+
+        // without progress, the input is truncated or the output too small
+        if ((status != MZ_OK && status != MZ_STREAM_END) ||
+            (!used && stream.total_out == produced &&
+             status != MZ_STREAM_END))
+        {
+            mz_inflateEnd(&stream);
+            THROW(Result::MZ_INFLATE_FAILED);
+        }
+
+        if (consumed && used)
+            consumed(offset);
+    }
+
+    auto const total = static_cast<size_t>(stream.total_out);
+    mz_inflateEnd(&stream);
+
+    if (total != inflatedLength)
+        THROW(Result::MZ_INFLATE_FAILED);
 }
 
 BinaryStream& operator<<(BinaryStream& stream, const std::string& str)
@@ -273,13 +441,141 @@ BinaryStream& operator<<(BinaryStream& stream, const std::string& str)
 
 BinaryStream& operator<<(BinaryStream& stream, const BinaryStream& other)
 {
-    stream.Write(&other.m_buffer[0], other.wpos());
+    stream.Write(other.data(), other.wpos());
     return stream;
 }
 
 std::ostream& operator<<(std::ostream& stream, const BinaryStream& data)
 {
-    stream.write(reinterpret_cast<const char*>(&data.m_buffer[0]), data.m_wpos);
+    stream.write(reinterpret_cast<const char*>(data.data()), data.m_wpos);
+    return stream;
+}
+
+BinaryStream& BinaryRope::AppendOwned(size_t length)
+{
+    m_owned.emplace_back(length);
+    m_pieces.push_back(&m_owned.back());
+
+    return m_owned.back();
+}
+
+size_t BinaryRope::wpos() const
+{
+    size_t result = 0;
+
+    for (auto const piece : m_pieces)
+        result += piece->wpos();
+
+    return result;
+}
+
+std::uint32_t BinaryRope::Deflate(int level, bool last,
+                                  BinaryStream& out) const
+{
+    mz_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // negative window bits ask for raw deflate, without the zlib header
+    if (mz_deflateInit2(&stream, level, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS,
+                        9, MZ_DEFAULT_STRATEGY) != MZ_OK)
+        THROW(Result::BINARYSTREAM_COMPRESS_FAILED);
+
+    std::vector<std::uint8_t> buffer(64 * 1024);
+    auto adler = static_cast<mz_ulong>(MZ_ADLER32_INIT);
+    auto failed = false;
+
+    auto const feed = [&](const std::uint8_t* data, size_t length,
+                          int flush) {
+        stream.next_in = data;
+        stream.avail_in = static_cast<unsigned int>(length);
+
+        do
+        {
+            stream.next_out = &buffer[0];
+            stream.avail_out = static_cast<unsigned int>(buffer.size());
+
+            auto const status = mz_deflate(&stream, flush);
+
+            // a buffer error only means that there was nothing to do
+            if (status != MZ_OK && status != MZ_STREAM_END &&
+                status != MZ_BUF_ERROR)
+            {
+                failed = true;
+                return;
+            }
+
+            out.Write(&buffer[0], buffer.size() - stream.avail_out);
+        } while (stream.avail_out == 0);
+    };
+
+    ForEach([&](const std::uint8_t* data, size_t length) {
+        adler = mz_adler32(adler, data, length);
+
+        if (!failed)
+            feed(data, length, MZ_NO_FLUSH);
+    });
+
+    if (!failed)
+        feed(nullptr, 0, last ? MZ_FINISH : MZ_SYNC_FLUSH);
+
+    mz_deflateEnd(&stream);
+
+    if (failed)
+        THROW(Result::BINARYSTREAM_COMPRESS_FAILED);
+
+    return static_cast<std::uint32_t>(adler);
+}
+
+void BinaryRope::ZlibHeader(int level, BinaryStream& out)
+{
+    // deflate with a 32 KiB window, and the level as zlib reports it
+    constexpr std::uint8_t method = 0x78;
+
+    std::uint8_t flags = level < 0 || level == 6 ? 2 << 6
+                         : level < 2             ? 0
+                         : level < 6             ? 1 << 6
+                                                 : 3 << 6;
+
+    flags += 31 - (method * 256 + flags) % 31;
+
+    out << method << flags;
+}
+
+std::uint32_t BinaryRope::Adler32Combine(std::uint32_t first,
+                                         std::uint32_t second,
+                                         size_t secondLength)
+{
+    // as zlib's adler32_combine(), which miniz lacks
+    constexpr std::uint32_t base = 65521;
+
+    auto const remainder = static_cast<std::uint32_t>(secondLength % base);
+
+    std::uint32_t sum1 = first & 0xFFFF;
+    std::uint32_t sum2 =
+        static_cast<std::uint32_t>((std::uint64_t {remainder} * sum1) % base);
+
+    sum1 += (second & 0xFFFF) + base - 1;
+    sum2 += ((first >> 16) & 0xFFFF) + ((second >> 16) & 0xFFFF) + base -
+            remainder;
+
+    if (sum1 >= base)
+        sum1 -= base;
+    if (sum1 >= base)
+        sum1 -= base;
+    if (sum2 >= (base << 1))
+        sum2 -= (base << 1);
+    if (sum2 >= base)
+        sum2 -= base;
+
+    return sum1 | (sum2 << 16);
+}
+
+std::ostream& operator<<(std::ostream& stream, const BinaryRope& rope)
+{
+    rope.ForEach([&stream](const std::uint8_t* data, size_t length) {
+        stream.write(reinterpret_cast<const char*>(data), length);
+    });
+
     return stream;
 }
 } // namespace utility
\ No newline at end of file
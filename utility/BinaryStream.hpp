@@ -1,21 +1,40 @@
 #pragma once
 
+#include "utility/MappedFile.hpp"
+
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace utility
 {
+class BinaryRope;
+
 class BinaryStream
 {
 private:
     static constexpr size_t DEFAULT_BUFFER_LENGTH = 4096;
 
+    // how many chains of chunks are remembered by each stream
+    static constexpr size_t MAX_CHUNK_DIRECTORIES = 8;
+
+    // every chunk reached by hopping from one chunk to the next, starting
+    // from some chunk.  the offsets are in ascending order
+    struct ChunkDirectory
+    {
+        std::vector<size_t> Offsets;
+        std::unordered_map<std::uint32_t, std::vector<size_t>> Chunks;
+    };
+
+    friend class BinaryRope;
     friend std::ostream& operator<<(std::ostream&, const BinaryStream&);
     friend BinaryStream& operator<<(BinaryStream&, const BinaryStream&);
     friend BinaryStream& operator<<(BinaryStream&, const std::string&);
@@ -24,6 +43,14 @@ private:
     std::vector<std::uint8_t> m_buffer;
     size_t m_rpos, m_wpos;
 
+    // a mapping which is read in place, from the offset on, in which case
+    // there is no buffer and the stream may not be written to
+    std::shared_ptr<MappedFile> m_mapping;
+    size_t m_mappingOffset = 0;
+
+    // built as chunks are first searched for, and discarded when written to
+    mutable std::vector<ChunkDirectory> m_chunkDirectories;
+
     inline std::vector<std::uint8_t>* buffer()
     {
         return m_sharedBuffer ? m_sharedBuffer.get() : &m_buffer;
@@ -34,9 +61,21 @@ private:
         return m_sharedBuffer ? m_sharedBuffer.get() : &m_buffer;
     }
 
+    // the bytes which may be read, wherever they are held
+    const std::uint8_t* data() const;
+    size_t size() const;
+
+    void CheckWritable() const;
+
 public:
     BinaryStream(std::shared_ptr<std::vector<std::uint8_t>> sharedBuffer);
-    BinaryStream(std::vector<std::uint8_t>& buffer);
+    // takes the buffer without copying it
+    BinaryStream(std::vector<std::uint8_t>&& buffer);
+    // reads length bytes of the mapping, from the offset on, in place.  the
+    // stream holds the mapping, and so may outlive whoever created it, but may
+    // not be written to
+    BinaryStream(std::shared_ptr<MappedFile> mapping, size_t offset,
+                 size_t length);
     BinaryStream(size_t length = DEFAULT_BUFFER_LENGTH);
     BinaryStream(const std::filesystem::path& path);
     BinaryStream(BinaryStream&& other) noexcept;
@@ -86,6 +125,21 @@ public:
     void Write(size_t position, const void* data, size_t length);
     void ReadBytes(void* dest, size_t length);
 
+    // returns a pointer to the next length bytes, without copying them, and
+    // advances past them.  the pointer is valid until the stream is written
+    // to, or for a mapped stream, for as long as the mapping is alive
+    const std::uint8_t* ReadInPlace(size_t length);
+
+    // as above, but returning a cursor over the bytes, for decoding many
+    // values with a single check of the length
+    ByteCursor ReadCursor(size_t length)
+    {
+        return {ReadInPlace(length), length};
+    }
+
+    // the mapping which the stream reads in place, if it does
+    const std::shared_ptr<MappedFile>& GetMapping() const { return m_mapping; }
+
     std::string ReadString();
     std::string ReadString(size_t length);
 
@@ -104,8 +158,79 @@ public:
                           size_t& result) const;
     bool IsEOF();
 
-    void Compress();
+    // the buffer, which is shared from here on rather than owned by this
+    // stream alone, so that other streams may read it without copying it
+    std::shared_ptr<std::vector<std::uint8_t>> Share();
+
+    // zlib compression of the written bytes.  level runs from 0 (stored) to
+    // 9 (smallest), with -1 for zlib's default
+    void Compress(int level = -1);
     void Decompress();
+
+    // inflates zlib data whose inflated length is already known, without
+    // copying it into a stream first
+    static std::vector<std::uint8_t> Inflate(const std::uint8_t* data,
+                                             size_t length,
+                                             size_t inflatedLength);
+
+    // as above, but into output, which holds inflatedLength bytes, feeding
+    // the input a window at a time.  consumed(length) is called as each
+    // window has been inflated, with the length of the input consumed so far,
+    // so that the caller may release it
+    static void Inflate(const std::uint8_t* data, size_t length,
+                        std::uint8_t* output, size_t inflatedLength,
+                        const std::function<void(size_t)>& consumed);
+};
+
+// a sequence of streams written out one after another, as though they were
+// one, without their bytes ever being copied together.  streams appended by
+// reference must outlive the rope.  the bytes between them, such as headers,
+// lengths and padding, are written to small streams which the rope owns, and
+// which may still be written to after more has been appended
+class BinaryRope
+{
+private:
+    // a deque, so that the owned streams never move
+    std::deque<BinaryStream> m_owned;
+    std::vector<const BinaryStream*> m_pieces;
+
+public:
+    BinaryRope() = default;
+    BinaryRope(const BinaryRope&) = delete;
+    BinaryRope& operator=(const BinaryRope&) = delete;
+
+    void Append(const BinaryStream& stream) { m_pieces.push_back(&stream); }
+
+    // appends an empty stream of the rope's own, and returns it
+    BinaryStream& AppendOwned(size_t length = 64);
+
+    // the total of the written bytes of every piece
+    size_t wpos() const;
+
+    // compresses the written bytes into raw deflate blocks, appended to out,
+    // and returns their adler-32.  unless last, the blocks end with a sync
+    // flush, on a byte boundary, so that ropes compressed apart, even on
+    // different threads, may be concatenated into one zlib stream: the
+    // header from ZlibHeader(), the blocks in order with the last one last,
+    // and then the adler-32 of them all, from Adler32Combine(), big endian
+    std::uint32_t Deflate(int level, bool last, BinaryStream& out) const;
+
+    static void ZlibHeader(int level, BinaryStream& out);
+
+    // the adler-32 of two byte sequences one after the other, from that of
+    // each and the length of the second.  that of no bytes is one
+    static std::uint32_t Adler32Combine(std::uint32_t first,
+                                        std::uint32_t second,
+                                        size_t secondLength);
+
+    // calls visit(data, length) with the written bytes of each piece in turn
+    template <typename Visitor>
+    void ForEach(Visitor&& visit) const
+    {
+        for (auto const piece : m_pieces)
+            if (piece->m_wpos > 0)
+                visit(piece->data(), piece->m_wpos);
+    }
 };
 
 template <typename T>
@@ -132,4 +257,5 @@ std::ostream& operator<<(std::ostream&, const BinaryStream&);
 BinaryStream& operator<<(BinaryStream&, const BinaryStream&);
 BinaryStream& operator<<(BinaryStream&, const std::string&);
 std::ostream& operator<<(std::ostream& stream, const BinaryStream& data);
+std::ostream& operator<<(std::ostream& stream, const BinaryRope& rope);
 } // namespace utility
\ No newline at end of file
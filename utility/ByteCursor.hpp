@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace utility
+{
+// reads from a range of bytes which has already been checked against the end
+// of its buffer, so that the reads themselves are not checked, except by
+// assertion.  values are copied out rather than cast in place, since the
+// formats read this way do not align them, and a copy of a fixed size
+// compiles to a single load.  the bytes must outlive the cursor
+class ByteCursor
+{
+private:
+    const std::uint8_t* m_position;
+    const std::uint8_t* m_end;
+
+public:
+    ByteCursor(const std::uint8_t* data, size_t length)
+        : m_position(data), m_end(data + length)
+    {
+    }
+
+    template <typename T>
+    T Read()
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "T must be trivially copyable");
+        assert(Remaining() >= sizeof(T));
+
+        T result;
+        std::memcpy(&result, m_position, sizeof(T));
+        m_position += sizeof(T);
+
+        return result;
+    }
+
+    void Skip(size_t length)
+    {
+        assert(Remaining() >= length);
+        m_position += length;
+    }
+
+    size_t Remaining() const { return static_cast<size_t>(m_end - m_position); }
+};
+} // namespace utility
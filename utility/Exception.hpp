@@ -100,6 +100,10 @@ namespace {
                 return "Invalid doodad file";
             case Result::FAILED_TO_OPEN_GAMEOBJECT_FILE:
                 return "Failed to open gameobject file";
+            case Result::FAILED_TO_OPEN_OFF_MESH_CONNECTION_FILE:
+                return "Failed to open off-mesh connection file";
+            case Result::BAD_FORMAT_OF_OFF_MESH_CONNECTION_FILE:
+                return "Bad format of off-mesh connection file";
             case Result::UNRECOGNIZED_MODEL_EXTENSION:
                 return "Unrecognized model extension";
             case Result::GAME_OBJECT_REFERENCES_NON_EXISTENT_MODEL_ID:
@@ -146,6 +150,10 @@ namespace {
                 return "Incorrect WMO coordinates";
             case Result::DTNAVMESHQUERY_INIT_FAILED:
                 return "dtNavMeshQuery::init failed";
+            case Result::DTPATHCORRIDOR_INIT_FAILED:
+                return "dtPathCorridor::init failed";
+            case Result::DTCROWD_INIT_FAILED:
+                return "dtCrowd::init failed";
             case Result::UNKNOWN_WMO_INSTANCE_REQUESTED:
                 return "Unknown WMO instance requested";
             case Result::UNKNOWN_DOODAD_INSTANCE_REQUESTED:
@@ -164,6 +172,12 @@ namespace {
                 return "mz_inflateInit failed";
             case Result::MZ_INFLATE_FAILED:
                 return "mz_inflate failed";
+            case Result::FAILED_TO_MAP_FILE:
+                return "Failed to map file";
+            case Result::PATH_REQUEST_NOT_FINISHED:
+                return "Path request has not finished";
+            case Result::UNKNOWN_QUERY_FILTER:
+                return "Unknown query filter";
             case Result::INVALID_ROW_COLUMN_FROM_DBC:
                 return "Invalid row, column requested from DBC";
             case Result::GAMEOBJECT_WITH_SPECIFIED_GUID_ALREADY_EXISTS:
@@ -172,6 +186,36 @@ namespace {
                 return "Temporary WMO obstacles are not supported";
             case Result::NO_DOODAD_SET_SPECIFIED_FOR_WMO_GAME_OBJECT:
                 return "No doodad set specified for WMO game object";
+            case Result::INVALID_DOODAD_SET_FOR_WMO_GAME_OBJECT:
+                return "Invalid doodad set for WMO game object";
+            case Result::INVALID_SHARD:
+                return "Invalid shard";
+            case Result::UNKNOWN_NAV_COMPRESSION:
+                return "Unknown nav file compression";
+            case Result::UNKNOWN_JOB:
+                return "Unknown job";
+            case Result::INVALID_QUERY_RECORDING:
+                return "Invalid query recording";
+            case Result::BUILD_ALREADY_STARTED:
+                return "Build already started";
+            case Result::ALLOCATOR_ALREADY_INSTALLED:
+                return "Allocator already installed";
+            case Result::NO_POLYGON_NEAR_POSITION:
+                return "No navmesh polygon near position";
+            case Result::UNKNOWN_AGENT_SIZE:
+                return "Unknown agent size";
+            case Result::AGENT_SIZE_MISMATCH:
+                return "Nav files of different agent sizes";
+            case Result::UNKNOWN_REGION_PARTITION:
+                return "Unknown region partition";
+            case Result::REGION_PARTITION_MISMATCH:
+                return "Nav files of different region partitions";
+            case Result::ADT_LOAD_CANCELLED:
+                return "ADT load cancelled";
+            case Result::TILE_HAS_NO_HEIGHT_FIELD:
+                return "Tile has no height field from which to rebuild it";
+            case Result::INVALID_QUERY_LIMITS:
+                return "Invalid query limits";
 
             default:
                 return "Unknown error";
@@ -0,0 +1,270 @@
+#include "utility/MappedFile.hpp"
+
+#include "utility/Exception.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#ifdef WIN32
+#    include <Windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace utility
+{
+#ifdef WIN32
+MappedFile::MappedFile(const std::filesystem::path& path, size_t offset,
+                       size_t length)
+    : m_data(nullptr), m_size(0), m_view(nullptr), m_viewSize(0),
+      m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{
+    m_file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                           nullptr);
+
+    if (m_file == INVALID_HANDLE_VALUE)
+        THROW(Result::FAILED_TO_MAP_FILE).ErrorCode();
+
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(m_file, &size) ||
+        offset > static_cast<size_t>(size.QuadPart))
+    {
+        ::CloseHandle(m_file);
+        THROW(Result::FAILED_TO_MAP_FILE).ErrorCode();
+    }
+
+    auto const available = static_cast<size_t>(size.QuadPart) - offset;
+
+    if (length == WholeFile)
+        length = available;
+    else if (length > available)
+    {
+        ::CloseHandle(m_file);
+        THROW(Result::FAILED_TO_MAP_FILE);
+    }
+
+    m_size = length;
+
+    // an empty file cannot be mapped, but there is nothing to read either
+    if (!m_size)
+        return;
+
+    m_mapping =
+        ::CreateFileMappingW(m_file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+
+    if (!m_mapping)
+    {
+        ::CloseHandle(m_file);
+        THROW(Result::FAILED_TO_MAP_FILE).ErrorCode();
+    }
+
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+
+    auto const start = offset - offset % info.dwAllocationGranularity;
+    m_viewSize = m_size + (offset - start);
+
+    m_view = ::MapViewOfFile(m_mapping, FILE_MAP_COPY,
+                             static_cast<DWORD>(start >> 32),
+                             static_cast<DWORD>(start & 0xFFFFFFFF),
+                             m_viewSize);
+
+    if (!m_view)
+    {
+        ::CloseHandle(m_mapping);
+        ::CloseHandle(m_file);
+        THROW(Result::FAILED_TO_MAP_FILE).ErrorCode();
+    }
+
+    m_data = static_cast<std::uint8_t*>(m_view) + (offset - start);
+}
+
+MappedFile::MappedFile(std::vector<std::uint8_t>&& contents)
+    : m_data(nullptr), m_size(contents.size()), m_view(nullptr),
+      m_viewSize(0), m_contents(std::move(contents)),
+      m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{
+    if (m_size)
+        m_data = &m_contents[0];
+}
+
+MappedFile::MappedFile(size_t length)
+    : m_data(nullptr), m_size(length), m_view(nullptr), m_viewSize(0),
+      m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+{
+    if (!m_size)
+        return;
+
+    m_view = ::VirtualAlloc(nullptr, m_size, MEM_RESERVE | MEM_COMMIT,
+                            PAGE_READWRITE);
+
+    if (!m_view)
+        THROW(Result::FAILED_TO_MAP_FILE).ErrorCode();
+
+    m_viewSize = m_size;
+    m_data = static_cast<std::uint8_t*>(m_view);
+}
+
+MappedFile::~MappedFile()
+{
+    // a view without a mapping is an allocated block
+    if (m_view && !m_mapping)
+        ::VirtualFree(m_view, 0, MEM_RELEASE);
+    else if (m_view)
+        ::UnmapViewOfFile(m_view);
+    if (m_mapping)
+        ::CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        ::CloseHandle(m_file);
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path, size_t offset,
+                       size_t length)
+    : m_data(nullptr), m_size(0), m_view(nullptr), m_viewSize(0)
+{
+    auto const fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        THROW(Result::FAILED_TO_MAP_FILE);
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || offset > static_cast<size_t>(info.st_size))
+    {
+        ::close(fd);
+        THROW(Result::FAILED_TO_MAP_FILE);
+    }
+
+    auto const available = static_cast<size_t>(info.st_size) - offset;
+
+    if (length == WholeFile)
+        length = available;
+    else if (length > available)
+    {
+        ::close(fd);
+        THROW(Result::FAILED_TO_MAP_FILE);
+    }
+
+    m_size = length;
+
+    // an empty file cannot be mapped, but there is nothing to read either
+    if (m_size > 0)
+    {
+        auto const page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        auto const start = offset - offset % page;
+        m_viewSize = m_size + (offset - start);
+
+        auto const data =
+            ::mmap(nullptr, m_viewSize, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                   fd, static_cast<off_t>(start));
+
+        if (data == MAP_FAILED)
+        {
+            ::close(fd);
+            THROW(Result::FAILED_TO_MAP_FILE);
+        }
+
+        m_view = data;
+        m_data = static_cast<std::uint8_t*>(data) + (offset - start);
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+}
+
+MappedFile::MappedFile(std::vector<std::uint8_t>&& contents)
+    : m_data(nullptr), m_size(contents.size()), m_view(nullptr),
+      m_viewSize(0), m_contents(std::move(contents))
+{
+    if (m_size)
+        m_data = &m_contents[0];
+}
+
+MappedFile::MappedFile(size_t length)
+    : m_data(nullptr), m_size(length), m_view(nullptr), m_viewSize(0)
+{
+    if (!m_size)
+        return;
+
+    // anonymous pages are only zeroed by the system as they are first
+    // touched, which is when they are written
+    auto const data = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (data == MAP_FAILED)
+        THROW(Result::FAILED_TO_MAP_FILE);
+
+    m_view = data;
+    m_viewSize = m_size;
+    m_data = static_cast<std::uint8_t*>(data);
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_view)
+        ::munmap(m_view, m_viewSize);
+}
+#endif
+
+void MappedFile::Discard(size_t offset, size_t length) const
+{
+    if (!m_view || offset >= m_size)
+        return;
+
+    length = (std::min)(length, m_size - offset);
+
+#ifdef WIN32
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    auto const page = static_cast<size_t>(info.dwPageSize);
+#else
+    auto const page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+
+    auto const begin = reinterpret_cast<std::uintptr_t>(m_data + offset);
+    auto const end = reinterpret_cast<std::uintptr_t>(m_data + offset + length);
+
+    auto const first = (begin + page - 1) / page * page;
+    auto const last = end / page * page;
+
+    if (first >= last)
+        return;
+
+#ifdef WIN32
+    // unlocking pages which are not locked removes them from the working set
+    ::VirtualUnlock(reinterpret_cast<void*>(first), last - first);
+#else
+    ::madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+#endif
+}
+
+MappedStream::MappedStream(std::shared_ptr<MappedFile> file, size_t rpos)
+    : m_file(std::move(file)), m_rpos(rpos)
+{
+}
+
+void MappedStream::ReadBytes(void* dest, size_t length)
+{
+    if (length == 0)
+        return;
+
+    memcpy(dest, ReadInPlace(length), length);
+}
+
+std::uint8_t* MappedStream::ReadInPlace(size_t length)
+{
+    if (m_rpos + length > m_file->size())
+        throw std::domain_error("Read past end of buffer");
+
+    auto const result = m_file->data() + m_rpos;
+    m_rpos += length;
+
+    return result;
+}
+} // namespace utility
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "utility/ByteCursor.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace utility
+{
+// a copy-on-write mapping of an entire file.  writes made through data() are
+// private to this process and never reach the file, while pages which are
+// only ever read are shared with the operating system's file cache.  this
+// lets a consumer such as dtNavMesh::addTile(), which patches links into the
+// tile data, use the file contents in place.
+class MappedFile
+{
+private:
+    std::uint8_t* m_data;
+    size_t m_size;
+
+    // the pages which were mapped, which begin at or before m_data since a
+    // mapping must begin on a page boundary
+    void* m_view;
+    size_t m_viewSize;
+
+    // the contents, when they are held in memory rather than mapped
+    std::vector<std::uint8_t> m_contents;
+
+#ifdef WIN32
+    void* m_file;
+    void* m_mapping;
+#endif
+
+public:
+    // a length of WholeFile maps everything from the offset to the end
+    static constexpr size_t WholeFile = ~static_cast<size_t>(0);
+
+    MappedFile(const std::filesystem::path& path, size_t offset = 0,
+               size_t length = WholeFile);
+
+    // contents which did not come straight from a file, such as those of a
+    // file which was compressed, read as though they were mapped
+    MappedFile(std::vector<std::uint8_t>&& contents);
+
+    // as above, but an uninitialized block of the given length, for contents
+    // which are produced in place through data(), rather than in a vector
+    // which would first be filled with zeros
+    explicit MappedFile(size_t length);
+
+    MappedFile(const MappedFile&) = delete;
+    ~MappedFile();
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    // hints that the given range of a file mapping, which must never have
+    // been written to, will not be read again, so that its pages need not
+    // stay resident.  it still reads as before if it is.  only the pages
+    // wholly within the range are released
+    void Discard(size_t offset, size_t length) const;
+};
+
+// sequential reads from a mapped file, mirroring the read interface of
+// BinaryStream
+class MappedStream
+{
+private:
+    std::shared_ptr<MappedFile> m_file;
+    size_t m_rpos;
+
+public:
+    MappedStream(std::shared_ptr<MappedFile> file, size_t rpos = 0);
+
+    template <typename T>
+    T Read()
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "T must be trivially copyable");
+        static_assert(sizeof(T) <= 4,
+                      "Stack return read is meant only for small values");
+
+        T ret;
+        Read(ret);
+        return ret;
+    }
+
+    template <typename T>
+    void Read(T& out)
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "T must be trivially copyable");
+
+        ReadBytes(&out, sizeof(T));
+    }
+
+    void ReadBytes(void* dest, size_t length);
+
+    // returns a pointer to the next length bytes of the mapping, without
+    // copying them, and advances past them.  the pointer remains valid for as
+    // long as the mapping is alive
+    std::uint8_t* ReadInPlace(size_t length);
+
+    // as above, but returning a cursor over the bytes, for decoding many
+    // values with a single check of the length
+    ByteCursor ReadCursor(size_t length)
+    {
+        return {ReadInPlace(length), length};
+    }
+
+    // the bytes of the mapping from the read position on
+    size_t Remaining() const
+    {
+        return m_rpos < m_file->size() ? m_file->size() - m_rpos : 0;
+    }
+
+    size_t rpos() const { return m_rpos; }
+    void rpos(size_t pos) { m_rpos = pos; }
+
+    const std::shared_ptr<MappedFile>& file() const { return m_file; }
+};
+
+template <typename T>
+MappedStream& operator>>(MappedStream& stream, T& data)
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "T must be trivially copyable");
+
+    stream.Read(data);
+    return stream;
+}
+} // namespace utility
@@ -1,6 +1,7 @@
 #include "utility/MathHelper.hpp"
 
 #include "Common.hpp"
+#include "utility/Matrix.hpp"
 #include "utility/Vector.hpp"
 
 #include <algorithm>
@@ -160,6 +161,37 @@ void Convert::VerticesToRecast(const std::vector<Vector3>& input,
         VertexToRecast(input[i], &output[i * 3]);
 }
 
+void Convert::TransformToRecast(const std::vector<Vector3>& input,
+                                const Matrix& transform, float* output)
+{
+    assert(!!output);
+
+    // the rows of the matrix are read once, rather than once per vertex as
+    // Vector3::Transform() would, and the loop has no calls or aliasing so
+    // that the compiler may vectorize it
+    float m[16];
+    for (auto r = 0; r < 4; ++r)
+        for (auto c = 0; c < 4; ++c)
+            m[r * 4 + c] = transform[r][c];
+
+    auto const count = input.size();
+    auto const in = input.data();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto const x = in[i].X, y = in[i].Y, z = in[i].Z;
+
+        auto const rx = m[0] * x + m[1] * y + m[2] * z + m[3];
+        auto const ry = m[4] * x + m[5] * y + m[6] * z + m[7];
+        auto const rz = m[8] * x + m[9] * y + m[10] * z + m[11];
+        auto const w = 1.f / (m[12] * x + m[13] * y + m[14] * z + m[15]);
+
+        output[i * 3 + 0] = -ry * w;
+        output[i * 3 + 1] = rz * w;
+        output[i * 3 + 2] = -rx * w;
+    }
+}
+
 void Convert::VertexToWow(const float* input, Vector3& output)
 {
     // this is necessary in case input = output
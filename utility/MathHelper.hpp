@@ -7,6 +7,8 @@
 
 namespace math
 {
+class Matrix;
+
 class MathHelper
 {
 public:
@@ -46,6 +48,11 @@ public:
     static void VerticesToRecast(const std::vector<Vector3>& input,
                                  std::vector<float>& output);
 
+    // transforms the vertices and converts them to recast space in one pass,
+    // writing three floats for each to output, which must have room for them
+    static void TransformToRecast(const std::vector<Vector3>& input,
+                                  const Matrix& transform, float* output);
+
     static void VertexToWow(const float* input, Vector3& output);
     static void VerticesToWow(const float* input, int vertexCount,
                               std::vector<Vector3>& output);
@@ -4,38 +4,20 @@
 #include "utility/Exception.hpp"
 #include "utility/Quaternion.hpp"
 
-#include <cassert>
 #include <cmath>
 #include <ostream>
 
 namespace math
 {
-Matrix::Matrix(int rows, int columns)
-    : m_rows(rows), m_columns(columns), m_matrix(rows * columns)
+Matrix::Matrix() : m_matrix {}
 {
 }
 
-float* Matrix::operator[](int row)
-{
-    if (row >= m_rows)
-        THROW(Result::BAD_MATRIX_ROW);
-
-    return &m_matrix[m_columns * row];
-}
-
-const float* Matrix::operator[](int row) const
-{
-    if (row >= m_rows)
-        THROW(Result::BAD_MATRIX_ROW);
-
-    return &m_matrix[m_columns * row];
-}
-
 // taken from:
 // https://github.com/radekp/qt/blob/master/src/gui/math3d/qmatrix4x4.cpp#L1066
 Matrix Matrix::CreateRotation(Vector3 direction, float radians)
 {
-    Matrix ret(4, 4);
+    Matrix ret;
 
     const float c = cosf(radians);
     const float ic = 1.f - c;
@@ -58,7 +40,7 @@ Matrix Matrix::CreateRotation(Vector3 direction, float radians)
 
 Matrix Matrix::CreateScalingMatrix(float scale)
 {
-    Matrix ret(4, 4);
+    Matrix ret;
 
     for (int y = 0; y < 4; ++y)
         for (int x = 0; x < 4; ++x)
@@ -73,7 +55,7 @@ Matrix Matrix::CreateScalingMatrix(float scale)
 // taken from: http://www.flipcode.com/documents/matrfaq.html#Q54
 Matrix Matrix::CreateFromQuaternion(const Quaternion& q)
 {
-    Matrix ret(4, 4);
+    Matrix ret;
 
     const float xx = q.X * q.X;
     const float xy = q.X * q.Y;
@@ -108,7 +90,7 @@ Matrix Matrix::CreateFromQuaternion(const Quaternion& q)
 // taken from MaiN's XNA Math lib
 Matrix Matrix::CreateTranslationMatrix(const math::Vector3& position)
 {
-    Matrix ret(4, 4);
+    Matrix ret;
 
     for (int y = 0; y < 4; ++y)
         for (int x = 0; x < 4; ++x)
@@ -134,7 +116,7 @@ Matrix Matrix::CreateViewMatrix(const math::Vector3& eye,
     const float yDotEye = Vector3::DotProduct(v_y, eye);
     const float zDotEye = Vector3::DotProduct(v_z, eye);
 
-    Matrix ret(4, 4);
+    Matrix ret;
 
     ret[0][0] = v_x.X;
     ret[0][1] = v_y.X;
@@ -160,7 +142,7 @@ Matrix Matrix::CreateViewMatrix(const math::Vector3& eye,
 Matrix Matrix::CreateProjectionMatrix(float fovy, float aspect, float zNear,
                                       float zFar)
 {
-    Matrix ret(4, 4);
+    Matrix ret;
 
     for (int y = 0; y < 4; ++y)
         for (int x = 0; x < 4; ++x)
@@ -180,30 +162,29 @@ Matrix Matrix::CreateProjectionMatrix(float fovy, float aspect, float zNear,
 
 Matrix Matrix::CreateFromArray(const float* in, int count)
 {
-    const int len = static_cast<int>(sqrt(count));
-    assert(len * len == count);
+    if (count != Size * Size)
+        THROW(Result::ONLY_4X4_MATRIX_IS_SUPPORTED);
 
-    Matrix ret(len, len);
+    Matrix ret;
 
-    memcpy(&ret.m_matrix[0], in, sizeof(float) * count);
+    memcpy(ret.m_matrix, in, sizeof(ret.m_matrix));
 
     return ret;
 }
 
 Matrix operator*(const Matrix& a, const Matrix& b)
 {
-    if (a.m_columns != b.m_rows)
-        THROW(Result::INVALID_MATRIX_MULTIPLICATION);
-
-    Matrix ret(a.m_rows, b.m_columns);
+    Matrix ret;
 
-    for (int r = 0; r < a.m_rows; ++r)
-        for (int c = 0; c < b.m_columns; ++c)
+    for (int r = 0; r < Matrix::Size; ++r)
+        for (int c = 0; c < Matrix::Size; ++c)
         {
-            ret[r][c] = 0.f;
+            float sum = 0.f;
 
-            for (int i = 0; i < a.m_columns; ++i)
-                ret[r][c] += a[r][i] * b[i][c];
+            for (int i = 0; i < Matrix::Size; ++i)
+                sum += a[r][i] * b[i][c];
+
+            ret[r][c] = sum;
         }
 
     return ret;
@@ -212,10 +193,10 @@ Matrix operator*(const Matrix& a, const Matrix& b)
 Matrix Matrix::Transposed() const
 {
     const Matrix& m = *this;
-    Matrix ret(m_rows, m_columns);
+    Matrix ret;
 
-    for (int r = 0; r < m_rows; ++r)
-        for (int c = 0; c < m_columns; ++c)
+    for (int r = 0; r < Size; ++r)
+        for (int c = 0; c < Size; ++c)
             ret[r][c] = m[c][r];
     return ret;
 }
@@ -236,9 +217,6 @@ float Determinant3x3(const Matrix& m, int col0, int col1, int col2, int row0,
 
 float Matrix::ComputeDeterminant() const
 {
-    if (m_columns != 4 || m_rows != 4)
-        THROW(Result::ONLY_4X4_MATRIX_IS_SUPPORTED);
-
     const Matrix& m = *this;
 
     float det;
@@ -252,9 +230,6 @@ float Matrix::ComputeDeterminant() const
 
 Matrix Matrix::ComputeInverse() const
 {
-    if (m_columns != 4 || m_rows != 4)
-        THROW(Result::ONLY_4X4_MATRIX_IS_SUPPORTED);
-
     float det = ComputeDeterminant();
     if (fabs(det) < 9e-7f)
     {
@@ -264,7 +239,7 @@ Matrix Matrix::ComputeInverse() const
     det = 1.0f / det;
     const Matrix& m = *this;
 
-    Matrix inv(4, 4);
+    Matrix inv;
     inv[0][0] = Determinant3x3(m, 1, 2, 3, 1, 2, 3) * det;
     inv[1][0] = -Determinant3x3(m, 0, 2, 3, 1, 2, 3) * det;
     inv[2][0] = Determinant3x3(m, 0, 1, 3, 1, 2, 3) * det;
@@ -286,7 +261,7 @@ Matrix Matrix::ComputeInverse() const
 
 utility::BinaryStream& operator<<(utility::BinaryStream& o, const Matrix& m)
 {
-    o.Write(&m.m_matrix[0], sizeof(float) * m.m_matrix.size());
+    o.Write(m.m_matrix, sizeof(m.m_matrix));
     return o;
 }
 } // namespace math
\ No newline at end of file
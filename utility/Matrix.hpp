@@ -7,7 +7,6 @@
 #include <cstring>
 #include <iostream>
 #include <ostream>
-#include <vector>
 
 #ifndef PI
 #    define PI 3.14159264f
@@ -18,32 +17,36 @@ namespace math
 class BinaryStream;
 struct Quaternion;
 
-class Matrix
+// every transform in namigator is a 4x4 matrix, so that is the only shape
+// supported.  the elements are stored inline, in row major order, so copying or
+// transforming by a matrix never allocates.
+class alignas(16) Matrix
 {
 private:
-    int m_rows;
-    int m_columns;
-    std::vector<float> m_matrix;
+    static constexpr int Size = 4;
+
+    float m_matrix[Size * Size];
 
 public:
-    Matrix(int rows = 0, int columns = 0);
+    // all elements are zero
+    Matrix();
 
     // printing
     void Print(std::ostream& s = std::cout) const
     {
-        s << m_rows << " x " << m_columns << std::endl;
+        s << Size << " x " << Size << std::endl;
 
-        for (int r = 0; r < m_rows; ++r)
+        for (int r = 0; r < Size; ++r)
         {
-            for (int c = 0; c < m_columns; ++c)
-                s << m_matrix[r * m_columns + c] << " ";
+            for (int c = 0; c < Size; ++c)
+                s << m_matrix[r * Size + c] << " ";
 
             s << std::endl;
         }
     }
 
-    float* operator[](int row);
-    const float* operator[](int row) const;
+    float* operator[](int row) { return &m_matrix[Size * row]; }
+    const float* operator[](int row) const { return &m_matrix[Size * row]; }
 
     static Matrix CreateRotationX(float radians)
     {
@@ -66,6 +69,7 @@ public:
                                    const Vector3& up);
     static Matrix CreateProjectionMatrix(float fovy, float aspect, float zNear,
                                          float zFar);
+    // count must be 16
     static Matrix CreateFromArray(const float* in, int count);
 
     Matrix Transposed() const;
@@ -79,7 +83,7 @@ public:
 
     void PopulateArray(float* out) const
     {
-        ::memcpy(out, &m_matrix[0], m_matrix.size() * sizeof(float));
+        ::memcpy(out, m_matrix, sizeof(m_matrix));
     }
 };
 
@@ -6,6 +6,38 @@
 
 namespace math
 {
+Ray::Ray(const Vector3& start, const Vector3& end)
+    : m_startPoint(start), m_endPoint(end), m_vector(end - start),
+      m_direction(Vector3::Normalize(m_vector)), m_length(m_vector.Length())
+{
+    for (auto axis = 0; axis < 3; ++axis)
+    {
+        auto d = m_vector[axis];
+        if (fabsf(d) < 1e-20f)
+            d = d < 0.f ? -1e-20f : 1e-20f;
+
+        m_inverseVector[axis] = 1.f / d;
+        m_sign[axis] = m_inverseVector[axis] < 0.f ? 1 : 0;
+    }
+
+    // the watertight test works in a space where the ray runs along +z
+    auto const absX = fabsf(m_vector.X);
+    auto const absY = fabsf(m_vector.Y);
+    auto const absZ = fabsf(m_vector.Z);
+
+    m_kz = absX > absY ? (absX > absZ ? 0 : 2) : (absY > absZ ? 1 : 2);
+    m_kx = (m_kz + 1) % 3;
+    m_ky = (m_kx + 1) % 3;
+
+    // preserve the winding of the triangles
+    if (m_vector[m_kz] < 0.f)
+        std::swap(m_kx, m_ky);
+
+    m_shearX = m_vector[m_kx] / m_vector[m_kz];
+    m_shearY = m_vector[m_ky] / m_vector[m_kz];
+    m_shearZ = 1.f / m_vector[m_kz];
+}
+
 void Ray::SetHitPoint(float distance)
 {
     assert(distance >= 0.0f);
@@ -19,92 +51,89 @@ bool Ray::IntersectTriangle(const Vector3* verts, float* distance) const
     return IntersectTriangle(verts[0], verts[1], verts[2], distance);
 }
 
+// watertight ray/triangle intersection, from Woop, Benthin and Wald, "Watertight
+// Ray/Triangle Intersection", JCGT 2013.  rays passing exactly along a shared
+// edge or through a shared vertex always hit at least one of the triangles.
+// like the test this replaces, only triangles facing the ray are hit.
 bool Ray::IntersectTriangle(const Vector3& p0, const Vector3& p1,
                             const Vector3& p2, float* distance) const
 {
-    // To increase precision for very small world scales
-    constexpr float upscaleFactor = 100.0f;
-
-    Vector3 rayDir = GetDirection() * upscaleFactor;
-    Vector3 v0 = p0 * upscaleFactor;
-    Vector3 v1 = p1 * upscaleFactor - v0;
-    Vector3 v2 = p2 * upscaleFactor - v0;
-
-    Vector3 p = Vector3::CrossProduct(rayDir, v2);
-    float det = Vector3::DotProduct(v1, p);
-
-    if (det < 1e-5)
+    auto const a = p0 - m_startPoint;
+    auto const b = p1 - m_startPoint;
+    auto const c = p2 - m_startPoint;
+
+    auto const ax = a[m_kx] - m_shearX * a[m_kz];
+    auto const ay = a[m_ky] - m_shearY * a[m_kz];
+    auto const bx = b[m_kx] - m_shearX * b[m_kz];
+    auto const by = b[m_ky] - m_shearY * b[m_kz];
+    auto const cx = c[m_kx] - m_shearX * c[m_kz];
+    auto const cy = c[m_ky] - m_shearY * c[m_kz];
+
+    auto u = cx * by - cy * bx;
+    auto v = ax * cy - ay * cx;
+    auto w = bx * ay - by * ax;
+
+    // on an edge, fall back to double precision to decide which side it is
+    if (u == 0.f || v == 0.f || w == 0.f)
     {
-        return false;
+        u = static_cast<float>(static_cast<double>(cx) * by -
+                               static_cast<double>(cy) * bx);
+        v = static_cast<float>(static_cast<double>(ax) * cy -
+                               static_cast<double>(ay) * cx);
+        w = static_cast<float>(static_cast<double>(bx) * ay -
+                               static_cast<double>(by) * ax);
     }
 
-    Vector3 t = m_startPoint * upscaleFactor - v0;
-    float e1 = Vector3::DotProduct(t, p) / det;
-
-    if (e1 < 0.0f || e1 > 1.0f)
-    {
+    if (u < 0.f || v < 0.f || w < 0.f)
         return false;
-    }
-
-    Vector3 q = Vector3::CrossProduct(t, v1);
-    float e2 = Vector3::DotProduct(rayDir, q) / det;
 
-    if (e2 < 0.0f || (e1 + e2) > 1.0f)
-    {
+    auto const det = u + v + w;
+    if (det == 0.f)
         return false;
-    }
 
-    float d = Vector3::DotProduct(v2, q) / det;
-    if (d < 1e-5)
-    {
+    auto const az = m_shearZ * a[m_kz];
+    auto const bz = m_shearZ * b[m_kz];
+    auto const cz = m_shearZ * c[m_kz];
+
+    // the distance, scaled by det
+    auto const t = u * az + v * bz + w * cz;
+    if (t <= 0.f)
         return false;
-    }
 
     if (distance)
-    {
-        *distance = d / GetLength();
-    }
+        *distance = t / det;
+
     return true;
 }
 
 bool Ray::IntersectBoundingBox(const BoundingBox& bbox, float* distance) const
 {
-    Vector3 rayDir = GetDirection();
-    Vector3 invDir {/* x = */ 1.0f / rayDir.X,
-                    /* y = */ 1.0f / rayDir.Y,
-                    /* z = */ 1.0f / rayDir.Z};
-
-    Vector3 minimum = bbox.getMinimum();
-    Vector3 maximum = bbox.getMaximum();
-
-    float t1 = (minimum.X - m_startPoint.X) * invDir.X;
-    float t2 = (maximum.X - m_startPoint.X) * invDir.X;
-    float t3 = (minimum.Y - m_startPoint.Y) * invDir.Y;
-    float t4 = (maximum.Y - m_startPoint.Y) * invDir.Y;
-    float t5 = (minimum.Z - m_startPoint.Z) * invDir.Z;
-    float t6 = (maximum.Z - m_startPoint.Z) * invDir.Z;
-
-    float tmin = std::max(std::max(std::min(t1, t2), std::min(t3, t4)),
-                          std::min(t5, t6));
-    float tmax = std::min(std::min(std::max(t1, t2), std::max(t3, t4)),
-                          std::max(t5, t6));
-
-    // if tmax < 0, ray (line) is intersecting AABB, but whole AABB is behind us
-    if (tmax < 0)
+    const Vector3* const corners[2] = {&bbox.MinCorner, &bbox.MaxCorner};
+
+    // distances are measured as a fraction of the ray's length, the sign of
+    // each axis selecting which plane is entered first
+    float tmin = std::numeric_limits<float>::lowest();
+    float tmax = std::numeric_limits<float>::max();
+
+    for (auto axis = 0; axis < 3; ++axis)
     {
-        return false;
+        auto const nearPlane = (*corners[m_sign[axis]])[axis];
+        auto const farPlane = (*corners[1 - m_sign[axis]])[axis];
+
+        tmin = (std::max)(tmin, (nearPlane - m_startPoint[axis]) *
+                                    m_inverseVector[axis]);
+        tmax = (std::min)(tmax, (farPlane - m_startPoint[axis]) *
+                                    m_inverseVector[axis]);
     }
 
-    // if tmin > tmax, ray doesn't intersect AABB
-    if (tmin > tmax)
-    {
+    // if tmax < 0, ray (line) is intersecting AABB, but whole AABB is behind
+    // us.  if tmin > tmax, ray doesn't intersect AABB
+    if (tmax < 0 || tmin > tmax)
         return false;
-    }
 
     if (distance)
-    {
-        *distance = tmin / GetLength();
-    }
+        *distance = tmin;
+
     return true;
 }
-} // namespace math
\ No newline at end of file
+} // namespace math
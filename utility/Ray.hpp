@@ -3,15 +3,14 @@
 #include "utility/BoundingBox.hpp"
 #include "utility/Vector.hpp"
 
+#include <cstdint>
+
 namespace math
 {
 class Ray
 {
 public:
-    Ray(const Vector3& start, const Vector3& end)
-        : m_startPoint(start), m_endPoint(end)
-    {
-    }
+    Ray(const Vector3& start, const Vector3& end);
 
     Ray() = default;
     ~Ray() = default;
@@ -27,11 +26,15 @@ public:
                               float* distance = 0) const;
 
 public:
-    float GetLength() const { return GetVector().Length(); }
+    float GetLength() const { return m_length; }
+
+    const Vector3& GetVector() const { return m_vector; }
 
-    Vector3 GetVector() const { return m_endPoint - m_startPoint; }
+    const Vector3& GetDirection() const { return m_direction; }
 
-    Vector3 GetDirection() const { return Vector3::Normalize(GetVector()); }
+    // the reciprocal of each component of GetVector().  components which are
+    // zero are treated as tiny instead, so that this is always finite
+    const Vector3& GetInverseVector() const { return m_inverseVector; }
 
     Vector3 GetHitPoint() const
     {
@@ -50,6 +53,23 @@ private:
     Vector3 m_startPoint;
     Vector3 m_endPoint;
 
+    // everything below is derived from the start and end points once, rather
+    // than for every box and triangle tested
+    Vector3 m_vector;
+    Vector3 m_direction;
+    Vector3 m_inverseVector;
+    float m_length = 0.f;
+
+    // whether each component of the inverse vector is negative, which selects
+    // the near and far planes of a box along that axis
+    std::uint8_t m_sign[3] = {};
+
+    // the axis along which the ray is longest, the two axes which follow it,
+    // and the shear which maps the ray onto that axis, for the watertight
+    // triangle test
+    std::uint8_t m_kx = 0, m_ky = 1, m_kz = 2;
+    float m_shearX = 0.f, m_shearY = 0.f, m_shearZ = 0.f;
+
     float m_hitDistance = 1.0f;
 };
-} // namespace math
\ No newline at end of file
+} // namespace math
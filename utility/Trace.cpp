@@ -0,0 +1,128 @@
+#include "Trace.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+namespace utility
+{
+namespace
+{
+struct Event
+{
+    const char* m_name;
+    const char* m_category;
+    std::uint32_t m_thread;
+    int m_x;
+    int m_y;
+
+    // nanoseconds since tracing began
+    std::int64_t m_start;
+    std::int64_t m_duration;
+};
+
+std::atomic<bool> Tracing {false};
+
+// events are coarse, such as reading a file or building a tile, so a single
+// lock around them is not contended enough to matter
+std::mutex EventMutex;
+std::vector<Event> Events;
+std::chrono::steady_clock::time_point Epoch;
+
+// chrome traces identify threads by number, and small sequential ones are
+// easier to read than those of the operating system
+std::uint32_t ThreadId()
+{
+    static std::atomic<std::uint32_t> nextId {1};
+    thread_local auto const id = nextId++;
+
+    return id;
+}
+} // namespace
+
+Trace::Scope::Scope(const char* name, const char* category, int x, int y)
+    : m_name(name), m_category(category), m_x(x), m_y(y),
+      m_enabled(Tracing.load(std::memory_order_relaxed))
+{
+    if (m_enabled)
+        m_start = std::chrono::steady_clock::now();
+}
+
+Trace::Scope::~Scope()
+{
+    if (!m_enabled)
+        return;
+
+    auto const stop = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(EventMutex);
+
+    // the trace may have been started again since this began
+    if (m_start < Epoch)
+        return;
+
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    Events.push_back({m_name, m_category, ThreadId(), m_x, m_y,
+                      duration_cast<nanoseconds>(m_start - Epoch).count(),
+                      duration_cast<nanoseconds>(stop - m_start).count()});
+}
+
+void Trace::Start()
+{
+    std::lock_guard<std::mutex> guard(EventMutex);
+
+    Events.clear();
+    Epoch = std::chrono::steady_clock::now();
+    Tracing = true;
+}
+
+void Trace::Stop()
+{
+    Tracing = false;
+}
+
+bool Trace::Enabled()
+{
+    return Tracing.load(std::memory_order_relaxed);
+}
+
+bool Trace::Save(const std::string& path)
+{
+    std::ofstream out(path, std::ios::trunc);
+
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> guard(EventMutex);
+
+    // complete ("X") events, timed in microseconds
+    out << "{\"traceEvents\":[";
+    out << std::fixed << std::setprecision(3);
+
+    for (auto i = 0u; i < Events.size(); ++i)
+    {
+        auto const& event = Events[i];
+
+        out << (i ? ",\n" : "\n") << "{\"name\":\"" << event.m_name
+            << "\",\"cat\":\"" << event.m_category
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.m_thread
+            << ",\"ts\":" << event.m_start / 1000.0
+            << ",\"dur\":" << event.m_duration / 1000.0;
+
+        if (event.m_x >= 0 || event.m_y >= 0)
+            out << ",\"args\":{\"x\":" << event.m_x << ",\"y\":" << event.m_y
+                << "}";
+
+        out << "}";
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return !!out;
+}
+} // namespace utility
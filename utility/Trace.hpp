@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace utility
+{
+// scoped events which, while tracing, are collected in memory to be saved as
+// a chrome trace, for viewing in chrome://tracing or perfetto.  this shows
+// where each thread spends its time, including the gaps where it waits.
+// while not tracing, a scope costs a relaxed load.
+class Trace
+{
+public:
+    // records the time from its construction to its destruction as one event,
+    // if tracing when constructed.  the name and category must be literals,
+    // or otherwise outlive the trace.  x and y are recorded as arguments of
+    // the event when not negative, such as the coordinates of a tile
+    class Scope
+    {
+    private:
+        const char* const m_name;
+        const char* const m_category;
+        const int m_x;
+        const int m_y;
+        const bool m_enabled;
+        std::chrono::steady_clock::time_point m_start;
+
+    public:
+        Scope(const char* name, const char* category, int x = -1,
+              int y = -1);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // discards any events collected so far, and begins collecting
+    static void Start();
+    static void Stop();
+    static bool Enabled();
+
+    // writes the events collected so far as chrome trace json, returning
+    // false if the file could not be written
+    static bool Save(const std::string& path);
+};
+} // namespace utility
@@ -31,19 +31,17 @@ Vector3 Vector3::Normalize(const Vector3& a)
 
 Vector3 Vector3::Transform(const Vector3& position, const Matrix& matrix)
 {
-    Matrix Vector3Vector(4, 1);
-
-    Vector3Vector[0][0] = position.X;
-    Vector3Vector[1][0] = position.Y;
-    Vector3Vector[2][0] = position.Z;
-    Vector3Vector[3][0] = 1.0f;
-
-    // multiply matrix by column std::vector matrix
-    const Matrix newVector = matrix * Vector3Vector;
-
-    float w = 1.0f / newVector[3][0];
-    return Vector3(newVector[0][0] * w, newVector[1][0] * w,
-                   newVector[2][0] * w);
+    // multiply matrix by the column vector (x, y, z, 1)
+    float result[4];
+    for (int r = 0; r < 4; ++r)
+    {
+        auto const row = matrix[r];
+        result[r] = row[0] * position.X + row[1] * position.Y +
+                    row[2] * position.Z + row[3];
+    }
+
+    float w = 1.0f / result[3];
+    return Vector3(result[0] * w, result[1] * w, result[2] * w);
 }
 
 Vector3& Vector3::operator+=(const Vector3& other)